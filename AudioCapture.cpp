@@ -0,0 +1,241 @@
+//------------------------------------------------------------------------------
+// <copyright file="AudioCapture.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "KinectTypes.h"
+#include <chrono>
+#include "AudioCapture.h"
+
+/// <summary>
+/// Constructor
+/// </summary>
+/// <param name="nChunkSamples">number of samples requested per read</param>
+/// <param name="nMaxChunksPerWakeup">most reads per wake-up before giving up on the backlog</param>
+AudioCapture::AudioCapture(UINT nChunkSamples, UINT nMaxChunksPerWakeup) :
+    m_pSource(nullptr),
+    m_pSink(nullptr),
+    m_nIntervalMs(0),
+    m_nChunkSamples(nChunkSamples),
+    m_nMaxChunksPerWakeup(nMaxChunksPerWakeup),
+    m_audioBuffer(nChunkSamples),
+    m_bStopping(false),
+    m_nWakeups(0),
+    m_nChunksRead(0),
+    m_nSamplesRead(0),
+    m_nUnderruns(0),
+    m_nOverruns(0),
+    m_nReadErrors(0),
+    m_nBacklogChunks(0),
+    m_nMaxBacklogChunks(0),
+    m_nVadHops(0),
+    m_nVadSpeechHops(0),
+    m_nVadVoiceHops(0),
+    m_nVadOnsets(0)
+{
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+AudioCapture::~AudioCapture()
+{
+    Stop();
+}
+
+/// <summary>
+/// Starts the capture thread
+/// </summary>
+/// <param name="pSource">audio to capture; must outlive the capture</param>
+/// <param name="pSink">optional tap receiving the raw chunks; must outlive the capture</param>
+/// <param name="nIntervalMs">time between wake-ups in milliseconds</param>
+/// <returns>indicates success or failure</returns>
+HRESULT AudioCapture::Start(IAudioSampleSource* pSource, IAudioChunkSink* pSink, int nIntervalMs)
+{
+    if (nullptr == pSource || nIntervalMs <= 0)
+    {
+        return E_INVALIDARG;
+    }
+
+    if (m_thread.joinable())
+    {
+        return E_UNEXPECTED;
+    }
+
+    m_pSource = pSource;
+    m_pSink = pSink;
+    m_nIntervalMs = nIntervalMs;
+    m_bStopping = false;
+    m_thread = std::thread(&AudioCapture::CaptureThread, this);
+
+    return S_OK;
+}
+
+/// <summary>
+/// Stops the capture thread and waits for it to exit
+/// </summary>
+void AudioCapture::Stop()
+{
+    if (m_thread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_bStopping = true;
+        }
+        m_wakeup.notify_all();
+        m_thread.join();
+    }
+}
+
+/// <summary>
+/// Snapshot of the capture counters
+/// </summary>
+/// <param name="pStats">receives the counters</param>
+void AudioCapture::GetStats(AudioCaptureStats* pStats) const
+{
+    pStats->nWakeups = m_nWakeups;
+    pStats->nChunksRead = m_nChunksRead;
+    pStats->nSamplesRead = m_nSamplesRead;
+    pStats->nUnderruns = m_nUnderruns;
+    pStats->nOverruns = m_nOverruns;
+    pStats->nReadErrors = m_nReadErrors;
+    pStats->nBacklogChunks = m_nBacklogChunks;
+    pStats->nMaxBacklogChunks = m_nMaxBacklogChunks;
+}
+
+/// <summary>
+/// Snapshot of the voice activity counters, as of the latest chunk
+/// </summary>
+/// <param name="pStats">receives the counters</param>
+void AudioCapture::GetVoiceActivityStats(VoiceActivityStats* pStats) const
+{
+    pStats->nHops = m_nVadHops;
+    pStats->nSpeechHops = m_nVadSpeechHops;
+    pStats->nVoiceHops = m_nVadVoiceHops;
+    pStats->nOnsets = m_nVadOnsets;
+}
+
+/// <summary>
+/// Feeds a chunk of audio through the sink, voice activity detector, energy meter and
+/// counters. Like the beam state, the voice state is taken once per chunk, as of its end.
+/// The capture thread feeds every chunk it reads through here; audio obtained elsewhere
+/// may only be fed while the thread is not running.
+/// </summary>
+/// <param name="nTime">time of the first sample, in 100ns ticks</param>
+/// <param name="pSamples">beam audio samples</param>
+/// <param name="nSampleCount">number of samples</param>
+/// <param name="fBeamAngle">beam angle in radians</param>
+/// <param name="fBeamAngleConfidence">beam angle confidence in the range [0,1]</param>
+void AudioCapture::ProcessChunk(INT64 nTime, const float* pSamples, UINT nSampleCount, float fBeamAngle, float fBeamAngleConfidence)
+{
+    if (m_pSink)
+    {
+        m_pSink->OnAudioChunk(nTime, pSamples, nSampleCount, fBeamAngle, fBeamAngleConfidence);
+    }
+
+    m_voiceActivity.Process(pSamples, nSampleCount);
+
+    VoiceActivityStats voiceActivity;
+    m_voiceActivity.GetStats(&voiceActivity);
+    m_nVadHops = voiceActivity.nHops;
+    m_nVadSpeechHops = voiceActivity.nSpeechHops;
+    m_nVadVoiceHops = voiceActivity.nVoiceHops;
+    m_nVadOnsets = voiceActivity.nOnsets;
+
+    m_nOverruns += m_energyMeter.Process(nTime, pSamples, nSampleCount, fBeamAngle, fBeamAngleConfidence,
+        m_voiceActivity.IsVoiceActive(), m_voiceActivity.GetSpeechToNoiseDb(), &m_energyRing);
+    m_nChunksRead++;
+    m_nSamplesRead += nSampleCount;
+}
+
+/// <summary>
+/// Wakes up every m_nIntervalMs, on schedule rather than after the work, and drains the source
+/// </summary>
+void AudioCapture::CaptureThread()
+{
+    // COM calls made by the source run in the process' implicit multithreaded apartment
+    std::chrono::steady_clock::time_point nextWakeup = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while (!m_bStopping)
+    {
+        lock.unlock();
+        DrainPendingAudio();
+        lock.lock();
+
+        nextWakeup += std::chrono::milliseconds(m_nIntervalMs);
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (nextWakeup < now)
+        {
+            // we fell behind; don't try to catch up with a burst of wake-ups
+            nextWakeup = now;
+        }
+
+        m_wakeup.wait_until(lock, nextWakeup, [this]() { return m_bStopping; });
+    }
+}
+
+/// <summary>
+/// Reads every pending chunk from the source, rather than a single fixed-size buffer
+/// </summary>
+void AudioCapture::DrainPendingAudio()
+{
+    UINT32 nFullChunks = 0;
+    bool bReadAnything = false;
+    HRESULT hr = S_OK;
+
+    m_nWakeups++;
+
+    for (UINT iChunk = 0; iChunk < m_nMaxChunksPerWakeup; ++iChunk)
+    {
+        UINT nRead = 0;
+        INT64 nTime = 0;
+
+        // S_OK is returned when the buffer was filled, E_PENDING when less audio was
+        // pending. For both return codes we process the audio written into the buffer.
+        hr = m_pSource->Read(&m_audioBuffer[0], m_nChunkSamples, &nRead, &nTime);
+
+        if (FAILED(hr) && hr != E_PENDING)
+        {
+            m_nReadErrors++;
+            break;
+        }
+
+        if (nRead > 0)
+        {
+            float fBeamAngle = 0.f;
+            float fBeamAngleConfidence = 0.f;
+
+            // Get most recent audio beam angle and confidence
+            m_pSource->GetBeam(&fBeamAngle, &fBeamAngleConfidence);
+
+            ProcessChunk(nTime, &m_audioBuffer[0], nRead, fBeamAngle, fBeamAngleConfidence);
+            bReadAnything = true;
+        }
+
+        if (S_OK != hr)
+        {
+            break;
+        }
+
+        nFullChunks++;
+    }
+
+    if (S_OK == hr && nFullChunks == m_nMaxChunksPerWakeup)
+    {
+        // still more audio pending than we are allowed to drain per wake-up
+        m_nOverruns++;
+    }
+
+    if (!bReadAnything && E_PENDING == hr)
+    {
+        m_nUnderruns++;
+    }
+
+    m_nBacklogChunks = nFullChunks;
+    if (nFullChunks > m_nMaxBacklogChunks)
+    {
+        m_nMaxBacklogChunks = nFullChunks;
+    }
+}
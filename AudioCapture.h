@@ -0,0 +1,176 @@
+//------------------------------------------------------------------------------
+// <copyright file="AudioCapture.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Drains beam audio on its own thread at a fixed cadence, independently of the
+// video loop, and publishes the energy and beam history through an EnergyRing.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "KinectTypes.h"
+#include "AudioEnergy.h"
+#include "VoiceActivity.h"
+
+/// <summary>
+/// Source of beam audio polled by the capture thread
+/// </summary>
+class IAudioSampleSource
+{
+public:
+    virtual ~IAudioSampleSource() {}
+
+    /// <summary>
+    /// Reads pending audio without blocking
+    /// </summary>
+    /// <param name="pSamples">receives the samples</param>
+    /// <param name="nMaxSamples">capacity of pSamples</param>
+    /// <param name="pnRead">receives the number of samples read</param>
+    /// <param name="pnTime">receives the time of the first sample read, in 100ns ticks on the
+    /// clock of the frames the audio is matched against</param>
+    /// <returns>S_OK if pSamples was filled and more audio may be pending, E_PENDING if
+    /// fewer samples were available, else the failure code</returns>
+    virtual HRESULT Read(float* pSamples, UINT nMaxSamples, UINT* pnRead, INT64* pnTime) = 0;
+
+    /// <summary>
+    /// Reads the current beam state
+    /// </summary>
+    /// <param name="pfBeamAngle">receives the beam angle in radians</param>
+    /// <param name="pfBeamAngleConfidence">receives the beam angle confidence in the range [0,1]</param>
+    virtual void GetBeam(float* pfBeamAngle, float* pfBeamAngleConfidence) = 0;
+};
+
+/// <summary>
+/// Receives every chunk of raw audio the capture thread reads, on that thread
+/// </summary>
+class IAudioChunkSink
+{
+public:
+    virtual ~IAudioChunkSink() {}
+
+    virtual void OnAudioChunk(INT64 nTime, const float* pSamples, UINT nSampleCount, float fBeamAngle, float fBeamAngleConfidence) = 0;
+};
+
+struct AudioCaptureStats
+{
+    // Times the capture thread woke up
+    UINT64              nWakeups;
+
+    // Chunks and samples read
+    UINT64              nChunksRead;
+    UINT64              nSamplesRead;
+
+    // Wake-ups that found no audio at all (E_PENDING with nothing read)
+    UINT64              nUnderruns;
+
+    // Wake-ups that had to leave audio behind, plus energy values the video side
+    // did not consume in time
+    UINT64              nOverruns;
+
+    // Reads that failed outright
+    UINT64              nReadErrors;
+
+    // Full chunks drained by the latest wake-up, and the most seen in one wake-up
+    UINT32              nBacklogChunks;
+    UINT32              nMaxBacklogChunks;
+};
+
+class AudioCapture
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    /// <param name="nChunkSamples">number of samples requested per read</param>
+    /// <param name="nMaxChunksPerWakeup">most reads per wake-up before giving up on the backlog</param>
+    AudioCapture(UINT nChunkSamples, UINT nMaxChunksPerWakeup);
+
+    /// <summary>
+    /// Destructor
+    /// </summary>
+    ~AudioCapture();
+
+    /// <summary>
+    /// Starts the capture thread
+    /// </summary>
+    /// <param name="pSource">audio to capture; must outlive the capture</param>
+    /// <param name="pSink">optional tap receiving the raw chunks; must outlive the capture</param>
+    /// <param name="nIntervalMs">time between wake-ups in milliseconds</param>
+    /// <returns>indicates success or failure</returns>
+    HRESULT Start(IAudioSampleSource* pSource, IAudioChunkSink* pSink, int nIntervalMs);
+
+    /// <summary>
+    /// Stops the capture thread and waits for it to exit
+    /// </summary>
+    void Stop();
+
+    /// <summary>
+    /// Feeds a chunk of audio through the sink, voice activity detector, energy meter and
+    /// counters. The capture thread feeds every chunk it reads through here; audio obtained
+    /// elsewhere, e.g. from a replayed session, may only be fed while the thread is not running.
+    /// </summary>
+    /// <param name="nTime">time of the first sample, in 100ns ticks</param>
+    /// <param name="pSamples">beam audio samples</param>
+    /// <param name="nSampleCount">number of samples</param>
+    /// <param name="fBeamAngle">beam angle in radians</param>
+    /// <param name="fBeamAngleConfidence">beam angle confidence in the range [0,1]</param>
+    void ProcessChunk(INT64 nTime, const float* pSamples, UINT nSampleCount, float fBeamAngle, float fBeamAngleConfidence);
+
+    /// <summary>
+    /// Energy and beam history produced by the capture thread; the caller is the only consumer
+    /// </summary>
+    EnergyRing* GetEnergyRing() { return &m_energyRing; }
+
+    /// <summary>
+    /// Snapshot of the capture counters
+    /// </summary>
+    /// <param name="pStats">receives the counters</param>
+    void GetStats(AudioCaptureStats* pStats) const;
+
+    /// <summary>
+    /// Snapshot of the voice activity counters, as of the latest chunk
+    /// </summary>
+    /// <param name="pStats">receives the counters</param>
+    void GetVoiceActivityStats(VoiceActivityStats* pStats) const;
+
+private:
+    void CaptureThread();
+    void DrainPendingAudio();
+
+    IAudioSampleSource*     m_pSource;
+    IAudioChunkSink*        m_pSink;
+    int                     m_nIntervalMs;
+    UINT                    m_nChunkSamples;
+    UINT                    m_nMaxChunksPerWakeup;
+    std::vector<float>      m_audioBuffer;
+    VoiceActivityDetector   m_voiceActivity;
+    AudioEnergyMeter        m_energyMeter;
+    EnergyRing              m_energyRing;
+
+    std::thread             m_thread;
+    std::mutex              m_mutex;
+    std::condition_variable m_wakeup;
+    bool                    m_bStopping;
+
+    std::atomic<UINT64>     m_nWakeups;
+    std::atomic<UINT64>     m_nChunksRead;
+    std::atomic<UINT64>     m_nSamplesRead;
+    std::atomic<UINT64>     m_nUnderruns;
+    std::atomic<UINT64>     m_nOverruns;
+    std::atomic<UINT64>     m_nReadErrors;
+    std::atomic<UINT32>     m_nBacklogChunks;
+    std::atomic<UINT32>     m_nMaxBacklogChunks;
+
+    // Counters of the voice activity detector, published after every chunk for readers
+    // on other threads; the detector's own are only the feeding thread's
+    std::atomic<UINT64>     m_nVadHops;
+    std::atomic<UINT64>     m_nVadSpeechHops;
+    std::atomic<UINT64>     m_nVadVoiceHops;
+    std::atomic<UINT64>     m_nVadOnsets;
+};
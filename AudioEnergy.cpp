@@ -0,0 +1,367 @@
+//------------------------------------------------------------------------------
+// <copyright file="AudioEnergy.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "KinectTypes.h"
+#include <float.h>
+#include <math.h>
+#include <string.h>
+#include "CpuFeatures.h"
+#include "PerfClock.h"
+#include "AudioEnergy.h"
+
+// Duration of one audio sample in 100ns ticks
+static const INT64 c_TicksPerAudioSample = c_TicksPerSecond / c_AudioSamplesPerSecond;
+
+// Number of block sums computed per kernel call
+static const UINT c_BlocksPerBatch = 64;
+
+/// <summary>
+/// Block energy kernel, one sequential float sum per block as the original loop did
+/// </summary>
+static void SumSquaresPerBlockScalar(const float* pSamples, UINT nBlocks, float* pSums)
+{
+    for (UINT iBlock = 0; iBlock < nBlocks; ++iBlock)
+    {
+        const float* pBlock = pSamples + iBlock * c_AudioSamplesPerEnergySample;
+        float fSum = 0.0f;
+
+        for (int i = 0; i < c_AudioSamplesPerEnergySample; ++i)
+        {
+            fSum += pBlock[i] * pBlock[i];
+        }
+
+        pSums[iBlock] = fSum;
+    }
+}
+
+#if defined(CPU_X86)
+
+/// <summary>
+/// Block energy kernel, four lanes per block
+/// </summary>
+static void SumSquaresPerBlockSse(const float* pSamples, UINT nBlocks, float* pSums)
+{
+    for (UINT iBlock = 0; iBlock < nBlocks; ++iBlock)
+    {
+        const float* pBlock = pSamples + iBlock * c_AudioSamplesPerEnergySample;
+        __m128 sum = _mm_setzero_ps();
+        int i = 0;
+
+        for (; i + 4 <= c_AudioSamplesPerEnergySample; i += 4)
+        {
+            __m128 x = _mm_loadu_ps(pBlock + i);
+            sum = _mm_add_ps(sum, _mm_mul_ps(x, x));
+        }
+
+        // fold the lanes: (0+2, 1+3), then (0+2)+(1+3)
+        sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+        sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+        float fSum = _mm_cvtss_f32(sum);
+
+        for (; i < c_AudioSamplesPerEnergySample; ++i)
+        {
+            fSum += pBlock[i] * pBlock[i];
+        }
+
+        pSums[iBlock] = fSum;
+    }
+}
+
+/// <summary>
+/// Block energy kernel, eight lanes per block with fused multiply-add
+/// </summary>
+CPU_TARGET_AVX2
+static void SumSquaresPerBlockAvx2(const float* pSamples, UINT nBlocks, float* pSums)
+{
+    for (UINT iBlock = 0; iBlock < nBlocks; ++iBlock)
+    {
+        const float* pBlock = pSamples + iBlock * c_AudioSamplesPerEnergySample;
+        __m256 sum = _mm256_setzero_ps();
+        int i = 0;
+
+        for (; i + 8 <= c_AudioSamplesPerEnergySample; i += 8)
+        {
+            __m256 x = _mm256_loadu_ps(pBlock + i);
+            sum = _mm256_fmadd_ps(x, x, sum);
+        }
+
+        __m128 half = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+        half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+        half = _mm_add_ss(half, _mm_shuffle_ps(half, half, 1));
+        float fSum = _mm_cvtss_f32(half);
+
+        for (; i < c_AudioSamplesPerEnergySample; ++i)
+        {
+            fSum += pBlock[i] * pBlock[i];
+        }
+
+        pSums[iBlock] = fSum;
+    }
+}
+
+#endif
+
+/// <summary>
+/// Fastest energy kernel the processor supports
+/// </summary>
+EnergyKernel GetBestEnergyKernel()
+{
+    static const EnergyKernel s_kernel =
+        IsEnergyKernelSupported(EnergyKernel_Avx2) ? EnergyKernel_Avx2 :
+        IsEnergyKernelSupported(EnergyKernel_Sse) ? EnergyKernel_Sse :
+        EnergyKernel_Scalar;
+
+    return s_kernel;
+}
+
+/// <summary>
+/// Whether the processor supports an energy kernel
+/// </summary>
+/// <param name="kernel">kernel to check</param>
+bool IsEnergyKernelSupported(EnergyKernel kernel)
+{
+    switch (kernel)
+    {
+    case EnergyKernel_Scalar:
+        return true;
+
+#if defined(CPU_X86)
+    case EnergyKernel_Sse:
+        return CpuHasSse2();
+
+    case EnergyKernel_Avx2:
+        return CpuHasAvx2();
+#endif
+
+    default:
+        return false;
+    }
+}
+
+/// <summary>
+/// Short name of an energy kernel, for reports
+/// </summary>
+/// <param name="kernel">kernel to name</param>
+const char* GetEnergyKernelName(EnergyKernel kernel)
+{
+    static const char* c_szNames[EnergyKernel_Count] = { "scalar", "sse", "avx2" };
+    return (kernel >= 0 && kernel < EnergyKernel_Count) ? c_szNames[kernel] : "unknown";
+}
+
+/// <summary>
+/// Computes the sum of squares of consecutive blocks of c_AudioSamplesPerEnergySample samples
+/// </summary>
+/// <param name="kernel">kernel to use; must be supported</param>
+/// <param name="pSamples">audio samples, no alignment required</param>
+/// <param name="nBlocks">number of whole blocks in pSamples</param>
+/// <param name="pSums">receives one sum per block</param>
+void SumSquaresPerBlock(EnergyKernel kernel, const float* pSamples, UINT nBlocks, float* pSums)
+{
+    switch (kernel)
+    {
+#if defined(CPU_X86)
+    case EnergyKernel_Avx2:
+        SumSquaresPerBlockAvx2(pSamples, nBlocks, pSums);
+        break;
+
+    case EnergyKernel_Sse:
+        SumSquaresPerBlockSse(pSamples, nBlocks, pSums);
+        break;
+#endif
+
+    default:
+        SumSquaresPerBlockScalar(pSamples, nBlocks, pSums);
+        break;
+    }
+}
+
+/// <summary>
+/// Converts a power ratio to dB without calling log10; the result is within 1e-4 dB of
+/// 10*log10(fPower) for normal positive inputs
+/// </summary>
+/// <param name="fPower">power ratio, greater than zero</param>
+/// <returns>power in dB</returns>
+float PowerToDecibels(float fPower)
+{
+    if (!(fPower >= FLT_MIN))
+    {
+        // denormals (and anything odd) are rare enough to take the slow path
+        return 10.0f * log10(fPower);
+    }
+
+    // split into 2^nExponent * fMantissa with fMantissa in [sqrt(1/2), sqrt(2))
+    UINT32 nBits;
+    memcpy(&nBits, &fPower, sizeof(nBits));
+    int nExponent = static_cast<int>((nBits >> 23) & 0xFF) - 127;
+    nBits = (nBits & 0x007FFFFF) | 0x3F800000;
+
+    float fMantissa;
+    memcpy(&fMantissa, &nBits, sizeof(fMantissa));
+    if (fMantissa > 1.41421356f)
+    {
+        fMantissa *= 0.5f;
+        nExponent++;
+    }
+
+    // ln(m) = 2 atanh(t) with t = (m-1)/(m+1), |t| < 0.172; the series is truncated
+    // after t^7, leaving a relative error below 1e-7
+    float t = (fMantissa - 1.0f) / (fMantissa + 1.0f);
+    float t2 = t * t;
+    float fLn = 2.0f * t * (1.0f + t2 * (1.0f / 3.0f + t2 * (1.0f / 5.0f + t2 * (1.0f / 7.0f))));
+
+    // 10*log10(x) = 10*log10(2)*e + 10*log10(e)*ln(m)
+    return 3.01029996f * nExponent + 4.34294482f * fLn;
+}
+
+/// <summary>
+/// Copies the newest values of a circular energy buffer, oldest first, into a window
+/// that the energy display draws from
+/// </summary>
+/// <param name="pBuffer">circular buffer of energy values</param>
+/// <param name="nBufferLength">length of the circular buffer</param>
+/// <param name="nEndIndex">index one past the newest value to copy</param>
+/// <param name="pWindow">receives the values</param>
+/// <param name="nWindowLength">number of values to copy, at most nBufferLength</param>
+void CopyEnergyWindow(const float* pBuffer, int nBufferLength, int nEndIndex, float* pWindow, int nWindowLength)
+{
+    // the values wrap around the end of the circular buffer at most once
+    int nBaseIndex = (nEndIndex + nBufferLength - nWindowLength) % nBufferLength;
+    int nUntilEnd = nBufferLength - nBaseIndex;
+
+    if (nUntilEnd > nWindowLength)
+    {
+        memcpy(pWindow, pBuffer + nBaseIndex, nWindowLength * sizeof(float));
+    }
+    else
+    {
+        memcpy(pWindow, pBuffer + nBaseIndex, nUntilEnd * sizeof(float));
+        memcpy(pWindow + nUntilEnd, pBuffer, (nWindowLength - nUntilEnd) * sizeof(float));
+    }
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+/// <param name="kernel">energy kernel to use; must be supported</param>
+AudioEnergyMeter::AudioEnergyMeter(EnergyKernel kernel) :
+    m_kernel(kernel),
+    m_fAccumulatedSquareSum(0.0f),
+    m_nAccumulatedSampleCount(0),
+    m_nSequence(0)
+{
+}
+
+/// <summary>
+/// Accumulates beam audio into energy values and publishes each completed value,
+/// together with the beam state, to the ring
+/// </summary>
+/// <param name="nTime">time of the first sample, in 100ns ticks</param>
+/// <param name="pSamples">beam audio samples</param>
+/// <param name="nSampleCount">number of samples</param>
+/// <param name="fBeamAngle">beam angle in radians</param>
+/// <param name="fBeamAngleConfidence">beam angle confidence in the range [0,1]</param>
+/// <param name="bVoiceActive">whether voice is active as of the samples</param>
+/// <param name="fSpeechToNoiseDb">level of the speech bands above their noise floors, in dB</param>
+/// <param name="pRing">ring to publish the energy values to</param>
+/// <returns>number of energy values that did not fit in the ring</returns>
+UINT AudioEnergyMeter::Process(INT64 nTime, const float* pSamples, UINT nSampleCount, float fBeamAngle, float fBeamAngleConfidence, bool bVoiceActive, float fSpeechToNoiseDb, EnergyRing* pRing)
+{
+    UINT nDropped = 0;
+    UINT i = 0;
+    INT64 nCaptureNs = GetPerfClockNs();
+
+    // Complete the block left over from the previous read one sample at a time
+    if (m_nAccumulatedSampleCount > 0)
+    {
+        for (; i < nSampleCount && m_nAccumulatedSampleCount < c_AudioSamplesPerEnergySample; ++i)
+        {
+            m_fAccumulatedSquareSum += pSamples[i] * pSamples[i];
+            ++m_nAccumulatedSampleCount;
+        }
+
+        if (m_nAccumulatedSampleCount == c_AudioSamplesPerEnergySample)
+        {
+            if (!Publish(m_fAccumulatedSquareSum, nTime + (i - 1) * c_TicksPerAudioSample, nCaptureNs, fBeamAngle, fBeamAngleConfidence, bVoiceActive, fSpeechToNoiseDb, pRing))
+            {
+                nDropped++;
+            }
+
+            m_fAccumulatedSquareSum = 0.f;
+            m_nAccumulatedSampleCount = 0;
+        }
+    }
+
+    // Whole blocks go through the kernel in batches
+    float fSums[c_BlocksPerBatch];
+    UINT nBlocks = (nSampleCount - i) / c_AudioSamplesPerEnergySample;
+
+    while (nBlocks > 0)
+    {
+        UINT nBatch = (nBlocks < c_BlocksPerBatch) ? nBlocks : c_BlocksPerBatch;
+        SumSquaresPerBlock(m_kernel, pSamples + i, nBatch, fSums);
+
+        for (UINT iBlock = 0; iBlock < nBatch; ++iBlock)
+        {
+            i += c_AudioSamplesPerEnergySample;
+            if (!Publish(fSums[iBlock], nTime + (i - 1) * c_TicksPerAudioSample, nCaptureNs, fBeamAngle, fBeamAngleConfidence, bVoiceActive, fSpeechToNoiseDb, pRing))
+            {
+                nDropped++;
+            }
+        }
+
+        nBlocks -= nBatch;
+    }
+
+    // Carry the start of the next block over to the next read
+    for (; i < nSampleCount; ++i)
+    {
+        m_fAccumulatedSquareSum += pSamples[i] * pSamples[i];
+        ++m_nAccumulatedSampleCount;
+    }
+
+    return nDropped;
+}
+
+/// <summary>
+/// Turns the sum of squares of one block into an energy value and publishes it
+/// </summary>
+/// <returns>false if the value did not fit in the ring</returns>
+bool AudioEnergyMeter::Publish(float fSquareSum, INT64 nTime, INT64 nCaptureNs, float fBeamAngle, float fBeamAngleConfidence, bool bVoiceActive, float fSpeechToNoiseDb, EnergyRing* pRing)
+{
+    // Each energy value will represent the logarithm of the mean of the
+    // sum of squares of a group of audio samples.
+    float fMeanSquare = fSquareSum / c_AudioSamplesPerEnergySample;
+
+    if (fMeanSquare > 1.0f)
+    {
+        // A loud audio source right next to the sensor may result in mean square values
+        // greater than 1.0. Cap it at 1.0f for display purposes.
+        fMeanSquare = 1.0f;
+    }
+
+    float fEnergy = c_MinEnergy;
+    if (fMeanSquare > 0.f)
+    {
+        // Convert to dB
+        fEnergy = PowerToDecibels(fMeanSquare);
+    }
+
+    // Publish to the video side without ever waiting on it; if the consumer
+    // falls a whole ring behind the value is dropped and counted.
+    EnergySample sample;
+    sample.nTime = nTime;
+    sample.nCaptureNs = nCaptureNs;
+    sample.nSequence = m_nSequence++;
+
+    // Renormalize signal above noise floor to [0,1] range for visualization.
+    sample.fEnergy = (c_MinEnergy - fEnergy) / c_MinEnergy;
+    sample.fBeamAngle = fBeamAngle;
+    sample.fBeamAngleConfidence = fBeamAngleConfidence;
+    sample.bVoiceActive = bVoiceActive ? 1 : 0;
+    sample.fSpeechToNoiseDb = fSpeechToNoiseDb;
+
+    return pRing->TryPush(sample);
+}
@@ -0,0 +1,154 @@
+//------------------------------------------------------------------------------
+// <copyright file="AudioEnergy.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Audio energy values as handed from the audio producer to the video side
+
+#pragma once
+
+#include "KinectTypes.h"
+#include "SpscRing.h"
+
+// Audio samples per second in Kinect audio stream
+static const int c_AudioSamplesPerSecond = 16000;
+
+// Number of audio samples captured from Kinect audio stream accumulated into a single
+// energy measurement that will get displayed.
+static const int c_AudioSamplesPerEnergySample = 40;
+
+// Minimum energy of audio to display (in dB value, where 0 dB is full scale)
+static const int c_MinEnergy = -90;
+
+// Number of energy samples the producer can run ahead of the consumer before values are dropped
+static const size_t c_EnergyRingCapacity = 1024;
+
+/// <summary>
+/// One energy value together with the beam state it was computed under
+/// </summary>
+struct EnergySample
+{
+    // Time of the last audio sample the value was computed from, in 100ns ticks
+    INT64               nTime;
+
+    // GetPerfClockNs time the audio the value was computed from was handed to the meter
+    INT64               nCaptureNs;
+
+    // Running count of energy values produced, lets the consumer detect gaps
+    UINT32              nSequence;
+
+    // Energy renormalized above the noise floor to the [0,1] range
+    float               fEnergy;
+
+    // Beam angle in radians
+    float               fBeamAngle;
+
+    // Beam angle confidence in the range [0,1]
+    float               fBeamAngleConfidence;
+
+    // Nonzero if voice was active in the beam audio as of the value, and the level of
+    // the speech bands above their noise floors, in dB; see VoiceActivityDetector
+    UINT32              bVoiceActive;
+    float               fSpeechToNoiseDb;
+};
+
+typedef SpscRing<EnergySample, c_EnergyRingCapacity> EnergyRing;
+
+// Implementations of the block energy kernel, slowest first
+enum EnergyKernel
+{
+    EnergyKernel_Scalar = 0,
+    EnergyKernel_Sse = 1,
+    EnergyKernel_Avx2 = 2,
+    EnergyKernel_Count = 3
+};
+
+/// <summary>
+/// Fastest energy kernel the processor supports
+/// </summary>
+EnergyKernel GetBestEnergyKernel();
+
+/// <summary>
+/// Whether the processor supports an energy kernel
+/// </summary>
+/// <param name="kernel">kernel to check</param>
+bool IsEnergyKernelSupported(EnergyKernel kernel);
+
+/// <summary>
+/// Short name of an energy kernel, for reports
+/// </summary>
+/// <param name="kernel">kernel to name</param>
+const char* GetEnergyKernelName(EnergyKernel kernel);
+
+/// <summary>
+/// Computes the sum of squares of consecutive blocks of c_AudioSamplesPerEnergySample samples
+/// </summary>
+/// <param name="kernel">kernel to use; must be supported</param>
+/// <param name="pSamples">audio samples, no alignment required</param>
+/// <param name="nBlocks">number of whole blocks in pSamples</param>
+/// <param name="pSums">receives one sum per block</param>
+void SumSquaresPerBlock(EnergyKernel kernel, const float* pSamples, UINT nBlocks, float* pSums);
+
+/// <summary>
+/// Converts a power ratio to dB without calling log10; the result is within 1e-4 dB of
+/// 10*log10(fPower) for normal positive inputs
+/// </summary>
+/// <param name="fPower">power ratio, greater than zero</param>
+/// <returns>power in dB</returns>
+float PowerToDecibels(float fPower);
+
+/// <summary>
+/// Copies the newest values of a circular energy buffer, oldest first, into a window
+/// that the energy display draws from
+/// </summary>
+/// <param name="pBuffer">circular buffer of energy values</param>
+/// <param name="nBufferLength">length of the circular buffer</param>
+/// <param name="nEndIndex">index one past the newest value to copy</param>
+/// <param name="pWindow">receives the values</param>
+/// <param name="nWindowLength">number of values to copy, at most nBufferLength</param>
+void CopyEnergyWindow(const float* pBuffer, int nBufferLength, int nEndIndex, float* pWindow, int nWindowLength);
+
+class AudioEnergyMeter
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    /// <param name="kernel">energy kernel to use; must be supported</param>
+    explicit AudioEnergyMeter(EnergyKernel kernel = GetBestEnergyKernel());
+
+    /// <summary>
+    /// Accumulates beam audio into energy values and publishes each completed value,
+    /// together with the beam state, to the ring. Partial blocks carry over to the next call.
+    /// Must only be called from the ring's producer thread.
+    /// </summary>
+    /// <param name="nTime">time of the first sample, in 100ns ticks</param>
+    /// <param name="pSamples">beam audio samples</param>
+    /// <param name="nSampleCount">number of samples</param>
+    /// <param name="fBeamAngle">beam angle in radians</param>
+    /// <param name="fBeamAngleConfidence">beam angle confidence in the range [0,1]</param>
+    /// <param name="bVoiceActive">whether voice is active as of the samples</param>
+    /// <param name="fSpeechToNoiseDb">level of the speech bands above their noise floors, in dB</param>
+    /// <param name="pRing">ring to publish the energy values to</param>
+    /// <returns>number of energy values that did not fit in the ring</returns>
+    UINT Process(INT64 nTime, const float* pSamples, UINT nSampleCount, float fBeamAngle, float fBeamAngleConfidence, bool bVoiceActive, float fSpeechToNoiseDb, EnergyRing* pRing);
+
+private:
+    /// <summary>
+    /// Turns the sum of squares of one block into an energy value and publishes it
+    /// </summary>
+    /// <returns>false if the value did not fit in the ring</returns>
+    bool Publish(float fSquareSum, INT64 nTime, INT64 nCaptureNs, float fBeamAngle, float fBeamAngleConfidence, bool bVoiceActive, float fSpeechToNoiseDb, EnergyRing* pRing);
+
+    EnergyKernel        m_kernel;
+
+    // Sum of squares of audio samples being accumulated to compute the next energy value.
+    float               m_fAccumulatedSquareSum;
+
+    // Number of audio samples accumulated so far to compute the next energy value.
+    int                 m_nAccumulatedSampleCount;
+
+    // Number of energy values published so far.
+    UINT32              m_nSequence;
+};
@@ -0,0 +1,589 @@
+//------------------------------------------------------------------------------
+// <copyright file="BatchRunner.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "KinectTypes.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#if !defined(_WIN32)
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+#include "PerfClock.h"
+#include "AudioCapture.h"
+#include "FrameSource.h"
+#include "SpeakerPipeline.h"
+#include "BatchRunner.h"
+
+/// <summary>
+/// Opens a file with the C runtime
+/// </summary>
+/// <param name="szPath">path of the file</param>
+/// <param name="szMode">fopen style mode string</param>
+/// <returns>the open file or nullptr on failure</returns>
+static FILE* OpenFile(const char* szPath, const char* szMode)
+{
+    FILE* pFile = nullptr;
+#if defined(_WIN32)
+    if (0 != fopen_s(&pFile, szPath, szMode))
+    {
+        pFile = nullptr;
+    }
+#else
+    pFile = fopen(szPath, szMode);
+#endif
+    return pFile;
+}
+
+/// <summary>
+/// Whether a file starts with the magic of a recording
+/// </summary>
+/// <param name="szPath">path of the file</param>
+/// <returns>true for a recording</returns>
+static bool IsRecording(const char* szPath)
+{
+    FILE* pFile = OpenFile(szPath, "rb");
+    if (nullptr == pFile)
+    {
+        return false;
+    }
+
+    char magic[sizeof(c_SessionFileMagic)];
+    bool bRecording = sizeof(magic) == fread(magic, 1, sizeof(magic), pFile) && 0 == memcmp(magic, c_SessionFileMagic, sizeof(magic));
+    fclose(pFile);
+    return bRecording;
+}
+
+/// <summary>
+/// Path of an output of a recording: the output directory, the file name of the
+/// recording without its extension, and the suffix
+/// </summary>
+/// <param name="outputDirectory">directory of the outputs</param>
+/// <param name="recordingPath">path of the recording</param>
+/// <param name="szSuffix">suffix, starting with its dot</param>
+/// <returns>path of the output</returns>
+static std::string GetOutputPath(const std::string& outputDirectory, const std::string& recordingPath, const char* szSuffix)
+{
+    size_t nNameStart = recordingPath.find_last_of("/\\");
+    nNameStart = (std::string::npos == nNameStart) ? 0 : nNameStart + 1;
+
+    std::string name = recordingPath.substr(nNameStart);
+    size_t nExtension = name.find_last_of('.');
+    if (std::string::npos != nExtension && nExtension > 0)
+    {
+        name.erase(nExtension);
+    }
+
+    std::string path = outputDirectory;
+    if (!path.empty() && '/' != path[path.size() - 1] && '\\' != path[path.size() - 1])
+    {
+        path += '/';
+    }
+
+    return path + name + szSuffix;
+}
+
+/// <summary>
+/// Creates a directory unless it exists
+/// </summary>
+/// <param name="szDirectory">directory to create</param>
+/// <returns>indicates success or failure</returns>
+static HRESULT CreateOutputDirectory(const char* szDirectory)
+{
+#if defined(_WIN32)
+    if (!CreateDirectoryA(szDirectory, nullptr) && ERROR_ALREADY_EXISTS != GetLastError())
+    {
+        return E_FAIL;
+    }
+#else
+    struct stat status;
+    if (0 != mkdir(szDirectory, 0777) && (0 != stat(szDirectory, &status) || !S_ISDIR(status.st_mode)))
+    {
+        return E_FAIL;
+    }
+#endif
+    return S_OK;
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+SpeakerTimeline::SpeakerTimeline()
+{
+    memset(m_open, 0, sizeof(m_open));
+}
+
+/// <summary>
+/// Adds the decisions of the next frame
+/// </summary>
+/// <param name="pFrame">frame holding the face and body data</param>
+/// <param name="pbIsSpeaker">speaker decision for each of the BODY_COUNT faces</param>
+void SpeakerTimeline::AddFrame(const SessionFrame* pFrame, const bool* pbIsSpeaker)
+{
+    for (int i = 0; i < BODY_COUNT; ++i)
+    {
+        SpeakerSegment* pOpen = &m_open[i];
+
+        // a body that fell silent for longer than a pause ends its segment
+        if (pOpen->nFrames > 0 && pFrame->nTime - pOpen->nEndTime > c_SpeakerSegmentGapTicks)
+        {
+            CloseSegment(i);
+        }
+
+        if (!pbIsSpeaker[i])
+        {
+            continue;
+        }
+
+        UINT64 nTrackingId = pFrame->bHaveFaceData ? pFrame->faces[i].nTrackingId :
+            (pFrame->bHaveBodyData ? pFrame->bodies[i].nTrackingId : 0);
+
+        // the body slot went to somebody else
+        if (pOpen->nFrames > 0 && pOpen->nTrackingId != nTrackingId)
+        {
+            CloseSegment(i);
+        }
+
+        if (0 == pOpen->nFrames)
+        {
+            pOpen->nTrackingId = nTrackingId;
+            pOpen->nBody = i;
+            pOpen->nStartTime = pFrame->nTime;
+        }
+
+        pOpen->nEndTime = pFrame->nTime;
+        pOpen->nFrames++;
+    }
+}
+
+/// <summary>
+/// Closes the segments still open, after the last frame
+/// </summary>
+void SpeakerTimeline::Finish()
+{
+    for (int i = 0; i < BODY_COUNT; ++i)
+    {
+        if (m_open[i].nFrames > 0)
+        {
+            CloseSegment(i);
+        }
+    }
+}
+
+/// <summary>
+/// Writes the closed segments as CSV with times in 100ns ticks
+/// </summary>
+/// <param name="szPath">path of the file</param>
+/// <returns>indicates success or failure</returns>
+HRESULT SpeakerTimeline::WriteCsv(const char* szPath) const
+{
+    FILE* pFile = OpenFile(szPath, "w");
+    if (nullptr == pFile)
+    {
+        return E_FAIL;
+    }
+
+    fprintf(pFile, "tracking_id,body,start_time,end_time,frames\n");
+    for (size_t i = 0; i < m_segments.size(); ++i)
+    {
+        const SpeakerSegment& segment = m_segments[i];
+        fprintf(pFile, "%llu,%d,%lld,%lld,%u\n", static_cast<unsigned long long>(segment.nTrackingId), segment.nBody,
+            static_cast<long long>(segment.nStartTime), static_cast<long long>(segment.nEndTime), segment.nFrames);
+    }
+
+    bool bWritten = !ferror(pFile);
+    return (0 == fclose(pFile) && bWritten) ? S_OK : E_FAIL;
+}
+
+/// <summary>
+/// Moves the open segment of a body to the closed ones, keeping them ordered by their start
+/// </summary>
+/// <param name="iBody">index of the body</param>
+void SpeakerTimeline::CloseSegment(int iBody)
+{
+    SpeakerSegment* pOpen = &m_open[iBody];
+
+    std::vector<SpeakerSegment>::iterator it = m_segments.end();
+    while (it != m_segments.begin() && (it - 1)->nStartTime > pOpen->nStartTime)
+    {
+        --it;
+    }
+
+    m_segments.insert(it, *pOpen);
+    pOpen->nFrames = 0;
+}
+
+/// <summary>
+/// Lists the recordings in a directory, ordered by name; files that do not start like a
+/// recording are left out
+/// </summary>
+/// <param name="szDirectory">directory to list</param>
+/// <param name="pPaths">receives the paths of the recordings</param>
+/// <returns>indicates success or failure</returns>
+HRESULT ListRecordings(const char* szDirectory, std::vector<std::string>* pPaths)
+{
+    pPaths->clear();
+
+    std::string directory = szDirectory;
+    if (!directory.empty() && '/' != directory[directory.size() - 1] && '\\' != directory[directory.size() - 1])
+    {
+        directory += '/';
+    }
+
+    std::vector<std::string> names;
+
+#if defined(_WIN32)
+    WIN32_FIND_DATAA findData;
+    HANDLE hFind = FindFirstFileA((directory + "*").c_str(), &findData);
+    if (INVALID_HANDLE_VALUE == hFind)
+    {
+        return E_FAIL;
+    }
+
+    do
+    {
+        if (0 == (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+        {
+            names.push_back(findData.cFileName);
+        }
+    } while (FindNextFileA(hFind, &findData));
+
+    FindClose(hFind);
+#else
+    DIR* pDirectory = opendir(szDirectory);
+    if (nullptr == pDirectory)
+    {
+        return E_FAIL;
+    }
+
+    for (struct dirent* pEntry = readdir(pDirectory); pEntry; pEntry = readdir(pDirectory))
+    {
+        struct stat status;
+        if (0 == stat((directory + pEntry->d_name).c_str(), &status) && S_ISREG(status.st_mode))
+        {
+            names.push_back(pEntry->d_name);
+        }
+    }
+
+    closedir(pDirectory);
+#endif
+
+    std::sort(names.begin(), names.end());
+
+    for (size_t i = 0; i < names.size(); ++i)
+    {
+        std::string path = directory + names[i];
+        if (IsRecording(path.c_str()))
+        {
+            pPaths->push_back(path);
+        }
+    }
+
+    return S_OK;
+}
+
+/// <summary>
+/// A recording being replayed on the pool, with everything its pipeline uses
+/// </summary>
+struct BatchJob
+{
+    size_t              iPath;
+    INT64               nStartNs;
+
+    // Failure of opening or starting, before the pipeline ran
+    HRESULT             hrStart;
+
+    ReplayFrameSource   source;
+    FrameWakeup         wakeup;
+    AudioCapture        audioCapture;
+    SpeakerPipeline     pipeline;
+    RoiExporter         exporter;
+    SpeakerLogWriter    speakerLog;
+
+    // Filled in on the worker running the pipeline; the frame count is also read by the
+    // thread running the batch, for its progress
+    SpeakerTimeline     timeline;
+    std::atomic<UINT64> nFrames;
+    UINT64              nSpeakerFrames;
+    INT64               nFirstTime;
+    INT64               nLastTime;
+    HRESULT             hrExport;
+
+    BatchJob() :
+        iPath(0),
+        nStartNs(0),
+        hrStart(S_OK),
+        wakeup(FrameStream_Color),
+        audioCapture(0, 0),
+        pipeline(&audioCapture),
+        nFrames(0),
+        nSpeakerFrames(0),
+        nFirstTime(0),
+        nLastTime(0),
+        hrExport(S_OK)
+    {
+    }
+};
+
+/// <summary>
+/// Frame callback of the pipelines of a batch, run on a worker
+/// </summary>
+/// <param name="pContext">job of the pipeline</param>
+/// <param name="pFrame">composed frame</param>
+static void OnBatchFrame(void* pContext, SpeakerPipeline* /* pPipeline */, PipelineFrame* pFrame)
+{
+    BatchJob* pJob = static_cast<BatchJob*>(pContext);
+
+    pJob->timeline.AddFrame(&pFrame->frame, pFrame->bIsSpeaker);
+
+    if (0 == pJob->nFrames.load())
+    {
+        pJob->nFirstTime = pFrame->frame.nTime;
+    }
+    pJob->nLastTime = pFrame->frame.nTime;
+
+    if (pFrame->nSpeakers > 0)
+    {
+        pJob->nSpeakerFrames++;
+    }
+
+    if (FAILED(pFrame->hrExport) && SUCCEEDED(pJob->hrExport))
+    {
+        pJob->hrExport = pFrame->hrExport;
+    }
+
+    pJob->nFrames++;
+}
+
+/// <summary>
+/// Opens a recording and its outputs and adds its pipeline to the pool; a failure is
+/// kept in the job, whose pipeline is then not on the pool
+/// </summary>
+/// <param name="pJob">job to start</param>
+/// <param name="path">path of the recording</param>
+/// <param name="options">outputs of the batch</param>
+/// <param name="pPool">pool to run the pipeline on</param>
+static void StartBatchJob(BatchJob* pJob, const std::string& path, const BatchOptions& options, PipelineWorkerPool* pPool)
+{
+    pJob->source.SetDecodeThreads(options.nDecodeThreads);
+    pJob->hrStart = pJob->source.Open(path.c_str(), ReplayPacing_MaxSpeed);
+    if (FAILED(pJob->hrStart))
+    {
+        return;
+    }
+
+    if (options.bExportRois)
+    {
+        std::string roiPath = GetOutputPath(options.outputDirectory, path, (std::string(".") + GetRoiExportFormatName(options.format)).c_str());
+        std::string timestampPath = (RoiExportFormat_Y4m == options.format) ? std::string() : GetOutputPath(options.outputDirectory, path, ".timestamps.csv");
+        pJob->hrStart = pJob->exporter.Open(roiPath.c_str(), timestampPath.c_str(), options.format, options.nWidth, options.nHeight, options.scaling);
+        if (FAILED(pJob->hrStart))
+        {
+            return;
+        }
+    }
+
+    if (options.bSpeakerLog)
+    {
+        pJob->hrStart = pJob->speakerLog.Open(GetOutputPath(options.outputDirectory, path, ".speakerlog").c_str());
+        if (FAILED(pJob->hrStart))
+        {
+            return;
+        }
+    }
+
+    // every frame counts, and the frame buffers only need to hold the recorded color
+    const SessionFileHeader& header = pJob->source.GetHeader();
+    SpeakerPipelineOptions pipelineOptions;
+    pipelineOptions.bDropWhenBehind = false;
+    pipelineOptions.bVoiceGate = options.bVoiceGate;
+    pipelineOptions.angleMapping = options.angleMapping;
+    pipelineOptions.mosaicScaling = options.scaling;
+    pipelineOptions.nColorWidth = (std::max)(static_cast<int>(header.nColorWidth), 1);
+    pipelineOptions.nColorHeight = (std::max)(static_cast<int>(header.nColorHeight), 1);
+    pipelineOptions.pExporter = options.bExportRois ? &pJob->exporter : nullptr;
+    pipelineOptions.pSpeakerLog = options.bSpeakerLog ? &pJob->speakerLog : nullptr;
+
+    pJob->hrStart = pPool->Add(&pJob->pipeline, &pJob->source, &pJob->wakeup, pipelineOptions, OnBatchFrame, pJob);
+    if (FAILED(pJob->hrStart))
+    {
+        // the pool keeps a pipeline that failed to start as finished
+        pPool->Remove(&pJob->pipeline);
+    }
+}
+
+/// <summary>
+/// Collects the outcome of a job whose pipeline was taken off the pool and writes its timeline
+/// </summary>
+/// <param name="pJob">finished job</param>
+/// <param name="options">outputs of the batch</param>
+/// <param name="pResult">receives the outcome</param>
+static void FinishBatchJob(BatchJob* pJob, const BatchOptions& options, BatchFileResult* pResult)
+{
+    HRESULT hr = pJob->hrStart;
+    if (SUCCEEDED(hr))
+    {
+        hr = pJob->pipeline.GetEndResult();
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = pJob->hrExport;
+    }
+
+    if (pJob->exporter.IsOpen())
+    {
+        HRESULT hrClose = pJob->exporter.Close();
+        hr = SUCCEEDED(hr) ? hrClose : hr;
+    }
+
+    if (pJob->speakerLog.IsOpen())
+    {
+        HRESULT hrClose = pJob->speakerLog.Close();
+        hr = SUCCEEDED(hr) ? hrClose : hr;
+    }
+
+    if (SUCCEEDED(pJob->hrStart))
+    {
+        pJob->timeline.Finish();
+        HRESULT hrTimeline = pJob->timeline.WriteCsv(GetOutputPath(options.outputDirectory, pResult->path, ".speakers.csv").c_str());
+        hr = SUCCEEDED(hr) ? hrTimeline : hr;
+    }
+
+    pResult->hr = hr;
+    pResult->nFrames = pJob->nFrames.load();
+    pResult->nSpeakerFrames = pJob->nSpeakerFrames;
+    pResult->nSegments = pJob->timeline.GetSegments().size();
+    pResult->nRecordedTicks = pJob->nLastTime - pJob->nFirstTime;
+    pResult->nElapsedNs = GetPerfClockNs() - pJob->nStartNs;
+}
+
+/// <summary>
+/// Replays every recording through the speaker selection and writes its outputs,
+/// named after the recording: NAME.speakers.csv; when exporting, NAME.y4m, .i420 or
+/// .bgra, the headerless ones with NAME.timestamps.csv; and when logging, NAME.speakerlog
+/// </summary>
+/// <param name="paths">recordings to replay</param>
+/// <param name="options">outputs and parallelism</param>
+/// <param name="pfnProgress">optional; receives the progress</param>
+/// <param name="pContext">passed to the progress callback</param>
+/// <param name="pResults">receives the outcome of every recording, in the order given</param>
+/// <param name="pPoolStats">optional; receives the counters of the worker pool</param>
+/// <returns>S_OK, or the failure of the first recording that failed</returns>
+HRESULT RunBatch(const std::vector<std::string>& paths, const BatchOptions& options, BatchProgressCallback pfnProgress, void* pContext,
+    std::vector<BatchFileResult>* pResults, PipelineWorkerPoolStats* pPoolStats)
+{
+    pResults->assign(paths.size(), BatchFileResult());
+    for (size_t i = 0; i < paths.size(); ++i)
+    {
+        (*pResults)[i].path = paths[i];
+        (*pResults)[i].hr = E_PENDING;
+    }
+
+    HRESULT hr = CreateOutputDirectory(options.outputDirectory.c_str());
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    PipelineWorkerPool pool(options.nWorkers);
+    size_t nMaxActive = (options.nMaxActive > 0) ? options.nMaxActive : 2 * pool.GetWorkerCount();
+
+    std::vector<BatchJob*> active;
+    size_t iNext = 0;
+    size_t nDone = 0;
+    UINT64 nFramesDone = 0;
+    INT64 nStartNs = GetPerfClockNs();
+    INT64 nLastReportNs = nStartNs;
+
+    while (nDone < paths.size())
+    {
+        // a recording that fails to open is done at once
+        BatchJob* pDone = nullptr;
+        while (nullptr == pDone && iNext < paths.size() && active.size() < nMaxActive)
+        {
+            BatchJob* pJob = new BatchJob();
+            pJob->iPath = iNext++;
+            pJob->nStartNs = GetPerfClockNs();
+            StartBatchJob(pJob, paths[pJob->iPath], options, &pool);
+
+            if (FAILED(pJob->hrStart))
+            {
+                pDone = pJob;
+            }
+            else
+            {
+                active.push_back(pJob);
+            }
+        }
+
+        SpeakerPipeline* pFinished = pDone ? nullptr : pool.TakeFinished(100);
+        if (pFinished)
+        {
+            std::vector<BatchJob*>::iterator it = active.begin();
+            while (&(*it)->pipeline != pFinished)
+            {
+                ++it;
+            }
+
+            pDone = *it;
+            active.erase(it);
+        }
+
+        INT64 nNowNs = GetPerfClockNs();
+
+        BatchProgress progress;
+        progress.nTotal = paths.size();
+        progress.nElapsedNs = nNowNs - nStartNs;
+        progress.pFinished = nullptr;
+
+        if (pDone)
+        {
+            BatchFileResult* pResult = &(*pResults)[pDone->iPath];
+            FinishBatchJob(pDone, options, pResult);
+            delete pDone;
+
+            nDone++;
+            nFramesDone += pResult->nFrames;
+            if (SUCCEEDED(hr) && FAILED(pResult->hr))
+            {
+                hr = pResult->hr;
+            }
+
+            progress.pFinished = pResult;
+        }
+        else if (nNowNs - nLastReportNs < 1000000000)
+        {
+            continue;
+        }
+
+        progress.nDone = nDone;
+        progress.nActive = active.size();
+        progress.nFrames = nFramesDone;
+        for (size_t i = 0; i < active.size(); ++i)
+        {
+            progress.nFrames += active[i]->nFrames.load();
+        }
+
+        if (nullptr == progress.pFinished)
+        {
+            nLastReportNs = nNowNs;
+        }
+
+        if (pfnProgress)
+        {
+            pfnProgress(pContext, progress);
+        }
+    }
+
+    pool.Stop();
+    if (pPoolStats)
+    {
+        pool.GetStats(pPoolStats);
+    }
+
+    return hr;
+}
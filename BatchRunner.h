@@ -0,0 +1,202 @@
+//------------------------------------------------------------------------------
+// <copyright file="BatchRunner.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Reprocesses a set of recordings offline: every recording replays at maximum speed
+// through a speaker pipeline of its own, all of them on one worker pool, so a directory
+// of archived sessions is worked through on every core at once. The pipelines make the
+// same speaker decisions the application does. For every recording the runner writes
+// the speaker timeline, one row per stretch of time a face was picked as the speaker,
+// and optionally the speaker regions as a video stream, as the export command does.
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "KinectTypes.h"
+#include "PipelineWorkerPool.h"
+#include "RoiExport.h"
+#include "RoiScaler.h"
+#include "SessionRecording.h"
+#include "SpeakerSelection.h"
+
+// Longest pause, in 100ns ticks, within one speaker segment; the beam and the face
+// tracking make a speaker drop out for a few frames in mid sentence
+static const INT64 c_SpeakerSegmentGapTicks = 5000000;
+
+struct BatchOptions
+{
+    // Directory the outputs of every recording are written to, created if missing
+    std::string         outputDirectory;
+
+    // Whether the speaker regions are written, in the format, size and scaling given
+    bool                bExportRois;
+    RoiExportFormat     format;
+    int                 nWidth;
+    int                 nHeight;
+    ScaleMethod         scaling;
+
+    // Whether every face picked as the speaker is also written to a speaker log
+    bool                bSpeakerLog;
+
+    // Whether speakers are only picked while voice is active, as the application does by default
+    bool                bVoiceGate;
+
+    // How the angle of each face, compared with the beam angle, is obtained
+    SpeakerAngleMapping angleMapping;
+
+    // Worker threads, 0 for one per hardware thread, and recordings open at once, 0 for
+    // twice the workers, enough to keep every worker busy between recordings
+    int                 nWorkers;
+    int                 nMaxActive;
+
+    // Threads decoding the color of each encoded recording, its read thread included;
+    // one by default, as the recordings open at once keep every worker busy already,
+    // and 0 for one per hardware thread
+    int                 nDecodeThreads;
+
+    BatchOptions() :
+        bExportRois(true),
+        format(RoiExportFormat_Y4m),
+        nWidth(c_MosaicWidth),
+        nHeight(c_MosaicHeight),
+        scaling(ScaleMethod_Auto),
+        bSpeakerLog(false),
+        bVoiceGate(true),
+        angleMapping(SpeakerAngleMapping_Geometric),
+        nWorkers(0),
+        nMaxActive(0),
+        nDecodeThreads(1)
+    {
+    }
+};
+
+/// <summary>
+/// A stretch of time one face was picked as the speaker
+/// </summary>
+struct SpeakerSegment
+{
+    // Tracking id of the face and the index of its body
+    UINT64              nTrackingId;
+    int                 nBody;
+
+    // RelativeTime of the first and last frame the face was picked in, in 100ns ticks
+    INT64               nStartTime;
+    INT64               nEndTime;
+
+    // Frames the face was picked in
+    UINT32              nFrames;
+};
+
+/// <summary>
+/// Outcome of one recording of a batch
+/// </summary>
+struct BatchFileResult
+{
+    std::string         path;
+    HRESULT             hr;
+
+    // Frames replayed, those with at least one speaker, and the speaker segments found
+    UINT64              nFrames;
+    UINT64              nSpeakerFrames;
+    UINT64              nSegments;
+
+    // Span of recorded time covered, in 100ns ticks
+    INT64               nRecordedTicks;
+
+    // Wall clock time from opening the recording to writing its last output, in nanoseconds
+    INT64               nElapsedNs;
+};
+
+/// <summary>
+/// Where a batch stands
+/// </summary>
+struct BatchProgress
+{
+    // Recordings done, being replayed, and in the batch
+    size_t              nDone;
+    size_t              nActive;
+    size_t              nTotal;
+
+    // Frames replayed so far, over all recordings
+    UINT64              nFrames;
+
+    // Wall clock time since the batch started, in nanoseconds
+    INT64               nElapsedNs;
+
+    // Recording that just finished, null for a periodic report
+    const BatchFileResult* pFinished;
+};
+
+// Called on the thread running the batch whenever a recording finishes, and about once a second
+typedef void (*BatchProgressCallback)(void* pContext, const BatchProgress& progress);
+
+/// <summary>
+/// Collects the speaker decisions of a recording, frame by frame, into segments
+/// </summary>
+class SpeakerTimeline
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    SpeakerTimeline();
+
+    /// <summary>
+    /// Adds the decisions of the next frame
+    /// </summary>
+    /// <param name="pFrame">frame holding the face and body data</param>
+    /// <param name="pbIsSpeaker">speaker decision for each of the BODY_COUNT faces</param>
+    void AddFrame(const SessionFrame* pFrame, const bool* pbIsSpeaker);
+
+    /// <summary>
+    /// Closes the segments still open, after the last frame
+    /// </summary>
+    void Finish();
+
+    /// <summary>
+    /// Closed segments, ordered by their start
+    /// </summary>
+    const std::vector<SpeakerSegment>& GetSegments() const { return m_segments; }
+
+    /// <summary>
+    /// Writes the closed segments as CSV with times in 100ns ticks
+    /// </summary>
+    /// <param name="szPath">path of the file</param>
+    /// <returns>indicates success or failure</returns>
+    HRESULT WriteCsv(const char* szPath) const;
+
+private:
+    void CloseSegment(int iBody);
+
+    // Segment of each body while open; nFrames is 0 for none
+    SpeakerSegment              m_open[BODY_COUNT];
+
+    std::vector<SpeakerSegment> m_segments;
+};
+
+/// <summary>
+/// Lists the recordings in a directory, ordered by name; files that do not start like a
+/// recording are left out
+/// </summary>
+/// <param name="szDirectory">directory to list</param>
+/// <param name="pPaths">receives the paths of the recordings</param>
+/// <returns>indicates success or failure</returns>
+HRESULT ListRecordings(const char* szDirectory, std::vector<std::string>* pPaths);
+
+/// <summary>
+/// Replays every recording through the speaker selection and writes its outputs,
+/// named after the recording: NAME.speakers.csv; when exporting, NAME.y4m, .i420 or
+/// .bgra, the headerless ones with NAME.timestamps.csv; and when logging, NAME.speakerlog
+/// </summary>
+/// <param name="paths">recordings to replay</param>
+/// <param name="options">outputs and parallelism</param>
+/// <param name="pfnProgress">optional; receives the progress</param>
+/// <param name="pContext">passed to the progress callback</param>
+/// <param name="pResults">receives the outcome of every recording, in the order given</param>
+/// <param name="pPoolStats">optional; receives the counters of the worker pool</param>
+/// <returns>S_OK, or the failure of the first recording that failed</returns>
+HRESULT RunBatch(const std::vector<std::string>& paths, const BatchOptions& options, BatchProgressCallback pfnProgress, void* pContext,
+    std::vector<BatchFileResult>* pResults, PipelineWorkerPoolStats* pPoolStats);
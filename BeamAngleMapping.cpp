@@ -0,0 +1,100 @@
+//------------------------------------------------------------------------------
+// <copyright file="BeamAngleMapping.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "KinectTypes.h"
+#include <math.h>
+#include "BeamAngleMapping.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/// <summary>
+/// Pixel to angle table, filled in during static initialization so that lookups
+/// never race with its construction
+/// </summary>
+struct PixelAngleTable
+{
+    float               fAngles[c_PixelAngleTableSize];
+
+    PixelAngleTable()
+    {
+        // the hand-fit quadratic, 0.000054253472 * (x - 960)^2 mirrored left of the
+        // center column; it is continuous at 960
+        for (int x = 0; x < c_PixelAngleTableSize; ++x)
+        {
+            double fAngle = 0.000054253472 * x * x - .10416666666666667 * x + 50;
+            fAngles[x] = static_cast<float>((x < 960) ? -fAngle : fAngle);
+        }
+    }
+};
+
+static const PixelAngleTable s_pixelAngles;
+
+/// <summary>
+/// Calibration assumed when none was measured
+/// </summary>
+/// <param name="pCalibration">receives the calibration</param>
+void GetDefaultMicArrayCalibration(MicArrayCalibration* pCalibration)
+{
+    pCalibration->fOffsetX = 0.0f;
+    pCalibration->fOffsetZ = 0.0f;
+    pCalibration->fYawDegrees = 0.0f;
+}
+
+/// <summary>
+/// Horizontal angle of a camera space point as seen from the microphone array
+/// </summary>
+/// <param name="pPoint">point in camera space, e.g. a head joint</param>
+/// <param name="pCalibration">position of the array</param>
+/// <returns>angle in degrees, negative to the left of the sensor as the beam angle is</returns>
+float GetCameraSpaceAngle(const CameraSpacePoint* pPoint, const MicArrayCalibration* pCalibration)
+{
+    // the height of the point does not matter to a linear array
+    float fX = pPoint->X - pCalibration->fOffsetX;
+    float fZ = pPoint->Z - pCalibration->fOffsetZ;
+
+    return static_cast<float>(atan2(fX, fZ) * 180.0 / M_PI) - pCalibration->fYawDegrees;
+}
+
+/// <summary>
+/// Whether a joint position is usable for the geometric mapping
+/// </summary>
+/// <param name="pPoint">point in camera space</param>
+/// <returns>false for points at or behind the sensor, which untracked joints report</returns>
+bool IsValidCameraSpacePoint(const CameraSpacePoint* pPoint)
+{
+    return pPoint->Z > 0.0f;
+}
+
+/// <summary>
+/// Horizontal angle of a color pixel column from the precomputed table of the
+/// hand-fit pixel mapping, linearly interpolated between columns
+/// </summary>
+/// <param name="fX">column in the color frame, clamped to the frame</param>
+/// <param name="nColorWidth">width (in pixels) of the color frame</param>
+/// <returns>angle in degrees, negative to the left of the sensor</returns>
+float GetPixelAngle(float fX, int nColorWidth)
+{
+    if (nColorWidth != c_PixelAngleTableSize)
+    {
+        fX = fX * c_PixelAngleTableSize / nColorWidth;
+    }
+
+    if (!(fX > 0.0f))
+    {
+        return s_pixelAngles.fAngles[0];
+    }
+
+    int x = static_cast<int>(fX);
+    if (x >= c_PixelAngleTableSize - 1)
+    {
+        return s_pixelAngles.fAngles[c_PixelAngleTableSize - 1];
+    }
+
+    float fFraction = fX - x;
+    return s_pixelAngles.fAngles[x] + fFraction * (s_pixelAngles.fAngles[x + 1] - s_pixelAngles.fAngles[x]);
+}
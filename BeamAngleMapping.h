@@ -0,0 +1,61 @@
+//------------------------------------------------------------------------------
+// <copyright file="BeamAngleMapping.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Maps a tracked person to the horizontal angle under which the microphone array
+// hears them, so that it can be compared with the audio beam angle.
+
+#pragma once
+
+#include "KinectTypes.h"
+#include "FrameGeometry.h"
+
+// Width (in pixels) of the color frames the pixel mapping is defined for; columns of
+// frames of other widths are scaled to it
+static const int c_PixelAngleTableSize = c_SensorColorWidth;
+
+/// <summary>
+/// Position of the microphone array relative to camera space
+/// </summary>
+struct MicArrayCalibration
+{
+    // Center of the array in camera space, in meters; the array is centered on the
+    // sensor bar, close enough to the depth camera that zero is a good default
+    float               fOffsetX;
+    float               fOffsetZ;
+
+    // Rotation of the array's zero angle relative to the camera's optical axis, in degrees
+    float               fYawDegrees;
+};
+
+/// <summary>
+/// Calibration assumed when none was measured
+/// </summary>
+/// <param name="pCalibration">receives the calibration</param>
+void GetDefaultMicArrayCalibration(MicArrayCalibration* pCalibration);
+
+/// <summary>
+/// Horizontal angle of a camera space point as seen from the microphone array
+/// </summary>
+/// <param name="pPoint">point in camera space, e.g. a head joint</param>
+/// <param name="pCalibration">position of the array</param>
+/// <returns>angle in degrees, negative to the left of the sensor as the beam angle is</returns>
+float GetCameraSpaceAngle(const CameraSpacePoint* pPoint, const MicArrayCalibration* pCalibration);
+
+/// <summary>
+/// Whether a joint position is usable for the geometric mapping
+/// </summary>
+/// <param name="pPoint">point in camera space</param>
+/// <returns>false for points at or behind the sensor, which untracked joints report</returns>
+bool IsValidCameraSpacePoint(const CameraSpacePoint* pPoint);
+
+/// <summary>
+/// Horizontal angle of a color pixel column from the precomputed table of the
+/// hand-fit pixel mapping, linearly interpolated between columns
+/// </summary>
+/// <param name="fX">column in the color frame, clamped to the frame</param>
+/// <param name="nColorWidth">width (in pixels) of the color frame</param>
+/// <returns>angle in degrees, negative to the left of the sensor</returns>
+float GetPixelAngle(float fX, int nColorWidth);
@@ -0,0 +1,157 @@
+//------------------------------------------------------------------------------
+// <copyright file="BeamHistory.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "KinectTypes.h"
+#include "BeamHistory.h"
+
+/// <summary>
+/// Constructor
+/// </summary>
+/// <param name="nCapacity">states kept, rounded up to a power of two</param>
+BeamHistory::BeamHistory(size_t nCapacity) :
+    m_nNext(0),
+    m_nCount(0)
+{
+    size_t nSize = 2;
+    while (nSize < nCapacity)
+    {
+        nSize *= 2;
+    }
+
+    m_states.resize(nSize);
+    m_nMask = nSize - 1;
+}
+
+/// <summary>
+/// Adds a state, dropping the oldest one when full. Times are expected to grow; a
+/// state not later than the newest ones replaces them, as after the audio clock was
+/// re-anchored or the source restarted.
+/// </summary>
+/// <param name="nTime">time of the state, in 100ns ticks</param>
+/// <param name="fBeamAngle">beam angle in radians</param>
+/// <param name="fBeamAngleConfidence">beam angle confidence in the range [0,1]</param>
+/// <param name="bVoiceActive">whether voice was active in the beam audio</param>
+void BeamHistory::Add(INT64 nTime, float fBeamAngle, float fBeamAngleConfidence, bool bVoiceActive)
+{
+    // keeps the times strictly growing, which the lookup relies on
+    while (m_nCount > 0 && GetState(m_nCount - 1).nTime >= nTime)
+    {
+        m_nNext = (m_nNext - 1) & m_nMask;
+        m_nCount--;
+    }
+
+    BeamState& state = m_states[m_nNext];
+    state.nTime = nTime;
+    state.fBeamAngle = fBeamAngle;
+    state.fBeamAngleConfidence = fBeamAngleConfidence;
+    state.bVoiceActive = bVoiceActive;
+
+    m_nNext = (m_nNext + 1) & m_nMask;
+    if (m_nCount < m_states.size())
+    {
+        m_nCount++;
+    }
+}
+
+/// <summary>
+/// Adds the beam states of energy values, in order; of consecutive values under the
+/// same beam state only the last one is added, where that state held for sure
+/// </summary>
+/// <param name="pSamples">energy values</param>
+/// <param name="nCount">number of energy values</param>
+void BeamHistory::Add(const EnergySample* pSamples, size_t nCount)
+{
+    for (size_t i = 0; i < nCount; ++i)
+    {
+        const EnergySample& sample = pSamples[i];
+        bool bLastOfRun = (i + 1 == nCount) || (pSamples[i + 1].fBeamAngle != sample.fBeamAngle) ||
+            (pSamples[i + 1].fBeamAngleConfidence != sample.fBeamAngleConfidence) ||
+            (pSamples[i + 1].bVoiceActive != sample.bVoiceActive);
+
+        if (bLastOfRun)
+        {
+            Add(sample.nTime, sample.fBeamAngle, sample.fBeamAngleConfidence, 0 != sample.bVoiceActive);
+        }
+    }
+}
+
+/// <summary>
+/// Beam state at a point in time, interpolated between the states around it. Before
+/// the oldest state, after the newest one or within a gap in the audio, the nearest
+/// state is taken and keeps its own time. Voice counts as active between two states
+/// if it was in either.
+/// </summary>
+/// <param name="nTime">time to look up, in 100ns ticks</param>
+/// <param name="pState">receives the state; its time is nTime when interpolated</param>
+/// <returns>false if the history is empty, pState then holds a zero beam</returns>
+bool BeamHistory::GetAt(INT64 nTime, BeamState* pState) const
+{
+    if (0 == m_nCount)
+    {
+        pState->nTime = nTime;
+        pState->fBeamAngle = 0.0f;
+        pState->fBeamAngleConfidence = 0.0f;
+        pState->bVoiceActive = false;
+        return false;
+    }
+
+    const BeamState& newest = GetState(m_nCount - 1);
+    if (nTime >= newest.nTime)
+    {
+        *pState = newest;
+        return true;
+    }
+
+    const BeamState& oldest = GetState(0);
+    if (nTime <= oldest.nTime)
+    {
+        *pState = oldest;
+        return true;
+    }
+
+    // first state later than the time; the oldest one is not, the newest one is
+    size_t nLow = 1;
+    size_t nHigh = m_nCount - 1;
+    while (nLow < nHigh)
+    {
+        size_t nMid = nLow + (nHigh - nLow) / 2;
+        if (GetState(nMid).nTime > nTime)
+        {
+            nHigh = nMid;
+        }
+        else
+        {
+            nLow = nMid + 1;
+        }
+    }
+
+    const BeamState& before = GetState(nLow - 1);
+    const BeamState& after = GetState(nLow);
+    INT64 nGap = after.nTime - before.nTime;
+
+    if (nGap > c_BeamHistoryMaxGapTicks)
+    {
+        *pState = (nTime - before.nTime <= after.nTime - nTime) ? before : after;
+        return true;
+    }
+
+    float fWeight = static_cast<float>(nTime - before.nTime) / static_cast<float>(nGap);
+    pState->nTime = nTime;
+    pState->fBeamAngle = before.fBeamAngle + fWeight * (after.fBeamAngle - before.fBeamAngle);
+    pState->fBeamAngleConfidence = before.fBeamAngleConfidence + fWeight * (after.fBeamAngleConfidence - before.fBeamAngleConfidence);
+    pState->bVoiceActive = before.bVoiceActive || (nTime > before.nTime && after.bVoiceActive);
+
+    return true;
+}
+
+/// <summary>
+/// Removes every state
+/// </summary>
+void BeamHistory::Clear()
+{
+    m_nNext = 0;
+    m_nCount = 0;
+}
@@ -0,0 +1,112 @@
+//------------------------------------------------------------------------------
+// <copyright file="BeamHistory.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Recent beam states by the time of the audio they came with, so that a color frame is
+// matched against the beam as it was when the frame was taken rather than as of the
+// latest audio read, which can be up to a whole audio buffer off. The beam is read once
+// per audio read, so a state holds for the end of the audio it came with and is ramped
+// into from the previous one. Audio and color times are both Kinect RelativeTime in
+// 100ns ticks: the sensor's audio is read without times and is stamped through the
+// SensorClock its frame source keeps, and recordings store both as they were stamped.
+
+#pragma once
+
+#include <vector>
+#include "KinectTypes.h"
+#include "AudioEnergy.h"
+
+// Beam states kept; at one per audio read this covers well over ten seconds, and still
+// over half a second if the beam changed with every energy value
+static const size_t c_BeamHistoryCapacity = 256;
+
+// Two states further apart than this, in 100ns ticks, are not interpolated between since
+// the audio in between went missing; the one nearer in time is taken instead
+static const INT64 c_BeamHistoryMaxGapTicks = c_TicksPerSecond / 10;
+
+/// <summary>
+/// Beam state at a point in time
+/// </summary>
+struct BeamState
+{
+    // Time the state holds for, in 100ns ticks
+    INT64               nTime;
+
+    // Beam angle in radians
+    float               fBeamAngle;
+
+    // Beam angle confidence in the range [0,1]
+    float               fBeamAngleConfidence;
+
+    // Whether voice was active in the beam audio
+    bool                bVoiceActive;
+};
+
+class BeamHistory
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    /// <param name="nCapacity">states kept, rounded up to a power of two</param>
+    explicit BeamHistory(size_t nCapacity = c_BeamHistoryCapacity);
+
+    /// <summary>
+    /// Adds a state, dropping the oldest one when full. Times are expected to grow; a
+    /// state not later than the newest ones replaces them, as after the audio clock was
+    /// re-anchored or the source restarted.
+    /// </summary>
+    /// <param name="nTime">time of the state, in 100ns ticks</param>
+    /// <param name="fBeamAngle">beam angle in radians</param>
+    /// <param name="fBeamAngleConfidence">beam angle confidence in the range [0,1]</param>
+    /// <param name="bVoiceActive">whether voice was active in the beam audio</param>
+    void Add(INT64 nTime, float fBeamAngle, float fBeamAngleConfidence, bool bVoiceActive);
+
+    /// <summary>
+    /// Adds the beam states of energy values, in order; of consecutive values under the
+    /// same beam state only the last one is added, where that state held for sure
+    /// </summary>
+    /// <param name="pSamples">energy values</param>
+    /// <param name="nCount">number of energy values</param>
+    void Add(const EnergySample* pSamples, size_t nCount);
+
+    /// <summary>
+    /// Beam state at a point in time, interpolated between the states around it. Before
+    /// the oldest state, after the newest one or within a gap in the audio, the nearest
+    /// state is taken and keeps its own time. Voice counts as active between two states
+    /// if it was in either.
+    /// </summary>
+    /// <param name="nTime">time to look up, in 100ns ticks</param>
+    /// <param name="pState">receives the state; its time is nTime when interpolated</param>
+    /// <returns>false if the history is empty, pState then holds a zero beam</returns>
+    bool GetAt(INT64 nTime, BeamState* pState) const;
+
+    /// <summary>
+    /// Removes every state
+    /// </summary>
+    void Clear();
+
+    /// <summary>
+    /// Number of states held
+    /// </summary>
+    size_t GetCount() const { return m_nCount; }
+
+private:
+    /// <summary>
+    /// State by age, 0 being the oldest one held
+    /// </summary>
+    /// <param name="nIndex">index of the state from the oldest</param>
+    const BeamState& GetState(size_t nIndex) const
+    {
+        return m_states[(m_nNext - m_nCount + nIndex) & m_nMask];
+    }
+
+    std::vector<BeamState>  m_states;
+    size_t                  m_nMask;
+
+    // Slot the next state goes to, and the number of states held before it
+    size_t                  m_nNext;
+    size_t                  m_nCount;
+};
@@ -0,0 +1,340 @@
+//------------------------------------------------------------------------------
+// <copyright file="BenchAudioCapture.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Stress tests of the audio sample ring and of the capture thread, run as console tool commands
+
+#include "KinectTypes.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "PerfClock.h"
+#include "AudioCapture.h"
+#include "AudioEnergy.h"
+#include "ToolCommands.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/// <summary>
+/// Fills in an energy sample whose fields are all derived from its sequence number,
+/// so a consumer can tell a torn record from a whole one
+/// </summary>
+/// <param name="nSequence">sequence number</param>
+/// <param name="pSample">receives the sample</param>
+static void MakeStressSample(UINT32 nSequence, EnergySample* pSample)
+{
+    pSample->nTime = static_cast<INT64>(nSequence) * 25000;
+    pSample->nCaptureNs = static_cast<INT64>(nSequence) * 7;
+    pSample->nSequence = nSequence;
+    pSample->fEnergy = static_cast<float>(nSequence & 0x3FF) / 1024.0f;
+    pSample->fBeamAngle = static_cast<float>(nSequence & 0xFFFF);
+    pSample->fBeamAngleConfidence = static_cast<float>((nSequence >> 3) & 0xFF) / 256.0f;
+    pSample->bVoiceActive = (nSequence >> 5) & 1;
+    pSample->fSpeechToNoiseDb = static_cast<float>(nSequence & 0x7F) * 0.25f;
+}
+
+/// <summary>
+/// Pushes nCount samples through the energy ring from a producer thread while a
+/// slow consumer drains it, checking every popped record
+/// </summary>
+/// <param name="nCount">number of samples to produce</param>
+/// <param name="nRate">producer rate in samples per second, 0 for unpaced</param>
+/// <param name="nConsumerIntervalMs">time the consumer sleeps between drains, 0 to only yield</param>
+/// <param name="bExpectNoLoss">whether any dropped sample is a failure</param>
+/// <returns>true if the run passed</returns>
+static bool RunRingStressPhase(UINT32 nCount, int nRate, int nConsumerIntervalMs, bool bExpectNoLoss)
+{
+    EnergyRing* pRing = new EnergyRing();
+    std::atomic<bool> bProducerDone(false);
+
+    std::thread producer([=, &bProducerDone]()
+    {
+        INT64 nStartNs = GetPerfClockNs();
+        for (UINT32 i = 0; i < nCount; ++i)
+        {
+            if (nRate > 0)
+            {
+                INT64 nDueNs = nStartNs + static_cast<INT64>(i) * 1000000000 / nRate;
+                INT64 nNowNs = GetPerfClockNs();
+                if (nDueNs > nNowNs)
+                {
+                    std::this_thread::sleep_for(std::chrono::nanoseconds(nDueNs - nNowNs));
+                }
+            }
+
+            EnergySample sample;
+            MakeStressSample(i, &sample);
+            pRing->TryPush(sample);
+        }
+        bProducerDone = true;
+    });
+
+    UINT64 nReceived = 0;
+    UINT64 nTorn = 0;
+    UINT64 nGaps = 0;
+    UINT64 nOutOfOrder = 0;
+    UINT32 nExpected = 0;
+    size_t nMaxBacklog = 0;
+    EnergySample samples[256];
+
+    for (;;)
+    {
+        bool bDone = bProducerDone;
+
+        size_t nBacklog = pRing->GetSize();
+        nMaxBacklog = (nBacklog > nMaxBacklog) ? nBacklog : nMaxBacklog;
+
+        size_t nPopped;
+        while ((nPopped = pRing->PopMany(samples, _countof(samples))) > 0)
+        {
+            for (size_t i = 0; i < nPopped; ++i)
+            {
+                EnergySample reference;
+                MakeStressSample(samples[i].nSequence, &reference);
+                if (0 != memcmp(&reference, &samples[i], sizeof(reference)))
+                {
+                    nTorn++;
+                }
+
+                if (samples[i].nSequence < nExpected)
+                {
+                    nOutOfOrder++;
+                }
+                else if (samples[i].nSequence > nExpected)
+                {
+                    nGaps++;
+                }
+                nExpected = samples[i].nSequence + 1;
+            }
+            nReceived += nPopped;
+        }
+
+        if (bDone)
+        {
+            break;
+        }
+
+        if (nConsumerIntervalMs > 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(nConsumerIntervalMs));
+        }
+        else
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    producer.join();
+
+    UINT64 nDropped = pRing->GetDroppedCount();
+    delete pRing;
+
+    bool bPassed = (0 == nTorn) && (0 == nOutOfOrder) && (nReceived + nDropped == nCount) &&
+        (!bExpectNoLoss || (0 == nDropped && 0 == nGaps));
+
+    printf("%-7s produced %u received %llu dropped %llu gaps %llu torn %llu out-of-order %llu max backlog %llu  %s\n",
+        (nRate > 0) ? "paced" : "burst",
+        nCount,
+        static_cast<unsigned long long>(nReceived),
+        static_cast<unsigned long long>(nDropped),
+        static_cast<unsigned long long>(nGaps),
+        static_cast<unsigned long long>(nTorn),
+        static_cast<unsigned long long>(nOutOfOrder),
+        static_cast<unsigned long long>(nMaxBacklog),
+        bPassed ? "PASS" : "FAIL");
+
+    return bPassed;
+}
+
+/// <summary>
+/// ring-stress [--seconds N] [--consumer-ms N]: checks the energy ring for loss and tearing
+/// with a producer at the real energy rate against a slow consumer, then with an unpaced
+/// producer where drops are expected but must be accounted for
+/// </summary>
+/// <param name="argc">number of command arguments</param>
+/// <param name="argv">command arguments, starting after the command name</param>
+/// <returns>process exit code</returns>
+int RingStressCommand(int argc, char** argv)
+{
+    // 16 kHz audio folded 40 samples per energy value
+    const int nEnergyRate = 16000 / 40;
+    int nSeconds = 10;
+    int nConsumerIntervalMs = 250;
+
+    for (int i = 0; i < argc; ++i)
+    {
+        if (IsSwitch(argv[i], "--seconds") && i + 1 < argc)
+        {
+            nSeconds = atoi(argv[++i]);
+        }
+        else if (IsSwitch(argv[i], "--consumer-ms") && i + 1 < argc)
+        {
+            nConsumerIntervalMs = atoi(argv[++i]);
+        }
+    }
+
+    bool bPassed = RunRingStressPhase(static_cast<UINT32>(nSeconds * nEnergyRate), nEnergyRate, nConsumerIntervalMs, true);
+    bPassed = RunRingStressPhase(20000000, 0, 0, false) && bPassed;
+
+    return bPassed ? 0 : 1;
+}
+
+/// <summary>
+/// Beam audio generated against the clock at the sensor's sample rate, so that audio
+/// becomes pending whether or not anybody reads it, as it does on the sensor
+/// </summary>
+class SimulatedAudioSource : public IAudioSampleSource
+{
+public:
+    SimulatedAudioSource() :
+        m_nStartNs(GetPerfClockNs()),
+        m_nSamplesRead(0)
+    {
+    }
+
+    virtual HRESULT Read(float* pSamples, UINT nMaxSamples, UINT* pnRead, INT64* pnTime)
+    {
+        INT64 nSamplesDue = (GetPerfClockNs() - m_nStartNs) * c_AudioSamplesPerSecond / 1000000000;
+        INT64 nPending = nSamplesDue - m_nSamplesRead;
+        UINT nRead = (nPending < nMaxSamples) ? static_cast<UINT>(nPending) : nMaxSamples;
+
+        for (UINT i = 0; i < nRead; ++i)
+        {
+            // 440 Hz tone
+            pSamples[i] = 0.25f * static_cast<float>(sin(2.0 * M_PI * 440.0 * (m_nSamplesRead + i) / c_AudioSamplesPerSecond));
+        }
+
+        *pnRead = nRead;
+        *pnTime = m_nStartNs / 100 + m_nSamplesRead * c_TicksPerSecond / c_AudioSamplesPerSecond;
+        m_nSamplesRead += nRead;
+
+        return (nRead == nMaxSamples) ? S_OK : E_PENDING;
+    }
+
+    virtual void GetBeam(float* pfBeamAngle, float* pfBeamAngleConfidence)
+    {
+        *pfBeamAngle = 0.0f;
+        *pfBeamAngleConfidence = 1.0f;
+    }
+
+private:
+    INT64               m_nStartNs;
+    INT64               m_nSamplesRead;
+};
+
+/// <summary>
+/// audio-capture [--seconds N] [--stall-ms N]: runs the audio capture thread on simulated
+/// audio while the video side stalls every second, and checks that no energy was lost
+/// </summary>
+/// <param name="argc">number of command arguments</param>
+/// <param name="argv">command arguments, starting after the command name</param>
+/// <returns>process exit code</returns>
+int AudioCaptureCommand(int argc, char** argv)
+{
+    // same cadence and buffer size as the application
+    const int nIntervalMs = 50;
+    const UINT nChunkSamples = 2 * nIntervalMs * c_AudioSamplesPerSecond / 1000;
+    const int nFrameMs = 33;
+    int nSeconds = 10;
+    int nStallMs = 500;
+
+    for (int i = 0; i < argc; ++i)
+    {
+        if (IsSwitch(argv[i], "--seconds") && i + 1 < argc)
+        {
+            nSeconds = atoi(argv[++i]);
+        }
+        else if (IsSwitch(argv[i], "--stall-ms") && i + 1 < argc)
+        {
+            nStallMs = atoi(argv[++i]);
+        }
+    }
+
+    SimulatedAudioSource source;
+    AudioCapture* pCapture = new AudioCapture(nChunkSamples, 16);
+    EnergyRing* pRing = pCapture->GetEnergyRing();
+    EnergySample samples[256];
+    UINT64 nReceived = 0;
+    UINT64 nGaps = 0;
+    UINT32 nExpected = 0;
+    INT64 nMaxStalenessTicks = 0;
+
+    INT64 nStartNs = GetPerfClockNs();
+    INT64 nEndNs = nStartNs + static_cast<INT64>(nSeconds) * 1000000000;
+    INT64 nNextStallNs = nStartNs + 1000000000;
+
+    pCapture->Start(&source, nullptr, nIntervalMs);
+
+    // the video side: a frame every nFrameMs, except when it stalls
+    for (bool bStopped = false; !bStopped; )
+    {
+        if (GetPerfClockNs() >= nEndNs)
+        {
+            // one last pass picks up whatever the stopped thread left in the ring
+            pCapture->Stop();
+            bStopped = true;
+        }
+
+        size_t nPopped;
+        while ((nPopped = pRing->PopMany(samples, _countof(samples))) > 0)
+        {
+            for (size_t i = 0; i < nPopped; ++i)
+            {
+                if (samples[i].nSequence != nExpected)
+                {
+                    nGaps++;
+                }
+                nExpected = samples[i].nSequence + 1;
+            }
+
+            // how old the newest beam state is by the time the video side sees it
+            INT64 nStalenessTicks = GetPerfClockTicks() - samples[nPopped - 1].nTime;
+            nMaxStalenessTicks = (nStalenessTicks > nMaxStalenessTicks) ? nStalenessTicks : nMaxStalenessTicks;
+            nReceived += nPopped;
+        }
+
+        if (bStopped)
+        {
+            break;
+        }
+
+        if (GetPerfClockNs() >= nNextStallNs)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(nStallMs));
+            nNextStallNs += 1000000000;
+        }
+        else
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(nFrameMs));
+        }
+    }
+
+    AudioCaptureStats stats;
+    pCapture->GetStats(&stats);
+    delete pCapture;
+
+    bool bPassed = (0 == nGaps) && (0 == stats.nOverruns) && (0 == stats.nReadErrors) &&
+        (nReceived == stats.nSamplesRead / c_AudioSamplesPerEnergySample);
+
+    printf("wake-ups             %llu\n", static_cast<unsigned long long>(stats.nWakeups));
+    printf("chunks read          %llu\n", static_cast<unsigned long long>(stats.nChunksRead));
+    printf("samples read         %llu\n", static_cast<unsigned long long>(stats.nSamplesRead));
+    printf("underruns            %llu\n", static_cast<unsigned long long>(stats.nUnderruns));
+    printf("overruns             %llu\n", static_cast<unsigned long long>(stats.nOverruns));
+    printf("read errors          %llu\n", static_cast<unsigned long long>(stats.nReadErrors));
+    printf("max backlog chunks   %u\n", stats.nMaxBacklogChunks);
+    printf("energy received      %llu\n", static_cast<unsigned long long>(nReceived));
+    printf("energy gaps          %llu\n", static_cast<unsigned long long>(nGaps));
+    printf("max beam staleness   %.1f ms\n", static_cast<double>(nMaxStalenessTicks) / c_TicksPerMillisecond);
+    printf("%s\n", bPassed ? "PASS" : "FAIL");
+
+    return bPassed ? 0 : 1;
+}
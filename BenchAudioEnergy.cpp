@@ -0,0 +1,273 @@
+//------------------------------------------------------------------------------
+// <copyright file="BenchAudioEnergy.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Accuracy and speed of the beam energy meter, run as a console tool command
+
+#include "KinectTypes.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "PerfClock.h"
+#include "AudioEnergy.h"
+#include "ToolCommands.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/// <summary>
+/// The energy loop as it originally ran in the application, one sample at a time with a
+/// call to log10 per energy value; the reference the energy kernels are checked against
+/// </summary>
+/// <param name="pSamples">beam audio samples</param>
+/// <param name="nSampleCount">number of samples</param>
+/// <param name="pfAccumulatedSquareSum">partial block carried between calls</param>
+/// <param name="pnAccumulatedSampleCount">samples in the partial block</param>
+/// <param name="pEnergies">receives the normalized energy values</param>
+static void ReferenceEnergy(const float* pSamples, UINT nSampleCount, float* pfAccumulatedSquareSum, int* pnAccumulatedSampleCount, std::vector<float>* pEnergies)
+{
+    for (UINT i = 0; i < nSampleCount; i++)
+    {
+        *pfAccumulatedSquareSum += pSamples[i] * pSamples[i];
+        ++*pnAccumulatedSampleCount;
+
+        if (*pnAccumulatedSampleCount < c_AudioSamplesPerEnergySample)
+        {
+            continue;
+        }
+
+        float fMeanSquare = *pfAccumulatedSquareSum / c_AudioSamplesPerEnergySample;
+
+        if (fMeanSquare > 1.0f)
+        {
+            fMeanSquare = 1.0f;
+        }
+
+        float fEnergy = c_MinEnergy;
+        if (fMeanSquare > 0.f)
+        {
+            fEnergy = 10.0f*log10(fMeanSquare);
+        }
+
+        pEnergies->push_back((c_MinEnergy - fEnergy) / c_MinEnergy);
+
+        *pfAccumulatedSquareSum = 0.f;
+        *pnAccumulatedSampleCount = 0;
+    }
+}
+
+/// <summary>
+/// Fills a buffer with test audio: alternating seconds of tone, noise, silence, clipping
+/// and near-silent noise, so every branch of the energy loop is exercised
+/// </summary>
+/// <param name="pSamples">receives the samples</param>
+static void MakeTestAudio(std::vector<float>* pSamples)
+{
+    UINT32 nSeed = 12345;
+
+    for (size_t i = 0; i < pSamples->size(); ++i)
+    {
+        nSeed = nSeed * 1664525 + 1013904223;
+        float fNoise = static_cast<float>(nSeed >> 8) / 16777216.0f - 0.5f;
+        float fTone = static_cast<float>(sin(2.0 * M_PI * 440.0 * i / c_AudioSamplesPerSecond));
+
+        switch ((i / c_AudioSamplesPerSecond) % 5)
+        {
+        case 0: (*pSamples)[i] = 0.3f * fTone; break;
+        case 1: (*pSamples)[i] = fNoise; break;
+        case 2: (*pSamples)[i] = 0.0f; break;
+        case 3: (*pSamples)[i] = 1.5f * fTone; break;
+        default: (*pSamples)[i] = 1e-5f * fNoise; break;
+        }
+    }
+}
+
+/// <summary>
+/// Runs audio through an energy meter in chunks and collects the energy values
+/// </summary>
+/// <param name="pMeter">meter to run</param>
+/// <param name="pRing">ring the meter publishes to, drained after every call</param>
+/// <param name="samples">audio to run</param>
+/// <param name="nChunkSamples">samples per call, 0 for pseudo-random chunk sizes</param>
+/// <param name="pEnergies">receives the normalized energy values, may be null</param>
+/// <returns>number of energy values produced</returns>
+static UINT64 RunEnergyMeter(AudioEnergyMeter* pMeter, EnergyRing* pRing, const std::vector<float>& samples, UINT nChunkSamples, std::vector<float>* pEnergies)
+{
+    EnergySample energy[256];
+    UINT64 nProduced = 0;
+    UINT32 nSeed = 777;
+
+    for (size_t i = 0; i < samples.size(); )
+    {
+        UINT nChunk = nChunkSamples;
+        if (0 == nChunk)
+        {
+            // sizes from 1 to 3200 samples leave blocks straddling the reads
+            nSeed = nSeed * 1664525 + 1013904223;
+            nChunk = 1 + (nSeed >> 8) % 3200;
+        }
+        nChunk = static_cast<UINT>((std::min)(static_cast<size_t>(nChunk), samples.size() - i));
+
+        pMeter->Process(0, &samples[i], nChunk, 0.0f, 1.0f, true, 0.0f, pRing);
+        i += nChunk;
+
+        size_t nPopped;
+        while ((nPopped = pRing->PopMany(energy, _countof(energy))) > 0)
+        {
+            for (size_t j = 0; pEnergies && j < nPopped; ++j)
+            {
+                pEnergies->push_back(energy[j].fEnergy);
+            }
+            nProduced += nPopped;
+        }
+    }
+
+    return nProduced;
+}
+
+/// <summary>
+/// energy-bench [--seconds N] [--iterations N]: checks the energy kernels against the original
+/// scalar loop, then measures their throughput on the application's read size
+/// </summary>
+/// <param name="argc">number of command arguments</param>
+/// <param name="argv">command arguments, starting after the command name</param>
+/// <returns>process exit code</returns>
+int EnergyBenchCommand(int argc, char** argv)
+{
+    // largest difference to the original, in dB, that still counts as a pass; far below
+    // the resolution of the energy display (90 dB over a few hundred pixels)
+    const double fMaxErrorDb = 1e-3;
+    const UINT nReadSamples = 1600;
+    int nSeconds = 60;
+    int nIterations = 20;
+
+    for (int i = 0; i < argc; ++i)
+    {
+        if (IsSwitch(argv[i], "--seconds") && i + 1 < argc)
+        {
+            nSeconds = atoi(argv[++i]);
+        }
+        else if (IsSwitch(argv[i], "--iterations") && i + 1 < argc)
+        {
+            nIterations = atoi(argv[++i]);
+        }
+    }
+
+    std::vector<float> samples(static_cast<size_t>((std::max)(nSeconds, 1)) * c_AudioSamplesPerSecond);
+    MakeTestAudio(&samples);
+
+    bool bPassed = true;
+    EnergyRing* pRing = new EnergyRing();
+
+    // dB conversion on its own, across the whole range of mean squares
+    double fMaxDbError = 0.0;
+    for (float fPower = 1e-30f; fPower <= 1.0f; fPower *= 1.0001f)
+    {
+        double fError = fabs(PowerToDecibels(fPower) - 10.0 * log10(static_cast<double>(fPower)));
+        fMaxDbError = (fError > fMaxDbError) ? fError : fMaxDbError;
+    }
+    printf("dB conversion        max error %.2e dB\n", fMaxDbError);
+    bPassed = bPassed && (fMaxDbError < 1e-4);
+
+    // accuracy against the original loop, with reads that split blocks
+    std::vector<float> reference;
+    {
+        float fSum = 0.0f;
+        int nCount = 0;
+        UINT32 nSeed = 777;
+        for (size_t i = 0; i < samples.size(); )
+        {
+            nSeed = nSeed * 1664525 + 1013904223;
+            UINT nChunk = static_cast<UINT>((std::min)(static_cast<size_t>(1 + (nSeed >> 8) % 3200), samples.size() - i));
+            ReferenceEnergy(&samples[i], nChunk, &fSum, &nCount, &reference);
+            i += nChunk;
+        }
+    }
+
+    for (int k = 0; k < EnergyKernel_Count; ++k)
+    {
+        EnergyKernel kernel = static_cast<EnergyKernel>(k);
+        if (!IsEnergyKernelSupported(kernel))
+        {
+            printf("%-7s accuracy    not supported\n", GetEnergyKernelName(kernel));
+            continue;
+        }
+
+        AudioEnergyMeter meter(kernel);
+        std::vector<float> energies;
+        RunEnergyMeter(&meter, pRing, samples, 0, &energies);
+
+        UINT64 nExact = 0;
+        double fMaxError = 0.0;
+        for (size_t i = 0; i < energies.size() && i < reference.size(); ++i)
+        {
+            nExact += (0 == memcmp(&energies[i], &reference[i], sizeof(float))) ? 1 : 0;
+
+            // normalized energy back to dB
+            double fError = fabs(static_cast<double>(energies[i]) - reference[i]) * -c_MinEnergy;
+            fMaxError = (fError > fMaxError) ? fError : fMaxError;
+        }
+
+        bool bKernelPassed = (energies.size() == reference.size()) && (fMaxError <= fMaxErrorDb);
+        bPassed = bPassed && bKernelPassed;
+
+        printf("%-7s accuracy    values %llu/%llu bit-exact %llu max error %.2e dB  %s\n",
+            GetEnergyKernelName(kernel),
+            static_cast<unsigned long long>(energies.size()),
+            static_cast<unsigned long long>(reference.size()),
+            static_cast<unsigned long long>(nExact),
+            fMaxError,
+            bKernelPassed ? "PASS" : "FAIL");
+    }
+
+    // throughput, in reads of the size the capture thread uses
+    double fReferenceNs = 0.0;
+    {
+        std::vector<float> energies;
+        energies.reserve(samples.size() / c_AudioSamplesPerEnergySample + 1);
+        INT64 nStartNs = GetPerfClockNs();
+        for (int iIteration = 0; iIteration < nIterations; ++iIteration)
+        {
+            float fSum = 0.0f;
+            int nCount = 0;
+            energies.clear();
+            for (size_t i = 0; i < samples.size(); i += nReadSamples)
+            {
+                UINT nChunk = static_cast<UINT>((std::min)(static_cast<size_t>(nReadSamples), samples.size() - i));
+                ReferenceEnergy(&samples[i], nChunk, &fSum, &nCount, &energies);
+            }
+        }
+        fReferenceNs = static_cast<double>(GetPerfClockNs() - nStartNs) / (static_cast<double>(nIterations) * samples.size());
+        printf("%-7s speed       %.3f ns/sample  %.1f Msamples/s\n", "orig", fReferenceNs, 1e3 / fReferenceNs);
+    }
+
+    for (int k = 0; k < EnergyKernel_Count; ++k)
+    {
+        EnergyKernel kernel = static_cast<EnergyKernel>(k);
+        if (!IsEnergyKernelSupported(kernel))
+        {
+            continue;
+        }
+
+        AudioEnergyMeter meter(kernel);
+        INT64 nStartNs = GetPerfClockNs();
+        for (int iIteration = 0; iIteration < nIterations; ++iIteration)
+        {
+            RunEnergyMeter(&meter, pRing, samples, nReadSamples, nullptr);
+        }
+        double fNs = static_cast<double>(GetPerfClockNs() - nStartNs) / (static_cast<double>(nIterations) * samples.size());
+
+        printf("%-7s speed       %.3f ns/sample  %.1f Msamples/s  %.2fx\n", GetEnergyKernelName(kernel), fNs, 1e3 / fNs, fReferenceNs / fNs);
+    }
+
+    delete pRing;
+
+    printf("%s\n", bPassed ? "PASS" : "FAIL");
+    return bPassed ? 0 : 1;
+}
@@ -0,0 +1,274 @@
+//------------------------------------------------------------------------------
+// <copyright file="BenchColorConversion.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Accuracy and speed of the YUY2 conversion, run as a console tool command
+
+#include "KinectTypes.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "PerfClock.h"
+#include "ColorConversion.h"
+#include "ToolCommands.h"
+
+/// <summary>
+/// Straightforward YUY2 to BGRA conversion in floating point, one pixel at a time; the
+/// reference the color kernels are checked and measured against
+/// </summary>
+/// <param name="pSource">YUY2 image</param>
+/// <param name="nSourceStride">length (in bytes) of a row of the YUY2 image</param>
+/// <param name="pDest">BGRA image of the same size</param>
+/// <param name="nDestStride">length (in bytes) of a row of the BGRA image</param>
+/// <param name="pRect">rectangle to convert, on whole macropixels</param>
+static void ReferenceYuy2ToBgra(const BYTE* pSource, int nSourceStride, BYTE* pDest, int nDestStride, const RectI* pRect)
+{
+    for (int y = pRect->Top; y < pRect->Bottom; ++y)
+    {
+        for (int x = pRect->Left; x < pRect->Right; ++x)
+        {
+            const BYTE* pPair = pSource + y * nSourceStride + (x & ~1) * 2;
+            float fC = 1.164383f * (pPair[(x & 1) * 2] - 16);
+            float fD = static_cast<float>(pPair[1] - 128);
+            float fE = static_cast<float>(pPair[3] - 128);
+
+            float fChannels[3] =
+            {
+                fC + 2.017232f * fD,
+                fC - 0.391762f * fD - 0.812968f * fE,
+                fC + 1.596027f * fE
+            };
+
+            BYTE* pPixel = pDest + y * nDestStride + x * 4;
+            for (int i = 0; i < 3; ++i)
+            {
+                float fValue = floor(fChannels[i] + 0.5f);
+                pPixel[i] = static_cast<BYTE>((fValue < 0.0f) ? 0.0f : ((fValue > 255.0f) ? 255.0f : fValue));
+            }
+            pPixel[3] = 0xFF;
+        }
+    }
+}
+
+/// <summary>
+/// yuy2-bench [--iterations N]: checks every color kernel against the scalar kernel and a
+/// floating point reference on synthetic frames, then measures them per megapixel on the
+/// full frame and on a speaker sized region
+/// </summary>
+/// <param name="argc">number of command arguments</param>
+/// <param name="argv">command arguments, starting after the command name</param>
+/// <returns>process exit code</returns>
+int Yuy2BenchCommand(int argc, char** argv)
+{
+    const int nWidth = 1920;
+    const int nHeight = 1080;
+    const int nSourceStride = nWidth * 2;
+    const int nDestStride = nWidth * 4;
+    const BYTE cGuard = 0x5A;
+    int nIterations = 20;
+
+    for (int i = 0; i < argc; ++i)
+    {
+        if (IsSwitch(argv[i], "--iterations") && i + 1 < argc)
+        {
+            nIterations = (std::max)(atoi(argv[++i]), 1);
+        }
+    }
+
+    // random pixels, with the extremes of every channel in the first rows
+    std::vector<BYTE> source(static_cast<size_t>(nSourceStride) * nHeight);
+    UINT32 nSeed = 4242;
+    for (size_t i = 0; i < source.size(); ++i)
+    {
+        nSeed = nSeed * 1664525 + 1013904223;
+        source[i] = (i < 4 * 256 * 4) ? static_cast<BYTE>((i % 4 == 0) ? i / 16 : ((i / 4) % 256)) : static_cast<BYTE>(nSeed >> 24);
+    }
+
+    std::vector<BYTE> expected(static_cast<size_t>(nDestStride) * nHeight);
+    std::vector<BYTE> actual(expected.size());
+    std::vector<BYTE> reference(expected.size());
+
+    const RectI c_TestRects[] =
+    {
+        { 0, 0, nWidth, nHeight },          // full frame
+        { 812, 236, 1164, 640 },            // speaker region
+        { 0, 0, 2, 1 },                     // single macropixel
+        { 1900, 1000, 1920, 1080 },         // bottom right corner
+        { 31, 17, 67, 19 },                 // odd edges, widened to macropixels
+        { 6, 500, 36, 501 },                // shorter than one vector
+    };
+
+    bool bPassed = true;
+    int nMaxReferenceError = 0;
+
+    for (size_t iRect = 0; iRect < _countof(c_TestRects); ++iRect)
+    {
+        RectI rect = c_TestRects[iRect];
+        AlignRectToYuy2(&rect, nWidth);
+
+        memset(&expected[0], cGuard, expected.size());
+        ConvertYuy2ToBgra(ColorKernel_Scalar, &source[0], nSourceStride, &expected[0], nDestStride, &rect);
+
+        memset(&reference[0], cGuard, reference.size());
+        ReferenceYuy2ToBgra(&source[0], nSourceStride, &reference[0], nDestStride, &rect);
+
+        for (size_t i = 0; i < expected.size(); ++i)
+        {
+            int nError = abs(static_cast<int>(expected[i]) - reference[i]);
+            nMaxReferenceError = (std::max)(nMaxReferenceError, nError);
+        }
+
+        for (int k = ColorKernel_Sse41; k < ColorKernel_Count; ++k)
+        {
+            ColorKernel kernel = static_cast<ColorKernel>(k);
+            if (!IsColorKernelSupported(kernel))
+            {
+                continue;
+            }
+
+            memset(&actual[0], cGuard, actual.size());
+            ConvertYuy2ToBgra(kernel, &source[0], nSourceStride, &actual[0], nDestStride, &rect);
+
+            // the whole image is compared, so writes outside the rectangle are caught too
+            if (0 != memcmp(&actual[0], &expected[0], actual.size()))
+            {
+                printf("%-7s mismatch in rect %d,%d-%d,%d\n", GetColorKernelName(kernel), rect.Left, rect.Top, rect.Right, rect.Bottom);
+                bPassed = false;
+            }
+        }
+    }
+
+    // the fixed point coefficients are within one step of the exact ones
+    bool bReferencePassed = nMaxReferenceError <= 2;
+    printf("reference            max difference %d  %s\n", nMaxReferenceError, bReferencePassed ? "PASS" : "FAIL");
+    bPassed = bPassed && bReferencePassed;
+
+    for (int k = ColorKernel_Sse41; k < ColorKernel_Count; ++k)
+    {
+        ColorKernel kernel = static_cast<ColorKernel>(k);
+        printf("%-7s accuracy    %s\n", GetColorKernelName(kernel),
+            !IsColorKernelSupported(kernel) ? "not supported" : (bPassed ? "bit-exact with scalar" : "see mismatches above"));
+    }
+
+    // throughput per megapixel on the full frame and on a speaker region
+    const RectI c_BenchRects[] =
+    {
+        { 0, 0, nWidth, nHeight },
+        { 812, 236, 1164, 640 },
+    };
+
+    for (size_t iRect = 0; iRect < _countof(c_BenchRects); ++iRect)
+    {
+        const RectI& rect = c_BenchRects[iRect];
+        double fMegapixels = (rect.Right - rect.Left) * (rect.Bottom - rect.Top) / 1e6;
+        double fReferenceMs = 0.0;
+
+        for (int k = -1; k < ColorKernel_Count; ++k)
+        {
+            ColorKernel kernel = static_cast<ColorKernel>(k);
+            if (k >= 0 && !IsColorKernelSupported(kernel))
+            {
+                continue;
+            }
+
+            INT64 nStartNs = GetPerfClockNs();
+            for (int iIteration = 0; iIteration < nIterations; ++iIteration)
+            {
+                if (k < 0)
+                {
+                    ReferenceYuy2ToBgra(&source[0], nSourceStride, &actual[0], nDestStride, &rect);
+                }
+                else
+                {
+                    ConvertYuy2ToBgra(kernel, &source[0], nSourceStride, &actual[0], nDestStride, &rect);
+                }
+            }
+            double fMs = static_cast<double>(GetPerfClockNs() - nStartNs) / nIterations / 1e6;
+            fReferenceMs = (k < 0) ? fMs : fReferenceMs;
+
+            printf("%-7s %-12s %7.3f ms/frame  %6.3f ms/Mpix  %7.1f Mpix/s  %5.1fx\n",
+                (k < 0) ? "float" : GetColorKernelName(kernel),
+                (0 == iRect) ? "full frame" : "speaker roi",
+                fMs, fMs / fMegapixels, fMegapixels * 1e3 / fMs, fReferenceMs / fMs);
+        }
+    }
+
+    // half resolution previews: the sensor's width and another specialized one, then
+    // widths that go through the generic loop in one chunk and in several
+    const int c_HalfWidths[] = { nWidth, 1280, 1000, 1600 };
+    bool bHalfPassed = true;
+
+    for (size_t iWidth = 0; iWidth < _countof(c_HalfWidths); ++iWidth)
+    {
+        int nHalfWidth = c_HalfWidths[iWidth];
+
+        memset(&expected[0], cGuard, expected.size());
+        ConvertYuy2ToBgraHalf(ColorKernel_Scalar, &source[0], nSourceStride, nHalfWidth, nHeight, &expected[0], nDestStride);
+        memset(&reference[0], cGuard, reference.size());
+        ShrinkBgraHalf(ColorKernel_Scalar, &source[0], nSourceStride, nHalfWidth / 2, nHeight, &reference[0], nDestStride);
+
+        for (int k = ColorKernel_Sse41; k < ColorKernel_Count; ++k)
+        {
+            ColorKernel kernel = static_cast<ColorKernel>(k);
+            if (!IsColorKernelSupported(kernel))
+            {
+                continue;
+            }
+
+            memset(&actual[0], cGuard, actual.size());
+            ConvertYuy2ToBgraHalf(kernel, &source[0], nSourceStride, nHalfWidth, nHeight, &actual[0], nDestStride);
+            if (0 != memcmp(&actual[0], &expected[0], actual.size()))
+            {
+                printf("%-7s half mismatch at width %d\n", GetColorKernelName(kernel), nHalfWidth);
+                bHalfPassed = false;
+            }
+
+            // the YUY2 bytes double as a BGRA image of half the width
+            memset(&actual[0], cGuard, actual.size());
+            ShrinkBgraHalf(kernel, &source[0], nSourceStride, nHalfWidth / 2, nHeight, &actual[0], nDestStride);
+            if (0 != memcmp(&actual[0], &reference[0], actual.size()))
+            {
+                printf("%-7s shrink mismatch at width %d\n", GetColorKernelName(kernel), nHalfWidth / 2);
+                bHalfPassed = false;
+            }
+        }
+    }
+
+    printf("half resolution      %s\n", bHalfPassed ? "bit-exact with scalar  PASS" : "FAIL");
+    bPassed = bPassed && bHalfPassed;
+
+    // what a background costs at either resolution
+    RectI fullRect = { 0, 0, nWidth, nHeight };
+    for (int k = 0; k < ColorKernel_Count; ++k)
+    {
+        ColorKernel kernel = static_cast<ColorKernel>(k);
+        if (!IsColorKernelSupported(kernel))
+        {
+            continue;
+        }
+
+        INT64 nStartNs = GetPerfClockNs();
+        for (int iIteration = 0; iIteration < nIterations; ++iIteration)
+        {
+            ConvertYuy2ToBgra(kernel, &source[0], nSourceStride, &actual[0], nDestStride, &fullRect);
+        }
+        double fFullMs = static_cast<double>(GetPerfClockNs() - nStartNs) / nIterations / 1e6;
+
+        nStartNs = GetPerfClockNs();
+        for (int iIteration = 0; iIteration < nIterations; ++iIteration)
+        {
+            ConvertYuy2ToBgraHalf(kernel, &source[0], nSourceStride, nWidth, nHeight, &actual[0], nDestStride / 2);
+        }
+        double fHalfMs = static_cast<double>(GetPerfClockNs() - nStartNs) / nIterations / 1e6;
+
+        printf("%-7s background   %7.3f ms full  %7.3f ms half  %5.1fx\n", GetColorKernelName(kernel), fFullMs, fHalfMs, fFullMs / fHalfMs);
+    }
+
+    printf("%s\n", bPassed ? "PASS" : "FAIL");
+    return bPassed ? 0 : 1;
+}
@@ -0,0 +1,177 @@
+//------------------------------------------------------------------------------
+// <copyright file="BenchFrameBufferPool.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Stress test of the frame buffer pool, run as a console tool command
+
+#include "KinectTypes.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "PerfClock.h"
+#include "BoundedQueue.h"
+#include "FrameBufferPool.h"
+#include "ToolCommands.h"
+
+struct PoolStressItem
+{
+    UINT32              nSequence;
+    FrameBufferHandle   buffer;
+};
+
+/// <summary>
+/// Checks that a buffer is aligned and holds the pattern written for a sequence number
+/// </summary>
+/// <param name="item">buffer and the sequence number it was filled for</param>
+/// <returns>true if it does</returns>
+static bool CheckPoolStressBuffer(const PoolStressItem& item)
+{
+    const BYTE* pData = item.buffer.GetData();
+    BYTE nValue = static_cast<BYTE>(item.nSequence * 31 + 7);
+    UINT32 nSequence;
+
+    if (nullptr == pData || 0 != reinterpret_cast<size_t>(pData) % c_FrameBufferAlignment)
+    {
+        return false;
+    }
+
+    memcpy(&nSequence, pData, sizeof(nSequence));
+    for (size_t i = sizeof(nSequence); i < item.buffer.GetSize(); ++i)
+    {
+        if (pData[i] != nValue)
+        {
+            return false;
+        }
+    }
+
+    return nSequence == item.nSequence;
+}
+
+/// <summary>
+/// pool-stress [--seconds N] [--large-pages]: fills pooled buffers as fast as the pool
+/// hands them out and shares every one between a fast and a slow consumer, checking that
+/// no buffer is reused while referenced, that every buffer is aligned, and that all of
+/// them are back in the pool at the end
+/// </summary>
+/// <param name="argc">number of command arguments</param>
+/// <param name="argv">command arguments, starting after the command name</param>
+/// <returns>process exit code</returns>
+int PoolStressCommand(int argc, char** argv)
+{
+    // an odd size, so that the stride has to be rounded up to keep the alignment
+    const size_t cbBuffer = 256 * 1024 + 13;
+    const UINT32 nBuffers = 8;
+    int nSeconds = 5;
+    bool bLargePages = false;
+
+    for (int i = 0; i < argc; ++i)
+    {
+        if (IsSwitch(argv[i], "--seconds") && i + 1 < argc)
+        {
+            nSeconds = atoi(argv[++i]);
+        }
+        else if (IsSwitch(argv[i], "--large-pages"))
+        {
+            bLargePages = true;
+        }
+    }
+
+    FrameBufferPool pool;
+    HRESULT hr = pool.Create(cbBuffer, nBuffers, bLargePages);
+    if (FAILED(hr))
+    {
+        fprintf(stderr, "pool-stress: failed to create the pool (0x%08x)\n", static_cast<unsigned int>(hr));
+        return 1;
+    }
+
+    BoundedQueue<PoolStressItem> fastQueue(nBuffers, QueueFull_Block);
+    BoundedQueue<PoolStressItem> slowQueue(nBuffers, QueueFull_Block);
+    std::atomic<UINT64> nReceived(0);
+    std::atomic<UINT64> nCorrupt(0);
+
+    // the slow consumer holds on to its buffers for a while every few frames, so that
+    // the pool runs dry now and then
+    std::thread consumers[2];
+    for (int iConsumer = 0; iConsumer < 2; ++iConsumer)
+    {
+        BoundedQueue<PoolStressItem>* pQueue = (0 == iConsumer) ? &fastQueue : &slowQueue;
+        consumers[iConsumer] = std::thread([=, &nReceived, &nCorrupt]()
+        {
+            PoolStressItem item;
+            while (pQueue->Pop(&item, -1))
+            {
+                if (!CheckPoolStressBuffer(item))
+                {
+                    nCorrupt++;
+                }
+
+                if (1 == iConsumer && 0 == item.nSequence % 16)
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+                }
+
+                item.buffer.Reset();
+                nReceived++;
+            }
+        });
+    }
+
+    UINT32 nProduced = 0;
+    INT64 nAcquireNs = 0;
+    INT64 nMaxAcquireNs = 0;
+    INT64 nEndNs = GetPerfClockNs() + static_cast<INT64>(nSeconds) * 1000000000;
+    PoolStressItem item;
+
+    while (GetPerfClockNs() < nEndNs)
+    {
+        INT64 nStartNs = GetPerfClockNs();
+        bool bAcquired = pool.Acquire(&item.buffer);
+        INT64 nNs = GetPerfClockNs() - nStartNs;
+
+        if (!bAcquired)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        nAcquireNs += nNs;
+        nMaxAcquireNs = (nNs > nMaxAcquireNs) ? nNs : nMaxAcquireNs;
+
+        item.nSequence = nProduced++;
+        memcpy(item.buffer.GetData(), &item.nSequence, sizeof(item.nSequence));
+        memset(item.buffer.GetData() + sizeof(item.nSequence), static_cast<BYTE>(item.nSequence * 31 + 7), item.buffer.GetSize() - sizeof(item.nSequence));
+
+        bool bEvicted = false;
+        PoolStressItem evicted;
+        fastQueue.Push(item, &evicted, &bEvicted);
+        slowQueue.Push(item, &evicted, &bEvicted);
+        item.buffer.Reset();
+    }
+
+    fastQueue.Close();
+    slowQueue.Close();
+    consumers[0].join();
+    consumers[1].join();
+
+    FrameBufferPoolStats stats;
+    pool.GetStats(&stats);
+
+    bool bPassed = (0 == nCorrupt) && (0 == stats.nInUse) && (2ULL * nProduced == nReceived) &&
+        (stats.nAcquired == nProduced) && (stats.nHighWater <= nBuffers);
+
+    printf("pool %u x %llu bytes%s\n", stats.nBuffers, static_cast<unsigned long long>(stats.cbBuffer),
+        stats.bLargePages ? " in large pages" : "");
+    printf("produced %u received %llu corrupt %llu exhausted %llu high water %u held at end %u\n",
+        nProduced, static_cast<unsigned long long>(nReceived.load()), static_cast<unsigned long long>(nCorrupt.load()),
+        static_cast<unsigned long long>(stats.nExhausted), stats.nHighWater, stats.nInUse);
+    printf("acquire mean %.0f ns max %.0f ns\n", nProduced ? static_cast<double>(nAcquireNs) / nProduced : 0.0,
+        static_cast<double>(nMaxAcquireNs));
+    printf("%s\n", bPassed ? "PASS" : "FAIL");
+
+    return bPassed ? 0 : 1;
+}
@@ -0,0 +1,351 @@
+//------------------------------------------------------------------------------
+// <copyright file="BenchFrameCodec.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Compression and round trip checks of the color frame codec, run as a console tool command
+
+#include "KinectTypes.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include "FrameCodec.h"
+#include "SessionRecording.h"
+#include "ToolCommands.h"
+
+/// <summary>
+/// Renders a frame of a synthetic YUY2 scene for codec-bench: shaded and textured walls,
+/// a few textured shapes moving across them, and sensor noise of a standard deviation
+/// of about 1.5 levels over everything
+/// </summary>
+/// <param name="background">the walls, rendered once</param>
+/// <param name="nWidth">width of the frame in pixels</param>
+/// <param name="nHeight">height of the frame in pixels</param>
+/// <param name="iFrame">index of the frame, which sets where the shapes are</param>
+/// <param name="pnRandom">state of the noise generator</param>
+/// <param name="pFrame">receives the frame, two bytes per pixel</param>
+static void RenderCodecScene(const std::vector<BYTE>& background, int nWidth, int nHeight, int iFrame, UINT64* pnRandom, BYTE* pFrame)
+{
+    const int nStride = nWidth * 2;
+    memcpy(pFrame, &background[0], background.size());
+
+    for (int iShape = 0; iShape < 4; ++iShape)
+    {
+        int nRadius = 90 + 20 * iShape;
+        int nCenterX = (300 + 400 * iShape + iFrame * (3 + iShape)) % nWidth;
+        int nCenterY = 250 + 180 * iShape + ((iFrame * (iShape + 1)) % 40);
+
+        for (int y = (std::max)(nCenterY - nRadius, 0); y < (std::min)(nCenterY + nRadius, nHeight); ++y)
+        {
+            BYTE* pRow = pFrame + static_cast<size_t>(y) * nStride;
+            for (int x = (std::max)(nCenterX - nRadius, 0) & ~1; x < (std::min)(nCenterX + nRadius, nWidth); x += 2)
+            {
+                int dx = x - nCenterX;
+                int dy = y - nCenterY;
+                if (dx * dx + dy * dy <= nRadius * nRadius)
+                {
+                    pRow[2 * x] = static_cast<BYTE>(120 + 40 * iShape + (((x - nCenterX + y) >> 3) & 15));
+                    pRow[2 * x + 1] = static_cast<BYTE>(100 + 20 * iShape);
+                    pRow[2 * x + 2] = static_cast<BYTE>(120 + 40 * iShape + (((x - nCenterX + y + 1) >> 3) & 15));
+                    pRow[2 * x + 3] = static_cast<BYTE>(150 - 15 * iShape);
+                }
+            }
+        }
+    }
+
+    // three uniform variables summed are near enough to a normal distribution
+    UINT64 nRandom = *pnRandom;
+    size_t cbFrame = static_cast<size_t>(nStride) * nHeight;
+    for (size_t i = 0; i < cbFrame; ++i)
+    {
+        nRandom ^= nRandom << 13;
+        nRandom ^= nRandom >> 7;
+        nRandom ^= nRandom << 17;
+
+        float fNoise = (static_cast<float>((nRandom & 7) + ((nRandom >> 3) & 7) + ((nRandom >> 6) & 7)) - 10.5f) * 0.38f;
+        int nValue = static_cast<int>(pFrame[i] + fNoise + ((fNoise >= 0.0f) ? 0.5f : -0.5f));
+        pFrame[i] = static_cast<BYTE>((std::min)((std::max)(nValue, 0), 255));
+    }
+    *pnRandom = nRandom;
+}
+
+/// <summary>
+/// Encodes and decodes a set of frames with the given options, checking every decoded
+/// byte against the original
+/// </summary>
+/// <param name="frames">frames to code, in order</param>
+/// <param name="colorFormat">format of the frames</param>
+/// <param name="nHeight">rows of the frames</param>
+/// <param name="nStride">bytes per row</param>
+/// <param name="options">how to code them</param>
+/// <param name="pEncodeStats">receives the counters of the encoder</param>
+/// <param name="pDecodeStats">receives the counters of the decoder</param>
+/// <param name="pnMaxError">receives the largest difference of a decoded byte from the original</param>
+/// <returns>indicates success or failure of the coding</returns>
+static HRESULT RunCodecPass(const std::vector<std::vector<BYTE> >& frames, ColorImageFormat colorFormat, int nHeight, int nStride,
+    const FrameCodecOptions& options, FrameCodecStats* pEncodeStats, FrameCodecStats* pDecodeStats, int* pnMaxError)
+{
+    FrameEncoder* pEncoder = new FrameEncoder(options);
+    FrameDecoder* pDecoder = new FrameDecoder(options.nThreads);
+    std::vector<std::vector<BYTE> > encoded(frames.size());
+    HRESULT hr = S_OK;
+
+    for (size_t i = 0; i < frames.size() && SUCCEEDED(hr); ++i)
+    {
+        const BYTE* pEncoded = nullptr;
+        UINT cbEncoded = 0;
+        hr = pEncoder->Encode(colorFormat, nHeight, nStride, &frames[i][0], &pEncoded, &cbEncoded);
+        if (SUCCEEDED(hr))
+        {
+            encoded[i].assign(pEncoded, pEncoded + cbEncoded);
+        }
+    }
+
+    // decoding is timed on its own, the way replay decodes, then checked
+    std::vector<int> maxErrors(frames.size(), 0);
+    for (size_t i = 0; i < frames.size() && SUCCEEDED(hr); ++i)
+    {
+        const BYTE* pPixels = nullptr;
+        hr = pDecoder->Decode(colorFormat, nHeight, nStride, &encoded[i][0], static_cast<UINT>(encoded[i].size()), &pPixels);
+
+        for (size_t j = 0; SUCCEEDED(hr) && j < frames[i].size(); ++j)
+        {
+            maxErrors[i] = (std::max)(maxErrors[i], abs(pPixels[j] - frames[i][j]));
+        }
+    }
+
+    *pEncodeStats = pEncoder->GetStats();
+    *pDecodeStats = pDecoder->GetStats();
+    *pnMaxError = maxErrors.empty() ? 0 : *std::max_element(maxErrors.begin(), maxErrors.end());
+
+    delete pDecoder;
+    delete pEncoder;
+    return hr;
+}
+
+/// <summary>
+/// Decodes a key frame with its header damaged in ways that once slipped through: tiles
+/// taller than the frame, including so tall that the tile count wraps around to zero.
+/// Every damaged frame has to be rejected, and the frame as it was has to decode after.
+/// </summary>
+/// <param name="frame">frame to code</param>
+/// <param name="colorFormat">format of the frame</param>
+/// <param name="nHeight">rows of the frame</param>
+/// <param name="nStride">bytes per row</param>
+/// <param name="pnRejected">receives the number of damaged frames rejected</param>
+/// <returns>number of damaged frames tried, or -1 if the intact frame failed to code</returns>
+static int CheckCorruptHeaders(const std::vector<BYTE>& frame, ColorImageFormat colorFormat, int nHeight, int nStride, int* pnRejected)
+{
+    FrameCodecOptions options;
+    options.nThreads = 1;
+    FrameEncoder* pEncoder = new FrameEncoder(options);
+    FrameDecoder* pDecoder = new FrameDecoder(1);
+
+    const BYTE* pEncoded = nullptr;
+    UINT cbEncoded = 0;
+    HRESULT hr = pEncoder->Encode(colorFormat, nHeight, nStride, &frame[0], &pEncoded, &cbEncoded);
+    std::vector<BYTE> encoded;
+    if (SUCCEEDED(hr))
+    {
+        encoded.assign(pEncoded, pEncoded + cbEncoded);
+    }
+
+    // rows per tile and the tile count they are stored with
+    const UINT32 damage[][2] =
+    {
+        { 0xffffffff, 0 },
+        { 0x80000000, 1 },
+        { static_cast<UINT32>(nHeight) + 1, 1 },
+    };
+
+    *pnRejected = 0;
+    for (size_t i = 0; i < _countof(damage) && SUCCEEDED(hr); ++i)
+    {
+        std::vector<BYTE> damaged(encoded);
+        EncodedColorHeader header;
+        memcpy(&header, &damaged[0], sizeof(header));
+        header.nTileRows = damage[i][0];
+        header.nTiles = damage[i][1];
+        memcpy(&damaged[0], &header, sizeof(header));
+
+        const BYTE* pPixels = nullptr;
+        if (FAILED(pDecoder->Decode(colorFormat, nHeight, nStride, &damaged[0], static_cast<UINT>(damaged.size()), &pPixels)))
+        {
+            ++*pnRejected;
+        }
+    }
+
+    const BYTE* pPixels = nullptr;
+    if (SUCCEEDED(hr))
+    {
+        hr = pDecoder->Decode(colorFormat, nHeight, nStride, &encoded[0], static_cast<UINT>(encoded.size()), &pPixels);
+    }
+
+    bool bIntact = SUCCEEDED(hr) && 0 == memcmp(pPixels, &frame[0], frame.size());
+
+    delete pDecoder;
+    delete pEncoder;
+    return bIntact ? static_cast<int>(_countof(damage)) : -1;
+}
+
+/// <summary>
+/// codec-bench [recording] [--frames N] [--max-error N] [--threads N] [--keyframe N]:
+/// encodes and decodes color frames, those of a recording or of a synthetic 1080p YUY2
+/// scene, losslessly and with the given maximum error, on one thread and on the given
+/// number of threads. Reports the compression ratio and the encode and decode rates in
+/// MB of frames per second, both per core and on the wall clock, against the 30 frames
+/// per second of the sensor. Checks that lossless coding decodes every byte and that
+/// no byte of near-lossless coding is off by more than the maximum error, and that
+/// frames with a damaged header are rejected.
+/// </summary>
+/// <param name="argc">number of command arguments</param>
+/// <param name="argv">command arguments, starting after the command name</param>
+/// <returns>process exit code</returns>
+int CodecBenchCommand(int argc, char** argv)
+{
+    const char* szPath = nullptr;
+    int nFrames = 60;
+    int nMaxError = c_FrameCodecNearLosslessMaxError;
+    int nThreads = (std::max)(static_cast<int>(std::thread::hardware_concurrency()), 1);
+    int nKeyFrameInterval = c_FrameCodecDefaultKeyFrameInterval;
+
+    for (int i = 0; i < argc; ++i)
+    {
+        if (IsSwitch(argv[i], "--frames") && i + 1 < argc)
+        {
+            nFrames = (std::max)(atoi(argv[++i]), 1);
+        }
+        else if (IsSwitch(argv[i], "--max-error") && i + 1 < argc)
+        {
+            nMaxError = (std::min)((std::max)(atoi(argv[++i]), 1), 127);
+        }
+        else if (IsSwitch(argv[i], "--threads") && i + 1 < argc)
+        {
+            nThreads = (std::max)(atoi(argv[++i]), 1);
+        }
+        else if (IsSwitch(argv[i], "--keyframe") && i + 1 < argc)
+        {
+            nKeyFrameInterval = (std::max)(atoi(argv[++i]), 1);
+        }
+        else
+        {
+            szPath = argv[i];
+        }
+    }
+
+    std::vector<std::vector<BYTE> > frames;
+    ColorImageFormat colorFormat = ColorImageFormat_Yuy2;
+    int nWidth = 1920;
+    int nHeight = 1080;
+    int nStride = nWidth * 2;
+
+    if (szPath)
+    {
+        SessionReplaySource* pSource = new SessionReplaySource();
+        SessionFrame frame;
+        std::vector<AudioChunk> audio;
+        HRESULT hr = pSource->Open(szPath, ReplayPacing_MaxSpeed);
+
+        while (SUCCEEDED(hr) && static_cast<int>(frames.size()) < nFrames && S_OK == (hr = pSource->ReadNextFrame(&frame, &audio)))
+        {
+            if ((ColorImageFormat_Yuy2 != frame.colorFormat && ColorImageFormat_Bgra != frame.colorFormat) ||
+                frame.cbColorBuffer < static_cast<UINT>(frame.nColorStride) * frame.nColorHeight)
+            {
+                continue;
+            }
+
+            colorFormat = frame.colorFormat;
+            nWidth = frame.nColorWidth;
+            nHeight = frame.nColorHeight;
+            nStride = frame.nColorStride;
+            frames.push_back(std::vector<BYTE>(frame.pColorBuffer, frame.pColorBuffer + static_cast<size_t>(nStride) * nHeight));
+        }
+
+        delete pSource;
+
+        if (FAILED(hr) || frames.empty())
+        {
+            fprintf(stderr, "codec-bench: failed to read YUY2 or BGRA frames from %s (0x%08x)\n", szPath, static_cast<unsigned int>(hr));
+            return 1;
+        }
+    }
+    else
+    {
+        std::vector<BYTE> background(static_cast<size_t>(nStride) * nHeight);
+        for (int y = 0; y < nHeight; ++y)
+        {
+            for (int x = 0; x < nWidth; ++x)
+            {
+                BYTE* pPixel = &background[static_cast<size_t>(y) * nStride + x * 2];
+                pPixel[0] = static_cast<BYTE>(60 + y * 100 / nHeight + static_cast<int>(20.0 * sin(x * 0.05) * sin(y * 0.03)));
+                pPixel[1] = static_cast<BYTE>((x & 1) ? 128 + (y - nHeight / 2) * 20 / nHeight : 128 + (x - nWidth / 2) * 20 / nWidth);
+            }
+        }
+
+        UINT64 nRandom = 88172645463325252ULL;
+        frames.resize(nFrames);
+        for (int i = 0; i < nFrames; ++i)
+        {
+            frames[i].resize(background.size());
+            RenderCodecScene(background, nWidth, nHeight, i, &nRandom, &frames[i][0]);
+        }
+    }
+
+    double fFrameMb = static_cast<double>(nStride) * nHeight / 1e6;
+    printf("%u frames of %dx%d %s%s, %.1f MB each, %.0f MB/s at 30 fps\n", static_cast<unsigned int>(frames.size()), nWidth, nHeight,
+        (ColorImageFormat_Yuy2 == colorFormat) ? "YUY2" : "BGRA", szPath ? "" : " (synthetic scene)", fFrameMb, fFrameMb * 30.0);
+    printf("%-14s %7s %8s %11s %11s %11s %11s %8s %6s\n", "", "threads", "ratio", "enc/core", "enc", "dec/core", "dec", "dec fps", "error");
+
+    bool bPassed = true;
+    const int maxErrors[2] = { 0, nMaxError };
+    const int threadCounts[2] = { 1, nThreads };
+
+    for (int iMode = 0; iMode < 2; ++iMode)
+    {
+        for (int iThreads = 0; iThreads < 2; ++iThreads)
+        {
+            if (1 == iThreads && 1 == nThreads)
+            {
+                break;
+            }
+
+            FrameCodecOptions options;
+            options.nMaxError = maxErrors[iMode];
+            options.nKeyFrameInterval = nKeyFrameInterval;
+            options.nThreads = threadCounts[iThreads];
+
+            FrameCodecStats encodeStats;
+            FrameCodecStats decodeStats;
+            int nError = 0;
+            HRESULT hr = RunCodecPass(frames, colorFormat, nHeight, nStride, options, &encodeStats, &decodeStats, &nError);
+
+            bool bExact = SUCCEEDED(hr) && nError <= options.nMaxError;
+            bPassed = bPassed && bExact;
+
+            // MB of frames per second of tile time on one core, and of wall clock time
+            printf("%-14s %7d %6.2f:1 %7.0fMB/s %7.0fMB/s %7.0fMB/s %7.0fMB/s %8.1f %6d%s\n",
+                (0 == options.nMaxError) ? "lossless" : "near-lossless", options.nThreads,
+                static_cast<double>(encodeStats.cbDecoded) / (std::max)(encodeStats.cbEncoded, static_cast<UINT64>(1)),
+                encodeStats.cbDecoded * 1e3 / (std::max)(encodeStats.nTileNs, static_cast<INT64>(1)),
+                encodeStats.cbDecoded * 1e3 / (std::max)(encodeStats.nWallNs, static_cast<INT64>(1)),
+                decodeStats.cbDecoded * 1e3 / (std::max)(decodeStats.nTileNs, static_cast<INT64>(1)),
+                decodeStats.cbDecoded * 1e3 / (std::max)(decodeStats.nWallNs, static_cast<INT64>(1)),
+                decodeStats.nFrames * 1e9 / (std::max)(decodeStats.nWallNs, static_cast<INT64>(1)),
+                nError, bExact ? "" : " FAILED");
+        }
+    }
+
+    int nRejected = 0;
+    int nDamaged = CheckCorruptHeaders(frames[0], colorFormat, nHeight, nStride, &nRejected);
+    bool bRejected = nDamaged > 0 && nRejected == nDamaged;
+    bPassed = bPassed && bRejected;
+    printf("\ndamaged headers      %d of %d rejected%s\n", nRejected, (std::max)(nDamaged, 0), bRejected ? "" : " FAILED");
+
+    printf("%s\n", bPassed ? "PASS" : "FAIL");
+    return bPassed ? 0 : 1;
+}
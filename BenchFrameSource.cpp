@@ -0,0 +1,217 @@
+//------------------------------------------------------------------------------
+// <copyright file="BenchFrameSource.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Benchmark of the frame acquisition loop, run as a console tool command
+
+#include "KinectTypes.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+#include "PerfClock.h"
+#include "FrameSource.h"
+#include "SessionRecording.h"
+#include "ToolCommands.h"
+
+struct AcquisitionLoopResult
+{
+    UINT64              nFrames;
+    UINT64              nLoopPasses;
+    double              fCpuPercent;
+    std::vector<INT64>  latenciesNs;
+    FrameWakeupStats    wakeupStats;
+    FrameSourceStats    sourceStats;
+};
+
+/// <summary>
+/// Runs the acquisition loop of the application against a synthetic source, either
+/// polling the source as fast as it can or sleeping until the source signals a frame
+/// </summary>
+/// <param name="bEventDriven">whether to wait for wake-ups rather than poll</param>
+/// <param name="nSeconds">time to run for</param>
+/// <param name="nFrameIntervalUs">time between frames of the source, in microseconds</param>
+/// <param name="pResult">receives the measurements</param>
+static void RunAcquisitionLoop(bool bEventDriven, int nSeconds, int nFrameIntervalUs, AcquisitionLoopResult* pResult)
+{
+    // audio chunks arrive at the cadence of the audio capture thread
+    SyntheticFrameSource source(1920, 1080, nFrameIntervalUs, 50000);
+    FrameWakeup wakeup(FrameStream_Color);
+    SessionFrame frame;
+    std::vector<AudioChunk> audio;
+    volatile BYTE nSink = 0;
+
+    pResult->nFrames = 0;
+    pResult->nLoopPasses = 0;
+    pResult->latenciesNs.clear();
+
+    INT64 nStartNs = GetPerfClockNs();
+    INT64 nStartCpuNs = GetProcessCpuNs();
+    INT64 nEndNs = nStartNs + static_cast<INT64>(nSeconds) * 1000000000;
+    source.Start(&wakeup);
+
+    while (GetPerfClockNs() < nEndNs)
+    {
+        if (bEventDriven)
+        {
+            wakeup.Wait(100);
+        }
+
+        wakeup.TakePending(nullptr);
+        pResult->nLoopPasses++;
+
+        if (S_OK == source.AcquireFrame(&frame, &audio))
+        {
+            // stands in for drawing: the frame is only read, not converted
+            for (int x = 0; x < frame.nColorStride; x += 64)
+            {
+                nSink = nSink + frame.pColorBuffer[x];
+            }
+
+            pResult->latenciesNs.push_back(GetPerfClockNs() - frame.nTime * 100);
+            pResult->nFrames++;
+        }
+    }
+
+    source.Stop();
+    INT64 nElapsedNs = GetPerfClockNs() - nStartNs;
+    pResult->fCpuPercent = 100.0 * (GetProcessCpuNs() - nStartCpuNs) / nElapsedNs;
+    wakeup.GetStats(&pResult->wakeupStats);
+    source.GetStats(&pResult->sourceStats);
+}
+
+/// <summary>
+/// acquisition-bench [--seconds N] [--fps N] [recording]: measures the CPU use and the time
+/// from frame arrival to the end of its processing of the polling and of the event driven
+/// loop, then replays the recording, if any, in real time through the event driven loop
+/// </summary>
+/// <param name="argc">number of command arguments</param>
+/// <param name="argv">command arguments, starting after the command name</param>
+/// <returns>process exit code</returns>
+int AcquisitionBenchCommand(int argc, char** argv)
+{
+    int nSeconds = 5;
+    int nFps = 30;
+    const char* szPath = nullptr;
+
+    for (int i = 0; i < argc; ++i)
+    {
+        if (IsSwitch(argv[i], "--seconds") && i + 1 < argc)
+        {
+            nSeconds = (std::max)(atoi(argv[++i]), 1);
+        }
+        else if (IsSwitch(argv[i], "--fps") && i + 1 < argc)
+        {
+            nFps = (std::max)(atoi(argv[++i]), 1);
+        }
+        else
+        {
+            szPath = argv[i];
+        }
+    }
+
+    AcquisitionLoopResult results[2];
+    const char* c_szModes[2] = { "polling", "event" };
+
+    printf("%-8s %7s %8s %9s %12s %12s %12s %9s %9s\n",
+        "loop", "frames", "dropped", "cpu", "passes/s", "latency p50", "p99", "max", "wake-ups");
+
+    for (int iMode = 0; iMode < 2; ++iMode)
+    {
+        AcquisitionLoopResult& result = results[iMode];
+        RunAcquisitionLoop(1 == iMode, nSeconds, 1000000 / nFps, &result);
+
+        std::vector<INT64>& latencies = result.latenciesNs;
+        std::sort(latencies.begin(), latencies.end());
+        double fP50 = latencies.empty() ? 0.0 : latencies[latencies.size() / 2] / 1e3;
+        double fP99 = latencies.empty() ? 0.0 : latencies[latencies.size() * 99 / 100] / 1e3;
+        double fMax = latencies.empty() ? 0.0 : latencies.back() / 1e3;
+
+        printf("%-8s %7llu %8llu %8.1f%% %12.0f %9.1f us %9.1f us %9.1f us %9llu\n",
+            c_szModes[iMode],
+            static_cast<unsigned long long>(result.nFrames),
+            static_cast<unsigned long long>(result.sourceStats.nFramesDropped),
+            result.fCpuPercent,
+            static_cast<double>(result.nLoopPasses) / nSeconds,
+            fP50, fP99, fMax,
+            static_cast<unsigned long long>(result.wakeupStats.nWakeups));
+    }
+
+    // signals from streams other than color, and from color while a frame is pending, never wake the loop
+    const FrameWakeupStats& wakeupStats = results[1].wakeupStats;
+    printf("coalesced            %llu of %llu signals\n",
+        static_cast<unsigned long long>(wakeupStats.nSignals - wakeupStats.nWakeups),
+        static_cast<unsigned long long>(wakeupStats.nSignals));
+
+    bool bPassed = (0 == results[1].sourceStats.nFramesDropped) && (results[1].fCpuPercent < results[0].fCpuPercent);
+
+    if (szPath)
+    {
+        ReplayFrameSource replay;
+        FrameWakeup wakeup(FrameStream_Color);
+        SessionFrame frame;
+        std::vector<AudioChunk> audio;
+        std::vector<INT64> latencies;
+        UINT64 nAudioChunks = 0;
+
+        HRESULT hr = replay.Open(szPath, ReplayPacing_RealTime);
+        if (SUCCEEDED(hr))
+        {
+            hr = replay.Start(&wakeup);
+        }
+
+        INT64 nStartNs = GetPerfClockNs();
+        INT64 nStartCpuNs = GetProcessCpuNs();
+
+        while (SUCCEEDED(hr) && S_FALSE != hr)
+        {
+            INT64 nTriggerTimeNs = 0;
+            wakeup.Wait(1000);
+            wakeup.TakePending(&nTriggerTimeNs);
+
+            hr = replay.AcquireFrame(&frame, &audio);
+            if (S_OK == hr)
+            {
+                nAudioChunks += audio.size();
+                if (nTriggerTimeNs)
+                {
+                    latencies.push_back(GetPerfClockNs() - nTriggerTimeNs);
+                }
+            }
+            else if (E_PENDING == hr)
+            {
+                hr = S_OK;
+            }
+        }
+
+        double fCpuPercent = 100.0 * (GetProcessCpuNs() - nStartCpuNs) / (GetPerfClockNs() - nStartNs);
+        replay.Stop();
+
+        if (FAILED(hr))
+        {
+            fprintf(stderr, "acquisition-bench: failed to replay %s (0x%08x)\n", szPath, static_cast<unsigned int>(hr));
+            bPassed = false;
+        }
+        else
+        {
+            FrameSourceStats stats;
+            replay.GetStats(&stats);
+            std::sort(latencies.begin(), latencies.end());
+
+            printf("%-8s %7llu %8llu %8.1f%% %12s %9.1f us %9.1f us %9.1f us %9llu\n", "replay",
+                static_cast<unsigned long long>(stats.nFramesPublished - stats.nFramesDropped),
+                static_cast<unsigned long long>(stats.nFramesDropped), fCpuPercent, "-",
+                latencies.empty() ? 0.0 : latencies[latencies.size() / 2] / 1e3,
+                latencies.empty() ? 0.0 : latencies[latencies.size() * 99 / 100] / 1e3,
+                latencies.empty() ? 0.0 : latencies.back() / 1e3,
+                static_cast<unsigned long long>(latencies.size()));
+            printf("replayed audio       %llu chunks\n", static_cast<unsigned long long>(nAudioChunks));
+        }
+    }
+
+    printf("%s\n", bPassed ? "PASS" : "FAIL");
+
+    return bPassed ? 0 : 1;
+}
@@ -0,0 +1,566 @@
+//------------------------------------------------------------------------------
+// <copyright file="BenchKernels.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Micro benchmarks of the per frame kernels, run as a console tool command
+
+#include "KinectTypes.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "AudioEnergy.h"
+#include "BeamAngleMapping.h"
+#include "BeamHistory.h"
+#include "ColorConversion.h"
+#include "FaceFrameBatch.h"
+#include "LatencyHistogram.h"
+#include "MicroBench.h"
+#include "RoiScaler.h"
+#include "SessionRecording.h"
+#include "SpeakerSelection.h"
+#include "VoiceActivity.h"
+#include "ToolCommands.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// Synthetic inputs each face kernel cycles through, a power of two
+static const size_t c_KernelBenchInputs = 1024;
+
+/// <summary>
+/// kernel-bench [--filter S] [--min-ms N] [--batches N] [--json file] [--baseline file]
+/// [--tolerance PCT]: times the per-frame and per-chunk kernels of the speaker pipeline on
+/// synthetic data, optionally writing the results as JSON and comparing them against a
+/// baseline written the same way; fails if any kernel slowed down beyond the tolerance
+/// </summary>
+/// <param name="argc">number of command arguments</param>
+/// <param name="argv">command arguments, starting after the command name</param>
+/// <returns>process exit code</returns>
+int KernelBenchCommand(int argc, char** argv)
+{
+    const char* szFilter = nullptr;
+    const char* szJsonPath = nullptr;
+    const char* szBaselinePath = nullptr;
+    int nMinBatchMs = 20;
+    int nBatches = 7;
+    double fTolerance = 0.15;
+
+    for (int i = 0; i < argc; ++i)
+    {
+        if (IsSwitch(argv[i], "--filter") && i + 1 < argc)
+        {
+            szFilter = argv[++i];
+        }
+        else if (IsSwitch(argv[i], "--min-ms") && i + 1 < argc)
+        {
+            nMinBatchMs = atoi(argv[++i]);
+        }
+        else if (IsSwitch(argv[i], "--batches") && i + 1 < argc)
+        {
+            nBatches = atoi(argv[++i]);
+        }
+        else if (IsSwitch(argv[i], "--json") && i + 1 < argc)
+        {
+            szJsonPath = argv[++i];
+        }
+        else if (IsSwitch(argv[i], "--baseline") && i + 1 < argc)
+        {
+            szBaselinePath = argv[++i];
+        }
+        else if (IsSwitch(argv[i], "--tolerance") && i + 1 < argc)
+        {
+            fTolerance = atof(argv[++i]) / 100.0;
+        }
+    }
+
+    std::vector<MicroBenchResult> baseline;
+    if (szBaselinePath && FAILED(ReadMicroBenchJson(szBaselinePath, &baseline)))
+    {
+        fprintf(stderr, "kernel-bench: failed to read the baseline %s\n", szBaselinePath);
+        return 1;
+    }
+
+    // faces scattered over the color frame, one in eight with a point off the frame so
+    // that validation takes both of its paths, and head rotations within what the face
+    // tracker reports
+    std::vector<RectI> faceBoxes(c_KernelBenchInputs);
+    std::vector<PointF> facePoints(c_KernelBenchInputs * FacePointType_Count);
+    std::vector<Vector4> rotations(c_KernelBenchInputs);
+    UINT32 nSeed = 2024;
+
+    for (size_t i = 0; i < c_KernelBenchInputs; ++i)
+    {
+        nSeed = nSeed * 1664525 + 1013904223;
+        int nSize = 80 + static_cast<int>((nSeed >> 8) % 240);
+        int nLeft = static_cast<int>((nSeed >> 4) % (1920 - nSize));
+        nSeed = nSeed * 1664525 + 1013904223;
+        int nTop = static_cast<int>((nSeed >> 8) % (1080 - nSize));
+
+        faceBoxes[i].Left = nLeft;
+        faceBoxes[i].Top = nTop;
+        faceBoxes[i].Right = nLeft + nSize;
+        faceBoxes[i].Bottom = nTop + nSize;
+
+        for (int j = 0; j < FacePointType_Count; ++j)
+        {
+            nSeed = nSeed * 1664525 + 1013904223;
+            PointF& point = facePoints[i * FacePointType_Count + j];
+            point.X = nLeft + static_cast<float>((nSeed >> 8) % nSize);
+            point.Y = nTop + static_cast<float>((nSeed >> 16) % nSize);
+        }
+
+        if (7 == i % 8)
+        {
+            facePoints[i * FacePointType_Count + FacePointType_MouthCornerRight].X = 1920.0f + 10.0f;
+        }
+
+        // a small rotation about a random axis
+        nSeed = nSeed * 1664525 + 1013904223;
+        double fHalfAngle = ((nSeed >> 8) % 1000) / 1000.0 * 0.5;
+        double fAxisX = ((nSeed >> 4) % 100) / 100.0 - 0.5;
+        double fAxisY = ((nSeed >> 12) % 100) / 100.0 - 0.5;
+        double fAxisZ = 0.25;
+        double fAxisLength = sqrt(fAxisX * fAxisX + fAxisY * fAxisY + fAxisZ * fAxisZ);
+        rotations[i].x = static_cast<float>(sin(fHalfAngle) * fAxisX / fAxisLength);
+        rotations[i].y = static_cast<float>(sin(fHalfAngle) * fAxisY / fAxisLength);
+        rotations[i].z = static_cast<float>(sin(fHalfAngle) * fAxisZ / fAxisLength);
+        rotations[i].w = static_cast<float>(cos(fHalfAngle));
+    }
+
+    // one 50 ms read of beam audio, as the audio capture thread gets it
+    const UINT nChunkSamples = c_AudioSamplesPerSecond / 20;
+    std::vector<float> audio(nChunkSamples);
+    for (UINT i = 0; i < nChunkSamples; ++i)
+    {
+        audio[i] = 0.25f * static_cast<float>(sin(2.0 * M_PI * 440.0 * i / c_AudioSamplesPerSecond));
+    }
+
+    // a color frame in both of the formats the sensor delivers
+    const int nWidth = 1920;
+    const int nHeight = 1080;
+    std::vector<BYTE> yuy2(static_cast<size_t>(nWidth) * nHeight * 2);
+    std::vector<BYTE> bgra(static_cast<size_t>(nWidth) * nHeight * 4);
+    std::vector<BYTE> bgraCopy(bgra.size());
+    for (size_t i = 0; i < yuy2.size(); ++i)
+    {
+        nSeed = nSeed * 1664525 + 1013904223;
+        yuy2[i] = static_cast<BYTE>(nSeed >> 24);
+    }
+
+    MicroBenchRunner runner(nMinBatchMs, nBatches, szFilter);
+    const size_t nMask = c_KernelBenchInputs - 1;
+
+    // audio energy
+    std::vector<float> sums(nChunkSamples / c_AudioSamplesPerEnergySample);
+    for (int k = 0; k < EnergyKernel_Count; ++k)
+    {
+        EnergyKernel kernel = static_cast<EnergyKernel>(k);
+        if (!IsEnergyKernelSupported(kernel))
+        {
+            continue;
+        }
+
+        std::string name = std::string("energy/sum-squares/") + GetEnergyKernelName(kernel);
+        runner.Run(name.c_str(), nChunkSamples * sizeof(float), [&](UINT64 nIterations)
+        {
+            for (UINT64 i = 0; i < nIterations; ++i)
+            {
+                SumSquaresPerBlock(kernel, &audio[0], static_cast<UINT>(sums.size()), &sums[0]);
+            }
+            MicroBenchSink(sums[0]);
+        });
+    }
+
+    {
+        AudioEnergyMeter meter;
+        EnergyRing* pRing = new EnergyRing();
+        EnergySample energy[64];
+
+        runner.Run("energy/meter-chunk", nChunkSamples * sizeof(float), [&](UINT64 nIterations)
+        {
+            for (UINT64 i = 0; i < nIterations; ++i)
+            {
+                meter.Process(static_cast<INT64>(i), &audio[0], nChunkSamples, 0.0f, 1.0f, true, 0.0f, pRing);
+                while (pRing->PopMany(energy, _countof(energy)) > 0)
+                {
+                }
+            }
+            MicroBenchSink(energy[0].fEnergy);
+        });
+
+        delete pRing;
+    }
+
+    runner.Run("energy/decibels", sizeof(float), [&](UINT64 nIterations)
+    {
+        float fSum = 0.0f;
+        for (UINT64 i = 0; i < nIterations; ++i)
+        {
+            fSum += PowerToDecibels(audio[i % nChunkSamples] * audio[i % nChunkSamples] + 1e-9f);
+        }
+        MicroBenchSink(fSum);
+    });
+
+    // voice activity on a 50 ms read
+    for (int k = 0; k < VadKernel_Count; ++k)
+    {
+        VadKernel kernel = static_cast<VadKernel>(k);
+        if (!IsVadKernelSupported(kernel))
+        {
+            continue;
+        }
+
+        VoiceActivityDetector detector(kernel);
+        std::string name = std::string("audio/vad-chunk/") + GetVadKernelName(kernel);
+        runner.Run(name.c_str(), nChunkSamples * sizeof(float), [&](UINT64 nIterations)
+        {
+            for (UINT64 i = 0; i < nIterations; ++i)
+            {
+                detector.Process(&audio[0], nChunkSamples);
+            }
+            MicroBenchSink(detector.GetSpeechToNoiseDb());
+        });
+    }
+
+    // the energy display window, at every position of the circular buffer in turn
+    {
+        const int nBufferLength = 1000;
+        const int nWindowLength = 780;
+        std::vector<float> buffer(nBufferLength, 0.5f);
+        std::vector<float> window(nWindowLength);
+
+        runner.Run("energy/display-copy", nWindowLength * sizeof(float), [&](UINT64 nIterations)
+        {
+            for (UINT64 i = 0; i < nIterations; ++i)
+            {
+                CopyEnergyWindow(&buffer[0], nBufferLength, static_cast<int>(i % nBufferLength), &window[0], nWindowLength);
+            }
+            MicroBenchSink(window[0]);
+        });
+    }
+
+    // face geometry
+    runner.Run("face/mouth-angle-quadratic", FacePointType_Count * sizeof(PointF), [&](UINT64 nIterations)
+    {
+        float fSum = 0.0f;
+        for (UINT64 i = 0; i < nIterations; ++i)
+        {
+            fSum += GetMouthCenterAngle(&facePoints[(i & nMask) * FacePointType_Count], nWidth);
+        }
+        MicroBenchSink(fSum);
+    });
+
+    runner.Run("face/mouth-angle-table", FacePointType_Count * sizeof(PointF), [&](UINT64 nIterations)
+    {
+        float fSum = 0.0f;
+        for (UINT64 i = 0; i < nIterations; ++i)
+        {
+            const PointF* pPoints = &facePoints[(i & nMask) * FacePointType_Count];
+            fSum += GetPixelAngle((pPoints[FacePointType_MouthCornerLeft].X + pPoints[FacePointType_MouthCornerRight].X) / 2, nWidth);
+        }
+        MicroBenchSink(fSum);
+    });
+
+    runner.Run("face/validate-box-and-points", sizeof(RectI) + FacePointType_Count * sizeof(PointF), [&](UINT64 nIterations)
+    {
+        int nValid = 0;
+        for (UINT64 i = 0; i < nIterations; ++i)
+        {
+            nValid += ValidateFaceBoxAndPoints(&faceBoxes[i & nMask], &facePoints[(i & nMask) * FacePointType_Count], nWidth, nHeight) ? 1 : 0;
+        }
+        MicroBenchSink(nValid);
+    });
+
+    runner.Run("face/rotation-degrees", sizeof(Vector4), [&](UINT64 nIterations)
+    {
+        int nSum = 0;
+        for (UINT64 i = 0; i < nIterations; ++i)
+        {
+            int nPitch, nYaw, nRoll;
+            ExtractFaceRotationInDegrees(&rotations[i & nMask], &nPitch, &nYaw, &nRoll);
+            nSum += nPitch + nYaw + nRoll;
+        }
+        MicroBenchSink(nSum);
+    });
+
+    runner.Run("face/enlarged-roi-clamp", sizeof(RectI), [&](UINT64 nIterations)
+    {
+        float fSum = 0.0f;
+        for (UINT64 i = 0; i < nIterations; ++i)
+        {
+            RoiRect roi;
+            GetEnlargedFaceRect(&faceBoxes[i & nMask], nWidth, nHeight, &roi);
+            fSum += roi.left + roi.bottom;
+        }
+        MicroBenchSink(fSum);
+    });
+
+    // frames of BODY_COUNT of the faces above, every other one with the head joint of
+    // its body, both as the recordings store them and loaded into batches
+    const size_t nFaceFrames = c_KernelBenchInputs / 8;
+    const size_t nFaceFrameMask = nFaceFrames - 1;
+    std::vector<SessionFrame> faceFrames(nFaceFrames);
+    std::vector<FaceFrameBatch> faceBatches(nFaceFrames);
+    for (size_t i = 0; i < nFaceFrames; ++i)
+    {
+        SessionFrame& frame = faceFrames[i];
+        ResetSessionFrame(&frame);
+        frame.nColorWidth = nWidth;
+        frame.nColorHeight = nHeight;
+        frame.bHaveFaceData = true;
+        frame.bHaveBodyData = true;
+
+        for (int iFace = 0; iFace < BODY_COUNT; ++iFace)
+        {
+            size_t iInput = i * 8 + iFace;
+            FaceSample& face = frame.faces[iFace];
+            face.bTracked = 1;
+            face.bHaveResult = 1;
+            face.nTrackingId = iInput + 1;
+            face.faceBox = faceBoxes[iInput];
+            memcpy(face.facePoints, &facePoints[iInput * FacePointType_Count], sizeof(face.facePoints));
+            face.faceRotation = rotations[iInput];
+
+            BodySample& body = frame.bodies[iFace];
+            body.bTracked = iFace % 2;
+            body.nTrackingId = face.nTrackingId;
+            body.headJoint.X = (face.faceBox.Left + face.faceBox.Right) / 1920.0f - 1.0f;
+            body.headJoint.Y = 0.3f;
+            body.headJoint.Z = 2.0f;
+        }
+
+        LoadFaceFrameBatch(&frame, &faceBatches[i]);
+    }
+
+    runner.Run("face/load-batch", sizeof(FaceSample) * BODY_COUNT, [&](UINT64 nIterations)
+    {
+        FaceFrameBatch batch;
+        int nSum = 0;
+        for (UINT64 i = 0; i < nIterations; ++i)
+        {
+            LoadFaceFrameBatch(&faceFrames[i & nFaceFrameMask], &batch);
+            nSum += batch.nBoxLeft[i % BODY_COUNT];
+        }
+        MicroBenchSink(nSum);
+    });
+
+    runner.Run("face/validate-frame-per-face", sizeof(FaceSample) * BODY_COUNT, [&](UINT64 nIterations)
+    {
+        int nValid = 0;
+        for (UINT64 i = 0; i < nIterations; ++i)
+        {
+            const SessionFrame& frame = faceFrames[i & nFaceFrameMask];
+            for (int iFace = 0; iFace < BODY_COUNT; ++iFace)
+            {
+                nValid += ValidateFaceBoxAndPoints(&frame.faces[iFace].faceBox, frame.faces[iFace].facePoints, nWidth, nHeight) ? 1 : 0;
+            }
+        }
+        MicroBenchSink(nValid);
+    });
+
+    runner.Run("face/validate-frame-batch", sizeof(FaceFrameBatch), [&](UINT64 nIterations)
+    {
+        int nValid = 0;
+        bool bValid[BODY_COUNT];
+        for (UINT64 i = 0; i < nIterations; ++i)
+        {
+            nValid += ValidateFaceBatch(&faceBatches[i & nFaceFrameMask], bValid);
+        }
+        MicroBenchSink(nValid);
+    });
+
+    runner.Run("face/mouth-angle-frame-per-face", sizeof(FaceSample) * BODY_COUNT, [&](UINT64 nIterations)
+    {
+        float fSum = 0.0f;
+        for (UINT64 i = 0; i < nIterations; ++i)
+        {
+            const SessionFrame& frame = faceFrames[i & nFaceFrameMask];
+            for (int iFace = 0; iFace < BODY_COUNT; ++iFace)
+            {
+                fSum += GetMouthCenterAngle(frame.faces[iFace].facePoints, nWidth);
+            }
+        }
+        MicroBenchSink(fSum);
+    });
+
+    runner.Run("face/mouth-angle-frame-batch", sizeof(FaceFrameBatch), [&](UINT64 nIterations)
+    {
+        float fSum = 0.0f;
+        float fAngles[BODY_COUNT];
+        for (UINT64 i = 0; i < nIterations; ++i)
+        {
+            GetMouthCenterAngleBatch(&faceBatches[i & nFaceFrameMask], fAngles);
+            fSum += fAngles[i % BODY_COUNT];
+        }
+        MicroBenchSink(fSum);
+    });
+
+    for (int m = 0; m < 2; ++m)
+    {
+        SpeakerAngleMapping mapping = m ? SpeakerAngleMapping_Geometric : SpeakerAngleMapping_Quadratic;
+        const char* szMapping = m ? "geometric" : "quadratic";
+
+        // the beam swept across the frame so that faces are both in and out of it
+        std::string name = std::string("face/select-speakers-frame/") + szMapping;
+        runner.Run(name.c_str(), (sizeof(FaceSample) + sizeof(BodySample)) * BODY_COUNT, [&](UINT64 nIterations)
+        {
+            int nSpeakers = 0;
+            bool bIsSpeaker[BODY_COUNT];
+            for (UINT64 i = 0; i < nIterations; ++i)
+            {
+                float fBeamAngle = static_cast<float>((static_cast<int>(i % 64) - 32) * M_PI / 180.0);
+                nSpeakers += SelectSpeakers(&faceFrames[i & nFaceFrameMask], fBeamAngle, 0.8f, bIsSpeaker, mapping);
+            }
+            MicroBenchSink(nSpeakers);
+        });
+
+        name = std::string("face/select-speakers-batch/") + szMapping;
+        runner.Run(name.c_str(), sizeof(FaceFrameBatch), [&](UINT64 nIterations)
+        {
+            int nSpeakers = 0;
+            bool bIsSpeaker[BODY_COUNT];
+            for (UINT64 i = 0; i < nIterations; ++i)
+            {
+                float fBeamAngle = static_cast<float>((static_cast<int>(i % 64) - 32) * M_PI / 180.0);
+                nSpeakers += SelectSpeakersBatch(&faceBatches[i & nFaceFrameMask], fBeamAngle, 0.8f, bIsSpeaker, mapping);
+            }
+            MicroBenchSink(nSpeakers);
+        });
+    }
+
+    // a full history of beam states one audio read apart, looked up all over
+    const INT64 c_ReadTicks = c_TicksPerSecond / 20;
+    BeamHistory beamHistory;
+    for (size_t i = 0; i < c_BeamHistoryCapacity; ++i)
+    {
+        beamHistory.Add(static_cast<INT64>(i) * c_ReadTicks, 0.01f * (i % 100), 0.8f, true);
+    }
+
+    runner.Run("beam/history-at", sizeof(BeamState), [&](UINT64 nIterations)
+    {
+        float fSum = 0.0f;
+        for (UINT64 i = 0; i < nIterations; ++i)
+        {
+            BeamState state;
+            beamHistory.GetAt(static_cast<INT64>((i * 2654435761ULL) % (c_BeamHistoryCapacity * c_ReadTicks)), &state);
+            fSum += state.fBeamAngle;
+        }
+        MicroBenchSink(fSum);
+    });
+
+    // a face region resampled to the mosaic and to a model input; the sizes count output pixels
+    {
+        const RoiRect c_FaceRoi = { 812.5f, 236.25f, 1164.5f, 640.25f };
+        std::vector<BYTE> scaled(640 * 480 * 4);
+        const int c_Sizes[][2] = { { 640, 480 }, { 224, 224 } };
+        const char* c_szNames[] = { "scale/face-to-640x480/", "scale/face-to-224x224/" };
+
+        for (int s = 0; s < 2; ++s)
+        {
+            ScaleOutput output = { &scaled[0], c_Sizes[s][0] * 4, c_Sizes[s][0], c_Sizes[s][1], ScaleMethod_Auto };
+            for (int k = 0; k < ScaleKernel_Count; ++k)
+            {
+                ScaleKernel kernel = static_cast<ScaleKernel>(k);
+                if (!IsScaleKernelSupported(kernel))
+                {
+                    continue;
+                }
+
+                RoiScaler scaler(kernel);
+                std::string name = std::string(c_szNames[s]) + GetScaleKernelName(kernel);
+                runner.Run(name.c_str(), static_cast<size_t>(output.nWidth) * output.nHeight * 4, [&](UINT64 nIterations)
+                {
+                    for (UINT64 i = 0; i < nIterations; ++i)
+                    {
+                        scaler.Scale(&bgra[0], nWidth, nHeight, nWidth * 4, &c_FaceRoi, &output, 1);
+                    }
+                    MicroBenchSink(scaled[0]);
+                });
+            }
+        }
+    }
+
+    // whole color frames; the sizes count what is read and written
+    runner.Run("frame/copy-yuy2", 2 * yuy2.size(), [&](UINT64 nIterations)
+    {
+        for (UINT64 i = 0; i < nIterations; ++i)
+        {
+            memcpy(&bgraCopy[0], &yuy2[0], yuy2.size());
+        }
+        MicroBenchSink(bgraCopy[0]);
+    });
+
+    runner.Run("frame/copy-bgra", 2 * bgra.size(), [&](UINT64 nIterations)
+    {
+        for (UINT64 i = 0; i < nIterations; ++i)
+        {
+            memcpy(&bgraCopy[0], &bgra[0], bgra.size());
+        }
+        MicroBenchSink(bgraCopy[0]);
+    });
+
+    for (int k = 0; k < ColorKernel_Count; ++k)
+    {
+        ColorKernel kernel = static_cast<ColorKernel>(k);
+        if (!IsColorKernelSupported(kernel))
+        {
+            continue;
+        }
+
+        RectI frameRect = { 0, 0, nWidth, nHeight };
+        std::string name = std::string("frame/yuy2-to-bgra/") + GetColorKernelName(kernel);
+        runner.Run(name.c_str(), yuy2.size() + bgra.size(), [&](UINT64 nIterations)
+        {
+            for (UINT64 i = 0; i < nIterations; ++i)
+            {
+                ConvertYuy2ToBgra(kernel, &yuy2[0], nWidth * 2, &bgra[0], nWidth * 4, &frameRect);
+            }
+            MicroBenchSink(bgra[0]);
+        });
+    }
+
+    // latencies spread over the buckets of a few milliseconds, as the stages record them
+    LatencyMonitor* pLatencyMonitor = new LatencyMonitor();
+    runner.Run("latency/record", 0, [&](UINT64 nIterations)
+    {
+        for (UINT64 i = 0; i < nIterations; ++i)
+        {
+            pLatencyMonitor->Record(LatencyMetric_Compose, static_cast<INT64>((i * 2654435761ULL) & 0x3FFFFF));
+        }
+        LatencySnapshot snapshot;
+        pLatencyMonitor->GetSnapshot(LatencyMetric_Compose, &snapshot);
+        MicroBenchSink(static_cast<double>(snapshot.nTotal));
+    });
+    delete pLatencyMonitor;
+
+    const std::vector<MicroBenchResult>& results = runner.GetResults();
+    bool bPassed = !results.empty();
+
+    if (szJsonPath)
+    {
+        HRESULT hr = WriteMicroBenchJson(szJsonPath, results);
+        if (FAILED(hr))
+        {
+            fprintf(stderr, "kernel-bench: failed to write %s\n", szJsonPath);
+            bPassed = false;
+        }
+    }
+
+    if (szBaselinePath)
+    {
+        printf("\n");
+        int nRegressed = CompareMicroBenchResults(results, baseline, fTolerance);
+        printf("regressed            %d beyond %.0f%%\n", nRegressed, fTolerance * 100.0);
+        bPassed = bPassed && (0 == nRegressed);
+    }
+
+    printf("%s\n", bPassed ? "PASS" : "FAIL");
+
+    return bPassed ? 0 : 1;
+}
@@ -0,0 +1,297 @@
+//------------------------------------------------------------------------------
+// <copyright file="BenchMosaicCompositor.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Benchmarks of the speaker region transfer and of the mosaic, run as console tool commands
+
+#include "KinectTypes.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "PerfClock.h"
+#include "MosaicCompositor.h"
+#include "RoiScaler.h"
+#include "SessionRecording.h"
+#include "SpeakerSelection.h"
+#include "ToolCommands.h"
+
+/// <summary>
+/// Copies a rectangle of 32 bit pixels between two images of the same size, the way the
+/// renderer's bitmap upload reads the source
+/// </summary>
+/// <param name="pSource">source image</param>
+/// <param name="pDest">destination image</param>
+/// <param name="nStride">length (in bytes) of a row of both images</param>
+/// <param name="pRect">rectangle to copy; right and bottom are exclusive</param>
+/// <returns>number of bytes copied</returns>
+static UINT64 CopyImageRect(const BYTE* pSource, BYTE* pDest, int nStride, const RectI* pRect)
+{
+    size_t cbRow = static_cast<size_t>(pRect->Right - pRect->Left) * sizeof(RGBQUAD);
+    size_t nOffset = static_cast<size_t>(pRect->Top) * nStride + pRect->Left * sizeof(RGBQUAD);
+
+    for (int y = pRect->Top; y < pRect->Bottom; ++y, nOffset += nStride)
+    {
+        memcpy(pDest + nOffset, pSource + nOffset, cbRow);
+    }
+
+    return static_cast<UINT64>(cbRow) * (pRect->Bottom - pRect->Top);
+}
+
+/// <summary>
+/// roi-bench [--frames N] [--speakers N]: compares the bytes moved and the time spent per
+/// frame transferring the full color frame against transferring only the speaker regions
+/// </summary>
+/// <param name="argc">number of command arguments</param>
+/// <param name="argv">command arguments, starting after the command name</param>
+/// <returns>process exit code</returns>
+int RoiBenchCommand(int argc, char** argv)
+{
+    const int nWidth = 1920;
+    const int nHeight = 1080;
+    const int nStride = nWidth * sizeof(RGBQUAD);
+    int nFrames = 300;
+    int nSpeakers = 1;
+
+    for (int i = 0; i < argc; ++i)
+    {
+        if (IsSwitch(argv[i], "--frames") && i + 1 < argc)
+        {
+            nFrames = atoi(argv[++i]);
+        }
+        else if (IsSwitch(argv[i], "--speakers") && i + 1 < argc)
+        {
+            nSpeakers = atoi(argv[++i]);
+        }
+    }
+
+    nFrames = (std::max)(nFrames, 1);
+    nSpeakers = (std::max)(1, (std::min)(nSpeakers, static_cast<int>(BODY_COUNT)));
+
+    std::vector<BYTE> source(static_cast<size_t>(nStride) * nHeight);
+    std::vector<BYTE> bitmap(source.size());
+    for (size_t i = 0; i < source.size(); ++i)
+    {
+        source[i] = static_cast<BYTE>(i * 7);
+    }
+
+    SessionFrame frame;
+    ResetSessionFrame(&frame);
+    frame.nColorWidth = nWidth;
+    frame.nColorHeight = nHeight;
+    frame.bHaveFaceData = true;
+
+    bool bIsSpeaker[BODY_COUNT] = {0};
+    for (int i = 0; i < nSpeakers; ++i)
+    {
+        bIsSpeaker[i] = true;
+    }
+
+    UINT64 cbFull = 0;
+    UINT64 cbRoi = 0;
+    INT64 nFullNs = 0;
+    INT64 nRoiNs = 0;
+
+    for (int iFrame = 0; iFrame < nFrames; ++iFrame)
+    {
+        // speakers side by side, drifting a little every frame
+        for (int i = 0; i < nSpeakers; ++i)
+        {
+            MakeBenchFace(&frame.faces[i], 150 + i * 280 + (iFrame % 40), 300 + (iFrame % 25));
+        }
+
+        INT64 nStartNs = GetPerfClockNs();
+        RectI fullRect = { 0, 0, nWidth, nHeight };
+        cbFull += CopyImageRect(&source[0], &bitmap[0], nStride, &fullRect);
+        nFullNs += GetPerfClockNs() - nStartNs;
+
+        nStartNs = GetPerfClockNs();
+        RectI roiRect;
+        if (GetSpeakerTransferRect(&frame, bIsSpeaker, c_RoiTransferMargin, &roiRect))
+        {
+            cbRoi += CopyImageRect(&source[0], &bitmap[0], nStride, &roiRect);
+        }
+        nRoiNs += GetPerfClockNs() - nStartNs;
+    }
+
+    double fFullUs = static_cast<double>(nFullNs) / nFrames / 1000.0;
+    double fRoiUs = static_cast<double>(nRoiNs) / nFrames / 1000.0;
+
+    printf("speakers             %d\n", nSpeakers);
+    printf("full frame           %.1f KB/frame  %.1f us/frame\n", static_cast<double>(cbFull) / nFrames / 1024, fFullUs);
+    printf("speaker regions      %.1f KB/frame  %.1f us/frame\n", static_cast<double>(cbRoi) / nFrames / 1024, fRoiUs);
+    if (cbRoi > 0 && nRoiNs > 0)
+    {
+        printf("reduction            %.1fx bytes  %.1fx time\n", static_cast<double>(cbFull) / cbRoi, static_cast<double>(nFullNs) / nRoiNs);
+    }
+
+    return 0;
+}
+
+/// <summary>
+/// Checks a composed mosaic of a source whose pixels hold their own coordinates: every
+/// tile pixel must come from inside the tile's source region, in order, and everything
+/// outside the tiles must be black
+/// </summary>
+/// <param name="pLayout">layout the mosaic was composed with</param>
+/// <param name="pMosaic">composed mosaic</param>
+/// <returns>number of wrong pixels</returns>
+static UINT64 CheckMosaic(const MosaicLayout* pLayout, const MosaicCompositor* pMosaic)
+{
+    UINT64 nErrors = 0;
+
+    for (int y = 0; y < pMosaic->GetHeight(); ++y)
+    {
+        const UINT32* pRow = reinterpret_cast<const UINT32*>(pMosaic->GetPixels() + static_cast<size_t>(y) * pMosaic->GetStride());
+        UINT32 nPrevious = 0;
+
+        for (int x = 0; x < pMosaic->GetWidth(); ++x)
+        {
+            const MosaicTile* pTile = nullptr;
+            for (int i = 0; i < pLayout->nTiles; ++i)
+            {
+                const RectI& dest = pLayout->tiles[i].dest;
+                if (x >= dest.Left && x < dest.Right && y >= dest.Top && y < dest.Bottom)
+                {
+                    nErrors += (nullptr != pTile) ? 1 : 0;
+                    pTile = &pLayout->tiles[i];
+                }
+            }
+
+            if (nullptr == pTile)
+            {
+                nErrors += (0 != pRow[x]) ? 1 : 0;
+                continue;
+            }
+
+            int xSource = pRow[x] & 0xFFFF;
+            int ySource = pRow[x] >> 16;
+            bool bInside = xSource >= floor(pTile->source.left) && xSource < ceil(pTile->source.right) &&
+                ySource >= floor(pTile->source.top) && ySource < ceil(pTile->source.bottom);
+            bool bInOrder = (x == pTile->dest.Left) || (pRow[x] >= nPrevious);
+
+            nErrors += (bInside && bInOrder) ? 0 : 1;
+            nPrevious = pRow[x];
+        }
+    }
+
+    return nErrors;
+}
+
+/// <summary>
+/// mosaic-bench [--frames N]: checks the speaker mosaic for every number of speakers and
+/// compares its cost against stretching each speaker region over the full frame
+/// </summary>
+/// <param name="argc">number of command arguments</param>
+/// <param name="argv">command arguments, starting after the command name</param>
+/// <returns>process exit code</returns>
+int MosaicBenchCommand(int argc, char** argv)
+{
+    const int nWidth = 1920;
+    const int nHeight = 1080;
+    const int nStride = nWidth * sizeof(RGBQUAD);
+    int nFrames = 100;
+
+    for (int i = 0; i < argc; ++i)
+    {
+        if (IsSwitch(argv[i], "--frames") && i + 1 < argc)
+        {
+            nFrames = (std::max)(atoi(argv[++i]), 1);
+        }
+    }
+
+    // every source pixel holds its own coordinates
+    std::vector<UINT32> source(static_cast<size_t>(nWidth) * nHeight);
+    for (int y = 0; y < nHeight; ++y)
+    {
+        for (int x = 0; x < nWidth; ++x)
+        {
+            source[static_cast<size_t>(y) * nWidth + x] = (static_cast<UINT32>(y) << 16) | x;
+        }
+    }
+    const BYTE* pSource = reinterpret_cast<const BYTE*>(&source[0]);
+
+    SessionFrame frame;
+    ResetSessionFrame(&frame);
+    frame.nColorWidth = nWidth;
+    frame.nColorHeight = nHeight;
+    frame.bHaveFaceData = true;
+
+    // nearest neighbor, so that every mosaic pixel can be traced back to its source pixel
+    MosaicCompositor mosaic(c_MosaicWidth, c_MosaicHeight, ScaleMethod_Nearest);
+    MosaicCompositor fullFrame(nWidth, nHeight, ScaleMethod_Nearest);
+    bool bPassed = true;
+
+    printf("mosaic               %dx%d\n", c_MosaicWidth, c_MosaicHeight);
+
+    for (int nSpeakers = 1; nSpeakers <= BODY_COUNT; ++nSpeakers)
+    {
+        bool bIsSpeaker[BODY_COUNT] = {0};
+        for (int i = 0; i < nSpeakers; ++i)
+        {
+            bIsSpeaker[i] = true;
+        }
+
+        INT64 nMosaicNs = 0;
+        INT64 nPerFaceNs = 0;
+        UINT64 nErrors = 0;
+        int nTiles = 0;
+
+        for (int iFrame = 0; iFrame < nFrames; ++iFrame)
+        {
+            // speakers side by side, listed right to left, drifting a little every frame
+            for (int i = 0; i < nSpeakers; ++i)
+            {
+                MakeBenchFace(&frame.faces[i], 1550 - i * 280 + (iFrame % 40), 300 + (iFrame % 25));
+            }
+
+            MosaicLayout layout;
+            INT64 nStartNs = GetPerfClockNs();
+            nTiles = LayoutSpeakerMosaic(&frame, bIsSpeaker, c_MosaicWidth, c_MosaicHeight, &layout);
+            mosaic.Compose(&layout, pSource, nWidth, nHeight, nStride);
+            nMosaicNs += GetPerfClockNs() - nStartNs;
+
+            if (0 == iFrame)
+            {
+                nErrors = CheckMosaic(&layout, &mosaic);
+                for (int i = 1; i < layout.nTiles; ++i)
+                {
+                    // speakers must read left to right as they stand
+                    nErrors += (layout.tiles[i - 1].source.left < layout.tiles[i].source.left) ? 0 : 1;
+                }
+            }
+
+            // what drawing each speaker over the whole frame used to cost
+            nStartNs = GetPerfClockNs();
+            for (int i = 0; i < layout.nTiles; ++i)
+            {
+                MosaicLayout single;
+                single.nWidth = nWidth;
+                single.nHeight = nHeight;
+                single.nTiles = 1;
+                single.tiles[0].source = layout.tiles[i].source;
+                single.tiles[0].dest.Left = 0;
+                single.tiles[0].dest.Top = 0;
+                single.tiles[0].dest.Right = nWidth;
+                single.tiles[0].dest.Bottom = nHeight;
+                fullFrame.Compose(&single, pSource, nWidth, nHeight, nStride);
+            }
+            nPerFaceNs += GetPerfClockNs() - nStartNs;
+        }
+
+        bool bSpeakersPassed = (nTiles == nSpeakers) && (0 == nErrors);
+        bPassed = bPassed && bSpeakersPassed;
+
+        double fMosaicUs = static_cast<double>(nMosaicNs) / nFrames / 1000.0;
+        double fPerFaceUs = static_cast<double>(nPerFaceNs) / nFrames / 1000.0;
+        printf("%d speakers           mosaic %7.1f us/frame  per face full frame %7.1f us/frame  %4.1fx  %s\n",
+            nSpeakers, fMosaicUs, fPerFaceUs, fPerFaceUs / fMosaicUs, bSpeakersPassed ? "PASS" : "FAIL");
+    }
+
+    printf("%s\n", bPassed ? "PASS" : "FAIL");
+    return bPassed ? 0 : 1;
+}
@@ -0,0 +1,382 @@
+//------------------------------------------------------------------------------
+// <copyright file="BenchRoiScaler.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Accuracy and speed of the region scaling methods, run as a console tool command
+
+#include "KinectTypes.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "PerfClock.h"
+#include "RoiScaler.h"
+#include "SpeakerSelection.h"
+#include "ToolCommands.h"
+
+/// <summary>
+/// Resamples a region of a BGRA frame straight from the definition of the method in
+/// double precision, one output pixel at a time; the reference the resampling kernels
+/// are checked against
+/// </summary>
+/// <param name="pSource">BGRA color frame</param>
+/// <param name="nSourceWidth">width (in pixels) of the color frame</param>
+/// <param name="nSourceHeight">height (in pixels) of the color frame</param>
+/// <param name="pRoi">region to resample</param>
+/// <param name="pOutput">image receiving the region; its method must not be auto</param>
+static void ReferenceScale(const BYTE* pSource, int nSourceWidth, int nSourceHeight, const RoiRect* pRoi, const ScaleOutput* pOutput)
+{
+    const double fStartX = pRoi->left;
+    const double fStartY = pRoi->top;
+    const double fScaleX = (pRoi->right - fStartX) / pOutput->nWidth;
+    const double fScaleY = (pRoi->bottom - fStartY) / pOutput->nHeight;
+    const int nFirstX = (std::max)(static_cast<int>(floor(pRoi->left)), 0);
+    const int nLastX = (std::min)(static_cast<int>(ceil(pRoi->right)), nSourceWidth) - 1;
+    const int nFirstY = (std::max)(static_cast<int>(floor(pRoi->top)), 0);
+    const int nLastY = (std::min)(static_cast<int>(ceil(pRoi->bottom)), nSourceHeight) - 1;
+
+    for (int y = 0; y < pOutput->nHeight; ++y)
+    {
+        for (int x = 0; x < pOutput->nWidth; ++x)
+        {
+            double fSums[4] = { 0.0, 0.0, 0.0, 0.0 };
+            double fTotal = 0.0;
+
+            // every source pixel under the output pixel and its weight, as a 2D sum
+            int nStartX, nEndX, nStartY, nEndY;
+            double fCenterX = fStartX + (x + 0.5) * fScaleX;
+            double fCenterY = fStartY + (y + 0.5) * fScaleY;
+            if (ScaleMethod_Nearest == pOutput->method)
+            {
+                nStartX = static_cast<int>(floor(fCenterX));
+                nEndX = nStartX + 1;
+                nStartY = static_cast<int>(floor(fCenterY));
+                nEndY = nStartY + 1;
+            }
+            else if (ScaleMethod_Box == pOutput->method)
+            {
+                nStartX = static_cast<int>(floor(fStartX + x * fScaleX));
+                nEndX = static_cast<int>(ceil(fStartX + (x + 1) * fScaleX));
+                nStartY = static_cast<int>(floor(fStartY + y * fScaleY));
+                nEndY = static_cast<int>(ceil(fStartY + (y + 1) * fScaleY));
+            }
+            else
+            {
+                nStartX = static_cast<int>(floor(fCenterX - 0.5));
+                nEndX = nStartX + 2;
+                nStartY = static_cast<int>(floor(fCenterY - 0.5));
+                nEndY = nStartY + 2;
+            }
+
+            for (int j = nStartY; j < nEndY; ++j)
+            {
+                for (int i = nStartX; i < nEndX; ++i)
+                {
+                    double fWeight = 1.0;
+                    if (ScaleMethod_Box == pOutput->method)
+                    {
+                        double fCoverX = (std::min)(fStartX + (x + 1) * fScaleX, i + 1.0) - (std::max)(fStartX + x * fScaleX, static_cast<double>(i));
+                        double fCoverY = (std::min)(fStartY + (y + 1) * fScaleY, j + 1.0) - (std::max)(fStartY + y * fScaleY, static_cast<double>(j));
+                        fWeight = (std::max)(fCoverX, 0.0) * (std::max)(fCoverY, 0.0);
+                    }
+                    else if (ScaleMethod_Bilinear == pOutput->method)
+                    {
+                        fWeight = (1.0 - fabs(fCenterX - 0.5 - i)) * (1.0 - fabs(fCenterY - 0.5 - j));
+                    }
+
+                    const BYTE* pPixel = pSource + (static_cast<size_t>((std::max)(nFirstY, (std::min)(j, nLastY))) * nSourceWidth +
+                        (std::max)(nFirstX, (std::min)(i, nLastX))) * 4;
+                    for (int c = 0; c < 4; ++c)
+                    {
+                        fSums[c] += fWeight * pPixel[c];
+                    }
+                    fTotal += fWeight;
+                }
+            }
+
+            BYTE* pDest = pOutput->pPixels + static_cast<size_t>(y) * pOutput->nStride + x * 4;
+            for (int c = 0; c < 4; ++c)
+            {
+                double fValue = floor(fSums[c] / fTotal + 0.5);
+                pDest[c] = static_cast<BYTE>((std::max)(0.0, (std::min)(fValue, 255.0)));
+            }
+        }
+    }
+}
+
+/// <summary>
+/// Largest difference between two images of the same size
+/// </summary>
+static int MaxImageDifference(const BYTE* pA, const BYTE* pB, int nWidth, int nHeight, int nStride)
+{
+    int nMax = 0;
+    for (int y = 0; y < nHeight; ++y)
+    {
+        for (int i = 0; i < nWidth * 4; ++i)
+        {
+            nMax = (std::max)(nMax, abs(static_cast<int>(pA[static_cast<size_t>(y) * nStride + i]) - pB[static_cast<size_t>(y) * nStride + i]));
+        }
+    }
+
+    return nMax;
+}
+
+/// <summary>
+/// scale-bench [--iterations N]: checks the resampling kernels against each other and
+/// against a double precision reference, and measures their throughput enlarging a small
+/// face, shrinking a large one to a model input, and making three sizes of one region in
+/// one pass rather than three
+/// </summary>
+/// <param name="argc">number of command arguments</param>
+/// <param name="argv">command arguments, starting after the command name</param>
+/// <returns>process exit code</returns>
+int ScaleBenchCommand(int argc, char** argv)
+{
+    const int nWidth = 1920;
+    const int nHeight = 1080;
+    const BYTE cGuard = 0x5A;
+    int nIterations = 50;
+
+    for (int i = 0; i < argc; ++i)
+    {
+        if (IsSwitch(argv[i], "--iterations") && i + 1 < argc)
+        {
+            nIterations = (std::max)(atoi(argv[++i]), 1);
+        }
+    }
+
+    // random pixels, and one constant frame, which every method must keep as it is
+    std::vector<BYTE> source(static_cast<size_t>(nWidth) * nHeight * 4);
+    std::vector<BYTE> flat(source.size(), 0xC8);
+    UINT32 nSeed = 1801;
+    for (size_t i = 0; i < source.size(); ++i)
+    {
+        nSeed = nSeed * 1664525 + 1013904223;
+        source[i] = static_cast<BYTE>(nSeed >> 24);
+    }
+
+    struct ScaleCase
+    {
+        const char*     szName;
+        RoiRect         roi;
+        int             nWidth;
+        int             nHeight;
+    };
+
+    const ScaleCase c_Cases[] =
+    {
+        { "up 200x200->640x480", { 700.3f, 300.7f, 900.3f, 500.7f }, 640, 480 },
+        { "down 600x600->224x224", { 600.5f, 200.25f, 1200.5f, 800.25f }, 224, 224 },
+        { "mixed 480x120->160x360", { 10.0f, 900.0f, 490.0f, 1020.0f }, 160, 360 },
+        { "past the edges", { -40.0f, 1000.0f, 260.0f, 1100.0f }, 97, 33 },
+        { "one pixel", { 5.0f, 5.0f, 6.0f, 6.0f }, 3, 2 },
+    };
+
+    // outputs sit in a larger image, so that writes outside them are caught
+    const int nPad = 8;
+    const int nMaxWidth = 640 + 2 * nPad;
+    const int nMaxHeight = 480 + 2 * nPad;
+    const int nStride = nMaxWidth * 4;
+    std::vector<BYTE> expected(static_cast<size_t>(nStride) * nMaxHeight);
+    std::vector<BYTE> actual(expected.size());
+    std::vector<BYTE> reference(expected.size());
+
+    bool bPassed = true;
+    int nMaxReferenceError = 0;
+    int nMaxKernelError[ScaleKernel_Count] = { 0 };
+
+    for (size_t iCase = 0; iCase < _countof(c_Cases); ++iCase)
+    {
+        const ScaleCase& test = c_Cases[iCase];
+
+        for (int m = 0; m < ScaleMethod_Count; ++m)
+        {
+            ScaleOutput output;
+            output.nStride = nStride;
+            output.nWidth = test.nWidth;
+            output.nHeight = test.nHeight;
+            output.method = static_cast<ScaleMethod>(m);
+            const size_t nOffset = static_cast<size_t>(nPad) * nStride + nPad * 4;
+
+            memset(&expected[0], cGuard, expected.size());
+            output.pPixels = &expected[nOffset];
+            RoiScaler(ScaleKernel_Scalar).Scale(&source[0], nWidth, nHeight, nWidth * 4, &test.roi, &output, 1);
+
+            // auto is checked against the method it picks along both axes, where it picks one
+            ScaleOutput referenceOutput = output;
+            referenceOutput.pPixels = &reference[nOffset];
+            bool bWidthShrinks = test.roi.right - test.roi.left > test.nWidth;
+            bool bHeightShrinks = test.roi.bottom - test.roi.top > test.nHeight;
+            if (ScaleMethod_Auto == output.method)
+            {
+                referenceOutput.method = bWidthShrinks ? ScaleMethod_Box : ScaleMethod_Bilinear;
+            }
+
+            if (ScaleMethod_Auto != output.method || bWidthShrinks == bHeightShrinks)
+            {
+                memset(&reference[0], cGuard, reference.size());
+                ReferenceScale(&source[0], nWidth, nHeight, &test.roi, &referenceOutput);
+                nMaxReferenceError = (std::max)(nMaxReferenceError, MaxImageDifference(&expected[0], &reference[0], nMaxWidth, nMaxHeight, nStride));
+            }
+
+            for (int k = ScaleKernel_Sse41; k < ScaleKernel_Count; ++k)
+            {
+                ScaleKernel kernel = static_cast<ScaleKernel>(k);
+                if (!IsScaleKernelSupported(kernel))
+                {
+                    continue;
+                }
+
+                memset(&actual[0], cGuard, actual.size());
+                output.pPixels = &actual[nOffset];
+                RoiScaler(kernel).Scale(&source[0], nWidth, nHeight, nWidth * 4, &test.roi, &output, 1);
+
+                // the whole image is compared, so writes outside the output are caught too
+                int nError = MaxImageDifference(&expected[0], &actual[0], nMaxWidth, nMaxHeight, nStride);
+                nMaxKernelError[k] = (std::max)(nMaxKernelError[k], nError);
+                if (nError > ((ScaleKernel_Sse41 == kernel) ? 0 : 1))
+                {
+                    printf("%-7s mismatch in %s %s by %d\n", GetScaleKernelName(kernel), test.szName, GetScaleMethodName(output.method), nError);
+                    bPassed = false;
+                }
+            }
+
+            for (int k = 0; k < ScaleKernel_Count; ++k)
+            {
+                ScaleKernel kernel = static_cast<ScaleKernel>(k);
+                if (!IsScaleKernelSupported(kernel))
+                {
+                    continue;
+                }
+
+                memset(&actual[0], cGuard, actual.size());
+                output.pPixels = &actual[nOffset];
+                RoiScaler(kernel).Scale(&flat[0], nWidth, nHeight, nWidth * 4, &test.roi, &output, 1);
+
+                for (int y = 0; y < output.nHeight; ++y)
+                {
+                    for (int i = 0; i < output.nWidth * 4; ++i)
+                    {
+                        if (0xC8 != output.pPixels[static_cast<size_t>(y) * nStride + i])
+                        {
+                            printf("%-7s changes a constant image in %s %s\n", GetScaleKernelName(kernel), test.szName, GetScaleMethodName(output.method));
+                            bPassed = false;
+                            y = output.nHeight;
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // float weights against double ones, on noise, the hardest case for rounding
+    bool bReferencePassed = nMaxReferenceError <= 1;
+    printf("reference            max difference %d  %s\n", nMaxReferenceError, bReferencePassed ? "PASS" : "FAIL");
+    bPassed = bPassed && bReferencePassed;
+
+    for (int k = ScaleKernel_Sse41; k < ScaleKernel_Count; ++k)
+    {
+        ScaleKernel kernel = static_cast<ScaleKernel>(k);
+        printf("%-7s accuracy    %s, max difference %d\n", GetScaleKernelName(kernel),
+            !IsScaleKernelSupported(kernel) ? "not supported" : (ScaleKernel_Sse41 == kernel ? "bit-exact with scalar" : "within one level of scalar"),
+            nMaxKernelError[k]);
+    }
+
+    // throughput in output pixels, with the method each case picks by itself
+    for (size_t iCase = 0; iCase < 2; ++iCase)
+    {
+        const ScaleCase& test = c_Cases[iCase];
+        ScaleOutput output = { &actual[0], nStride, test.nWidth, test.nHeight, ScaleMethod_Auto };
+        double fMegapixels = test.nWidth * test.nHeight / 1e6;
+        double fScalarMs = 0.0;
+
+        for (int k = 0; k < ScaleKernel_Count; ++k)
+        {
+            ScaleKernel kernel = static_cast<ScaleKernel>(k);
+            if (!IsScaleKernelSupported(kernel))
+            {
+                continue;
+            }
+
+            RoiScaler scaler(kernel);
+            INT64 nStartNs = GetPerfClockNs();
+            for (int iIteration = 0; iIteration < nIterations; ++iIteration)
+            {
+                scaler.Scale(&source[0], nWidth, nHeight, nWidth * 4, &test.roi, &output, 1);
+            }
+            double fMs = static_cast<double>(GetPerfClockNs() - nStartNs) / nIterations / 1e6;
+            fScalarMs = (ScaleKernel_Scalar == kernel) ? fMs : fScalarMs;
+
+            printf("%-7s %-22s %7.3f ms  %7.1f Mpix/s  %5.1fx\n", GetScaleKernelName(kernel), test.szName, fMs, fMegapixels * 1e3 / fMs, fScalarMs / fMs);
+        }
+    }
+
+    // three model input sizes of one region, in one pass and in three
+    {
+        const RoiRect& roi = c_Cases[1].roi;
+        const int c_Sizes[][2] = { { 640, 480 }, { 224, 224 }, { 112, 112 } };
+        std::vector<BYTE> together(expected.size() * 3);
+        std::vector<BYTE> separate(together.size());
+        ScaleOutput outputs[3];
+        double fMegapixels = 0.0;
+        for (int i = 0; i < 3; ++i)
+        {
+            ScaleOutput output = { &together[0] + i * expected.size(), nStride, c_Sizes[i][0], c_Sizes[i][1], ScaleMethod_Auto };
+            outputs[i] = output;
+            fMegapixels += c_Sizes[i][0] * c_Sizes[i][1] / 1e6;
+        }
+
+        for (int k = 0; k < ScaleKernel_Count; ++k)
+        {
+            ScaleKernel kernel = static_cast<ScaleKernel>(k);
+            if (!IsScaleKernelSupported(kernel))
+            {
+                continue;
+            }
+
+            RoiScaler scaler(kernel);
+            double fMs[2];
+            for (int iPass = 0; iPass < 2; ++iPass)
+            {
+                INT64 nStartNs = GetPerfClockNs();
+                for (int iIteration = 0; iIteration < nIterations; ++iIteration)
+                {
+                    if (0 == iPass)
+                    {
+                        scaler.Scale(&source[0], nWidth, nHeight, nWidth * 4, &roi, outputs, 3);
+                    }
+                    else
+                    {
+                        for (int i = 0; i < 3; ++i)
+                        {
+                            ScaleOutput output = outputs[i];
+                            output.pPixels = &separate[0] + (output.pPixels - &together[0]);
+                            scaler.Scale(&source[0], nWidth, nHeight, nWidth * 4, &roi, &output, 1);
+                        }
+                    }
+                }
+                fMs[iPass] = static_cast<double>(GetPerfClockNs() - nStartNs) / nIterations / 1e6;
+            }
+
+            // one pass makes the same images as separate calls
+            bool bSame = true;
+            for (int i = 0; i < 3; ++i)
+            {
+                const BYTE* pSeparate = &separate[0] + (outputs[i].pPixels - &together[0]);
+                bSame = bSame && 0 == MaxImageDifference(outputs[i].pPixels, pSeparate, outputs[i].nWidth, outputs[i].nHeight, nStride);
+            }
+            bPassed = bPassed && bSame;
+
+            printf("%-7s %-22s %7.3f ms  %7.1f Mpix/s  separately %7.3f ms  %5.2fx  %s\n", GetScaleKernelName(kernel), "640x480+224x224+112x112",
+                fMs[0], fMegapixels * 1e3 / fMs[0], fMs[1], fMs[1] / fMs[0], bSame ? "same" : "DIFFERENT");
+        }
+    }
+
+    printf("%s\n", bPassed ? "PASS" : "FAIL");
+    return bPassed ? 0 : 1;
+}
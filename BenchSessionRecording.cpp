@@ -0,0 +1,392 @@
+//------------------------------------------------------------------------------
+// <copyright file="BenchSessionRecording.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Seek and read benchmark of session recordings, run as a console tool command
+
+#include "KinectTypes.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "PerfClock.h"
+#include "FrameCodec.h"
+#include "LatencyHistogram.h"
+#include "SessionRecording.h"
+#include "ToolCommands.h"
+
+// Start of a digest made with DigestSessionFrame
+static const UINT64 c_SessionDigestSeed = 14695981039346656037ULL;
+
+/// <summary>
+/// Folds a frame into a digest of a replay: its time, every byte of its color, and the
+/// amount of audio preceding it
+/// </summary>
+/// <param name="frame">frame read</param>
+/// <param name="audio">audio chunks read with the frame</param>
+/// <param name="pnDigest">digest to fold the frame into</param>
+static void DigestSessionFrame(const SessionFrame& frame, const std::vector<AudioChunk>& audio, UINT64* pnDigest)
+{
+    UINT64 nSum = static_cast<UINT64>(frame.nTime);
+    UINT64 nWord;
+    UINT i = 0;
+
+    for (; i + sizeof(nWord) <= frame.cbColorBuffer; i += sizeof(nWord))
+    {
+        memcpy(&nWord, frame.pColorBuffer + i, sizeof(nWord));
+        nSum += nWord;
+    }
+
+    for (; i < frame.cbColorBuffer; ++i)
+    {
+        nSum += frame.pColorBuffer[i];
+    }
+
+    for (size_t j = 0; j < audio.size(); ++j)
+    {
+        nSum += audio[j].samples.size();
+    }
+
+    *pnDigest = (*pnDigest ^ nSum) * 1099511628211ULL;
+}
+
+/// <summary>
+/// Reads a recording record by record, as recordings were replayed before they were
+/// mapped, up to and including a frame
+/// </summary>
+/// <param name="pReader">reader of the recording</param>
+/// <param name="nLastFrame">index of the last frame to read, or -1 for all of them</param>
+/// <param name="pnDigest">optional; receives the digest of the frames read</param>
+/// <param name="pcbRead">optional; receives the bytes read</param>
+/// <returns>frames read</returns>
+static UINT64 ReadSessionRecords(SessionReader* pReader, INT64 nLastFrame, UINT64* pnDigest, UINT64* pcbRead)
+{
+    SessionRecordHeader header;
+    std::vector<BYTE> payload;
+    SessionFrame frame;
+    std::vector<AudioChunk> audio;
+    UINT64 nFrames = 0;
+    UINT64 nDigest = c_SessionDigestSeed;
+    UINT64 cbRead = 0;
+
+    pReader->Rewind();
+    ResetSessionFrame(&frame);
+
+    while ((nLastFrame < 0 || static_cast<INT64>(nFrames) <= nLastFrame) && S_OK == pReader->ReadRecord(&header, &payload))
+    {
+        cbRead += sizeof(header) + header.cbPayload;
+
+        if (DecodeSessionRecord(header, payload.empty() ? nullptr : &payload[0], &frame, &audio))
+        {
+            if (pnDigest)
+            {
+                DigestSessionFrame(frame, audio, &nDigest);
+            }
+
+            ResetSessionFrame(&frame);
+            audio.clear();
+            nFrames++;
+        }
+    }
+
+    if (pnDigest)
+    {
+        *pnDigest = nDigest;
+    }
+
+    if (pcbRead)
+    {
+        *pcbRead = cbRead;
+    }
+
+    return nFrames;
+}
+
+/// <summary>
+/// Writes a recording of at least the given size by repeating the frames and audio of
+/// another one, with times carrying on from one repetition to the next
+/// </summary>
+/// <param name="szSource">recording to repeat</param>
+/// <param name="szPath">path of the recording to write</param>
+/// <param name="cbTarget">size to reach, in bytes</param>
+/// <returns>indicates success or failure</returns>
+static HRESULT SynthesizeRecording(const char* szSource, const char* szPath, UINT64 cbTarget)
+{
+    MappedSession source;
+    HRESULT hr = source.Open(szSource);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    const std::vector<SessionIndexEntry>& index = source.GetIndex();
+    if (index.empty())
+    {
+        return E_INVALIDARG;
+    }
+
+    SessionWriter writer;
+    // encoded frames are copied as they are, which takes a recording opened with a codec
+    FrameCodecOptions codec;
+    hr = writer.Open(szPath, source.GetHeader().nColorWidth, source.GetHeader().nColorHeight, source.GetHeader().nAudioSamplesPerSecond,
+        (source.GetHeader().nFlags & SessionFile_EncodedColor) ? &codec : nullptr);
+
+    // a repetition starts a frame interval after the previous one ended
+    INT64 nRepeatTicks = index.back().nTime - index[0].nTime + c_TicksPerSecond / 30;
+    INT64 nOffset = 0;
+    UINT64 cbWritten = sizeof(SessionFileHeader);
+    SessionFrame frame;
+    std::vector<AudioChunk> audio;
+
+    for (size_t i = 0; SUCCEEDED(hr) && cbWritten < cbTarget; ++i)
+    {
+        if (index.size() == i)
+        {
+            i = 0;
+            nOffset += nRepeatTicks;
+        }
+
+        hr = source.ReadFrame(i, &frame, &audio);
+
+        for (size_t j = 0; SUCCEEDED(hr) && j < audio.size(); ++j)
+        {
+            const AudioChunk& chunk = audio[j];
+            hr = writer.WriteAudio(chunk.nTime + nOffset, chunk.samples.empty() ? nullptr : &chunk.samples[0],
+                static_cast<UINT>(chunk.samples.size()), chunk.fBeamAngle, chunk.fBeamAngleConfidence);
+            cbWritten += sizeof(SessionRecordHeader) + sizeof(AudioRecordHeader) + chunk.samples.size() * sizeof(float);
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            frame.nTime += nOffset;
+            hr = writer.WriteFrame(&frame);
+            cbWritten += sizeof(SessionRecordHeader) + sizeof(ColorRecordHeader) + frame.cbColorBuffer +
+                (frame.bHaveBodyData ? sizeof(SessionRecordHeader) + sizeof(frame.bodies) : 0) +
+                (frame.bHaveFaceData ? sizeof(SessionRecordHeader) + sizeof(frame.faces) : 0);
+        }
+    }
+
+    HRESULT hrClose = writer.Close();
+    return FAILED(hr) ? hr : hrClose;
+}
+
+/// <summary>
+/// session-bench &lt;recording&gt; [--seeks N] [--synthesize GB] [--output file]: measures
+/// opening a mapped recording, reading it from start to end mapped against reading it
+/// record by record, and seeking to random times through the index against reading up
+/// to the time. With --synthesize the recording is first repeated into a new one of the
+/// given size, which is removed afterwards. Checks that both ways of reading yield the
+/// same frames, and that every seek lands on the last frame at or before its time.
+/// Reads go through the page cache, so a recording read recently measures memory
+/// rather than the disk.
+/// </summary>
+/// <param name="argc">number of command arguments</param>
+/// <param name="argv">command arguments, starting after the command name</param>
+/// <returns>process exit code</returns>
+int SessionBenchCommand(int argc, char** argv)
+{
+    const char* szSource = nullptr;
+    const char* szSynthesized = "session-bench.kin";
+    double fSynthesizeGb = 0.0;
+    int nSeeks = 1000;
+
+    for (int i = 0; i < argc; ++i)
+    {
+        if (IsSwitch(argv[i], "--seeks") && i + 1 < argc)
+        {
+            nSeeks = (std::max)(atoi(argv[++i]), 1);
+        }
+        else if (IsSwitch(argv[i], "--synthesize") && i + 1 < argc)
+        {
+            fSynthesizeGb = atof(argv[++i]);
+        }
+        else if (IsSwitch(argv[i], "--output") && i + 1 < argc)
+        {
+            szSynthesized = argv[++i];
+        }
+        else
+        {
+            szSource = argv[i];
+        }
+    }
+
+    if (nullptr == szSource)
+    {
+        fprintf(stderr, "session-bench: missing recording path\n");
+        return 1;
+    }
+
+    const char* szPath = szSource;
+    if (fSynthesizeGb > 0.0)
+    {
+        INT64 nStartNs = GetPerfClockNs();
+        HRESULT hr = SynthesizeRecording(szSource, szSynthesized, static_cast<UINT64>(fSynthesizeGb * 1e9));
+        double fSeconds = (GetPerfClockNs() - nStartNs) / 1e9;
+        if (FAILED(hr))
+        {
+            fprintf(stderr, "session-bench: failed to write %s from %s (0x%08x)\n", szSynthesized, szSource, static_cast<unsigned int>(hr));
+            remove(szSynthesized);
+            return 1;
+        }
+
+        printf("synthesized          %s, %.1f GB in %.1f s (%.0f MB/s written)\n", szSynthesized, fSynthesizeGb, fSeconds, fSynthesizeGb * 1e3 / fSeconds);
+        szPath = szSynthesized;
+    }
+
+    // open: map, load or rebuild the index, bucket the frame times
+    MappedSession* pSession = new MappedSession();
+    INT64 nStartNs = GetPerfClockNs();
+    HRESULT hr = pSession->Open(szPath);
+    INT64 nOpenNs = GetPerfClockNs() - nStartNs;
+
+    SessionReader reader;
+    if (SUCCEEDED(hr))
+    {
+        hr = reader.Open(szPath);
+    }
+
+    const std::vector<SessionIndexEntry>& index = pSession->GetIndex();
+    if (FAILED(hr) || index.empty())
+    {
+        fprintf(stderr, "session-bench: failed to open %s or it holds no frames (0x%08x)\n", szPath, static_cast<unsigned int>(hr));
+        delete pSession;
+        if (szPath != szSource)
+        {
+            remove(szPath);
+        }
+        return 1;
+    }
+
+    bool bPassed = true;
+    UINT64 cbRecords = pSession->GetRecordsEnd() - sizeof(SessionFileHeader);
+
+    printf("recording            %s, %.1f MB, %u frames, %.1f s\n", szPath, pSession->GetFileSize() / 1e6,
+        static_cast<unsigned int>(index.size()), (index.back().nTime - index[0].nTime) / 1e7);
+    printf("open                 %.2f ms, index %s\n", nOpenNs / 1e6, pSession->HasStoredIndex() ? "stored" : "rebuilt from the records");
+
+    // sequential: every frame with every byte of its color, mapped and record by record
+    SessionFrame frame;
+    std::vector<AudioChunk> audio;
+    UINT64 nMappedDigest = c_SessionDigestSeed;
+
+    nStartNs = GetPerfClockNs();
+    for (size_t i = 0; i < index.size() && SUCCEEDED(hr); ++i)
+    {
+        hr = pSession->ReadFrame(i, &frame, &audio);
+        DigestSessionFrame(frame, audio, &nMappedDigest);
+    }
+    double fMappedSeconds = (GetPerfClockNs() - nStartNs) / 1e9;
+
+    UINT64 nReadDigest;
+    UINT64 cbRead;
+    nStartNs = GetPerfClockNs();
+    UINT64 nReadFrames = ReadSessionRecords(&reader, -1, &nReadDigest, &cbRead);
+    double fReadSeconds = (GetPerfClockNs() - nStartNs) / 1e9;
+
+    bool bScanPassed = SUCCEEDED(hr) && nReadFrames == index.size() && nReadDigest == nMappedDigest;
+    bPassed = bPassed && bScanPassed;
+
+    printf("sequential scan      mapped %.2f GB/s, record by record %.2f GB/s, frames %s\n", cbRecords / fMappedSeconds / 1e9,
+        cbRead / fReadSeconds / 1e9, bScanPassed ? "match" : "DIFFER");
+
+    // random seeks: the frame lookup alone, then with the frame read and its color touched
+    LatencyHistogram* pLookup = new LatencyHistogram();
+    LatencyHistogram* pSeek = new LatencyHistogram();
+    LatencySnapshot* pSnapshot = new LatencySnapshot;
+    INT64 nFirstTime = index[0].nTime;
+    UINT64 nSpan = static_cast<UINT64>(index.back().nTime - nFirstTime) + 1;
+    UINT64 nRandom = 88172645463325252ULL;
+    std::vector<INT64> seekTimes(nSeeks);
+    std::vector<size_t> seekFrames(nSeeks);
+    bool bSeekPassed = true;
+
+    for (int i = 0; i < nSeeks; ++i)
+    {
+        nRandom ^= nRandom << 13;
+        nRandom ^= nRandom >> 7;
+        nRandom ^= nRandom << 17;
+        seekTimes[i] = nFirstTime + static_cast<INT64>(nRandom % nSpan);
+
+        // the last frame at or before the time
+        size_t iExpected = 0;
+        size_t nBelow = index.size();
+        while (nBelow > 0)
+        {
+            size_t nHalf = nBelow / 2;
+            if (index[iExpected + nHalf].nTime <= seekTimes[i])
+            {
+                iExpected += nHalf + 1;
+                nBelow -= nHalf + 1;
+            }
+            else
+            {
+                nBelow = nHalf;
+            }
+        }
+        seekFrames[i] = (iExpected > 0) ? iExpected - 1 : 0;
+    }
+
+    for (int i = 0; i < nSeeks; ++i)
+    {
+        INT64 nSeekNs = GetPerfClockNs();
+        size_t iFrame = pSession->FindFrame(seekTimes[i]);
+        pLookup->Record(GetPerfClockNs() - nSeekNs);
+
+        bSeekPassed = bSeekPassed && iFrame == seekFrames[i];
+    }
+
+    UINT64 nTouched = 0;
+    for (int i = 0; i < nSeeks; ++i)
+    {
+        INT64 nSeekNs = GetPerfClockNs();
+        size_t iFrame = pSession->FindFrame(seekTimes[i]);
+        hr = pSession->ReadFrame(iFrame, &frame, &audio);
+        UINT64 nDigest = 0;
+        DigestSessionFrame(frame, audio, &nDigest);
+        pSeek->Record(GetPerfClockNs() - nSeekNs);
+
+        nTouched += nDigest;
+        bSeekPassed = bSeekPassed && SUCCEEDED(hr) && frame.nTime == index[seekFrames[i]].nTime;
+    }
+    bPassed = bPassed && bSeekPassed;
+
+    pLookup->GetSnapshot(pSnapshot);
+    printf("%-20s %10s %10s %10s  (%d random times)\n", "seek", "p50", "p99", "max", nSeeks);
+    printf("%-20s %8.2fus %8.2fus %8.2fus\n", "  frame lookup", pSnapshot->GetPercentileNs(0.5) / 1e3,
+        pSnapshot->GetPercentileNs(0.99) / 1e3, pSnapshot->nMaxNs / 1e3);
+
+    pSeek->GetSnapshot(pSnapshot);
+    printf("%-20s %8.2fus %8.2fus %8.2fus\n", "  lookup and read", pSnapshot->GetPercentileNs(0.5) / 1e3,
+        pSnapshot->GetPercentileNs(0.99) / 1e3, pSnapshot->nMaxNs / 1e3);
+
+    // reading up to the frame is linear in its position, so only a few of the seeks
+    int nReadSeeks = (std::min)(nSeeks, 5);
+    double fReadSeekMs = 0.0;
+    for (int i = 0; i < nReadSeeks; ++i)
+    {
+        INT64 nSeekNs = GetPerfClockNs();
+        ReadSessionRecords(&reader, static_cast<INT64>(seekFrames[i]), nullptr, nullptr);
+        fReadSeekMs += (GetPerfClockNs() - nSeekNs) / 1e6;
+    }
+
+    printf("  record by record   %8.2fms mean of %d seeks, reading up to the frame\n", fReadSeekMs / nReadSeeks, nReadSeeks);
+    printf("seeks                %s (digest %016llx)\n", bSeekPassed ? "land on the right frames" : "MISSED frames",
+        static_cast<unsigned long long>(nTouched));
+
+    delete pSnapshot;
+    delete pSeek;
+    delete pLookup;
+    delete pSession;
+    reader.Close();
+
+    if (szPath != szSource)
+    {
+        remove(szPath);
+    }
+
+    printf("%s\n", bPassed ? "PASS" : "FAIL");
+    return bPassed ? 0 : 1;
+}
@@ -0,0 +1,262 @@
+//------------------------------------------------------------------------------
+// <copyright file="BenchSpeakerLog.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Throughput and integrity checks of the speaker log, run as console tool commands
+
+#include "KinectTypes.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include "PerfClock.h"
+#include "LatencyHistogram.h"
+#include "SpeakerLog.h"
+#include "ToolCommands.h"
+
+/// <summary>
+/// Fills in a speaker log record whose fields are all derived from its sequence number,
+/// so that a reader can tell a damaged record from a whole one
+/// </summary>
+/// <param name="nSequence">sequence number</param>
+/// <param name="pRecord">receives the record</param>
+static void MakeTestLogRecord(UINT64 nSequence, SpeakerLogRecord* pRecord)
+{
+    memset(pRecord, 0, sizeof(*pRecord));
+    pRecord->nTime = static_cast<INT64>(nSequence) * 333333;
+    pRecord->nTrackingId = nSequence * 7 + 1;
+    pRecord->faceBox.Left = static_cast<INT32>(nSequence % 1700);
+    pRecord->faceBox.Top = static_cast<INT32>(nSequence % 900);
+    pRecord->faceBox.Right = pRecord->faceBox.Left + 200;
+    pRecord->faceBox.Bottom = pRecord->faceBox.Top + 180;
+    pRecord->fFaceAngle = static_cast<float>(nSequence % 100) - 50.0f;
+    pRecord->fBeamAngle = pRecord->fFaceAngle + 1.0f;
+    pRecord->fBeamAngleConfidence = static_cast<float>(nSequence % 11) / 10.0f;
+    pRecord->fEnergy = static_cast<float>(nSequence % 101) / 100.0f;
+    pRecord->nFace = static_cast<UINT32>(nSequence % BODY_COUNT);
+}
+
+/// <summary>
+/// Reads a speaker log written from MakeTestLogRecord records back and checks that every
+/// record is whole and that the records are in order
+/// </summary>
+/// <param name="szPath">path of the log</param>
+/// <param name="pnRecords">receives the number of records read</param>
+/// <returns>true if every record checked out</returns>
+static bool CheckTestLog(const char* szPath, UINT64* pnRecords)
+{
+    SpeakerLogReader reader;
+    *pnRecords = 0;
+    if (FAILED(reader.Open(szPath)))
+    {
+        return false;
+    }
+
+    SpeakerLogRecord record;
+    SpeakerLogRecord expected;
+    INT64 nLastTime = -1;
+    HRESULT hr;
+
+    while (S_OK == (hr = reader.Read(&record)))
+    {
+        UINT64 nSequence = static_cast<UINT64>(record.nTime / 333333);
+        MakeTestLogRecord(nSequence, &expected);
+        if (0 != memcmp(&record, &expected, sizeof(record)) || record.nTime <= nLastTime)
+        {
+            return false;
+        }
+
+        nLastTime = record.nTime;
+        (*pnRecords)++;
+    }
+
+    return S_FALSE == hr;
+}
+
+/// <summary>
+/// speaker-log-bench [--seconds N] [--faces N] [--output file]: measures the sustained
+/// throughput of the speaker log with one thread appending as fast as it can, then the
+/// time appending adds to a frame loop logging N speakers in every frame at 30 frames per
+/// second, against writing every record with the C runtime right away, and last a frame
+/// loop appending one record and then none. Checks that the frame loop lost no record,
+/// that the logs read back whole and in order, and that the lone record was written
+/// once it had been held for the hand-off time, without waiting for another record.
+/// </summary>
+/// <param name="argc">number of command arguments</param>
+/// <param name="argv">command arguments, starting after the command name</param>
+/// <returns>process exit code</returns>
+int SpeakerLogBenchCommand(int argc, char** argv)
+{
+    int nSeconds = 3;
+    int nFaces = BODY_COUNT;
+    const char* szPath = "speaker-log-bench.bin";
+
+    for (int i = 0; i < argc; ++i)
+    {
+        if (IsSwitch(argv[i], "--seconds") && i + 1 < argc)
+        {
+            nSeconds = (std::max)(atoi(argv[++i]), 1);
+        }
+        else if (IsSwitch(argv[i], "--faces") && i + 1 < argc)
+        {
+            nFaces = (std::max)(atoi(argv[++i]), 1);
+        }
+        else if (IsSwitch(argv[i], "--output") && i + 1 < argc)
+        {
+            szPath = argv[++i];
+        }
+    }
+
+    bool bPassed = true;
+    SpeakerLogWriter writer;
+    SpeakerLogStats stats;
+    UINT64 nRead;
+
+    // sustained: as fast as one thread appends; what the disk does not take in time is dropped
+    if (FAILED(writer.Open(szPath)))
+    {
+        fprintf(stderr, "speaker-log-bench: failed to create %s\n", szPath);
+        return 1;
+    }
+
+    SpeakerLogRecord record;
+    UINT64 nSequence = 0;
+    INT64 nStartNs = GetPerfClockNs();
+    INT64 nEndNs = nStartNs + static_cast<INT64>(nSeconds) * 1000000000;
+
+    while (GetPerfClockNs() < nEndNs)
+    {
+        for (int i = 0; i < 1024; ++i)
+        {
+            MakeTestLogRecord(nSequence++, &record);
+            writer.Append(record);
+        }
+    }
+
+    HRESULT hr = writer.Close();
+    double fSeconds = (GetPerfClockNs() - nStartNs) / 1e9;
+    writer.GetStats(&stats);
+
+    bool bSustainedPassed = SUCCEEDED(hr) && stats.nWritten == stats.nAppended && CheckTestLog(szPath, &nRead) && nRead == stats.nWritten;
+    bPassed = bPassed && bSustainedPassed;
+
+    printf("sustained            %.0f records/s appended, %.0f records/s written (%.1f MB/s)\n",
+        (stats.nAppended + stats.nDropped) / fSeconds, stats.nWritten / fSeconds, stats.nBytesWritten / fSeconds / 1e6);
+    printf("                     %llu written in %llu writes, %llu dropped, read back %s\n",
+        static_cast<unsigned long long>(stats.nWritten), static_cast<unsigned long long>(stats.nWrites),
+        static_cast<unsigned long long>(stats.nDropped), bSustainedPassed ? "whole" : "DAMAGED");
+
+    // frame loop: every face of every frame appended, each append timed
+    LatencyHistogram* pLogged = new LatencyHistogram();
+    LatencyHistogram* pDirect = new LatencyHistogram();
+    LatencySnapshot* pSnapshot = new LatencySnapshot;
+    const INT64 nFrameNs = 1000000000 / 30;
+    int nFrames = nSeconds * 30;
+
+    hr = writer.Open(szPath);
+    nSequence = 0;
+    nStartNs = GetPerfClockNs();
+
+    for (int iFrame = 0; SUCCEEDED(hr) && iFrame < nFrames; ++iFrame)
+    {
+        for (int i = 0; i < nFaces; ++i)
+        {
+            MakeTestLogRecord(nSequence++, &record);
+
+            INT64 nAppendNs = GetPerfClockNs();
+            writer.Append(record);
+            pLogged->Record(GetPerfClockNs() - nAppendNs);
+        }
+
+        std::this_thread::sleep_for(std::chrono::nanoseconds(nStartNs + (iFrame + 1) * nFrameNs - GetPerfClockNs()));
+    }
+
+    hr = SUCCEEDED(hr) ? writer.Close() : hr;
+    writer.GetStats(&stats);
+    bool bFramePassed = SUCCEEDED(hr) && 0 == stats.nDropped && CheckTestLog(szPath, &nRead) && nRead == static_cast<UINT64>(nFrames) * nFaces;
+    bPassed = bPassed && bFramePassed;
+
+    pLogged->GetSnapshot(pSnapshot);
+    INT64 nLoggedP50Ns = pSnapshot->GetPercentileNs(0.5);
+    INT64 nLoggedP99Ns = pSnapshot->GetPercentileNs(0.99);
+    INT64 nLoggedMaxNs = pSnapshot->nMaxNs;
+
+    // the same records written by the frame loop itself, flushed once a frame
+    FILE* pFile = OpenFile(szPath, "wb");
+    nSequence = 0;
+    nStartNs = GetPerfClockNs();
+
+    for (int iFrame = 0; pFile && iFrame < nFrames; ++iFrame)
+    {
+        for (int i = 0; i < nFaces; ++i)
+        {
+            MakeTestLogRecord(nSequence++, &record);
+
+            INT64 nWriteNs = GetPerfClockNs();
+            fwrite(&record, sizeof(record), 1, pFile);
+            if (nFaces - 1 == i)
+            {
+                fflush(pFile);
+            }
+            pDirect->Record(GetPerfClockNs() - nWriteNs);
+        }
+
+        std::this_thread::sleep_for(std::chrono::nanoseconds(nStartNs + (iFrame + 1) * nFrameNs - GetPerfClockNs()));
+    }
+
+    if (pFile)
+    {
+        fclose(pFile);
+    }
+
+    pDirect->GetSnapshot(pSnapshot);
+
+    printf("frame loop           %d frames of %d speakers, %llu records in %llu writes, %llu dropped, read back %s\n",
+        nFrames, nFaces, static_cast<unsigned long long>(stats.nWritten), static_cast<unsigned long long>(stats.nWrites),
+        static_cast<unsigned long long>(stats.nDropped), bFramePassed ? "whole" : "DAMAGED");
+    printf("%-20s %10s %10s %10s\n", "added per record", "p50", "p99", "max");
+    printf("%-20s %8lldns %8lldns %8lldns\n", "  speaker log", static_cast<long long>(nLoggedP50Ns),
+        static_cast<long long>(nLoggedP99Ns), static_cast<long long>(nLoggedMaxNs));
+    printf("%-20s %8lldns %8lldns %8lldns\n", "  direct write", static_cast<long long>(pSnapshot->GetPercentileNs(0.5)),
+        static_cast<long long>(pSnapshot->GetPercentileNs(0.99)), static_cast<long long>(pSnapshot->nMaxNs));
+
+    // silence: one record, then frames without any; the frame path hands it off in time
+    hr = writer.Open(szPath);
+    MakeTestLogRecord(0, &record);
+    writer.Append(record);
+    nStartNs = GetPerfClockNs();
+    INT64 nWrittenNs = -1;
+
+    for (int iFrame = 0; SUCCEEDED(hr) && nWrittenNs < 0 && iFrame < 30; ++iFrame)
+    {
+        std::this_thread::sleep_for(std::chrono::nanoseconds(nStartNs + (iFrame + 1) * nFrameNs - GetPerfClockNs()));
+        writer.GetStats(&stats);
+        if (stats.nWritten > 0)
+        {
+            nWrittenNs = GetPerfClockNs() - nStartNs;
+        }
+
+        writer.HandOffIfStale();
+    }
+
+    hr = SUCCEEDED(hr) ? writer.Close() : hr;
+
+    // written within the hand-off time, the frame it is handed off in and the frame the
+    // write is seen in; Close writes out what is left, so only a write before it counts
+    bool bSilencePassed = SUCCEEDED(hr) && nWrittenNs >= 0 && nWrittenNs <= static_cast<INT64>(c_SpeakerLogHandOffMs) * 1000000 + 2 * nFrameNs;
+    bPassed = bPassed && bSilencePassed;
+    printf("silence              lone record written after %.0f ms, hand-off after %d ms%s\n",
+        nWrittenNs / 1e6, c_SpeakerLogHandOffMs, bSilencePassed ? "" : " FAILED");
+
+    delete pSnapshot;
+    delete pDirect;
+    delete pLogged;
+    remove(szPath);
+
+    printf("%s\n", bPassed ? "PASS" : "FAIL");
+    return bPassed ? 0 : 1;
+}
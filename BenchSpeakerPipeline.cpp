@@ -0,0 +1,737 @@
+//------------------------------------------------------------------------------
+// <copyright file="BenchSpeakerPipeline.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Throughput and latency benchmarks of the speaker pipeline, run as console tool commands
+
+#include "KinectTypes.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include "PerfClock.h"
+#include "AudioCapture.h"
+#include "FrameBufferPool.h"
+#include "FrameGeometry.h"
+#include "FrameSource.h"
+#include "LatencyHistogram.h"
+#include "PipelineWorkerPool.h"
+#include "SessionRecording.h"
+#include "SpeakerPipeline.h"
+#include "ToolCommands.h"
+
+struct PipelineRunResult
+{
+    HRESULT             hr;
+    UINT64              nFrames;
+    UINT64              nDropped;
+    double              fSeconds;
+    std::vector<INT64>  latenciesNs;
+    SpeakerPipelineStats stats;
+
+    // Median and 99th percentile of every latency metric, and the latencies recorded in all
+    INT64               nLatencyP50Ns[LatencyMetric_Count];
+    INT64               nLatencyP99Ns[LatencyMetric_Count];
+    UINT64              nLatencyRecords;
+
+    // Digest of the time, speaker decisions and mosaic layout of every presented frame
+    UINT64              nDecisionHash;
+
+    // Bytes of the backgrounds presented, those the window copies to its bitmap
+    UINT64              nBackgroundBytes;
+};
+
+// Start of a digest made with HashFrameDecisions
+static const UINT64 c_DecisionHashSeed = 14695981039346656037ULL;
+
+/// <summary>
+/// Adds the time, speaker decisions and mosaic layout of a composed frame to a digest
+/// </summary>
+/// <param name="pFrame">composed frame</param>
+/// <param name="pnHash">digest to update, starting at c_DecisionHashSeed</param>
+static void HashFrameDecisions(const PipelineFrame* pFrame, UINT64* pnHash)
+{
+    UINT64 nValue = static_cast<UINT64>(pFrame->frame.nTime) * 131 + pFrame->layout.nTiles;
+    for (int i = 0; i < BODY_COUNT; ++i)
+    {
+        nValue = nValue * 2 + (pFrame->bIsSpeaker[i] ? 1 : 0);
+    }
+    *pnHash = (*pnHash ^ nValue) * 1099511628211ULL;
+}
+
+/// <summary>
+/// Replays a recording through the speaker pipeline, presenting every composed frame
+/// with a busy wait standing in for drawing it
+/// </summary>
+/// <param name="szPath">path of the recording</param>
+/// <param name="pacing">pacing of the replay</param>
+/// <param name="nDecodeThreads">threads decoding encoded color, 0 for one per hardware thread</param>
+/// <param name="pipelineOptions">how the stages run; whether frames are dropped follows the pacing</param>
+/// <param name="nPresentUs">time presenting a frame takes, in microseconds</param>
+/// <param name="pResult">receives the measurements</param>
+static void RunPipeline(const char* szPath, ReplayPacing pacing, int nDecodeThreads, const SpeakerPipelineOptions& pipelineOptions, int nPresentUs, PipelineRunResult* pResult)
+{
+    ReplayFrameSource source;
+    FrameWakeup wakeup(FrameStream_Color);
+    AudioCapture audioCapture(0, 0);
+    SpeakerPipeline pipeline(&audioCapture);
+    LatencyMonitor* pMonitor = new LatencyMonitor();
+
+    // real time replays drop what the pipeline is too slow for, as the window does
+    SpeakerPipelineOptions options = pipelineOptions;
+    options.bDropWhenBehind = ReplayPacing_RealTime == pacing;
+    options.pLatencyMonitor = pMonitor;
+
+    pResult->nFrames = 0;
+    pResult->nDropped = 0;
+    pResult->latenciesNs.clear();
+    pResult->nDecisionHash = c_DecisionHashSeed;
+    pResult->nBackgroundBytes = 0;
+
+    INT64 nStartNs = GetPerfClockNs();
+    source.SetDecodeThreads(nDecodeThreads);
+    pResult->hr = source.Open(szPath, pacing);
+    if (SUCCEEDED(pResult->hr))
+    {
+        pResult->hr = pipeline.Start(&source, &wakeup, options);
+    }
+
+    while (SUCCEEDED(pResult->hr) && !pipeline.IsFinished())
+    {
+        PipelineFrame* pFrame = pipeline.TakeComposedFrame(1000);
+        if (nullptr == pFrame)
+        {
+            continue;
+        }
+
+        INT64 nPresentStartNs = GetPerfClockNs();
+        INT64 nPresentEndNs = nPresentStartNs + static_cast<INT64>(nPresentUs) * 1000;
+        while (GetPerfClockNs() < nPresentEndNs)
+        {
+        }
+
+        nPresentEndNs = GetPerfClockNs();
+        pMonitor->Record(LatencyMetric_Present, nPresentEndNs - nPresentStartNs);
+
+        if (pFrame->nTriggerNs)
+        {
+            pResult->latenciesNs.push_back(nPresentEndNs - pFrame->nTriggerNs);
+            pMonitor->Record(LatencyMetric_FrameToDisplay, nPresentEndNs - pFrame->nTriggerNs);
+        }
+
+        if (pFrame->nAudioCaptureNs)
+        {
+            pMonitor->Record(LatencyMetric_AudioToDisplay, nPresentEndNs - pFrame->nAudioCaptureNs);
+        }
+
+        if (pFrame->pBgra && !pFrame->bRoiTransfer && 0 == pFrame->layout.nTiles)
+        {
+            pResult->nBackgroundBytes += static_cast<UINT64>(pFrame->nBgraWidth) * pFrame->nBgraHeight * sizeof(UINT32);
+        }
+
+        HashFrameDecisions(pFrame, &pResult->nDecisionHash);
+        pResult->nFrames++;
+        pipeline.ReleaseFrame(pFrame);
+    }
+
+    if (SUCCEEDED(pResult->hr) && FAILED(pipeline.GetEndResult()))
+    {
+        pResult->hr = pipeline.GetEndResult();
+    }
+
+    pipeline.Stop();
+    pResult->fSeconds = (GetPerfClockNs() - nStartNs) / 1e9;
+    pipeline.GetStats(&pResult->stats);
+
+    FrameSourceStats sourceStats;
+    source.GetStats(&sourceStats);
+    pResult->nDropped = sourceStats.nFramesDropped + pResult->stats.queues[PipelineStage_Acquire].nDropped +
+        pResult->stats.queues[PipelineStage_Compose].nDropped + pResult->stats.pool.nExhausted;
+
+    LatencySnapshot* pSnapshot = new LatencySnapshot;
+    pResult->nLatencyRecords = 0;
+    for (int i = 0; i < LatencyMetric_Count; ++i)
+    {
+        pMonitor->GetSnapshot(static_cast<LatencyMetric>(i), pSnapshot);
+        pResult->nLatencyP50Ns[i] = pSnapshot->GetPercentileNs(0.5);
+        pResult->nLatencyP99Ns[i] = pSnapshot->GetPercentileNs(0.99);
+        pResult->nLatencyRecords += pSnapshot->nTotal;
+    }
+
+    delete pSnapshot;
+    delete pMonitor;
+}
+
+/// <summary>
+/// Time recording one latency takes, clock reads included, in nanoseconds
+/// </summary>
+static double MeasureLatencyRecordNs()
+{
+    const int c_nRecords = 1000000;
+    LatencyMonitor* pMonitor = new LatencyMonitor();
+
+    INT64 nStartNs = GetPerfClockNs();
+    for (int i = 0; i < c_nRecords; ++i)
+    {
+        INT64 nRecordStartNs = GetPerfClockNs();
+        pMonitor->Record(LatencyMetric_Compose, GetPerfClockNs() - nRecordStartNs);
+    }
+    double fNs = static_cast<double>(GetPerfClockNs() - nStartNs) / c_nRecords;
+
+    delete pMonitor;
+    return fNs;
+}
+
+/// <summary>
+/// pipeline-bench &lt;recording&gt; [--depth N] [--present-ms N] [--large-pages]: replays a
+/// recording through the serial and the threaded speaker pipeline, as fast as possible to
+/// compare the throughput and in real time to compare the latency from frame arrival to
+/// presentation; also reports the latency of every stage and checks that timing them
+/// costs under 1% of the work per frame
+/// </summary>
+/// <param name="argc">number of command arguments</param>
+/// <param name="argv">command arguments, starting after the command name</param>
+/// <returns>process exit code</returns>
+int PipelineBenchCommand(int argc, char** argv)
+{
+    const char* szPath = nullptr;
+    int nQueueDepth = 1;
+    int nPresentUs = 4000;
+    bool bLargePages = false;
+
+    for (int i = 0; i < argc; ++i)
+    {
+        if (IsSwitch(argv[i], "--large-pages"))
+        {
+            bLargePages = true;
+        }
+        else if (IsSwitch(argv[i], "--depth") && i + 1 < argc)
+        {
+            nQueueDepth = (std::max)(atoi(argv[++i]), 1);
+        }
+        else if (IsSwitch(argv[i], "--present-ms") && i + 1 < argc)
+        {
+            nPresentUs = (std::max)(atoi(argv[++i]), 0) * 1000;
+        }
+        else
+        {
+            szPath = argv[i];
+        }
+    }
+
+    if (nullptr == szPath)
+    {
+        fprintf(stderr, "pipeline-bench: missing recording path\n");
+        return 1;
+    }
+
+    // max speed runs first, serial then threaded, then the real time runs
+    PipelineRunResult results[4];
+    const char* c_szModes[2] = { "serial", "threaded" };
+    const char* c_szPacings[2] = { "max", "realtime" };
+    bool bPassed = true;
+
+    printf("%-9s %-9s %7s %8s %8s %12s %12s %12s %9s %9s %9s\n",
+        "pipeline", "pacing", "frames", "dropped", "fps", "latency p50", "p99", "max", "acquire", "associate", "compose");
+
+    for (int iRun = 0; iRun < 4; ++iRun)
+    {
+        PipelineRunResult& result = results[iRun];
+        ReplayPacing pacing = (iRun < 2) ? ReplayPacing_MaxSpeed : ReplayPacing_RealTime;
+        SpeakerPipelineOptions options;
+        options.bThreaded = 1 == iRun % 2;
+        options.nQueueDepth = nQueueDepth;
+        options.bLargePages = bLargePages;
+        RunPipeline(szPath, pacing, 0, options, nPresentUs, &result);
+
+        if (FAILED(result.hr))
+        {
+            fprintf(stderr, "pipeline-bench: failed to replay %s (0x%08x)\n", szPath, static_cast<unsigned int>(result.hr));
+            return 1;
+        }
+
+        std::vector<INT64>& latencies = result.latenciesNs;
+        std::sort(latencies.begin(), latencies.end());
+        double fStageFrames = static_cast<double>((std::max)(result.stats.nFramesAcquired, static_cast<UINT64>(1))) * 1e6;
+
+        printf("%-9s %-9s %7llu %8llu %8.1f %9.2f ms %9.2f ms %9.2f ms %6.2f ms %6.2f ms %6.2f ms\n",
+            c_szModes[iRun % 2], c_szPacings[iRun / 2],
+            static_cast<unsigned long long>(result.nFrames),
+            static_cast<unsigned long long>(result.nDropped),
+            result.fSeconds > 0.0 ? result.nFrames / result.fSeconds : 0.0,
+            latencies.empty() ? 0.0 : latencies[latencies.size() / 2] / 1e6,
+            latencies.empty() ? 0.0 : latencies[latencies.size() * 99 / 100] / 1e6,
+            latencies.empty() ? 0.0 : latencies.back() / 1e6,
+            result.stats.nStageNs[PipelineStage_Acquire] / fStageFrames,
+            result.stats.nStageNs[PipelineStage_Associate] / fStageFrames,
+            result.stats.nStageNs[PipelineStage_Compose] / fStageFrames);
+    }
+
+    for (int iRun = 0; iRun < 4; ++iRun)
+    {
+        const FrameBufferPoolStats& pool = results[iRun].stats.pool;
+        printf("%-9s %-9s pool %u x %llu KB%s, high water %u, exhausted %llu, held at stop %u\n",
+            c_szModes[iRun % 2], c_szPacings[iRun / 2], pool.nBuffers,
+            static_cast<unsigned long long>(pool.cbBuffer / 1024), pool.bLargePages ? " in large pages" : "",
+            pool.nHighWater, static_cast<unsigned long long>(pool.nExhausted), pool.nInUse);
+    }
+
+    // at max speed nothing is dropped, and threading must not change a single decision
+    const PipelineRunResult& serial = results[0];
+    const PipelineRunResult& threaded = results[1];
+    bPassed = (0 == serial.nDropped) && (0 == threaded.nDropped) &&
+        (serial.nFrames == threaded.nFrames) && (serial.nDecisionHash == threaded.nDecisionHash);
+
+    // every buffer went back to its pool with the frame holding it
+    for (int iRun = 0; iRun < 4; ++iRun)
+    {
+        bPassed = bPassed && (0 == results[iRun].stats.pool.nInUse);
+    }
+
+    printf("\n%-17s", "latency p50/p99");
+    for (int iRun = 0; iRun < 4; ++iRun)
+    {
+        printf(" %8s %-9s", c_szModes[iRun % 2], c_szPacings[iRun / 2]);
+    }
+    printf("\n");
+
+    for (int i = 0; i < LatencyMetric_Count; ++i)
+    {
+        printf("%-17s", GetLatencyMetricName(static_cast<LatencyMetric>(i)));
+        for (int iRun = 0; iRun < 4; ++iRun)
+        {
+            printf(" %7.2f/%-7.2f ms", results[iRun].nLatencyP50Ns[i] / 1e6, results[iRun].nLatencyP99Ns[i] / 1e6);
+        }
+        printf("\n");
+    }
+
+    // the instrumentation must stay cheap enough to leave on: what the latencies recorded
+    // per frame cost against the work the stages do per frame, presenting left out. The
+    // serial stages take the frames of a mapped recording without copying them and so do
+    // next to no work; the threaded ones copy every frame, as the sensor source does.
+    double fRecordNs = MeasureLatencyRecordNs();
+    double fRecordsPerFrame = static_cast<double>(threaded.nLatencyRecords) / (std::max)(threaded.nFrames, static_cast<UINT64>(1));
+    double fStageNsPerFrame = static_cast<double>(threaded.stats.nStageNs[PipelineStage_Acquire] + threaded.stats.nStageNs[PipelineStage_Associate] +
+        threaded.stats.nStageNs[PipelineStage_Compose]) / (std::max)(threaded.stats.nFramesAcquired, static_cast<UINT64>(1));
+    double fOverhead = (fStageNsPerFrame > 0.0) ? fRecordsPerFrame * fRecordNs / fStageNsPerFrame : 0.0;
+    bPassed = bPassed && fOverhead < 0.01;
+
+    printf("\n");
+    if (serial.fSeconds > 0.0 && threaded.fSeconds > 0.0)
+    {
+        printf("throughput gain      %.2fx\n", serial.fSeconds / threaded.fSeconds);
+    }
+
+    printf("latency overhead     %.1f records/frame x %.1f ns = %.3f%% of %.2f ms stage work\n",
+        fRecordsPerFrame, fRecordNs, fOverhead * 100.0, fStageNsPerFrame / 1e6);
+
+    printf("decisions            %s\n", (serial.nDecisionHash == threaded.nDecisionHash) ? "identical" : "DIFFERENT");
+    printf("%s\n", bPassed ? "PASS" : "FAIL");
+
+    return bPassed ? 0 : 1;
+}
+
+/// <summary>
+/// Frames one pipeline on a worker pool composed, and their digest
+/// </summary>
+struct PooledPipelineResult
+{
+    UINT64              nFrames;
+    UINT64              nDecisionHash;
+};
+
+/// <summary>
+/// Frame callback of the pipelines of multi-bench
+/// </summary>
+static void CountPooledFrame(void* pContext, SpeakerPipeline* /* pPipeline */, PipelineFrame* pFrame)
+{
+    PooledPipelineResult* pResult = static_cast<PooledPipelineResult*>(pContext);
+    HashFrameDecisions(pFrame, &pResult->nDecisionHash);
+    pResult->nFrames++;
+}
+
+/// <summary>
+/// multi-bench &lt;recording&gt; [--pipelines N] [--workers N]: replays a recording at
+/// maximum speed through 1, 2, 4 ... N independent pipelines at once, every one with a
+/// source of its own, first on a worker pool sized to the machine and then as threaded
+/// pipelines with three stage threads each. Reports the aggregate frames per second and
+/// the scaling over one pipeline, and checks that every pipeline decides as one alone does.
+/// </summary>
+/// <param name="argc">number of command arguments</param>
+/// <param name="argv">command arguments, starting after the command name</param>
+/// <returns>process exit code</returns>
+int MultiBenchCommand(int argc, char** argv)
+{
+    const char* szPath = nullptr;
+    int nHardwareThreads = (std::max)(static_cast<int>(std::thread::hardware_concurrency()), 1);
+    int nMaxPipelines = (std::max)(nHardwareThreads, 4);
+    int nWorkers = 0;
+
+    for (int i = 0; i < argc; ++i)
+    {
+        if (IsSwitch(argv[i], "--pipelines") && i + 1 < argc)
+        {
+            nMaxPipelines = (std::max)(atoi(argv[++i]), 1);
+        }
+        else if (IsSwitch(argv[i], "--workers") && i + 1 < argc)
+        {
+            nWorkers = (std::max)(atoi(argv[++i]), 1);
+        }
+        else
+        {
+            szPath = argv[i];
+        }
+    }
+
+    if (nullptr == szPath)
+    {
+        fprintf(stderr, "multi-bench: missing recording path\n");
+        return 1;
+    }
+
+    // what every pipeline has to decide, from one serial pipeline alone
+    SpeakerPipelineOptions options;
+    options.bThreaded = false;
+    options.bDropWhenBehind = false;
+
+    PipelineRunResult* pReference = new PipelineRunResult;
+    RunPipeline(szPath, ReplayPacing_MaxSpeed, 0, options, 0, pReference);
+    if (FAILED(pReference->hr) || 0 == pReference->nFrames)
+    {
+        fprintf(stderr, "multi-bench: failed to replay %s (0x%08x)\n", szPath, static_cast<unsigned int>(pReference->hr));
+        delete pReference;
+        return 1;
+    }
+
+    UINT64 nReferenceFrames = pReference->nFrames;
+    UINT64 nReferenceHash = pReference->nDecisionHash;
+    delete pReference;
+
+    printf("recording            %llu frames, %d hardware threads\n\n", static_cast<unsigned long long>(nReferenceFrames), nHardwareThreads);
+    printf("%9s %7s %11s %9s %9s %11s %10s %11s %9s %9s\n",
+        "pipelines", "workers", "pooled fps", "scaling", "busy", "migrations", "decisions", "threaded", "scaling", "decisions");
+
+    std::vector<int> pipelineCounts;
+    for (int n = 1; n < nMaxPipelines; n *= 2)
+    {
+        pipelineCounts.push_back(n);
+    }
+    pipelineCounts.push_back(nMaxPipelines);
+
+    bool bPassed = true;
+    double fPooledBase = 0.0;
+    double fThreadedBase = 0.0;
+
+    for (size_t iCount = 0; iCount < pipelineCounts.size(); ++iCount)
+    {
+        int nPipelines = pipelineCounts[iCount];
+        // every pipeline with its own source, wake-up and audio, on one pool; each source
+        // decodes on its read thread alone, as in the batch
+        std::vector<ReplayFrameSource*> sources;
+        std::vector<FrameWakeup*> wakeups;
+        std::vector<AudioCapture*> audioCaptures;
+        std::vector<SpeakerPipeline*> pipelines;
+        std::vector<PooledPipelineResult> pooledResults(nPipelines);
+        PipelineWorkerPoolStats poolStats;
+        HRESULT hr = S_OK;
+        double fPooledSeconds;
+
+        {
+            PipelineWorkerPool pool(nWorkers);
+            INT64 nStartNs = GetPerfClockNs();
+
+            for (int i = 0; i < nPipelines && SUCCEEDED(hr); ++i)
+            {
+                sources.push_back(new ReplayFrameSource());
+                wakeups.push_back(new FrameWakeup(FrameStream_Color));
+                audioCaptures.push_back(new AudioCapture(0, 0));
+                pipelines.push_back(new SpeakerPipeline(audioCaptures.back()));
+                pooledResults[i].nFrames = 0;
+                pooledResults[i].nDecisionHash = c_DecisionHashSeed;
+
+                sources.back()->SetDecodeThreads(1);
+                hr = sources.back()->Open(szPath, ReplayPacing_MaxSpeed);
+                if (SUCCEEDED(hr))
+                {
+                    hr = pool.Add(pipelines.back(), sources.back(), wakeups.back(), options, CountPooledFrame, &pooledResults[i]);
+                }
+            }
+
+            while (SUCCEEDED(hr) && !pool.WaitUntilFinished(1000))
+            {
+            }
+
+            fPooledSeconds = (GetPerfClockNs() - nStartNs) / 1e9;
+            pool.Stop();
+            pool.GetStats(&poolStats);
+        }
+
+        for (int i = 0; i < nPipelines; ++i)
+        {
+            if (SUCCEEDED(hr) && FAILED(pipelines[i]->GetEndResult()))
+            {
+                hr = pipelines[i]->GetEndResult();
+            }
+
+            delete pipelines[i];
+            delete audioCaptures[i];
+            delete wakeups[i];
+            delete sources[i];
+        }
+
+        if (FAILED(hr))
+        {
+            fprintf(stderr, "multi-bench: failed to replay %s on %d pipelines (0x%08x)\n", szPath, nPipelines, static_cast<unsigned int>(hr));
+            return 1;
+        }
+
+        // the same pipelines threaded, every one presenting from a consumer thread of its own
+        SpeakerPipelineOptions threadedOptions = options;
+        threadedOptions.bThreaded = true;
+        PipelineRunResult* pThreadedResults = new PipelineRunResult[nPipelines];
+        std::vector<std::thread> consumers;
+        INT64 nThreadedStartNs = GetPerfClockNs();
+
+        for (int i = 0; i < nPipelines; ++i)
+        {
+            consumers.push_back(std::thread(RunPipeline, szPath, ReplayPacing_MaxSpeed, 1, threadedOptions, 0, &pThreadedResults[i]));
+        }
+
+        for (int i = 0; i < nPipelines; ++i)
+        {
+            consumers[i].join();
+        }
+
+        double fThreadedSeconds = (GetPerfClockNs() - nThreadedStartNs) / 1e9;
+
+        bool bPooledSame = true;
+        bool bThreadedSame = true;
+        UINT64 nPooledFrames = 0;
+        UINT64 nThreadedFrames = 0;
+        for (int i = 0; i < nPipelines; ++i)
+        {
+            bPooledSame = bPooledSame && pooledResults[i].nFrames == nReferenceFrames && pooledResults[i].nDecisionHash == nReferenceHash;
+            bThreadedSame = bThreadedSame && SUCCEEDED(pThreadedResults[i].hr) &&
+                pThreadedResults[i].nFrames == nReferenceFrames && pThreadedResults[i].nDecisionHash == nReferenceHash;
+            nPooledFrames += pooledResults[i].nFrames;
+            nThreadedFrames += pThreadedResults[i].nFrames;
+        }
+
+        delete[] pThreadedResults;
+        bPassed = bPassed && bPooledSame && bThreadedSame;
+
+        double fPooledFps = nPooledFrames / fPooledSeconds;
+        double fThreadedFps = nThreadedFrames / fThreadedSeconds;
+        fPooledBase = (1 == nPipelines) ? fPooledFps : fPooledBase;
+        fThreadedBase = (1 == nPipelines) ? fThreadedFps : fThreadedBase;
+
+        printf("%9d %7d %11.1f %8.2fx %8.1f%% %11llu %10s %11.1f %8.2fx %9s\n",
+            nPipelines, poolStats.nWorkers, fPooledFps, fPooledFps / fPooledBase,
+            100.0 * poolStats.nBusyNs / (fPooledSeconds * 1e9 * poolStats.nWorkers),
+            static_cast<unsigned long long>(poolStats.nMigrations), bPooledSame ? "identical" : "DIFFERENT",
+            fThreadedFps, fThreadedFps / fThreadedBase, bThreadedSame ? "identical" : "DIFFERENT");
+    }
+
+    printf("%s\n", bPassed ? "PASS" : "FAIL");
+    return bPassed ? 0 : 1;
+}
+
+/// <summary>
+/// lazy-bench &lt;recording&gt; [--idle-preview N]: replays a recording through the serial
+/// pipeline with every stream of every frame acquired and converted, then with acquisition
+/// following demand; once with the voice gate, which makes a recording without speech an
+/// idle room, and once without. Reports the stage time per frame and the work done and
+/// skipped, and checks that no speaker decision changes. The stage times are only
+/// reported, as they vary from run to run too much to pass or fail on.
+/// </summary>
+/// <param name="argc">number of command arguments</param>
+/// <param name="argv">command arguments, starting after the command name</param>
+/// <returns>process exit code</returns>
+int LazyBenchCommand(int argc, char** argv)
+{
+    const char* szPath = nullptr;
+    int nIdlePreviewInterval = SpeakerPipelineOptions().nIdlePreviewInterval;
+
+    for (int i = 0; i < argc; ++i)
+    {
+        if (IsSwitch(argv[i], "--idle-preview") && i + 1 < argc)
+        {
+            nIdlePreviewInterval = (std::max)(atoi(argv[++i]), 1);
+        }
+        else
+        {
+            szPath = argv[i];
+        }
+    }
+
+    if (nullptr == szPath)
+    {
+        fprintf(stderr, "lazy-bench: missing recording path\n");
+        return 1;
+    }
+
+    const char* c_szScenes[2] = { "gated", "ungated" };
+    const char* c_szModes[2] = { "eager", "lazy" };
+    PipelineRunResult* pResults = new PipelineRunResult[4];
+    bool bPassed = true;
+
+    printf("%-8s %-6s %7s %9s %9s %9s %9s %15s %15s %15s %13s\n",
+        "scene", "mode", "frames", "acquire", "associate", "compose", "total", "bodies", "faces", "color", "converted");
+
+    for (int iRun = 0; iRun < 4; ++iRun)
+    {
+        PipelineRunResult& result = pResults[iRun];
+        SpeakerPipelineOptions options;
+        options.bThreaded = false;
+        options.bVoiceGate = iRun < 2;
+        options.bEagerAcquisition = 0 == iRun % 2;
+        options.nIdlePreviewInterval = nIdlePreviewInterval;
+        RunPipeline(szPath, ReplayPacing_MaxSpeed, 0, options, 0, &result);
+
+        if (FAILED(result.hr))
+        {
+            fprintf(stderr, "lazy-bench: failed to replay %s (0x%08x)\n", szPath, static_cast<unsigned int>(result.hr));
+            delete[] pResults;
+            return 1;
+        }
+
+        const SpeakerPipelineStats& stats = result.stats;
+        double fFrames = static_cast<double>((std::max)(stats.nFramesAcquired, static_cast<UINT64>(1))) * 1e6;
+        INT64 nTotalNs = stats.nStageNs[PipelineStage_Acquire] + stats.nStageNs[PipelineStage_Associate] + stats.nStageNs[PipelineStage_Compose];
+
+        printf("%-8s %-6s %7llu %6.2f ms %6.2f ms %6.2f ms %6.2f ms %7llu/%-7llu %7llu/%-7llu %7llu/%-7llu %6llu/%-6llu\n",
+            c_szScenes[iRun / 2], c_szModes[iRun % 2], static_cast<unsigned long long>(result.nFrames),
+            stats.nStageNs[PipelineStage_Acquire] / fFrames, stats.nStageNs[PipelineStage_Associate] / fFrames,
+            stats.nStageNs[PipelineStage_Compose] / fFrames, nTotalNs / fFrames,
+            static_cast<unsigned long long>(stats.nBodyAcquired), static_cast<unsigned long long>(stats.nBodySkipped),
+            static_cast<unsigned long long>(stats.nFaceAcquired), static_cast<unsigned long long>(stats.nFaceSkipped),
+            static_cast<unsigned long long>(stats.nColorAcquired), static_cast<unsigned long long>(stats.nColorSkipped),
+            static_cast<unsigned long long>(stats.nFullConversions), static_cast<unsigned long long>(stats.nRoiConversions));
+    }
+
+    printf("%-8s %-6s %7s %9s %9s %9s %9s %15s %15s %15s %13s\n\n",
+        "", "", "", "", "", "", "", "done/skipped", "done/skipped", "done/skipped", "full/roi");
+
+    for (int iScene = 0; iScene < 2; ++iScene)
+    {
+        const PipelineRunResult& eager = pResults[2 * iScene];
+        const PipelineRunResult& lazy = pResults[2 * iScene + 1];
+        INT64 nEagerNs = eager.stats.nStageNs[PipelineStage_Acquire] + eager.stats.nStageNs[PipelineStage_Associate] + eager.stats.nStageNs[PipelineStage_Compose];
+        INT64 nLazyNs = lazy.stats.nStageNs[PipelineStage_Acquire] + lazy.stats.nStageNs[PipelineStage_Associate] + lazy.stats.nStageNs[PipelineStage_Compose];
+
+        // skipping work must not change what is shown
+        bool bSame = (eager.nFrames == lazy.nFrames) && (eager.nDecisionHash == lazy.nDecisionHash) &&
+            (eager.stats.nFramesVoiceGated == lazy.stats.nFramesVoiceGated);
+        bPassed = bPassed && bSame;
+
+        printf("%-8s stage time %5.1f%% of eager, decisions %s  %s\n", c_szScenes[iScene],
+            (nEagerNs > 0) ? 100.0 * nLazyNs / nEagerNs : 0.0, bSame ? "identical" : "DIFFERENT",
+            bSame ? "PASS" : "FAIL");
+    }
+
+    delete[] pResults;
+
+    printf("%s\n", bPassed ? "PASS" : "FAIL");
+    return bPassed ? 0 : 1;
+}
+
+/// <summary>
+/// preview-bench &lt;recording&gt; [--idle-preview N]: replays a recording through the
+/// serial pipeline with the background converted at full and at half resolution, once
+/// with the voice gate, which makes a recording without speech an idle room, and once
+/// without. Reports the stage time and conversion latency per frame and the background
+/// bytes presented, and checks that the speaker decisions and the speaker regions, which
+/// are converted at full resolution either way, do not change.
+/// </summary>
+/// <param name="argc">number of command arguments</param>
+/// <param name="argv">command arguments, starting after the command name</param>
+/// <returns>process exit code</returns>
+int PreviewBenchCommand(int argc, char** argv)
+{
+    const char* szPath = nullptr;
+    int nIdlePreviewInterval = 1;
+
+    for (int i = 0; i < argc; ++i)
+    {
+        if (IsSwitch(argv[i], "--idle-preview") && i + 1 < argc)
+        {
+            nIdlePreviewInterval = (std::max)(atoi(argv[++i]), 1);
+        }
+        else
+        {
+            szPath = argv[i];
+        }
+    }
+
+    if (nullptr == szPath)
+    {
+        fprintf(stderr, "preview-bench: missing recording path\n");
+        return 1;
+    }
+
+    const char* c_szScenes[2] = { "gated", "ungated" };
+    PipelineRunResult* pResults = new PipelineRunResult[4];
+    bool bPassed = true;
+
+    printf("%-8s %-7s %7s %9s %9s %10s %12s %17s\n",
+        "scene", "preview", "frames", "associate", "total", "conversion", "background", "converted");
+
+    for (int iRun = 0; iRun < 4; ++iRun)
+    {
+        PipelineRunResult& result = pResults[iRun];
+        SpeakerPipelineOptions options;
+        options.bThreaded = false;
+        options.bVoiceGate = iRun < 2;
+        options.nIdlePreviewInterval = nIdlePreviewInterval;
+        options.previewResolution = static_cast<PreviewResolution>(iRun % 2);
+        RunPipeline(szPath, ReplayPacing_MaxSpeed, 0, options, 0, &result);
+
+        if (FAILED(result.hr))
+        {
+            fprintf(stderr, "preview-bench: failed to replay %s (0x%08x)\n", szPath, static_cast<unsigned int>(result.hr));
+            delete[] pResults;
+            return 1;
+        }
+
+        const SpeakerPipelineStats& stats = result.stats;
+        double fFrames = static_cast<double>((std::max)(stats.nFramesAcquired, static_cast<UINT64>(1))) * 1e6;
+        INT64 nTotalNs = stats.nStageNs[PipelineStage_Acquire] + stats.nStageNs[PipelineStage_Associate] + stats.nStageNs[PipelineStage_Compose];
+
+        printf("%-8s %-7s %7llu %6.2f ms %6.2f ms %7.2f ms %7.0f KB/f %5llu/%-5llu/%-5llu\n",
+            c_szScenes[iRun / 2], GetPreviewResolutionName(options.previewResolution), static_cast<unsigned long long>(result.nFrames),
+            stats.nStageNs[PipelineStage_Associate] / fFrames, nTotalNs / fFrames, result.nLatencyP50Ns[LatencyMetric_Conversion] / 1e6,
+            result.nBackgroundBytes / 1024.0 / (std::max)(result.nFrames, static_cast<UINT64>(1)),
+            static_cast<unsigned long long>(stats.nFullConversions), static_cast<unsigned long long>(stats.nRoiConversions),
+            static_cast<unsigned long long>(stats.nPreviewConversions));
+    }
+
+    printf("%-8s %-7s %7s %9s %9s %10s %12s %17s\n\n", "", "", "", "", "", "p50", "", "full/roi/preview");
+
+    for (int iScene = 0; iScene < 2; ++iScene)
+    {
+        const PipelineRunResult& full = pResults[2 * iScene];
+        const PipelineRunResult& half = pResults[2 * iScene + 1];
+        INT64 nFullNs = full.stats.nStageNs[PipelineStage_Acquire] + full.stats.nStageNs[PipelineStage_Associate] + full.stats.nStageNs[PipelineStage_Compose];
+        INT64 nHalfNs = half.stats.nStageNs[PipelineStage_Acquire] + half.stats.nStageNs[PipelineStage_Associate] + half.stats.nStageNs[PipelineStage_Compose];
+
+        // the speakers are picked and cropped from full resolution frames either way; only
+        // the backgrounds shrink, to a quarter of the bytes
+        bool bSame = (full.nFrames == half.nFrames) && (full.nDecisionHash == half.nDecisionHash) &&
+            (full.stats.nRoiConversions == half.stats.nRoiConversions);
+        bool bSmaller = 4 * half.nBackgroundBytes == full.nBackgroundBytes;
+        bPassed = bPassed && bSame && bSmaller;
+
+        printf("%-8s stage time %5.1f%% of full, background bytes %5.1f%%, decisions %s  %s\n", c_szScenes[iScene],
+            (nFullNs > 0) ? 100.0 * nHalfNs / nFullNs : 0.0,
+            (full.nBackgroundBytes > 0) ? 100.0 * half.nBackgroundBytes / full.nBackgroundBytes : 0.0,
+            bSame ? "identical" : "DIFFERENT", (bSame && bSmaller) ? "PASS" : "FAIL");
+    }
+
+    delete[] pResults;
+
+    printf("%s\n", bPassed ? "PASS" : "FAIL");
+    return bPassed ? 0 : 1;
+}
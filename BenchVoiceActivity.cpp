@@ -0,0 +1,442 @@
+//------------------------------------------------------------------------------
+// <copyright file="BenchVoiceActivity.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Detection rates and speed of the voice activity detector, run as a console tool command
+
+#include "KinectTypes.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+#include "PerfClock.h"
+#include "AudioEnergy.h"
+#include "ReplayRunner.h"
+#include "SessionRecording.h"
+#include "VoiceActivity.h"
+#include "ToolCommands.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// Kinds of sound in the synthetic voice activity scene
+enum VadSound
+{
+    VadSound_Quiet = 0,
+    VadSound_Fan = 1,
+    VadSound_Door = 2,
+    VadSound_Typing = 3,
+    VadSound_Speech = 4,
+    VadSound_SpeechOverFan = 5,
+    VadSound_Count = 6
+};
+
+/// <summary>
+/// Next value of the benchmarks' pseudo-random sequence, uniform in [0,1)
+/// </summary>
+/// <param name="pnSeed">state of the sequence</param>
+static float NextUniform(UINT32* pnSeed)
+{
+    *pnSeed = *pnSeed * 1664525 + 1013904223;
+    return static_cast<float>(*pnSeed >> 8) / 16777216.0f;
+}
+
+/// <summary>
+/// Adds a phrase of voiced speech: syllables of harmonics of a falling pitch, shaped by
+/// three formants that move from syllable to syllable, some of them starting with a
+/// hiss like an "s"
+/// </summary>
+/// <param name="pSamples">audio to add the phrase to</param>
+/// <param name="nStart">first sample of the phrase</param>
+/// <param name="nEnd">sample one past the end of the phrase</param>
+/// <param name="fLevel">peak amplitude of the loudest harmonic</param>
+/// <param name="pnSeed">state of the pseudo-random sequence</param>
+static void AddVadSpeech(std::vector<float>* pSamples, size_t nStart, size_t nEnd, float fLevel, UINT32* pnSeed)
+{
+    const float fRate = static_cast<float>(c_AudioSamplesPerSecond);
+    float fPitch = 90.0f + 130.0f * NextUniform(pnSeed);
+    size_t i = nStart + static_cast<size_t>(0.02f * fRate);
+
+    while (i < nEnd)
+    {
+        size_t nLength = static_cast<size_t>((0.12f + 0.16f * NextUniform(pnSeed)) * fRate);
+        nLength = (std::min)(nLength, nEnd - i);
+
+        // formant gain for each harmonic of the syllable
+        float fFormants[3] =
+        {
+            300.0f + 500.0f * NextUniform(pnSeed),
+            900.0f + 1400.0f * NextUniform(pnSeed),
+            2500.0f + 500.0f * NextUniform(pnSeed)
+        };
+        const float c_fBandwidths[3] = { 100.0f, 150.0f, 200.0f };
+        int nHarmonics = static_cast<int>(7500.0f / fPitch);
+        std::vector<float> gains(nHarmonics);
+        for (int k = 0; k < nHarmonics; ++k)
+        {
+            float fFrequency = (k + 1) * fPitch;
+            float fGain = 0.02f;
+            for (int f = 0; f < 3; ++f)
+            {
+                float fOffset = (fFrequency - fFormants[f]) / c_fBandwidths[f];
+                fGain += 1.0f / (1.0f + fOffset * fOffset);
+            }
+            gains[k] = fGain / (k + 1);
+        }
+
+        // one syllable in four starts with a hiss
+        size_t nHiss = (NextUniform(pnSeed) < 0.25f) ? static_cast<size_t>(0.06f * fRate) : 0;
+        float fPrevious = 0.0f;
+        for (size_t j = 0; j < nHiss && i + j < nEnd; ++j)
+        {
+            float fNoise = NextUniform(pnSeed) - 0.5f;
+            (*pSamples)[i + j] += 0.3f * fLevel * (fNoise - fPrevious);
+            fPrevious = fNoise;
+        }
+        i += nHiss;
+        nLength = (std::min)(nLength, nEnd - (std::min)(i, nEnd));
+
+        for (size_t j = 0; j < nLength; ++j)
+        {
+            float fEnvelope = static_cast<float>(sin(M_PI * j / nLength));
+            float fPhase = static_cast<float>(2.0 * M_PI * fPitch * (1.0f - 0.1f * j / nLength) * j / fRate);
+            float fValue = 0.0f;
+            for (int k = 0; k < nHarmonics; ++k)
+            {
+                fValue += gains[k] * static_cast<float>(sin((k + 1) * fPhase));
+            }
+            (*pSamples)[i + j] += fLevel * fEnvelope * fValue;
+        }
+
+        fPitch = (std::max)(fPitch * (0.95f + 0.08f * NextUniform(pnSeed)), 80.0f);
+        i += nLength + static_cast<size_t>((0.04f + 0.08f * NextUniform(pnSeed)) * fRate);
+    }
+}
+
+/// <summary>
+/// Adds the noise of a fan: broadband, louder toward the low frequencies, with a hum at
+/// the blade rate, fading in over 50 ms
+/// </summary>
+/// <param name="pSamples">audio to add the noise to</param>
+/// <param name="nStart">first sample of the noise</param>
+/// <param name="nEnd">sample one past the end of the noise</param>
+/// <param name="pnSeed">state of the pseudo-random sequence</param>
+static void AddVadFan(std::vector<float>* pSamples, size_t nStart, size_t nEnd, UINT32* pnSeed)
+{
+    float fLowPass = 0.0f;
+    for (size_t i = nStart; i < nEnd; ++i)
+    {
+        float fNoise = NextUniform(pnSeed) - 0.5f;
+        fLowPass = 0.85f * fLowPass + 0.15f * fNoise;
+        float fFade = (std::min)(static_cast<float>(i - nStart) / (0.05f * c_AudioSamplesPerSecond), 1.0f);
+        float fHum = static_cast<float>(sin(2.0 * M_PI * 90.0 * i / c_AudioSamplesPerSecond));
+        (*pSamples)[i] += fFade * (0.05f * fLowPass + 0.008f * fNoise + 0.002f * fHum);
+    }
+}
+
+/// <summary>
+/// Builds a scene of room noise with quiet stretches, a fan, doors closing, typing and
+/// phrases of speech with and without the fan, and the kind of sound of every hop
+/// </summary>
+/// <param name="nSeconds">length of the scene</param>
+/// <param name="pSamples">receives the audio</param>
+/// <param name="pHopSounds">receives a VadSound per c_VadHopSamples hop</param>
+static void MakeVadScene(int nSeconds, std::vector<float>* pSamples, std::vector<BYTE>* pHopSounds)
+{
+    const size_t nLength = static_cast<size_t>(nSeconds) * c_AudioSamplesPerSecond;
+    const float fRate = static_cast<float>(c_AudioSamplesPerSecond);
+    UINT32 nSeed = 16000;
+
+    // room noise around -60 dBFS throughout
+    pSamples->resize(nLength);
+    for (size_t i = 0; i < nLength; ++i)
+    {
+        (*pSamples)[i] = 0.003f * (NextUniform(&nSeed) - 0.5f);
+    }
+    pHopSounds->assign(nLength / c_VadHopSamples, static_cast<BYTE>(VadSound_Quiet));
+
+    size_t nStart = 0;
+    while (nStart < nLength)
+    {
+        VadSound sound = static_cast<VadSound>(static_cast<int>(NextUniform(&nSeed) * VadSound_Count));
+        float fSeconds = 1.0f + 3.0f * NextUniform(&nSeed);
+        size_t nEnd = (std::min)(nStart + static_cast<size_t>(fSeconds * fRate), nLength);
+
+        switch (sound)
+        {
+        case VadSound_Fan:
+            AddVadFan(pSamples, nStart, nEnd, &nSeed);
+            break;
+
+        case VadSound_Door:
+            {
+                // a click, then a decaying broadband rattle and a low thud
+                float fLowPass = 0.0f;
+                for (size_t i = nStart; i < nEnd; ++i)
+                {
+                    float t = (i - nStart) / fRate;
+                    float fNoise = NextUniform(&nSeed) - 0.5f;
+                    fLowPass = 0.6f * fLowPass + 0.4f * fNoise;
+                    float fValue = (t < 0.004f) ? fNoise : 0.4f * fLowPass * expf(-t / 0.06f);
+                    fValue += 0.3f * expf(-t / 0.1f) * static_cast<float>(sin(2.0 * M_PI * 80.0 * t));
+                    (*pSamples)[i] += fValue;
+                }
+            }
+            break;
+
+        case VadSound_Typing:
+            {
+                // key clicks a few milliseconds long, 4 to 12 a second
+                size_t i = nStart;
+                while (i < nEnd)
+                {
+                    float fLevel = 0.1f + 0.2f * NextUniform(&nSeed);
+                    for (size_t j = 0; j < 80 && i + j < nEnd; ++j)
+                    {
+                        (*pSamples)[i + j] += fLevel * expf(-static_cast<float>(j) / 24.0f) * (NextUniform(&nSeed) - 0.5f);
+                    }
+                    i += static_cast<size_t>((0.08f + 0.17f * NextUniform(&nSeed)) * fRate);
+                }
+            }
+            break;
+
+        case VadSound_SpeechOverFan:
+            {
+                // the fan runs for a while before someone speaks over it
+                nEnd = (std::min)(nEnd + static_cast<size_t>(1.5f * fRate), nLength);
+                size_t nSpeechStart = (std::min)(nStart + static_cast<size_t>(1.5f * fRate), nEnd);
+                AddVadFan(pSamples, nStart, nEnd, &nSeed);
+                AddVadSpeech(pSamples, nSpeechStart, nEnd, 0.04f, &nSeed);
+                for (size_t iHop = nStart / c_VadHopSamples; iHop < nSpeechStart / c_VadHopSamples; ++iHop)
+                {
+                    (*pHopSounds)[iHop] = static_cast<BYTE>(VadSound_Fan);
+                }
+                nStart = nSpeechStart;
+            }
+            break;
+
+        case VadSound_Speech:
+            AddVadSpeech(pSamples, nStart, nEnd, 0.04f, &nSeed);
+            break;
+
+        default:
+            break;
+        }
+
+        for (size_t iHop = nStart / c_VadHopSamples; iHop < nEnd / c_VadHopSamples; ++iHop)
+        {
+            (*pHopSounds)[iHop] = static_cast<BYTE>(sound);
+        }
+
+        nStart = nEnd;
+    }
+}
+
+/// <summary>
+/// Runs audio through a voice activity detector in reads of 50 ms
+/// </summary>
+/// <param name="pDetector">detector to run</param>
+/// <param name="samples">audio to run</param>
+/// <param name="pVoice">optional; receives whether voice was active after every hop</param>
+/// <param name="pSpeechToNoiseDb">optional; receives the speech to noise level after every hop</param>
+static void RunVoiceActivity(VoiceActivityDetector* pDetector, const std::vector<float>& samples, std::vector<BYTE>* pVoice, std::vector<float>* pSpeechToNoiseDb)
+{
+    const UINT nReadSamples = c_AudioSamplesPerSecond / 20;
+
+    for (size_t i = 0; i < samples.size(); i += nReadSamples)
+    {
+        UINT nRead = static_cast<UINT>((std::min)(static_cast<size_t>(nReadSamples), samples.size() - i));
+
+        // hop by hop, so that the state of every hop can be collected
+        for (UINT j = 0; j < nRead; j += c_VadHopSamples)
+        {
+            UINT nHop = (std::min)(c_VadHopSamples, nRead - j);
+            if (pDetector->Process(&samples[i + j], nHop) > 0)
+            {
+                if (pVoice)
+                {
+                    pVoice->push_back(pDetector->IsVoiceActive() ? 1 : 0);
+                }
+                if (pSpeechToNoiseDb)
+                {
+                    pSpeechToNoiseDb->push_back(pDetector->GetSpeechToNoiseDb());
+                }
+            }
+        }
+    }
+}
+
+/// <summary>
+/// vad-bench [--seconds N] [--iterations N] [recording ...]: checks the voice activity
+/// kernels against each other, measures their cost per 10 ms hop, and measures how often
+/// voice is found in a synthetic scene of speech among fan noise, doors and typing, and
+/// how often it gates the speakers the beam picks in every recording given
+/// </summary>
+/// <param name="argc">number of command arguments</param>
+/// <param name="argv">command arguments, starting after the command name</param>
+/// <returns>process exit code</returns>
+int VadBenchCommand(int argc, char** argv)
+{
+    // most hops outside of speech and its hangover that may find voice, fewest hops of
+    // speech that have to, and most time a hop may take, in microseconds
+    const double fMaxFalseTriggerRate = 0.05;
+    const double fMinHitRate = 0.85;
+    const double fMaxHopMicroseconds = 5.0;
+    int nSeconds = 120;
+    int nIterations = 5;
+    std::vector<const char*> paths;
+
+    for (int i = 0; i < argc; ++i)
+    {
+        if (IsSwitch(argv[i], "--seconds") && i + 1 < argc)
+        {
+            nSeconds = (std::max)(atoi(argv[++i]), 10);
+        }
+        else if (IsSwitch(argv[i], "--iterations") && i + 1 < argc)
+        {
+            nIterations = (std::max)(atoi(argv[++i]), 1);
+        }
+        else
+        {
+            paths.push_back(argv[i]);
+        }
+    }
+
+    std::vector<float> samples;
+    std::vector<BYTE> hopSounds;
+    MakeVadScene(nSeconds, &samples, &hopSounds);
+    bool bPassed = true;
+
+    // every kernel has to make the same decisions as the scalar one
+    std::vector<BYTE> voice[VadKernel_Count];
+    std::vector<float> speechToNoise[VadKernel_Count];
+    for (int k = 0; k < VadKernel_Count; ++k)
+    {
+        VadKernel kernel = static_cast<VadKernel>(k);
+        if (!IsVadKernelSupported(kernel))
+        {
+            continue;
+        }
+
+        VoiceActivityDetector detector(kernel);
+        RunVoiceActivity(&detector, samples, &voice[k], &speechToNoise[k]);
+
+        double fMaxError = 0.0;
+        for (size_t i = 0; i < speechToNoise[k].size(); ++i)
+        {
+            fMaxError = (std::max)(fMaxError, fabs(static_cast<double>(speechToNoise[k][i] - speechToNoise[VadKernel_Scalar][i])));
+        }
+
+        bool bSame = voice[k] == voice[VadKernel_Scalar];
+        printf("%-8s decisions %s, max level difference %.2e dB\n", GetVadKernelName(kernel), bSame ? "same" : "DIFFERENT", fMaxError);
+        bPassed = bPassed && bSame && fMaxError < 1e-2;
+    }
+
+    // cost per hop; the best of the iterations
+    for (int k = 0; k < VadKernel_Count; ++k)
+    {
+        VadKernel kernel = static_cast<VadKernel>(k);
+        if (!IsVadKernelSupported(kernel))
+        {
+            continue;
+        }
+
+        INT64 nBestNs = 0;
+        UINT64 nHops = 0;
+        for (int iIteration = 0; iIteration < nIterations; ++iIteration)
+        {
+            VoiceActivityDetector detector(kernel);
+            INT64 nStartNs = GetPerfClockNs();
+            for (size_t i = 0; i < samples.size(); i += 800)
+            {
+                detector.Process(&samples[i], static_cast<UINT>((std::min)(static_cast<size_t>(800), samples.size() - i)));
+            }
+            INT64 nElapsedNs = GetPerfClockNs() - nStartNs;
+
+            VoiceActivityStats stats;
+            detector.GetStats(&stats);
+            nHops = stats.nHops;
+            nBestNs = (0 == iIteration) ? nElapsedNs : (std::min)(nBestNs, nElapsedNs);
+        }
+
+        double fHopMicroseconds = nHops ? nBestNs / 1e3 / nHops : 0.0;
+        printf("%-8s %6.2f us/hop  %6.3f%% of real time\n", GetVadKernelName(kernel), fHopMicroseconds, fHopMicroseconds / 100.0);
+        if (kernel == GetBestVadKernel())
+        {
+            bPassed = bPassed && fHopMicroseconds < fMaxHopMicroseconds;
+        }
+    }
+
+    // voice found per kind of sound; after speech, voice may hold on for the hangover
+    static const char* c_szSounds[VadSound_Count] = { "quiet", "fan", "door", "typing", "speech", "speech+fan" };
+    const std::vector<BYTE>& decisions = voice[VadKernel_Scalar];
+    UINT64 nHops[VadSound_Count] = {0};
+    UINT64 nVoiceHops[VadSound_Count] = {0};
+    UINT64 nFalseOnsets = 0;
+    size_t nSinceSpeech = static_cast<size_t>(-1) / 2;
+
+    for (size_t i = 0; i < decisions.size() && i < hopSounds.size(); ++i)
+    {
+        bool bSpeech = VadSound_Speech == hopSounds[i] || VadSound_SpeechOverFan == hopSounds[i];
+        nSinceSpeech = bSpeech ? 0 : nSinceSpeech + 1;
+        if (!bSpeech && nSinceSpeech <= static_cast<size_t>(c_VadHangoverHops))
+        {
+            continue;
+        }
+
+        nHops[hopSounds[i]]++;
+        nVoiceHops[hopSounds[i]] += decisions[i];
+        if (!bSpeech && decisions[i] && (0 == i || !decisions[i - 1]))
+        {
+            nFalseOnsets++;
+        }
+    }
+
+    UINT64 nNoiseHops = 0;
+    UINT64 nFalseHops = 0;
+    UINT64 nSpeechHops = 0;
+    UINT64 nHitHops = 0;
+    for (int s = 0; s < VadSound_Count; ++s)
+    {
+        printf("    %-10s %6.1f s  voice %5.1f%%\n", c_szSounds[s], nHops[s] * c_VadHopSamples / static_cast<double>(c_AudioSamplesPerSecond),
+            nHops[s] ? 100.0 * nVoiceHops[s] / nHops[s] : 0.0);
+
+        bool bSpeech = VadSound_Speech == s || VadSound_SpeechOverFan == s;
+        (bSpeech ? nSpeechHops : nNoiseHops) += nHops[s];
+        (bSpeech ? nHitHops : nFalseHops) += nVoiceHops[s];
+    }
+
+    double fFalseTriggerRate = nNoiseHops ? static_cast<double>(nFalseHops) / nNoiseHops : 0.0;
+    double fHitRate = nSpeechHops ? static_cast<double>(nHitHops) / nSpeechHops : 0.0;
+    printf("false triggers       %.2f%% of noise hops, %.1f onsets/min\n", 100.0 * fFalseTriggerRate,
+        nNoiseHops ? nFalseOnsets * 6000.0 / nNoiseHops : 0.0);
+    printf("speech found         %.2f%% of speech hops\n", 100.0 * fHitRate);
+    bPassed = bPassed && fFalseTriggerRate < fMaxFalseTriggerRate && fHitRate > fMinHitRate;
+
+    // on recordings, how much of the time voice was found, and how many of the frames the
+    // beam was confident in it gated
+    for (size_t i = 0; i < paths.size(); ++i)
+    {
+        ReplayStats stats;
+        HRESULT hr = RunReplay(paths[i], ReplayPacing_MaxSpeed, true, nullptr, &stats);
+        if (FAILED(hr))
+        {
+            fprintf(stderr, "vad-bench: failed to replay %s (0x%08x)\n", paths[i], static_cast<unsigned int>(hr));
+            bPassed = false;
+            continue;
+        }
+
+        printf("%s\n", paths[i]);
+        printf("    voice active %.1f%% of audio, %llu onsets; %llu of %llu frames gated (%.1f%%)\n",
+            stats.voiceActivity.nHops ? 100.0 * stats.voiceActivity.nVoiceHops / stats.voiceActivity.nHops : 0.0,
+            static_cast<unsigned long long>(stats.voiceActivity.nOnsets), static_cast<unsigned long long>(stats.nFramesVoiceGated),
+            static_cast<unsigned long long>(stats.nFrames), stats.nFrames ? 100.0 * stats.nFramesVoiceGated / stats.nFrames : 0.0);
+    }
+
+    printf("%s\n", bPassed ? "PASS" : "FAIL");
+    return bPassed ? 0 : 1;
+}
@@ -0,0 +1,200 @@
+//------------------------------------------------------------------------------
+// <copyright file="BoundedQueue.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Blocking queue of fixed capacity connecting two pipeline stages. What happens when
+// the queue is full is chosen per queue: the producer either waits for room, which
+// pushes back on everything upstream, or evicts the oldest item to make room for the
+// newest one. Closing the queue wakes every waiter; the consumer drains what is left.
+
+#pragma once
+
+#include <stddef.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+#include "KinectTypes.h"
+#include "PerfClock.h"
+
+enum QueueFullPolicy
+{
+    // The producer waits until the consumer makes room
+    QueueFull_Block         = 0,
+
+    // The oldest item is evicted and handed back to the producer
+    QueueFull_DropOldest    = 1
+};
+
+struct BoundedQueueStats
+{
+    // Items pushed, including those evicted later
+    UINT64              nPushed;
+
+    // Items evicted to make room for newer ones
+    UINT64              nDropped;
+
+    // Most items ever waiting at once
+    UINT64              nMaxDepth;
+
+    // Time producers spent waiting for room, in nanoseconds
+    INT64               nBlockedNs;
+};
+
+template <typename T>
+class BoundedQueue
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    /// <param name="nCapacity">most items waiting at once, at least one</param>
+    /// <param name="policy">what a push into a full queue does</param>
+    BoundedQueue(size_t nCapacity, QueueFullPolicy policy) :
+        m_items(nCapacity > 0 ? nCapacity : 1),
+        m_policy(policy),
+        m_nHead(0),
+        m_nCount(0),
+        m_bClosed(false)
+    {
+        m_stats.nPushed = 0;
+        m_stats.nDropped = 0;
+        m_stats.nMaxDepth = 0;
+        m_stats.nBlockedNs = 0;
+    }
+
+    /// <summary>
+    /// Appends an item, waiting for room or evicting the oldest item as the policy says
+    /// </summary>
+    /// <param name="item">item to append</param>
+    /// <param name="pEvicted">receives the evicted item, if any</param>
+    /// <param name="pbEvicted">receives whether an item was evicted</param>
+    /// <returns>false if the queue was closed and the item was not appended</returns>
+    bool Push(const T& item, T* pEvicted, bool* pbEvicted)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        *pbEvicted = false;
+
+        if (m_nCount == m_items.size() && !m_bClosed)
+        {
+            if (QueueFull_DropOldest == m_policy)
+            {
+                *pEvicted = m_items[m_nHead];
+                m_nHead = (m_nHead + 1) % m_items.size();
+                m_nCount--;
+                m_stats.nDropped++;
+                *pbEvicted = true;
+            }
+            else
+            {
+                INT64 nStartNs = GetPerfClockNs();
+                m_notFull.wait(lock, [this]() { return m_bClosed || m_nCount < m_items.size(); });
+                m_stats.nBlockedNs += GetPerfClockNs() - nStartNs;
+            }
+        }
+
+        if (m_bClosed)
+        {
+            return false;
+        }
+
+        m_items[(m_nHead + m_nCount) % m_items.size()] = item;
+        m_nCount++;
+        m_stats.nPushed++;
+        m_stats.nMaxDepth = (m_nCount > m_stats.nMaxDepth) ? m_nCount : m_stats.nMaxDepth;
+        lock.unlock();
+
+        m_notEmpty.notify_one();
+        return true;
+    }
+
+    /// <summary>
+    /// Removes the oldest item, waiting for one if the queue is empty
+    /// </summary>
+    /// <param name="pItem">receives the item</param>
+    /// <param name="nTimeoutMs">longest time to wait in milliseconds, negative to wait
+    /// until an item arrives or the queue is closed</param>
+    /// <returns>false on timeout, or once the queue is closed and empty</returns>
+    bool Pop(T* pItem, int nTimeoutMs)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        if (nTimeoutMs < 0)
+        {
+            m_notEmpty.wait(lock, [this]() { return m_bClosed || m_nCount > 0; });
+        }
+        else if (!m_notEmpty.wait_for(lock, std::chrono::milliseconds(nTimeoutMs), [this]() { return m_bClosed || m_nCount > 0; }))
+        {
+            return false;
+        }
+
+        if (0 == m_nCount)
+        {
+            return false;
+        }
+
+        // the slot lets go of the item, which matters for items holding references
+        *pItem = m_items[m_nHead];
+        m_items[m_nHead] = T();
+        m_nHead = (m_nHead + 1) % m_items.size();
+        m_nCount--;
+        lock.unlock();
+
+        m_notFull.notify_one();
+        return true;
+    }
+
+    /// <summary>
+    /// Refuses further pushes and wakes every waiting producer and consumer
+    /// </summary>
+    void Close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_bClosed = true;
+        }
+        m_notEmpty.notify_all();
+        m_notFull.notify_all();
+    }
+
+    /// <summary>
+    /// Number of items currently waiting
+    /// </summary>
+    size_t GetCount() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_nCount;
+    }
+
+    /// <summary>
+    /// Whether the queue was closed and everything in it was taken
+    /// </summary>
+    bool IsDrained() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_bClosed && 0 == m_nCount;
+    }
+
+    /// <summary>
+    /// Snapshot of the queue counters
+    /// </summary>
+    /// <param name="pStats">receives the counters</param>
+    void GetStats(BoundedQueueStats* pStats) const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        *pStats = m_stats;
+    }
+
+private:
+    mutable std::mutex      m_mutex;
+    std::condition_variable m_notEmpty;
+    std::condition_variable m_notFull;
+    std::vector<T>          m_items;
+    QueueFullPolicy         m_policy;
+    size_t                  m_nHead;
+    size_t                  m_nCount;
+    bool                    m_bClosed;
+    BoundedQueueStats       m_stats;
+};
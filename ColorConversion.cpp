@@ -0,0 +1,548 @@
+//------------------------------------------------------------------------------
+// <copyright file="ColorConversion.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "KinectTypes.h"
+#include <algorithm>
+#include "CpuFeatures.h"
+#include "FrameGeometry.h"
+#include "ColorConversion.h"
+
+// BT.601 studio swing coefficients scaled by 256:
+//     C = Y - 16, D = U - 128, E = V - 128
+//     R = (298 C + 409 E + 128) >> 8
+//     G = (298 C - 100 D - 208 E + 128) >> 8
+//     B = (298 C + 516 D + 128) >> 8
+static const int c_YScale = 298;
+static const int c_VToR = 409;
+static const int c_UToG = -100;
+static const int c_VToG = -208;
+static const int c_UToB = 516;
+
+/// <summary>
+/// Clamps a converted channel to a byte
+/// </summary>
+static inline BYTE ClampToByte(int nValue)
+{
+    return static_cast<BYTE>((nValue < 0) ? 0 : ((nValue > 255) ? 255 : nValue));
+}
+
+/// <summary>
+/// Converts a run of whole macropixels one pixel pair at a time
+/// </summary>
+/// <param name="pSource">first YUY2 macropixel</param>
+/// <param name="pDest">first BGRA pixel</param>
+/// <param name="nPairs">number of macropixels</param>
+static void ConvertYuy2RowScalar(const BYTE* pSource, BYTE* pDest, int nPairs)
+{
+    for (int i = 0; i < nPairs; ++i, pSource += 4, pDest += 8)
+    {
+        int d = pSource[1] - 128;
+        int e = pSource[3] - 128;
+        int nR = c_VToR * e + 128;
+        int nG = c_UToG * d + c_VToG * e + 128;
+        int nB = c_UToB * d + 128;
+
+        int c0 = c_YScale * (pSource[0] - 16);
+        pDest[0] = ClampToByte((c0 + nB) >> 8);
+        pDest[1] = ClampToByte((c0 + nG) >> 8);
+        pDest[2] = ClampToByte((c0 + nR) >> 8);
+        pDest[3] = 0xFF;
+
+        int c1 = c_YScale * (pSource[2] - 16);
+        pDest[4] = ClampToByte((c1 + nB) >> 8);
+        pDest[5] = ClampToByte((c1 + nG) >> 8);
+        pDest[6] = ClampToByte((c1 + nR) >> 8);
+        pDest[7] = 0xFF;
+    }
+}
+
+/// <summary>
+/// Average of two bytes rounded up, as _mm_avg_epu8 takes it
+/// </summary>
+static inline BYTE AverageBytes(int a, int b)
+{
+    return static_cast<BYTE>((a + b + 1) >> 1);
+}
+
+/// <summary>
+/// Averages two rows of YUY2 into one row of half the width, still YUY2: the rows first,
+/// then the two luma samples under every half size pixel and the two chroma samples
+/// under every half size macropixel
+/// </summary>
+/// <param name="pRow0">first row</param>
+/// <param name="pRow1">row below it</param>
+/// <param name="pDest">receives the half size row</param>
+/// <param name="nPairs">number of half size macropixels, each made of two macropixels of either row</param>
+static void AverageYuy2RowsScalar(const BYTE* pRow0, const BYTE* pRow1, BYTE* pDest, int nPairs)
+{
+    for (int i = 0; i < nPairs; ++i, pRow0 += 8, pRow1 += 8, pDest += 4)
+    {
+        // Y0 U0 Y1 V0 Y2 U1 Y3 V1
+        BYTE v[8];
+        for (int j = 0; j < 8; ++j)
+        {
+            v[j] = AverageBytes(pRow0[j], pRow1[j]);
+        }
+
+        pDest[0] = AverageBytes(v[0], v[2]);
+        pDest[1] = AverageBytes(v[1], v[5]);
+        pDest[2] = AverageBytes(v[4], v[6]);
+        pDest[3] = AverageBytes(v[3], v[7]);
+    }
+}
+
+/// <summary>
+/// Averages two rows of BGRA into one row of half the width
+/// </summary>
+/// <param name="pRow0">first row</param>
+/// <param name="pRow1">row below it</param>
+/// <param name="pDest">receives the half size row</param>
+/// <param name="nPixels">number of half size pixels</param>
+static void ShrinkBgraRowScalar(const BYTE* pRow0, const BYTE* pRow1, BYTE* pDest, int nPixels)
+{
+    for (int i = 0; i < nPixels; ++i, pRow0 += 8, pRow1 += 8, pDest += 4)
+    {
+        for (int c = 0; c < 4; ++c)
+        {
+            pDest[c] = AverageBytes(AverageBytes(pRow0[c], pRow1[c]), AverageBytes(pRow0[c + 4], pRow1[c + 4]));
+        }
+    }
+}
+
+#if defined(CPU_X86)
+
+/// <summary>
+/// Converts four pixels held as 32 bit Y, U and V lanes to 16 BGRA bytes
+/// </summary>
+CPU_TARGET_SSE41
+static inline __m128i ConvertYuvLanesSse41(__m128i y, __m128i u, __m128i v)
+{
+    const __m128i yScale = _mm_set1_epi32(c_YScale);
+    const __m128i yOffset = _mm_set1_epi32(16);
+    const __m128i uvOffset = _mm_set1_epi32(128);
+    const __m128i rounding = _mm_set1_epi32(128);
+    const __m128i alpha = _mm_set1_epi32(0xFF);
+
+    __m128i c = _mm_add_epi32(_mm_mullo_epi32(_mm_sub_epi32(y, yOffset), yScale), rounding);
+    __m128i d = _mm_sub_epi32(u, uvOffset);
+    __m128i e = _mm_sub_epi32(v, uvOffset);
+
+    __m128i r = _mm_srai_epi32(_mm_add_epi32(c, _mm_mullo_epi32(e, _mm_set1_epi32(c_VToR))), 8);
+    __m128i g = _mm_srai_epi32(_mm_add_epi32(c, _mm_add_epi32(_mm_mullo_epi32(d, _mm_set1_epi32(c_UToG)), _mm_mullo_epi32(e, _mm_set1_epi32(c_VToG)))), 8);
+    __m128i b = _mm_srai_epi32(_mm_add_epi32(c, _mm_mullo_epi32(d, _mm_set1_epi32(c_UToB))), 8);
+
+    // saturate to bytes as b0..b3 r0..r3 g0..g3 a0..a3, then interleave to b g r a
+    __m128i packed = _mm_packus_epi16(_mm_packs_epi32(b, r), _mm_packs_epi32(g, alpha));
+    return _mm_shuffle_epi8(packed, _mm_setr_epi8(0, 8, 4, 12, 1, 9, 5, 13, 2, 10, 6, 14, 3, 11, 7, 15));
+}
+
+/// <summary>
+/// Converts a run of whole macropixels eight pixels at a time
+/// </summary>
+CPU_TARGET_SSE41
+static void ConvertYuy2RowSse41(const BYTE* pSource, BYTE* pDest, int nPairs)
+{
+    // spread Y, U and V of pixels 0-3 and 4-7 of 16 YUY2 bytes into 32 bit lanes
+    const __m128i yLow = _mm_setr_epi8(0, -1, -1, -1, 2, -1, -1, -1, 4, -1, -1, -1, 6, -1, -1, -1);
+    const __m128i uLow = _mm_setr_epi8(1, -1, -1, -1, 1, -1, -1, -1, 5, -1, -1, -1, 5, -1, -1, -1);
+    const __m128i vLow = _mm_setr_epi8(3, -1, -1, -1, 3, -1, -1, -1, 7, -1, -1, -1, 7, -1, -1, -1);
+    const __m128i yHigh = _mm_setr_epi8(8, -1, -1, -1, 10, -1, -1, -1, 12, -1, -1, -1, 14, -1, -1, -1);
+    const __m128i uHigh = _mm_setr_epi8(9, -1, -1, -1, 9, -1, -1, -1, 13, -1, -1, -1, 13, -1, -1, -1);
+    const __m128i vHigh = _mm_setr_epi8(11, -1, -1, -1, 11, -1, -1, -1, 15, -1, -1, -1, 15, -1, -1, -1);
+
+    int i = 0;
+    for (; i + 4 <= nPairs; i += 4, pSource += 16, pDest += 32)
+    {
+        __m128i yuy2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSource));
+
+        __m128i low = ConvertYuvLanesSse41(_mm_shuffle_epi8(yuy2, yLow), _mm_shuffle_epi8(yuy2, uLow), _mm_shuffle_epi8(yuy2, vLow));
+        __m128i high = ConvertYuvLanesSse41(_mm_shuffle_epi8(yuy2, yHigh), _mm_shuffle_epi8(yuy2, uHigh), _mm_shuffle_epi8(yuy2, vHigh));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(pDest), low);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(pDest + 16), high);
+    }
+
+    ConvertYuy2RowScalar(pSource, pDest, nPairs - i);
+}
+
+/// <summary>
+/// Converts four pixels per 128 bit lane held as 32 bit Y, U and V lanes to BGRA bytes
+/// </summary>
+CPU_TARGET_AVX2
+static inline __m256i ConvertYuvLanesAvx2(__m256i y, __m256i u, __m256i v)
+{
+    const __m256i yScale = _mm256_set1_epi32(c_YScale);
+    const __m256i yOffset = _mm256_set1_epi32(16);
+    const __m256i uvOffset = _mm256_set1_epi32(128);
+    const __m256i rounding = _mm256_set1_epi32(128);
+    const __m256i alpha = _mm256_set1_epi32(0xFF);
+
+    __m256i c = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_sub_epi32(y, yOffset), yScale), rounding);
+    __m256i d = _mm256_sub_epi32(u, uvOffset);
+    __m256i e = _mm256_sub_epi32(v, uvOffset);
+
+    __m256i r = _mm256_srai_epi32(_mm256_add_epi32(c, _mm256_mullo_epi32(e, _mm256_set1_epi32(c_VToR))), 8);
+    __m256i g = _mm256_srai_epi32(_mm256_add_epi32(c, _mm256_add_epi32(_mm256_mullo_epi32(d, _mm256_set1_epi32(c_UToG)), _mm256_mullo_epi32(e, _mm256_set1_epi32(c_VToG)))), 8);
+    __m256i b = _mm256_srai_epi32(_mm256_add_epi32(c, _mm256_mullo_epi32(d, _mm256_set1_epi32(c_UToB))), 8);
+
+    // the packs and the shuffle work within each 128 bit lane, exactly as in the SSE version
+    __m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(b, r), _mm256_packs_epi32(g, alpha));
+    return _mm256_shuffle_epi8(packed, _mm256_setr_epi8(
+        0, 8, 4, 12, 1, 9, 5, 13, 2, 10, 6, 14, 3, 11, 7, 15,
+        0, 8, 4, 12, 1, 9, 5, 13, 2, 10, 6, 14, 3, 11, 7, 15));
+}
+
+/// <summary>
+/// Converts a run of whole macropixels sixteen pixels at a time
+/// </summary>
+CPU_TARGET_AVX2
+static void ConvertYuy2RowAvx2(const BYTE* pSource, BYTE* pDest, int nPairs)
+{
+    const __m256i yLow = _mm256_setr_epi8(
+        0, -1, -1, -1, 2, -1, -1, -1, 4, -1, -1, -1, 6, -1, -1, -1,
+        0, -1, -1, -1, 2, -1, -1, -1, 4, -1, -1, -1, 6, -1, -1, -1);
+    const __m256i uLow = _mm256_setr_epi8(
+        1, -1, -1, -1, 1, -1, -1, -1, 5, -1, -1, -1, 5, -1, -1, -1,
+        1, -1, -1, -1, 1, -1, -1, -1, 5, -1, -1, -1, 5, -1, -1, -1);
+    const __m256i vLow = _mm256_setr_epi8(
+        3, -1, -1, -1, 3, -1, -1, -1, 7, -1, -1, -1, 7, -1, -1, -1,
+        3, -1, -1, -1, 3, -1, -1, -1, 7, -1, -1, -1, 7, -1, -1, -1);
+    const __m256i yHigh = _mm256_setr_epi8(
+        8, -1, -1, -1, 10, -1, -1, -1, 12, -1, -1, -1, 14, -1, -1, -1,
+        8, -1, -1, -1, 10, -1, -1, -1, 12, -1, -1, -1, 14, -1, -1, -1);
+    const __m256i uHigh = _mm256_setr_epi8(
+        9, -1, -1, -1, 9, -1, -1, -1, 13, -1, -1, -1, 13, -1, -1, -1,
+        9, -1, -1, -1, 9, -1, -1, -1, 13, -1, -1, -1, 13, -1, -1, -1);
+    const __m256i vHigh = _mm256_setr_epi8(
+        11, -1, -1, -1, 11, -1, -1, -1, 15, -1, -1, -1, 15, -1, -1, -1,
+        11, -1, -1, -1, 11, -1, -1, -1, 15, -1, -1, -1, 15, -1, -1, -1);
+
+    int i = 0;
+    for (; i + 8 <= nPairs; i += 8, pSource += 32, pDest += 64)
+    {
+        __m256i yuy2 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pSource));
+
+        // low holds pixels 0-3 and 8-11, high holds pixels 4-7 and 12-15
+        __m256i low = ConvertYuvLanesAvx2(_mm256_shuffle_epi8(yuy2, yLow), _mm256_shuffle_epi8(yuy2, uLow), _mm256_shuffle_epi8(yuy2, vLow));
+        __m256i high = ConvertYuvLanesAvx2(_mm256_shuffle_epi8(yuy2, yHigh), _mm256_shuffle_epi8(yuy2, uHigh), _mm256_shuffle_epi8(yuy2, vHigh));
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(pDest), _mm256_permute2x128_si256(low, high, 0x20));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(pDest + 32), _mm256_permute2x128_si256(low, high, 0x31));
+    }
+
+    ConvertYuy2RowSse41(pSource, pDest, nPairs - i);
+}
+
+/// <summary>
+/// Averages two rows of YUY2 into one row of half the width four half size macropixels
+/// at a time; the same averages in the same order as the scalar version
+/// </summary>
+CPU_TARGET_SSE41
+static void AverageYuy2RowsSse41(const BYTE* pRow0, const BYTE* pRow1, BYTE* pDest, int nPairs)
+{
+    // of every 8 bytes Y0 U0 Y1 V0 Y2 U1 Y3 V1 averaged over the rows, Y0 U0 Y2 V0 and
+    // Y1 U1 Y3 V1, which averaged give the half size macropixel
+    const __m128i firstLow = _mm_setr_epi8(0, 1, 4, 3, 8, 9, 12, 11, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i firstHigh = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, 0, 1, 4, 3, 8, 9, 12, 11);
+    const __m128i secondLow = _mm_setr_epi8(2, 5, 6, 7, 10, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i secondHigh = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 6, 7, 10, 13, 14, 15);
+
+    int i = 0;
+    for (; i + 4 <= nPairs; i += 4, pRow0 += 32, pRow1 += 32, pDest += 16)
+    {
+        __m128i low = _mm_avg_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pRow0)),
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(pRow1)));
+        __m128i high = _mm_avg_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pRow0 + 16)),
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(pRow1 + 16)));
+
+        __m128i first = _mm_or_si128(_mm_shuffle_epi8(low, firstLow), _mm_shuffle_epi8(high, firstHigh));
+        __m128i second = _mm_or_si128(_mm_shuffle_epi8(low, secondLow), _mm_shuffle_epi8(high, secondHigh));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(pDest), _mm_avg_epu8(first, second));
+    }
+
+    AverageYuy2RowsScalar(pRow0, pRow1, pDest, nPairs - i);
+}
+
+/// <summary>
+/// Averages two rows of BGRA into one row of half the width four pixels at a time
+/// </summary>
+static void ShrinkBgraRowSse2(const BYTE* pRow0, const BYTE* pRow1, BYTE* pDest, int nPixels)
+{
+    int i = 0;
+    for (; i + 4 <= nPixels; i += 4, pRow0 += 32, pRow1 += 32, pDest += 16)
+    {
+        __m128 low = _mm_castsi128_ps(_mm_avg_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pRow0)),
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(pRow1))));
+        __m128 high = _mm_castsi128_ps(_mm_avg_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pRow0 + 16)),
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(pRow1 + 16))));
+
+        // the even and the odd pixels of the eight, whose average is the half size row
+        __m128i even = _mm_castps_si128(_mm_shuffle_ps(low, high, _MM_SHUFFLE(2, 0, 2, 0)));
+        __m128i odd = _mm_castps_si128(_mm_shuffle_ps(low, high, _MM_SHUFFLE(3, 1, 3, 1)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(pDest), _mm_avg_epu8(even, odd));
+    }
+
+    ShrinkBgraRowScalar(pRow0, pRow1, pDest, nPixels - i);
+}
+
+#endif
+
+// Half size macropixels averaged and converted at a time for widths without a specialization
+static const int c_HalfRowChunkPairs = 256;
+
+/// <summary>
+/// Converts a YUY2 image to BGRA at half its width and height, through one half size
+/// YUY2 row at a time. A width known at compile time holds the half size row whole, so
+/// that every row is averaged and converted in one call each; other widths go through
+/// it in chunks.
+/// </summary>
+template <int c_nWidth>
+static void ConvertYuy2HalfRows(void (*pfnAverageRows)(const BYTE*, const BYTE*, BYTE*, int), void (*pfnConvertRow)(const BYTE*, BYTE*, int),
+    const BYTE* pSource, int nSourceStride, int nWidth, int nHeight, BYTE* pDest, int nDestStride)
+{
+    const int nPairs = c_nWidth ? c_nWidth / 4 : nWidth / 4;
+    const int nChunkPairs = c_nWidth ? c_nWidth / 4 : c_HalfRowChunkPairs;
+    BYTE halfRow[c_nWidth ? c_nWidth : 4 * c_HalfRowChunkPairs];
+
+    for (int y = 0; y + 1 < nHeight; y += 2)
+    {
+        const BYTE* pRow0 = pSource + static_cast<size_t>(y) * nSourceStride;
+        const BYTE* pRow1 = pRow0 + nSourceStride;
+        BYTE* pDestRow = pDest + static_cast<size_t>(y / 2) * nDestStride;
+
+        for (int i = 0; i < nPairs; i += nChunkPairs)
+        {
+            int nChunk = (std::min)(nChunkPairs, nPairs - i);
+            pfnAverageRows(pRow0 + i * 8, pRow1 + i * 8, halfRow, nChunk);
+            pfnConvertRow(halfRow, pDestRow + i * 8, nChunk);
+        }
+    }
+}
+
+/// <summary>
+/// Fastest color kernel the processor supports
+/// </summary>
+ColorKernel GetBestColorKernel()
+{
+    static const ColorKernel s_kernel =
+        IsColorKernelSupported(ColorKernel_Avx2) ? ColorKernel_Avx2 :
+        IsColorKernelSupported(ColorKernel_Sse41) ? ColorKernel_Sse41 :
+        ColorKernel_Scalar;
+
+    return s_kernel;
+}
+
+/// <summary>
+/// Whether the processor supports a color kernel
+/// </summary>
+/// <param name="kernel">kernel to check</param>
+bool IsColorKernelSupported(ColorKernel kernel)
+{
+    switch (kernel)
+    {
+    case ColorKernel_Scalar:
+        return true;
+
+    case ColorKernel_Sse41:
+        return CpuHasSse41();
+
+    case ColorKernel_Avx2:
+        // the AVX2 kernel finishes rows with the SSE4.1 one
+        return CpuHasAvx2() && CpuHasSse41();
+
+    default:
+        return false;
+    }
+}
+
+/// <summary>
+/// Short name of a color kernel, for reports
+/// </summary>
+/// <param name="kernel">kernel to name</param>
+const char* GetColorKernelName(ColorKernel kernel)
+{
+    static const char* c_szNames[ColorKernel_Count] = { "scalar", "sse4.1", "avx2" };
+    return (kernel >= 0 && kernel < ColorKernel_Count) ? c_szNames[kernel] : "unknown";
+}
+
+/// <summary>
+/// Widens a rectangle to whole YUY2 macropixels, i.e. to an even left and right edge,
+/// since both pixels of a macropixel share their chroma
+/// </summary>
+/// <param name="pRect">rectangle to widen; right and bottom are exclusive</param>
+/// <param name="nWidth">width (in pixels) of the image, even</param>
+void AlignRectToYuy2(RectI* pRect, int nWidth)
+{
+    pRect->Left &= ~1;
+    pRect->Right = (pRect->Right + 1) & ~1;
+    if (pRect->Right > nWidth)
+    {
+        pRect->Right = nWidth;
+    }
+}
+
+/// <summary>
+/// Converts a rectangle of a YUY2 image to the same rectangle of a BGRA image, using
+/// BT.601 studio swing coefficients in 8 bit fixed point. Every kernel produces
+/// exactly the same output. Pixels outside the rectangle are not touched.
+/// </summary>
+/// <param name="kernel">kernel to use; must be supported</param>
+/// <param name="pSource">YUY2 image</param>
+/// <param name="nSourceStride">length (in bytes) of a row of the YUY2 image</param>
+/// <param name="pDest">BGRA image of the same size; alpha is set to 255</param>
+/// <param name="nDestStride">length (in bytes) of a row of the BGRA image</param>
+/// <param name="pRect">rectangle to convert, aligned with AlignRectToYuy2</param>
+void ConvertYuy2ToBgra(ColorKernel kernel, const BYTE* pSource, int nSourceStride, BYTE* pDest, int nDestStride, const RectI* pRect)
+{
+    void (*pfnConvertRow)(const BYTE*, BYTE*, int) = ConvertYuy2RowScalar;
+
+#if defined(CPU_X86)
+    if (ColorKernel_Avx2 == kernel)
+    {
+        pfnConvertRow = ConvertYuy2RowAvx2;
+    }
+    else if (ColorKernel_Sse41 == kernel)
+    {
+        pfnConvertRow = ConvertYuy2RowSse41;
+    }
+#endif
+
+    int nPairs = (pRect->Right - pRect->Left) / 2;
+    const BYTE* pSourceRow = pSource + static_cast<size_t>(pRect->Top) * nSourceStride + pRect->Left * 2;
+    BYTE* pDestRow = pDest + static_cast<size_t>(pRect->Top) * nDestStride + pRect->Left * 4;
+
+    for (int y = pRect->Top; y < pRect->Bottom; ++y, pSourceRow += nSourceStride, pDestRow += nDestStride)
+    {
+        pfnConvertRow(pSourceRow, pDestRow, nPairs);
+    }
+}
+
+/// <summary>
+/// Converts a YUY2 image to a BGRA image of half its width and height. Every BGRA pixel
+/// has the average luma of the 2x2 YUY2 pixels under it, and every pair of them the
+/// average chroma of the 4x2 pixels under the pair, so that the half size image is
+/// YUY2 subsampled again. Every kernel produces exactly the same output; the widths of
+/// common frame sizes run loops specialized for them at compile time.
+/// </summary>
+/// <param name="kernel">kernel to use; must be supported</param>
+/// <param name="pSource">YUY2 image</param>
+/// <param name="nSourceStride">length (in bytes) of a row of the YUY2 image</param>
+/// <param name="nWidth">width (in pixels) of the YUY2 image, a multiple of 4</param>
+/// <param name="nHeight">height (in pixels) of the YUY2 image, even</param>
+/// <param name="pDest">BGRA image of nWidth / 2 by nHeight / 2 pixels; alpha is set to 255</param>
+/// <param name="nDestStride">length (in bytes) of a row of the BGRA image</param>
+void ConvertYuy2ToBgraHalf(ColorKernel kernel, const BYTE* pSource, int nSourceStride, int nWidth, int nHeight, BYTE* pDest, int nDestStride)
+{
+    void (*pfnAverageRows)(const BYTE*, const BYTE*, BYTE*, int) = AverageYuy2RowsScalar;
+    void (*pfnConvertRow)(const BYTE*, BYTE*, int) = ConvertYuy2RowScalar;
+
+#if defined(CPU_X86)
+    if (ColorKernel_Avx2 == kernel)
+    {
+        pfnAverageRows = AverageYuy2RowsSse41;
+        pfnConvertRow = ConvertYuy2RowAvx2;
+    }
+    else if (ColorKernel_Sse41 == kernel)
+    {
+        pfnAverageRows = AverageYuy2RowsSse41;
+        pfnConvertRow = ConvertYuy2RowSse41;
+    }
+#endif
+
+    switch (nWidth)
+    {
+    case c_SensorColorWidth:
+        ConvertYuy2HalfRows<c_SensorColorWidth>(pfnAverageRows, pfnConvertRow, pSource, nSourceStride, nWidth, nHeight, pDest, nDestStride);
+        break;
+
+    case 1280:
+        ConvertYuy2HalfRows<1280>(pfnAverageRows, pfnConvertRow, pSource, nSourceStride, nWidth, nHeight, pDest, nDestStride);
+        break;
+
+    default:
+        ConvertYuy2HalfRows<0>(pfnAverageRows, pfnConvertRow, pSource, nSourceStride, nWidth, nHeight, pDest, nDestStride);
+        break;
+    }
+}
+
+/// <summary>
+/// Shrinks a BGRA image to half its width and height, every pixel the average of the
+/// 2x2 pixels under it. Every kernel produces exactly the same output.
+/// </summary>
+/// <param name="kernel">kernel to use; must be supported</param>
+/// <param name="pSource">BGRA image</param>
+/// <param name="nSourceStride">length (in bytes) of a row of the source image</param>
+/// <param name="nWidth">width (in pixels) of the source image, even</param>
+/// <param name="nHeight">height (in pixels) of the source image, even</param>
+/// <param name="pDest">BGRA image of nWidth / 2 by nHeight / 2 pixels</param>
+/// <param name="nDestStride">length (in bytes) of a row of the destination image</param>
+void ShrinkBgraHalf(ColorKernel kernel, const BYTE* pSource, int nSourceStride, int nWidth, int nHeight, BYTE* pDest, int nDestStride)
+{
+    void (*pfnShrinkRow)(const BYTE*, const BYTE*, BYTE*, int) = ShrinkBgraRowScalar;
+
+#if defined(CPU_X86)
+    // the vector kernels all come with SSE2
+    if (ColorKernel_Scalar != kernel)
+    {
+        pfnShrinkRow = ShrinkBgraRowSse2;
+    }
+#endif
+
+    for (int y = 0; y + 1 < nHeight; y += 2)
+    {
+        const BYTE* pRow0 = pSource + static_cast<size_t>(y) * nSourceStride;
+        pfnShrinkRow(pRow0, pRow0 + nSourceStride, pDest + static_cast<size_t>(y / 2) * nDestStride, nWidth / 2);
+    }
+}
+
+/// <summary>
+/// Converts a BGRA image to planar I420 (BT.601 studio swing, chroma averaged over
+/// each 2x2 block), the layout video encoders expect
+/// </summary>
+/// <param name="pSource">BGRA image</param>
+/// <param name="nSourceStride">length (in bytes) of a row of the BGRA image</param>
+/// <param name="nWidth">width (in pixels) of the image, even</param>
+/// <param name="nHeight">height (in pixels) of the image, even</param>
+/// <param name="pY">receives nWidth * nHeight luma samples</param>
+/// <param name="pU">receives nWidth * nHeight / 4 blue difference samples</param>
+/// <param name="pV">receives nWidth * nHeight / 4 red difference samples</param>
+void ConvertBgraToI420(const BYTE* pSource, int nSourceStride, int nWidth, int nHeight, BYTE* pY, BYTE* pU, BYTE* pV)
+{
+    for (int y = 0; y < nHeight; y += 2)
+    {
+        const BYTE* pRow0 = pSource + static_cast<size_t>(y) * nSourceStride;
+        const BYTE* pRow1 = pRow0 + nSourceStride;
+        BYTE* pY0 = pY + static_cast<size_t>(y) * nWidth;
+        BYTE* pY1 = pY0 + nWidth;
+        BYTE* pURow = pU + static_cast<size_t>(y / 2) * (nWidth / 2);
+        BYTE* pVRow = pV + static_cast<size_t>(y / 2) * (nWidth / 2);
+
+        for (int x = 0; x < nWidth; x += 2)
+        {
+            const BYTE* pPixels[4] = { pRow0 + x * 4, pRow0 + x * 4 + 4, pRow1 + x * 4, pRow1 + x * 4 + 4 };
+            BYTE* pLuma[4] = { pY0 + x, pY0 + x + 1, pY1 + x, pY1 + x + 1 };
+            int nB = 0;
+            int nG = 0;
+            int nR = 0;
+
+            for (int i = 0; i < 4; ++i)
+            {
+                int b = pPixels[i][0];
+                int g = pPixels[i][1];
+                int r = pPixels[i][2];
+
+                *pLuma[i] = static_cast<BYTE>(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+                nB += b;
+                nG += g;
+                nR += r;
+            }
+
+            // the sums are four times the block average, hence the extra shift by 2
+            pURow[x / 2] = ClampToByte(((-38 * nR - 74 * nG + 112 * nB + 512) >> 10) + 128);
+            pVRow[x / 2] = ClampToByte(((112 * nR - 94 * nG - 18 * nB + 512) >> 10) + 128);
+        }
+    }
+}
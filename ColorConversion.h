@@ -0,0 +1,102 @@
+//------------------------------------------------------------------------------
+// <copyright file="ColorConversion.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Converts the raw YUY2 color stream of the sensor to BGRA, limited to a region of
+// interest so that only the pixels that will be shown are ever converted, or at half
+// the width and height for a preview, and BGRA to the planar YUV layout of video encoders.
+
+#pragma once
+
+#include "KinectTypes.h"
+
+// Implementations of the YUY2 to BGRA converter, slowest first
+enum ColorKernel
+{
+    ColorKernel_Scalar = 0,
+    ColorKernel_Sse41 = 1,
+    ColorKernel_Avx2 = 2,
+    ColorKernel_Count = 3
+};
+
+/// <summary>
+/// Fastest color kernel the processor supports
+/// </summary>
+ColorKernel GetBestColorKernel();
+
+/// <summary>
+/// Whether the processor supports a color kernel
+/// </summary>
+/// <param name="kernel">kernel to check</param>
+bool IsColorKernelSupported(ColorKernel kernel);
+
+/// <summary>
+/// Short name of a color kernel, for reports
+/// </summary>
+/// <param name="kernel">kernel to name</param>
+const char* GetColorKernelName(ColorKernel kernel);
+
+/// <summary>
+/// Widens a rectangle to whole YUY2 macropixels, i.e. to an even left and right edge,
+/// since both pixels of a macropixel share their chroma
+/// </summary>
+/// <param name="pRect">rectangle to widen; right and bottom are exclusive</param>
+/// <param name="nWidth">width (in pixels) of the image, even</param>
+void AlignRectToYuy2(RectI* pRect, int nWidth);
+
+/// <summary>
+/// Converts a rectangle of a YUY2 image to the same rectangle of a BGRA image, using
+/// BT.601 studio swing coefficients in 8 bit fixed point. Every kernel produces
+/// exactly the same output. Pixels outside the rectangle are not touched.
+/// </summary>
+/// <param name="kernel">kernel to use; must be supported</param>
+/// <param name="pSource">YUY2 image</param>
+/// <param name="nSourceStride">length (in bytes) of a row of the YUY2 image</param>
+/// <param name="pDest">BGRA image of the same size; alpha is set to 255</param>
+/// <param name="nDestStride">length (in bytes) of a row of the BGRA image</param>
+/// <param name="pRect">rectangle to convert, aligned with AlignRectToYuy2</param>
+void ConvertYuy2ToBgra(ColorKernel kernel, const BYTE* pSource, int nSourceStride, BYTE* pDest, int nDestStride, const RectI* pRect);
+
+/// <summary>
+/// Converts a YUY2 image to a BGRA image of half its width and height. Every BGRA pixel
+/// has the average luma of the 2x2 YUY2 pixels under it, and every pair of them the
+/// average chroma of the 4x2 pixels under the pair, so that the half size image is
+/// YUY2 subsampled again. Every kernel produces exactly the same output; the widths of
+/// common frame sizes run loops specialized for them at compile time.
+/// </summary>
+/// <param name="kernel">kernel to use; must be supported</param>
+/// <param name="pSource">YUY2 image</param>
+/// <param name="nSourceStride">length (in bytes) of a row of the YUY2 image</param>
+/// <param name="nWidth">width (in pixels) of the YUY2 image, a multiple of 4</param>
+/// <param name="nHeight">height (in pixels) of the YUY2 image, even</param>
+/// <param name="pDest">BGRA image of nWidth / 2 by nHeight / 2 pixels; alpha is set to 255</param>
+/// <param name="nDestStride">length (in bytes) of a row of the BGRA image</param>
+void ConvertYuy2ToBgraHalf(ColorKernel kernel, const BYTE* pSource, int nSourceStride, int nWidth, int nHeight, BYTE* pDest, int nDestStride);
+
+/// <summary>
+/// Shrinks a BGRA image to half its width and height, every pixel the average of the
+/// 2x2 pixels under it. Every kernel produces exactly the same output.
+/// </summary>
+/// <param name="kernel">kernel to use; must be supported</param>
+/// <param name="pSource">BGRA image</param>
+/// <param name="nSourceStride">length (in bytes) of a row of the source image</param>
+/// <param name="nWidth">width (in pixels) of the source image, even</param>
+/// <param name="nHeight">height (in pixels) of the source image, even</param>
+/// <param name="pDest">BGRA image of nWidth / 2 by nHeight / 2 pixels</param>
+/// <param name="nDestStride">length (in bytes) of a row of the destination image</param>
+void ShrinkBgraHalf(ColorKernel kernel, const BYTE* pSource, int nSourceStride, int nWidth, int nHeight, BYTE* pDest, int nDestStride);
+
+/// <summary>
+/// Converts a BGRA image to planar I420 (BT.601 studio swing, chroma averaged over
+/// each 2x2 block), the layout video encoders expect
+/// </summary>
+/// <param name="pSource">BGRA image</param>
+/// <param name="nSourceStride">length (in bytes) of a row of the BGRA image</param>
+/// <param name="nWidth">width (in pixels) of the image, even</param>
+/// <param name="nHeight">height (in pixels) of the image, even</param>
+/// <param name="pY">receives nWidth * nHeight luma samples</param>
+/// <param name="pU">receives nWidth * nHeight / 4 blue difference samples</param>
+/// <param name="pV">receives nWidth * nHeight / 4 red difference samples</param>
+void ConvertBgraToI420(const BYTE* pSource, int nSourceStride, int nWidth, int nHeight, BYTE* pY, BYTE* pU, BYTE* pV);
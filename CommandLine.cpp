@@ -0,0 +1,267 @@
+//------------------------------------------------------------------------------
+// <copyright file="CommandLine.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// On platforms other than Windows this file also provides the process entry point;
+// the hardware independent sources build into the console tool with e.g.
+//     g++ -std=c++11 -O2 -pthread CommandLine.cpp SessionRecording.cpp SpeakerSelection.cpp ReplayRunner.cpp
+//         AudioEnergy.cpp AudioCapture.cpp ColorConversion.cpp CpuFeatures.cpp MosaicCompositor.cpp RoiExport.cpp
+//         BeamAngleMapping.cpp FrameSource.cpp SpeakerPipeline.cpp FrameBufferPool.cpp
+//         MicroBench.cpp LatencyHistogram.cpp BeamHistory.cpp VoiceActivity.cpp RoiScaler.cpp
+//         PipelineWorkerPool.cpp BatchRunner.cpp SpeakerLog.cpp FrameCodec.cpp FrameGeometry.cpp
+//         FaceFrameBatch.cpp SensorClock.cpp ToolCommands.cpp BenchAudioCapture.cpp BenchAudioEnergy.cpp
+//         BenchBeamMapping.cpp BenchColorConversion.cpp BenchFrameBufferPool.cpp BenchFrameCodec.cpp
+//         BenchFrameSource.cpp BenchKernels.cpp BenchMosaicCompositor.cpp BenchRoiScaler.cpp
+//         BenchSessionRecording.cpp BenchSpeakerLog.cpp BenchSpeakerPipeline.cpp BenchVoiceActivity.cpp
+
+#include "KinectTypes.h"
+#include <stdio.h>
+#include <string.h>
+#include "CommandLine.h"
+#include "ToolCommands.h"
+
+typedef int (*ToolCommandHandler)(int argc, char** argv);
+
+struct ToolCommand
+{
+    const char*         szName;
+    const char*         szUsage;
+    ToolCommandHandler  pfnHandler;
+};
+
+static const ToolCommand c_ToolCommands[] =
+{
+    { "replay", "replay <recording> [--realtime] [--no-vad]", ReplayCommand },
+    { "export", "export <recording> <output|-> [--format y4m|i420|bgra] [--size WxH] [--scaling nearest|bilinear|box|auto] [--timestamps file] [--realtime] [--no-vad]", ExportCommand },
+    { "batch", "batch <directory> <output directory> [--format y4m|i420|bgra] [--size WxH] [--scaling nearest|bilinear|box|auto] [--workers N] [--no-crops] [--speaker-log] [--no-vad] [--mapping quadratic|geometric] [--decode-threads N]", BatchCommand },
+    { "speaker-log", "speaker-log <log> [--json]", SpeakerLogCommand },
+    { "speaker-log-bench", "speaker-log-bench [--seconds N] [--faces N] [--output file]", SpeakerLogBenchCommand },
+    { "session-index", "session-index <recording> [recording ...]", SessionIndexCommand },
+    { "session-bench", "session-bench <recording> [--seeks N] [--synthesize GB] [--output file]", SessionBenchCommand },
+    { "session-encode", "session-encode <recording> <output> [--raw] [--max-error N] [--threads N]", SessionEncodeCommand },
+    { "codec-bench", "codec-bench [recording] [--frames N] [--max-error N] [--threads N] [--keyframe N]", CodecBenchCommand },
+    { "ring-stress", "ring-stress [--seconds N] [--consumer-ms N]", RingStressCommand },
+    { "audio-capture", "audio-capture [--seconds N] [--stall-ms N]", AudioCaptureCommand },
+    { "energy-bench", "energy-bench [--seconds N] [--iterations N]", EnergyBenchCommand },
+    { "roi-bench", "roi-bench [--frames N] [--speakers N]", RoiBenchCommand },
+    { "yuy2-bench", "yuy2-bench [--iterations N]", Yuy2BenchCommand },
+    { "scale-bench", "scale-bench [--iterations N]", ScaleBenchCommand },
+    { "mosaic-bench", "mosaic-bench [--frames N]", MosaicBenchCommand },
+    { "beam-map-bench", "beam-map-bench [--frames N] [--iterations N] [recording ...]", BeamMapBenchCommand },
+    { "beam-align-bench", "beam-align-bench [--frames N] [recording ...]", BeamAlignBenchCommand },
+    { "vad-bench", "vad-bench [--seconds N] [--iterations N] [recording ...]", VadBenchCommand },
+    { "acquisition-bench", "acquisition-bench [--seconds N] [--fps N]", AcquisitionBenchCommand },
+    { "pipeline-bench", "pipeline-bench <recording> [--depth N] [--present-ms N] [--large-pages]", PipelineBenchCommand },
+    { "lazy-bench", "lazy-bench <recording> [--idle-preview N]", LazyBenchCommand },
+    { "preview-bench", "preview-bench <recording> [--idle-preview N]", PreviewBenchCommand },
+    { "multi-bench", "multi-bench <recording> [--pipelines N] [--workers N]", MultiBenchCommand },
+    { "pool-stress", "pool-stress [--seconds N] [--large-pages]", PoolStressCommand },
+    { "kernel-bench", "kernel-bench [--filter S] [--min-ms N] [--batches N] [--json file] [--baseline file] [--tolerance PCT]", KernelBenchCommand },
+};
+
+// Options of the windowed application
+static const char c_szAppUsage[] =
+    "FaceBasics-D2D [options]\n"
+    "    --record <file>  --record-codec raw|lossless  --record-max-error 0-127\n"
+    "    --replay <file>  --fast\n"
+    "    --full-frame  --no-vad  --eager  --idle-preview N  --serial  --large-pages\n"
+    "    --export <file>  --export-format y4m|i420|bgra  --export-size WxH  --export-timestamps <file>\n"
+    "    --latency-log <file>  --speaker-log <file>  --scaling nearest|bilinear|box|auto  --preview full|half\n";
+
+/// <summary>
+/// Prints the list of tool commands
+/// </summary>
+static void PrintUsage()
+{
+    fprintf(stderr, "usage:\n");
+    for (size_t i = 0; i < _countof(c_ToolCommands); ++i)
+    {
+        fprintf(stderr, "    %s\n", c_ToolCommands[i].szUsage);
+    }
+}
+
+/// <summary>
+/// Whether the arguments name a console tool command rather than application options
+/// </summary>
+/// <param name="argc">number of arguments, including the program name</param>
+/// <param name="argv">UTF-8 arguments</param>
+/// <returns>true for a tool command</returns>
+bool IsToolCommand(int argc, char** argv)
+{
+    return argc > 1 && 0 != strncmp(argv[1], "--", 2);
+}
+
+/// <summary>
+/// Parses the options of the windowed application
+/// </summary>
+/// <param name="argc">number of arguments, including the program name</param>
+/// <param name="argv">UTF-8 arguments</param>
+/// <param name="pOptions">receives the options</param>
+/// <param name="piInvalidArg">receives, on failure, the index of the argument that is unknown, lacks its value or has an invalid one</param>
+/// <returns>indicates success or failure; E_INVALIDARG for an invalid argument</returns>
+HRESULT ParseAppOptions(int argc, char** argv, AppOptions* pOptions, int* piInvalidArg)
+{
+    *pOptions = AppOptions();
+
+    // an invalid argument ends the loop early, with i at the argument
+    int i = 1;
+    for (; i < argc; ++i)
+    {
+        if (IsSwitch(argv[i], "--record") && i + 1 < argc)
+        {
+            pOptions->recordPath = argv[++i];
+        }
+        else if (IsSwitch(argv[i], "--record-codec") && i + 1 < argc)
+        {
+            ++i;
+            if (0 == strcmp(argv[i], "raw") || 0 == strcmp(argv[i], "lossless"))
+            {
+                pOptions->bRecordRawColor = (0 == strcmp(argv[i], "raw"));
+            }
+            else
+            {
+                break;
+            }
+        }
+        else if (IsSwitch(argv[i], "--record-max-error") && i + 1 < argc)
+        {
+            pOptions->recordCodec.nMaxError = atoi(argv[++i]);
+            if (pOptions->recordCodec.nMaxError < 0 || pOptions->recordCodec.nMaxError > 127)
+            {
+                break;
+            }
+        }
+        else if (IsSwitch(argv[i], "--replay") && i + 1 < argc)
+        {
+            pOptions->replayPath = argv[++i];
+        }
+        else if (IsSwitch(argv[i], "--fast"))
+        {
+            pOptions->replayPacing = ReplayPacing_MaxSpeed;
+        }
+        else if (IsSwitch(argv[i], "--full-frame"))
+        {
+            pOptions->bFullFrameTransfer = true;
+        }
+        else if (IsSwitch(argv[i], "--no-vad"))
+        {
+            pOptions->bNoVoiceGate = true;
+        }
+        else if (IsSwitch(argv[i], "--eager"))
+        {
+            pOptions->bEagerAcquisition = true;
+        }
+        else if (IsSwitch(argv[i], "--idle-preview") && i + 1 < argc)
+        {
+            pOptions->nIdlePreviewInterval = atoi(argv[++i]);
+            if (pOptions->nIdlePreviewInterval < 1)
+            {
+                break;
+            }
+        }
+        else if (IsSwitch(argv[i], "--serial"))
+        {
+            pOptions->bSerialPipeline = true;
+        }
+        else if (IsSwitch(argv[i], "--large-pages"))
+        {
+            pOptions->bLargePages = true;
+        }
+        else if (IsSwitch(argv[i], "--export") && i + 1 < argc)
+        {
+            pOptions->exportPath = argv[++i];
+        }
+        else if (IsSwitch(argv[i], "--export-format") && i + 1 < argc)
+        {
+            if (!ParseRoiExportFormat(argv[++i], &pOptions->exportFormat))
+            {
+                break;
+            }
+        }
+        else if (IsSwitch(argv[i], "--export-size") && i + 1 < argc)
+        {
+            if (!ParseFrameSize(argv[++i], &pOptions->nExportWidth, &pOptions->nExportHeight))
+            {
+                break;
+            }
+        }
+        else if (IsSwitch(argv[i], "--export-timestamps") && i + 1 < argc)
+        {
+            pOptions->exportTimestampPath = argv[++i];
+        }
+        else if (IsSwitch(argv[i], "--latency-log") && i + 1 < argc)
+        {
+            pOptions->latencyLogPath = argv[++i];
+        }
+        else if (IsSwitch(argv[i], "--speaker-log") && i + 1 < argc)
+        {
+            pOptions->speakerLogPath = argv[++i];
+        }
+        else if (IsSwitch(argv[i], "--scaling") && i + 1 < argc)
+        {
+            if (!ParseScaleMethod(argv[++i], &pOptions->scaling))
+            {
+                break;
+            }
+        }
+        else if (IsSwitch(argv[i], "--preview") && i + 1 < argc)
+        {
+            if (!ParsePreviewResolution(argv[++i], &pOptions->previewResolution))
+            {
+                break;
+            }
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    if (i < argc)
+    {
+        *piInvalidArg = i;
+        return E_INVALIDARG;
+    }
+
+    return S_OK;
+}
+
+/// <summary>
+/// Options of the windowed application, one per line, as reported for invalid arguments
+/// </summary>
+const char* GetAppUsage()
+{
+    return c_szAppUsage;
+}
+
+/// <summary>
+/// Runs a console tool command
+/// </summary>
+/// <param name="argc">number of arguments, including the program name</param>
+/// <param name="argv">UTF-8 arguments</param>
+/// <returns>process exit code</returns>
+int RunToolCommand(int argc, char** argv)
+{
+    if (argc > 1)
+    {
+        for (size_t i = 0; i < _countof(c_ToolCommands); ++i)
+        {
+            if (0 == strcmp(argv[1], c_ToolCommands[i].szName))
+            {
+                return c_ToolCommands[i].pfnHandler(argc - 2, argv + 2);
+            }
+        }
+    }
+
+    PrintUsage();
+    return 1;
+}
+
+#if !defined(_WIN32)
+int main(int argc, char** argv)
+{
+    return RunToolCommand(argc, argv);
+}
+#endif
@@ -0,0 +1,130 @@
+//------------------------------------------------------------------------------
+// <copyright file="CommandLine.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Command line handling shared by the Windows application and the portable tools.
+//
+// Arguments starting with "--" configure the windowed application; a leading
+// argument without dashes names a console tool command instead (see RunToolCommand).
+
+#pragma once
+
+#include <string>
+#include "KinectTypes.h"
+#include "SessionRecording.h"
+#include "RoiExport.h"
+#include "FrameGeometry.h"
+
+struct AppOptions
+{
+    // If not empty, every frame processed by the application is recorded to this file
+    std::string         recordPath;
+
+    // Whether the recorded color frames are stored as they are rather than encoded, and
+    // how they are encoded otherwise
+    bool                bRecordRawColor;
+    FrameCodecOptions   recordCodec;
+
+    // If not empty, frames are replayed from this file instead of the sensor
+    std::string         replayPath;
+
+    // Pacing of the replay
+    ReplayPacing        replayPacing;
+
+    // Whether the whole color frame is transferred every frame, even when only the
+    // speaker regions are shown
+    bool                bFullFrameTransfer;
+
+    // Whether speakers are picked whenever the beam is confident, even with no voice
+    // active in the beam audio
+    bool                bNoVoiceGate;
+
+    // Whether every stream of every frame is acquired and converted, whether anything
+    // uses it or not, rather than only what the beam state calls for
+    bool                bEagerAcquisition;
+
+    // Idle frames, those nobody can be picked as a speaker in, per idle frame shown
+    int                 nIdlePreviewInterval;
+
+    // Whether acquisition, speaker association and composition run one after the
+    // other on the window thread rather than on pipeline threads of their own
+    bool                bSerialPipeline;
+
+    // Whether the frame buffers are backed by large pages, when the account may lock
+    // pages in memory
+    bool                bLargePages;
+
+    // If not empty, the application runs without a window and writes the speaker
+    // regions as a video stream to this file, or to stdout for "-"
+    std::string         exportPath;
+
+    // Optional CSV file receiving the RelativeTime of every exported frame
+    std::string         exportTimestampPath;
+
+    // If not empty, the latency percentiles of every second are written to this CSV file
+    std::string         latencyLogPath;
+
+    // If not empty, every face picked as the speaker is appended to this binary log
+    std::string         speakerLogPath;
+
+    // Format and size of the exported frames
+    RoiExportFormat     exportFormat;
+    int                 nExportWidth;
+    int                 nExportHeight;
+
+    // How speaker regions are resampled to the mosaic and to the exported frames
+    ScaleMethod         scaling;
+
+    // Resolution the background shown while nobody speaks is converted and drawn at
+    PreviewResolution   previewResolution;
+
+    AppOptions() :
+        bRecordRawColor(false),
+        replayPacing(ReplayPacing_RealTime),
+        bFullFrameTransfer(false),
+        bNoVoiceGate(false),
+        bEagerAcquisition(false),
+        nIdlePreviewInterval(3),
+        bSerialPipeline(false),
+        bLargePages(false),
+        exportFormat(RoiExportFormat_Y4m),
+        nExportWidth(c_MosaicWidth),
+        nExportHeight(c_MosaicHeight),
+        scaling(ScaleMethod_Auto),
+        previewResolution(PreviewResolution_Full)
+    {
+    }
+};
+
+/// <summary>
+/// Whether the arguments name a console tool command rather than application options
+/// </summary>
+/// <param name="argc">number of arguments, including the program name</param>
+/// <param name="argv">UTF-8 arguments</param>
+/// <returns>true for a tool command</returns>
+bool IsToolCommand(int argc, char** argv);
+
+/// <summary>
+/// Parses the options of the windowed application
+/// </summary>
+/// <param name="argc">number of arguments, including the program name</param>
+/// <param name="argv">UTF-8 arguments</param>
+/// <param name="pOptions">receives the options</param>
+/// <param name="piInvalidArg">receives, on failure, the index of the argument that is unknown, lacks its value or has an invalid one</param>
+/// <returns>indicates success or failure; E_INVALIDARG for an invalid argument</returns>
+HRESULT ParseAppOptions(int argc, char** argv, AppOptions* pOptions, int* piInvalidArg);
+
+/// <summary>
+/// Options of the windowed application, one per line, as reported for invalid arguments
+/// </summary>
+const char* GetAppUsage();
+
+/// <summary>
+/// Runs a console tool command
+/// </summary>
+/// <param name="argc">number of arguments, including the program name</param>
+/// <param name="argv">UTF-8 arguments</param>
+/// <returns>process exit code</returns>
+int RunToolCommand(int argc, char** argv);
@@ -0,0 +1,97 @@
+//------------------------------------------------------------------------------
+// <copyright file="CpuFeatures.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "KinectTypes.h"
+#include "CpuFeatures.h"
+
+#if defined(CPU_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#if defined(CPU_X86)
+
+/// <summary>
+/// Instruction set support, read once
+/// </summary>
+struct CpuFeatureFlags
+{
+    bool bSse2;
+    bool bSse41;
+    bool bAvx2;
+
+    CpuFeatureFlags() :
+        bSse2(false),
+        bSse41(false),
+        bAvx2(false)
+    {
+#if defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 0);
+        int nMaxLeaf = info[0];
+
+        __cpuid(info, 1);
+        bSse2 = 0 != (info[3] & (1 << 26));
+        bSse41 = (0 != (info[2] & (1 << 9))) && (0 != (info[2] & (1 << 19)));
+
+        bool bOsSavesYmm = (0 != (info[2] & (1 << 27))) && (0 != (info[2] & (1 << 28))) && (6 == (_xgetbv(0) & 6));
+        bool bFma = 0 != (info[2] & (1 << 12));
+        if (bOsSavesYmm && bFma && nMaxLeaf >= 7)
+        {
+            __cpuidex(info, 7, 0);
+            bAvx2 = 0 != (info[1] & (1 << 5));
+        }
+#else
+        __builtin_cpu_init();
+        bSse2 = __builtin_cpu_supports("sse2");
+        bSse41 = __builtin_cpu_supports("ssse3") && __builtin_cpu_supports("sse4.1");
+        bAvx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+    }
+};
+
+static const CpuFeatureFlags& GetCpuFeatureFlags()
+{
+    static const CpuFeatureFlags s_flags;
+    return s_flags;
+}
+
+#endif
+
+/// <summary>
+/// Whether the processor supports SSE2; always true on x64
+/// </summary>
+bool CpuHasSse2()
+{
+#if defined(CPU_X86)
+    return GetCpuFeatureFlags().bSse2;
+#else
+    return false;
+#endif
+}
+
+/// <summary>
+/// Whether the processor supports SSSE3 and SSE4.1
+/// </summary>
+bool CpuHasSse41()
+{
+#if defined(CPU_X86)
+    return GetCpuFeatureFlags().bSse41;
+#else
+    return false;
+#endif
+}
+
+/// <summary>
+/// Whether the processor supports AVX2 and FMA, and the OS saves the AVX registers
+/// </summary>
+bool CpuHasAvx2()
+{
+#if defined(CPU_X86)
+    return GetCpuFeatureFlags().bAvx2;
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,40 @@
+//------------------------------------------------------------------------------
+// <copyright file="CpuFeatures.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Run-time detection of the instruction sets the vectorized kernels are written for.
+// Kernels using an instruction set beyond the build's baseline are compiled with
+// CPU_TARGET_* so that they can live next to the portable code in the same file.
+
+#pragma once
+
+#include "KinectTypes.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#define CPU_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#define CPU_TARGET_SSE41
+#define CPU_TARGET_AVX2
+#else
+#define CPU_TARGET_SSE41 __attribute__((target("sse4.1")))
+#define CPU_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#endif
+#endif
+
+/// <summary>
+/// Whether the processor supports SSE2; always true on x64
+/// </summary>
+bool CpuHasSse2();
+
+/// <summary>
+/// Whether the processor supports SSSE3 and SSE4.1
+/// </summary>
+bool CpuHasSse41();
+
+/// <summary>
+/// Whether the processor supports AVX2 and FMA, and the OS saves the AVX registers
+/// </summary>
+bool CpuHasAvx2();
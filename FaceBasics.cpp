@@ -6,28 +6,62 @@
 
 #include "stdafx.h"
 #include <strsafe.h>
+#include <shellapi.h>
+#include <stdio.h>
+#include <string>
 #include "resource.h"
+#include "PerfClock.h"
+#include "SpeakerSelection.h"
 #include "FaceBasics.h"
 
-// face property text layout offset in X axis
-static const float c_FaceTextLayoutOffsetX = -0.1f;
-
-// face property text layout offset in Y axis
-static const float c_FaceTextLayoutOffsetY = -0.125f;
-
-// define the face frame features required to be computed by this application
-static const DWORD c_FaceFrameFeatures = 
-    FaceFrameFeatures::FaceFrameFeatures_BoundingBoxInColorSpace
-    | FaceFrameFeatures::FaceFrameFeatures_PointsInColorSpace
-    | FaceFrameFeatures::FaceFrameFeatures_RotationOrientation
-    | FaceFrameFeatures::FaceFrameFeatures_Happy
-    | FaceFrameFeatures::FaceFrameFeatures_RightEyeClosed
-    | FaceFrameFeatures::FaceFrameFeatures_LeftEyeClosed
-    | FaceFrameFeatures::FaceFrameFeatures_MouthOpen
-    | FaceFrameFeatures::FaceFrameFeatures_MouthMoved
-    | FaceFrameFeatures::FaceFrameFeatures_LookingAway
-    | FaceFrameFeatures::FaceFrameFeatures_Glasses
-    | FaceFrameFeatures::FaceFrameFeatures_FaceEngagement;
+/// <summary>
+/// Converts the process command line to UTF-8 arguments
+/// </summary>
+/// <param name="pArgs">receives the argument storage</param>
+/// <param name="pArgv">receives pointers to the arguments, valid while pArgs is</param>
+static void GetUtf8CommandLine(std::vector<std::string>* pArgs, std::vector<char*>* pArgv)
+{
+    int nArgs = 0;
+    LPWSTR* pszArgs = CommandLineToArgvW(GetCommandLineW(), &nArgs);
+
+    for (int i = 0; pszArgs && i < nArgs; ++i)
+    {
+        int cbArg = WideCharToMultiByte(CP_UTF8, 0, pszArgs[i], -1, NULL, 0, NULL, NULL);
+        std::string arg(cbArg > 0 ? cbArg : 1, '\0');
+        WideCharToMultiByte(CP_UTF8, 0, pszArgs[i], -1, &arg[0], cbArg, NULL, NULL);
+        arg.resize(strlen(arg.c_str()));
+        pArgs->push_back(arg);
+    }
+
+    LocalFree(pszArgs);
+
+    if (pArgs->empty())
+    {
+        pArgs->push_back(std::string());
+    }
+
+    for (size_t i = 0; i < pArgs->size(); ++i)
+    {
+        pArgv->push_back(&(*pArgs)[i][0]);
+    }
+}
+
+/// <summary>
+/// Reports an invalid application argument, with the options the application takes,
+/// to the debugger and in a message box
+/// </summary>
+/// <param name="szArg">UTF-8 argument that is unknown, lacks its value or has an invalid one</param>
+static void ReportInvalidArgument(const char* szArg)
+{
+    std::string message = std::string("Invalid argument: ") + szArg + "\n\nusage:\n" + GetAppUsage();
+
+    int cchMessage = MultiByteToWideChar(CP_UTF8, 0, message.c_str(), -1, NULL, 0);
+    std::wstring wideMessage(cchMessage > 0 ? cchMessage : 1, L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, message.c_str(), -1, &wideMessage[0], cchMessage);
+
+    OutputDebugStringW(wideMessage.c_str());
+    MessageBoxW(NULL, wideMessage.c_str(), L"Face Basics", MB_OK | MB_ICONERROR);
+}
 
 /// <summary>
 /// Entry point for the application
@@ -39,17 +73,45 @@ static const DWORD c_FaceFrameFeatures =
 /// <returns>status</returns>
 int APIENTRY wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance, _In_ LPWSTR lpCmdLine, _In_ int nCmdShow)
 {
-	HRESULT hr = CoInitializeEx(NULL, COINIT_MULTITHREADED);
     UNREFERENCED_PARAMETER(hPrevInstance);
     UNREFERENCED_PARAMETER(lpCmdLine);
+
+    std::vector<std::string> args;
+    std::vector<char*> argv;
+    GetUtf8CommandLine(&args, &argv);
+    int argc = static_cast<int>(argv.size());
+
+    // Tool commands run without a window, reporting to the console they were started from
+    if (IsToolCommand(argc, &argv[0]))
+    {
+        if (AttachConsole(ATTACH_PARENT_PROCESS))
+        {
+            FILE* pConsole = nullptr;
+            freopen_s(&pConsole, "CONOUT$", "w", stdout);
+            freopen_s(&pConsole, "CONOUT$", "w", stderr);
+        }
+
+        return RunToolCommand(argc, &argv[0]);
+    }
+
+    AppOptions options;
+    int iInvalidArg = 0;
+    if (FAILED(ParseAppOptions(argc, &argv[0], &options, &iInvalidArg)))
+    {
+        ReportInvalidArgument(argv[iInvalidArg]);
+        return EXIT_FAILURE;
+    }
+
+	int nExitCode = EXIT_SUCCESS;
+	HRESULT hr = CoInitializeEx(NULL, COINIT_MULTITHREADED);
 	if (SUCCEEDED(hr))
 	{
 		CFaceBasics application;
-		application.Run(hInstance, nCmdShow);
+		nExitCode = application.Run(hInstance, nCmdShow, options);
 		CoUninitialize();
 	}
 
-	return EXIT_SUCCESS;
+	return nExitCode;
 }
 
 /// <summary>
@@ -62,25 +124,31 @@ CFaceBasics::CFaceBasics() :
     m_nFramesSinceUpdate(0),
     m_fFreq(0),
     m_nNextStatusTime(0),
-    m_pKinectSensor(nullptr),
-    m_pCoordinateMapper(nullptr),
-    m_pColorFrameReader(nullptr),
+    m_pFrameSource(nullptr),
+    m_pKinectSource(nullptr),
+    m_frameWakeup(FrameStream_Color),
+    m_pPipeline(nullptr),
+    m_pLatencyMonitor(new LatencyMonitor()),
+    m_pLatencyLog(nullptr),
+    m_nLatencyIntervalStartTime(0),
+    m_nLatencyLogStartTime(0),
     m_pD2DFactory(nullptr),
     m_pDrawDataStreams(nullptr),
-    m_pColorRGBX(nullptr),
-    m_pBodyFrameReader(nullptr),
+    m_pSessionWriter(nullptr),
+    m_pSpeakerLog(nullptr),
 	m_pAudioBeam(NULL),
 	m_pAudioStream(NULL),
-	m_fAccumulatedSquareSum(0.0f),
+	m_fBeamAngle(0.0f),
+	m_fBeamAngleConfidence(0.0f),
+	m_pAudioSource(nullptr),
+	m_pAudioCapture(nullptr),
+	m_pRoiExporter(nullptr),
 	m_fEnergyError(0.0f),
-	m_nAccumulatedSampleCount(0),
 	m_nEnergyIndex(0),
 	m_nEnergyRefreshIndex(0),
 	m_nNewEnergyAvailable(0),
 	m_nLastEnergyRefreshTime(NULL)
 {
-	InitializeCriticalSection(&m_csLock);
-
 	ZeroMemory(m_fEnergyBuffer, sizeof(m_fEnergyBuffer));
 	ZeroMemory(m_fEnergyDisplayBuffer, sizeof(m_fEnergyDisplayBuffer));
     LARGE_INTEGER qpf = {0};
@@ -89,14 +157,7 @@ CFaceBasics::CFaceBasics() :
         m_fFreq = double(qpf.QuadPart);
     }
 
-    for (int i = 0; i < BODY_COUNT; i++)
-    {
-        m_pFaceFrameSources[i] = nullptr;
-        m_pFaceFrameReaders[i] = nullptr;
-    }
-
-    // create heap storage for color pixel data in RGBX format
-    m_pColorRGBX = new RGBQUAD[cColorWidth * cColorHeight];
+    m_pAudioCapture = new AudioCapture(cAudioBufferLength, cAudioMaxBuffersPerRead);
 }
 
 
@@ -105,6 +166,22 @@ CFaceBasics::CFaceBasics() :
 /// </summary>
 CFaceBasics::~CFaceBasics()
 {
+    // no more frames or wake-ups once the window and the renderer go away
+    if (m_pPipeline)
+    {
+        m_pPipeline->Stop();
+    }
+    else if (m_pFrameSource)
+    {
+        m_pFrameSource->Stop();
+    }
+
+    // stop reading audio before anything the capture thread touches goes away
+    if (m_pAudioCapture)
+    {
+        m_pAudioCapture->Stop();
+    }
+
     // clean up Direct2D renderer
     if (m_pDrawDataStreams)
     {
@@ -112,54 +189,94 @@ CFaceBasics::~CFaceBasics()
         m_pDrawDataStreams = nullptr;
     }
 
-    if (m_pColorRGBX)
+    if (m_pPipeline)
     {
-        delete [] m_pColorRGBX;
-        m_pColorRGBX = nullptr;
+        delete m_pPipeline;
+        m_pPipeline = nullptr;
     }
 
-    // clean up Direct2D
-    SafeRelease(m_pD2DFactory);
-	SafeRelease(m_pAudioStream);
-	SafeRelease(m_pAudioBeam);
+    // appended to by the pipeline until it was deleted above
+    if (m_pSpeakerLog)
+    {
+        m_pSpeakerLog->Close();
+        delete m_pSpeakerLog;
+        m_pSpeakerLog = nullptr;
+    }
+
+    if (m_pRoiExporter)
+    {
+        delete m_pRoiExporter;
+        m_pRoiExporter = nullptr;
+    }
 
-    // done with face sources and readers
-    for (int i = 0; i < BODY_COUNT; i++)
+    // finish the recording and the replay
+    if (m_pSessionWriter)
     {
-        SafeRelease(m_pFaceFrameSources[i]);
-        SafeRelease(m_pFaceFrameReaders[i]);		
+        m_pSessionWriter->Close();
+        delete m_pSessionWriter;
+        m_pSessionWriter = nullptr;
     }
 
-    // done with body frame reader
-    SafeRelease(m_pBodyFrameReader);
+    if (m_pAudioCapture)
+    {
+        delete m_pAudioCapture;
+        m_pAudioCapture = nullptr;
+    }
 
-    // done with color frame reader
-    SafeRelease(m_pColorFrameReader);
+    if (m_pAudioSource)
+    {
+        delete m_pAudioSource;
+        m_pAudioSource = nullptr;
+    }
 
-    // done with coordinate mapper
-    SafeRelease(m_pCoordinateMapper);
+    // clean up Direct2D
+    SafeRelease(m_pD2DFactory);
+	SafeRelease(m_pAudioStream);
+	SafeRelease(m_pAudioBeam);
 
-    // close the Kinect Sensor
-    if (m_pKinectSensor)
+    // closes the sensor, after everything opened on it
+    if (m_pFrameSource)
     {
-        m_pKinectSensor->Close();
+        delete m_pFrameSource;
+        m_pFrameSource = nullptr;
+        m_pKinectSource = nullptr;
     }
 
-    SafeRelease(m_pKinectSensor);
+    // recorded into by the sources until they were deleted above
+    if (m_pLatencyLog)
+    {
+        delete m_pLatencyLog;
+        m_pLatencyLog = nullptr;
+    }
 
-	DeleteCriticalSection(&m_csLock);
+    delete m_pLatencyMonitor;
+    m_pLatencyMonitor = nullptr;
 }
 
 /// <summary>
-/// Creates the main window and begins processing
+/// Creates the main window and begins processing, or runs headless when exporting
 /// </summary>
 /// <param name="hInstance">handle to the application instance</param>
 /// <param name="nCmdShow">whether to display minimized, maximized, or normally</param>
-int CFaceBasics::Run(HINSTANCE hInstance, int nCmdShow)
+/// <param name="options">recording, replay and export options</param>
+int CFaceBasics::Run(HINSTANCE hInstance, int nCmdShow, const AppOptions& options)
 {
     MSG       msg = {0};
     WNDCLASS  wc;
 
+    m_options = options;
+
+    // the sensor's frames; a replay brings its own size
+    if (FAILED(GetFrameGeometry(c_SensorColorWidth, c_SensorColorHeight, m_options.previewResolution, &m_geometry)))
+    {
+        return EXIT_FAILURE;
+    }
+
+    if (!m_options.exportPath.empty())
+    {
+        return RunHeadless();
+    }
+
     // Dialog custom window class
     ZeroMemory(&wc, sizeof(wc));
     wc.style         = CS_HREDRAW | CS_VREDRAW;
@@ -185,27 +302,82 @@ int CFaceBasics::Run(HINSTANCE hInstance, int nCmdShow)
     // Show window
     ShowWindow(hWndApp, nCmdShow);
 
-    // Main message loop
-    while (WM_QUIT != msg.message)
+    // Main message loop; frames arrive as cFrameReadyMessage, so the thread sleeps between them
+    while (GetMessageW(&msg, NULL, 0, 0) > 0)
     {
-        Update();
-
-        while (PeekMessageW(&msg, NULL, 0, 0, PM_REMOVE))
+        // If a dialog message will be taken care of by the dialog proc
+        if (hWndApp && IsDialogMessageW(hWndApp, &msg))
         {
-            // If a dialog message will be taken care of by the dialog proc
-            if (hWndApp && IsDialogMessageW(hWndApp, &msg))
-            {
-                continue;
-            }
-
-            TranslateMessage(&msg);
-            DispatchMessageW(&msg);
+            continue;
         }
+
+        TranslateMessage(&msg);
+        DispatchMessageW(&msg);
     }
 
     return static_cast<int>(msg.wParam);
 }
 
+/// <summary>
+/// Processes frames without a window, writing the speaker regions to the export stream
+/// until the replay ends or the consumer of the stream goes away
+/// </summary>
+/// <returns>process exit code</returns>
+int CFaceBasics::RunHeadless()
+{
+    m_pRoiExporter = new RoiExporter();
+
+    HRESULT hr = m_pRoiExporter->Open(m_options.exportPath.c_str(),
+        m_options.exportTimestampPath.empty() ? nullptr : m_options.exportTimestampPath.c_str(),
+        m_options.exportFormat, m_options.nExportWidth, m_options.nExportHeight, m_options.scaling);
+
+    if (SUCCEEDED(hr))
+    {
+        hr = InitializeSources();
+    }
+
+    // the pipeline writes the frames; a failed write closes the stream and ends the export
+    while (SUCCEEDED(hr) && m_pPipeline && !m_pPipeline->IsFinished())
+    {
+        PipelineFrame* pFrame = m_pPipeline->TakeComposedFrame(cHeadlessWaitTimeout);
+        if (pFrame)
+        {
+            hr = FAILED(pFrame->hrExport) ? pFrame->hrExport : S_OK;
+            m_pPipeline->ReleaseFrame(pFrame);
+        }
+
+        UpdateLatencyIntervals();
+    }
+
+    StopPipeline();
+
+    // a stream closed before the end means that writing to it failed
+    bool bExported = SUCCEEDED(hr) && m_pRoiExporter->IsOpen();
+    if (bExported)
+    {
+        bExported = SUCCEEDED(m_pRoiExporter->Close());
+    }
+
+    return bExported ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/// <summary>
+/// Posts a frame ready message to the window; called by the pipeline on the thread
+/// that made the frame ready
+/// </summary>
+/// <param name="pContext">the class instance</param>
+void CFaceBasics::PostFrameReady(void* pContext)
+{
+    CFaceBasics* pThis = static_cast<CFaceBasics*>(pContext);
+
+    // the pipeline only calls back again once the frame was taken, so these messages
+    // do not pile up
+    if (pThis->m_hWnd)
+    {
+        PostMessageW(pThis->m_hWnd, cFrameReadyMessage, 0, 0);
+    }
+}
+
 /// <summary>
 /// Handles window messages, passes most to the class instance to handle
 /// </summary>
@@ -259,20 +431,26 @@ LRESULT CALLBACK CFaceBasics::DlgProc(HWND hWnd, UINT message, WPARAM wParam, LP
             // Init Direct2D
             D2D1CreateFactory(D2D1_FACTORY_TYPE_SINGLE_THREADED, &m_pD2DFactory);
 
+            // the sources settle the frame size; their first frames are only drawn once
+            // this message has been handled
+            InitializeSources();
+
             // Create and initialize a new Direct2D image renderer (take a look at ImageRenderer.h)
             // We'll use this to draw the data we receive from the Kinect to the screen
             m_pDrawDataStreams = new ImageRenderer();
-            HRESULT hr = m_pDrawDataStreams->Initialize(GetDlgItem(m_hWnd, IDC_VIDEOVIEW), m_pD2DFactory, cColorWidth, cColorHeight, cColorWidth * sizeof(RGBQUAD)); 
+            HRESULT hr = m_pDrawDataStreams->Initialize(GetDlgItem(m_hWnd, IDC_VIDEOVIEW), m_pD2DFactory,
+                m_geometry.nPreviewWidth, m_geometry.nPreviewHeight, m_geometry.nPreviewWidth * sizeof(RGBQUAD));
             if (FAILED(hr))
             {
                 SetStatusMessage(L"Failed to initialize the Direct2D draw device.", 10000, true);
             }
-
-            // Get and initialize the default Kinect sensor
-            InitializeDefaultSensor();
         }
         break;
 
+    case cFrameReadyMessage:
+        Update();
+        break;
+
         // If the titlebar X is clicked, destroy app
     case WM_CLOSE:
         DestroyWindow(hWnd);
@@ -288,74 +466,76 @@ LRESULT CALLBACK CFaceBasics::DlgProc(HWND hWnd, UINT message, WPARAM wParam, LP
 }
 
 /// <summary>
-/// Initializes the default Kinect sensor
+/// Opens the recording, if any, and the sensor or the session to replay
 /// </summary>
 /// <returns>S_OK on success else the failure code</returns>
-HRESULT CFaceBasics::InitializeDefaultSensor()
+HRESULT CFaceBasics::InitializeSources()
 {
-    HRESULT hr;
-
-    hr = GetDefaultKinectSensor(&m_pKinectSensor);
-    if (FAILED(hr))
+    // the recording is opened first since the audio capture thread starts writing to it right away
+    if (!m_options.recordPath.empty())
     {
-        return hr;
+        m_pSessionWriter = new SessionWriter();
+        if (FAILED(m_pSessionWriter->Open(m_options.recordPath.c_str(), m_geometry.nColorWidth, m_geometry.nColorHeight, c_AudioSamplesPerSecond,
+            m_options.bRecordRawColor ? nullptr : &m_options.recordCodec)))
+        {
+            SetStatusMessage(L"Failed to create the session recording.", 10000, true);
+            delete m_pSessionWriter;
+            m_pSessionWriter = nullptr;
+        }
     }
 
-    if (m_pKinectSensor)
+    if (!m_options.latencyLogPath.empty())
     {
-        // Initialize Kinect and get color, body and face readers
-        IColorFrameSource* pColorFrameSource = nullptr;
-		IBodyFrameSource* pBodyFrameSource = nullptr;	
-		IAudioSource* pAudioSource = NULL;
-		IAudioBeamList* pAudioBeamList = NULL;
-
-        hr = m_pKinectSensor->Open();
-
-        if (SUCCEEDED(hr))
+        m_pLatencyLog = new LatencyCsvLog();
+        if (FAILED(m_pLatencyLog->Open(m_options.latencyLogPath.c_str())))
         {
-            hr = m_pKinectSensor->get_CoordinateMapper(&m_pCoordinateMapper);
+            SetStatusMessage(L"Failed to create the latency log.", 10000, true);
+            delete m_pLatencyLog;
+            m_pLatencyLog = nullptr;
         }
+    }
 
-        if (SUCCEEDED(hr))
+    if (!m_options.speakerLogPath.empty())
+    {
+        m_pSpeakerLog = new SpeakerLogWriter();
+        if (FAILED(m_pSpeakerLog->Open(m_options.speakerLogPath.c_str())))
         {
-            hr = m_pKinectSensor->get_ColorFrameSource(&pColorFrameSource);
+            SetStatusMessage(L"Failed to create the speaker log.", 10000, true);
+            delete m_pSpeakerLog;
+            m_pSpeakerLog = nullptr;
         }
+    }
 
-        if (SUCCEEDED(hr))
-        {
-            hr = pColorFrameSource->OpenReader(&m_pColorFrameReader);
-        }
+    if (m_options.replayPath.empty())
+    {
+        // Get and initialize the default Kinect sensor
+        return InitializeDefaultSensor();
+    }
 
-        if (SUCCEEDED(hr))
-        {
-            hr = m_pKinectSensor->get_BodyFrameSource(&pBodyFrameSource);
-        }
+    return InitializeReplay();
+}
 
-        if (SUCCEEDED(hr))
-        {
-            hr = pBodyFrameSource->OpenReader(&m_pBodyFrameReader);
-        }
+/// <summary>
+/// Initializes the default Kinect sensor
+/// </summary>
+/// <returns>S_OK on success else the failure code</returns>
+HRESULT CFaceBasics::InitializeDefaultSensor()
+{
+    m_pKinectSource = new KinectFrameSource();
+    m_pFrameSource = m_pKinectSource;
+
+    // Initialize Kinect and get color, body and face readers
+    HRESULT hr = m_pKinectSource->Open();
+    IKinectSensor* pKinectSensor = m_pKinectSource->GetSensor();
+
+    if (pKinectSensor)
+    {
+		IAudioSource* pAudioSource = NULL;
+		IAudioBeamList* pAudioBeamList = NULL;
 
-        if (SUCCEEDED(hr))
-        {
-            // create a face frame source + reader to track each body in the fov
-            for (int i = 0; i < BODY_COUNT; i++)
-            {
-                if (SUCCEEDED(hr))
-                {
-                    // create the face frame source by specifying the required face frame features
-                    hr = CreateFaceFrameSource(m_pKinectSensor, 0, c_FaceFrameFeatures, &m_pFaceFrameSources[i]);
-                }
-                if (SUCCEEDED(hr))
-                {
-                    // open the corresponding reader
-                    hr = m_pFaceFrameSources[i]->OpenReader(&m_pFaceFrameReaders[i]);
-                }				
-            }
-        }       
 		if (SUCCEEDED(hr))
 		{
-			hr = m_pKinectSensor->get_AudioSource(&pAudioSource);
+			hr = pKinectSensor->get_AudioSource(&pAudioSource);
 		}
 
 		if (SUCCEEDED(hr))
@@ -373,6 +553,13 @@ HRESULT CFaceBasics::InitializeDefaultSensor()
 			hr = m_pAudioBeam->OpenInputStream(&m_pAudioStream);
 		}
 
+		if (SUCCEEDED(hr))
+		{
+			// drain the audio on its own thread so a slow frame never holds it up
+			m_pAudioSource = new KinectAudioSource(m_pAudioBeam, m_pAudioStream, m_pKinectSource->GetSensorClock());
+			hr = m_pAudioCapture->Start(m_pAudioSource, this, cAudioReadTimerInterval);
+		}
+
         #if 0
 		// To overwrite the automatic mode of the audio beam, change it to
 		// manual and set the desired beam angle. In this example, point it
@@ -398,13 +585,16 @@ HRESULT CFaceBasics::InitializeDefaultSensor()
 			SetStatusMessage(L"Failed opening an audio stream!", 10000, true);
 		}
 
-        SafeRelease(pColorFrameSource);
-        SafeRelease(pBodyFrameSource);
 		SafeRelease(pAudioBeamList);
 		SafeRelease(pAudioSource);
     }
 
-    if (!m_pKinectSensor || FAILED(hr))
+    if (SUCCEEDED(hr))
+    {
+        hr = StartPipeline();
+    }
+
+    if (!pKinectSensor || FAILED(hr))
     {
         SetStatusMessage(L"No ready Kinect found!", 10000, true);
         return E_FAIL;
@@ -414,75 +604,183 @@ HRESULT CFaceBasics::InitializeDefaultSensor()
 }
 
 /// <summary>
-/// Main processing function
+/// Opens the session to replay instead of the sensor
 /// </summary>
-void CFaceBasics::Update()
+/// <returns>S_OK on success else the failure code</returns>
+HRESULT CFaceBasics::InitializeReplay()
 {
-    if (!m_pColorFrameReader || !m_pBodyFrameReader)
+    ReplayFrameSource* pReplaySource = new ReplayFrameSource();
+
+    HRESULT hr = pReplaySource->Open(m_options.replayPath.c_str(), m_options.replayPacing);
+
+    if (SUCCEEDED(hr))
     {
-        return;
+        const SessionFileHeader& header = pReplaySource->GetHeader();
+        hr = GetFrameGeometry(static_cast<int>(header.nColorWidth), static_cast<int>(header.nColorHeight), m_options.previewResolution, &m_geometry);
     }
 
-    IColorFrame* pColorFrame = nullptr;
-    HRESULT hr = m_pColorFrameReader->AcquireLatestFrame(&pColorFrame);
+    m_pFrameSource = pReplaySource;
 
     if (SUCCEEDED(hr))
     {
-        INT64 nTime = 0;
-        IFrameDescription* pFrameDescription = nullptr;
-        int nWidth = 0;
-        int nHeight = 0;
-        ColorImageFormat imageFormat = ColorImageFormat_None;
-        UINT nBufferSize = 0;
-        RGBQUAD *pBuffer = nullptr;
+        hr = StartPipeline();
+    }
 
-        hr = pColorFrame->get_RelativeTime(&nTime);
+    if (FAILED(hr))
+    {
+        SetStatusMessage(L"Failed to open the session to replay!", 10000, true);
+        StopPipeline();
+    }
 
-        if (SUCCEEDED(hr))
-        {
-            hr = pColorFrame->get_FrameDescription(&pFrameDescription);
-        }
+    return hr;
+}
 
-        if (SUCCEEDED(hr))
-        {
-            hr = pFrameDescription->get_Width(&nWidth);
-        }
+/// <summary>
+/// Starts the pipeline processing the frames of the frame source
+/// </summary>
+/// <returns>S_OK on success else the failure code</returns>
+HRESULT CFaceBasics::StartPipeline()
+{
+    SpeakerPipelineOptions options;
+    options.bThreaded = !m_options.bSerialPipeline;
+    options.bFullFrameTransfer = m_options.bFullFrameTransfer;
+    options.bVoiceGate = !m_options.bNoVoiceGate;
+    options.bEagerAcquisition = m_options.bEagerAcquisition;
+    options.nIdlePreviewInterval = m_options.nIdlePreviewInterval;
+    options.mosaicScaling = m_options.scaling;
+    options.previewResolution = m_options.previewResolution;
+    options.nColorWidth = m_geometry.nColorWidth;
+    options.nColorHeight = m_geometry.nColorHeight;
+    options.bLargePages = m_options.bLargePages;
+    options.pfnFrameReady = &CFaceBasics::PostFrameReady;
+    options.pContext = this;
+    options.pExporter = m_pRoiExporter;
+    options.pLatencyMonitor = m_pLatencyMonitor;
+    options.pSpeakerLog = m_pSpeakerLog;
+
+    // the sensor and real time replays show the newest frame when the window falls
+    // behind; exports and fast replays go through every frame
+    options.bDropWhenBehind = !m_pRoiExporter &&
+        (m_options.replayPath.empty() || ReplayPacing_RealTime == m_options.replayPacing);
+
+    // replayed frames are recorded already
+    options.pRecorder = m_pKinectSource ? m_pSessionWriter : nullptr;
+
+    m_pPipeline = new SpeakerPipeline(m_pAudioCapture);
+    return m_pPipeline->Start(m_pFrameSource, &m_frameWakeup, options);
+}
 
-        if (SUCCEEDED(hr))
-        {
-            hr = pFrameDescription->get_Height(&nHeight);
-        }
+/// <summary>
+/// Stops the pipeline and closes the frame source
+/// </summary>
+void CFaceBasics::StopPipeline()
+{
+    if (m_pPipeline)
+    {
+        m_pPipeline->Stop();
+        delete m_pPipeline;
+        m_pPipeline = nullptr;
+    }
 
-        if (SUCCEEDED(hr))
-        {
-            hr = pColorFrame->get_RawColorImageFormat(&imageFormat);
-        }
+    if (m_pFrameSource)
+    {
+        m_pFrameSource->Stop();
+        delete m_pFrameSource;
+        m_pFrameSource = nullptr;
+        m_pKinectSource = nullptr;
+    }
+}
 
-        if (SUCCEEDED(hr))
-        {
-            if (imageFormat == ColorImageFormat_Bgra)
-            {
-                hr = pColorFrame->AccessRawUnderlyingBuffer(&nBufferSize, reinterpret_cast<BYTE**>(&pBuffer));
-            }
-            else if (m_pColorRGBX)
-            {
-                pBuffer = m_pColorRGBX;
-                nBufferSize = cColorWidth * cColorHeight * sizeof(RGBQUAD);
-                hr = pColorFrame->CopyConvertedFrameDataToArray(nBufferSize, reinterpret_cast<BYTE*>(pBuffer), ColorImageFormat_Bgra);            
-            }
-            else
-            {
-                hr = E_FAIL;
-            }
-        }			
+/// <summary>
+/// Main processing function
+/// </summary>
+void CFaceBasics::Update()
+{
+    if (m_pPipeline)
+    {
+        UpdateFromPipeline();
+    }
 
-        if (SUCCEEDED(hr))
+    UpdateEnergyDisplay();
+}
+
+/// <summary>
+/// Presents the next composed frame of the pipeline, if there is one
+/// </summary>
+void CFaceBasics::UpdateFromPipeline()
+{
+    // idle frames are not worth their color while nobody can see them
+    m_pPipeline->SetPreviewRequired(nullptr != m_hWnd && !IsIconic(m_hWnd));
+
+    PipelineFrame* pFrame = m_pPipeline->TakeComposedFrame(0);
+
+    if (nullptr == pFrame)
+    {
+        if (m_pPipeline->IsFinished())
         {
-            DrawStreams(nTime, pBuffer, nWidth, nHeight);
+            SetStatusMessage(FAILED(m_pPipeline->GetEndResult()) ? L"Failed to read the replayed session." : L"Replay finished.", 10000, true);
+            StopPipeline();
         }
 
-        SafeRelease(pFrameDescription);		
+        return;
+    }
+
+    INT64 nStartNs = GetPerfClockNs();
+    DrawStreams(pFrame);
+    INT64 nEndNs = GetPerfClockNs();
+
+    m_pLatencyMonitor->Record(LatencyMetric_Present, nEndNs - nStartNs);
+
+    if (pFrame->nTriggerNs)
+    {
+        m_pLatencyMonitor->Record(LatencyMetric_FrameToDisplay, nEndNs - pFrame->nTriggerNs);
+    }
+
+    if (pFrame->nAudioCaptureNs)
+    {
+        m_pLatencyMonitor->Record(LatencyMetric_AudioToDisplay, nEndNs - pFrame->nAudioCaptureNs);
     }
+
+    m_pPipeline->ReleaseFrame(pFrame);
+
+    UpdateLatencyIntervals();
+}
+
+/// <summary>
+/// Closes the latency interval once a second, and logs it when logging
+/// </summary>
+void CFaceBasics::UpdateLatencyIntervals()
+{
+    ULONGLONG now = GetTickCount64();
+
+    if (0 == m_nLatencyIntervalStartTime)
+    {
+        m_nLatencyIntervalStartTime = now;
+        m_nLatencyLogStartTime = now;
+        return;
+    }
+
+    if (now - m_nLatencyIntervalStartTime < cLatencyIntervalMsec)
+    {
+        return;
+    }
+
+    m_latencyIntervals.Advance(m_pLatencyMonitor);
+    m_nLatencyIntervalStartTime = now;
+
+    if (m_pLatencyLog && FAILED(m_pLatencyLog->WriteInterval(&m_latencyIntervals, (now - m_nLatencyLogStartTime) / 1000.0)))
+    {
+        // a full disk is no reason to stop showing frames; the log just ends
+        delete m_pLatencyLog;
+        m_pLatencyLog = nullptr;
+    }
+}
+
+/// <summary>
+/// Advances the energy display buffer
+/// </summary>
+void CFaceBasics::UpdateEnergyDisplay()
+{
 	ULONGLONG previousRefreshTime = m_nLastEnergyRefreshTime;
 	ULONGLONG now = GetTickCount64();
 
@@ -495,13 +793,11 @@ void CFaceBasics::Update()
 	}
 
 	{
-		EnterCriticalSection(&m_csLock);
-
 		if (previousRefreshTime != NULL)
 		{
 			// Calculate how many energy samples we need to advance since the last Update() call in order to
 			// have a smooth animation effect.
-			float energyToAdvance = m_fEnergyError + (((now - previousRefreshTime) * cAudioSamplesPerSecond / (float)1000.0) / cAudioSamplesPerEnergySample);
+			float energyToAdvance = m_fEnergyError + (((now - previousRefreshTime) * c_AudioSamplesPerSecond / (float)1000.0) / c_AudioSamplesPerEnergySample);
 			int energySamplesToAdvance = min(m_nNewEnergyAvailable, (int)(energyToAdvance));
 			m_fEnergyError = energyToAdvance - energySamplesToAdvance;
 			m_nEnergyRefreshIndex = (m_nEnergyRefreshIndex + energySamplesToAdvance) % cEnergyBufferLength;
@@ -510,52 +806,50 @@ void CFaceBasics::Update()
 
 		// Copy energy samples into buffer to be displayed, taking into account that energy
 		// wraps around in a circular buffer.
-		int baseIndex = (m_nEnergyRefreshIndex + cEnergyBufferLength - cEnergySamplesToDisplay) % cEnergyBufferLength;
-		int samplesUntilEnd = cEnergyBufferLength - baseIndex;
-		if (samplesUntilEnd>cEnergySamplesToDisplay)
-		{
-			memcpy_s(m_fEnergyDisplayBuffer, cEnergySamplesToDisplay*sizeof(float), m_fEnergyBuffer + baseIndex, cEnergySamplesToDisplay*sizeof(float));
-		}
-		else
-		{
-			int samplesFromBeginning = cEnergySamplesToDisplay - samplesUntilEnd;
-			memcpy_s(m_fEnergyDisplayBuffer, cEnergySamplesToDisplay*sizeof(float), m_fEnergyBuffer + baseIndex, samplesUntilEnd*sizeof(float));
-			memcpy_s(m_fEnergyDisplayBuffer + samplesUntilEnd, (cEnergySamplesToDisplay - samplesUntilEnd)*sizeof(float), m_fEnergyBuffer, samplesFromBeginning*sizeof(float));
-		}
-
-		LeaveCriticalSection(&m_csLock);
+		CopyEnergyWindow(m_fEnergyBuffer, cEnergyBufferLength, m_nEnergyRefreshIndex, m_fEnergyDisplayBuffer, cEnergySamplesToDisplay);
 	}
-
-    SafeRelease(pColorFrame);
 }
 
 /// <summary>
 /// Renders the color and face streams
 /// </summary>
-/// <param name="nTime">timestamp of frame</param>
-/// <param name="pBuffer">pointer to frame data</param>
-/// <param name="nWidth">width (in pixels) of input image data</param>
-/// <param name="nHeight">height (in pixels) of input image data</param>
-void CFaceBasics::DrawStreams(INT64 nTime, RGBQUAD* pBuffer, int nWidth, int nHeight)
+/// <param name="pFrame">composed frame to render</param>
+void CFaceBasics::DrawStreams(const PipelineFrame* pFrame)
 {
+    // pick up the energy values and beam state that came with the frame
+    ConsumeEnergy(pFrame);
+
     if (m_hWnd)
     {
         HRESULT hr;
         hr = m_pDrawDataStreams->BeginDrawing();
 
+        UINT64 nBytesTransferred = m_pDrawDataStreams->GetBytesTransferred();
+
         if (SUCCEEDED(hr))
         {
-            // Make sure we've received valid color data
-            if (pBuffer && (nWidth == cColorWidth) && (nHeight == cColorHeight))
+            // the pipeline converted only the regions that will be shown; make sure we've
+            // received valid color data
+            const BYTE* pBgra = nullptr;
+            if ((pFrame->frame.nColorWidth == m_geometry.nColorWidth) && (pFrame->frame.nColorHeight == m_geometry.nColorHeight))
             {
-				if (m_fBeamAngleConfidence < 0.5f)
-				{
-					// Draw the data with Direct2D
-					hr = m_pDrawDataStreams->DrawBackground(reinterpret_cast<BYTE*>(pBuffer), cColorWidth * cColorHeight * sizeof(RGBQUAD));
-				}
-				else
+                pBgra = pFrame->pBgra;
+            }
+
+            if (!(pFrame->nStreams & FrameStream_Color))
+            {
+                // an idle frame the pipeline did not read the color of; the background
+                // shown last stays up
+            }
+            else if (pBgra)
+            {
+				// the full frame is shown when no speaker is found, drawn once by
+				// ProcessFaces; speakers are shown through the mosaic, which leaves the
+				// background bitmap alone. A frame converted whole for its speakers is
+				// larger than a half resolution background and is not drawn as one.
+				if (!pFrame->bRoiTransfer && (pFrame->nBgraWidth == m_geometry.nPreviewWidth) && (pFrame->nBgraHeight == m_geometry.nPreviewHeight))
 				{
-					hr = m_pDrawDataStreams->SetBackground(reinterpret_cast<BYTE*>(pBuffer), cColorWidth * cColorHeight * sizeof(RGBQUAD));
+					hr = m_pDrawDataStreams->SetBackground(pBgra, m_geometry.nPreviewWidth * m_geometry.nPreviewHeight * sizeof(RGBQUAD));
 				}
             }
             else
@@ -567,12 +861,13 @@ void CFaceBasics::DrawStreams(INT64 nTime, RGBQUAD* pBuffer, int nWidth, int nHe
             if (SUCCEEDED(hr))
             {
                 // begin processing the face frames
-                ProcessFaces();				
+                ProcessFaces(pFrame);
             }
 
             m_pDrawDataStreams->EndDrawing();
         }
 
+        INT64 nTime = pFrame->frame.nTime;
         if (!m_nStartTime)
         {
             m_nStartTime = nTime;
@@ -593,8 +888,26 @@ void CFaceBasics::DrawStreams(INT64 nTime, RGBQUAD* pBuffer, int nWidth, int nHe
             }
         }
 
-        WCHAR szStatusMessage[64];
-		StringCchPrintf(szStatusMessage, _countof(szStatusMessage), L" FPS = %0.2f    Time = %I64d, Beam angle = %0.2f", fps, (nTime - m_nStartTime), 180.0f * m_fBeamAngle / static_cast<float>(M_PI));
+        AudioCaptureStats audioStats;
+        m_pAudioCapture->GetStats(&audioStats);
+
+        SpeakerPipelineStats pipelineStats;
+        m_pPipeline->GetStats(&pipelineStats);
+        UINT64 nDropped = pipelineStats.queues[PipelineStage_Acquire].nDropped + pipelineStats.queues[PipelineStage_Compose].nDropped +
+            pipelineStats.pool.nExhausted;
+
+        nBytesTransferred = m_pDrawDataStreams->GetBytesTransferred() - nBytesTransferred;
+
+        // percentiles of the latest full second
+        const LatencySnapshot& frameLatency = m_latencyIntervals.GetInterval(LatencyMetric_FrameToDisplay);
+        const LatencySnapshot& audioLatency = m_latencyIntervals.GetInterval(LatencyMetric_AudioToDisplay);
+
+        WCHAR szStatusMessage[256];
+		StringCchPrintf(szStatusMessage, _countof(szStatusMessage), L" FPS = %0.2f    Time = %I64d, Beam angle = %0.2f    Transfer = %I64u KB    Latency p50/p99: frame %0.1f/%0.1f ms, audio %0.1f/%0.1f ms, dropped = %I64u    Audio backlog = %u, overruns = %I64u, underruns = %I64u",
+			fps, (nTime - m_nStartTime), 180.0f * m_fBeamAngle / static_cast<float>(M_PI), nBytesTransferred / 1024,
+			frameLatency.GetPercentileNs(0.5) / 1e6, frameLatency.GetPercentileNs(0.99) / 1e6,
+			audioLatency.GetPercentileNs(0.5) / 1e6, audioLatency.GetPercentileNs(0.99) / 1e6,
+			nDropped, audioStats.nBacklogChunks, audioStats.nOverruns, audioStats.nUnderruns);
 
         if (SetStatusMessage(szStatusMessage, 1000, false))
         {
@@ -605,281 +918,64 @@ void CFaceBasics::DrawStreams(INT64 nTime, RGBQUAD* pBuffer, int nWidth, int nHe
 }
 
 /// <summary>
-/// Processes new face frames
+/// Processes the faces of a frame, drawing every active speaker as a tile of the mosaic
 /// </summary>
-void CFaceBasics::ProcessFaces()
+/// <param name="pFrame">composed frame holding the speaker mosaic</param>
+void CFaceBasics::ProcessFaces(const PipelineFrame* pFrame)
 {
-    HRESULT hr;
-    IBody* ppBodies[BODY_COUNT] = {0};
-    bool bHaveBodyData = SUCCEEDED( UpdateBodyData(ppBodies) );
-	bool foundFace = false;
+	const MosaicCompositor* pMosaic = pFrame->pMosaic;
+	HRESULT hr = E_FAIL;
 
-	if (m_fBeamAngleConfidence < 0.5f)
+	if (pFrame->layout.nTiles > 0)
 	{
-	}
-	else
-	{		
-		// iterate through each face reader
-		for (int iFace = 0; iFace < BODY_COUNT; ++iFace)
-		{
-			// retrieve the latest face frame from this reader
-			IFaceFrame* pFaceFrame = nullptr;
-			hr = m_pFaceFrameReaders[iFace]->AcquireLatestFrame(&pFaceFrame);
-
-			BOOLEAN bFaceTracked = false;
-			if (SUCCEEDED(hr) && nullptr != pFaceFrame)
-			{
-				// check if a valid face is tracked in this face frame
-				hr = pFaceFrame->get_IsTrackingIdValid(&bFaceTracked);
-			}
-
-			if (SUCCEEDED(hr))
-			{
-				if (bFaceTracked)
-				{
-					IFaceFrameResult* pFaceFrameResult = nullptr;
-					RectI faceBox = {0};
-					PointF facePoints[FacePointType::FacePointType_Count];
-					Vector4 faceRotation;
-					DetectionResult faceProperties[FaceProperty::FaceProperty_Count];
-					D2D1_POINT_2F faceTextLayout;
-					float ang;
-
-					hr = pFaceFrame->get_FaceFrameResult(&pFaceFrameResult);
-
-					// need to verify if pFaceFrameResult contains data before trying to access it
-					if (SUCCEEDED(hr) && pFaceFrameResult != nullptr)
-					{
-						hr = pFaceFrameResult->get_FaceBoundingBoxInColorSpace(&faceBox);
-
-						if (SUCCEEDED(hr))
-						{										
-							hr = pFaceFrameResult->GetFacePointsInColorSpace(FacePointType::FacePointType_Count, facePoints);
-						}
-
-						PointF centerMouth;
-						centerMouth.X = (facePoints[3].X + facePoints[4].X) / 2;
-						centerMouth.Y = (facePoints[3].Y + facePoints[4].Y) / 2;
-						if (centerMouth.X < (float) 960.0)
-						{
-							ang = -(0.000054253472*(pow(centerMouth.X, 2)) - .10416666666666667*centerMouth.X + 50);
-						}
-						else
-						{
-							ang = (0.000054253472*(pow(centerMouth.X, 2)) - .10416666666666667*centerMouth.X + 50);
-						}
-						
-						if (SUCCEEDED(hr))
-						{
-							hr = pFaceFrameResult->get_FaceRotationQuaternion(&faceRotation);
-						}
-
-						if (SUCCEEDED(hr))
-						{
-							hr = pFaceFrameResult->GetFaceProperties(FaceProperty::FaceProperty_Count, faceProperties);
-						}
-
-						if (SUCCEEDED(hr))
-						{
-							hr = GetFaceTextPositionInColorSpace(ppBodies[iFace], &faceTextLayout);
-						}
-
-						if (SUCCEEDED(hr))
-						{
-							if (abs((180.0f * m_fBeamAngle / static_cast<float>(M_PI)) - ang) < (float) 5.0)
-							{
-								foundFace = true;
-								m_pDrawDataStreams->DrawFaceFrameResults(iFace, &faceBox, facePoints, &faceRotation, faceProperties, &faceTextLayout);
-							}
-						}							
-					}
-
-					SafeRelease(pFaceFrameResult);	
-				}
-				else 
-				{	
-					// face tracking is not valid - attempt to fix the issue
-					// a valid body is required to perform this step
-					if (bHaveBodyData)
-					{
-						// check if the corresponding body is tracked 
-						// if this is true then update the face frame source to track this body
-						IBody* pBody = ppBodies[iFace];
-						if (pBody != nullptr)
-						{
-							BOOLEAN bTracked = false;
-							hr = pBody->get_IsTracked(&bTracked);
-
-							UINT64 bodyTId;
-							if (SUCCEEDED(hr) && bTracked)
-							{
-								// get the tracking ID of this body
-								hr = pBody->get_TrackingId(&bodyTId);
-								if (SUCCEEDED(hr))
-								{
-									// update the face frame source with the tracking ID
-									m_pFaceFrameSources[iFace]->put_TrackingId(bodyTId);
-								}
-							}
-						}
-					}
-				}
-			}	
-			SafeRelease(pFaceFrame);
-		}
-		}
-		if (!foundFace)
-		{
-			hr = m_pDrawDataStreams->DrawBackgroundA();
-		}
-
-		float audioBuffer[cAudioBufferLength];
-		DWORD cbRead = 0;
-
-		// S_OK will be returned when cbRead == sizeof(audioBuffer).
-		// E_PENDING will be returned when cbRead < sizeof(audioBuffer).
-		// For both return codes we will continue to process the audio written into the buffer.
-		hr = m_pAudioStream->Read((void *)audioBuffer, sizeof(audioBuffer), &cbRead);
-
-		if (FAILED(hr) && hr != E_PENDING)
+		hr = m_pDrawDataStreams->SetMosaic(pMosaic->GetPixels(), pMosaic->GetWidth(), pMosaic->GetHeight(), pMosaic->GetStride());
+		if (SUCCEEDED(hr))
 		{
-			SetStatusMessage(L"Failed to read from audio stream.", 10000, true);
+			hr = m_pDrawDataStreams->DrawMosaic();
 		}
-		else if (cbRead > 0)
-		{
-			DWORD nSampleCount = cbRead / sizeof(float);
-			float fBeamAngle = 0.f;
-			float fBeamAngleConfidence = 0.f;
-
-			// Get most recent audio beam angle and confidence
-			m_pAudioBeam->get_BeamAngle(&fBeamAngle);
-			m_pAudioBeam->get_BeamAngleConfidence(&fBeamAngleConfidence);
-
-			// Calculate energy from audio
-			for (UINT i = 0; i < nSampleCount; i++)
-			{
-				// Compute the sum of squares of audio samples that will get accumulated
-				// into a single energy value.
-				m_fAccumulatedSquareSum += audioBuffer[i] * audioBuffer[i];
-				++m_nAccumulatedSampleCount;
-
-				if (m_nAccumulatedSampleCount < cAudioSamplesPerEnergySample)
-				{
-					continue;
-				}
-
-				// Each energy value will represent the logarithm of the mean of the
-				// sum of squares of a group of audio samples.
-				float fMeanSquare = m_fAccumulatedSquareSum / cAudioSamplesPerEnergySample;
-
-				if (fMeanSquare > 1.0f)
-				{
-					// A loud audio source right next to the sensor may result in mean square values
-					// greater than 1.0. Cap it at 1.0f for display purposes.
-					fMeanSquare = 1.0f;
-				}
-
-				float fEnergy = cMinEnergy;
-				if (fMeanSquare > 0.f)
-				{
-					// Convert to dB
-					fEnergy = 10.0f*log10(fMeanSquare);
-				}
-
-			{
-				// Protect shared resources with Update() method on another thread
-				EnterCriticalSection(&m_csLock);
-
-				m_fBeamAngle = fBeamAngle;
-				m_fBeamAngleConfidence = fBeamAngleConfidence;
-
-				// Renormalize signal above noise floor to [0,1] range for visualization.
-				m_fEnergyBuffer[m_nEnergyIndex] = (cMinEnergy - fEnergy) / cMinEnergy;
-				m_nNewEnergyAvailable++;
-				m_nEnergyIndex = (m_nEnergyIndex + 1) % cEnergyBufferLength;
-
-				LeaveCriticalSection(&m_csLock);
-			}
+	}
 
-			m_fAccumulatedSquareSum = 0.f;
-			m_nAccumulatedSampleCount = 0;
-			}
-		}
-    if (bHaveBodyData)
-    {
-        for (int i = 0; i < _countof(ppBodies); ++i)
-        {
-            SafeRelease(ppBodies[i]);
-        }
-    }
+	if (FAILED(hr))
+	{
+		m_pDrawDataStreams->DrawBackgroundA();
+	}
 }
 
 /// <summary>
-/// Computes the face result text position by adding an offset to the corresponding 
-/// body's head joint in camera space and then by projecting it to screen space
+/// Records a chunk of beam audio; called on the audio capture thread
 /// </summary>
-/// <param name="pBody">pointer to the body data</param>
-/// <param name="pFaceTextLayout">pointer to the text layout position in screen space</param>
-/// <returns>indicates success or failure</returns>
-HRESULT CFaceBasics::GetFaceTextPositionInColorSpace(IBody* pBody, D2D1_POINT_2F* pFaceTextLayout)
+/// <param name="nTime">time of the first sample, in 100ns ticks</param>
+/// <param name="pSamples">beam audio samples</param>
+/// <param name="nSampleCount">number of samples</param>
+/// <param name="fBeamAngle">beam angle in radians</param>
+/// <param name="fBeamAngleConfidence">beam angle confidence in the range [0,1]</param>
+void CFaceBasics::OnAudioChunk(INT64 nTime, const float* pSamples, UINT nSampleCount, float fBeamAngle, float fBeamAngleConfidence)
 {
-    HRESULT hr = E_FAIL;
-
-    if (pBody != nullptr)
-    {
-        BOOLEAN bTracked = false;
-        hr = pBody->get_IsTracked(&bTracked);
-
-        if (SUCCEEDED(hr) && bTracked)
-        {
-            Joint joints[JointType_Count]; 
-            hr = pBody->GetJoints(_countof(joints), joints);
-            if (SUCCEEDED(hr))
-            {
-                CameraSpacePoint headJoint = joints[JointType_Head].Position;
-                CameraSpacePoint textPoint = 
-                {
-                    headJoint.X + c_FaceTextLayoutOffsetX,
-                    headJoint.Y + c_FaceTextLayoutOffsetY,
-                    headJoint.Z
-                };
-
-                ColorSpacePoint colorPoint = {0};
-                hr = m_pCoordinateMapper->MapCameraPointToColorSpace(textPoint, &colorPoint);
-
-                if (SUCCEEDED(hr))
-                {
-                    pFaceTextLayout->x = colorPoint.X;
-                    pFaceTextLayout->y = colorPoint.Y;
-                }
-            }
-        }
-    }
+	if (m_pSessionWriter)
+	{
+		m_pSessionWriter->WriteAudio(nTime, pSamples, nSampleCount, fBeamAngle, fBeamAngleConfidence);
+	}
 
-    return hr;
+	// picked up by the next frame rather than waking the loop on its own
+	m_frameWakeup.Signal(FrameStream_Audio);
 }
 
 /// <summary>
-/// Updates body data
+/// Takes the energy values that came with a frame into the display history and
+/// updates the beam state shown
 /// </summary>
-/// <param name="ppBodies">pointer to the body data storage</param>
-/// <returns>indicates success or failure</returns>
-HRESULT CFaceBasics::UpdateBodyData(IBody** ppBodies)
+/// <param name="pFrame">composed frame</param>
+void CFaceBasics::ConsumeEnergy(const PipelineFrame* pFrame)
 {
-    HRESULT hr = E_FAIL;
-
-    if (m_pBodyFrameReader != nullptr)
-    {
-        IBodyFrame* pBodyFrame = nullptr;
-        hr = m_pBodyFrameReader->AcquireLatestFrame(&pBodyFrame);
-        if (SUCCEEDED(hr))
-        {
-            hr = pBodyFrame->GetAndRefreshBodyData(BODY_COUNT, ppBodies);
-        }
-        SafeRelease(pBodyFrame);    
-    }
+	for (size_t i = 0; i < pFrame->energies.size(); ++i)
+	{
+		m_fEnergyBuffer[m_nEnergyIndex] = pFrame->energies[i];
+		m_nEnergyIndex = (m_nEnergyIndex + 1) % cEnergyBufferLength;
+	}
 
-    return hr;
+	m_nNewEnergyAvailable += static_cast<int>(pFrame->energies.size());
+	m_fBeamAngle = pFrame->fBeamAngle;
+	m_fBeamAngleConfidence = pFrame->fBeamAngleConfidence;
 }
 
 /// <summary>
@@ -6,13 +6,21 @@
 
 #pragma once
 
+#include <vector>
 #include "resource.h"
 #include "ImageRenderer.h"
-
-class CFaceBasics
+#include "RoiExport.h"
+#include "SessionRecording.h"
+#include "AudioCapture.h"
+#include "KinectAudioSource.h"
+#include "KinectFrameSource.h"
+#include "SpeakerPipeline.h"
+#include "CommandLine.h"
+
+class CFaceBasics : public IAudioChunkSink
 {
-    static const int       cColorWidth  = 1920;
-    static const int       cColorHeight = 1080;
+    // Posted to the window when the pipeline has a composed frame
+    static const UINT      cFrameReadyMessage = WM_APP + 1;
 
 public:
     /// <summary>
@@ -46,53 +54,105 @@ public:
     LRESULT CALLBACK       DlgProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
 
     /// <summary>
-    /// Creates the main window and begins processing
+    /// Creates the main window and begins processing, or runs headless when exporting
     /// </summary>
     /// <param name="hInstance"></param>
     /// <param name="nCmdShow"></param>
-    int                    Run(HINSTANCE hInstance, int nCmdShow);
+    /// <param name="options">recording, replay and export options</param>
+    int                    Run(HINSTANCE hInstance, int nCmdShow, const AppOptions& options);
 
 private:
+    /// <summary>
+    /// Processes frames without a window, writing the speaker regions to the export stream
+    /// until the replay ends or the consumer of the stream goes away
+    /// </summary>
+    /// <returns>process exit code</returns>
+    int                    RunHeadless();
+
     /// <summary>
     /// Main processing function
     /// </summary>
     void                   Update();
 
+    /// <summary>
+    /// Presents the next composed frame of the pipeline, if there is one
+    /// </summary>
+    void                   UpdateFromPipeline();
+
+    /// <summary>
+    /// Closes the latency interval once a second, and logs it when logging
+    /// </summary>
+    void                   UpdateLatencyIntervals();
+
+    /// <summary>
+    /// Posts a frame ready message to the window; called by the pipeline on the thread
+    /// that made the frame ready
+    /// </summary>
+    /// <param name="pContext">the class instance</param>
+    static void            PostFrameReady(void* pContext);
+
+    /// <summary>
+    /// Advances the energy display buffer
+    /// </summary>
+    void                   UpdateEnergyDisplay();
+
+    /// <summary>
+    /// Opens the recording, if any, and the sensor or the session to replay
+    /// </summary>
+    /// <returns>S_OK on success else the failure code</returns>
+    HRESULT                InitializeSources();
+
     /// <summary>
     /// Initializes the default Kinect sensor
     /// </summary>
     /// <returns>S_OK on success else the failure code</returns>
     HRESULT                InitializeDefaultSensor();
 
+    /// <summary>
+    /// Opens the session to replay instead of the sensor
+    /// </summary>
+    /// <returns>S_OK on success else the failure code</returns>
+    HRESULT                InitializeReplay();
+
+    /// <summary>
+    /// Starts the pipeline processing the frames of the frame source
+    /// </summary>
+    /// <returns>S_OK on success else the failure code</returns>
+    HRESULT                StartPipeline();
+
+    /// <summary>
+    /// Stops the pipeline and closes the frame source
+    /// </summary>
+    void                   StopPipeline();
+
     /// <summary>
     /// Renders the color and face streams
     /// </summary>			
-    /// <param name="nTime">timestamp of frame</param>
-    /// <param name="pBuffer">pointer to frame data</param>
-    /// <param name="nWidth">width (in pixels) of input image data</param>
-    /// <param name="nHeight">height (in pixels) of input image data</param>
-    void                   DrawStreams(INT64 nTime, RGBQUAD* pBuffer, int nWidth, int nHeight);
+    /// <param name="pFrame">composed frame to render</param>
+    void                   DrawStreams(const PipelineFrame* pFrame);
 
     /// <summary>
-    /// Processes new face frames
+    /// Processes the faces of a frame, drawing every active speaker as a tile of the mosaic
     /// </summary>
-    void                   ProcessFaces();
+    /// <param name="pFrame">composed frame holding the speaker mosaic</param>
+    void                   ProcessFaces(const PipelineFrame* pFrame);
 
     /// <summary>
-    /// Computes the face result text layout position by adding an offset to the corresponding 
-    /// body's head joint in camera space and then by projecting it to screen space
+    /// Records a chunk of beam audio; called on the audio capture thread
     /// </summary>
-    /// <param name="pBody">pointer to the body data</param>
-    /// <param name="pFaceTextLayout">pointer to the text layout position in screen space</param>
-    /// <returns>indicates success or failure</returns>
-    HRESULT                GetFaceTextPositionInColorSpace(IBody* pBody, D2D1_POINT_2F* pFaceTextLayout);
+    /// <param name="nTime">time of the first sample, in 100ns ticks</param>
+    /// <param name="pSamples">beam audio samples</param>
+    /// <param name="nSampleCount">number of samples</param>
+    /// <param name="fBeamAngle">beam angle in radians</param>
+    /// <param name="fBeamAngleConfidence">beam angle confidence in the range [0,1]</param>
+    virtual void           OnAudioChunk(INT64 nTime, const float* pSamples, UINT nSampleCount, float fBeamAngle, float fBeamAngleConfidence);
 
     /// <summary>
-    /// Updates body data
+    /// Takes the energy values that came with a frame into the display history and
+    /// updates the beam state shown
     /// </summary>
-    /// <param name="ppBodies">pointer to the body data storage</param>
-    /// <returns>indicates success or failure</returns>
-    HRESULT                UpdateBodyData(IBody** ppBodies);
+    /// <param name="pFrame">composed frame</param>
+    void                   ConsumeEnergy(const PipelineFrame* pFrame);
 
     /// <summary>
     /// Set the status bar message
@@ -104,47 +164,59 @@ private:
     bool                   SetStatusMessage(_In_z_ WCHAR* szMessage, ULONGLONG nShowTimeMsec, bool bForce);
 
     HWND                   m_hWnd;
+    AppOptions             m_options;
+
+    // Size of the color frames of the sensor or the replayed session, and of the
+    // background drawn of them
+    FrameGeometry          m_geometry;
     INT64                  m_nStartTime;
     INT64                  m_nLastCounter;
     double                 m_fFreq;
     ULONGLONG              m_nNextStatusTime;
     DWORD                  m_nFramesSinceUpdate;
 
-    // Current Kinect
-    IKinectSensor*         m_pKinectSensor;
+    // Source of the frames: the sensor, or the replayed session
+    IFrameSource*          m_pFrameSource;
 
-    // Coordinate mapper
-    ICoordinateMapper*     m_pCoordinateMapper;
+    // The frame source when it is the sensor, else null
+    KinectFrameSource*     m_pKinectSource;
 
-    // Color reader
-    IColorFrameReader*     m_pColorFrameReader;
+    // Signalled by the frame source and the audio capture thread; only color frames wake the pipeline
+    FrameWakeup            m_frameWakeup;
 
-    // Body reader
-    IBodyFrameReader*      m_pBodyFrameReader;
+    // Acquires, associates and composes the frames of the frame source ahead of presenting them
+    SpeakerPipeline*       m_pPipeline;
 
-    // Face sources
-    IFaceFrameSource*	   m_pFaceFrameSources[BODY_COUNT];
-
-    // Face readers
-    IFaceFrameReader*	   m_pFaceFrameReaders[BODY_COUNT];
+    // Latencies of the pipeline stages and of presenting the frames, and those of the
+    // latest second, which the status shows and the latency log receives
+    LatencyMonitor*        m_pLatencyMonitor;
+    LatencyIntervals       m_latencyIntervals;
+    LatencyCsvLog*         m_pLatencyLog;
+    ULONGLONG              m_nLatencyIntervalStartTime;
+    ULONGLONG              m_nLatencyLogStartTime;
 
     // Direct2D
     ImageRenderer*         m_pDrawDataStreams;
     ID2D1Factory*          m_pD2DFactory;
-    RGBQUAD*               m_pColorRGBX;	
 
-	// ID of timer that drives audio capture.
-	static const int        cAudioReadTimerId = 1;
+    // Writer of the recorded session, if recording
+    SessionWriter*         m_pSessionWriter;
 
-	// Time interval, in milliseconds, for timer that drives audio capture.
-	static const int        cAudioReadTimerInterval = 50;
+    // Log of the speaker decisions, if logging them
+    SpeakerLogWriter*      m_pSpeakerLog;
 
-	// Audio samples per second in Kinect audio stream
-	static const int        cAudioSamplesPerSecond = 16000;
+    // Length of a latency interval, in milliseconds
+    static const int       cLatencyIntervalMsec = 1000;
 
-	// Number of float samples in the audio beffer we allocate for reading every time the audio capture timer fires
+	// Time interval, in milliseconds, between wake-ups of the audio capture thread.
+	static const int        cAudioReadTimerInterval = 50;
+
+	// Number of float samples in the audio beffer we allocate for reading every time the audio capture thread wakes up
 	// (should be larger than the amount of audio corresponding to cAudioReadTimerInterval msec).
-	static const int        cAudioBufferLength = 2 * cAudioReadTimerInterval * cAudioSamplesPerSecond / 1000;
+	static const int        cAudioBufferLength = 2 * cAudioReadTimerInterval * c_AudioSamplesPerSecond / 1000;
+
+	// Most buffers the audio capture thread drains per wake-up before it reports an overrun.
+	static const int        cAudioMaxBuffersPerRead = 16;
 
 	// ID of timer that drives energy stream display.
 	static const int        cEnergyRefreshTimerId = 2;
@@ -152,10 +224,6 @@ private:
 	// Time interval, in milliseconds, for timer that drives energy stream display.
 	static const int        cEnergyRefreshTimerInterval = 10;
 
-	// Number of audio samples captured from Kinect audio stream accumulated into a single
-	// energy measurement that will get displayed.
-	static const int        cAudioSamplesPerEnergySample = 40;
-
 	// Number of energy samples that will be visible in display at any given time.
 	static const int        cEnergySamplesToDisplay = 780;
 
@@ -163,45 +231,46 @@ private:
 	// Always keep it higher than the energy display length to avoid overflow.
 	static const int        cEnergyBufferLength = 1000;
 
-	// Minimum energy of audio to display (in dB value, where 0 dB is full scale)
-	static const int        cMinEnergy = -90;
-
-	// To manage access to shared resources between worker thread and UI update thread
-	CRITICAL_SECTION        m_csLock;
-
 	// A single audio beam off the Kinect sensor.
 	IAudioBeam*             m_pAudioBeam;
 
 	// An IStream derived from the audio beam, used to read audio samples
 	IStream*                m_pAudioStream;
 
+	// Beam audio of the sensor as read by the audio capture thread.
+	KinectAudioSource*      m_pAudioSource;
+
+	// Reads beam audio off the video loop and hands energy values and beam state to the
+	// video side. Replayed audio is fed through it by the pipeline.
+	AudioCapture*           m_pAudioCapture;
+
+	// Writes the speaker regions as a video stream when running headless.
+	RoiExporter*            m_pRoiExporter;
+
+	// Longest time, in milliseconds, the headless loop waits for a frame before checking on the export stream.
+	static const int        cHeadlessWaitTimeout = 1000;
+
 	// Latest audio beam angle in radians
 	float                   m_fBeamAngle;
 
 	// Latest audio beam angle confidence, in the range [0,1]
 	float                   m_fBeamAngleConfidence;
 
-	// Buffer used to store audio stream energy data as we read audio.
+	// Buffer used to store audio stream energy data as it is consumed.
 	float                   m_fEnergyBuffer[cEnergyBufferLength];
 
 	// Buffer used to store audio stream energy data ready to be displayed.
 	float                   m_fEnergyDisplayBuffer[cEnergySamplesToDisplay];
 
-	// Sum of squares of audio samples being accumulated to compute the next energy value.
-	float                   m_fAccumulatedSquareSum;
-
 	// Error between time slice we wanted to display and time slice that we ended up
 	// displaying, given that we have to display in integer pixels.
 	float                   m_fEnergyError;
 
-	// Number of audio samples accumulated so far to compute the next energy value.
-	int                     m_nAccumulatedSampleCount;
-
 	// Index of next element available in audio energy buffer.
 	int                     m_nEnergyIndex;
 
-	// Number of newly calculated audio stream energy values that have not yet been displayed.
-	volatile int            m_nNewEnergyAvailable;
+	// Number of consumed audio stream energy values that have not yet been displayed.
+	int                     m_nNewEnergyAvailable;
 
 	// Index of first energy element that has never (yet) been displayed to screen.
 	int                     m_nEnergyRefreshIndex;
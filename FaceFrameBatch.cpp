@@ -0,0 +1,85 @@
+//------------------------------------------------------------------------------
+// <copyright file="FaceFrameBatch.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "KinectTypes.h"
+#include <string.h>
+#include "BeamAngleMapping.h"
+#include "FaceFrameBatch.h"
+
+/// <summary>
+/// Loads the faces of a frame, and the head joints of their bodies, into a batch
+/// </summary>
+/// <param name="pFrame">frame holding the face and body data</param>
+/// <param name="pBatch">receives the faces with a result; a frame without face data has none</param>
+void LoadFaceFrameBatch(const SessionFrame* pFrame, FaceFrameBatch* pBatch)
+{
+    // one clear of the whole batch is cheaper than clearing faces one field at a time;
+    // rarely more than two of the faces are tracked
+    memset(pBatch, 0, sizeof(*pBatch));
+    pBatch->nColorWidth = pFrame->nColorWidth;
+    pBatch->nColorHeight = pFrame->nColorHeight;
+
+    if (!pFrame->bHaveFaceData)
+    {
+        return;
+    }
+
+    for (int iFace = 0; iFace < BODY_COUNT; ++iFace)
+    {
+        const FaceSample& face = pFrame->faces[iFace];
+        const BodySample& body = pFrame->bodies[iFace];
+
+        if (!face.bTracked || !face.bHaveResult)
+        {
+            continue;
+        }
+
+        // face sources are bound to the body of the same index
+        pBatch->bHaveResult[iFace] = true;
+        pBatch->bHaveHead[iFace] = pFrame->bHaveBodyData && body.bTracked && body.nTrackingId == face.nTrackingId &&
+            IsValidCameraSpacePoint(&body.headJoint);
+        pBatch->nTrackingIds[iFace] = face.nTrackingId;
+
+        pBatch->nBoxLeft[iFace] = face.faceBox.Left;
+        pBatch->nBoxTop[iFace] = face.faceBox.Top;
+        pBatch->nBoxRight[iFace] = face.faceBox.Right;
+        pBatch->nBoxBottom[iFace] = face.faceBox.Bottom;
+
+        for (int i = 0; i < FacePointType_Count; ++i)
+        {
+            pBatch->fPointX[i][iFace] = face.facePoints[i].X;
+            pBatch->fPointY[i][iFace] = face.facePoints[i].Y;
+        }
+
+        pBatch->fRotationX[iFace] = face.faceRotation.x;
+        pBatch->fRotationY[iFace] = face.faceRotation.y;
+        pBatch->fRotationZ[iFace] = face.faceRotation.z;
+        pBatch->fRotationW[iFace] = face.faceRotation.w;
+
+        for (int i = 0; i < FaceProperty_Count; ++i)
+        {
+            pBatch->faceProperties[i][iFace] = face.faceProperties[i];
+        }
+
+        pBatch->fHeadX[iFace] = body.headJoint.X;
+        pBatch->fHeadY[iFace] = body.headJoint.Y;
+        pBatch->fHeadZ[iFace] = body.headJoint.Z;
+    }
+}
+
+/// <summary>
+/// Face bounding box of a face of a batch
+/// </summary>
+/// <param name="pBatch">batch holding the face</param>
+/// <param name="iFace">face index</param>
+/// <param name="pFaceBox">receives the bounding box</param>
+void GetBatchFaceBox(const FaceFrameBatch* pBatch, int iFace, RectI* pFaceBox)
+{
+    pFaceBox->Left = pBatch->nBoxLeft[iFace];
+    pFaceBox->Top = pBatch->nBoxTop[iFace];
+    pFaceBox->Right = pBatch->nBoxRight[iFace];
+    pFaceBox->Bottom = pBatch->nBoxBottom[iFace];
+}
@@ -0,0 +1,75 @@
+//------------------------------------------------------------------------------
+// <copyright file="FaceFrameBatch.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// The faces of a frame laid out field by field rather than face by face, so that the
+// speaker selection kernels walk every face in one pass over contiguous arrays. A
+// FaceSample is the layout of the recordings and is kept as it is; a batch is loaded
+// from the frame once and the kernels of SpeakerSelection.h run over it. Batches need
+// no sensor and can be filled in directly by the benchmarks.
+
+#pragma once
+
+#include "KinectTypes.h"
+#include "SessionRecording.h"
+
+/// <summary>
+/// Faces of a frame and the head joints of their bodies, one array entry per face index;
+/// every field of a face without a result is zero
+/// </summary>
+struct FaceFrameBatch
+{
+    // Size of the color frame the face points are in
+    int                 nColorWidth;
+    int                 nColorHeight;
+
+    // Whether the face is tracked and its result was retrieved
+    bool                bHaveResult[BODY_COUNT];
+
+    // Whether the body of the same index is tracked as the same person and has a
+    // usable head joint
+    bool                bHaveHead[BODY_COUNT];
+
+    UINT64              nTrackingIds[BODY_COUNT];
+
+    // Face bounding boxes in color space
+    INT32               nBoxLeft[BODY_COUNT];
+    INT32               nBoxTop[BODY_COUNT];
+    INT32               nBoxRight[BODY_COUNT];
+    INT32               nBoxBottom[BODY_COUNT];
+
+    // Face points in color space, by point type and then by face
+    float               fPointX[FacePointType_Count][BODY_COUNT];
+    float               fPointY[FacePointType_Count][BODY_COUNT];
+
+    // Face rotation quaternions
+    float               fRotationX[BODY_COUNT];
+    float               fRotationY[BODY_COUNT];
+    float               fRotationZ[BODY_COUNT];
+    float               fRotationW[BODY_COUNT];
+
+    // Face properties, by property and then by face
+    DetectionResult     faceProperties[FaceProperty_Count][BODY_COUNT];
+
+    // Head joints in camera space; only meaningful where bHaveHead is set
+    float               fHeadX[BODY_COUNT];
+    float               fHeadY[BODY_COUNT];
+    float               fHeadZ[BODY_COUNT];
+};
+
+/// <summary>
+/// Loads the faces of a frame, and the head joints of their bodies, into a batch
+/// </summary>
+/// <param name="pFrame">frame holding the face and body data</param>
+/// <param name="pBatch">receives the faces with a result; a frame without face data has none</param>
+void LoadFaceFrameBatch(const SessionFrame* pFrame, FaceFrameBatch* pBatch);
+
+/// <summary>
+/// Face bounding box of a face of a batch
+/// </summary>
+/// <param name="pBatch">batch holding the face</param>
+/// <param name="iFace">face index</param>
+/// <param name="pFaceBox">receives the bounding box</param>
+void GetBatchFaceBox(const FaceFrameBatch* pBatch, int iFace, RectI* pFaceBox);
@@ -0,0 +1,355 @@
+//------------------------------------------------------------------------------
+// <copyright file="FrameBufferPool.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "KinectTypes.h"
+#include "FrameBufferPool.h"
+
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#endif
+
+#if defined(_WIN32)
+
+/// <summary>
+/// Enables the privilege to lock pages in memory for the process, which large page
+/// allocations require; the account must have been granted it
+/// </summary>
+/// <returns>true if the privilege is enabled</returns>
+static bool EnableLockMemoryPrivilege()
+{
+    HANDLE hToken = NULL;
+    if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &hToken))
+    {
+        return false;
+    }
+
+    TOKEN_PRIVILEGES privileges;
+    privileges.PrivilegeCount = 1;
+    privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+
+    bool bEnabled = LookupPrivilegeValueW(NULL, SE_LOCK_MEMORY_NAME, &privileges.Privileges[0].Luid) &&
+        AdjustTokenPrivileges(hToken, FALSE, &privileges, 0, NULL, NULL) &&
+        ERROR_SUCCESS == GetLastError();
+
+    CloseHandle(hToken);
+    return bEnabled;
+}
+
+#endif
+
+/// <summary>
+/// Allocates page aligned memory, with large pages if asked for and granted
+/// </summary>
+/// <param name="cbSize">size in bytes</param>
+/// <param name="bLargePages">whether to try large pages</param>
+/// <param name="pcbAllocated">receives the size allocated, rounded up to whole pages</param>
+/// <param name="pbLargePages">receives whether large pages back the memory</param>
+/// <returns>the memory, or null</returns>
+static BYTE* AllocatePages(size_t cbSize, bool bLargePages, size_t* pcbAllocated, bool* pbLargePages)
+{
+    *pbLargePages = false;
+
+#if defined(_WIN32)
+    SIZE_T cbLargePage = GetLargePageMinimum();
+    if (bLargePages && cbLargePage > 0 && EnableLockMemoryPrivilege())
+    {
+        size_t cbRounded = (cbSize + cbLargePage - 1) / cbLargePage * cbLargePage;
+        void* pMemory = VirtualAlloc(NULL, cbRounded, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+        if (pMemory)
+        {
+            *pcbAllocated = cbRounded;
+            *pbLargePages = true;
+            return static_cast<BYTE*>(pMemory);
+        }
+    }
+
+    *pcbAllocated = cbSize;
+    return static_cast<BYTE*>(VirtualAlloc(NULL, cbSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+#else
+#if defined(MAP_HUGETLB)
+    // explicit huge pages, 2 MB on x86-64, when the system has reserved any
+    static const size_t c_cbHugePage = 2 * 1024 * 1024;
+    if (bLargePages)
+    {
+        size_t cbRounded = (cbSize + c_cbHugePage - 1) / c_cbHugePage * c_cbHugePage;
+        void* pMemory = mmap(nullptr, cbRounded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (MAP_FAILED != pMemory)
+        {
+            *pcbAllocated = cbRounded;
+            *pbLargePages = true;
+            return static_cast<BYTE*>(pMemory);
+        }
+    }
+#endif
+
+    void* pMemory = mmap(nullptr, cbSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED == pMemory)
+    {
+        return nullptr;
+    }
+
+#if defined(MADV_HUGEPAGE)
+    // otherwise let the kernel back the memory with transparent huge pages where it can
+    if (bLargePages)
+    {
+        madvise(pMemory, cbSize, MADV_HUGEPAGE);
+    }
+#endif
+
+    *pcbAllocated = cbSize;
+    return static_cast<BYTE*>(pMemory);
+#endif
+}
+
+/// <summary>
+/// Frees memory allocated with AllocatePages
+/// </summary>
+/// <param name="pMemory">the memory</param>
+/// <param name="cbAllocated">size that was allocated</param>
+static void FreePages(BYTE* pMemory, size_t cbAllocated)
+{
+#if defined(_WIN32)
+    UNREFERENCED_PARAMETER(cbAllocated);
+    VirtualFree(pMemory, 0, MEM_RELEASE);
+#else
+    munmap(pMemory, cbAllocated);
+#endif
+}
+
+/// <summary>
+/// Constructor; the handle refers to no buffer
+/// </summary>
+FrameBufferHandle::FrameBufferHandle() :
+    m_pPool(nullptr),
+    m_nIndex(0),
+    m_pData(nullptr)
+{
+}
+
+/// <summary>
+/// Copy constructor; both handles refer to the same buffer
+/// </summary>
+FrameBufferHandle::FrameBufferHandle(const FrameBufferHandle& other) :
+    m_pPool(other.m_pPool),
+    m_nIndex(other.m_nIndex),
+    m_pData(other.m_pData)
+{
+    if (m_pPool)
+    {
+        m_pPool->AddRef(m_nIndex);
+    }
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+FrameBufferHandle::~FrameBufferHandle()
+{
+    Reset();
+}
+
+/// <summary>
+/// Lets go of the current buffer and refers to that of another handle
+/// </summary>
+FrameBufferHandle& FrameBufferHandle::operator=(const FrameBufferHandle& other)
+{
+    // referenced first, in case both handles already share the buffer
+    if (other.m_pPool)
+    {
+        other.m_pPool->AddRef(other.m_nIndex);
+    }
+
+    Reset();
+    m_pPool = other.m_pPool;
+    m_nIndex = other.m_nIndex;
+    m_pData = other.m_pData;
+
+    return *this;
+}
+
+/// <summary>
+/// Lets go of the buffer
+/// </summary>
+void FrameBufferHandle::Reset()
+{
+    if (m_pPool)
+    {
+        m_pPool->Release(m_nIndex);
+        m_pPool = nullptr;
+        m_nIndex = 0;
+        m_pData = nullptr;
+    }
+}
+
+/// <summary>
+/// Usable size of the buffer in bytes, 0 for no buffer
+/// </summary>
+size_t FrameBufferHandle::GetSize() const
+{
+    return m_pPool ? m_pPool->GetBufferSize() : 0;
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+FrameBufferPool::FrameBufferPool() :
+    m_pMemory(nullptr),
+    m_cbMemory(0),
+    m_cbBuffer(0),
+    m_cbStride(0),
+    m_nBuffers(0),
+    m_bLargePages(false),
+    m_pRefCounts(nullptr),
+    m_nHighWater(0),
+    m_nAcquired(0),
+    m_nExhausted(0)
+{
+}
+
+/// <summary>
+/// Destructor; every handle must have let go of its buffer
+/// </summary>
+FrameBufferPool::~FrameBufferPool()
+{
+    FreeMemory();
+}
+
+/// <summary>
+/// Allocates every buffer of the pool; the only allocation the pool ever makes
+/// </summary>
+/// <param name="cbBuffer">usable size of each buffer in bytes</param>
+/// <param name="nBuffers">number of buffers</param>
+/// <param name="bLargePages">whether to try backing the pool with large pages; falls
+/// back to regular pages when the system does not grant them</param>
+/// <returns>indicates success or failure</returns>
+HRESULT FrameBufferPool::Create(size_t cbBuffer, UINT32 nBuffers, bool bLargePages)
+{
+    if (0 == cbBuffer || 0 == nBuffers)
+    {
+        return E_INVALIDARG;
+    }
+
+    if (m_pMemory)
+    {
+        return E_UNEXPECTED;
+    }
+
+    // every buffer starts on its own cache line; the memory itself is page aligned
+    m_cbStride = (cbBuffer + c_FrameBufferAlignment - 1) / c_FrameBufferAlignment * c_FrameBufferAlignment;
+    m_pMemory = AllocatePages(m_cbStride * nBuffers, bLargePages, &m_cbMemory, &m_bLargePages);
+
+    if (nullptr == m_pMemory)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    m_cbBuffer = cbBuffer;
+    m_nBuffers = nBuffers;
+    m_pRefCounts = new std::atomic<INT32>[nBuffers];
+    m_freeBuffers.reserve(nBuffers);
+
+    // handed out lowest index first
+    for (UINT32 i = nBuffers; i > 0; --i)
+    {
+        m_pRefCounts[i - 1] = 0;
+        m_freeBuffers.push_back(i - 1);
+    }
+
+    return S_OK;
+}
+
+/// <summary>
+/// Takes a free buffer without blocking
+/// </summary>
+/// <param name="pHandle">receives the buffer, after letting go of the one it held</param>
+/// <returns>false if every buffer is held; counted as an exhaustion</returns>
+bool FrameBufferPool::Acquire(FrameBufferHandle* pHandle)
+{
+    pHandle->Reset();
+
+    UINT32 nIndex;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (m_freeBuffers.empty())
+        {
+            m_nExhausted++;
+            return false;
+        }
+
+        nIndex = m_freeBuffers.back();
+        m_freeBuffers.pop_back();
+
+        UINT32 nInUse = m_nBuffers - static_cast<UINT32>(m_freeBuffers.size());
+        m_nHighWater = (nInUse > m_nHighWater) ? nInUse : m_nHighWater;
+        m_nAcquired++;
+    }
+
+    m_pRefCounts[nIndex] = 1;
+    pHandle->m_pPool = this;
+    pHandle->m_nIndex = nIndex;
+    pHandle->m_pData = m_pMemory + nIndex * m_cbStride;
+
+    return true;
+}
+
+/// <summary>
+/// Snapshot of the pool counters
+/// </summary>
+/// <param name="pStats">receives the counters</param>
+void FrameBufferPool::GetStats(FrameBufferPoolStats* pStats) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    pStats->nBuffers = m_nBuffers;
+    pStats->cbBuffer = m_cbBuffer;
+    pStats->bLargePages = m_bLargePages;
+    pStats->nInUse = m_nBuffers - static_cast<UINT32>(m_freeBuffers.size());
+    pStats->nHighWater = m_nHighWater;
+    pStats->nAcquired = m_nAcquired;
+    pStats->nExhausted = m_nExhausted;
+}
+
+/// <summary>
+/// Adds a handle to a buffer
+/// </summary>
+/// <param name="nIndex">buffer</param>
+void FrameBufferPool::AddRef(UINT32 nIndex)
+{
+    m_pRefCounts[nIndex].fetch_add(1, std::memory_order_relaxed);
+}
+
+/// <summary>
+/// Removes a handle from a buffer, returning the buffer to the pool with the last one
+/// </summary>
+/// <param name="nIndex">buffer</param>
+void FrameBufferPool::Release(UINT32 nIndex)
+{
+    // acquire-release so that every write through the other handles happens before
+    // the buffer is handed out again
+    if (1 == m_pRefCounts[nIndex].fetch_sub(1, std::memory_order_acq_rel))
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        // the capacity was reserved for every buffer, so this never allocates
+        m_freeBuffers.push_back(nIndex);
+    }
+}
+
+/// <summary>
+/// Frees the buffers
+/// </summary>
+void FrameBufferPool::FreeMemory()
+{
+    if (m_pMemory)
+    {
+        FreePages(m_pMemory, m_cbMemory);
+        m_pMemory = nullptr;
+    }
+
+    delete [] m_pRefCounts;
+    m_pRefCounts = nullptr;
+}
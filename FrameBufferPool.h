@@ -0,0 +1,162 @@
+//------------------------------------------------------------------------------
+// <copyright file="FrameBufferPool.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Fixed set of frame buffers carved out of one allocation made up front, optionally
+// backed by large pages. Buffers are handed out through reference counted handles and
+// go back to the pool when the last handle lets go, so that a frame can be held by
+// several consumers, or while the next frame is filled in, without any allocation.
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include "KinectTypes.h"
+
+// Alignment of every buffer, that of a cache line and of the widest vector loads
+static const size_t c_FrameBufferAlignment = 64;
+
+struct FrameBufferPoolStats
+{
+    // Buffers in the pool and the size of each, in bytes
+    UINT32              nBuffers;
+    size_t              cbBuffer;
+
+    // Whether the pool is backed by large pages
+    bool                bLargePages;
+
+    // Buffers currently held, and the most ever held at once
+    UINT32              nInUse;
+    UINT32              nHighWater;
+
+    // Buffers handed out, and requests that found every buffer held
+    UINT64              nAcquired;
+    UINT64              nExhausted;
+};
+
+class FrameBufferPool;
+
+/// <summary>
+/// Reference to a pooled buffer; copies share the buffer, which goes back to the pool
+/// when the last of them is reset or destroyed. Handles must not outlive their pool.
+/// </summary>
+class FrameBufferHandle
+{
+public:
+    /// <summary>
+    /// Constructor; the handle refers to no buffer
+    /// </summary>
+    FrameBufferHandle();
+
+    /// <summary>
+    /// Copy constructor; both handles refer to the same buffer
+    /// </summary>
+    FrameBufferHandle(const FrameBufferHandle& other);
+
+    /// <summary>
+    /// Destructor
+    /// </summary>
+    ~FrameBufferHandle();
+
+    /// <summary>
+    /// Lets go of the current buffer and refers to that of another handle
+    /// </summary>
+    FrameBufferHandle& operator=(const FrameBufferHandle& other);
+
+    /// <summary>
+    /// Lets go of the buffer
+    /// </summary>
+    void Reset();
+
+    /// <summary>
+    /// Whether the handle refers to a buffer
+    /// </summary>
+    bool IsValid() const { return nullptr != m_pPool; }
+
+    /// <summary>
+    /// Start of the buffer, aligned to c_FrameBufferAlignment, or null
+    /// </summary>
+    BYTE* GetData() const { return m_pData; }
+
+    /// <summary>
+    /// Usable size of the buffer in bytes, 0 for no buffer
+    /// </summary>
+    size_t GetSize() const;
+
+private:
+    friend class FrameBufferPool;
+
+    FrameBufferPool*        m_pPool;
+    UINT32                  m_nIndex;
+    BYTE*                   m_pData;
+};
+
+class FrameBufferPool
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    FrameBufferPool();
+
+    /// <summary>
+    /// Destructor; every handle must have let go of its buffer
+    /// </summary>
+    ~FrameBufferPool();
+
+    /// <summary>
+    /// Allocates every buffer of the pool; the only allocation the pool ever makes
+    /// </summary>
+    /// <param name="cbBuffer">usable size of each buffer in bytes</param>
+    /// <param name="nBuffers">number of buffers</param>
+    /// <param name="bLargePages">whether to try backing the pool with large pages; falls
+    /// back to regular pages when the system does not grant them</param>
+    /// <returns>indicates success or failure</returns>
+    HRESULT Create(size_t cbBuffer, UINT32 nBuffers, bool bLargePages);
+
+    /// <summary>
+    /// Takes a free buffer without blocking
+    /// </summary>
+    /// <param name="pHandle">receives the buffer, after letting go of the one it held</param>
+    /// <returns>false if every buffer is held; counted as an exhaustion</returns>
+    bool Acquire(FrameBufferHandle* pHandle);
+
+    /// <summary>
+    /// Usable size of each buffer in bytes
+    /// </summary>
+    size_t GetBufferSize() const { return m_cbBuffer; }
+
+    /// <summary>
+    /// Snapshot of the pool counters
+    /// </summary>
+    /// <param name="pStats">receives the counters</param>
+    void GetStats(FrameBufferPoolStats* pStats) const;
+
+private:
+    friend class FrameBufferHandle;
+
+    void AddRef(UINT32 nIndex);
+    void Release(UINT32 nIndex);
+    void FreeMemory();
+
+    BYTE*                   m_pMemory;
+    size_t                  m_cbMemory;
+    size_t                  m_cbBuffer;
+    size_t                  m_cbStride;
+    UINT32                  m_nBuffers;
+    bool                    m_bLargePages;
+
+    // Handles referring to each buffer
+    std::atomic<INT32>*     m_pRefCounts;
+
+    // Indices of the free buffers; reserved for all of them up front
+    mutable std::mutex      m_mutex;
+    std::vector<UINT32>     m_freeBuffers;
+
+    UINT32                  m_nHighWater;
+    UINT64                  m_nAcquired;
+    UINT64                  m_nExhausted;
+};
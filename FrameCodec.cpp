@@ -0,0 +1,1191 @@
+//------------------------------------------------------------------------------
+// <copyright file="FrameCodec.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "KinectTypes.h"
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include "CpuFeatures.h"
+#include "PerfClock.h"
+#include "FrameCodec.h"
+
+// How a tile is predicted; the first byte of every encoded tile
+enum TileMode
+{
+    // From the neighbours within the tile
+    TileMode_Spatial    = 0,
+
+    // From the same byte of the previous frame
+    TileMode_Temporal   = 1
+};
+
+// Blocks are packed in pairs: a byte holding both widths, then the bits of each
+static const int c_BlockPairBytes = 2 * c_FrameCodecBlockBytes;
+
+// Rows sampled when choosing how to predict a tile: one in this many
+static const int c_ModeSampleRowStep = 4;
+
+/// <summary>
+/// Distance from every byte of a row to its left neighbour of the same channel, by the
+/// byte's position within a group of four: YUY2 lumas two bytes apart and chromas four,
+/// BGRA channels four
+/// </summary>
+/// <param name="colorFormat">ColorImageFormat_Yuy2 or ColorImageFormat_Bgra</param>
+/// <param name="pnDistances">receives the four distances</param>
+static void GetLeftDistances(ColorImageFormat colorFormat, int* pnDistances)
+{
+    bool bYuy2 = (ColorImageFormat_Yuy2 == colorFormat);
+    pnDistances[0] = bYuy2 ? 2 : 4;
+    pnDistances[1] = 4;
+    pnDistances[2] = bYuy2 ? 2 : 4;
+    pnDistances[3] = 4;
+}
+
+/// <summary>
+/// Smaller and larger of two values that differ by less than 2^31, computed with the
+/// sign of their difference rather than a branch, which noisy pixels would mispredict
+/// </summary>
+static inline int MinOf(int x, int y)
+{
+    int d = x - y;
+    return y + (d & (d >> 31));
+}
+
+static inline int MaxOf(int x, int y)
+{
+    int d = x - y;
+    return x - (d & (d >> 31));
+}
+
+/// <summary>
+/// Median edge detector of LOCO-I: predicts a byte from the bytes of the same channel
+/// to its left, above it and above its left one. The prediction is the median of a, b
+/// and a + b - c, which is a + b - c clamped to the range of a and b.
+/// </summary>
+static inline int PredictMed(int a, int b, int c)
+{
+    return MinOf(MaxOf(a + b - c, MinOf(a, b)), MaxOf(a, b));
+}
+
+/// <summary>
+/// Predicts a byte from within its tile, including the bytes without a left neighbour,
+/// which are predicted from above, and the first row, predicted from the left
+/// </summary>
+/// <param name="pRow">row holding the byte, reconstructed up to it</param>
+/// <param name="pUp">reconstructed row above, or null for the first row of a tile</param>
+/// <param name="i">position of the byte in the row</param>
+/// <param name="nDistance">distance to the left neighbour of the same channel</param>
+/// <returns>the predicted value</returns>
+static inline int PredictSpatial(const BYTE* pRow, const BYTE* pUp, int i, int nDistance)
+{
+    if (i < nDistance)
+    {
+        return pUp ? pUp[i] : 0;
+    }
+
+    return pUp ? PredictMed(pRow[i - nDistance], pUp[i], pUp[i - nDistance]) : pRow[i - nDistance];
+}
+
+/// <summary>
+/// Zigzag code of a residual from -128 to 127: 0, -1, 1, -2, 2... become 0, 1, 2, 3, 4...
+/// </summary>
+static inline BYTE ZigzagResidual(int q)
+{
+    // shifted unsigned, as a left shift of a negative int is undefined
+    return static_cast<BYTE>((static_cast<unsigned>(q) << 1) ^ static_cast<unsigned>(q >> 31));
+}
+
+/// <summary>
+/// Residual of a zigzag code
+/// </summary>
+static inline int UnzigzagResidual(int z)
+{
+    return (z >> 1) ^ -(z & 1);
+}
+
+/// <summary>
+/// Near-lossless quantization of every difference of a byte from its prediction, from
+/// -255 to 255: the residual is rounded to steps of twice the maximum error plus one
+/// </summary>
+struct ResidualQuantizer
+{
+    // Zigzag coded quantized residual, and the difference the decoder reconstructs
+    BYTE                coded[511];
+    short               reconstructed[511];
+
+    explicit ResidualQuantizer(int nMaxError)
+    {
+        int nStep = 2 * nMaxError + 1;
+        for (int e = -255; e <= 255; ++e)
+        {
+            int q = (e >= 0) ? (e + nMaxError) / nStep : -((nMaxError - e) / nStep);
+            coded[e + 255] = ZigzagResidual(q);
+            reconstructed[e + 255] = static_cast<short>(q * nStep);
+        }
+    }
+
+    /// <summary>
+    /// Codes a byte and returns its zigzag coded residual
+    /// </summary>
+    /// <param name="nValue">original value</param>
+    /// <param name="nPredicted">predicted value</param>
+    /// <param name="pReconstructed">receives the value the decoder will reconstruct</param>
+    BYTE Code(int nValue, int nPredicted, BYTE* pReconstructed) const
+    {
+        int e = nValue - nPredicted + 255;
+        *pReconstructed = static_cast<BYTE>(MinOf(MaxOf(nPredicted + reconstructed[e], 0), 255));
+        return coded[e];
+    }
+};
+
+/// <summary>
+/// Reconstructs a byte coded with a maximum error above 0, as ResidualQuantizer does
+/// </summary>
+static inline BYTE ReconstructNearLossless(int z, int nPredicted, int nStep)
+{
+    return static_cast<BYTE>(MinOf(MaxOf(nPredicted + UnzigzagResidual(z) * nStep, 0), 255));
+}
+
+#if defined(CPU_X86)
+
+/// <summary>
+/// Zigzag codes 16 residuals of a byte each
+/// </summary>
+static inline __m128i ZigzagResidualsSse2(__m128i q)
+{
+    return _mm_xor_si128(_mm_add_epi8(q, q), _mm_cmplt_epi8(q, _mm_setzero_si128()));
+}
+
+/// <summary>
+/// The 16 bytes ending at p[i + 15] of the channel to the left: two bytes back in the
+/// lanes of the mask, four bytes back in the others
+/// </summary>
+static inline __m128i LoadLeftSse2(const BYTE* p, int i, __m128i nearLanes)
+{
+    __m128i near2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i - 2));
+    __m128i far4 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i - 4));
+    return _mm_or_si128(_mm_and_si128(nearLanes, near2), _mm_andnot_si128(nearLanes, far4));
+}
+
+/// <summary>
+/// Lanes whose left neighbour is two bytes back, for 16 bytes starting at a multiple of four
+/// </summary>
+static inline __m128i GetNearLanesSse2(const int* pnDistances)
+{
+    char lanes[16];
+    for (int k = 0; k < 16; ++k)
+    {
+        lanes[k] = (2 == pnDistances[k & 3]) ? -1 : 0;
+    }
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(lanes));
+}
+
+/// <summary>
+/// Lossless spatial residuals of the bytes of a row from position 4 on, 16 at a time;
+/// the predictions only read original bytes, which is what the decoder reconstructs
+/// </summary>
+/// <returns>position of the first byte left for the scalar code</returns>
+static int CodeSpatialRowLosslessSse2(const BYTE* pRow, const BYTE* pUp, int nStride, const int* pnDistances, BYTE* pOut)
+{
+    __m128i nearLanes = GetNearLanesSse2(pnDistances);
+    int i = 4;
+
+    for (; i + 16 <= nStride; i += 16)
+    {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pRow + i));
+        __m128i a = LoadLeftSse2(pRow, i, nearLanes);
+        __m128i p = a;
+
+        if (pUp)
+        {
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pUp + i));
+            __m128i c = LoadLeftSse2(pUp, i, nearLanes);
+            __m128i nMin = _mm_min_epu8(a, b);
+            __m128i nMax = _mm_max_epu8(a, b);
+
+            // a + b - c lies between a and b whenever it is the prediction, so it cannot wrap
+            __m128i cAtMost = _mm_cmpeq_epi8(_mm_min_epu8(c, nMin), c);
+            __m128i cAtLeast = _mm_cmpeq_epi8(_mm_max_epu8(c, nMax), c);
+            p = _mm_sub_epi8(_mm_add_epi8(a, b), c);
+            p = _mm_or_si128(_mm_and_si128(cAtMost, nMax), _mm_andnot_si128(cAtMost, p));
+            p = _mm_or_si128(_mm_and_si128(cAtLeast, nMin), _mm_andnot_si128(cAtLeast, p));
+        }
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(pOut + i), ZigzagResidualsSse2(_mm_sub_epi8(x, p)));
+    }
+
+    return i;
+}
+
+/// <summary>
+/// Lossless temporal residuals of a row, 16 bytes at a time
+/// </summary>
+/// <returns>position of the first byte left for the scalar code</returns>
+static int CodeTemporalRowLosslessSse2(const BYTE* pRow, const BYTE* pPrevious, int nStride, BYTE* pOut)
+{
+    int i = 0;
+    for (; i + 16 <= nStride; i += 16)
+    {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pRow + i));
+        __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pPrevious + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(pOut + i), ZigzagResidualsSse2(_mm_sub_epi8(x, p)));
+    }
+    return i;
+}
+
+/// <summary>
+/// Decodes lossless temporal residuals in place over the previous frame, 16 bytes at a time
+/// </summary>
+/// <returns>position of the first byte left for the scalar code</returns>
+static int DecodeTemporalRowLosslessSse2(BYTE* pRow, int nStride, const BYTE* pIn)
+{
+    const __m128i ones = _mm_set1_epi8(1);
+    const __m128i low7 = _mm_set1_epi8(0x7F);
+    int i = 0;
+
+    for (; i + 16 <= nStride; i += 16)
+    {
+        __m128i z = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pIn + i));
+        __m128i half = _mm_and_si128(_mm_srli_epi16(z, 1), low7);
+        __m128i q = _mm_xor_si128(half, _mm_sub_epi8(_mm_setzero_si128(), _mm_and_si128(z, ones)));
+        __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pRow + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(pRow + i), _mm_add_epi8(p, q));
+    }
+
+    return i;
+}
+
+/// <summary>
+/// Sums of the absolute differences of the bytes of a row from the previous frame and
+/// from their left neighbours, from position 4 on, 16 bytes at a time
+/// </summary>
+/// <returns>position of the first byte left for the scalar code</returns>
+static int SumRowDifferencesSse2(const BYTE* pRow, const BYTE* pPrevious, int nStride, const int* pnDistances, UINT64* pnTemporal, UINT64* pnSpatial)
+{
+    __m128i nearLanes = GetNearLanesSse2(pnDistances);
+    __m128i temporal = _mm_setzero_si128();
+    __m128i spatial = _mm_setzero_si128();
+    int i = 4;
+
+    for (; i + 16 <= nStride; i += 16)
+    {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pRow + i));
+        temporal = _mm_add_epi64(temporal, _mm_sad_epu8(x, _mm_loadu_si128(reinterpret_cast<const __m128i*>(pPrevious + i))));
+        spatial = _mm_add_epi64(spatial, _mm_sad_epu8(x, LoadLeftSse2(pRow, i, nearLanes)));
+    }
+
+    UINT64 sums[2];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(sums), temporal);
+    *pnTemporal += sums[0] + sums[1];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(sums), spatial);
+    *pnSpatial += sums[0] + sums[1];
+
+    return i;
+}
+
+#endif
+
+/// <summary>
+/// Walks a row that has a row above it from its fifth byte on, predicting every byte
+/// from its reconstructed neighbours and storing what the reconstruction function makes
+/// of the prediction. The newest byte of every channel is carried in a register rather
+/// than read back from the row, which keeps the channels' dependency chains short; they
+/// overlap, as the channels of a group of four bytes are independent.
+/// </summary>
+/// <param name="colorFormat">ColorImageFormat_Yuy2 or ColorImageFormat_Bgra</param>
+/// <param name="pRecon">row being reconstructed, its first four bytes done</param>
+/// <param name="pUp">reconstructed row above</param>
+/// <param name="nStride">bytes per row</param>
+/// <param name="reconstruct">takes the position and prediction of a byte, returns the reconstructed byte</param>
+/// <returns>position of the first byte left, past the last whole group of four</returns>
+template <typename Reconstruct>
+static int ReconstructSpatialRow(ColorImageFormat colorFormat, BYTE* pRecon, const BYTE* pUp, int nStride, Reconstruct reconstruct)
+{
+    int i = 4;
+
+    if (ColorImageFormat_Yuy2 == colorFormat)
+    {
+        // Y0 U Y1 V: the lumas two bytes apart, the chromas four
+        int y = pRecon[2];
+        int u = pRecon[1];
+        int v = pRecon[3];
+        for (; i + 4 <= nStride; i += 4)
+        {
+            y = reconstruct(i, PredictMed(y, pUp[i], pUp[i - 2]));
+            u = reconstruct(i + 1, PredictMed(u, pUp[i + 1], pUp[i - 3]));
+            y = reconstruct(i + 2, PredictMed(y, pUp[i + 2], pUp[i]));
+            v = reconstruct(i + 3, PredictMed(v, pUp[i + 3], pUp[i - 1]));
+        }
+    }
+    else
+    {
+        int b = pRecon[0];
+        int g = pRecon[1];
+        int r = pRecon[2];
+        int a = pRecon[3];
+        for (; i + 4 <= nStride; i += 4)
+        {
+            b = reconstruct(i, PredictMed(b, pUp[i], pUp[i - 4]));
+            g = reconstruct(i + 1, PredictMed(g, pUp[i + 1], pUp[i - 3]));
+            r = reconstruct(i + 2, PredictMed(r, pUp[i + 2], pUp[i - 2]));
+            a = reconstruct(i + 3, PredictMed(a, pUp[i + 3], pUp[i - 1]));
+        }
+    }
+
+    return i;
+}
+
+/// <summary>
+/// Codes a row of a tile predicted from within the tile
+/// </summary>
+/// <param name="colorFormat">ColorImageFormat_Yuy2 or ColorImageFormat_Bgra</param>
+/// <param name="pRow">original row</param>
+/// <param name="pRecon">receives the row as the decoder will reconstruct it</param>
+/// <param name="pUp">reconstructed row above, or null for the first row of a tile</param>
+/// <param name="nStride">bytes per row</param>
+/// <param name="pnDistances">distances to the left neighbours, by position within a group of four</param>
+/// <param name="pQuantizer">quantizer for near-lossless coding, null for lossless</param>
+/// <param name="bSse2">whether the SSE2 kernel may be used</param>
+/// <param name="pOut">receives the zigzag coded residuals</param>
+static void CodeSpatialRow(ColorImageFormat colorFormat, const BYTE* pRow, BYTE* pRecon, const BYTE* pUp, int nStride,
+    const int* pnDistances, const ResidualQuantizer* pQuantizer, bool bSse2, BYTE* pOut)
+{
+    int i = 0;
+
+    if (pQuantizer)
+    {
+        for (; i < 4 && i < nStride; ++i)
+        {
+            pOut[i] = pQuantizer->Code(pRow[i], PredictSpatial(pRecon, pUp, i, pnDistances[i]), &pRecon[i]);
+        }
+
+        if (pUp && nStride >= 4)
+        {
+            i = ReconstructSpatialRow(colorFormat, pRecon, pUp, nStride, [&](int j, int p) -> int
+            {
+                pOut[j] = pQuantizer->Code(pRow[j], p, &pRecon[j]);
+                return pRecon[j];
+            });
+        }
+
+        for (; i < nStride; ++i)
+        {
+            pOut[i] = pQuantizer->Code(pRow[i], PredictSpatial(pRecon, pUp, i, pnDistances[i & 3]), &pRecon[i]);
+        }
+        return;
+    }
+
+    // lossless: the reconstruction is the original, so everything is predicted from it
+    const BYTE* pUpRow = pUp ? pRow - nStride : nullptr;
+
+    for (; i < 4 && i < nStride; ++i)
+    {
+        pOut[i] = ZigzagResidual(static_cast<signed char>(pRow[i] - PredictSpatial(pRow, pUpRow, i, pnDistances[i])));
+    }
+
+#if defined(CPU_X86)
+    if (bSse2 && nStride >= 20)
+    {
+        i = CodeSpatialRowLosslessSse2(pRow, pUpRow, nStride, pnDistances, pOut);
+    }
+#else
+    (void)bSse2;
+#endif
+
+    for (; i < nStride; ++i)
+    {
+        pOut[i] = ZigzagResidual(static_cast<signed char>(pRow[i] - PredictSpatial(pRow, pUpRow, i, pnDistances[i & 3])));
+    }
+
+    memcpy(pRecon, pRow, nStride);
+}
+
+/// <summary>
+/// Codes a row of a tile predicted from the previous frame
+/// </summary>
+/// <param name="pRow">original row</param>
+/// <param name="pRecon">the row of the previous frame as reconstructed; receives the row
+/// as the decoder will reconstruct it</param>
+/// <param name="nStride">bytes per row</param>
+/// <param name="pQuantizer">quantizer for near-lossless coding, null for lossless</param>
+/// <param name="bSse2">whether the SSE2 kernel may be used</param>
+/// <param name="pOut">receives the zigzag coded residuals</param>
+static void CodeTemporalRow(const BYTE* pRow, BYTE* pRecon, int nStride, const ResidualQuantizer* pQuantizer, bool bSse2, BYTE* pOut)
+{
+    if (pQuantizer)
+    {
+        for (int i = 0; i < nStride; ++i)
+        {
+            pOut[i] = pQuantizer->Code(pRow[i], pRecon[i], &pRecon[i]);
+        }
+        return;
+    }
+
+    int i = 0;
+#if defined(CPU_X86)
+    if (bSse2)
+    {
+        i = CodeTemporalRowLosslessSse2(pRow, pRecon, nStride, pOut);
+    }
+#else
+    (void)bSse2;
+#endif
+
+    for (; i < nStride; ++i)
+    {
+        pOut[i] = ZigzagResidual(static_cast<signed char>(pRow[i] - pRecon[i]));
+    }
+
+    memcpy(pRecon, pRow, nStride);
+}
+
+/// <summary>
+/// Decodes a row of a tile predicted from within the tile
+/// </summary>
+/// <param name="colorFormat">ColorImageFormat_Yuy2 or ColorImageFormat_Bgra</param>
+/// <param name="pRow">receives the row</param>
+/// <param name="pUp">decoded row above, or null for the first row of a tile</param>
+/// <param name="nStride">bytes per row</param>
+/// <param name="pnDistances">distances to the left neighbours, by position within a group of four</param>
+/// <param name="nMaxError">largest error allowed</param>
+/// <param name="pIn">zigzag coded residuals</param>
+static void DecodeSpatialRow(ColorImageFormat colorFormat, BYTE* pRow, const BYTE* pUp, int nStride, const int* pnDistances,
+    int nMaxError, const BYTE* pIn)
+{
+    int nStep = 2 * nMaxError + 1;
+    int i = 0;
+
+    for (; i < 4 && i < nStride; ++i)
+    {
+        int p = PredictSpatial(pRow, pUp, i, pnDistances[i]);
+        pRow[i] = (0 == nMaxError) ? static_cast<BYTE>(p + UnzigzagResidual(pIn[i])) : ReconstructNearLossless(pIn[i], p, nStep);
+    }
+
+    if (pUp && nStride >= 4 && 0 == nMaxError)
+    {
+        i = ReconstructSpatialRow(colorFormat, pRow, pUp, nStride, [&](int j, int p) -> int
+        {
+            BYTE x = static_cast<BYTE>(p + UnzigzagResidual(pIn[j]));
+            pRow[j] = x;
+            return x;
+        });
+    }
+    else if (pUp && nStride >= 4)
+    {
+        i = ReconstructSpatialRow(colorFormat, pRow, pUp, nStride, [&](int j, int p) -> int
+        {
+            BYTE x = ReconstructNearLossless(pIn[j], p, nStep);
+            pRow[j] = x;
+            return x;
+        });
+    }
+
+    for (; i < nStride; ++i)
+    {
+        int p = PredictSpatial(pRow, pUp, i, pnDistances[i & 3]);
+        pRow[i] = (0 == nMaxError) ? static_cast<BYTE>(p + UnzigzagResidual(pIn[i])) : ReconstructNearLossless(pIn[i], p, nStep);
+    }
+}
+
+/// <summary>
+/// Decodes a row of a tile predicted from the previous frame, in place over it
+/// </summary>
+/// <param name="pRow">the row of the previous frame; receives the row</param>
+/// <param name="nStride">bytes per row</param>
+/// <param name="nMaxError">largest error allowed</param>
+/// <param name="bSse2">whether the SSE2 kernel may be used</param>
+/// <param name="pIn">zigzag coded residuals</param>
+static void DecodeTemporalRow(BYTE* pRow, int nStride, int nMaxError, bool bSse2, const BYTE* pIn)
+{
+    int nStep = 2 * nMaxError + 1;
+    int i = 0;
+
+#if defined(CPU_X86)
+    if (bSse2 && 0 == nMaxError)
+    {
+        i = DecodeTemporalRowLosslessSse2(pRow, nStride, pIn);
+    }
+#else
+    (void)bSse2;
+#endif
+
+    for (; i < nStride; ++i)
+    {
+        pRow[i] = (0 == nMaxError) ? static_cast<BYTE>(pRow[i] + UnzigzagResidual(pIn[i])) : ReconstructNearLossless(pIn[i], pRow[i], nStep);
+    }
+}
+
+/// <summary>
+/// Bits needed for a value up to 255
+/// </summary>
+/// <param name="nValue">value</param>
+/// <returns>bits from 0 to 8</returns>
+static inline int GetBitWidth(int nValue)
+{
+    int nBits = 0;
+    while (nValue >> nBits)
+    {
+        ++nBits;
+    }
+    return nBits;
+}
+
+/// <summary>
+/// Packs a block of 16 residuals into twice as many bytes as their width, eight
+/// residuals to a group of bytes; the width is a constant so the shifts are too
+/// </summary>
+template <int nWidth>
+static inline void PackBlock(const BYTE* pBlock, BYTE* pOut)
+{
+    for (int iHalf = 0; iHalf < 2; ++iHalf)
+    {
+        UINT64 nBits = 0;
+        for (int j = 0; j < 8; ++j)
+        {
+            nBits |= static_cast<UINT64>(pBlock[iHalf * 8 + j]) << (j * nWidth);
+        }
+
+        memcpy(pOut + iHalf * nWidth, &nBits, nWidth);
+    }
+}
+
+/// <summary>
+/// Unpacks a block packed by PackBlock
+/// </summary>
+/// <param name="pIn">packed block</param>
+/// <param name="pBlock">receives the 16 residuals</param>
+/// <param name="bWholeWords">whether 16 bytes may be read from pIn, so that each group
+/// of bytes is read as one word whatever its width</param>
+template <int nWidth>
+static inline void UnpackBlock(const BYTE* pIn, BYTE* pBlock, bool bWholeWords)
+{
+    const UINT64 nMask = (static_cast<UINT64>(1) << nWidth) - 1;
+
+    for (int iHalf = 0; iHalf < 2; ++iHalf)
+    {
+        UINT64 nBits = 0;
+        if (bWholeWords)
+        {
+            memcpy(&nBits, pIn + iHalf * nWidth, sizeof(nBits));
+        }
+        else
+        {
+            memcpy(&nBits, pIn + iHalf * nWidth, nWidth);
+        }
+
+        for (int j = 0; j < 8; ++j)
+        {
+            pBlock[iHalf * 8 + j] = static_cast<BYTE>((nBits >> (j * nWidth)) & nMask);
+        }
+    }
+}
+
+/// <summary>
+/// Packs residuals: for every pair of blocks a byte holding the bit width of the first
+/// in its low half and of the second in its high half, then the 16 residuals of each
+/// block in that many bits, eight residuals to as many bytes as their width
+/// </summary>
+/// <param name="pResiduals">residuals, a multiple of c_BlockPairBytes of them</param>
+/// <param name="cbResiduals">number of residuals</param>
+/// <param name="pPacked">receives the packed residuals; needs room for 33 bytes per pair</param>
+/// <returns>bytes written</returns>
+static size_t PackResiduals(const BYTE* pResiduals, size_t cbResiduals, BYTE* pPacked)
+{
+    BYTE* pOut = pPacked;
+
+    for (size_t iPair = 0; iPair < cbResiduals; iPair += c_BlockPairBytes)
+    {
+        BYTE* pWidths = pOut++;
+        *pWidths = 0;
+
+        for (int iBlock = 0; iBlock < 2; ++iBlock)
+        {
+            const BYTE* pBlock = pResiduals + iPair + iBlock * c_FrameCodecBlockBytes;
+
+            int nAll = 0;
+            for (int j = 0; j < c_FrameCodecBlockBytes; ++j)
+            {
+                nAll |= pBlock[j];
+            }
+
+            int nWidth = GetBitWidth(nAll);
+            *pWidths |= static_cast<BYTE>(nWidth << (4 * iBlock));
+
+            switch (nWidth)
+            {
+            case 1: PackBlock<1>(pBlock, pOut); break;
+            case 2: PackBlock<2>(pBlock, pOut); break;
+            case 3: PackBlock<3>(pBlock, pOut); break;
+            case 4: PackBlock<4>(pBlock, pOut); break;
+            case 5: PackBlock<5>(pBlock, pOut); break;
+            case 6: PackBlock<6>(pBlock, pOut); break;
+            case 7: PackBlock<7>(pBlock, pOut); break;
+            case 8: memcpy(pOut, pBlock, c_FrameCodecBlockBytes); break;
+            default: break;
+            }
+
+            pOut += 2 * nWidth;
+        }
+    }
+
+    return pOut - pPacked;
+}
+
+/// <summary>
+/// Unpacks residuals packed by PackResiduals
+/// </summary>
+/// <param name="pPacked">packed residuals</param>
+/// <param name="cbPacked">size of the packed residuals</param>
+/// <param name="pResiduals">receives the residuals</param>
+/// <param name="cbResiduals">number of residuals, a multiple of c_BlockPairBytes</param>
+/// <returns>false if the packed residuals end too early</returns>
+static bool UnpackResiduals(const BYTE* pPacked, size_t cbPacked, BYTE* pResiduals, size_t cbResiduals)
+{
+    const BYTE* pIn = pPacked;
+    const BYTE* pEnd = pPacked + cbPacked;
+
+    for (size_t iPair = 0; iPair < cbResiduals; iPair += c_BlockPairBytes)
+    {
+        if (pIn >= pEnd)
+        {
+            return false;
+        }
+
+        int nWidths = *pIn++;
+
+        for (int iBlock = 0; iBlock < 2; ++iBlock)
+        {
+            BYTE* pBlock = pResiduals + iPair + iBlock * c_FrameCodecBlockBytes;
+            int nWidth = (nWidths >> (4 * iBlock)) & 0xF;
+
+            if (nWidth > 8 || pEnd - pIn < 2 * nWidth)
+            {
+                return false;
+            }
+
+            bool bWholeWords = pEnd - pIn >= 16;
+
+            switch (nWidth)
+            {
+            case 0: memset(pBlock, 0, c_FrameCodecBlockBytes); break;
+            case 1: UnpackBlock<1>(pIn, pBlock, bWholeWords); break;
+            case 2: UnpackBlock<2>(pIn, pBlock, bWholeWords); break;
+            case 3: UnpackBlock<3>(pIn, pBlock, bWholeWords); break;
+            case 4: UnpackBlock<4>(pIn, pBlock, bWholeWords); break;
+            case 5: UnpackBlock<5>(pIn, pBlock, bWholeWords); break;
+            case 6: UnpackBlock<6>(pIn, pBlock, bWholeWords); break;
+            case 7: UnpackBlock<7>(pIn, pBlock, bWholeWords); break;
+            default: memcpy(pBlock, pIn, c_FrameCodecBlockBytes); break;
+            }
+
+            pIn += 2 * nWidth;
+        }
+    }
+
+    return true;
+}
+
+/// <summary>
+/// Residual bytes of a tile, padded to a whole number of block pairs
+/// </summary>
+/// <param name="nRows">rows of the tile</param>
+/// <param name="nStride">bytes per row</param>
+/// <returns>padded size</returns>
+static size_t GetPaddedTileBytes(int nRows, int nStride)
+{
+    size_t cbTile = static_cast<size_t>(nRows) * nStride;
+    return (cbTile + c_BlockPairBytes - 1) / c_BlockPairBytes * c_BlockPairBytes;
+}
+
+/// <summary>
+/// Constructor; starts the threads
+/// </summary>
+/// <param name="nThreads">threads, the calling one included, or 0 for one per hardware thread</param>
+TileWorkers::TileWorkers(int nThreads) :
+    m_bStopping(false),
+    m_nGeneration(0),
+    m_pfnTask(nullptr),
+    m_pContext(nullptr),
+    m_nTiles(0),
+    m_nNextTile(0),
+    m_nRunning(0)
+{
+    if (nThreads <= 0)
+    {
+        nThreads = (std::max)(static_cast<int>(std::thread::hardware_concurrency()), 1);
+    }
+
+    for (int i = 1; i < nThreads; ++i)
+    {
+        m_threads.push_back(std::thread(&TileWorkers::WorkerThread, this, i));
+    }
+}
+
+/// <summary>
+/// Destructor; stops the threads
+/// </summary>
+TileWorkers::~TileWorkers()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_bStopping = true;
+    }
+
+    m_workReady.notify_all();
+
+    for (size_t i = 0; i < m_threads.size(); ++i)
+    {
+        m_threads[i].join();
+    }
+}
+
+/// <summary>
+/// Runs a task for every tile and returns once all of them are done
+/// </summary>
+/// <param name="nTiles">number of tiles</param>
+/// <param name="pfnTask">task run for every tile</param>
+/// <param name="pContext">passed to the task</param>
+void TileWorkers::Run(int nTiles, TileTask pfnTask, void* pContext)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pfnTask = pfnTask;
+        m_pContext = pContext;
+        m_nTiles = nTiles;
+        m_nNextTile.store(0);
+        m_nRunning = static_cast<int>(m_threads.size());
+        m_nGeneration++;
+    }
+
+    m_workReady.notify_all();
+
+    RunTiles(0);
+
+    // every thread is done with the run before the next one may change the task
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_workDone.wait(lock, [this]() { return 0 == m_nRunning; });
+}
+
+/// <summary>
+/// Takes part in every run until the workers are stopped
+/// </summary>
+/// <param name="iWorker">index of the thread</param>
+void TileWorkers::WorkerThread(int iWorker)
+{
+    UINT64 nGeneration = 0;
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    for (;;)
+    {
+        m_workReady.wait(lock, [this, nGeneration]() { return m_bStopping || m_nGeneration != nGeneration; });
+        if (m_bStopping)
+        {
+            break;
+        }
+
+        nGeneration = m_nGeneration;
+        lock.unlock();
+
+        RunTiles(iWorker);
+
+        lock.lock();
+        if (0 == --m_nRunning)
+        {
+            m_workDone.notify_one();
+        }
+    }
+}
+
+/// <summary>
+/// Takes tiles of the run in progress until none is left
+/// </summary>
+/// <param name="iWorker">index of the thread</param>
+void TileWorkers::RunTiles(int iWorker)
+{
+    int iTile;
+    while ((iTile = m_nNextTile.fetch_add(1)) < m_nTiles)
+    {
+        m_pfnTask(m_pContext, iTile, iWorker);
+    }
+}
+
+/// <summary>
+/// Constructor; starts the threads
+/// </summary>
+/// <param name="options">how frames are coded</param>
+FrameEncoder::FrameEncoder(const FrameCodecOptions& options) :
+    m_options(options),
+    m_workers(options.nThreads),
+    m_pQuantizer(nullptr),
+    m_colorFormat(ColorImageFormat_None),
+    m_nHeight(0),
+    m_nStride(0),
+    m_pPixels(nullptr),
+    m_bKeyFrame(true),
+    m_nSinceKeyFrame(-1),
+    m_cbTileCapacity(0),
+    m_residuals(m_workers.GetWorkerCount())
+{
+    memset(&m_stats, 0, sizeof(m_stats));
+
+    m_options.nMaxError = (std::min)((std::max)(m_options.nMaxError, 0), 127);
+    m_options.nKeyFrameInterval = (std::max)(m_options.nKeyFrameInterval, 1);
+    m_options.nTileRows = (std::max)(m_options.nTileRows, 1);
+
+    if (m_options.nMaxError > 0)
+    {
+        m_pQuantizer = new ResidualQuantizer(m_options.nMaxError);
+    }
+}
+
+/// <summary>
+/// Destructor; stops the threads
+/// </summary>
+FrameEncoder::~FrameEncoder()
+{
+    delete m_pQuantizer;
+}
+
+/// <summary>
+/// Encodes the next frame; frames must keep their format and size between key frames
+/// </summary>
+/// <param name="colorFormat">ColorImageFormat_Yuy2 or ColorImageFormat_Bgra</param>
+/// <param name="nHeight">rows of the frame</param>
+/// <param name="nStride">bytes from one row to the next</param>
+/// <param name="pPixels">the frame, nStride times nHeight bytes</param>
+/// <param name="ppEncoded">receives the encoded frame, valid until the next call</param>
+/// <param name="pcbEncoded">receives the size of the encoded frame</param>
+/// <returns>indicates success or failure; E_INVALIDARG for another format</returns>
+HRESULT FrameEncoder::Encode(ColorImageFormat colorFormat, int nHeight, int nStride, const BYTE* pPixels, const BYTE** ppEncoded, UINT* pcbEncoded)
+{
+    if ((ColorImageFormat_Yuy2 != colorFormat && ColorImageFormat_Bgra != colorFormat) ||
+        nHeight <= 0 || nStride <= 0 || nullptr == pPixels)
+    {
+        return E_INVALIDARG;
+    }
+
+    INT64 nStartNs = GetPerfClockNs();
+    size_t cbFrame = static_cast<size_t>(nStride) * nHeight;
+
+    // a change of layout starts over with a key frame
+    m_bKeyFrame = m_nSinceKeyFrame < 0 || m_nSinceKeyFrame + 1 >= m_options.nKeyFrameInterval ||
+        colorFormat != m_colorFormat || nStride != m_nStride || nHeight != m_nHeight;
+    m_nSinceKeyFrame = m_bKeyFrame ? 0 : m_nSinceKeyFrame + 1;
+
+    m_colorFormat = colorFormat;
+    m_nHeight = nHeight;
+    m_nStride = nStride;
+    m_pPixels = pPixels;
+    m_reference.resize(cbFrame);
+
+    // a frame shorter than a tile is one tile of its height, as the decoder expects
+    int nTileRows = (std::min)(m_options.nTileRows, nHeight);
+    int nTiles = (nHeight + nTileRows - 1) / nTileRows;
+    size_t cbResiduals = GetPaddedTileBytes(nTileRows, nStride);
+    size_t cbTable = sizeof(EncodedColorHeader) + nTiles * sizeof(UINT32);
+
+    m_cbTileCapacity = 1 + cbResiduals / c_BlockPairBytes * (c_BlockPairBytes + 1);
+    m_encoded.resize(cbTable + nTiles * m_cbTileCapacity);
+    m_tileSizes.resize(nTiles);
+    m_tileNs.resize(nTiles);
+    for (size_t i = 0; i < m_residuals.size(); ++i)
+    {
+        m_residuals[i].resize(cbResiduals);
+    }
+
+    m_workers.Run(nTiles, &FrameEncoder::EncodeTileTask, this);
+
+    EncodedColorHeader header = {0};
+    header.nVersion = c_FrameCodecVersion;
+    header.nFlags = m_bKeyFrame ? EncodedColor_KeyFrame : 0;
+    header.nMaxError = m_options.nMaxError;
+    header.nTileRows = nTileRows;
+    header.nTiles = nTiles;
+    header.cbDecoded = static_cast<UINT32>(cbFrame);
+    memcpy(&m_encoded[0], &header, sizeof(header));
+    memcpy(&m_encoded[sizeof(header)], &m_tileSizes[0], nTiles * sizeof(UINT32));
+
+    // the tiles were coded at their largest possible offsets; close the gaps
+    size_t cbEncoded = cbTable;
+    for (int i = 0; i < nTiles; ++i)
+    {
+        memmove(&m_encoded[cbEncoded], &m_encoded[cbTable + i * m_cbTileCapacity], m_tileSizes[i]);
+        cbEncoded += m_tileSizes[i];
+        m_stats.nTileNs += m_tileNs[i];
+    }
+
+    *ppEncoded = &m_encoded[0];
+    *pcbEncoded = static_cast<UINT>(cbEncoded);
+
+    m_stats.nFrames++;
+    m_stats.nKeyFrames += m_bKeyFrame ? 1 : 0;
+    m_stats.cbDecoded += cbFrame;
+    m_stats.cbEncoded += cbEncoded;
+    m_stats.nWallNs += GetPerfClockNs() - nStartNs;
+
+    return S_OK;
+}
+
+/// <summary>
+/// Encodes one tile: predicts every byte, from within the tile or from the previous
+/// frame, whichever the sampled rows suggest costs less, and packs the residuals
+/// </summary>
+/// <param name="pContext">the encoder</param>
+/// <param name="iTile">index of the tile</param>
+/// <param name="iWorker">index of the thread</param>
+void FrameEncoder::EncodeTileTask(void* pContext, int iTile, int iWorker)
+{
+    FrameEncoder* pThis = static_cast<FrameEncoder*>(pContext);
+    INT64 nStartNs = GetPerfClockNs();
+
+    int nStride = pThis->m_nStride;
+    int nFirstRow = iTile * pThis->m_options.nTileRows;
+    int nRows = (std::min)(pThis->m_options.nTileRows, pThis->m_nHeight - nFirstRow);
+    const ResidualQuantizer* pQuantizer = pThis->m_pQuantizer;
+    const BYTE* pPixels = pThis->m_pPixels + static_cast<size_t>(nFirstRow) * nStride;
+    BYTE* pReference = &pThis->m_reference[static_cast<size_t>(nFirstRow) * nStride];
+    BYTE* pResiduals = &pThis->m_residuals[iWorker][0];
+
+    bool bSse2 = CpuHasSse2();
+    int nDistances[4];
+    GetLeftDistances(pThis->m_colorFormat, nDistances);
+
+    TileMode mode = TileMode_Spatial;
+    if (!pThis->m_bKeyFrame)
+    {
+        // both residuals estimated from the original pixels of a few rows
+        UINT64 nTemporal = 0;
+        UINT64 nSpatial = 0;
+        for (int y = 0; y < nRows; y += c_ModeSampleRowStep)
+        {
+            const BYTE* pRow = pPixels + static_cast<size_t>(y) * nStride;
+            const BYTE* pOld = pReference + static_cast<size_t>(y) * nStride;
+            int i = 4;
+#if defined(CPU_X86)
+            if (bSse2)
+            {
+                i = SumRowDifferencesSse2(pRow, pOld, nStride, nDistances, &nTemporal, &nSpatial);
+            }
+#endif
+            for (; i < nStride; ++i)
+            {
+                nTemporal += abs(pRow[i] - pOld[i]);
+                nSpatial += abs(pRow[i] - pRow[i - nDistances[i & 3]]);
+            }
+        }
+
+        mode = (nTemporal <= nSpatial) ? TileMode_Temporal : TileMode_Spatial;
+    }
+
+    // the reference is overwritten in place with what the decoder will reconstruct
+    for (int y = 0; y < nRows; ++y)
+    {
+        const BYTE* pRow = pPixels + static_cast<size_t>(y) * nStride;
+        BYTE* pRecon = pReference + static_cast<size_t>(y) * nStride;
+        BYTE* pOut = pResiduals + static_cast<size_t>(y) * nStride;
+
+        if (TileMode_Temporal == mode)
+        {
+            CodeTemporalRow(pRow, pRecon, nStride, pQuantizer, bSse2, pOut);
+        }
+        else
+        {
+            CodeSpatialRow(pThis->m_colorFormat, pRow, pRecon, (y > 0) ? pRecon - nStride : nullptr, nStride, nDistances, pQuantizer, bSse2, pOut);
+        }
+    }
+
+    size_t cbResiduals = GetPaddedTileBytes(nRows, nStride);
+    memset(pResiduals + static_cast<size_t>(nRows) * nStride, 0, cbResiduals - static_cast<size_t>(nRows) * nStride);
+
+    size_t cbTableEnd = sizeof(EncodedColorHeader) + pThis->m_tileSizes.size() * sizeof(UINT32);
+    BYTE* pTile = &pThis->m_encoded[cbTableEnd + iTile * pThis->m_cbTileCapacity];
+    pTile[0] = static_cast<BYTE>(mode);
+
+    pThis->m_tileSizes[iTile] = static_cast<UINT32>(1 + PackResiduals(pResiduals, cbResiduals, pTile + 1));
+    pThis->m_tileNs[iTile] = GetPerfClockNs() - nStartNs;
+}
+
+/// <summary>
+/// Constructor; starts the threads
+/// </summary>
+/// <param name="nThreads">threads, the calling one included, or 0 for one per hardware thread</param>
+FrameDecoder::FrameDecoder(int nThreads) :
+    m_workers(nThreads),
+    m_colorFormat(ColorImageFormat_None),
+    m_nStride(0),
+    m_bHaveReference(false),
+    m_bDamaged(false),
+    m_residuals(m_workers.GetWorkerCount())
+{
+    memset(&m_stats, 0, sizeof(m_stats));
+    memset(&m_header, 0, sizeof(m_header));
+}
+
+/// <summary>
+/// Decodes the next frame; frames that are not key frames must follow the frame
+/// they were encoded after
+/// </summary>
+/// <param name="colorFormat">format the frame was encoded in</param>
+/// <param name="nHeight">rows of the frame</param>
+/// <param name="nStride">bytes from one row to the next</param>
+/// <param name="pEncoded">the encoded frame</param>
+/// <param name="cbEncoded">size of the encoded frame</param>
+/// <param name="ppPixels">receives the decoded frame, valid until the next call</param>
+/// <returns>indicates success or failure; E_FAIL for a damaged frame, E_UNEXPECTED for
+/// a frame that does not follow the frame it was encoded after</returns>
+HRESULT FrameDecoder::Decode(ColorImageFormat colorFormat, int nHeight, int nStride, const BYTE* pEncoded, UINT cbEncoded, const BYTE** ppPixels)
+{
+    if ((ColorImageFormat_Yuy2 != colorFormat && ColorImageFormat_Bgra != colorFormat) ||
+        nHeight <= 0 || nStride <= 0 || nullptr == pEncoded || cbEncoded < sizeof(EncodedColorHeader))
+    {
+        return E_INVALIDARG;
+    }
+
+    INT64 nStartNs = GetPerfClockNs();
+    EncodedColorHeader header;
+    memcpy(&header, pEncoded, sizeof(header));
+
+    // tiles taller than the frame are rejected before the tile count is worked out, which
+    // would wrap around for them
+    size_t cbFrame = static_cast<size_t>(nStride) * nHeight;
+    if (c_FrameCodecVersion != header.nVersion || cbFrame != header.cbDecoded || 0 == header.nTileRows ||
+        header.nTileRows > static_cast<UINT32>(nHeight) || header.nMaxError > 127 ||
+        header.nTiles != (static_cast<UINT32>(nHeight) + header.nTileRows - 1) / header.nTileRows ||
+        cbEncoded - sizeof(header) < header.nTiles * sizeof(UINT32))
+    {
+        return E_FAIL;
+    }
+
+    bool bKeyFrame = 0 != (header.nFlags & EncodedColor_KeyFrame);
+    if (!bKeyFrame && (!m_bHaveReference || colorFormat != m_colorFormat || nStride != m_nStride || cbFrame != m_pixels.size()))
+    {
+        return E_UNEXPECTED;
+    }
+
+    // the tiles follow their sizes back to back
+    m_tileSizes.resize(header.nTiles);
+    m_tiles.resize(header.nTiles);
+    m_tileNs.resize(header.nTiles);
+    memcpy(&m_tileSizes[0], pEncoded + sizeof(header), header.nTiles * sizeof(UINT32));
+
+    size_t nOffset = sizeof(header) + header.nTiles * sizeof(UINT32);
+    for (UINT32 i = 0; i < header.nTiles; ++i)
+    {
+        if (m_tileSizes[i] < 1 || m_tileSizes[i] > cbEncoded - nOffset)
+        {
+            m_bHaveReference = false;
+            return E_FAIL;
+        }
+
+        m_tiles[i] = pEncoded + nOffset;
+        nOffset += m_tileSizes[i];
+    }
+
+    m_header = header;
+    m_colorFormat = colorFormat;
+    m_nStride = nStride;
+    m_pixels.resize(cbFrame);
+    m_bDamaged.store(false);
+
+    size_t cbResiduals = GetPaddedTileBytes((std::min)(static_cast<int>(header.nTileRows), nHeight), nStride);
+    for (size_t i = 0; i < m_residuals.size(); ++i)
+    {
+        m_residuals[i].resize(cbResiduals);
+    }
+
+    m_workers.Run(static_cast<int>(header.nTiles), &FrameDecoder::DecodeTileTask, this);
+
+    // a damaged tile leaves nothing for the next frame to be predicted from
+    m_bHaveReference = !m_bDamaged.load();
+    if (!m_bHaveReference)
+    {
+        return E_FAIL;
+    }
+
+    for (UINT32 i = 0; i < header.nTiles; ++i)
+    {
+        m_stats.nTileNs += m_tileNs[i];
+    }
+
+    m_stats.nFrames++;
+    m_stats.nKeyFrames += bKeyFrame ? 1 : 0;
+    m_stats.cbDecoded += cbFrame;
+    m_stats.cbEncoded += cbEncoded;
+    m_stats.nWallNs += GetPerfClockNs() - nStartNs;
+
+    *ppPixels = &m_pixels[0];
+    return S_OK;
+}
+
+/// <summary>
+/// Decodes one tile in place over the same tile of the previous frame
+/// </summary>
+/// <param name="pContext">the decoder</param>
+/// <param name="iTile">index of the tile</param>
+/// <param name="iWorker">index of the thread</param>
+void FrameDecoder::DecodeTileTask(void* pContext, int iTile, int iWorker)
+{
+    FrameDecoder* pThis = static_cast<FrameDecoder*>(pContext);
+    INT64 nStartNs = GetPerfClockNs();
+
+    int nStride = pThis->m_nStride;
+    int nHeight = static_cast<int>(pThis->m_pixels.size() / nStride);
+    int nFirstRow = iTile * static_cast<int>(pThis->m_header.nTileRows);
+    int nRows = (std::min)(static_cast<int>(pThis->m_header.nTileRows), nHeight - nFirstRow);
+    int nMaxError = static_cast<int>(pThis->m_header.nMaxError);
+    const BYTE* pTile = pThis->m_tiles[iTile];
+    BYTE* pPixels = &pThis->m_pixels[static_cast<size_t>(nFirstRow) * nStride];
+    BYTE* pResiduals = &pThis->m_residuals[iWorker][0];
+
+    TileMode mode = static_cast<TileMode>(pTile[0]);
+    bool bKeyFrame = 0 != (pThis->m_header.nFlags & EncodedColor_KeyFrame);
+
+    if ((TileMode_Spatial != mode && TileMode_Temporal != mode) || (bKeyFrame && TileMode_Temporal == mode) ||
+        !UnpackResiduals(pTile + 1, pThis->m_tileSizes[iTile] - 1, pResiduals, GetPaddedTileBytes(nRows, nStride)))
+    {
+        pThis->m_bDamaged.store(true);
+        return;
+    }
+
+    bool bSse2 = CpuHasSse2();
+    int nDistances[4];
+    GetLeftDistances(pThis->m_colorFormat, nDistances);
+
+    for (int y = 0; y < nRows; ++y)
+    {
+        BYTE* pRow = pPixels + static_cast<size_t>(y) * nStride;
+        const BYTE* pIn = pResiduals + static_cast<size_t>(y) * nStride;
+
+        if (TileMode_Temporal == mode)
+        {
+            DecodeTemporalRow(pRow, nStride, nMaxError, bSse2, pIn);
+        }
+        else
+        {
+            DecodeSpatialRow(pThis->m_colorFormat, pRow, (y > 0) ? pRow - nStride : nullptr, nStride, nDistances, nMaxError, pIn);
+        }
+    }
+
+    pThis->m_tileNs[iTile] = GetPerfClockNs() - nStartNs;
+}
+
+/// <summary>
+/// Whether an encoded frame is a key frame, which decodes without the frame before it
+/// </summary>
+/// <param name="pEncoded">the encoded frame</param>
+/// <param name="cbEncoded">size of the encoded frame</param>
+/// <returns>true for a key frame</returns>
+bool IsEncodedKeyFrame(const BYTE* pEncoded, UINT cbEncoded)
+{
+    EncodedColorHeader header;
+    if (nullptr == pEncoded || cbEncoded < sizeof(header))
+    {
+        return false;
+    }
+
+    memcpy(&header, pEncoded, sizeof(header));
+    return 0 != (header.nFlags & EncodedColor_KeyFrame);
+}
@@ -0,0 +1,288 @@
+//------------------------------------------------------------------------------
+// <copyright file="FrameCodec.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Lossless or near-lossless codec for the color frames of a recording, in their native
+// YUY2 or BGRA layout. A frame is cut into bands of rows, the tiles, that are coded
+// independently of each other on a few threads. Every byte is predicted, from its left,
+// upper and upper left neighbours of the same channel within the tile (the median edge
+// detector of LOCO-I), or from the same byte of the previous frame; key frames, every
+// so many frames, only predict within the frame so that replay can start at them. The
+// prediction residuals of every block of 16 bytes are packed into as many bits as the
+// largest of them needs, so the static parts of the scene cost half a byte per block.
+//
+// With a maximum error above 0 the residuals are quantized as in JPEG-LS near-lossless
+// mode: no decoded byte is further than the maximum error from the original, and the
+// sensor noise of a still scene quantizes to nothing. The encoder predicts from what
+// the decoder will reconstruct, so errors never build up from frame to frame.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "KinectTypes.h"
+
+// Version of the encoded frame layout
+static const UINT32 c_FrameCodecVersion = 1;
+
+// Bytes whose residuals are packed together
+static const int c_FrameCodecBlockBytes = 16;
+
+// Defaults: rows per tile, frames from one key frame to the next, and the largest
+// error of near-lossless coding that leaves the faces as sharp as the sensor makes them
+static const int c_FrameCodecDefaultTileRows = 36;
+static const int c_FrameCodecDefaultKeyFrameInterval = 30;
+static const int c_FrameCodecNearLosslessMaxError = 2;
+
+enum EncodedColorFlags
+{
+    // The frame is coded without reference to the previous one
+    EncodedColor_KeyFrame   = 1
+};
+
+/// <summary>
+/// Start of an encoded frame; followed by the encoded size of every tile, as UINT32,
+/// then by the tiles in order
+/// </summary>
+struct EncodedColorHeader
+{
+    UINT32              nVersion;
+    UINT32              nFlags;
+
+    // Largest difference of a decoded byte from the original, 0 for lossless
+    UINT32              nMaxError;
+
+    // Rows per tile, the last one holding what is left, and the number of tiles
+    UINT32              nTileRows;
+    UINT32              nTiles;
+
+    // Size of the decoded frame, the stride times the height
+    UINT32              cbDecoded;
+    UINT32              nReserved[2];
+};
+
+static_assert(sizeof(EncodedColorHeader) == 32, "EncodedColorHeader layout is part of the file format");
+
+struct FrameCodecOptions
+{
+    // Largest difference of a decoded byte from the original, 0 for lossless
+    int                 nMaxError;
+
+    // Frames from one key frame to the next, 1 for key frames only
+    int                 nKeyFrameInterval;
+
+    // Rows per tile; fewer rows make more tiles to spread over the threads
+    int                 nTileRows;
+
+    // Threads coding tiles, the calling one included, or 0 for one per hardware thread
+    int                 nThreads;
+
+    FrameCodecOptions() :
+        nMaxError(0),
+        nKeyFrameInterval(c_FrameCodecDefaultKeyFrameInterval),
+        nTileRows(c_FrameCodecDefaultTileRows),
+        nThreads(0)
+    {
+    }
+};
+
+struct FrameCodecStats
+{
+    // Frames coded, and of those key frames
+    UINT64              nFrames;
+    UINT64              nKeyFrames;
+
+    // Bytes of the frames decoded and encoded
+    UINT64              cbDecoded;
+    UINT64              cbEncoded;
+
+    // Wall clock time coding took, and the time the threads spent coding tiles, in nanoseconds
+    INT64               nWallNs;
+    INT64               nTileNs;
+};
+
+// Runs the tiles of a frame on a fixed set of threads, the calling one among them
+class TileWorkers
+{
+public:
+    // Codes one tile; iWorker tells apart the threads running at once, from 0
+    typedef void (*TileTask)(void* pContext, int iTile, int iWorker);
+
+    /// <summary>
+    /// Constructor; starts the threads
+    /// </summary>
+    /// <param name="nThreads">threads, the calling one included, or 0 for one per hardware thread</param>
+    explicit TileWorkers(int nThreads);
+
+    /// <summary>
+    /// Destructor; stops the threads
+    /// </summary>
+    ~TileWorkers();
+
+    /// <summary>
+    /// Runs a task for every tile and returns once all of them are done
+    /// </summary>
+    /// <param name="nTiles">number of tiles</param>
+    /// <param name="pfnTask">task run for every tile</param>
+    /// <param name="pContext">passed to the task</param>
+    void Run(int nTiles, TileTask pfnTask, void* pContext);
+
+    /// <summary>
+    /// Threads running tiles, the calling one included
+    /// </summary>
+    int GetWorkerCount() const { return static_cast<int>(m_threads.size()) + 1; }
+
+private:
+    void WorkerThread(int iWorker);
+    void RunTiles(int iWorker);
+
+    std::vector<std::thread>    m_threads;
+    std::mutex                  m_mutex;
+    std::condition_variable     m_workReady;
+    std::condition_variable     m_workDone;
+    bool                        m_bStopping;
+
+    // Run in progress: its number, the task, the next tile to take and the threads still at it
+    UINT64                      m_nGeneration;
+    TileTask                    m_pfnTask;
+    void*                       m_pContext;
+    int                         m_nTiles;
+    std::atomic<int>            m_nNextTile;
+    int                         m_nRunning;
+};
+
+struct ResidualQuantizer;
+
+class FrameEncoder
+{
+public:
+    /// <summary>
+    /// Constructor; starts the threads
+    /// </summary>
+    /// <param name="options">how frames are coded</param>
+    explicit FrameEncoder(const FrameCodecOptions& options);
+
+    /// <summary>
+    /// Destructor; stops the threads
+    /// </summary>
+    ~FrameEncoder();
+
+    /// <summary>
+    /// Encodes the next frame; frames must keep their format and size between key frames
+    /// </summary>
+    /// <param name="colorFormat">ColorImageFormat_Yuy2 or ColorImageFormat_Bgra</param>
+    /// <param name="nHeight">rows of the frame</param>
+    /// <param name="nStride">bytes from one row to the next</param>
+    /// <param name="pPixels">the frame, nStride times nHeight bytes</param>
+    /// <param name="ppEncoded">receives the encoded frame, valid until the next call</param>
+    /// <param name="pcbEncoded">receives the size of the encoded frame</param>
+    /// <returns>indicates success or failure; E_INVALIDARG for another format</returns>
+    HRESULT Encode(ColorImageFormat colorFormat, int nHeight, int nStride, const BYTE* pPixels, const BYTE** ppEncoded, UINT* pcbEncoded);
+
+    /// <summary>
+    /// Makes the next frame a key frame
+    /// </summary>
+    void Reset() { m_nSinceKeyFrame = -1; }
+
+    /// <summary>
+    /// Counters since the encoder was created
+    /// </summary>
+    const FrameCodecStats& GetStats() const { return m_stats; }
+
+private:
+    static void EncodeTileTask(void* pContext, int iTile, int iWorker);
+
+    FrameCodecOptions           m_options;
+    TileWorkers                 m_workers;
+    FrameCodecStats             m_stats;
+
+    // Quantization of the residuals to the maximum error, shared by the tiles; null
+    // when frames are coded losslessly
+    ResidualQuantizer*          m_pQuantizer;
+
+    // Frame being encoded, and the frame as the decoder will reconstruct it, which the
+    // next frame is predicted from
+    ColorImageFormat            m_colorFormat;
+    int                         m_nHeight;
+    int                         m_nStride;
+    const BYTE*                 m_pPixels;
+    bool                        m_bKeyFrame;
+    int                         m_nSinceKeyFrame;
+    std::vector<BYTE>           m_reference;
+
+    // Encoded frame: header, tile sizes, then the tiles, each coded at its largest
+    // possible offset first and moved up once all are done
+    std::vector<BYTE>           m_encoded;
+    size_t                      m_cbTileCapacity;
+    std::vector<UINT32>         m_tileSizes;
+    std::vector<INT64>          m_tileNs;
+
+    // Residuals of the tile each thread is coding
+    std::vector<std::vector<BYTE> > m_residuals;
+};
+
+class FrameDecoder
+{
+public:
+    /// <summary>
+    /// Constructor; starts the threads
+    /// </summary>
+    /// <param name="nThreads">threads, the calling one included, or 0 for one per hardware thread</param>
+    explicit FrameDecoder(int nThreads);
+
+    /// <summary>
+    /// Decodes the next frame; frames that are not key frames must follow the frame
+    /// they were encoded after
+    /// </summary>
+    /// <param name="colorFormat">format the frame was encoded in</param>
+    /// <param name="nHeight">rows of the frame</param>
+    /// <param name="nStride">bytes from one row to the next</param>
+    /// <param name="pEncoded">the encoded frame</param>
+    /// <param name="cbEncoded">size of the encoded frame</param>
+    /// <param name="ppPixels">receives the decoded frame, valid until the next call</param>
+    /// <returns>indicates success or failure; E_FAIL for a damaged frame, E_UNEXPECTED for
+    /// a frame that does not follow the frame it was encoded after</returns>
+    HRESULT Decode(ColorImageFormat colorFormat, int nHeight, int nStride, const BYTE* pEncoded, UINT cbEncoded, const BYTE** ppPixels);
+
+    /// <summary>
+    /// Forgets the previous frame, so that only a key frame decodes next
+    /// </summary>
+    void Reset() { m_bHaveReference = false; }
+
+    /// <summary>
+    /// Counters since the decoder was created
+    /// </summary>
+    const FrameCodecStats& GetStats() const { return m_stats; }
+
+private:
+    static void DecodeTileTask(void* pContext, int iTile, int iWorker);
+
+    TileWorkers                 m_workers;
+    FrameCodecStats             m_stats;
+
+    // Frame being decoded, in place over the previous one
+    ColorImageFormat            m_colorFormat;
+    int                         m_nStride;
+    EncodedColorHeader          m_header;
+    std::vector<const BYTE*>    m_tiles;
+    std::vector<UINT32>         m_tileSizes;
+    std::vector<INT64>          m_tileNs;
+    std::vector<BYTE>           m_pixels;
+    bool                        m_bHaveReference;
+    std::atomic<bool>           m_bDamaged;
+
+    std::vector<std::vector<BYTE> > m_residuals;
+};
+
+/// <summary>
+/// Whether an encoded frame is a key frame, which decodes without the frame before it
+/// </summary>
+/// <param name="pEncoded">the encoded frame</param>
+/// <param name="cbEncoded">size of the encoded frame</param>
+/// <returns>true for a key frame</returns>
+bool IsEncodedKeyFrame(const BYTE* pEncoded, UINT cbEncoded);
@@ -0,0 +1,72 @@
+//------------------------------------------------------------------------------
+// <copyright file="FrameGeometry.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "KinectTypes.h"
+#include <string.h>
+#include "FrameGeometry.h"
+
+/// <summary>
+/// Short name of a preview resolution, as taken by ParsePreviewResolution
+/// </summary>
+/// <param name="resolution">resolution to name</param>
+const char* GetPreviewResolutionName(PreviewResolution resolution)
+{
+    static const char* c_szNames[PreviewResolution_Count] = { "full", "half" };
+    return (resolution >= 0 && resolution < PreviewResolution_Count) ? c_szNames[resolution] : "unknown";
+}
+
+/// <summary>
+/// Parses the name of a preview resolution
+/// </summary>
+/// <param name="szName">full or half</param>
+/// <param name="pResolution">receives the resolution</param>
+/// <returns>false for an unknown name</returns>
+bool ParsePreviewResolution(const char* szName, PreviewResolution* pResolution)
+{
+    for (int i = 0; i < PreviewResolution_Count; ++i)
+    {
+        if (0 == strcmp(szName, GetPreviewResolutionName(static_cast<PreviewResolution>(i))))
+        {
+            *pResolution = static_cast<PreviewResolution>(i);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/// <summary>
+/// Size of the preview of color frames of a size at a preview resolution
+/// </summary>
+/// <param name="nColorWidth">width (in pixels) of the color frames</param>
+/// <param name="nColorHeight">height (in pixels) of the color frames</param>
+/// <param name="resolution">resolution of the preview</param>
+/// <param name="pGeometry">receives the sizes</param>
+/// <returns>indicates success or failure; E_INVALIDARG for frames of an odd width, or
+/// for a half resolution preview of frames whose width is not a multiple of 4 or whose
+/// height is odd, which have no whole YUY2 macropixels at that resolution</returns>
+HRESULT GetFrameGeometry(int nColorWidth, int nColorHeight, PreviewResolution resolution, FrameGeometry* pGeometry)
+{
+    if (nColorWidth <= 0 || nColorHeight <= 0 || 0 != nColorWidth % 2 || resolution < 0 || resolution >= PreviewResolution_Count)
+    {
+        return E_INVALIDARG;
+    }
+
+    if (PreviewResolution_Half == resolution && (0 != nColorWidth % 4 || 0 != nColorHeight % 2))
+    {
+        return E_INVALIDARG;
+    }
+
+    int nShift = (PreviewResolution_Half == resolution) ? 1 : 0;
+
+    pGeometry->nColorWidth = nColorWidth;
+    pGeometry->nColorHeight = nColorHeight;
+    pGeometry->previewResolution = resolution;
+    pGeometry->nPreviewWidth = nColorWidth >> nShift;
+    pGeometry->nPreviewHeight = nColorHeight >> nShift;
+
+    return S_OK;
+}
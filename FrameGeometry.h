@@ -0,0 +1,72 @@
+//------------------------------------------------------------------------------
+// <copyright file="FrameGeometry.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Sizes of the color frames and of the background shown of them. Speaker regions are
+// always cropped from the color frames as acquired; the background shown while nobody
+// speaks can be converted and presented at half their width and height, a quarter of
+// the pixels. Frames need not be the sensor's size: the beam angle mapping and the
+// clamps of the speaker regions follow the size of every frame.
+
+#pragma once
+
+#include "KinectTypes.h"
+
+// Size of the color frames of the sensor, which the hand-fit pixel mapping was measured on
+static const int c_SensorColorWidth = 1920;
+static const int c_SensorColorHeight = 1080;
+
+// Size the background shown while nobody speaks is converted and presented at
+enum PreviewResolution
+{
+    // That of the color frames
+    PreviewResolution_Full = 0,
+
+    // Half their width and height; every pixel averages the 2x2 frame pixels under it
+    PreviewResolution_Half = 1,
+
+    PreviewResolution_Count = 2
+};
+
+/// <summary>
+/// Sizes, in pixels, of the color frames and of the background preview
+/// </summary>
+struct FrameGeometry
+{
+    // Color frames, which the speaker regions are cropped from
+    int                 nColorWidth;
+    int                 nColorHeight;
+
+    // Background shown while nobody speaks
+    PreviewResolution   previewResolution;
+    int                 nPreviewWidth;
+    int                 nPreviewHeight;
+};
+
+/// <summary>
+/// Short name of a preview resolution, as taken by ParsePreviewResolution
+/// </summary>
+/// <param name="resolution">resolution to name</param>
+const char* GetPreviewResolutionName(PreviewResolution resolution);
+
+/// <summary>
+/// Parses the name of a preview resolution
+/// </summary>
+/// <param name="szName">full or half</param>
+/// <param name="pResolution">receives the resolution</param>
+/// <returns>false for an unknown name</returns>
+bool ParsePreviewResolution(const char* szName, PreviewResolution* pResolution);
+
+/// <summary>
+/// Size of the preview of color frames of a size at a preview resolution
+/// </summary>
+/// <param name="nColorWidth">width (in pixels) of the color frames</param>
+/// <param name="nColorHeight">height (in pixels) of the color frames</param>
+/// <param name="resolution">resolution of the preview</param>
+/// <param name="pGeometry">receives the sizes</param>
+/// <returns>indicates success or failure; E_INVALIDARG for frames of an odd width, or
+/// for a half resolution preview of frames whose width is not a multiple of 4 or whose
+/// height is odd, which have no whole YUY2 macropixels at that resolution</returns>
+HRESULT GetFrameGeometry(int nColorWidth, int nColorHeight, PreviewResolution resolution, FrameGeometry* pGeometry);
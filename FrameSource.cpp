@@ -0,0 +1,530 @@
+//------------------------------------------------------------------------------
+// <copyright file="FrameSource.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "KinectTypes.h"
+#include <string.h>
+#include <chrono>
+#include "PerfClock.h"
+#include "AudioEnergy.h"
+#include "FrameSource.h"
+
+// Streams that come with every replayed or synthetic color frame
+static const UINT32 c_FrameStreams = FrameStream_Color | FrameStream_Body | FrameStream_Face;
+
+/// <summary>
+/// Constructor
+/// </summary>
+/// <param name="nTriggerStreams">streams that wake the consumer; the others are only
+/// collected and picked up by the next wake-up</param>
+FrameWakeup::FrameWakeup(UINT32 nTriggerStreams) :
+    m_pfnCallback(nullptr),
+    m_pCallbackContext(nullptr),
+    m_nTriggerStreams(nTriggerStreams),
+    m_nPending(0),
+    m_nTriggerTimeNs(0),
+    m_nSignals(0),
+    m_nWakeups(0)
+{
+}
+
+/// <summary>
+/// Sets a callback run whenever a wake-up is due
+/// </summary>
+/// <param name="pfnCallback">callback, or null for none</param>
+/// <param name="pContext">passed to the callback</param>
+void FrameWakeup::SetCallback(FrameWakeupCallback pfnCallback, void* pContext)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_pfnCallback = pfnCallback;
+    m_pCallbackContext = pContext;
+}
+
+/// <summary>
+/// Marks streams as having new data; called by the sources on any thread
+/// </summary>
+/// <param name="nStreams">combination of FrameStream values</param>
+void FrameWakeup::Signal(UINT32 nStreams)
+{
+    FrameWakeupCallback pfnCallback = nullptr;
+    void* pContext = nullptr;
+    bool bWake = false;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        // only the first trigger since the consumer last looked wakes it up
+        bWake = (0 != (nStreams & m_nTriggerStreams)) && (0 == (m_nPending & m_nTriggerStreams));
+        m_nPending |= nStreams;
+        m_nSignals++;
+
+        if (bWake)
+        {
+            m_nTriggerTimeNs = GetPerfClockNs();
+            m_nWakeups++;
+            pfnCallback = m_pfnCallback;
+            pContext = m_pCallbackContext;
+        }
+    }
+
+    if (bWake)
+    {
+        m_wakeup.notify_all();
+
+        if (pfnCallback)
+        {
+            pfnCallback(pContext);
+        }
+    }
+}
+
+/// <summary>
+/// Blocks until a trigger stream is pending or the timeout elapses
+/// </summary>
+/// <param name="nTimeoutMs">longest time to wait, in milliseconds</param>
+/// <returns>true if a trigger stream is pending</returns>
+bool FrameWakeup::Wait(int nTimeoutMs)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    return m_wakeup.wait_for(lock, std::chrono::milliseconds(nTimeoutMs),
+        [this]() { return 0 != (m_nPending & m_nTriggerStreams); });
+}
+
+/// <summary>
+/// Takes and clears the pending streams without blocking
+/// </summary>
+/// <param name="pnTriggerTimeNs">optional; receives the time of the signal that made the
+/// wake-up due, or 0 if none is pending</param>
+/// <returns>the pending streams</returns>
+UINT32 FrameWakeup::TakePending(INT64* pnTriggerTimeNs)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    UINT32 nPending = m_nPending;
+    if (pnTriggerTimeNs)
+    {
+        *pnTriggerTimeNs = (0 != (nPending & m_nTriggerStreams)) ? m_nTriggerTimeNs : 0;
+    }
+
+    m_nPending = 0;
+    return nPending;
+}
+
+/// <summary>
+/// Snapshot of the wake-up counters
+/// </summary>
+/// <param name="pStats">receives the counters</param>
+void FrameWakeup::GetStats(FrameWakeupStats* pStats) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    pStats->nSignals = m_nSignals;
+    pStats->nWakeups = m_nWakeups;
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+ReplayFrameSource::ReplayFrameSource() :
+    m_pacing(ReplayPacing_MaxSpeed),
+    m_pWakeup(nullptr),
+    m_pLatencyMonitor(nullptr),
+    m_bStopping(false),
+    m_bColorStable(false),
+    m_bPublished(false),
+    m_bEnded(false),
+    m_hrEnded(S_FALSE),
+    m_nFramesPublished(0),
+    m_nFramesDropped(0)
+{
+    ResetSessionFrame(&m_publishedFrame);
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+ReplayFrameSource::~ReplayFrameSource()
+{
+    Stop();
+}
+
+/// <summary>
+/// Opens a recording for replay
+/// </summary>
+/// <param name="szPath">path of the recording</param>
+/// <param name="pacing">real time pacing drops the frames the consumer is too slow for;
+/// maximum speed waits for the consumer instead</param>
+/// <returns>indicates success or failure</returns>
+HRESULT ReplayFrameSource::Open(const char* szPath, ReplayPacing pacing)
+{
+    if (m_thread.joinable())
+    {
+        return E_UNEXPECTED;
+    }
+
+    // the read thread does the pacing itself, so that Stop never waits out a gap in the recording
+    m_pacing = pacing;
+    HRESULT hr = m_source.Open(szPath, ReplayPacing_MaxSpeed);
+    m_bColorStable = SUCCEEDED(hr) && m_source.IsColorStable();
+
+    return hr;
+}
+
+/// <summary>
+/// Makes the replay start from the last frame recorded at or before a time; call it
+/// before Start
+/// </summary>
+/// <param name="nTime">RelativeTime in 100ns ticks</param>
+/// <returns>indicates success or failure; E_NOTIMPL if the recording is not mapped</returns>
+HRESULT ReplayFrameSource::Seek(INT64 nTime)
+{
+    if (m_thread.joinable())
+    {
+        return E_UNEXPECTED;
+    }
+
+    return m_source.Seek(nTime);
+}
+
+/// <summary>
+/// Starts the read thread
+/// </summary>
+/// <param name="pWakeup">wake-up signalled for every published frame</param>
+/// <returns>indicates success or failure</returns>
+HRESULT ReplayFrameSource::Start(FrameWakeup* pWakeup)
+{
+    if (nullptr == pWakeup)
+    {
+        return E_INVALIDARG;
+    }
+
+    if (m_thread.joinable())
+    {
+        return E_UNEXPECTED;
+    }
+
+    m_pWakeup = pWakeup;
+    m_bStopping = false;
+    m_thread = std::thread(&ReplayFrameSource::ReadThread, this);
+
+    return S_OK;
+}
+
+/// <summary>
+/// Stops the read thread and waits for it to exit
+/// </summary>
+void ReplayFrameSource::Stop()
+{
+    if (m_thread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_bStopping = true;
+        }
+        m_stateChanged.notify_all();
+        m_thread.join();
+    }
+}
+
+/// <summary>
+/// Takes the latest published frame without blocking
+/// </summary>
+/// <param name="pFrame">receives the frame; its color buffer stays valid until the next call</param>
+/// <param name="pAudio">receives the audio recorded since the previously taken frame</param>
+/// <returns>S_OK for a new frame, E_PENDING if there is none yet, S_FALSE at the end of
+/// the recording, else the failure code</returns>
+HRESULT ReplayFrameSource::AcquireFrame(SessionFrame* pFrame, std::vector<AudioChunk>* pAudio)
+{
+    INT64 nStartNs = GetPerfClockNs();
+    pAudio->clear();
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (!m_bPublished)
+        {
+            return m_bEnded ? m_hrEnded : E_PENDING;
+        }
+
+        // the buffers are swapped rather than copied; the read thread fills the other one
+        *pFrame = m_publishedFrame;
+        m_acquiredColor.swap(m_publishedColor);
+        pAudio->swap(m_publishedAudio);
+        m_bPublished = false;
+    }
+
+    m_stateChanged.notify_all();
+
+    if (!m_bColorStable)
+    {
+        pFrame->pColorBuffer = m_acquiredColor.empty() ? nullptr : &m_acquiredColor[0];
+    }
+
+    if (m_pLatencyMonitor)
+    {
+        m_pLatencyMonitor->Record(LatencyMetric_ColorAcquire, GetPerfClockNs() - nStartNs);
+    }
+
+    return S_OK;
+}
+
+/// <summary>
+/// Snapshot of the source counters
+/// </summary>
+/// <param name="pStats">receives the counters</param>
+void ReplayFrameSource::GetStats(FrameSourceStats* pStats) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    pStats->nFramesPublished = m_nFramesPublished;
+    pStats->nFramesDropped = m_nFramesDropped;
+}
+
+/// <summary>
+/// Reads the recording ahead of the consumer, publishing every frame when it is due
+/// </summary>
+void ReplayFrameSource::ReadThread()
+{
+    SessionFrame frame;
+    std::vector<AudioChunk> audio;
+    std::vector<BYTE> color;
+    INT64 nFirstFrameTime = 0;
+    INT64 nStartNs = 0;
+    bool bStarted = false;
+    HRESULT hr;
+
+    while (S_OK == (hr = m_source.ReadNextFrame(&frame, &audio)))
+    {
+        // the reader's buffer is only valid until its next read, unless it is the mapping
+        if (!m_bColorStable)
+        {
+            color.assign(frame.pColorBuffer, frame.pColorBuffer + (frame.pColorBuffer ? frame.cbColorBuffer : 0));
+        }
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        if (!bStarted)
+        {
+            nFirstFrameTime = frame.nTime;
+            nStartNs = GetPerfClockNs();
+            bStarted = true;
+        }
+        else if (ReplayPacing_RealTime == m_pacing)
+        {
+            std::chrono::steady_clock::time_point due = std::chrono::steady_clock::now() +
+                std::chrono::nanoseconds(nStartNs + (frame.nTime - nFirstFrameTime) * 100 - GetPerfClockNs());
+            m_stateChanged.wait_until(lock, due, [this]() { return m_bStopping; });
+        }
+        else
+        {
+            // at maximum speed every frame is delivered, at the pace of the consumer
+            m_stateChanged.wait(lock, [this]() { return m_bStopping || !m_bPublished; });
+        }
+
+        if (m_bStopping)
+        {
+            return;
+        }
+
+        if (m_bPublished)
+        {
+            // the consumer fell behind; it gets the newer frame along with all the audio
+            m_nFramesDropped++;
+            m_publishedAudio.insert(m_publishedAudio.end(), audio.begin(), audio.end());
+        }
+        else
+        {
+            m_publishedAudio.swap(audio);
+        }
+
+        m_publishedFrame = frame;
+        m_publishedColor.swap(color);
+        m_bPublished = true;
+        m_nFramesPublished++;
+        audio.clear();
+        lock.unlock();
+
+        m_pWakeup->Signal(c_FrameStreams | FrameStream_Audio);
+    }
+
+    {
+        // the last frame is taken first; signalled along with it, the end would be
+        // coalesced into the wake-up for that frame and go unnoticed
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_stateChanged.wait(lock, [this]() { return m_bStopping || !m_bPublished; });
+        m_bEnded = true;
+        m_hrEnded = hr;
+    }
+
+    // wake the consumer so that it learns about the end
+    m_pWakeup->Signal(FrameStream_Color);
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+/// <param name="nWidth">width (in pixels) of the frames</param>
+/// <param name="nHeight">height (in pixels) of the frames</param>
+/// <param name="nFrameIntervalUs">time between frames, in microseconds</param>
+/// <param name="nAudioIntervalUs">time between audio chunks, in microseconds</param>
+SyntheticFrameSource::SyntheticFrameSource(int nWidth, int nHeight, int nFrameIntervalUs, int nAudioIntervalUs) :
+    m_nWidth(nWidth),
+    m_nHeight(nHeight),
+    m_nFrameIntervalUs(nFrameIntervalUs),
+    m_nAudioIntervalUs(nAudioIntervalUs),
+    m_color(static_cast<size_t>(nWidth) * nHeight * sizeof(RGBQUAD), 0x80),
+    m_pWakeup(nullptr),
+    m_bStopping(false),
+    m_bPublished(false),
+    m_nPublishedTime(0),
+    m_nFramesPublished(0),
+    m_nFramesDropped(0)
+{
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+SyntheticFrameSource::~SyntheticFrameSource()
+{
+    Stop();
+}
+
+/// <summary>
+/// Starts the timer thread
+/// </summary>
+/// <param name="pWakeup">wake-up signalled for every frame and audio chunk</param>
+/// <returns>indicates success or failure</returns>
+HRESULT SyntheticFrameSource::Start(FrameWakeup* pWakeup)
+{
+    if (nullptr == pWakeup || m_nFrameIntervalUs <= 0 || m_nAudioIntervalUs <= 0)
+    {
+        return E_INVALIDARG;
+    }
+
+    if (m_thread.joinable())
+    {
+        return E_UNEXPECTED;
+    }
+
+    m_pWakeup = pWakeup;
+    m_bStopping = false;
+    m_thread = std::thread(&SyntheticFrameSource::TimerThread, this);
+
+    return S_OK;
+}
+
+/// <summary>
+/// Stops the timer thread and waits for it to exit
+/// </summary>
+void SyntheticFrameSource::Stop()
+{
+    if (m_thread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_bStopping = true;
+        }
+        m_stopping.notify_all();
+        m_thread.join();
+    }
+}
+
+/// <summary>
+/// Takes the latest frame without blocking
+/// </summary>
+/// <param name="pFrame">receives the frame; its time is the GetPerfClockTicks time it was published at</param>
+/// <param name="pAudio">receives the audio published since the previously taken frame</param>
+/// <returns>S_OK for a new frame, else E_PENDING</returns>
+HRESULT SyntheticFrameSource::AcquireFrame(SessionFrame* pFrame, std::vector<AudioChunk>* pAudio)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    pAudio->clear();
+    if (!m_bPublished)
+    {
+        return E_PENDING;
+    }
+
+    ResetSessionFrame(pFrame);
+    pFrame->nTime = m_nPublishedTime;
+    pFrame->colorFormat = ColorImageFormat_Bgra;
+    pFrame->nColorWidth = m_nWidth;
+    pFrame->nColorHeight = m_nHeight;
+    pFrame->nColorStride = m_nWidth * sizeof(RGBQUAD);
+    pFrame->pColorBuffer = m_color.empty() ? nullptr : &m_color[0];
+    pFrame->cbColorBuffer = static_cast<UINT>(m_color.size());
+    pFrame->bHaveBodyData = true;
+    pFrame->bHaveFaceData = true;
+
+    pAudio->swap(m_publishedAudio);
+    m_bPublished = false;
+
+    return S_OK;
+}
+
+/// <summary>
+/// Snapshot of the source counters
+/// </summary>
+/// <param name="pStats">receives the counters</param>
+void SyntheticFrameSource::GetStats(FrameSourceStats* pStats) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    pStats->nFramesPublished = m_nFramesPublished;
+    pStats->nFramesDropped = m_nFramesDropped;
+}
+
+/// <summary>
+/// Publishes frames and audio chunks on schedule, each from the same timer
+/// </summary>
+void SyntheticFrameSource::TimerThread()
+{
+    std::chrono::steady_clock::time_point nextFrame = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point nextAudio = nextFrame;
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while (!m_bStopping)
+    {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        UINT32 nStreams = 0;
+
+        if (now >= nextAudio)
+        {
+            AudioChunk chunk;
+            chunk.nTime = GetPerfClockTicks();
+            chunk.fBeamAngle = 0.0f;
+            chunk.fBeamAngleConfidence = 0.0f;
+            chunk.samples.assign(static_cast<size_t>(c_AudioSamplesPerSecond) * m_nAudioIntervalUs / 1000000, 0.0f);
+            m_publishedAudio.push_back(chunk);
+
+            nextAudio += std::chrono::microseconds(m_nAudioIntervalUs);
+            nStreams |= FrameStream_Audio;
+        }
+
+        if (now >= nextFrame)
+        {
+            if (m_bPublished)
+            {
+                m_nFramesDropped++;
+            }
+
+            m_nPublishedTime = GetPerfClockTicks();
+            m_bPublished = true;
+            m_nFramesPublished++;
+
+            nextFrame += std::chrono::microseconds(m_nFrameIntervalUs);
+            nStreams |= c_FrameStreams;
+        }
+
+        if (0 != nStreams)
+        {
+            lock.unlock();
+            m_pWakeup->Signal(nStreams);
+            lock.lock();
+            continue;
+        }
+
+        m_stopping.wait_until(lock, (nextFrame < nextAudio) ? nextFrame : nextAudio, [this]() { return m_bStopping; });
+    }
+}
@@ -0,0 +1,341 @@
+//------------------------------------------------------------------------------
+// <copyright file="FrameSource.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Event driven frame acquisition. A frame source signals a FrameWakeup whenever one of
+// its streams has new data; the consumer sleeps on the wake-up, or is notified through
+// a callback, and then takes the latest frame from the source. Signals that arrive
+// while the consumer has not yet woken up are coalesced into a single wake-up.
+
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "KinectTypes.h"
+#include "LatencyHistogram.h"
+#include "SessionRecording.h"
+
+// Streams a source can signal; any combination may be pending at once
+enum FrameStream
+{
+    FrameStream_Color   = 0x1,
+    FrameStream_Body    = 0x2,
+    FrameStream_Face    = 0x4,
+    FrameStream_Audio   = 0x8
+};
+
+// Called on the signalling thread when a wake-up is due
+typedef void (*FrameWakeupCallback)(void* pContext);
+
+struct FrameWakeupStats
+{
+    // Signals received from the sources, of any stream
+    UINT64              nSignals;
+
+    // Wake-ups delivered to the consumer; every other signal was coalesced into one of them
+    UINT64              nWakeups;
+};
+
+class FrameWakeup
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    /// <param name="nTriggerStreams">streams that wake the consumer; the others are only
+    /// collected and picked up by the next wake-up</param>
+    explicit FrameWakeup(UINT32 nTriggerStreams);
+
+    /// <summary>
+    /// Sets a callback run whenever a wake-up is due, e.g. to post a window message;
+    /// must be set before any source is started
+    /// </summary>
+    /// <param name="pfnCallback">callback, or null for none</param>
+    /// <param name="pContext">passed to the callback</param>
+    void SetCallback(FrameWakeupCallback pfnCallback, void* pContext);
+
+    /// <summary>
+    /// Marks streams as having new data; called by the sources on any thread
+    /// </summary>
+    /// <param name="nStreams">combination of FrameStream values</param>
+    void Signal(UINT32 nStreams);
+
+    /// <summary>
+    /// Blocks until a trigger stream is pending or the timeout elapses
+    /// </summary>
+    /// <param name="nTimeoutMs">longest time to wait, in milliseconds</param>
+    /// <returns>true if a trigger stream is pending</returns>
+    bool Wait(int nTimeoutMs);
+
+    /// <summary>
+    /// Takes and clears the pending streams without blocking
+    /// </summary>
+    /// <param name="pnTriggerTimeNs">optional; receives the GetPerfClockNs time of the
+    /// signal that made the wake-up due, or 0 if none is pending</param>
+    /// <returns>the pending streams</returns>
+    UINT32 TakePending(INT64* pnTriggerTimeNs);
+
+    /// <summary>
+    /// Snapshot of the wake-up counters
+    /// </summary>
+    /// <param name="pStats">receives the counters</param>
+    void GetStats(FrameWakeupStats* pStats) const;
+
+private:
+    mutable std::mutex      m_mutex;
+    std::condition_variable m_wakeup;
+    FrameWakeupCallback     m_pfnCallback;
+    void*                   m_pCallbackContext;
+    UINT32                  m_nTriggerStreams;
+    UINT32                  m_nPending;
+    INT64                   m_nTriggerTimeNs;
+    UINT64                  m_nSignals;
+    UINT64                  m_nWakeups;
+};
+
+/// <summary>
+/// Source of color frames with their body, face and audio data
+/// </summary>
+class IFrameSource
+{
+public:
+    virtual ~IFrameSource() {}
+
+    /// <summary>
+    /// Starts signalling new data to a wake-up
+    /// </summary>
+    /// <param name="pWakeup">wake-up to signal; must outlive the source or the next Stop</param>
+    /// <returns>indicates success or failure</returns>
+    virtual HRESULT Start(FrameWakeup* pWakeup) = 0;
+
+    /// <summary>
+    /// Stops signalling and waits for any thread of the source to exit
+    /// </summary>
+    virtual void Stop() = 0;
+
+    /// <summary>
+    /// Takes the latest frame without blocking. Sources that pay for every stream they
+    /// read may leave the color, body and face data out until CompleteFrame asks for them.
+    /// </summary>
+    /// <param name="pFrame">receives the frame; its color buffer stays valid until the next call</param>
+    /// <param name="pAudio">receives the audio chunks preceding the frame that were not
+    /// captured elsewhere</param>
+    /// <returns>S_OK for a new frame, E_PENDING if there is none yet, S_FALSE once the
+    /// source has ended, else the failure code</returns>
+    virtual HRESULT AcquireFrame(SessionFrame* pFrame, std::vector<AudioChunk>* pAudio) = 0;
+
+    /// <summary>
+    /// Fills in the streams of the frame taken last that its consumer is going to use;
+    /// what could not be had is left out. Sources that fill in every stream on
+    /// acquisition ignore it.
+    /// </summary>
+    /// <param name="pFrame">frame taken last</param>
+    /// <param name="nStreams">combination of FrameStream_Color, FrameStream_Body and FrameStream_Face</param>
+    virtual void CompleteFrame(SessionFrame* pFrame, UINT32 nStreams)
+    {
+        UNREFERENCED_PARAMETER(pFrame);
+        UNREFERENCED_PARAMETER(nStreams);
+    }
+
+    /// <summary>
+    /// Sets where the source records the time its acquisition steps take; must be set
+    /// before the source is started. Sources that have no steps worth timing ignore it.
+    /// </summary>
+    /// <param name="pMonitor">monitor to record into, or null for none; must outlive the source</param>
+    virtual void SetLatencyMonitor(LatencyMonitor* pMonitor) { UNREFERENCED_PARAMETER(pMonitor); }
+};
+
+struct FrameSourceStats
+{
+    // Frames made available to the consumer
+    UINT64              nFramesPublished;
+
+    // Frames replaced by a newer one before the consumer took them
+    UINT64              nFramesDropped;
+};
+
+/// <summary>
+/// Replays a recording from its own thread, publishing every frame when it is due
+/// </summary>
+class ReplayFrameSource : public IFrameSource
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    ReplayFrameSource();
+
+    /// <summary>
+    /// Destructor
+    /// </summary>
+    virtual ~ReplayFrameSource();
+
+    /// <summary>
+    /// Opens a recording for replay
+    /// </summary>
+    /// <param name="szPath">path of the recording</param>
+    /// <param name="pacing">real time pacing drops the frames the consumer is too slow
+    /// for; maximum speed waits for the consumer instead</param>
+    /// <returns>indicates success or failure</returns>
+    HRESULT Open(const char* szPath, ReplayPacing pacing);
+
+    /// <summary>
+    /// Makes the replay start from the last frame recorded at or before a time; call it
+    /// before Start
+    /// </summary>
+    /// <param name="nTime">RelativeTime in 100ns ticks</param>
+    /// <returns>indicates success or failure; E_NOTIMPL if the recording is not mapped</returns>
+    HRESULT Seek(INT64 nTime);
+
+    /// <summary>
+    /// Sets the threads decoding encoded color, the read thread included, or 0 for one
+    /// per hardware thread; call it before Start
+    /// </summary>
+    /// <param name="nThreads">threads decoding the color</param>
+    void SetDecodeThreads(int nThreads) { m_source.SetDecodeThreads(nThreads); }
+
+    /// <summary>
+    /// Header of the recording being replayed
+    /// </summary>
+    const SessionFileHeader& GetHeader() const { return m_source.GetHeader(); }
+
+    /// <summary>
+    /// Starts the read thread
+    /// </summary>
+    /// <param name="pWakeup">wake-up signalled for every published frame</param>
+    /// <returns>indicates success or failure</returns>
+    virtual HRESULT Start(FrameWakeup* pWakeup);
+
+    /// <summary>
+    /// Stops the read thread and waits for it to exit
+    /// </summary>
+    virtual void Stop();
+
+    /// <summary>
+    /// Takes the latest published frame without blocking
+    /// </summary>
+    /// <param name="pFrame">receives the frame; its color buffer stays valid until the next call</param>
+    /// <param name="pAudio">receives the audio recorded since the previously taken frame</param>
+    /// <returns>S_OK for a new frame, E_PENDING if there is none yet, S_FALSE at the end of
+    /// the recording, else the failure code</returns>
+    virtual HRESULT AcquireFrame(SessionFrame* pFrame, std::vector<AudioChunk>* pAudio);
+
+    /// <summary>
+    /// Sets where the time taking a frame takes is recorded, as the color acquisition
+    /// </summary>
+    /// <param name="pMonitor">monitor to record into, or null for none</param>
+    virtual void SetLatencyMonitor(LatencyMonitor* pMonitor) { m_pLatencyMonitor = pMonitor; }
+
+    /// <summary>
+    /// Snapshot of the source counters
+    /// </summary>
+    /// <param name="pStats">receives the counters</param>
+    void GetStats(FrameSourceStats* pStats) const;
+
+private:
+    void ReadThread();
+
+    SessionReplaySource     m_source;
+    ReplayPacing            m_pacing;
+    FrameWakeup*            m_pWakeup;
+    LatencyMonitor*         m_pLatencyMonitor;
+
+    std::thread             m_thread;
+    mutable std::mutex      m_mutex;
+    std::condition_variable m_stateChanged;
+    bool                    m_bStopping;
+
+    // Whether the color the source reads stays valid until it is closed, as that of a
+    // mapped recording does; else every frame is published with a copy of its color
+    bool                    m_bColorStable;
+
+    // Frame published by the read thread and not yet taken, with its own copy of the color
+    bool                    m_bPublished;
+    SessionFrame            m_publishedFrame;
+    std::vector<BYTE>       m_publishedColor;
+    std::vector<AudioChunk> m_publishedAudio;
+
+    // Color of the frame the consumer took last
+    std::vector<BYTE>       m_acquiredColor;
+
+    // Result the read thread ended with, S_FALSE at the end of the recording
+    bool                    m_bEnded;
+    HRESULT                 m_hrEnded;
+
+    UINT64                  m_nFramesPublished;
+    UINT64                  m_nFramesDropped;
+};
+
+/// <summary>
+/// Publishes frames of a fixed gray BGRA image, and silent audio, on a timer; stands in
+/// for the sensor when measuring the acquisition loop
+/// </summary>
+class SyntheticFrameSource : public IFrameSource
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    /// <param name="nWidth">width (in pixels) of the frames</param>
+    /// <param name="nHeight">height (in pixels) of the frames</param>
+    /// <param name="nFrameIntervalUs">time between frames, in microseconds</param>
+    /// <param name="nAudioIntervalUs">time between audio chunks, in microseconds</param>
+    SyntheticFrameSource(int nWidth, int nHeight, int nFrameIntervalUs, int nAudioIntervalUs);
+
+    /// <summary>
+    /// Destructor
+    /// </summary>
+    virtual ~SyntheticFrameSource();
+
+    /// <summary>
+    /// Starts the timer thread
+    /// </summary>
+    /// <param name="pWakeup">wake-up signalled for every frame and audio chunk</param>
+    /// <returns>indicates success or failure</returns>
+    virtual HRESULT Start(FrameWakeup* pWakeup);
+
+    /// <summary>
+    /// Stops the timer thread and waits for it to exit
+    /// </summary>
+    virtual void Stop();
+
+    /// <summary>
+    /// Takes the latest frame without blocking
+    /// </summary>
+    /// <param name="pFrame">receives the frame; its time is the GetPerfClockTicks time it was published at</param>
+    /// <param name="pAudio">receives the audio published since the previously taken frame</param>
+    /// <returns>S_OK for a new frame, else E_PENDING</returns>
+    virtual HRESULT AcquireFrame(SessionFrame* pFrame, std::vector<AudioChunk>* pAudio);
+
+    /// <summary>
+    /// Snapshot of the source counters
+    /// </summary>
+    /// <param name="pStats">receives the counters</param>
+    void GetStats(FrameSourceStats* pStats) const;
+
+private:
+    void TimerThread();
+
+    int                     m_nWidth;
+    int                     m_nHeight;
+    int                     m_nFrameIntervalUs;
+    int                     m_nAudioIntervalUs;
+    std::vector<BYTE>       m_color;
+    FrameWakeup*            m_pWakeup;
+
+    std::thread             m_thread;
+    mutable std::mutex      m_mutex;
+    std::condition_variable m_stopping;
+    bool                    m_bStopping;
+
+    bool                    m_bPublished;
+    INT64                   m_nPublishedTime;
+    std::vector<AudioChunk> m_publishedAudio;
+
+    UINT64                  m_nFramesPublished;
+    UINT64                  m_nFramesDropped;
+};
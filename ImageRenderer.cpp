@@ -14,7 +14,6 @@ static const float c_FaceBoxThickness = 6.0f;
 static const float c_FacePointThickness = 10.0f;
 static const float c_FacePointRadius = 1.0f;
 static const float c_FacePropertyFontSize = 32.0f;
-static const double c_FaceRotationIncrementInDegrees = 5.0f;
 
 static const float c_TextLayoutWidth = 500;
 static const float c_TextLayoutHeight = 500;
@@ -27,9 +26,11 @@ ImageRenderer::ImageRenderer() :
     m_sourceWidth(0),
     m_sourceHeight(0),
     m_sourceStride(0),
+    m_nBytesTransferred(0),
     m_pD2DFactory(nullptr), 
     m_pRenderTarget(nullptr),
     m_pBitmap(0),
+    m_pMosaicBitmap(nullptr),
     m_pTextFormat(0),
     m_pDWriteFactory(nullptr)
 {
@@ -133,6 +134,7 @@ void ImageRenderer::DiscardResources()
     }
     SafeRelease(m_pRenderTarget);
     SafeRelease(m_pBitmap);
+    SafeRelease(m_pMosaicBitmap);
 }
 
 /// <summary>
@@ -240,7 +242,7 @@ HRESULT ImageRenderer::EndDrawing()
 /// <param name="pImage">image data in RGBX format</param>
 /// <param name="cbImage">size of image data in bytes</param>
 /// <returns>indicates success or failure</returns>
-HRESULT ImageRenderer::DrawBackground(BYTE* pImage, unsigned long cbImage)
+HRESULT ImageRenderer::DrawBackground(const BYTE* pImage, unsigned long cbImage)
 {
     HRESULT hr = S_OK;
 
@@ -254,6 +256,7 @@ HRESULT ImageRenderer::DrawBackground(BYTE* pImage, unsigned long cbImage)
     {
         // Copy the image that was passed in into the direct2d bitmap
         hr = m_pBitmap->CopyFromMemory(NULL, pImage, m_sourceStride);
+        m_nBytesTransferred += m_sourceHeight * m_sourceWidth * 4;
     }
 
 	if (SUCCEEDED(hr))
@@ -284,7 +287,7 @@ HRESULT ImageRenderer::DrawBackgroundA()
 /// <param name="pImage">image data in RGBX format</param>
 /// <param name="cbImage">size of image data in bytes</param>
 /// <returns>indicates success or failure</returns>
-HRESULT ImageRenderer::SetBackground(BYTE* pImage, unsigned long cbImage)
+HRESULT ImageRenderer::SetBackground(const BYTE* pImage, unsigned long cbImage)
 {
 	HRESULT hr = S_OK;
 
@@ -298,148 +301,70 @@ HRESULT ImageRenderer::SetBackground(BYTE* pImage, unsigned long cbImage)
 	{
 		// Copy the image that was passed in into the direct2d bitmap
 		hr = m_pBitmap->CopyFromMemory(NULL, pImage, m_sourceStride);
+		m_nBytesTransferred += m_sourceHeight * m_sourceWidth * 4;
 	}
 
 	return hr;
 }
 
 /// <summary>
-/// Draws face frame results
+/// Copies a 32 bit per pixel speaker mosaic into the mosaic bitmap, creating the bitmap
+/// the first time and whenever the mosaic size changes
 /// </summary>
-/// <param name="iFace">the index of the face frame corresponding to a specific body in the FOV</param>
-/// <param name="pFaceBox">face bounding box</param>
-/// <param name="pFacePoints">face points</param>
-/// <param name="pFaceRotation">face rotation</param>
-/// <param name="pFaceProperties">face properties</param>
-/// <param name="pFaceTextLayout">face result text layout</param>
-void ImageRenderer::DrawFaceFrameResults(int iFace, const RectI* pFaceBox, const PointF* pFacePoints, const Vector4* pFaceRotation, const DetectionResult* pFaceProperties, const D2D1_POINT_2F* pFaceTextLayout)
+/// <param name="pImage">mosaic in RGBX format</param>
+/// <param name="nWidth">width (in pixels) of the mosaic</param>
+/// <param name="nHeight">height (in pixels) of the mosaic</param>
+/// <param name="nStride">length (in bytes) of a row of the mosaic</param>
+/// <returns>indicates success or failure</returns>
+HRESULT ImageRenderer::SetMosaic(const BYTE* pImage, int nWidth, int nHeight, int nStride)
 {
-    // draw the face frame results only if the face bounding box is valid
-    if (ValidateFaceBoxAndPoints(pFaceBox, pFacePoints))
-    {
-        ID2D1SolidColorBrush* brush = m_pFaceBrush[iFace];
+	HRESULT hr = S_OK;
 
-        // draw the face bounding box
-        D2D1_RECT_F faceBox = D2D1::RectF(static_cast<FLOAT>(pFaceBox->Left), 
-			static_cast<FLOAT>(pFaceBox->Top),
-			static_cast<FLOAT>(pFaceBox->Right),
-			static_cast<FLOAT>(pFaceBox->Bottom));
+	if (nullptr == pImage || nWidth <= 0 || nHeight <= 0 || nStride < nWidth * 4)
+	{
+		hr = E_INVALIDARG;
+	}
 
-		D2D1_RECT_F enlarge;
-		if (faceBox.left - (float) 25.0 < (float) 0.0)
-		{
-			enlarge.left = (float) 0.0;
-		}
-		else 
-		{
-			enlarge.left = faceBox.left - (float) 25.0;
-		}
-		if (faceBox.top - (float) 50.0 < 0.0)
-		{
-			enlarge.top = (float) 0.0;
-		}
-		else
-		{
-			enlarge.top = faceBox.top - (float) 50.0;
-		}
-		if (faceBox.right + (float) 25.0 > (float) 1920.0)
-		{
-			enlarge.right = (float) 1920.0;
-		}
-		else
-		{
-			enlarge.right = faceBox.right + (float) 25.0;
-		}
-		if (faceBox.bottom + (float) 25.0 > (float) 1080.0)
-		{
-			enlarge.bottom = (float) 1080.0;
-		}
-		else
+	if (SUCCEEDED(hr) && m_pMosaicBitmap)
+	{
+		D2D1_SIZE_U size = m_pMosaicBitmap->GetPixelSize();
+		if (size.width != static_cast<UINT32>(nWidth) || size.height != static_cast<UINT32>(nHeight))
 		{
-			enlarge.bottom = faceBox.bottom + (float) 25.0;
+			SafeRelease(m_pMosaicBitmap);
 		}
+	}
 
-		D2D1_RECT_F d2d;
-		d2d.bottom = 1080;
-		d2d.left = 0;
-		d2d.right = 1920;
-		d2d.top = 0;
-		// Draw the bitmap stretched to the size of the window
-		m_pRenderTarget->DrawBitmap(m_pBitmap, d2d, 1.0f, D2D1_BITMAP_INTERPOLATION_MODE_NEAREST_NEIGHBOR, enlarge);
-    }
+	if (SUCCEEDED(hr) && nullptr == m_pMosaicBitmap)
+	{
+		hr = m_pRenderTarget->CreateBitmap(
+			D2D1::SizeU(nWidth, nHeight),
+			D2D1::BitmapProperties(D2D1::PixelFormat(DXGI_FORMAT_B8G8R8A8_UNORM, D2D1_ALPHA_MODE_IGNORE)),
+			&m_pMosaicBitmap
+			);
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		hr = m_pMosaicBitmap->CopyFromMemory(NULL, pImage, nStride);
+		m_nBytesTransferred += static_cast<UINT64>(nWidth) * nHeight * 4;
+	}
+
+	return hr;
 }
 
 /// <summary>
-/// Validates face bounding box and face points to be within screen space
+/// Draws the speaker mosaic stretched over the whole window
 /// </summary>
-/// <param name="pFaceBox">the face bounding box</param>
-/// <param name="pFacePoints">the face points</param>
-/// <returns>success or failure</returns>
-bool ImageRenderer::ValidateFaceBoxAndPoints(const RectI* pFaceBox, const PointF* pFacePoints)
+/// <returns>indicates success or failure</returns>
+HRESULT ImageRenderer::DrawMosaic()
 {
-    bool isFaceValid = false;
-
-    if (pFaceBox != nullptr)
-    {
-        INT32 screenWidth = m_sourceWidth;
-        INT32 screenHeight = m_sourceHeight;
-
-        INT32 width = pFaceBox->Right - pFaceBox->Left;
-        INT32 height = pFaceBox->Bottom - pFaceBox->Top;
-
-        // check if we have a valid rectangle within the bounds of the screen space
-        isFaceValid = width > 0 && 
-            height > 0 && 
-            pFaceBox->Right <= screenWidth && 
-            pFaceBox->Bottom <= screenHeight;
+	if (nullptr == m_pMosaicBitmap)
+	{
+		return E_UNEXPECTED;
+	}
 
-        if (isFaceValid)
-        {
-            for (int i = 0; i < FacePointType::FacePointType_Count; i++)
-            {
-                // check if we have a valid face point within the bounds of the screen space                        
-                bool isFacePointValid = pFacePoints[i].X > 0.0f &&
-                    pFacePoints[i].Y > 0.0f &&
-                    pFacePoints[i].X < m_sourceWidth &&
-                    pFacePoints[i].Y < m_sourceHeight;
-
-                if (!isFacePointValid)
-                {
-                    isFaceValid = false;
-                    break;
-                }
-            }
-        }
-    }
+	D2D1_RECT_F dest = D2D1::RectF(0.0f, 0.0f, static_cast<float>(m_sourceWidth), static_cast<float>(m_sourceHeight));
+	m_pRenderTarget->DrawBitmap(m_pMosaicBitmap, dest, 1.0f, D2D1_BITMAP_INTERPOLATION_MODE_LINEAR);
 
-    return isFaceValid;
+	return S_OK;
 }
-
-
-/// <summary>
-/// Converts rotation quaternion to Euler angles 
-/// And then maps them to a specified range of values to control the refresh rate
-/// </summary>
-/// <param name="pQuaternion">face rotation quaternion</param>
-/// <param name="pPitch">rotation about the X-axis</param>
-/// <param name="pYaw">rotation about the Y-axis</param>
-/// <param name="pRoll">rotation about the Z-axis</param>
-void ImageRenderer::ExtractFaceRotationInDegrees(const Vector4* pQuaternion, int* pPitch, int* pYaw, int* pRoll)
-{
-    double x = pQuaternion->x;
-    double y = pQuaternion->y;
-    double z = pQuaternion->z;
-    double w = pQuaternion->w;
-
-    // convert face rotation quaternion to Euler angles in degrees		
-    double dPitch, dYaw, dRoll;
-    dPitch = atan2(2 * (y * z + w * x), w * w - x * x - y * y + z * z) / M_PI * 180.0;
-    dYaw = asin(2 * (w * y - x * z)) / M_PI * 180.0;
-    dRoll = atan2(2 * (x * y + w * z), w * w + x * x - y * y - z * z) / M_PI * 180.0;
-
-    // clamp rotation values in degrees to a specified range of values to control the refresh rate
-    double increment = c_FaceRotationIncrementInDegrees; 
-    *pPitch = static_cast<int>(floor((dPitch + increment/2.0 * (dPitch > 0 ? 1.0 : -1.0)) / increment) * increment);
-    *pYaw = static_cast<int>(floor((dYaw + increment/2.0 * (dYaw > 0 ? 1.0 : -1.0)) / increment) * increment);
-    *pRoll = static_cast<int>(floor((dRoll + increment/2.0 * (dRoll > 0 ? 1.0 : -1.0)) / increment) * increment);
-}
\ No newline at end of file
@@ -55,7 +55,7 @@ public:
     /// <param name="pImage">image data in RGBX format</param>
     /// <param name="cbImage">size of image data in bytes</param>
     /// <returns>indicates success or failure</returns>
-    HRESULT DrawBackground(BYTE* pImage, unsigned long cbImage);
+    HRESULT DrawBackground(const BYTE* pImage, unsigned long cbImage);
 
 	/// <summary>
 	/// Draws a 32 bit per pixel image of previously specified width, height, and stride to the associated hwnd
@@ -71,18 +71,29 @@ public:
 	/// <param name="pImage">image data in RGBX format</param>
 	/// <param name="cbImage">size of image data in bytes</param>
 	/// <returns>indicates success or failure</returns>
-	HRESULT SetBackground(BYTE* pImage, unsigned long cbImage);
+	HRESULT SetBackground(const BYTE* pImage, unsigned long cbImage);
 
-    /// <summary>
-    /// Draws face frame results
-    /// </summary>
-    /// <param name="iFace">the index of the face frame corresponding to a specific body in the FOV</param>
-    /// <param name="pFaceBox">face bounding box</param>
-    /// <param name="pFacePoints">face points</param>
-    /// <param name="pFaceRotation">face rotation</param>
-    /// <param name="pFaceProperties">face properties</param>
-    /// <param name="pFaceTextLayout">face result text layout</param>
-    void DrawFaceFrameResults(int iFace, const RectI* pFaceBox, const PointF* pFacePoints, const Vector4* pFaceRotation, const DetectionResult* pFaceProperties, const D2D1_POINT_2F* pFaceTextLayout);
+	/// <summary>
+	/// Copies a 32 bit per pixel speaker mosaic into the mosaic bitmap, creating the bitmap
+	/// the first time and whenever the mosaic size changes
+	/// </summary>
+	/// <param name="pImage">mosaic in RGBX format</param>
+	/// <param name="nWidth">width (in pixels) of the mosaic</param>
+	/// <param name="nHeight">height (in pixels) of the mosaic</param>
+	/// <param name="nStride">length (in bytes) of a row of the mosaic</param>
+	/// <returns>indicates success or failure</returns>
+	HRESULT SetMosaic(const BYTE* pImage, int nWidth, int nHeight, int nStride);
+
+	/// <summary>
+	/// Draws the speaker mosaic stretched over the whole window
+	/// </summary>
+	/// <returns>indicates success or failure</returns>
+	HRESULT DrawMosaic();
+
+	/// <summary>
+	/// Number of bytes copied into the background and mosaic bitmaps so far
+	/// </summary>
+	UINT64 GetBytesTransferred() const { return m_nBytesTransferred; }
 
 private:
     /// <summary>
@@ -96,24 +107,6 @@ private:
     /// </summary>
     void DiscardResources();
 
-    /// <summary>
-    /// Validates face bounding box and face points to be within screen space
-    /// </summary>
-    /// <param name="pFaceBox">the face bounding box</param>
-    /// <param name="pFacePoints">the face points</param>
-    /// <returns>success or failure</returns>
-    bool ValidateFaceBoxAndPoints(const RectI* pFaceBox, const PointF* pFacePoints);
-
-    /// <summary>
-    /// Converts rotation quaternion to Euler angles 
-    /// And then maps them to a specified range of values to control the refresh rate
-    /// </summary>
-    /// <param name="pQuaternion">face rotation quaternion</param>
-    /// <param name="pPitch">rotation about the X-axis</param>
-    /// <param name="pYaw">rotation about the Y-axis</param>
-    /// <param name="pRoll">rotation about the Z-axis</param>
-    static void ExtractFaceRotationInDegrees(const Vector4* pQuaternion, int* pPitch, int* pYaw, int* pRoll);
-
     HWND                     m_hWnd;
 
     // Format information
@@ -121,10 +114,14 @@ private:
     UINT                     m_sourceWidth;
     LONG                     m_sourceStride;
 
+    // Bytes copied into m_pBitmap and m_pMosaicBitmap so far
+    UINT64                   m_nBytesTransferred;
+
     // Direct2D 
     ID2D1Factory*            m_pD2DFactory;
     ID2D1HwndRenderTarget*   m_pRenderTarget;
     ID2D1Bitmap*             m_pBitmap;
+    ID2D1Bitmap*             m_pMosaicBitmap;
     ID2D1SolidColorBrush*    m_pFaceBrush[BODY_COUNT];
 
     // DirectWrite
@@ -0,0 +1,88 @@
+//------------------------------------------------------------------------------
+// <copyright file="KinectAudioSource.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include "PerfClock.h"
+#include "KinectAudioSource.h"
+
+// Duration of one audio sample in 100ns ticks
+static const INT64 c_TicksPerAudioSample = c_TicksPerSecond / c_AudioSamplesPerSecond;
+
+/// <summary>
+/// Constructor
+/// </summary>
+/// <param name="pAudioBeam">audio beam to read the beam state from</param>
+/// <param name="pAudioStream">input stream of the audio beam</param>
+/// <param name="pSensorClock">mapping of the performance clock onto RelativeTime</param>
+KinectAudioSource::KinectAudioSource(IAudioBeam* pAudioBeam, IStream* pAudioStream, const SensorClock* pSensorClock) :
+    m_pAudioBeam(pAudioBeam),
+    m_pAudioStream(pAudioStream),
+    m_pSensorClock(pSensorClock),
+    m_nNextSampleTime(0),
+    m_bHaveSampleTime(false)
+{
+    m_pAudioBeam->AddRef();
+    m_pAudioStream->AddRef();
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+KinectAudioSource::~KinectAudioSource()
+{
+    SafeRelease(m_pAudioStream);
+    SafeRelease(m_pAudioBeam);
+}
+
+/// <summary>
+/// Reads pending audio without blocking
+/// </summary>
+/// <param name="pSamples">receives the samples</param>
+/// <param name="nMaxSamples">capacity of pSamples</param>
+/// <param name="pnRead">receives the number of samples read</param>
+/// <param name="pnTime">receives the RelativeTime of the first sample read, in 100ns ticks; 0
+/// until the first color frame relates the clocks</param>
+/// <returns>S_OK if pSamples was filled, E_PENDING if fewer samples were available, else the failure code</returns>
+HRESULT KinectAudioSource::Read(float* pSamples, UINT nMaxSamples, UINT* pnRead, INT64* pnTime)
+{
+    DWORD cbRead = 0;
+
+    // S_OK will be returned when cbRead == the buffer size.
+    // E_PENDING will be returned when cbRead < the buffer size.
+    HRESULT hr = m_pAudioStream->Read(pSamples, nMaxSamples * sizeof(float), &cbRead);
+
+    *pnRead = cbRead / sizeof(float);
+    *pnTime = 0;
+
+    if (*pnRead > 0)
+    {
+        if (E_PENDING == hr || !m_bHaveSampleTime)
+        {
+            // The stream has been drained, so the last sample just read is about now.
+            // Re-anchoring here keeps the sample count from drifting off the clock.
+            m_nNextSampleTime = GetPerfClockTicks() - *pnRead * c_TicksPerAudioSample;
+            m_bHaveSampleTime = true;
+        }
+
+        // the beam history compares the audio with color frame times; audio read before
+        // the first frame cannot be placed on that clock and stays at 0, far from any frame
+        m_pSensorClock->ToSensorTime(m_nNextSampleTime, pnTime);
+        m_nNextSampleTime += *pnRead * c_TicksPerAudioSample;
+    }
+
+    return hr;
+}
+
+/// <summary>
+/// Reads the current beam state
+/// </summary>
+/// <param name="pfBeamAngle">receives the beam angle in radians</param>
+/// <param name="pfBeamAngleConfidence">receives the beam angle confidence in the range [0,1]</param>
+void KinectAudioSource::GetBeam(float* pfBeamAngle, float* pfBeamAngleConfidence)
+{
+    m_pAudioBeam->get_BeamAngle(pfBeamAngle);
+    m_pAudioBeam->get_BeamAngleConfidence(pfBeamAngleConfidence);
+}
@@ -0,0 +1,61 @@
+//------------------------------------------------------------------------------
+// <copyright file="KinectAudioSource.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "AudioCapture.h"
+#include "SensorClock.h"
+
+/// <summary>
+/// Beam audio of the Kinect sensor, read through the beam's input stream. The stream
+/// carries no times; samples are timed by the performance clock as they are read and
+/// stamped with the RelativeTime of the color frames, which the beam history compares
+/// them with.
+/// </summary>
+class KinectAudioSource : public IAudioSampleSource
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    /// <param name="pAudioBeam">audio beam to read the beam state from</param>
+    /// <param name="pAudioStream">input stream of the audio beam</param>
+    /// <param name="pSensorClock">mapping of the performance clock onto RelativeTime</param>
+    KinectAudioSource(IAudioBeam* pAudioBeam, IStream* pAudioStream, const SensorClock* pSensorClock);
+
+    /// <summary>
+    /// Destructor
+    /// </summary>
+    virtual ~KinectAudioSource();
+
+    /// <summary>
+    /// Reads pending audio without blocking
+    /// </summary>
+    /// <param name="pSamples">receives the samples</param>
+    /// <param name="nMaxSamples">capacity of pSamples</param>
+    /// <param name="pnRead">receives the number of samples read</param>
+    /// <param name="pnTime">receives the RelativeTime of the first sample read, in 100ns ticks; 0
+    /// until the first color frame relates the clocks</param>
+    /// <returns>S_OK if pSamples was filled, E_PENDING if fewer samples were available, else the failure code</returns>
+    virtual HRESULT Read(float* pSamples, UINT nMaxSamples, UINT* pnRead, INT64* pnTime);
+
+    /// <summary>
+    /// Reads the current beam state
+    /// </summary>
+    /// <param name="pfBeamAngle">receives the beam angle in radians</param>
+    /// <param name="pfBeamAngleConfidence">receives the beam angle confidence in the range [0,1]</param>
+    virtual void GetBeam(float* pfBeamAngle, float* pfBeamAngleConfidence);
+
+private:
+    IAudioBeam*             m_pAudioBeam;
+    IStream*                m_pAudioStream;
+    const SensorClock*      m_pSensorClock;
+
+    // Performance clock time of the next sample to be read, valid once the first read
+    // returned audio
+    INT64                   m_nNextSampleTime;
+    bool                    m_bHaveSampleTime;
+};
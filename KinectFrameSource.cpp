@@ -0,0 +1,657 @@
+//------------------------------------------------------------------------------
+// <copyright file="KinectFrameSource.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include "PerfClock.h"
+#include "KinectFrameSource.h"
+
+// face property text layout offset in X axis
+static const float c_FaceTextLayoutOffsetX = -0.1f;
+
+// face property text layout offset in Y axis
+static const float c_FaceTextLayoutOffsetY = -0.125f;
+
+// define the face frame features required to be computed by this application
+static const DWORD c_FaceFrameFeatures =
+    FaceFrameFeatures::FaceFrameFeatures_BoundingBoxInColorSpace
+    | FaceFrameFeatures::FaceFrameFeatures_PointsInColorSpace
+    | FaceFrameFeatures::FaceFrameFeatures_RotationOrientation
+    | FaceFrameFeatures::FaceFrameFeatures_Happy
+    | FaceFrameFeatures::FaceFrameFeatures_RightEyeClosed
+    | FaceFrameFeatures::FaceFrameFeatures_LeftEyeClosed
+    | FaceFrameFeatures::FaceFrameFeatures_MouthOpen
+    | FaceFrameFeatures::FaceFrameFeatures_MouthMoved
+    | FaceFrameFeatures::FaceFrameFeatures_LookingAway
+    | FaceFrameFeatures::FaceFrameFeatures_Glasses
+    | FaceFrameFeatures::FaceFrameFeatures_FaceEngagement;
+
+/// <summary>
+/// Constructor
+/// </summary>
+KinectFrameSource::KinectFrameSource() :
+    m_pKinectSensor(nullptr),
+    m_pCoordinateMapper(nullptr),
+    m_pColorFrameReader(nullptr),
+    m_pBodyFrameReader(nullptr),
+    m_pColorFrame(nullptr),
+    m_colorFrameFormat(ColorImageFormat_None),
+    m_pWakeup(nullptr),
+    m_pLatencyMonitor(nullptr),
+    m_hStopEvent(NULL),
+    m_hColorFrameArrived(0),
+    m_hBodyFrameArrived(0)
+{
+    for (int i = 0; i < BODY_COUNT; i++)
+    {
+        m_pFaceFrameSources[i] = nullptr;
+        m_pFaceFrameReaders[i] = nullptr;
+        m_hFaceFrameArrived[i] = 0;
+    }
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+KinectFrameSource::~KinectFrameSource()
+{
+    Stop();
+
+    SafeRelease(m_pColorFrame);
+
+    // done with face sources and readers
+    for (int i = 0; i < BODY_COUNT; i++)
+    {
+        SafeRelease(m_pFaceFrameSources[i]);
+        SafeRelease(m_pFaceFrameReaders[i]);
+    }
+
+    // done with body frame reader
+    SafeRelease(m_pBodyFrameReader);
+
+    // done with color frame reader
+    SafeRelease(m_pColorFrameReader);
+
+    // done with coordinate mapper
+    SafeRelease(m_pCoordinateMapper);
+
+    // close the Kinect Sensor
+    if (m_pKinectSensor)
+    {
+        m_pKinectSensor->Close();
+    }
+
+    SafeRelease(m_pKinectSensor);
+}
+
+/// <summary>
+/// Opens the default sensor and its color, body and face readers
+/// </summary>
+/// <returns>S_OK on success else the failure code</returns>
+HRESULT KinectFrameSource::Open()
+{
+    HRESULT hr;
+
+    hr = GetDefaultKinectSensor(&m_pKinectSensor);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    if (!m_pKinectSensor)
+    {
+        return E_FAIL;
+    }
+
+    IColorFrameSource* pColorFrameSource = nullptr;
+    IBodyFrameSource* pBodyFrameSource = nullptr;
+
+    hr = m_pKinectSensor->Open();
+
+    if (SUCCEEDED(hr))
+    {
+        hr = m_pKinectSensor->get_CoordinateMapper(&m_pCoordinateMapper);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = m_pKinectSensor->get_ColorFrameSource(&pColorFrameSource);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = pColorFrameSource->OpenReader(&m_pColorFrameReader);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = m_pKinectSensor->get_BodyFrameSource(&pBodyFrameSource);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = pBodyFrameSource->OpenReader(&m_pBodyFrameReader);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        // create a face frame source + reader to track each body in the fov
+        for (int i = 0; i < BODY_COUNT; i++)
+        {
+            if (SUCCEEDED(hr))
+            {
+                // create the face frame source by specifying the required face frame features
+                hr = CreateFaceFrameSource(m_pKinectSensor, 0, c_FaceFrameFeatures, &m_pFaceFrameSources[i]);
+            }
+            if (SUCCEEDED(hr))
+            {
+                // open the corresponding reader
+                hr = m_pFaceFrameSources[i]->OpenReader(&m_pFaceFrameReaders[i]);
+            }
+        }
+    }
+
+    SafeRelease(pColorFrameSource);
+    SafeRelease(pBodyFrameSource);
+
+    return hr;
+}
+
+/// <summary>
+/// Subscribes to the frame arrived events and starts the thread waiting on them
+/// </summary>
+/// <param name="pWakeup">wake-up signalled whenever a stream has a new frame</param>
+/// <returns>indicates success or failure</returns>
+HRESULT KinectFrameSource::Start(FrameWakeup* pWakeup)
+{
+    if (nullptr == pWakeup)
+    {
+        return E_INVALIDARG;
+    }
+
+    if (!m_pColorFrameReader || !m_pBodyFrameReader)
+    {
+        return E_UNEXPECTED;
+    }
+
+    if (m_thread.joinable())
+    {
+        return E_UNEXPECTED;
+    }
+
+    HRESULT hr = m_pColorFrameReader->SubscribeFrameArrived(&m_hColorFrameArrived);
+
+    if (SUCCEEDED(hr))
+    {
+        hr = m_pBodyFrameReader->SubscribeFrameArrived(&m_hBodyFrameArrived);
+    }
+
+    for (int i = 0; i < BODY_COUNT && SUCCEEDED(hr); i++)
+    {
+        hr = m_pFaceFrameReaders[i]->SubscribeFrameArrived(&m_hFaceFrameArrived[i]);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        m_hStopEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+        hr = m_hStopEvent ? S_OK : HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        m_pWakeup = pWakeup;
+        m_thread = std::thread(&KinectFrameSource::WaitThread, this);
+    }
+    else
+    {
+        Stop();
+    }
+
+    return hr;
+}
+
+/// <summary>
+/// Stops the waiting thread and unsubscribes from the frame arrived events
+/// </summary>
+void KinectFrameSource::Stop()
+{
+    if (m_thread.joinable())
+    {
+        SetEvent(m_hStopEvent);
+        m_thread.join();
+    }
+
+    if (m_hStopEvent)
+    {
+        CloseHandle(m_hStopEvent);
+        m_hStopEvent = NULL;
+    }
+
+    if (m_hColorFrameArrived)
+    {
+        m_pColorFrameReader->UnsubscribeFrameArrived(m_hColorFrameArrived);
+        m_hColorFrameArrived = 0;
+    }
+
+    if (m_hBodyFrameArrived)
+    {
+        m_pBodyFrameReader->UnsubscribeFrameArrived(m_hBodyFrameArrived);
+        m_hBodyFrameArrived = 0;
+    }
+
+    for (int i = 0; i < BODY_COUNT; i++)
+    {
+        if (m_hFaceFrameArrived[i])
+        {
+            m_pFaceFrameReaders[i]->UnsubscribeFrameArrived(m_hFaceFrameArrived[i]);
+            m_hFaceFrameArrived[i] = 0;
+        }
+    }
+}
+
+/// <summary>
+/// Waits on the frame arrived events, signalling every stream that has a new frame
+/// </summary>
+void KinectFrameSource::WaitThread()
+{
+    HANDLE handles[cEventCount];
+    UINT32 nStreams[cEventCount];
+
+    handles[0] = m_hStopEvent;
+    nStreams[0] = 0;
+    handles[1] = reinterpret_cast<HANDLE>(m_hColorFrameArrived);
+    nStreams[1] = FrameStream_Color;
+    handles[2] = reinterpret_cast<HANDLE>(m_hBodyFrameArrived);
+    nStreams[2] = FrameStream_Body;
+
+    for (int i = 0; i < BODY_COUNT; i++)
+    {
+        handles[3 + i] = reinterpret_cast<HANDLE>(m_hFaceFrameArrived[i]);
+        nStreams[3 + i] = FrameStream_Face;
+    }
+
+    DWORD nTimeoutMs = INFINITE;
+    UINT32 nPending = 0;
+
+    for (;;)
+    {
+        DWORD dwResult = WaitForMultipleObjects(cEventCount, handles, FALSE, nTimeoutMs);
+
+        if (WAIT_TIMEOUT == dwResult)
+        {
+            // every event that was already set has been collected; hand them over as one
+            m_pWakeup->Signal(nPending);
+            nPending = 0;
+            nTimeoutMs = INFINITE;
+            continue;
+        }
+
+        int iEvent = static_cast<int>(dwResult - WAIT_OBJECT_0);
+        if (iEvent <= 0 || iEvent >= cEventCount)
+        {
+            // stopping, or the wait failed
+            break;
+        }
+
+        // the event data is only taken to acknowledge the event; the consumer acquires the latest frames
+        if (1 == iEvent)
+        {
+            IColorFrameArrivedEventArgs* pArgs = nullptr;
+            m_pColorFrameReader->GetFrameArrivedEventData(m_hColorFrameArrived, &pArgs);
+            SafeRelease(pArgs);
+        }
+        else if (2 == iEvent)
+        {
+            IBodyFrameArrivedEventArgs* pArgs = nullptr;
+            m_pBodyFrameReader->GetFrameArrivedEventData(m_hBodyFrameArrived, &pArgs);
+            SafeRelease(pArgs);
+        }
+        else
+        {
+            IFaceFrameArrivedEventArgs* pArgs = nullptr;
+            m_pFaceFrameReaders[iEvent - 3]->GetFrameArrivedEventData(m_hFaceFrameArrived[iEvent - 3], &pArgs);
+            SafeRelease(pArgs);
+        }
+
+        // poll the other events before signalling, so that streams arriving together wake the consumer once
+        nPending |= nStreams[iEvent];
+        nTimeoutMs = 0;
+    }
+}
+
+/// <summary>
+/// Acquires the latest color frame, without its pixels, body or face data
+/// </summary>
+/// <param name="pFrame">receives the time, size and format of the frame</param>
+/// <param name="pAudio">cleared; the sensor audio is captured by its own thread</param>
+/// <returns>S_OK for a new frame, E_PENDING if there is none yet, else the failure code</returns>
+HRESULT KinectFrameSource::AcquireFrame(SessionFrame* pFrame, std::vector<AudioChunk>* pAudio)
+{
+    INT64 nStartNs = GetPerfClockNs();
+    pAudio->clear();
+
+    if (!m_pColorFrameReader || !m_pBodyFrameReader)
+    {
+        return E_UNEXPECTED;
+    }
+
+    IColorFrame* pColorFrame = nullptr;
+    HRESULT hr = m_pColorFrameReader->AcquireLatestFrame(&pColorFrame);
+
+    if (FAILED(hr))
+    {
+        // no new color frame; everything else is acquired along with the next one
+        return E_PENDING;
+    }
+
+    // the previous frame is done with once the caller asks for the next one
+    SafeRelease(m_pColorFrame);
+
+    INT64 nTime = 0;
+    IFrameDescription* pFrameDescription = nullptr;
+    int nWidth = 0;
+    int nHeight = 0;
+    ColorImageFormat imageFormat = ColorImageFormat_None;
+
+    hr = pColorFrame->get_RelativeTime(&nTime);
+
+    if (SUCCEEDED(hr))
+    {
+        m_sensorClock.Observe(nTime, nStartNs / 100);
+        hr = pColorFrame->get_FrameDescription(&pFrameDescription);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = pFrameDescription->get_Width(&nWidth);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = pFrameDescription->get_Height(&nHeight);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = pColorFrame->get_RawColorImageFormat(&imageFormat);
+    }
+
+    SafeRelease(pFrameDescription);
+
+    if (FAILED(hr))
+    {
+        SafeRelease(pColorFrame);
+        return E_PENDING;
+    }
+
+    // YUY2 is converted later, and only as far as it will be shown; other raw formats
+    // are converted to BGRA by the sensor when the pixels are read
+    ColorImageFormat frameFormat = (imageFormat == ColorImageFormat_Yuy2) ? ColorImageFormat_Yuy2 : ColorImageFormat_Bgra;
+
+    ResetSessionFrame(pFrame);
+    pFrame->nTime = nTime;
+    pFrame->colorFormat = frameFormat;
+    pFrame->nColorWidth = nWidth;
+    pFrame->nColorHeight = nHeight;
+    pFrame->nColorStride = nWidth * ((frameFormat == ColorImageFormat_Yuy2) ? 2 : sizeof(RGBQUAD));
+
+    if (m_pLatencyMonitor)
+    {
+        m_pLatencyMonitor->Record(LatencyMetric_ColorAcquire, GetPerfClockNs() - nStartNs);
+    }
+
+    // the raw buffer belongs to the frame, which is kept until the next call
+    m_pColorFrame = pColorFrame;
+    m_colorFrameFormat = imageFormat;
+
+    return S_OK;
+}
+
+/// <summary>
+/// Reads the pixels of the color frame acquired last, refreshes the bodies and fetches
+/// the face results, as far as asked for; faces need the bodies and refresh them too.
+/// Refreshing the bodies binds the face sources to them, so face tracking starts
+/// even on frames whose face results are not read.
+/// </summary>
+/// <param name="pFrame">frame acquired last; its color buffer stays valid until the next acquisition</param>
+/// <param name="nStreams">combination of FrameStream_Color, FrameStream_Body and FrameStream_Face</param>
+void KinectFrameSource::CompleteFrame(SessionFrame* pFrame, UINT32 nStreams)
+{
+    if (nullptr == m_pColorFrame)
+    {
+        return;
+    }
+
+    if (nStreams & FrameStream_Color)
+    {
+        AcquireColorData(pFrame);
+    }
+
+    if (nStreams & (FrameStream_Body | FrameStream_Face))
+    {
+        AcquireFaceData(pFrame, 0 != (nStreams & FrameStream_Face));
+    }
+}
+
+/// <summary>
+/// Points a frame at the pixels of the color frame acquired last, converting them to
+/// BGRA first for raw formats other than BGRA and YUY2
+/// </summary>
+/// <param name="pFrame">frame to fill in; its color buffer is left null on failure</param>
+void KinectFrameSource::AcquireColorData(SessionFrame* pFrame)
+{
+    HRESULT hr;
+    UINT nBufferSize = 0;
+    BYTE *pBuffer = nullptr;
+
+    if (m_colorFrameFormat == ColorImageFormat_Bgra || m_colorFrameFormat == ColorImageFormat_Yuy2)
+    {
+        hr = m_pColorFrame->AccessRawUnderlyingBuffer(&nBufferSize, &pBuffer);
+    }
+    else
+    {
+        m_convertedColor.resize(static_cast<size_t>(pFrame->nColorWidth) * pFrame->nColorHeight);
+        pBuffer = reinterpret_cast<BYTE*>(&m_convertedColor[0]);
+        nBufferSize = static_cast<UINT>(m_convertedColor.size() * sizeof(RGBQUAD));
+        hr = m_pColorFrame->CopyConvertedFrameDataToArray(nBufferSize, pBuffer, ColorImageFormat_Bgra);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        pFrame->pColorBuffer = pBuffer;
+        pFrame->cbColorBuffer = nBufferSize;
+    }
+}
+
+/// <summary>
+/// Fills in the body data of a frame and binds the face sources to the tracked bodies,
+/// and fetches the face results if asked for
+/// </summary>
+/// <param name="pFrame">frame to fill in</param>
+/// <param name="bFaceResults">whether to fetch the face results too</param>
+void KinectFrameSource::AcquireFaceData(SessionFrame* pFrame, bool bFaceResults)
+{
+    HRESULT hr;
+    IBody* ppBodies[BODY_COUNT] = {0};
+    bool bHaveBodyData = false;
+    INT64 nStartNs = GetPerfClockNs();
+
+    IBodyFrame* pBodyFrame = nullptr;
+    hr = m_pBodyFrameReader->AcquireLatestFrame(&pBodyFrame);
+    if (SUCCEEDED(hr))
+    {
+        bHaveBodyData = SUCCEEDED(pBodyFrame->GetAndRefreshBodyData(BODY_COUNT, ppBodies));
+    }
+    SafeRelease(pBodyFrame);
+
+    if (bHaveBodyData)
+    {
+        pFrame->bHaveBodyData = true;
+
+        for (int iBody = 0; iBody < BODY_COUNT; ++iBody)
+        {
+            BodySample& body = pFrame->bodies[iBody];
+            IBody* pBody = ppBodies[iBody];
+            BOOLEAN bTracked = false;
+
+            if (pBody != nullptr && SUCCEEDED(pBody->get_IsTracked(&bTracked)) && bTracked)
+            {
+                Joint joints[JointType_Count];
+
+                body.bTracked = TRUE;
+                hr = pBody->get_TrackingId(&body.nTrackingId);
+
+                // the face source of the same index follows the body whether or not face
+                // results are read this frame, so that a person who walks in during
+                // silence is tracked by the time they speak
+                UINT64 nFaceTrackingId = 0;
+                if (SUCCEEDED(hr) && SUCCEEDED(m_pFaceFrameSources[iBody]->get_TrackingId(&nFaceTrackingId)) &&
+                    nFaceTrackingId != body.nTrackingId)
+                {
+                    m_pFaceFrameSources[iBody]->put_TrackingId(body.nTrackingId);
+                }
+
+                if (SUCCEEDED(pBody->GetJoints(_countof(joints), joints)))
+                {
+                    body.headJoint = joints[JointType_Head].Position;
+                }
+            }
+        }
+    }
+
+    if (m_pLatencyMonitor)
+    {
+        m_pLatencyMonitor->Record(LatencyMetric_BodyRefresh, GetPerfClockNs() - nStartNs);
+    }
+
+    if (bFaceResults)
+    {
+        pFrame->bHaveFaceData = true;
+
+        // iterate through each face reader
+        for (int iFace = 0; iFace < BODY_COUNT; ++iFace)
+        {
+            FaceSample& face = pFrame->faces[iFace];
+
+            // retrieve the latest face frame from this reader
+            IFaceFrame* pFaceFrame = nullptr;
+            INT64 nFaceStartNs = GetPerfClockNs();
+            hr = m_pFaceFrameReaders[iFace]->AcquireLatestFrame(&pFaceFrame);
+
+            BOOLEAN bFaceTracked = false;
+            if (SUCCEEDED(hr) && nullptr != pFaceFrame)
+            {
+                // check if a valid face is tracked in this face frame
+                hr = pFaceFrame->get_IsTrackingIdValid(&bFaceTracked);
+            }
+
+            if (SUCCEEDED(hr))
+            {
+                if (bFaceTracked)
+                {
+                    IFaceFrameResult* pFaceFrameResult = nullptr;
+
+                    face.bTracked = TRUE;
+                    pFaceFrame->get_TrackingId(&face.nTrackingId);
+
+                    hr = pFaceFrame->get_FaceFrameResult(&pFaceFrameResult);
+
+                    // need to verify if pFaceFrameResult contains data before trying to access it
+                    if (SUCCEEDED(hr) && pFaceFrameResult != nullptr)
+                    {
+                        hr = pFaceFrameResult->get_FaceBoundingBoxInColorSpace(&face.faceBox);
+
+                        if (SUCCEEDED(hr))
+                        {
+                            hr = pFaceFrameResult->GetFacePointsInColorSpace(FacePointType::FacePointType_Count, face.facePoints);
+                        }
+
+                        if (SUCCEEDED(hr))
+                        {
+                            hr = pFaceFrameResult->get_FaceRotationQuaternion(&face.faceRotation);
+                        }
+
+                        if (SUCCEEDED(hr))
+                        {
+                            hr = pFaceFrameResult->GetFaceProperties(FaceProperty::FaceProperty_Count, face.faceProperties);
+                        }
+
+                        if (SUCCEEDED(hr))
+                        {
+                            hr = GetFaceTextPositionInColorSpace(ppBodies[iFace], &face.faceTextLayout);
+                        }
+
+                        if (SUCCEEDED(hr))
+                        {
+                            face.bHaveResult = TRUE;
+                        }
+                    }
+
+                    // only faces with a result are timed; the others cost next to nothing
+                    if (m_pLatencyMonitor && face.bHaveResult)
+                    {
+                        m_pLatencyMonitor->Record(LatencyMetric_FaceFetch, GetPerfClockNs() - nFaceStartNs);
+                    }
+
+                    SafeRelease(pFaceFrameResult);
+                }
+            }
+            SafeRelease(pFaceFrame);
+        }
+    }
+
+    if (bHaveBodyData)
+    {
+        for (int i = 0; i < _countof(ppBodies); ++i)
+        {
+            SafeRelease(ppBodies[i]);
+        }
+    }
+}
+
+/// <summary>
+/// Computes the face result text position by adding an offset to the corresponding
+/// body's head joint in camera space and then by projecting it to screen space
+/// </summary>
+/// <param name="pBody">pointer to the body data</param>
+/// <param name="pFaceTextLayout">pointer to the text layout position in screen space</param>
+/// <returns>indicates success or failure</returns>
+HRESULT KinectFrameSource::GetFaceTextPositionInColorSpace(IBody* pBody, PointF* pFaceTextLayout)
+{
+    HRESULT hr = E_FAIL;
+
+    if (pBody != nullptr)
+    {
+        BOOLEAN bTracked = false;
+        hr = pBody->get_IsTracked(&bTracked);
+
+        if (SUCCEEDED(hr) && bTracked)
+        {
+            Joint joints[JointType_Count];
+            hr = pBody->GetJoints(_countof(joints), joints);
+            if (SUCCEEDED(hr))
+            {
+                CameraSpacePoint headJoint = joints[JointType_Head].Position;
+                CameraSpacePoint textPoint =
+                {
+                    headJoint.X + c_FaceTextLayoutOffsetX,
+                    headJoint.Y + c_FaceTextLayoutOffsetY,
+                    headJoint.Z
+                };
+
+                ColorSpacePoint colorPoint = {0};
+                hr = m_pCoordinateMapper->MapCameraPointToColorSpace(textPoint, &colorPoint);
+
+                if (SUCCEEDED(hr))
+                {
+                    pFaceTextLayout->X = colorPoint.X;
+                    pFaceTextLayout->Y = colorPoint.Y;
+                }
+            }
+        }
+    }
+
+    return hr;
+}
@@ -0,0 +1,118 @@
+//------------------------------------------------------------------------------
+// <copyright file="KinectFrameSource.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "FrameSource.h"
+#include "SensorClock.h"
+
+/// <summary>
+/// Color, body and face streams of the Kinect sensor. A thread waits on the frame
+/// arrived events of every reader and signals the streams that have new data. Taking a
+/// frame only takes the color frame; its pixels, the bodies and the face results are
+/// read when the consumer completes the frame with them, tracking continuing either way.
+/// </summary>
+class KinectFrameSource : public IFrameSource
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    KinectFrameSource();
+
+    /// <summary>
+    /// Destructor
+    /// </summary>
+    virtual ~KinectFrameSource();
+
+    /// <summary>
+    /// Opens the default sensor and its color, body and face readers
+    /// </summary>
+    /// <returns>S_OK on success else the failure code</returns>
+    HRESULT Open();
+
+    /// <summary>
+    /// Open sensor, e.g. to open its audio beam; owned by the source
+    /// </summary>
+    IKinectSensor* GetSensor() const { return m_pKinectSensor; }
+
+    /// <summary>
+    /// Mapping of the performance clock onto the RelativeTime of the frames acquired,
+    /// e.g. to stamp the beam audio with
+    /// </summary>
+    const SensorClock* GetSensorClock() const { return &m_sensorClock; }
+
+    /// <summary>
+    /// Subscribes to the frame arrived events and starts the thread waiting on them
+    /// </summary>
+    /// <param name="pWakeup">wake-up signalled whenever a stream has a new frame</param>
+    /// <returns>indicates success or failure</returns>
+    virtual HRESULT Start(FrameWakeup* pWakeup);
+
+    /// <summary>
+    /// Stops the waiting thread and unsubscribes from the frame arrived events
+    /// </summary>
+    virtual void Stop();
+
+    /// <summary>
+    /// Acquires the latest color frame, without its pixels, body or face data
+    /// </summary>
+    /// <param name="pFrame">receives the time, size and format of the frame</param>
+    /// <param name="pAudio">cleared; the sensor audio is captured by its own thread</param>
+    /// <returns>S_OK for a new frame, E_PENDING if there is none yet, else the failure code</returns>
+    virtual HRESULT AcquireFrame(SessionFrame* pFrame, std::vector<AudioChunk>* pAudio);
+
+    /// <summary>
+    /// Reads the pixels of the color frame acquired last, refreshes the bodies and fetches
+    /// the face results, as far as asked for; faces need the bodies and refresh them too.
+    /// Refreshing the bodies binds the face sources to them, so face tracking starts
+    /// even on frames whose face results are not read.
+    /// </summary>
+    /// <param name="pFrame">frame acquired last; its color buffer stays valid until the next acquisition</param>
+    /// <param name="nStreams">combination of FrameStream_Color, FrameStream_Body and FrameStream_Face</param>
+    virtual void CompleteFrame(SessionFrame* pFrame, UINT32 nStreams);
+
+    /// <summary>
+    /// Sets where the time taken acquiring the color, refreshing the bodies and fetching
+    /// every face result is recorded
+    /// </summary>
+    /// <param name="pMonitor">monitor to record into, or null for none</param>
+    virtual void SetLatencyMonitor(LatencyMonitor* pMonitor) { m_pLatencyMonitor = pMonitor; }
+
+private:
+    void WaitThread();
+    void AcquireColorData(SessionFrame* pFrame);
+    void AcquireFaceData(SessionFrame* pFrame, bool bFaceResults);
+    HRESULT GetFaceTextPositionInColorSpace(IBody* pBody, PointF* pFaceTextLayout);
+
+    // Number of events the waiting thread waits on: stop, color, body and one per face reader
+    static const int        cEventCount = 3 + BODY_COUNT;
+
+    IKinectSensor*          m_pKinectSensor;
+    ICoordinateMapper*      m_pCoordinateMapper;
+    IColorFrameReader*      m_pColorFrameReader;
+    IBodyFrameReader*       m_pBodyFrameReader;
+    IFaceFrameSource*       m_pFaceFrameSources[BODY_COUNT];
+    IFaceFrameReader*       m_pFaceFrameReaders[BODY_COUNT];
+
+    // Color frame handed out last, and its raw format; it owns the raw buffer the frame points to
+    IColorFrame*            m_pColorFrame;
+    ColorImageFormat        m_colorFrameFormat;
+
+    // Color converted to BGRA for raw formats other than BGRA and YUY2
+    std::vector<RGBQUAD>    m_convertedColor;
+
+    // Offset of RelativeTime from the performance clock, as of the frames acquired
+    SensorClock             m_sensorClock;
+
+    FrameWakeup*            m_pWakeup;
+    LatencyMonitor*         m_pLatencyMonitor;
+    std::thread             m_thread;
+    HANDLE                  m_hStopEvent;
+    WAITABLE_HANDLE         m_hColorFrameArrived;
+    WAITABLE_HANDLE         m_hBodyFrameArrived;
+    WAITABLE_HANDLE         m_hFaceFrameArrived[BODY_COUNT];
+};
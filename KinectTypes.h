@@ -0,0 +1,169 @@
+//------------------------------------------------------------------------------
+// <copyright file="KinectTypes.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Kinect value types used by the hardware independent parts of the pipeline.
+// On Windows these come straight from the Kinect SDK headers; everywhere else
+// layout compatible definitions are provided so that recorded sessions can be
+// replayed and processed without a sensor or the SDK installed.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+
+#include "stdafx.h"
+
+#else
+
+typedef int8_t                  INT8;
+typedef uint8_t                 BYTE;
+typedef unsigned char           BOOLEAN;
+typedef int32_t                 INT32;
+typedef uint32_t                UINT32;
+typedef unsigned int            UINT;
+typedef uint32_t                DWORD;
+typedef int64_t                 INT64;
+typedef uint64_t                UINT64;
+typedef uint64_t                ULONGLONG;
+typedef int32_t                 HRESULT;
+typedef INT64                   TIMESPAN;
+
+#define S_OK                    ((HRESULT)0)
+#define S_FALSE                 ((HRESULT)1)
+#define E_NOTIMPL               ((HRESULT)0x80004001)
+#define E_FAIL                  ((HRESULT)0x80004005)
+#define E_POINTER               ((HRESULT)0x80004003)
+#define E_INVALIDARG            ((HRESULT)0x80070057)
+#define E_OUTOFMEMORY           ((HRESULT)0x8007000E)
+#define E_PENDING               ((HRESULT)0x8000000A)
+#define E_UNEXPECTED            ((HRESULT)0x8000FFFF)
+
+#define FALSE                   0
+#define TRUE                    1
+
+#define SUCCEEDED(hr)           (((HRESULT)(hr)) >= 0)
+#define FAILED(hr)              (((HRESULT)(hr)) < 0)
+
+#ifndef UNREFERENCED_PARAMETER
+#define UNREFERENCED_PARAMETER(P) (void)(P)
+#endif
+
+#ifndef _countof
+#define _countof(a)             (sizeof(a) / sizeof((a)[0]))
+#endif
+
+#ifndef BODY_COUNT
+#define BODY_COUNT              6
+#endif
+
+typedef struct tagRGBQUAD
+{
+    BYTE    rgbBlue;
+    BYTE    rgbGreen;
+    BYTE    rgbRed;
+    BYTE    rgbReserved;
+} RGBQUAD;
+
+typedef struct _RectI
+{
+    INT32   Left;
+    INT32   Top;
+    INT32   Right;
+    INT32   Bottom;
+} RectI;
+
+typedef struct _PointF
+{
+    float   X;
+    float   Y;
+} PointF;
+
+typedef struct _Vector4
+{
+    float   x;
+    float   y;
+    float   z;
+    float   w;
+} Vector4;
+
+typedef struct _CameraSpacePoint
+{
+    float   X;
+    float   Y;
+    float   Z;
+} CameraSpacePoint;
+
+typedef struct _ColorSpacePoint
+{
+    float   X;
+    float   Y;
+} ColorSpacePoint;
+
+enum _DetectionResult
+{
+    DetectionResult_Unknown = 0,
+    DetectionResult_No      = 1,
+    DetectionResult_Maybe   = 2,
+    DetectionResult_Yes     = 3
+};
+typedef enum _DetectionResult DetectionResult;
+
+enum _FacePointType
+{
+    FacePointType_None              = -1,
+    FacePointType_EyeLeft           = 0,
+    FacePointType_EyeRight          = 1,
+    FacePointType_Nose              = 2,
+    FacePointType_MouthCornerLeft   = 3,
+    FacePointType_MouthCornerRight  = 4,
+    FacePointType_Count             = ( FacePointType_MouthCornerRight + 1 )
+};
+typedef enum _FacePointType FacePointType;
+
+enum _FaceProperty
+{
+    FaceProperty_Happy          = 0,
+    FaceProperty_Engaged        = 1,
+    FaceProperty_WearingGlasses = 2,
+    FaceProperty_LeftEyeClosed  = 3,
+    FaceProperty_RightEyeClosed = 4,
+    FaceProperty_MouthOpen      = 5,
+    FaceProperty_MouthMoved     = 6,
+    FaceProperty_LookingAway    = 7,
+    FaceProperty_Count          = ( FaceProperty_LookingAway + 1 )
+};
+typedef enum _FaceProperty FaceProperty;
+
+enum _JointType
+{
+    JointType_SpineBase     = 0,
+    JointType_SpineMid      = 1,
+    JointType_Neck          = 2,
+    JointType_Head          = 3,
+    JointType_Count         = 25
+};
+typedef enum _JointType JointType;
+
+enum _ColorImageFormat
+{
+    ColorImageFormat_None   = 0,
+    ColorImageFormat_Rgba   = 1,
+    ColorImageFormat_Yuv    = 2,
+    ColorImageFormat_Bgra   = 3,
+    ColorImageFormat_Bayer  = 4,
+    ColorImageFormat_Yuy2   = 5
+};
+typedef enum _ColorImageFormat ColorImageFormat;
+
+#endif
+
+// Number of 100ns TIMESPAN ticks (the unit of Kinect RelativeTime) in one second
+static const INT64 c_TicksPerSecond = 10000000;
+
+// Number of 100ns TIMESPAN ticks in one millisecond
+static const INT64 c_TicksPerMillisecond = 10000;
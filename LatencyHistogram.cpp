@@ -0,0 +1,251 @@
+//------------------------------------------------------------------------------
+// <copyright file="LatencyHistogram.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "KinectTypes.h"
+#include <math.h>
+#include <string.h>
+#include "LatencyHistogram.h"
+
+/// <summary>
+/// Short name of a metric, for reports
+/// </summary>
+/// <param name="metric">metric to name</param>
+const char* GetLatencyMetricName(LatencyMetric metric)
+{
+    static const char* c_szNames[LatencyMetric_Count] =
+    {
+        "color-acquire",
+        "body-refresh",
+        "face-fetch",
+        "speaker-match",
+        "conversion",
+        "compose",
+        "present",
+        "frame-to-display",
+        "audio-to-display"
+    };
+
+    return (metric >= 0 && metric < LatencyMetric_Count) ? c_szNames[metric] : "unknown";
+}
+
+/// <summary>
+/// Turns the counts into those recorded since an earlier snapshot of the same
+/// histogram, and moves that snapshot up to now; the maximum stays that of the whole run
+/// </summary>
+/// <param name="pLast">earlier snapshot; receives the counts as they were before the call</param>
+void LatencySnapshot::MakeInterval(LatencySnapshot* pLast)
+{
+    for (int i = 0; i < c_LatencyBucketCount; ++i)
+    {
+        UINT64 nCount = nCounts[i];
+        nCounts[i] -= pLast->nCounts[i];
+        pLast->nCounts[i] = nCount;
+    }
+
+    UINT64 nCount = nTotal;
+    nTotal -= pLast->nTotal;
+    pLast->nTotal = nCount;
+    pLast->nMaxNs = nMaxNs;
+}
+
+/// <summary>
+/// Latency below which a fraction of the recorded latencies fall
+/// </summary>
+/// <param name="fFraction">fraction in [0,1], e.g. 0.99 for the 99th percentile</param>
+/// <returns>latency in nanoseconds, the middle of its bucket; 0 when nothing was recorded</returns>
+INT64 LatencySnapshot::GetPercentileNs(double fFraction) const
+{
+    if (0 == nTotal)
+    {
+        return 0;
+    }
+
+    UINT64 nRank = static_cast<UINT64>(ceil(fFraction * nTotal));
+    nRank = (nRank < 1) ? 1 : (nRank > nTotal) ? nTotal : nRank;
+
+    UINT64 nSeen = 0;
+    for (int i = 0; i < c_LatencyBucketCount; ++i)
+    {
+        nSeen += nCounts[i];
+        if (nSeen >= nRank)
+        {
+            // never beyond the largest latency actually seen
+            INT64 nNs = LatencyHistogram::GetBucketLowerBoundNs(i) + LatencyHistogram::GetBucketWidthNs(i) / 2;
+            return (nNs < nMaxNs) ? nNs : nMaxNs;
+        }
+    }
+
+    return nMaxNs;
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+LatencyHistogram::LatencyHistogram() :
+    m_nMaxNs(0)
+{
+    for (int i = 0; i < c_LatencyBucketCount; ++i)
+    {
+        m_counts[i] = 0;
+    }
+}
+
+/// <summary>
+/// Copies the counts; may be called from any thread while another records
+/// </summary>
+/// <param name="pSnapshot">receives the counts</param>
+void LatencyHistogram::GetSnapshot(LatencySnapshot* pSnapshot) const
+{
+    // the total is summed from the copied counts so that it always matches them
+    pSnapshot->nTotal = 0;
+    for (int i = 0; i < c_LatencyBucketCount; ++i)
+    {
+        pSnapshot->nCounts[i] = m_counts[i].load(std::memory_order_relaxed);
+        pSnapshot->nTotal += pSnapshot->nCounts[i];
+    }
+
+    pSnapshot->nMaxNs = m_nMaxNs.load(std::memory_order_relaxed);
+}
+
+/// <summary>
+/// Smallest latency falling in a bucket
+/// </summary>
+/// <param name="nIndex">bucket</param>
+INT64 LatencyHistogram::GetBucketLowerBoundNs(int nIndex)
+{
+    int nShift = nIndex / c_LatencySubBuckets - 1;
+    if (nShift <= 0)
+    {
+        return nIndex;
+    }
+
+    return static_cast<INT64>(nIndex - nShift * c_LatencySubBuckets) << nShift;
+}
+
+/// <summary>
+/// Number of latencies a bucket spans
+/// </summary>
+/// <param name="nIndex">bucket</param>
+INT64 LatencyHistogram::GetBucketWidthNs(int nIndex)
+{
+    int nShift = nIndex / c_LatencySubBuckets - 1;
+    return static_cast<INT64>(1) << ((nShift > 0) ? nShift : 0);
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+LatencyIntervals::LatencyIntervals() :
+    m_pLast(new LatencySnapshot[LatencyMetric_Count]),
+    m_pIntervals(new LatencySnapshot[LatencyMetric_Count])
+{
+    memset(m_pLast, 0, LatencyMetric_Count * sizeof(LatencySnapshot));
+    memset(m_pIntervals, 0, LatencyMetric_Count * sizeof(LatencySnapshot));
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+LatencyIntervals::~LatencyIntervals()
+{
+    delete [] m_pLast;
+    delete [] m_pIntervals;
+}
+
+/// <summary>
+/// Ends the current interval and starts the next one
+/// </summary>
+/// <param name="pMonitor">monitor to read</param>
+void LatencyIntervals::Advance(const LatencyMonitor* pMonitor)
+{
+    for (int i = 0; i < LatencyMetric_Count; ++i)
+    {
+        pMonitor->GetSnapshot(static_cast<LatencyMetric>(i), &m_pIntervals[i]);
+        m_pIntervals[i].MakeInterval(&m_pLast[i]);
+    }
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+LatencyCsvLog::LatencyCsvLog() :
+    m_pFile(nullptr)
+{
+}
+
+/// <summary>
+/// Destructor; closes the file
+/// </summary>
+LatencyCsvLog::~LatencyCsvLog()
+{
+    if (m_pFile)
+    {
+        fclose(m_pFile);
+    }
+}
+
+/// <summary>
+/// Creates the log file
+/// </summary>
+/// <param name="szPath">path of the file</param>
+/// <returns>indicates success or failure</returns>
+HRESULT LatencyCsvLog::Open(const char* szPath)
+{
+    if (m_pFile)
+    {
+        return E_UNEXPECTED;
+    }
+
+#if defined(_WIN32)
+    if (0 != fopen_s(&m_pFile, szPath, "w"))
+    {
+        m_pFile = nullptr;
+    }
+#else
+    m_pFile = fopen(szPath, "w");
+#endif
+
+    if (nullptr == m_pFile)
+    {
+        return E_FAIL;
+    }
+
+    fprintf(m_pFile, "seconds,metric,count,p50_ms,p90_ms,p99_ms,p999_ms,run_max_ms\n");
+    return S_OK;
+}
+
+/// <summary>
+/// Writes the rows of an interval
+/// </summary>
+/// <param name="pIntervals">interval to write</param>
+/// <param name="fElapsedSeconds">time from the start of the run to the end of the interval, the first column</param>
+/// <returns>indicates success or failure</returns>
+HRESULT LatencyCsvLog::WriteInterval(const LatencyIntervals* pIntervals, double fElapsedSeconds)
+{
+    if (nullptr == m_pFile)
+    {
+        return E_UNEXPECTED;
+    }
+
+    for (int i = 0; i < LatencyMetric_Count; ++i)
+    {
+        LatencyMetric metric = static_cast<LatencyMetric>(i);
+        const LatencySnapshot& interval = pIntervals->GetInterval(metric);
+
+        if (interval.nTotal > 0)
+        {
+            fprintf(m_pFile, "%.3f,%s,%llu,%.3f,%.3f,%.3f,%.3f,%.3f\n", fElapsedSeconds, GetLatencyMetricName(metric),
+                static_cast<unsigned long long>(interval.nTotal),
+                interval.GetPercentileNs(0.5) / 1e6, interval.GetPercentileNs(0.9) / 1e6,
+                interval.GetPercentileNs(0.99) / 1e6, interval.GetPercentileNs(0.999) / 1e6,
+                interval.nMaxNs / 1e6);
+        }
+    }
+
+    fflush(m_pFile);
+
+    return ferror(m_pFile) ? E_FAIL : S_OK;
+}
@@ -0,0 +1,283 @@
+//------------------------------------------------------------------------------
+// <copyright file="LatencyHistogram.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Latency histograms cheap enough to stay enabled. Buckets are log-linear, as in HDR
+// histograms: every power of two is split into c_LatencySubBuckets equal buckets, so
+// that any recorded value is known to within 1/c_LatencySubBuckets of itself from 1 ns
+// up to c_LatencyMaxNs. Recording is a bucket lookup and a relaxed counter update by a
+// single writer; readers take snapshots at any time and diff them for an interval.
+
+#pragma once
+
+#include <stdio.h>
+#include <atomic>
+#include "KinectTypes.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Buckets per power of two, a power of two itself
+static const int c_LatencySubBucketBits = 5;
+static const int c_LatencySubBuckets = 1 << c_LatencySubBucketBits;
+
+// Largest latency told apart from larger ones, about 68 seconds; larger ones count as it
+static const int c_LatencyMaxBits = 36;
+static const INT64 c_LatencyMaxNs = (static_cast<INT64>(1) << c_LatencyMaxBits) - 1;
+
+// Buckets needed to cover every latency up to c_LatencyMaxNs
+static const int c_LatencyBucketCount = (c_LatencyMaxBits - c_LatencySubBucketBits + 1) * c_LatencySubBuckets;
+
+// What is timed; each metric must only be recorded by one thread at a time
+enum LatencyMetric
+{
+    // Taking the color frame from the source, up to the body data
+    LatencyMetric_ColorAcquire      = 0,
+
+    // Refreshing the body data of a frame
+    LatencyMetric_BodyRefresh       = 1,
+
+    // Fetching the result of one tracked face
+    LatencyMetric_FaceFetch         = 2,
+
+    // Matching the faces of a frame against the audio beam
+    LatencyMetric_SpeakerMatch      = 3,
+
+    // Converting the color of a frame to BGRA
+    LatencyMetric_Conversion        = 4,
+
+    // Composing the speaker mosaic, or writing the export stream
+    LatencyMetric_Compose           = 5,
+
+    // Drawing and presenting a frame
+    LatencyMetric_Present           = 6,
+
+    // From the wake-up a frame was acquired on to its presentation
+    LatencyMetric_FrameToDisplay    = 7,
+
+    // From reading the audio that a frame's beam state came from to its presentation
+    LatencyMetric_AudioToDisplay    = 8,
+
+    LatencyMetric_Count             = 9
+};
+
+/// <summary>
+/// Short name of a metric, for reports
+/// </summary>
+/// <param name="metric">metric to name</param>
+const char* GetLatencyMetricName(LatencyMetric metric);
+
+/// <summary>
+/// Counts of a histogram at one point in time, or over an interval once another
+/// snapshot was subtracted
+/// </summary>
+struct LatencySnapshot
+{
+    UINT64              nCounts[c_LatencyBucketCount];
+    UINT64              nTotal;
+    INT64               nMaxNs;
+
+    /// <summary>
+    /// Turns the counts into those recorded since an earlier snapshot of the same
+    /// histogram, and moves that snapshot up to now; the maximum stays that of the whole run
+    /// </summary>
+    /// <param name="pLast">earlier snapshot; receives the counts as they were before the call</param>
+    void MakeInterval(LatencySnapshot* pLast);
+
+    /// <summary>
+    /// Latency below which a fraction of the recorded latencies fall
+    /// </summary>
+    /// <param name="fFraction">fraction in [0,1], e.g. 0.99 for the 99th percentile</param>
+    /// <returns>latency in nanoseconds, the middle of its bucket; 0 when nothing was recorded</returns>
+    INT64 GetPercentileNs(double fFraction) const;
+};
+
+class LatencyHistogram
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    LatencyHistogram();
+
+    /// <summary>
+    /// Counts one latency; only one thread may record into a histogram at a time
+    /// </summary>
+    /// <param name="nNs">latency in nanoseconds; negative values count as 0</param>
+    void Record(INT64 nNs)
+    {
+        UINT64 nValue = (nNs <= 0) ? 0 : (nNs > c_LatencyMaxNs) ? c_LatencyMaxNs : static_cast<UINT64>(nNs);
+
+        // a single writer may update with a plain load and store, which unlike an
+        // atomic increment does not lock the bus
+        std::atomic<UINT64>& count = m_counts[GetBucketIndex(nValue)];
+        count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+        if (static_cast<INT64>(nValue) > m_nMaxNs.load(std::memory_order_relaxed))
+        {
+            m_nMaxNs.store(static_cast<INT64>(nValue), std::memory_order_relaxed);
+        }
+    }
+
+    /// <summary>
+    /// Copies the counts; may be called from any thread while another records
+    /// </summary>
+    /// <param name="pSnapshot">receives the counts</param>
+    void GetSnapshot(LatencySnapshot* pSnapshot) const;
+
+    /// <summary>
+    /// Bucket a latency falls in
+    /// </summary>
+    /// <param name="nValue">latency in nanoseconds, at most c_LatencyMaxNs</param>
+    static int GetBucketIndex(UINT64 nValue)
+    {
+        // values below two sub-bucket ranges map one to one, above that every power of
+        // two loses one more low bit
+        int nShift = GetHighestBit(nValue | 1) - c_LatencySubBucketBits;
+        nShift = (nShift > 0) ? nShift : 0;
+
+        return nShift * c_LatencySubBuckets + static_cast<int>(nValue >> nShift);
+    }
+
+    /// <summary>
+    /// Smallest latency falling in a bucket
+    /// </summary>
+    /// <param name="nIndex">bucket</param>
+    static INT64 GetBucketLowerBoundNs(int nIndex);
+
+    /// <summary>
+    /// Number of latencies a bucket spans
+    /// </summary>
+    /// <param name="nIndex">bucket</param>
+    static INT64 GetBucketWidthNs(int nIndex);
+
+private:
+    /// <summary>
+    /// Index of the highest set bit of a non-zero value
+    /// </summary>
+    static int GetHighestBit(UINT64 nValue)
+    {
+#if defined(_MSC_VER) && defined(_M_X64)
+        unsigned long nIndex;
+        _BitScanReverse64(&nIndex, nValue);
+        return static_cast<int>(nIndex);
+#elif defined(_MSC_VER)
+        unsigned long nIndex;
+        if (nValue >> 32)
+        {
+            _BitScanReverse(&nIndex, static_cast<unsigned long>(nValue >> 32));
+            return static_cast<int>(nIndex) + 32;
+        }
+        _BitScanReverse(&nIndex, static_cast<unsigned long>(nValue));
+        return static_cast<int>(nIndex);
+#else
+        return 63 - __builtin_clzll(nValue);
+#endif
+    }
+
+    std::atomic<UINT64>     m_counts[c_LatencyBucketCount];
+    std::atomic<INT64>      m_nMaxNs;
+};
+
+/// <summary>
+/// One histogram per metric, shared by everything that records latencies
+/// </summary>
+class LatencyMonitor
+{
+public:
+    /// <summary>
+    /// Counts one latency of a metric
+    /// </summary>
+    /// <param name="metric">what was timed</param>
+    /// <param name="nNs">latency in nanoseconds</param>
+    void Record(LatencyMetric metric, INT64 nNs)
+    {
+        m_histograms[metric].Record(nNs);
+    }
+
+    /// <summary>
+    /// Copies the counts of a metric
+    /// </summary>
+    /// <param name="metric">metric to copy</param>
+    /// <param name="pSnapshot">receives the counts</param>
+    void GetSnapshot(LatencyMetric metric, LatencySnapshot* pSnapshot) const
+    {
+        m_histograms[metric].GetSnapshot(pSnapshot);
+    }
+
+private:
+    LatencyHistogram        m_histograms[LatencyMetric_Count];
+};
+
+/// <summary>
+/// Latencies of every metric over the interval between the last two calls to Advance
+/// </summary>
+class LatencyIntervals
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    LatencyIntervals();
+
+    /// <summary>
+    /// Destructor
+    /// </summary>
+    ~LatencyIntervals();
+
+    /// <summary>
+    /// Ends the current interval and starts the next one
+    /// </summary>
+    /// <param name="pMonitor">monitor to read</param>
+    void Advance(const LatencyMonitor* pMonitor);
+
+    /// <summary>
+    /// Counts of a metric over the interval that ended with the last call to Advance
+    /// </summary>
+    /// <param name="metric">metric to get</param>
+    const LatencySnapshot& GetInterval(LatencyMetric metric) const { return m_pIntervals[metric]; }
+
+private:
+    // Snapshot of every metric as of the last call to Advance, and the interval that ended there
+    LatencySnapshot*        m_pLast;
+    LatencySnapshot*        m_pIntervals;
+};
+
+/// <summary>
+/// Writes the percentiles of every metric over an interval, one CSV row per metric
+/// that recorded anything; opening the file writes the header
+/// </summary>
+class LatencyCsvLog
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    LatencyCsvLog();
+
+    /// <summary>
+    /// Destructor; closes the file
+    /// </summary>
+    ~LatencyCsvLog();
+
+    /// <summary>
+    /// Creates the log file
+    /// </summary>
+    /// <param name="szPath">path of the file</param>
+    /// <returns>indicates success or failure</returns>
+    HRESULT Open(const char* szPath);
+
+    /// <summary>
+    /// Writes the rows of an interval
+    /// </summary>
+    /// <param name="pIntervals">interval to write</param>
+    /// <param name="fElapsedSeconds">time from the start of the run to the end of the interval, the first column</param>
+    /// <returns>indicates success or failure</returns>
+    HRESULT WriteInterval(const LatencyIntervals* pIntervals, double fElapsedSeconds);
+
+private:
+    FILE*                   m_pFile;
+};
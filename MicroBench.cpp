@@ -0,0 +1,281 @@
+//------------------------------------------------------------------------------
+// <copyright file="MicroBench.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "KinectTypes.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include "PerfClock.h"
+#include "CpuFeatures.h"
+#include "MicroBench.h"
+
+// Version of the JSON layout, bumped whenever a field changes meaning
+static const int c_MicroBenchJsonVersion = 1;
+
+// Target of MicroBenchSink; volatile so that every store happens
+static volatile double s_fMicroBenchSink = 0.0;
+
+/// <summary>
+/// Opens a file using the CRT of the current platform
+/// </summary>
+/// <param name="szPath">path of the file</param>
+/// <param name="szMode">fopen style mode string</param>
+/// <returns>the open file or nullptr on failure</returns>
+static FILE* OpenFile(const char* szPath, const char* szMode)
+{
+    FILE* pFile = nullptr;
+#if defined(_WIN32)
+    if (0 != fopen_s(&pFile, szPath, szMode))
+    {
+        pFile = nullptr;
+    }
+#else
+    pFile = fopen(szPath, szMode);
+#endif
+    return pFile;
+}
+
+/// <summary>
+/// Consumes a value so that the compiler cannot drop the computation that produced it
+/// </summary>
+/// <param name="fValue">value to consume</param>
+void MicroBenchSink(double fValue)
+{
+    s_fMicroBenchSink = fValue;
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+/// <param name="nMinBatchMs">shortest time a batch runs, in milliseconds</param>
+/// <param name="nBatches">number of batches timed for each kernel</param>
+/// <param name="szFilter">only kernels whose name contains it are run, or null for all</param>
+MicroBenchRunner::MicroBenchRunner(int nMinBatchMs, int nBatches, const char* szFilter) :
+    m_nMinBatchNs(static_cast<INT64>((std::max)(nMinBatchMs, 1)) * 1000000),
+    m_nBatches((std::max)(nBatches, 1)),
+    m_filter(szFilter ? szFilter : "")
+{
+    printf("%-36s %12s %12s %14s %12s\n", "kernel", "ns/op", "min ns/op", "MB/s", "ops/batch");
+}
+
+/// <summary>
+/// Times a kernel, prints its row and keeps its result
+/// </summary>
+/// <param name="szName">name of the kernel</param>
+/// <param name="cbPerOp">bytes one operation reads or writes</param>
+/// <param name="kernel">kernel to time</param>
+void MicroBenchRunner::Run(const char* szName, UINT64 cbPerOp, const MicroBenchKernel& kernel)
+{
+    if (!m_filter.empty() && nullptr == strstr(szName, m_filter.c_str()))
+    {
+        return;
+    }
+
+    // grow the batch until it lasts a tenth of the minimum, which also warms the caches
+    // and the branch predictors, then scale it to the minimum
+    UINT64 nIterations = 1;
+    INT64 nElapsedNs = 0;
+    for (;;)
+    {
+        INT64 nStartNs = GetPerfClockNs();
+        kernel(nIterations);
+        nElapsedNs = GetPerfClockNs() - nStartNs;
+
+        if (nElapsedNs * 10 >= m_nMinBatchNs || nIterations >= (1ULL << 40))
+        {
+            break;
+        }
+
+        nIterations *= 2;
+    }
+
+    if (nElapsedNs < m_nMinBatchNs)
+    {
+        nIterations = static_cast<UINT64>(static_cast<double>(nIterations) * m_nMinBatchNs / (std::max)(nElapsedNs, static_cast<INT64>(1))) + 1;
+    }
+
+    std::vector<double> nsPerOp(m_nBatches);
+    for (int i = 0; i < m_nBatches; ++i)
+    {
+        INT64 nStartNs = GetPerfClockNs();
+        kernel(nIterations);
+        nsPerOp[i] = static_cast<double>(GetPerfClockNs() - nStartNs) / nIterations;
+    }
+
+    std::sort(nsPerOp.begin(), nsPerOp.end());
+
+    MicroBenchResult result;
+    result.name = szName;
+    result.fNsPerOp = nsPerOp[nsPerOp.size() / 2];
+    result.fMinNsPerOp = nsPerOp[0];
+    result.cbPerOp = cbPerOp;
+    result.fBytesPerSecond = (result.fNsPerOp > 0.0) ? cbPerOp * 1e9 / result.fNsPerOp : 0.0;
+    result.nIterations = nIterations;
+    result.nBatches = m_nBatches;
+    m_results.push_back(result);
+
+    printf("%-36s %12.2f %12.2f %14.1f %12llu\n", szName, result.fNsPerOp, result.fMinNsPerOp,
+        result.fBytesPerSecond / 1e6, static_cast<unsigned long long>(nIterations));
+}
+
+/// <summary>
+/// Writes results as JSON
+/// </summary>
+/// <param name="szPath">path of the file to write</param>
+/// <param name="results">results to write</param>
+/// <returns>indicates success or failure</returns>
+HRESULT WriteMicroBenchJson(const char* szPath, const std::vector<MicroBenchResult>& results)
+{
+    FILE* pFile = OpenFile(szPath, "w");
+    if (nullptr == pFile)
+    {
+        return E_FAIL;
+    }
+
+    // names are made of letters, digits and separators, so nothing needs escaping
+    fprintf(pFile, "{\n  \"version\": %d,\n  \"cpu\": { \"sse2\": %s, \"sse41\": %s, \"avx2\": %s },\n  \"benchmarks\": [\n",
+        c_MicroBenchJsonVersion, CpuHasSse2() ? "true" : "false", CpuHasSse41() ? "true" : "false", CpuHasAvx2() ? "true" : "false");
+
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const MicroBenchResult& result = results[i];
+        fprintf(pFile, "    { \"name\": \"%s\", \"ns_per_op\": %.3f, \"min_ns_per_op\": %.3f, \"bytes_per_op\": %llu, \"bytes_per_second\": %.0f, \"iterations\": %llu, \"batches\": %d }%s\n",
+            result.name.c_str(), result.fNsPerOp, result.fMinNsPerOp, static_cast<unsigned long long>(result.cbPerOp),
+            result.fBytesPerSecond, static_cast<unsigned long long>(result.nIterations), result.nBatches,
+            (i + 1 < results.size()) ? "," : "");
+    }
+
+    fprintf(pFile, "  ]\n}\n");
+
+    bool bFailed = 0 != ferror(pFile);
+    return (0 != fclose(pFile) || bFailed) ? E_FAIL : S_OK;
+}
+
+/// <summary>
+/// Finds the number a key maps to within one JSON object
+/// </summary>
+/// <param name="object">text of the object</param>
+/// <param name="szKey">key, without quotes</param>
+/// <param name="pfValue">receives the number</param>
+/// <returns>false if the object has no such key</returns>
+static bool FindJsonNumber(const std::string& object, const char* szKey, double* pfValue)
+{
+    std::string key = std::string("\"") + szKey + "\"";
+    size_t nPos = object.find(key);
+    if (std::string::npos == nPos)
+    {
+        return false;
+    }
+
+    nPos = object.find(':', nPos + key.size());
+    if (std::string::npos == nPos)
+    {
+        return false;
+    }
+
+    *pfValue = strtod(object.c_str() + nPos + 1, nullptr);
+    return true;
+}
+
+/// <summary>
+/// Reads results written by WriteMicroBenchJson
+/// </summary>
+/// <param name="szPath">path of the file to read</param>
+/// <param name="pResults">receives the results</param>
+/// <returns>indicates success or failure; E_FAIL if the file holds no results</returns>
+HRESULT ReadMicroBenchJson(const char* szPath, std::vector<MicroBenchResult>* pResults)
+{
+    FILE* pFile = OpenFile(szPath, "r");
+    if (nullptr == pFile)
+    {
+        return E_FAIL;
+    }
+
+    std::string text;
+    char buffer[4096];
+    size_t cbRead;
+    while ((cbRead = fread(buffer, 1, sizeof(buffer), pFile)) > 0)
+    {
+        text.append(buffer, cbRead);
+    }
+    fclose(pFile);
+
+    // every benchmark is a flat object starting with its name; only the layout written
+    // above is understood, not JSON at large
+    pResults->clear();
+    size_t nPos = 0;
+    while (std::string::npos != (nPos = text.find("\"name\"", nPos)))
+    {
+        size_t nStart = text.find('"', text.find(':', nPos) + 1);
+        size_t nEnd = (std::string::npos == nStart) ? std::string::npos : text.find('"', nStart + 1);
+        size_t nObjectEnd = (std::string::npos == nEnd) ? std::string::npos : text.find('}', nEnd);
+        if (std::string::npos == nObjectEnd)
+        {
+            break;
+        }
+
+        std::string object = text.substr(nEnd, nObjectEnd - nEnd);
+        double fValue = 0.0;
+
+        MicroBenchResult result;
+        result.name = text.substr(nStart + 1, nEnd - nStart - 1);
+        result.fNsPerOp = FindJsonNumber(object, "ns_per_op", &fValue) ? fValue : 0.0;
+        result.fMinNsPerOp = FindJsonNumber(object, "min_ns_per_op", &fValue) ? fValue : result.fNsPerOp;
+        result.cbPerOp = FindJsonNumber(object, "bytes_per_op", &fValue) ? static_cast<UINT64>(fValue) : 0;
+        result.fBytesPerSecond = FindJsonNumber(object, "bytes_per_second", &fValue) ? fValue : 0.0;
+        result.nIterations = FindJsonNumber(object, "iterations", &fValue) ? static_cast<UINT64>(fValue) : 0;
+        result.nBatches = FindJsonNumber(object, "batches", &fValue) ? static_cast<int>(fValue) : 0;
+        pResults->push_back(result);
+
+        nPos = nObjectEnd;
+    }
+
+    return pResults->empty() ? E_FAIL : S_OK;
+}
+
+/// <summary>
+/// Prints the change of every result against the baseline result of the same name
+/// </summary>
+/// <param name="results">results of this run</param>
+/// <param name="baseline">results to compare against</param>
+/// <param name="fTolerance">relative slow down above which a kernel counts as regressed, e.g. 0.1</param>
+/// <returns>number of regressed kernels</returns>
+int CompareMicroBenchResults(const std::vector<MicroBenchResult>& results, const std::vector<MicroBenchResult>& baseline, double fTolerance)
+{
+    int nRegressed = 0;
+
+    printf("%-36s %12s %12s %9s\n", "kernel", "baseline", "ns/op", "change");
+
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const MicroBenchResult& result = results[i];
+        const MicroBenchResult* pBase = nullptr;
+
+        for (size_t j = 0; j < baseline.size() && nullptr == pBase; ++j)
+        {
+            if (baseline[j].name == result.name)
+            {
+                pBase = &baseline[j];
+            }
+        }
+
+        if (nullptr == pBase || pBase->fNsPerOp <= 0.0)
+        {
+            printf("%-36s %12s %12.2f %9s\n", result.name.c_str(), "-", result.fNsPerOp, "new");
+            continue;
+        }
+
+        double fChange = result.fNsPerOp / pBase->fNsPerOp - 1.0;
+        bool bRegressed = fChange > fTolerance;
+        nRegressed += bRegressed ? 1 : 0;
+
+        printf("%-36s %12.2f %12.2f %+8.1f%%%s\n", result.name.c_str(), pBase->fNsPerOp, result.fNsPerOp,
+            fChange * 100.0, bRegressed ? "  REGRESSED" : "");
+    }
+
+    return nRegressed;
+}
@@ -0,0 +1,100 @@
+//------------------------------------------------------------------------------
+// <copyright file="MicroBench.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Times small kernels on synthetic data in ns per operation and bytes per second, and
+// keeps the results as JSON so that a run can be compared against a stored baseline.
+// Each kernel is run in batches whose size is calibrated to last a minimum time; the
+// median batch is reported, which keeps the odd preemption out of the numbers.
+
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+#include "KinectTypes.h"
+
+struct MicroBenchResult
+{
+    // Name of the kernel, as group/kernel[/variant]
+    std::string         name;
+
+    // Median and fastest time of one operation over the batches, in nanoseconds
+    double              fNsPerOp;
+    double              fMinNsPerOp;
+
+    // Bytes one operation reads or writes, and the throughput that amounts to at the median
+    UINT64              cbPerOp;
+    double              fBytesPerSecond;
+
+    // Operations in each batch and number of batches timed
+    UINT64              nIterations;
+    int                 nBatches;
+};
+
+// Runs a kernel nIterations times
+typedef std::function<void(UINT64 nIterations)> MicroBenchKernel;
+
+/// <summary>
+/// Consumes a value so that the compiler cannot drop the computation that produced it
+/// </summary>
+/// <param name="fValue">value to consume</param>
+void MicroBenchSink(double fValue);
+
+class MicroBenchRunner
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    /// <param name="nMinBatchMs">shortest time a batch runs, in milliseconds</param>
+    /// <param name="nBatches">number of batches timed for each kernel</param>
+    /// <param name="szFilter">only kernels whose name contains it are run, or null for all</param>
+    MicroBenchRunner(int nMinBatchMs, int nBatches, const char* szFilter);
+
+    /// <summary>
+    /// Times a kernel, prints its row and keeps its result
+    /// </summary>
+    /// <param name="szName">name of the kernel</param>
+    /// <param name="cbPerOp">bytes one operation reads or writes</param>
+    /// <param name="kernel">kernel to time</param>
+    void Run(const char* szName, UINT64 cbPerOp, const MicroBenchKernel& kernel);
+
+    /// <summary>
+    /// Results of the kernels run so far, in order
+    /// </summary>
+    const std::vector<MicroBenchResult>& GetResults() const { return m_results; }
+
+private:
+    INT64                   m_nMinBatchNs;
+    int                     m_nBatches;
+    std::string             m_filter;
+    std::vector<MicroBenchResult> m_results;
+};
+
+/// <summary>
+/// Writes results as JSON
+/// </summary>
+/// <param name="szPath">path of the file to write</param>
+/// <param name="results">results to write</param>
+/// <returns>indicates success or failure</returns>
+HRESULT WriteMicroBenchJson(const char* szPath, const std::vector<MicroBenchResult>& results);
+
+/// <summary>
+/// Reads results written by WriteMicroBenchJson
+/// </summary>
+/// <param name="szPath">path of the file to read</param>
+/// <param name="pResults">receives the results</param>
+/// <returns>indicates success or failure; E_FAIL if the file holds no results</returns>
+HRESULT ReadMicroBenchJson(const char* szPath, std::vector<MicroBenchResult>* pResults);
+
+/// <summary>
+/// Prints the change of every result against the baseline result of the same name
+/// </summary>
+/// <param name="results">results of this run</param>
+/// <param name="baseline">results to compare against</param>
+/// <param name="fTolerance">relative slow down above which a kernel counts as regressed, e.g. 0.1</param>
+/// <returns>number of regressed kernels</returns>
+int CompareMicroBenchResults(const std::vector<MicroBenchResult>& results, const std::vector<MicroBenchResult>& baseline, double fTolerance);
@@ -0,0 +1,217 @@
+//------------------------------------------------------------------------------
+// <copyright file="MosaicCompositor.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "KinectTypes.h"
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include "MosaicCompositor.h"
+
+/// <summary>
+/// Maps the center of a destination pixel to the source pixel under it, for a source
+/// span stretched over a destination span
+/// </summary>
+/// <param name="i">destination pixel, counted from the start of the destination span</param>
+/// <param name="nDest">length of the destination span in pixels</param>
+/// <param name="fSourceStart">start of the source span</param>
+/// <param name="fSourceEnd">end of the source span</param>
+/// <param name="nSourceSize">size of the source image along the span</param>
+/// <returns>source pixel</returns>
+static int MapToSource(int i, int nDest, float fSourceStart, float fSourceEnd, int nSourceSize)
+{
+    float fSource = fSourceStart + (i + 0.5f) * (fSourceEnd - fSourceStart) / nDest;
+    int nFirst = (std::max)(static_cast<int>(floor(fSourceStart)), 0);
+    int nLast = (std::min)(static_cast<int>(ceil(fSourceEnd)), nSourceSize) - 1;
+
+    return (std::max)(nFirst, (std::min)(static_cast<int>(floor(fSource)), nLast));
+}
+
+/// <summary>
+/// Lays out the region of interest of every speaker that will be drawn on a grid of
+/// near-square shape, speakers left to right as they stand in front of the sensor
+/// </summary>
+/// <param name="pFrame">frame holding the face results</param>
+/// <param name="pbIsSpeaker">for each of the BODY_COUNT faces, whether it is speaking</param>
+/// <param name="nWidth">width (in pixels) of the mosaic</param>
+/// <param name="nHeight">height (in pixels) of the mosaic</param>
+/// <param name="pLayout">receives the layout</param>
+/// <returns>number of tiles</returns>
+int LayoutSpeakerMosaic(const SessionFrame* pFrame, const bool* pbIsSpeaker, int nWidth, int nHeight, MosaicLayout* pLayout)
+{
+    pLayout->nWidth = nWidth;
+    pLayout->nHeight = nHeight;
+    pLayout->nTiles = 0;
+
+    // the same regions the renderer transfers, sorted by their horizontal center
+    for (int iFace = 0; iFace < BODY_COUNT; ++iFace)
+    {
+        const FaceSample& face = pFrame->faces[iFace];
+        if (!pbIsSpeaker[iFace] || !ValidateFaceBoxAndPoints(&face.faceBox, face.facePoints, pFrame->nColorWidth, pFrame->nColorHeight))
+        {
+            continue;
+        }
+
+        RoiRect roi;
+        GetEnlargedFaceRect(&face.faceBox, pFrame->nColorWidth, pFrame->nColorHeight, &roi);
+
+        int i = pLayout->nTiles++;
+        for (; i > 0 && pLayout->tiles[i - 1].source.left + pLayout->tiles[i - 1].source.right > roi.left + roi.right; --i)
+        {
+            pLayout->tiles[i] = pLayout->tiles[i - 1];
+        }
+        pLayout->tiles[i].source = roi;
+    }
+
+    int nTiles = pLayout->nTiles;
+    if (0 == nTiles)
+    {
+        return 0;
+    }
+
+    int nColumns = static_cast<int>(ceil(sqrt(static_cast<double>(nTiles))));
+    int nRows = (nTiles + nColumns - 1) / nColumns;
+
+    for (int i = 0; i < nTiles; ++i)
+    {
+        int iRow = i / nColumns;
+        int iColumn = i % nColumns;
+
+        // an incomplete last row is centered
+        int nInRow = (std::min)(nColumns, nTiles - iRow * nColumns);
+        int nOffset = (nColumns - nInRow) * nWidth / (2 * nColumns);
+
+        RectI& dest = pLayout->tiles[i].dest;
+        dest.Left = nOffset + iColumn * nWidth / nColumns;
+        dest.Right = nOffset + (iColumn + 1) * nWidth / nColumns;
+        dest.Top = iRow * nHeight / nRows;
+        dest.Bottom = (iRow + 1) * nHeight / nRows;
+    }
+
+    return nTiles;
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+/// <param name="nWidth">width (in pixels) of the mosaic</param>
+/// <param name="nHeight">height (in pixels) of the mosaic</param>
+/// <param name="scaling">how tiles are resampled from the color frame</param>
+MosaicCompositor::MosaicCompositor(int nWidth, int nHeight, ScaleMethod scaling) :
+    m_nWidth(nWidth),
+    m_nHeight(nHeight),
+    m_pixels(static_cast<size_t>(nWidth) * nHeight * sizeof(UINT32)),
+    m_scaling(scaling),
+    m_sourceColumns(static_cast<size_t>(nWidth) * BODY_COUNT)
+{
+}
+
+/// <summary>
+/// Composes the mosaic. Every mosaic pixel is written exactly once, so the cost
+/// depends on the mosaic size, not on the number of tiles; pixels outside every tile
+/// are black. Tiles only read the source pixels their regions touch.
+/// </summary>
+/// <param name="pLayout">layout of the same size as the mosaic</param>
+/// <param name="pSource">BGRA color frame, valid at least within the tile sources</param>
+/// <param name="nSourceWidth">width (in pixels) of the color frame</param>
+/// <param name="nSourceHeight">height (in pixels) of the color frame</param>
+/// <param name="nSourceStride">length (in bytes) of a row of the color frame</param>
+void MosaicCompositor::Compose(const MosaicLayout* pLayout, const BYTE* pSource, int nSourceWidth, int nSourceHeight, int nSourceStride)
+{
+    int nTiles = (std::min)(pLayout->nTiles, static_cast<int>(BODY_COUNT));
+
+    if (ScaleMethod_Nearest != m_scaling)
+    {
+        ClearOutsideTiles(pLayout, nTiles);
+
+        for (int i = 0; i < nTiles; ++i)
+        {
+            const MosaicTile& tile = pLayout->tiles[i];
+            ScaleOutput output;
+            output.pPixels = &m_pixels[0] + static_cast<size_t>(tile.dest.Top) * GetStride() + tile.dest.Left * sizeof(UINT32);
+            output.nStride = GetStride();
+            output.nWidth = tile.dest.Right - tile.dest.Left;
+            output.nHeight = tile.dest.Bottom - tile.dest.Top;
+            output.method = m_scaling;
+
+            m_scaler.Scale(pSource, nSourceWidth, nSourceHeight, nSourceStride, &tile.source, &output, 1);
+        }
+
+        return;
+    }
+
+    // nearest neighbor: the source column of every tile column is the same on every row
+    for (int i = 0; i < nTiles; ++i)
+    {
+        const MosaicTile& tile = pLayout->tiles[i];
+        int nTileWidth = tile.dest.Right - tile.dest.Left;
+        int* pColumns = &m_sourceColumns[static_cast<size_t>(i) * m_nWidth];
+
+        for (int x = 0; x < nTileWidth; ++x)
+        {
+            pColumns[x] = MapToSource(x, nTileWidth, tile.source.left, tile.source.right, nSourceWidth);
+        }
+    }
+
+    // one pass over the mosaic rows, each gathering from the source rows of the tiles
+    // crossing it
+    for (int y = 0; y < m_nHeight; ++y)
+    {
+        UINT32* pRow = reinterpret_cast<UINT32*>(&m_pixels[0] + static_cast<size_t>(y) * GetStride());
+        int x = 0;
+
+        for (int i = 0; i < nTiles; ++i)
+        {
+            const MosaicTile& tile = pLayout->tiles[i];
+            if (y < tile.dest.Top || y >= tile.dest.Bottom)
+            {
+                continue;
+            }
+
+            memset(pRow + x, 0, (tile.dest.Left - x) * sizeof(UINT32));
+
+            int ySource = MapToSource(y - tile.dest.Top, tile.dest.Bottom - tile.dest.Top, tile.source.top, tile.source.bottom, nSourceHeight);
+            const UINT32* pSourceRow = reinterpret_cast<const UINT32*>(pSource + static_cast<size_t>(ySource) * nSourceStride);
+            const int* pColumns = &m_sourceColumns[static_cast<size_t>(i) * m_nWidth];
+            UINT32* pDest = pRow + tile.dest.Left;
+            int nTileWidth = tile.dest.Right - tile.dest.Left;
+
+            for (int iColumn = 0; iColumn < nTileWidth; ++iColumn)
+            {
+                pDest[iColumn] = pSourceRow[pColumns[iColumn]];
+            }
+
+            x = tile.dest.Right;
+        }
+
+        memset(pRow + x, 0, (m_nWidth - x) * sizeof(UINT32));
+    }
+}
+
+/// <summary>
+/// Blackens the mosaic pixels outside every tile
+/// </summary>
+/// <param name="pLayout">layout of the same size as the mosaic</param>
+/// <param name="nTiles">number of tiles to leave out</param>
+void MosaicCompositor::ClearOutsideTiles(const MosaicLayout* pLayout, int nTiles)
+{
+    for (int y = 0; y < m_nHeight; ++y)
+    {
+        UINT32* pRow = reinterpret_cast<UINT32*>(&m_pixels[0] + static_cast<size_t>(y) * GetStride());
+        int x = 0;
+
+        for (int i = 0; i < nTiles; ++i)
+        {
+            const MosaicTile& tile = pLayout->tiles[i];
+            if (y >= tile.dest.Top && y < tile.dest.Bottom)
+            {
+                memset(pRow + x, 0, (tile.dest.Left - x) * sizeof(UINT32));
+                x = tile.dest.Right;
+            }
+        }
+
+        memset(pRow + x, 0, (m_nWidth - x) * sizeof(UINT32));
+    }
+}
@@ -0,0 +1,105 @@
+//------------------------------------------------------------------------------
+// <copyright file="MosaicCompositor.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Lays out the regions of interest of every active speaker as tiles of a mosaic of
+// fixed size and composes the mosaic from the color frame, with nearest neighbor
+// sampling in a single pass or resampled tile by tile by a RoiScaler.
+
+#pragma once
+
+#include <vector>
+#include "KinectTypes.h"
+#include "SessionRecording.h"
+#include "SpeakerSelection.h"
+#include "RoiScaler.h"
+
+// Size of the speaker mosaic, independent of the number of speakers
+static const int c_MosaicWidth = 1280;
+static const int c_MosaicHeight = 720;
+
+/// <summary>
+/// One speaker region of interest and where it goes in the mosaic
+/// </summary>
+struct MosaicTile
+{
+    // Region of the color frame shown in the tile
+    RoiRect             source;
+
+    // Cell of the mosaic the region is stretched over; right and bottom are exclusive
+    RectI               dest;
+};
+
+/// <summary>
+/// Tiles of a mosaic, ordered top to bottom and then left to right
+/// </summary>
+struct MosaicLayout
+{
+    int                 nWidth;
+    int                 nHeight;
+    int                 nTiles;
+    MosaicTile          tiles[BODY_COUNT];
+};
+
+/// <summary>
+/// Lays out the region of interest of every speaker that will be drawn on a grid of
+/// near-square shape, speakers left to right as they stand in front of the sensor
+/// </summary>
+/// <param name="pFrame">frame holding the face results</param>
+/// <param name="pbIsSpeaker">for each of the BODY_COUNT faces, whether it is speaking</param>
+/// <param name="nWidth">width (in pixels) of the mosaic</param>
+/// <param name="nHeight">height (in pixels) of the mosaic</param>
+/// <param name="pLayout">receives the layout</param>
+/// <returns>number of tiles</returns>
+int LayoutSpeakerMosaic(const SessionFrame* pFrame, const bool* pbIsSpeaker, int nWidth, int nHeight, MosaicLayout* pLayout);
+
+class MosaicCompositor
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    /// <param name="nWidth">width (in pixels) of the mosaic</param>
+    /// <param name="nHeight">height (in pixels) of the mosaic</param>
+    /// <param name="scaling">how tiles are resampled from the color frame</param>
+    MosaicCompositor(int nWidth, int nHeight, ScaleMethod scaling = ScaleMethod_Auto);
+
+    /// <summary>
+    /// Composes the mosaic. Every mosaic pixel is written exactly once, so the cost
+    /// depends on the mosaic size, not on the number of tiles; pixels outside every tile
+    /// are black. Tiles only read the source pixels their regions touch.
+    /// </summary>
+    /// <param name="pLayout">layout of the same size as the mosaic</param>
+    /// <param name="pSource">BGRA color frame, valid at least within the tile sources</param>
+    /// <param name="nSourceWidth">width (in pixels) of the color frame</param>
+    /// <param name="nSourceHeight">height (in pixels) of the color frame</param>
+    /// <param name="nSourceStride">length (in bytes) of a row of the color frame</param>
+    void Compose(const MosaicLayout* pLayout, const BYTE* pSource, int nSourceWidth, int nSourceHeight, int nSourceStride);
+
+    const BYTE* GetPixels() const { return &m_pixels[0]; }
+    int GetWidth() const { return m_nWidth; }
+    int GetHeight() const { return m_nHeight; }
+    int GetStride() const { return m_nWidth * sizeof(UINT32); }
+    ScaleMethod GetScaling() const { return m_scaling; }
+
+private:
+    /// <summary>
+    /// Blackens the mosaic pixels outside every tile
+    /// </summary>
+    /// <param name="pLayout">layout of the same size as the mosaic</param>
+    /// <param name="nTiles">number of tiles to leave out</param>
+    void ClearOutsideTiles(const MosaicLayout* pLayout, int nTiles);
+
+    int                     m_nWidth;
+    int                     m_nHeight;
+    std::vector<BYTE>       m_pixels;
+
+    ScaleMethod             m_scaling;
+    RoiScaler               m_scaler;
+
+    // Source column of every destination column of every tile, computed once per
+    // frame; tile i uses the m_nWidth entries starting at i * m_nWidth
+    std::vector<int>        m_sourceColumns;
+};
@@ -0,0 +1,78 @@
+//------------------------------------------------------------------------------
+// <copyright file="PerfClock.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Monotonic high resolution clock shared by replay pacing and instrumentation, and the
+// CPU time of the process for measuring how busy it keeps the machine
+
+#pragma once
+
+#include "KinectTypes.h"
+
+#if !defined(_WIN32)
+#include <time.h>
+#endif
+
+/// <summary>
+/// Reads the monotonic high resolution clock
+/// </summary>
+/// <returns>current time in nanoseconds from an arbitrary origin</returns>
+inline INT64 GetPerfClockNs()
+{
+#if defined(_WIN32)
+    static LARGE_INTEGER s_qpf = {0};
+    if (0 == s_qpf.QuadPart)
+    {
+        QueryPerformanceFrequency(&s_qpf);
+    }
+
+    LARGE_INTEGER qpc = {0};
+    QueryPerformanceCounter(&qpc);
+
+    // split to avoid overflowing 64 bits at high counter frequencies
+    INT64 nSeconds = qpc.QuadPart / s_qpf.QuadPart;
+    INT64 nRemainder = qpc.QuadPart % s_qpf.QuadPart;
+    return nSeconds * 1000000000 + (nRemainder * 1000000000) / s_qpf.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<INT64>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+/// <summary>
+/// Reads the monotonic high resolution clock in the unit of Kinect RelativeTime
+/// </summary>
+/// <returns>current time in 100ns ticks from an arbitrary origin</returns>
+inline INT64 GetPerfClockTicks()
+{
+    return GetPerfClockNs() / 100;
+}
+
+/// <summary>
+/// Reads the CPU time consumed by the process so far, user and kernel, on all threads
+/// </summary>
+/// <returns>CPU time in nanoseconds</returns>
+inline INT64 GetProcessCpuNs()
+{
+#if defined(_WIN32)
+    FILETIME creationTime, exitTime, kernelTime, userTime;
+    if (!GetProcessTimes(GetCurrentProcess(), &creationTime, &exitTime, &kernelTime, &userTime))
+    {
+        return 0;
+    }
+
+    ULARGE_INTEGER kernel100ns, user100ns;
+    kernel100ns.LowPart = kernelTime.dwLowDateTime;
+    kernel100ns.HighPart = kernelTime.dwHighDateTime;
+    user100ns.LowPart = userTime.dwLowDateTime;
+    user100ns.HighPart = userTime.dwHighDateTime;
+    return static_cast<INT64>(kernel100ns.QuadPart + user100ns.QuadPart) * 100;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return static_cast<INT64>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+#endif
+}
@@ -0,0 +1,376 @@
+//------------------------------------------------------------------------------
+// <copyright file="PipelineWorkerPool.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "KinectTypes.h"
+#include <string.h>
+#include <algorithm>
+#include "PerfClock.h"
+#include "PipelineWorkerPool.h"
+
+/// <summary>
+/// Constructor; starts the workers
+/// </summary>
+/// <param name="nWorkers">worker threads, or 0 for one per hardware thread</param>
+PipelineWorkerPool::PipelineWorkerPool(int nWorkers) :
+    m_bStopping(false)
+{
+    memset(&m_stats, 0, sizeof(m_stats));
+
+    if (nWorkers <= 0)
+    {
+        nWorkers = (std::max)(static_cast<int>(std::thread::hardware_concurrency()), 1);
+    }
+
+    m_stats.nWorkers = nWorkers;
+    for (int i = 0; i < nWorkers; ++i)
+    {
+        m_workers.push_back(std::thread(&PipelineWorkerPool::WorkerThread, this, i));
+    }
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+PipelineWorkerPool::~PipelineWorkerPool()
+{
+    Stop();
+
+    for (size_t i = 0; i < m_slots.size(); ++i)
+    {
+        delete m_slots[i];
+    }
+}
+
+/// <summary>
+/// Starts a pipeline on the pool. Its stages run serially, whatever the options say,
+/// and its frame ready callback is taken over by the pool.
+/// </summary>
+/// <param name="pPipeline">pipeline to run; must outlive the pool</param>
+/// <param name="pSource">source of the frames; must outlive the pool</param>
+/// <param name="pWakeup">wake-up the source signals, used by no other pipeline; must outlive the pool</param>
+/// <param name="options">how the stages run</param>
+/// <param name="pfnFrame">called for every composed frame</param>
+/// <param name="pContext">passed to the frame callback</param>
+/// <returns>indicates success or failure</returns>
+HRESULT PipelineWorkerPool::Add(SpeakerPipeline* pPipeline, IFrameSource* pSource, FrameWakeup* pWakeup, const SpeakerPipelineOptions& options,
+    PipelineFrameCallback pfnFrame, void* pContext)
+{
+    if (nullptr == pPipeline || nullptr == pfnFrame)
+    {
+        return E_INVALIDARG;
+    }
+
+    Slot* pSlot = new Slot();
+    pSlot->pPool = this;
+    pSlot->pPipeline = pPipeline;
+    pSlot->pfnFrame = pfnFrame;
+    pSlot->pContext = pContext;
+    pSlot->bQueued = false;
+    pSlot->bRunning = false;
+    pSlot->bSignalled = false;
+    pSlot->bFinished = false;
+    pSlot->bRemoving = false;
+    pSlot->nLastWorker = -1;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_bStopping)
+        {
+            delete pSlot;
+            return E_UNEXPECTED;
+        }
+
+        m_slots.push_back(pSlot);
+        m_stats.nPipelines++;
+    }
+
+    // serial stages, with the wake-up of the source queueing the pipeline
+    SpeakerPipelineOptions pooledOptions = options;
+    pooledOptions.bThreaded = false;
+    pooledOptions.pfnFrameReady = &PipelineWorkerPool::OnFrameReady;
+    pooledOptions.pContext = pSlot;
+
+    HRESULT hr = pPipeline->Start(pSource, pWakeup, pooledOptions);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (FAILED(hr))
+    {
+        // counts as finished, so that nobody waits for it
+        pSlot->bFinished = true;
+        m_stats.nFinished++;
+        m_pipelineFinished.notify_all();
+    }
+    else
+    {
+        // whatever the source signalled before the callback was in place is picked up
+        Schedule(pSlot);
+    }
+
+    return hr;
+}
+
+/// <summary>
+/// Takes a pipeline off the pool, waiting for a run of it in progress to end, and
+/// stops it; it may be deleted afterwards
+/// </summary>
+/// <param name="pPipeline">pipeline added to the pool</param>
+/// <returns>indicates success or failure</returns>
+HRESULT PipelineWorkerPool::Remove(SpeakerPipeline* pPipeline)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    std::vector<Slot*>::iterator it = m_slots.begin();
+    while (it != m_slots.end() && (*it)->pPipeline != pPipeline)
+    {
+        ++it;
+    }
+
+    if (it == m_slots.end() || (*it)->bRemoving)
+    {
+        return E_INVALIDARG;
+    }
+
+    RemoveSlot(lock, *it);
+    return S_OK;
+}
+
+/// <summary>
+/// Waits for a pipeline on the pool to finish and takes it off the pool as Remove does
+/// </summary>
+/// <param name="nTimeoutMs">longest time to wait, in milliseconds</param>
+/// <returns>the pipeline taken off, or nullptr if none finished in time</returns>
+SpeakerPipeline* PipelineWorkerPool::TakeFinished(int nTimeoutMs)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    Slot* pFinished = nullptr;
+
+    m_pipelineFinished.wait_for(lock, std::chrono::milliseconds(nTimeoutMs), [this, &pFinished]()
+    {
+        for (size_t i = 0; i < m_slots.size(); ++i)
+        {
+            if (m_slots[i]->bFinished && !m_slots[i]->bRemoving)
+            {
+                pFinished = m_slots[i];
+                return true;
+            }
+        }
+        return false;
+    });
+
+    if (nullptr == pFinished)
+    {
+        return nullptr;
+    }
+
+    SpeakerPipeline* pPipeline = pFinished->pPipeline;
+    RemoveSlot(lock, pFinished);
+    return pPipeline;
+}
+
+/// <summary>
+/// Takes a slot off the pool once no worker runs it, stops its pipeline and deletes the
+/// slot. Must be called with the pool mutex held, which is let go of meanwhile.
+/// </summary>
+/// <param name="lock">lock on the pool mutex</param>
+/// <param name="pSlot">slot to remove</param>
+void PipelineWorkerPool::RemoveSlot(std::unique_lock<std::mutex>& lock, Slot* pSlot)
+{
+    // a worker running it lets go after the frame at hand, and nobody queues it again
+    pSlot->bRemoving = true;
+    m_runEnded.wait(lock, [pSlot]() { return !pSlot->bRunning; });
+
+    if (pSlot->bQueued)
+    {
+        m_runQueue.erase(std::find(m_runQueue.begin(), m_runQueue.end(), pSlot));
+        pSlot->bQueued = false;
+    }
+
+    // the wake-up calls back with the slot until the source is stopped
+    lock.unlock();
+    pSlot->pPipeline->Stop();
+    lock.lock();
+
+    m_slots.erase(std::find(m_slots.begin(), m_slots.end(), pSlot));
+    m_stats.nPipelines--;
+    if (pSlot->bFinished)
+    {
+        m_stats.nFinished--;
+    }
+
+    delete pSlot;
+}
+
+/// <summary>
+/// Blocks until every pipeline added has finished or the timeout elapses
+/// </summary>
+/// <param name="nTimeoutMs">longest time to wait, in milliseconds</param>
+/// <returns>true if every pipeline has finished</returns>
+bool PipelineWorkerPool::WaitUntilFinished(int nTimeoutMs)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    return m_pipelineFinished.wait_for(lock, std::chrono::milliseconds(nTimeoutMs),
+        [this]() { return m_stats.nFinished == m_stats.nPipelines; });
+}
+
+/// <summary>
+/// Stops the workers, then every pipeline still on the pool
+/// </summary>
+void PipelineWorkerPool::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_bStopping = true;
+        m_runQueue.clear();
+    }
+
+    m_workAvailable.notify_all();
+
+    for (size_t i = 0; i < m_workers.size(); ++i)
+    {
+        if (m_workers[i].joinable())
+        {
+            m_workers[i].join();
+        }
+    }
+
+    // no worker runs a pipeline any more, so they can be stopped from here
+    for (size_t i = 0; i < m_slots.size(); ++i)
+    {
+        m_slots[i]->pPipeline->Stop();
+    }
+}
+
+/// <summary>
+/// Snapshot of the pool counters
+/// </summary>
+/// <param name="pStats">receives the counters</param>
+void PipelineWorkerPool::GetStats(PipelineWorkerPoolStats* pStats) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    *pStats = m_stats;
+}
+
+/// <summary>
+/// Wake-up callback of every pipeline on the pool, run on the thread of its source
+/// </summary>
+/// <param name="pContext">slot of the pipeline</param>
+void PipelineWorkerPool::OnFrameReady(void* pContext)
+{
+    Slot* pSlot = static_cast<Slot*>(pContext);
+    PipelineWorkerPool* pThis = pSlot->pPool;
+
+    std::lock_guard<std::mutex> lock(pThis->m_mutex);
+    pSlot->bSignalled = true;
+    pThis->Schedule(pSlot);
+}
+
+/// <summary>
+/// Queues a pipeline for a worker unless it is queued or running already; a running
+/// one is queued again by its worker once it sees the signal. Must be called with the
+/// pool mutex held.
+/// </summary>
+/// <param name="pSlot">slot of the pipeline</param>
+void PipelineWorkerPool::Schedule(Slot* pSlot)
+{
+    if (pSlot->bQueued || pSlot->bRunning || pSlot->bFinished || pSlot->bRemoving || m_bStopping)
+    {
+        return;
+    }
+
+    pSlot->bQueued = true;
+    m_runQueue.push_back(pSlot);
+    m_workAvailable.notify_one();
+}
+
+/// <summary>
+/// Takes queued pipelines in turn and runs one frame of each through every stage; with
+/// no other pipeline waiting, the worker stays with the one it ran last
+/// </summary>
+/// <param name="nWorker">index of the worker</param>
+void PipelineWorkerPool::WorkerThread(int nWorker)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    Slot* pSlot = nullptr;
+
+    for (;;)
+    {
+        if (nullptr == pSlot)
+        {
+            m_workAvailable.wait(lock, [this]() { return m_bStopping || !m_runQueue.empty(); });
+            if (m_bStopping)
+            {
+                break;
+            }
+
+            pSlot = m_runQueue.front();
+            m_runQueue.pop_front();
+            pSlot->bQueued = false;
+            pSlot->bRunning = true;
+        }
+        else if (m_bStopping)
+        {
+            pSlot->bRunning = false;
+            m_runEnded.notify_all();
+            break;
+        }
+
+        pSlot->bSignalled = false;
+
+        m_stats.nRuns++;
+        if (pSlot->nLastWorker >= 0 && pSlot->nLastWorker != nWorker)
+        {
+            m_stats.nMigrations++;
+        }
+        pSlot->nLastWorker = nWorker;
+
+        lock.unlock();
+
+        INT64 nStartNs = GetPerfClockNs();
+        PipelineFrame* pFrame = pSlot->pPipeline->TakeComposedFrame(0);
+        if (pFrame)
+        {
+            pSlot->pfnFrame(pSlot->pContext, pSlot->pPipeline, pFrame);
+            pSlot->pPipeline->ReleaseFrame(pFrame);
+        }
+
+        bool bFinished = pSlot->pPipeline->IsFinished();
+        INT64 nBusyNs = GetPerfClockNs() - nStartNs;
+
+        lock.lock();
+        m_stats.nBusyNs += nBusyNs;
+
+        if (pFrame)
+        {
+            m_stats.nFrames++;
+        }
+
+        // another frame may be pending already; if not, the next run finds out without
+        // waiting and the pipeline goes idle until its source signals
+        bool bRunAgain = !bFinished && (pFrame || pSlot->bSignalled);
+
+        if (bRunAgain && m_runQueue.empty() && !pSlot->bRemoving)
+        {
+            // still running, so the source cannot queue it meanwhile
+            continue;
+        }
+
+        pSlot->bRunning = false;
+        m_runEnded.notify_all();
+        if (bFinished)
+        {
+            pSlot->bFinished = true;
+            m_stats.nFinished++;
+            m_pipelineFinished.notify_all();
+        }
+        else if (bRunAgain)
+        {
+            Schedule(pSlot);
+        }
+
+        pSlot = nullptr;
+    }
+}
@@ -0,0 +1,155 @@
+//------------------------------------------------------------------------------
+// <copyright file="PipelineWorkerPool.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Runs any number of independent speaker pipelines, each with a source of its own, on
+// one set of worker threads sized to the machine, for offline and lab work where one
+// process replays many recordings at once. A threaded pipeline brings three stage
+// threads of its own, so a few dozen of them oversubscribe any machine; here every
+// pipeline runs its stages serially, and its wake-up queues it on the pool whenever its
+// source has a frame. Workers take queued pipelines in turn, run one frame through
+// every stage and hand it to the pipeline's frame callback. A pipeline is only ever run
+// by one worker at a time, so its frames stay in order and its state needs no locks.
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "KinectTypes.h"
+#include "SpeakerPipeline.h"
+
+// Called on a worker for every frame a pipeline composed, before the frame is released
+typedef void (*PipelineFrameCallback)(void* pContext, SpeakerPipeline* pPipeline, PipelineFrame* pFrame);
+
+struct PipelineWorkerPoolStats
+{
+    // Worker threads, and pipelines on the pool and finished of those
+    int                 nWorkers;
+    int                 nPipelines;
+    int                 nFinished;
+
+    // Times a worker took up a pipeline, and frames those runs composed
+    UINT64              nRuns;
+    UINT64              nFrames;
+
+    // Runs on another worker than the pipeline's previous run, which finds none of the
+    // pipeline's state in its caches
+    UINT64              nMigrations;
+
+    // Time the workers spent running pipelines, in nanoseconds
+    INT64               nBusyNs;
+};
+
+class PipelineWorkerPool
+{
+public:
+    /// <summary>
+    /// Constructor; starts the workers
+    /// </summary>
+    /// <param name="nWorkers">worker threads, or 0 for one per hardware thread</param>
+    explicit PipelineWorkerPool(int nWorkers = 0);
+
+    /// <summary>
+    /// Destructor
+    /// </summary>
+    ~PipelineWorkerPool();
+
+    /// <summary>
+    /// Starts a pipeline on the pool. Its stages run serially, whatever the options say,
+    /// and its frame ready callback is taken over by the pool.
+    /// </summary>
+    /// <param name="pPipeline">pipeline to run; must outlive the pool</param>
+    /// <param name="pSource">source of the frames; must outlive the pool</param>
+    /// <param name="pWakeup">wake-up the source signals, used by no other pipeline; must outlive the pool</param>
+    /// <param name="options">how the stages run</param>
+    /// <param name="pfnFrame">called for every composed frame</param>
+    /// <param name="pContext">passed to the frame callback</param>
+    /// <returns>indicates success or failure</returns>
+    HRESULT Add(SpeakerPipeline* pPipeline, IFrameSource* pSource, FrameWakeup* pWakeup, const SpeakerPipelineOptions& options,
+        PipelineFrameCallback pfnFrame, void* pContext);
+
+    /// <summary>
+    /// Takes a pipeline off the pool, waiting for a run of it in progress to end, and
+    /// stops it; it may be deleted afterwards
+    /// </summary>
+    /// <param name="pPipeline">pipeline added to the pool</param>
+    /// <returns>indicates success or failure</returns>
+    HRESULT Remove(SpeakerPipeline* pPipeline);
+
+    /// <summary>
+    /// Waits for a pipeline on the pool to finish and takes it off the pool as Remove does
+    /// </summary>
+    /// <param name="nTimeoutMs">longest time to wait, in milliseconds</param>
+    /// <returns>the pipeline taken off, or nullptr if none finished in time</returns>
+    SpeakerPipeline* TakeFinished(int nTimeoutMs);
+
+    /// <summary>
+    /// Blocks until every pipeline added has finished or the timeout elapses
+    /// </summary>
+    /// <param name="nTimeoutMs">longest time to wait, in milliseconds</param>
+    /// <returns>true if every pipeline has finished</returns>
+    bool WaitUntilFinished(int nTimeoutMs);
+
+    /// <summary>
+    /// Stops the workers, then every pipeline still on the pool
+    /// </summary>
+    void Stop();
+
+    /// <summary>
+    /// Number of worker threads
+    /// </summary>
+    int GetWorkerCount() const { return static_cast<int>(m_workers.size()); }
+
+    /// <summary>
+    /// Snapshot of the pool counters
+    /// </summary>
+    /// <param name="pStats">receives the counters</param>
+    void GetStats(PipelineWorkerPoolStats* pStats) const;
+
+private:
+    /// <summary>
+    /// A pipeline on the pool and its scheduling state, guarded by the pool mutex
+    /// </summary>
+    struct Slot
+    {
+        PipelineWorkerPool*     pPool;
+        SpeakerPipeline*        pPipeline;
+        PipelineFrameCallback   pfnFrame;
+        void*                   pContext;
+
+        // Whether the pipeline waits in the run queue, is being run, was signalled
+        // since its run started, has finished, and is being taken off the pool
+        bool                    bQueued;
+        bool                    bRunning;
+        bool                    bSignalled;
+        bool                    bFinished;
+        bool                    bRemoving;
+
+        // Worker that ran the pipeline last, -1 before its first run
+        int                     nLastWorker;
+    };
+
+    static void OnFrameReady(void* pContext);
+    void RemoveSlot(std::unique_lock<std::mutex>& lock, Slot* pSlot);
+    void Schedule(Slot* pSlot);
+    void WorkerThread(int nWorker);
+
+    mutable std::mutex          m_mutex;
+    std::condition_variable     m_workAvailable;
+    std::condition_variable     m_pipelineFinished;
+    std::condition_variable     m_runEnded;
+    bool                        m_bStopping;
+
+    std::vector<std::thread>    m_workers;
+    std::vector<Slot*>          m_slots;
+
+    // Pipelines waiting for a worker, oldest first
+    std::deque<Slot*>           m_runQueue;
+
+    PipelineWorkerPoolStats     m_stats;
+};
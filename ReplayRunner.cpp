@@ -0,0 +1,121 @@
+//------------------------------------------------------------------------------
+// <copyright file="ReplayRunner.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "KinectTypes.h"
+#include <string.h>
+#include "PerfClock.h"
+#include "AudioCapture.h"
+#include "BeamHistory.h"
+#include "SpeakerSelection.h"
+#include "MosaicCompositor.h"
+#include "ReplayRunner.h"
+
+/// <summary>
+/// Replays a recording through the speaker selection and ROI logic, with speakers only
+/// picked while voice is active as the application does
+/// </summary>
+/// <param name="szPath">path of the recording</param>
+/// <param name="pacing">whether to replay in real time or as fast as possible</param>
+/// <param name="pExporter">optional open exporter receiving every replayed frame</param>
+/// <param name="pStats">receives the replay statistics</param>
+/// <returns>indicates success or failure</returns>
+HRESULT RunReplay(const char* szPath, ReplayPacing pacing, bool bVoiceGate, RoiExporter* pExporter, ReplayStats* pStats)
+{
+    memset(pStats, 0, sizeof(*pStats));
+
+    SessionReplaySource source;
+    HRESULT hr = source.Open(szPath, pacing);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    SessionFrame frame;
+    std::vector<AudioChunk> audio;
+
+    // recorded audio goes through the same meter and ring as live capture
+    AudioCapture audioCapture(0, 0);
+    EnergyRing* pEnergyRing = audioCapture.GetEnergyRing();
+    EnergySample energy[64];
+    size_t nEnergy;
+    BeamHistory beamHistory;
+    BeamState beam;
+    INT64 nFirstTime = 0;
+    INT64 nStartNs = GetPerfClockNs();
+
+    while (S_OK == (hr = source.ReadNextFrame(&frame, &audio)))
+    {
+        for (size_t i = 0; i < audio.size(); ++i)
+        {
+            const AudioChunk& chunk = audio[i];
+            if (!chunk.samples.empty())
+            {
+                audioCapture.ProcessChunk(chunk.nTime, &chunk.samples[0], static_cast<UINT>(chunk.samples.size()), chunk.fBeamAngle, chunk.fBeamAngleConfidence);
+            }
+
+            pStats->nAudioChunks++;
+            pStats->nAudioSamples += chunk.samples.size();
+        }
+
+        // the beam state at the time of the frame, as it is live
+        while ((nEnergy = pEnergyRing->PopMany(energy, _countof(energy))) > 0)
+        {
+            beamHistory.Add(energy, nEnergy);
+        }
+        beamHistory.GetAt(frame.nTime, &beam);
+
+        if (0 == pStats->nFrames)
+        {
+            nFirstTime = frame.nTime;
+        }
+        pStats->nFrames++;
+        pStats->nRecordedTicks = frame.nTime - nFirstTime;
+
+        bool bIsSpeaker[BODY_COUNT];
+        UINT64 cbFrame = static_cast<UINT64>(frame.nColorWidth) * frame.nColorHeight * sizeof(RGBQUAD);
+        UINT64 cbTransfer = cbFrame;
+        RectI transferRect;
+
+        int nSpeakers = SelectSpeakers(&frame, beam.fBeamAngle, beam.fBeamAngleConfidence, bIsSpeaker);
+        if (IsVoiceGated(beam.fBeamAngleConfidence, beam.bVoiceActive, bVoiceGate))
+        {
+            // the beam followed something other than a voice
+            memset(bIsSpeaker, 0, sizeof(bIsSpeaker));
+            nSpeakers = 0;
+            pStats->nFramesVoiceGated++;
+        }
+
+        if (nSpeakers > 0)
+        {
+            pStats->nFramesWithSpeaker++;
+
+            if (GetSpeakerTransferRect(&frame, bIsSpeaker, c_RoiTransferMargin, &transferRect))
+            {
+                cbTransfer = static_cast<UINT64>(transferRect.Right - transferRect.Left) * (transferRect.Bottom - transferRect.Top) * sizeof(RGBQUAD);
+            }
+        }
+
+        pStats->nFullFrameBytes += cbFrame;
+        pStats->nRoiTransferBytes += cbTransfer;
+
+        MosaicLayout layout;
+        pStats->nSpeakerRois += LayoutSpeakerMosaic(&frame, bIsSpeaker, c_MosaicWidth, c_MosaicHeight, &layout);
+
+        if (pExporter)
+        {
+            hr = pExporter->WriteFrame(&frame, bIsSpeaker);
+            if (FAILED(hr))
+            {
+                break;
+            }
+        }
+    }
+
+    pStats->nElapsedNs = GetPerfClockNs() - nStartNs;
+    audioCapture.GetVoiceActivityStats(&pStats->voiceActivity);
+
+    return SUCCEEDED(hr) ? S_OK : hr;
+}
@@ -0,0 +1,59 @@
+//------------------------------------------------------------------------------
+// <copyright file="ReplayRunner.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Runs the speaker ROI selection over a recorded session without a window or sensor
+
+#pragma once
+
+#include "KinectTypes.h"
+#include "SessionRecording.h"
+#include "RoiExport.h"
+#include "VoiceActivity.h"
+
+struct ReplayStats
+{
+    // Color frames replayed
+    UINT64              nFrames;
+
+    // Frames in which at least one speaker was selected
+    UINT64              nFramesWithSpeaker;
+
+    // Frames the beam was confident in while no voice was active, which the voice gate
+    // kept speakers from being picked in; see IsVoiceGated
+    UINT64              nFramesVoiceGated;
+
+    // Voice activity found in the audio, see VoiceActivityDetector
+    VoiceActivityStats  voiceActivity;
+
+    // Speaker regions of interest that passed validation and would have been tiled into the mosaic
+    UINT64              nSpeakerRois;
+
+    // Color bytes the renderer would transfer copying every full frame, and copying
+    // only the speaker regions whenever there are any
+    UINT64              nFullFrameBytes;
+    UINT64              nRoiTransferBytes;
+
+    // Audio chunks and samples consumed
+    UINT64              nAudioChunks;
+    UINT64              nAudioSamples;
+
+    // Span of recorded time covered, in 100ns ticks
+    INT64               nRecordedTicks;
+
+    // Wall clock time spent replaying, in nanoseconds
+    INT64               nElapsedNs;
+};
+
+/// <summary>
+/// Replays a recording through the speaker selection and ROI logic
+/// </summary>
+/// <param name="szPath">path of the recording</param>
+/// <param name="pacing">whether to replay in real time or as fast as possible</param>
+/// <param name="bVoiceGate">whether speakers are only picked while voice is active, as the application does by default</param>
+/// <param name="pExporter">optional open exporter receiving every replayed frame</param>
+/// <param name="pStats">receives the replay statistics</param>
+/// <returns>indicates success or failure</returns>
+HRESULT RunReplay(const char* szPath, ReplayPacing pacing, bool bVoiceGate, RoiExporter* pExporter, ReplayStats* pStats);
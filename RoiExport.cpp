@@ -0,0 +1,405 @@
+//------------------------------------------------------------------------------
+// <copyright file="RoiExport.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "KinectTypes.h"
+#include <string.h>
+#include <algorithm>
+#if defined(_WIN32)
+#include <fcntl.h>
+#include <io.h>
+#endif
+#include "PerfClock.h"
+#include "ColorConversion.h"
+#include "SpeakerSelection.h"
+#include "RoiExport.h"
+
+// Longest FRAME header of a Y4M stream
+static const size_t c_MaxFrameHeader = 64;
+
+/// <summary>
+/// Opens the output of the export, which may be standard output
+/// </summary>
+/// <param name="szPath">path of the file, or "-" for standard output</param>
+/// <param name="pbOwnsFile">receives whether the file has to be closed by the caller</param>
+/// <returns>the open file or nullptr on failure</returns>
+static FILE* OpenOutput(const char* szPath, bool* pbOwnsFile)
+{
+    FILE* pFile = nullptr;
+    *pbOwnsFile = true;
+
+#if defined(_WIN32)
+    if (0 == strcmp(szPath, "-"))
+    {
+        // a windowed process has no CRT stdout of its own, but may have been handed
+        // a pipe or file as its standard output
+        if (_fileno(stdout) >= 0)
+        {
+            _setmode(_fileno(stdout), _O_BINARY);
+            pFile = stdout;
+            *pbOwnsFile = false;
+        }
+        else
+        {
+            HANDLE hOutput = GetStdHandle(STD_OUTPUT_HANDLE);
+            int fd = (hOutput && hOutput != INVALID_HANDLE_VALUE) ? _open_osfhandle(reinterpret_cast<intptr_t>(hOutput), _O_BINARY) : -1;
+            pFile = (fd >= 0) ? _fdopen(fd, "wb") : nullptr;
+        }
+    }
+    else if (0 != fopen_s(&pFile, szPath, "wb"))
+    {
+        pFile = nullptr;
+    }
+#else
+    if (0 == strcmp(szPath, "-"))
+    {
+        pFile = stdout;
+        *pbOwnsFile = false;
+    }
+    else
+    {
+        pFile = fopen(szPath, "wb");
+    }
+#endif
+
+    return pFile;
+}
+
+/// <summary>
+/// Formats the FRAME header of a Y4M frame
+/// </summary>
+/// <param name="nTime">RelativeTime of the frame in 100ns ticks</param>
+/// <param name="szHeader">receives the header, c_MaxFrameHeader characters at most</param>
+/// <returns>length of the header</returns>
+static size_t FormatFrameHeader(INT64 nTime, char* szHeader)
+{
+#if defined(_WIN32)
+    int nLength = sprintf_s(szHeader, c_MaxFrameHeader, "FRAME XRT=%I64d\n", nTime);
+#else
+    int nLength = snprintf(szHeader, c_MaxFrameHeader, "FRAME XRT=%lld\n", static_cast<long long>(nTime));
+#endif
+    return (nLength > 0) ? static_cast<size_t>(nLength) : 0;
+}
+
+/// <summary>
+/// Name of an export format, also the extension of its files
+/// </summary>
+/// <param name="format">format</param>
+/// <returns>y4m, i420 or bgra</returns>
+const char* GetRoiExportFormatName(RoiExportFormat format)
+{
+    static const char* c_szNames[] = { "y4m", "i420", "bgra" };
+    return (format >= RoiExportFormat_Y4m && format <= RoiExportFormat_Bgra) ? c_szNames[format] : "unknown";
+}
+
+/// <summary>
+/// Parses the name of an export format
+/// </summary>
+/// <param name="szName">y4m, i420 or bgra</param>
+/// <param name="pFormat">receives the format</param>
+/// <returns>false for an unknown name</returns>
+bool ParseRoiExportFormat(const char* szName, RoiExportFormat* pFormat)
+{
+    for (int i = RoiExportFormat_Y4m; i <= RoiExportFormat_Bgra; ++i)
+    {
+        if (0 == strcmp(szName, GetRoiExportFormatName(static_cast<RoiExportFormat>(i))))
+        {
+            *pFormat = static_cast<RoiExportFormat>(i);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+RoiExporter::RoiExporter() :
+    m_pFile(nullptr),
+    m_pTimestampFile(nullptr),
+    m_bOwnsFile(false),
+    m_format(RoiExportFormat_Y4m),
+    m_pMosaic(nullptr),
+    m_cbBuffered(0)
+{
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+RoiExporter::~RoiExporter()
+{
+    Close();
+}
+
+/// <summary>
+/// Creates the output stream; all buffers are allocated here, not per frame
+/// </summary>
+/// <param name="szPath">path of the output file, or "-" for standard output</param>
+/// <param name="szTimestampPath">optional path of a CSV file receiving the RelativeTime
+/// of every frame, for the headerless formats</param>
+/// <param name="format">format of the stream</param>
+/// <param name="nWidth">width (in pixels) of the frames, even</param>
+/// <param name="nHeight">height (in pixels) of the frames, even</param>
+/// <param name="scaling">how the speaker regions, or the whole frame, are resampled to the frame size</param>
+/// <returns>indicates success or failure</returns>
+HRESULT RoiExporter::Open(const char* szPath, const char* szTimestampPath, RoiExportFormat format, int nWidth, int nHeight, ScaleMethod scaling)
+{
+    Close();
+
+    if (nullptr == szPath || nWidth <= 0 || nHeight <= 0 || (nWidth % 2) || (nHeight % 2) || scaling < 0 || scaling >= ScaleMethod_Count)
+    {
+        return E_INVALIDARG;
+    }
+
+    m_pFile = OpenOutput(szPath, &m_bOwnsFile);
+    if (nullptr == m_pFile)
+    {
+        return E_FAIL;
+    }
+
+    // the frames are already gathered into large writes, the CRT buffer would only copy them again
+    setvbuf(m_pFile, nullptr, _IONBF, 0);
+
+    if (szTimestampPath && *szTimestampPath)
+    {
+        bool bOwnsTimestampFile;
+        m_pTimestampFile = OpenOutput(szTimestampPath, &bOwnsTimestampFile);
+        if (nullptr == m_pTimestampFile || !bOwnsTimestampFile)
+        {
+            m_pTimestampFile = nullptr;
+            Close();
+            return E_INVALIDARG;
+        }
+
+        fprintf(m_pTimestampFile, "frame,relative_time\n");
+    }
+
+    m_format = format;
+    m_pMosaic = new MosaicCompositor(nWidth, nHeight, scaling);
+
+    size_t cbPixels = static_cast<size_t>(nWidth) * nHeight;
+    size_t cbFrame = (RoiExportFormat_Bgra == format) ? cbPixels * 4 : cbPixels * 3 / 2;
+    m_buffer.resize((std::max)(c_RoiExportBufferSize, cbFrame + c_MaxFrameHeader));
+    m_cbBuffered = 0;
+    memset(&m_stats, 0, sizeof(m_stats));
+
+    if (RoiExportFormat_Y4m == format)
+    {
+        // C420jpeg: chroma sited between the four luma samples it was averaged from
+#if defined(_WIN32)
+        int nLength = sprintf_s(reinterpret_cast<char*>(&m_buffer[0]), m_buffer.size(),
+#else
+        int nLength = snprintf(reinterpret_cast<char*>(&m_buffer[0]), m_buffer.size(),
+#endif
+            "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", nWidth, nHeight, c_RoiExportFramesPerSecond);
+        m_cbBuffered = (nLength > 0) ? nLength : 0;
+    }
+
+    return S_OK;
+}
+
+/// <summary>
+/// Composes the speaker regions of a frame, or the whole frame when nobody speaks,
+/// at the output size and appends the result to the stream
+/// </summary>
+/// <param name="pFrame">frame holding the color and face data</param>
+/// <param name="pbIsSpeaker">for each of the BODY_COUNT faces, whether it is speaking</param>
+/// <returns>indicates success or failure; a failed write closes the stream</returns>
+HRESULT RoiExporter::WriteFrame(const SessionFrame* pFrame, const bool* pbIsSpeaker)
+{
+    if (nullptr == m_pFile)
+    {
+        return E_UNEXPECTED;
+    }
+
+    INT64 nStartNs = GetPerfClockNs();
+    INT64 nWriteNs = m_stats.nWriteNs;
+    int nWidth = m_pMosaic->GetWidth();
+    int nHeight = m_pMosaic->GetHeight();
+
+    MosaicLayout layout;
+    RectI rect;
+
+    if (LayoutSpeakerMosaic(pFrame, pbIsSpeaker, nWidth, nHeight, &layout) > 0 &&
+        GetSpeakerTransferRect(pFrame, pbIsSpeaker, c_RoiTransferMargin, &rect))
+    {
+        m_stats.nSpeakerFrames++;
+    }
+    else
+    {
+        // nobody speaks: the whole frame, as the window shows it
+        rect.Left = 0;
+        rect.Top = 0;
+        rect.Right = pFrame->nColorWidth;
+        rect.Bottom = pFrame->nColorHeight;
+
+        layout.nTiles = 1;
+        layout.tiles[0].source.left = 0.0f;
+        layout.tiles[0].source.top = 0.0f;
+        layout.tiles[0].source.right = static_cast<float>(pFrame->nColorWidth);
+        layout.tiles[0].source.bottom = static_cast<float>(pFrame->nColorHeight);
+        layout.tiles[0].dest.Left = 0;
+        layout.tiles[0].dest.Top = 0;
+        layout.tiles[0].dest.Right = nWidth;
+        layout.tiles[0].dest.Bottom = nHeight;
+    }
+
+    const BYTE* pBgra = GetBgraPixels(pFrame, &rect);
+    if (nullptr == pBgra)
+    {
+        return E_INVALIDARG;
+    }
+
+    m_pMosaic->Compose(&layout, pBgra, pFrame->nColorWidth, pFrame->nColorHeight, pFrame->nColorWidth * 4);
+
+    size_t cbPixels = static_cast<size_t>(nWidth) * nHeight;
+    size_t cbFrame = (RoiExportFormat_Bgra == m_format) ? cbPixels * 4 : cbPixels * 3 / 2;
+
+    HRESULT hr = S_OK;
+    if (m_cbBuffered + c_MaxFrameHeader + cbFrame > m_buffer.size())
+    {
+        hr = Flush();
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        if (RoiExportFormat_Y4m == m_format)
+        {
+            m_cbBuffered += FormatFrameHeader(pFrame->nTime, reinterpret_cast<char*>(&m_buffer[m_cbBuffered]));
+        }
+
+        BYTE* pDest = &m_buffer[m_cbBuffered];
+        if (RoiExportFormat_Bgra == m_format)
+        {
+            memcpy(pDest, m_pMosaic->GetPixels(), cbFrame);
+        }
+        else
+        {
+            ConvertBgraToI420(m_pMosaic->GetPixels(), m_pMosaic->GetStride(), nWidth, nHeight,
+                pDest, pDest + cbPixels, pDest + cbPixels + cbPixels / 4);
+        }
+        m_cbBuffered += cbFrame;
+
+        if (m_pTimestampFile)
+        {
+            fprintf(m_pTimestampFile, "%llu,%lld\n", static_cast<unsigned long long>(m_stats.nFrames), static_cast<long long>(pFrame->nTime));
+        }
+
+        m_stats.nFrames++;
+    }
+
+    m_stats.nComposeNs += GetPerfClockNs() - nStartNs - (m_stats.nWriteNs - nWriteNs);
+
+    if (FAILED(hr))
+    {
+        // the consumer went away; there is no point in composing any further frames
+        Close();
+    }
+
+    return hr;
+}
+
+/// <summary>
+/// Writes out what is buffered and closes the stream
+/// </summary>
+/// <returns>indicates success or failure</returns>
+HRESULT RoiExporter::Close()
+{
+    HRESULT hr = S_OK;
+
+    if (m_pFile)
+    {
+        hr = Flush();
+
+        if (m_bOwnsFile)
+        {
+            fclose(m_pFile);
+        }
+        else
+        {
+            fflush(m_pFile);
+        }
+        m_pFile = nullptr;
+    }
+
+    if (m_pTimestampFile)
+    {
+        fclose(m_pTimestampFile);
+        m_pTimestampFile = nullptr;
+    }
+
+    if (m_pMosaic)
+    {
+        delete m_pMosaic;
+        m_pMosaic = nullptr;
+    }
+
+    return hr;
+}
+
+/// <summary>
+/// Gets the color of a frame as BGRA, converting only the part that will be composed
+/// </summary>
+/// <param name="pFrame">frame holding the color data</param>
+/// <param name="pRect">region that will be composed; widened to what was converted</param>
+/// <returns>BGRA image of the frame size, valid within pRect, or null for invalid color data</returns>
+const BYTE* RoiExporter::GetBgraPixels(const SessionFrame* pFrame, RectI* pRect)
+{
+    if (!pFrame->pColorBuffer || pFrame->nColorWidth <= 0 || pFrame->nColorHeight <= 0 ||
+        pFrame->cbColorBuffer < static_cast<UINT>(pFrame->nColorStride) * pFrame->nColorHeight)
+    {
+        return nullptr;
+    }
+
+    if (ColorImageFormat_Bgra == pFrame->colorFormat && pFrame->nColorStride == pFrame->nColorWidth * 4)
+    {
+        return pFrame->pColorBuffer;
+    }
+
+    if (ColorImageFormat_Yuy2 == pFrame->colorFormat)
+    {
+        // sized by the first frame; the color frame size does not change within a session
+        size_t cbBgra = static_cast<size_t>(pFrame->nColorWidth) * pFrame->nColorHeight * 4;
+        if (m_colorBgra.size() < cbBgra)
+        {
+            m_colorBgra.resize(cbBgra);
+        }
+
+        AlignRectToYuy2(pRect, pFrame->nColorWidth);
+        ConvertYuy2ToBgra(GetBestColorKernel(), pFrame->pColorBuffer, pFrame->nColorStride,
+            &m_colorBgra[0], pFrame->nColorWidth * 4, pRect);
+
+        return &m_colorBgra[0];
+    }
+
+    return nullptr;
+}
+
+/// <summary>
+/// Writes out the buffered frames in a single call
+/// </summary>
+/// <returns>indicates success or failure</returns>
+HRESULT RoiExporter::Flush()
+{
+    if (0 == m_cbBuffered)
+    {
+        return S_OK;
+    }
+
+    INT64 nStartNs = GetPerfClockNs();
+    size_t cbWritten = fwrite(&m_buffer[0], 1, m_cbBuffered, m_pFile);
+
+    m_stats.nWriteNs += GetPerfClockNs() - nStartNs;
+    m_stats.nBytesWritten += cbWritten;
+    m_stats.nWrites++;
+
+    bool bWritten = (cbWritten == m_cbBuffered);
+    m_cbBuffered = 0;
+
+    return bWritten ? S_OK : E_FAIL;
+}
@@ -0,0 +1,137 @@
+//------------------------------------------------------------------------------
+// <copyright file="RoiExport.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Writes the speaker regions of interest, composed at a fixed resolution, as a video
+// stream to a file or to standard output, for encoders and other headless consumers.
+
+#pragma once
+
+#include <stdio.h>
+#include <vector>
+#include "KinectTypes.h"
+#include "SessionRecording.h"
+#include "MosaicCompositor.h"
+
+// Frame rate declared in Y4M streams, that of the color stream
+static const int c_RoiExportFramesPerSecond = 30;
+
+// Size of the output buffer; frames are appended to it and written out in one call
+// whenever the next frame would not fit
+static const size_t c_RoiExportBufferSize = 8 * 1024 * 1024;
+
+enum RoiExportFormat
+{
+    // YUV4MPEG2 with I420 frames; every FRAME header carries the RelativeTime as XRT=<ticks>
+    RoiExportFormat_Y4m = 0,
+
+    // Headerless I420 frames
+    RoiExportFormat_I420 = 1,
+
+    // Headerless BGRA frames
+    RoiExportFormat_Bgra = 2
+};
+
+struct RoiExportStats
+{
+    // Frames written, and those of them that showed at least one speaker
+    UINT64              nFrames;
+    UINT64              nSpeakerFrames;
+
+    // Bytes handed to the file and number of write calls
+    UINT64              nBytesWritten;
+    UINT64              nWrites;
+
+    // Time spent composing and converting frames, and in write calls, in nanoseconds
+    INT64               nComposeNs;
+    INT64               nWriteNs;
+};
+
+/// <summary>
+/// Name of an export format, also the extension of its files
+/// </summary>
+/// <param name="format">format</param>
+/// <returns>y4m, i420 or bgra</returns>
+const char* GetRoiExportFormatName(RoiExportFormat format);
+
+/// <summary>
+/// Parses the name of an export format
+/// </summary>
+/// <param name="szName">y4m, i420 or bgra</param>
+/// <param name="pFormat">receives the format</param>
+/// <returns>false for an unknown name</returns>
+bool ParseRoiExportFormat(const char* szName, RoiExportFormat* pFormat);
+
+class RoiExporter
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    RoiExporter();
+
+    /// <summary>
+    /// Destructor
+    /// </summary>
+    ~RoiExporter();
+
+    /// <summary>
+    /// Creates the output stream; all buffers are allocated here, not per frame
+    /// </summary>
+    /// <param name="szPath">path of the output file, or "-" for standard output</param>
+    /// <param name="szTimestampPath">optional path of a CSV file receiving the RelativeTime
+    /// of every frame, for the headerless formats</param>
+    /// <param name="format">format of the stream</param>
+    /// <param name="nWidth">width (in pixels) of the frames, even</param>
+    /// <param name="nHeight">height (in pixels) of the frames, even</param>
+    /// <param name="scaling">how the speaker regions, or the whole frame, are resampled to the frame size</param>
+    /// <returns>indicates success or failure</returns>
+    HRESULT Open(const char* szPath, const char* szTimestampPath, RoiExportFormat format, int nWidth, int nHeight, ScaleMethod scaling);
+
+    /// <summary>
+    /// Composes the speaker regions of a frame, or the whole frame when nobody speaks,
+    /// at the output size and appends the result to the stream
+    /// </summary>
+    /// <param name="pFrame">frame holding the color and face data</param>
+    /// <param name="pbIsSpeaker">for each of the BODY_COUNT faces, whether it is speaking</param>
+    /// <returns>indicates success or failure; a failed write closes the stream</returns>
+    HRESULT WriteFrame(const SessionFrame* pFrame, const bool* pbIsSpeaker);
+
+    /// <summary>
+    /// Writes out what is buffered and closes the stream
+    /// </summary>
+    /// <returns>indicates success or failure</returns>
+    HRESULT Close();
+
+    /// <summary>
+    /// Whether a stream is currently open
+    /// </summary>
+    bool IsOpen() const { return nullptr != m_pFile; }
+
+    /// <summary>
+    /// Counters of the stream written so far
+    /// </summary>
+    /// <param name="pStats">receives the counters</param>
+    void GetStats(RoiExportStats* pStats) const { *pStats = m_stats; }
+
+private:
+    const BYTE* GetBgraPixels(const SessionFrame* pFrame, RectI* pRect);
+    HRESULT Flush();
+
+    FILE*                   m_pFile;
+    FILE*                   m_pTimestampFile;
+    bool                    m_bOwnsFile;
+    RoiExportFormat         m_format;
+    MosaicCompositor*       m_pMosaic;
+
+    // BGRA conversion of YUY2 color frames, valid within the converted rectangle
+    std::vector<BYTE>       m_colorBgra;
+
+    // Frames not yet written out
+    std::vector<BYTE>       m_buffer;
+    size_t                  m_cbBuffered;
+
+    RoiExportStats          m_stats;
+};
@@ -0,0 +1,480 @@
+//------------------------------------------------------------------------------
+// <copyright file="RoiScaler.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "KinectTypes.h"
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include "CpuFeatures.h"
+#include "RoiScaler.h"
+
+// Most taps a filter may have, enough for any method and any scale the frames allow
+static const int c_MaxScaleTaps = 256;
+
+/// <summary>
+/// Builds the resampling weights for a source span stretched over an output span.
+/// Taps outside the source pixels the span touches are moved to its nearest edge pixel.
+/// </summary>
+/// <param name="method">how output pixels are made</param>
+/// <param name="fSourceStart">start of the source span</param>
+/// <param name="fSourceEnd">end of the source span</param>
+/// <param name="nSourceSize">size of the source image along the span</param>
+/// <param name="nDest">length of the output span in pixels</param>
+/// <param name="pFilter">receives the weights</param>
+static void BuildScaleFilter(ScaleMethod method, float fSourceStart, float fSourceEnd, int nSourceSize, int nDest, ScaleFilter* pFilter)
+{
+    double fScale = (static_cast<double>(fSourceEnd) - fSourceStart) / nDest;
+    int nFirst = (std::max)(static_cast<int>(floor(fSourceStart)), 0);
+    int nLast = (std::min)(static_cast<int>(ceil(fSourceEnd)), nSourceSize) - 1;
+    if (nLast < nFirst)
+    {
+        nFirst = nLast = (std::max)(0, (std::min)(nFirst, nSourceSize - 1));
+    }
+
+    if (ScaleMethod_Auto == method)
+    {
+        method = (fScale > 1.0) ? ScaleMethod_Box : ScaleMethod_Bilinear;
+    }
+
+    int nMaxTaps = 1;
+    if (ScaleMethod_Bilinear == method)
+    {
+        nMaxTaps = 2;
+    }
+    else if (ScaleMethod_Box == method)
+    {
+        nMaxTaps = (std::min)(static_cast<int>(ceil(fScale)) + 1, c_MaxScaleTaps);
+    }
+
+    pFilter->nTaps = nMaxTaps;
+    pFilter->indices.resize(static_cast<size_t>(nDest) * nMaxTaps);
+    pFilter->weights.resize(static_cast<size_t>(nDest) * nMaxTaps);
+
+    int nIndices[c_MaxScaleTaps];
+    double fWeights[c_MaxScaleTaps];
+
+    for (int i = 0; i < nDest; ++i)
+    {
+        int nTaps = 0;
+
+        if (ScaleMethod_Nearest == method)
+        {
+            nIndices[0] = static_cast<int>(floor(fSourceStart + (i + 0.5) * fScale));
+            fWeights[0] = 1.0;
+            nTaps = 1;
+        }
+        else if (ScaleMethod_Bilinear == method)
+        {
+            double fCenter = fSourceStart + (i + 0.5) * fScale - 0.5;
+            int nLeft = static_cast<int>(floor(fCenter));
+            double fFraction = fCenter - nLeft;
+
+            nIndices[0] = nLeft;
+            fWeights[0] = 1.0 - fFraction;
+            nIndices[1] = nLeft + 1;
+            fWeights[1] = fFraction;
+            nTaps = 2;
+        }
+        else
+        {
+            // every source pixel weighs by how much of it the output pixel covers
+            double fStart = fSourceStart + i * fScale;
+            double fEnd = fStart + fScale;
+            for (int j = static_cast<int>(floor(fStart)); j < fEnd && nTaps < nMaxTaps; ++j)
+            {
+                double fCoverage = (std::min)(fEnd, j + 1.0) - (std::max)(fStart, static_cast<double>(j));
+                if (fCoverage > 0.0)
+                {
+                    nIndices[nTaps] = j;
+                    fWeights[nTaps] = fCoverage;
+                    ++nTaps;
+                }
+            }
+        }
+
+        // move taps onto the pixels the span touches, merging the ones that meet there
+        int nMerged = 0;
+        double fTotal = 0.0;
+        for (int t = 0; t < nTaps; ++t)
+        {
+            int nIndex = (std::max)(nFirst, (std::min)(nIndices[t], nLast));
+            if (nMerged > 0 && nIndices[nMerged - 1] == nIndex)
+            {
+                fWeights[nMerged - 1] += fWeights[t];
+            }
+            else
+            {
+                nIndices[nMerged] = nIndex;
+                fWeights[nMerged] = fWeights[t];
+                ++nMerged;
+            }
+
+            fTotal += fWeights[t];
+        }
+
+        int* pIndices = &pFilter->indices[static_cast<size_t>(i) * nMaxTaps];
+        float* pWeights = &pFilter->weights[static_cast<size_t>(i) * nMaxTaps];
+        for (int t = 0; t < nMaxTaps; ++t)
+        {
+            pIndices[t] = (t < nMerged) ? nIndices[t] : nIndices[nMerged - 1];
+            pWeights[t] = (t < nMerged && fTotal > 0.0) ? static_cast<float>(fWeights[t] / fTotal) : 0.0f;
+        }
+    }
+}
+
+/// <summary>
+/// Resamples one BGRA source row horizontally into float BGRA, one output pixel at a time
+/// </summary>
+/// <param name="pSource">BGRA source row</param>
+/// <param name="pIndices">source pixel of every tap, nTaps per output pixel</param>
+/// <param name="pWeights">weight of every tap</param>
+/// <param name="nTaps">taps per output pixel</param>
+/// <param name="nDest">number of output pixels</param>
+/// <param name="pDest">receives 4 floats per output pixel</param>
+static void ResampleRowScalar(const BYTE* pSource, const int* pIndices, const float* pWeights, int nTaps, int nDest, float* pDest)
+{
+    for (int i = 0; i < nDest; ++i, pIndices += nTaps, pWeights += nTaps, pDest += 4)
+    {
+        float b = 0.0f;
+        float g = 0.0f;
+        float r = 0.0f;
+        float a = 0.0f;
+
+        for (int t = 0; t < nTaps; ++t)
+        {
+            const BYTE* pPixel = pSource + pIndices[t] * 4;
+            float w = pWeights[t];
+            b += w * pPixel[0];
+            g += w * pPixel[1];
+            r += w * pPixel[2];
+            a += w * pPixel[3];
+        }
+
+        pDest[0] = b;
+        pDest[1] = g;
+        pDest[2] = r;
+        pDest[3] = a;
+    }
+}
+
+/// <summary>
+/// Blends resampled rows into one output row, rounding to the nearest level
+/// </summary>
+/// <param name="ppRows">resampled rows, one per tap</param>
+/// <param name="pWeights">weight of every row</param>
+/// <param name="nTaps">number of rows</param>
+/// <param name="nValues">number of floats per row, a multiple of 4</param>
+/// <param name="pDest">receives nValues bytes</param>
+static void BlendRowsScalar(const float* const* ppRows, const float* pWeights, int nTaps, int nValues, BYTE* pDest)
+{
+    for (int k = 0; k < nValues; ++k)
+    {
+        float fSum = 0.0f;
+        for (int t = 0; t < nTaps; ++t)
+        {
+            fSum += pWeights[t] * ppRows[t][k];
+        }
+
+        float fValue = fSum + 0.5f;
+        fValue = (fValue > 0.0f) ? fValue : 0.0f;
+        fValue = (fValue < 255.0f) ? fValue : 255.0f;
+        pDest[k] = static_cast<BYTE>(fValue);
+    }
+}
+
+#if defined(CPU_X86)
+
+/// <summary>
+/// Resamples one BGRA source row horizontally, one output pixel per vector
+/// </summary>
+CPU_TARGET_SSE41
+static void ResampleRowSse41(const BYTE* pSource, const int* pIndices, const float* pWeights, int nTaps, int nDest, float* pDest)
+{
+    for (int i = 0; i < nDest; ++i, pIndices += nTaps, pWeights += nTaps, pDest += 4)
+    {
+        __m128 sum = _mm_setzero_ps();
+        for (int t = 0; t < nTaps; ++t)
+        {
+            __m128i pixel = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(*reinterpret_cast<const int*>(pSource + pIndices[t] * 4)));
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(pWeights[t]), _mm_cvtepi32_ps(pixel)));
+        }
+
+        _mm_storeu_ps(pDest, sum);
+    }
+}
+
+/// <summary>
+/// Rounds four blended values to bytes and stores them
+/// </summary>
+CPU_TARGET_SSE41
+static inline void StoreLevelsSse41(__m128 sum, BYTE* pDest)
+{
+    __m128 value = _mm_add_ps(sum, _mm_set1_ps(0.5f));
+    value = _mm_min_ps(_mm_max_ps(value, _mm_setzero_ps()), _mm_set1_ps(255.0f));
+
+    __m128i levels = _mm_cvttps_epi32(value);
+    levels = _mm_packus_epi16(_mm_packus_epi32(levels, levels), levels);
+    *reinterpret_cast<int*>(pDest) = _mm_cvtsi128_si32(levels);
+}
+
+/// <summary>
+/// Blends resampled rows into one output row, four values per vector
+/// </summary>
+CPU_TARGET_SSE41
+static void BlendRowsSse41(const float* const* ppRows, const float* pWeights, int nTaps, int nValues, BYTE* pDest)
+{
+    for (int k = 0; k < nValues; k += 4)
+    {
+        __m128 sum = _mm_setzero_ps();
+        for (int t = 0; t < nTaps; ++t)
+        {
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(pWeights[t]), _mm_loadu_ps(ppRows[t] + k)));
+        }
+
+        StoreLevelsSse41(sum, pDest + k);
+    }
+}
+
+/// <summary>
+/// Resamples one BGRA source row horizontally, two output pixels per vector
+/// </summary>
+CPU_TARGET_AVX2
+static void ResampleRowAvx2(const BYTE* pSource, const int* pIndices, const float* pWeights, int nTaps, int nDest, float* pDest)
+{
+    int i = 0;
+    for (; i + 2 <= nDest; i += 2, pIndices += 2 * nTaps, pWeights += 2 * nTaps, pDest += 8)
+    {
+        __m256 sum = _mm256_setzero_ps();
+        for (int t = 0; t < nTaps; ++t)
+        {
+            __m128i pixels = _mm_unpacklo_epi32(
+                _mm_cvtsi32_si128(*reinterpret_cast<const int*>(pSource + pIndices[t] * 4)),
+                _mm_cvtsi32_si128(*reinterpret_cast<const int*>(pSource + pIndices[nTaps + t] * 4)));
+            __m256 weights = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(pWeights[t])), _mm_set1_ps(pWeights[nTaps + t]), 1);
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(weights, _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(pixels))));
+        }
+
+        _mm256_storeu_ps(pDest, sum);
+    }
+
+    if (i < nDest)
+    {
+        ResampleRowSse41(pSource, pIndices, pWeights, nTaps, nDest - i, pDest);
+    }
+}
+
+/// <summary>
+/// Blends resampled rows into one output row, eight values per vector
+/// </summary>
+CPU_TARGET_AVX2
+static void BlendRowsAvx2(const float* const* ppRows, const float* pWeights, int nTaps, int nValues, BYTE* pDest)
+{
+    int k = 0;
+    for (; k + 8 <= nValues; k += 8)
+    {
+        __m256 sum = _mm256_setzero_ps();
+        for (int t = 0; t < nTaps; ++t)
+        {
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_set1_ps(pWeights[t]), _mm256_loadu_ps(ppRows[t] + k)));
+        }
+
+        StoreLevelsSse41(_mm256_castps256_ps128(sum), pDest + k);
+        StoreLevelsSse41(_mm256_extractf128_ps(sum, 1), pDest + k + 4);
+    }
+
+    if (k < nValues)
+    {
+        const float* pTailRows[c_MaxScaleTaps];
+        for (int t = 0; t < nTaps; ++t)
+        {
+            pTailRows[t] = ppRows[t] + k;
+        }
+
+        BlendRowsSse41(pTailRows, pWeights, nTaps, nValues - k, pDest + k);
+    }
+}
+
+#endif
+
+/// <summary>
+/// Fastest resampling kernel the processor supports
+/// </summary>
+ScaleKernel GetBestScaleKernel()
+{
+    static const ScaleKernel s_kernel =
+        IsScaleKernelSupported(ScaleKernel_Avx2) ? ScaleKernel_Avx2 :
+        IsScaleKernelSupported(ScaleKernel_Sse41) ? ScaleKernel_Sse41 :
+        ScaleKernel_Scalar;
+
+    return s_kernel;
+}
+
+/// <summary>
+/// Whether the processor supports a resampling kernel
+/// </summary>
+/// <param name="kernel">kernel to check</param>
+bool IsScaleKernelSupported(ScaleKernel kernel)
+{
+    switch (kernel)
+    {
+    case ScaleKernel_Scalar:
+        return true;
+
+    case ScaleKernel_Sse41:
+        return CpuHasSse41();
+
+    case ScaleKernel_Avx2:
+        // the AVX2 kernel rounds and finishes rows with the SSE4.1 one
+        return CpuHasAvx2() && CpuHasSse41();
+
+    default:
+        return false;
+    }
+}
+
+/// <summary>
+/// Short name of a resampling kernel, for reports
+/// </summary>
+/// <param name="kernel">kernel to name</param>
+const char* GetScaleKernelName(ScaleKernel kernel)
+{
+    static const char* c_szNames[ScaleKernel_Count] = { "scalar", "sse4.1", "avx2" };
+    return (kernel >= 0 && kernel < ScaleKernel_Count) ? c_szNames[kernel] : "unknown";
+}
+
+/// <summary>
+/// Short name of a resampling method, as taken by ParseScaleMethod
+/// </summary>
+/// <param name="method">method to name</param>
+const char* GetScaleMethodName(ScaleMethod method)
+{
+    static const char* c_szNames[ScaleMethod_Count] = { "nearest", "bilinear", "box", "auto" };
+    return (method >= 0 && method < ScaleMethod_Count) ? c_szNames[method] : "unknown";
+}
+
+/// <summary>
+/// Parses the name of a resampling method
+/// </summary>
+/// <param name="szName">nearest, bilinear, box or auto</param>
+/// <param name="pMethod">receives the method</param>
+/// <returns>false for an unknown name</returns>
+bool ParseScaleMethod(const char* szName, ScaleMethod* pMethod)
+{
+    for (int i = 0; i < ScaleMethod_Count; ++i)
+    {
+        if (0 == strcmp(szName, GetScaleMethodName(static_cast<ScaleMethod>(i))))
+        {
+            *pMethod = static_cast<ScaleMethod>(i);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+/// <param name="kernel">resampling kernel to use; must be supported</param>
+RoiScaler::RoiScaler(ScaleKernel kernel) :
+    m_kernel(kernel)
+{
+}
+
+/// <summary>
+/// Resamples a region of a BGRA frame into every output in one pass over the region
+/// </summary>
+/// <param name="pSource">BGRA color frame, valid at least within the region</param>
+/// <param name="nSourceWidth">width (in pixels) of the color frame</param>
+/// <param name="nSourceHeight">height (in pixels) of the color frame</param>
+/// <param name="nSourceStride">length (in bytes) of a row of the color frame</param>
+/// <param name="pRoi">region to resample; the part outside the frame repeats its edge</param>
+/// <param name="pOutputs">images receiving the region</param>
+/// <param name="nOutputs">number of outputs</param>
+void RoiScaler::Scale(const BYTE* pSource, int nSourceWidth, int nSourceHeight, int nSourceStride, const RoiRect* pRoi, const ScaleOutput* pOutputs, int nOutputs)
+{
+    void (*pfnResampleRow)(const BYTE*, const int*, const float*, int, int, float*) = ResampleRowScalar;
+    void (*pfnBlendRows)(const float* const*, const float*, int, int, BYTE*) = BlendRowsScalar;
+
+#if defined(CPU_X86)
+    if (ScaleKernel_Avx2 == m_kernel)
+    {
+        pfnResampleRow = ResampleRowAvx2;
+        pfnBlendRows = BlendRowsAvx2;
+    }
+    else if (ScaleKernel_Sse41 == m_kernel)
+    {
+        pfnResampleRow = ResampleRowSse41;
+        pfnBlendRows = BlendRowsSse41;
+    }
+#endif
+
+    if (static_cast<int>(m_states.size()) < nOutputs)
+    {
+        m_states.resize(nOutputs);
+    }
+
+    // source rows the outputs need, from the first tap of their first row to the last
+    // tap of their last row
+    int nFirstRow = nSourceHeight;
+    int nLastRow = -1;
+    for (int i = 0; i < nOutputs; ++i)
+    {
+        const ScaleOutput& output = pOutputs[i];
+        OutputState& state = m_states[i];
+        state.nNextRow = 0;
+        if (output.nWidth <= 0 || output.nHeight <= 0)
+        {
+            state.nNextRow = output.nHeight;
+            continue;
+        }
+
+        BuildScaleFilter(output.method, pRoi->left, pRoi->right, nSourceWidth, output.nWidth, &state.horizontal);
+        BuildScaleFilter(output.method, pRoi->top, pRoi->bottom, nSourceHeight, output.nHeight, &state.vertical);
+        state.rows.resize(static_cast<size_t>(state.vertical.nTaps) * output.nWidth * 4);
+
+        nFirstRow = (std::min)(nFirstRow, state.vertical.indices.front());
+        nLastRow = (std::max)(nLastRow, state.vertical.indices.back());
+    }
+
+    const float* pRows[c_MaxScaleTaps];
+
+    for (int y = nFirstRow; y <= nLastRow; ++y)
+    {
+        const BYTE* pSourceRow = pSource + static_cast<size_t>(y) * nSourceStride;
+
+        for (int i = 0; i < nOutputs; ++i)
+        {
+            const ScaleOutput& output = pOutputs[i];
+            OutputState& state = m_states[i];
+            const int nTaps = state.vertical.nTaps;
+            const size_t nRowValues = static_cast<size_t>(output.nWidth) * 4;
+
+            // rows before the first tap of the next output row are of no more use
+            if (state.nNextRow >= output.nHeight || y < state.vertical.indices[static_cast<size_t>(state.nNextRow) * nTaps])
+            {
+                continue;
+            }
+
+            pfnResampleRow(pSourceRow, &state.horizontal.indices[0], &state.horizontal.weights[0], state.horizontal.nTaps, output.nWidth, &state.rows[(y % nTaps) * nRowValues]);
+
+            // make every output row whose last tap this row was; taps of a row are
+            // consecutive source rows, so all of them are still in the ring
+            while (state.nNextRow < output.nHeight && state.vertical.indices[static_cast<size_t>(state.nNextRow) * nTaps + nTaps - 1] <= y)
+            {
+                const int* pIndices = &state.vertical.indices[static_cast<size_t>(state.nNextRow) * nTaps];
+                for (int t = 0; t < nTaps; ++t)
+                {
+                    pRows[t] = &state.rows[(pIndices[t] % nTaps) * nRowValues];
+                }
+
+                BYTE* pDestRow = output.pPixels + static_cast<size_t>(state.nNextRow) * output.nStride;
+                pfnBlendRows(pRows, &state.vertical.weights[static_cast<size_t>(state.nNextRow) * nTaps], nTaps, static_cast<int>(nRowValues), pDestRow);
+                ++state.nNextRow;
+            }
+        }
+    }
+}
@@ -0,0 +1,151 @@
+//------------------------------------------------------------------------------
+// <copyright file="RoiScaler.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Resamples a region of interest of a BGRA frame to fixed output sizes, for the speaker
+// mosaic and for models that take images of one size. Enlarging blends the source
+// pixels around every output pixel (bilinear); shrinking averages the source area it
+// covers (box), so that no source pixel is skipped. The filter is separable: every
+// source row of the region is read once and resampled horizontally for every output
+// that needs it, and the output rows then blend the resampled rows they cover, so that
+// several output sizes come out of a single pass over the source. Only pixels within
+// the region, widened to whole pixels, are read.
+
+#pragma once
+
+#include <vector>
+#include "KinectTypes.h"
+#include "SpeakerSelection.h"
+
+// Implementations of the resampling kernels, slowest first
+enum ScaleKernel
+{
+    ScaleKernel_Scalar = 0,
+    ScaleKernel_Sse41 = 1,
+    ScaleKernel_Avx2 = 2,
+    ScaleKernel_Count = 3
+};
+
+/// <summary>
+/// Fastest resampling kernel the processor supports
+/// </summary>
+ScaleKernel GetBestScaleKernel();
+
+/// <summary>
+/// Whether the processor supports a resampling kernel
+/// </summary>
+/// <param name="kernel">kernel to check</param>
+bool IsScaleKernelSupported(ScaleKernel kernel);
+
+/// <summary>
+/// Short name of a resampling kernel, for reports
+/// </summary>
+/// <param name="kernel">kernel to name</param>
+const char* GetScaleKernelName(ScaleKernel kernel);
+
+// How an output pixel is made from the source pixels under it
+enum ScaleMethod
+{
+    // The source pixel under the center of the output pixel
+    ScaleMethod_Nearest = 0,
+
+    // Blend of the two source pixels around its center along each axis
+    ScaleMethod_Bilinear = 1,
+
+    // Average of the source area it covers, weighted by coverage
+    ScaleMethod_Box = 2,
+
+    // Box along an axis that shrinks, bilinear along one that grows
+    ScaleMethod_Auto = 3,
+
+    ScaleMethod_Count = 4
+};
+
+/// <summary>
+/// Short name of a resampling method, as taken by ParseScaleMethod
+/// </summary>
+/// <param name="method">method to name</param>
+const char* GetScaleMethodName(ScaleMethod method);
+
+/// <summary>
+/// Parses the name of a resampling method
+/// </summary>
+/// <param name="szName">nearest, bilinear, box or auto</param>
+/// <param name="pMethod">receives the method</param>
+/// <returns>false for an unknown name</returns>
+bool ParseScaleMethod(const char* szName, ScaleMethod* pMethod);
+
+/// <summary>
+/// One image to resample a region into
+/// </summary>
+struct ScaleOutput
+{
+    // First pixel of the BGRA image, and the length (in bytes) of one of its rows
+    BYTE*               pPixels;
+    int                 nStride;
+
+    // Size (in pixels) of the image
+    int                 nWidth;
+    int                 nHeight;
+
+    ScaleMethod         method;
+};
+
+/// <summary>
+/// Resampling weights along one axis; every output pixel has the same number of taps,
+/// unused ones weighing nothing
+/// </summary>
+struct ScaleFilter
+{
+    int                 nTaps;
+
+    // Source pixel and weight of every tap, nTaps per output pixel, pixels ascending
+    std::vector<int>    indices;
+    std::vector<float>  weights;
+};
+
+class RoiScaler
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    /// <param name="kernel">resampling kernel to use; must be supported</param>
+    explicit RoiScaler(ScaleKernel kernel = GetBestScaleKernel());
+
+    /// <summary>
+    /// Resamples a region of a BGRA frame into every output in one pass over the region.
+    /// The SSE4.1 kernel gives the same output as the scalar one; the AVX2 kernel may
+    /// differ by one level where the compiler fuses a multiply and an add.
+    /// </summary>
+    /// <param name="pSource">BGRA color frame, valid at least within the region</param>
+    /// <param name="nSourceWidth">width (in pixels) of the color frame</param>
+    /// <param name="nSourceHeight">height (in pixels) of the color frame</param>
+    /// <param name="nSourceStride">length (in bytes) of a row of the color frame</param>
+    /// <param name="pRoi">region to resample; the part outside the frame repeats its edge</param>
+    /// <param name="pOutputs">images receiving the region</param>
+    /// <param name="nOutputs">number of outputs</param>
+    void Scale(const BYTE* pSource, int nSourceWidth, int nSourceHeight, int nSourceStride, const RoiRect* pRoi, const ScaleOutput* pOutputs, int nOutputs);
+
+private:
+    /// <summary>
+    /// Filters and resampled source rows of one output, reused from call to call
+    /// </summary>
+    struct OutputState
+    {
+        ScaleFilter         horizontal;
+        ScaleFilter         vertical;
+
+        // Horizontally resampled source rows as float BGRA, one per vertical tap; source
+        // row y lives in slot y % vertical.nTaps
+        std::vector<float>  rows;
+
+        // Next output row to make
+        int                 nNextRow;
+    };
+
+    ScaleKernel                 m_kernel;
+    std::vector<OutputState>    m_states;
+};
@@ -0,0 +1,64 @@
+//------------------------------------------------------------------------------
+// <copyright file="SensorClock.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "KinectTypes.h"
+#include "SensorClock.h"
+
+// Offset held before any frame was observed
+static const INT64 c_NoOffset = 0x7fffffffffffffffLL;
+
+/// <summary>
+/// Constructor
+/// </summary>
+SensorClock::SensorClock() :
+    m_nCurrentMin(c_NoOffset),
+    m_nPreviousMin(c_NoOffset),
+    m_nCurrentFrames(0),
+    m_nOffset(c_NoOffset)
+{
+}
+
+/// <summary>
+/// Takes in a frame; called on the thread acquiring frames
+/// </summary>
+/// <param name="nSensorTime">RelativeTime of the frame, in 100ns ticks</param>
+/// <param name="nHostTime">performance clock time the frame was acquired at, in 100ns ticks</param>
+void SensorClock::Observe(INT64 nSensorTime, INT64 nHostTime)
+{
+    INT64 nOffset = nHostTime - nSensorTime;
+    if (nOffset < m_nCurrentMin)
+    {
+        m_nCurrentMin = nOffset;
+    }
+
+    // the older half of the window is dropped once the newer one is full
+    if (++m_nCurrentFrames >= c_SensorClockWindowFrames / 2)
+    {
+        m_nPreviousMin = m_nCurrentMin;
+        m_nCurrentMin = c_NoOffset;
+        m_nCurrentFrames = 0;
+    }
+
+    m_nOffset.store((m_nCurrentMin < m_nPreviousMin) ? m_nCurrentMin : m_nPreviousMin);
+}
+
+/// <summary>
+/// Converts a performance clock time to RelativeTime; may be called on any thread
+/// </summary>
+/// <param name="nHostTime">performance clock time, in 100ns ticks</param>
+/// <param name="pnSensorTime">receives the RelativeTime, in 100ns ticks</param>
+/// <returns>false, leaving pnSensorTime alone, until a frame was observed</returns>
+bool SensorClock::ToSensorTime(INT64 nHostTime, INT64* pnSensorTime) const
+{
+    INT64 nOffset = m_nOffset.load();
+    if (c_NoOffset == nOffset)
+    {
+        return false;
+    }
+
+    *pnSensorTime = nHostTime - nOffset;
+    return true;
+}
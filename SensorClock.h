@@ -0,0 +1,58 @@
+//------------------------------------------------------------------------------
+// <copyright file="SensorClock.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Maps the host performance clock onto the sensor's RelativeTime. Color frames carry
+// RelativeTime, while the beam audio stream carries no time at all and is stamped with
+// the performance clock when it is read; nothing guarantees the two clocks share an
+// origin, so audio times are converted before they are compared with frame times.
+//
+// Every frame that arrives tells the offset between the clocks plus the delay it was
+// delivered with. The delay is never negative, so the smallest offset seen is the
+// closest to the true one; it is taken over a sliding window of frames so that the
+// estimate follows the clocks drifting apart. What remains is the difference in the
+// delivery delays of the color and the audio, a few milliseconds.
+
+#pragma once
+
+#include <atomic>
+#include "KinectTypes.h"
+
+// Frames the smallest offset is taken over, in two halves; ten seconds at 30 fps
+static const int c_SensorClockWindowFrames = 300;
+
+class SensorClock
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    SensorClock();
+
+    /// <summary>
+    /// Takes in a frame; called on the thread acquiring frames
+    /// </summary>
+    /// <param name="nSensorTime">RelativeTime of the frame, in 100ns ticks</param>
+    /// <param name="nHostTime">performance clock time the frame was acquired at, in 100ns ticks</param>
+    void Observe(INT64 nSensorTime, INT64 nHostTime);
+
+    /// <summary>
+    /// Converts a performance clock time to RelativeTime; may be called on any thread
+    /// </summary>
+    /// <param name="nHostTime">performance clock time, in 100ns ticks</param>
+    /// <param name="pnSensorTime">receives the RelativeTime, in 100ns ticks</param>
+    /// <returns>false, leaving pnSensorTime alone, until a frame was observed</returns>
+    bool ToSensorTime(INT64 nHostTime, INT64* pnSensorTime) const;
+
+private:
+    // Smallest offsets, host minus sensor time, of the frames of the current and of the
+    // previous half of the window; only touched by the observing thread
+    INT64                   m_nCurrentMin;
+    INT64                   m_nPreviousMin;
+    int                     m_nCurrentFrames;
+
+    // Offset in use, the smaller of the two; c_NoOffset until a frame was observed
+    std::atomic<INT64>      m_nOffset;
+};
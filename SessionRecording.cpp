@@ -0,0 +1,1209 @@
+//------------------------------------------------------------------------------
+// <copyright file="SessionRecording.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "KinectTypes.h"
+#include <string.h>
+#include <algorithm>
+#include <thread>
+#include <chrono>
+#if !defined(_WIN32)
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "PerfClock.h"
+#include "SessionRecording.h"
+
+// Largest record payload accepted when reading, guards against corrupt files
+static const UINT32 c_MaxRecordPayload = 64 * 1024 * 1024;
+
+/// <summary>
+/// Opens a file using the CRT of the current platform
+/// </summary>
+/// <param name="szPath">path of the file</param>
+/// <param name="szMode">fopen style mode string</param>
+/// <returns>the open file or nullptr on failure</returns>
+static FILE* OpenFile(const char* szPath, const char* szMode)
+{
+    FILE* pFile = nullptr;
+#if defined(_WIN32)
+    if (0 != fopen_s(&pFile, szPath, szMode))
+    {
+        pFile = nullptr;
+    }
+#else
+    pFile = fopen(szPath, szMode);
+#endif
+    return pFile;
+}
+
+/// <summary>
+/// Maps a whole file into memory, read only
+/// </summary>
+/// <param name="szPath">path of the file</param>
+/// <param name="cbMinimum">smallest size accepted</param>
+/// <param name="ppData">receives the start of the mapping</param>
+/// <param name="pcbData">receives the size of the file</param>
+/// <returns>indicates success or failure; E_OUTOFMEMORY if the file does not fit into the address space</returns>
+static HRESULT MapFile(const char* szPath, UINT64 cbMinimum, const BYTE** ppData, UINT64* pcbData)
+{
+    void* pView = nullptr;
+    UINT64 cbFile = 0;
+
+#if defined(_WIN32)
+    HANDLE hFile = CreateFileA(szPath, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (INVALID_HANDLE_VALUE == hFile)
+    {
+        return E_FAIL;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(hFile, &size) || static_cast<UINT64>(size.QuadPart) < cbMinimum)
+    {
+        CloseHandle(hFile);
+        return E_FAIL;
+    }
+
+    cbFile = static_cast<UINT64>(size.QuadPart);
+    if (static_cast<size_t>(cbFile) != cbFile)
+    {
+        CloseHandle(hFile);
+        return E_OUTOFMEMORY;
+    }
+
+    // the view keeps the mapping and the file open once their handles are closed
+    HANDLE hMapping = CreateFileMappingA(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(hFile);
+    if (nullptr == hMapping)
+    {
+        return E_FAIL;
+    }
+
+    pView = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(hMapping);
+    if (nullptr == pView)
+    {
+        return E_OUTOFMEMORY;
+    }
+#else
+    int fd = open(szPath, O_RDONLY);
+    if (fd < 0)
+    {
+        return E_FAIL;
+    }
+
+    struct stat status;
+    if (0 != fstat(fd, &status) || static_cast<UINT64>(status.st_size) < cbMinimum)
+    {
+        close(fd);
+        return E_FAIL;
+    }
+
+    cbFile = static_cast<UINT64>(status.st_size);
+    if (static_cast<size_t>(cbFile) != cbFile)
+    {
+        close(fd);
+        return E_OUTOFMEMORY;
+    }
+
+    // the mapping keeps the file open once the descriptor is closed
+    pView = mmap(nullptr, static_cast<size_t>(cbFile), PROT_READ, MAP_SHARED, fd, 0);
+    int nError = errno;
+    close(fd);
+    if (MAP_FAILED == pView)
+    {
+        return (ENOMEM == nError) ? E_OUTOFMEMORY : E_FAIL;
+    }
+#endif
+
+    *ppData = static_cast<const BYTE*>(pView);
+    *pcbData = cbFile;
+    return S_OK;
+}
+
+/// <summary>
+/// Unmaps a file mapped by MapFile
+/// </summary>
+/// <param name="pData">start of the mapping</param>
+/// <param name="cbData">size of the file</param>
+static void UnmapFile(const BYTE* pData, UINT64 cbData)
+{
+#if defined(_WIN32)
+    UNREFERENCED_PARAMETER(cbData);
+    UnmapViewOfFile(pData);
+#else
+    munmap(const_cast<BYTE*>(pData), static_cast<size_t>(cbData));
+#endif
+}
+
+/// <summary>
+/// Clears a frame so that it holds no color, body or face data
+/// </summary>
+/// <param name="pFrame">frame to clear</param>
+void ResetSessionFrame(SessionFrame* pFrame)
+{
+    memset(pFrame, 0, sizeof(*pFrame));
+    pFrame->colorFormat = ColorImageFormat_None;
+}
+
+/// <summary>
+/// Adds a record to the frame being read: bodies and faces are copied into the frame,
+/// audio is appended to the chunks, and the color record completes the frame
+/// </summary>
+/// <param name="header">header of the record</param>
+/// <param name="pPayload">payload of the record, header.cbPayload bytes</param>
+/// <param name="pFrame">frame being read; its color buffer points into the payload</param>
+/// <param name="pAudio">receives the audio chunk of an audio record</param>
+/// <returns>true if the record was the color record completing the frame</returns>
+bool DecodeSessionRecord(const SessionRecordHeader& header, const BYTE* pPayload, SessionFrame* pFrame, std::vector<AudioChunk>* pAudio)
+{
+    switch (header.nType)
+    {
+    case SessionRecord_Bodies:
+        if (header.cbPayload == sizeof(pFrame->bodies))
+        {
+            memcpy(pFrame->bodies, pPayload, sizeof(pFrame->bodies));
+            pFrame->bHaveBodyData = true;
+        }
+        break;
+
+    case SessionRecord_Faces:
+        if (header.cbPayload == sizeof(pFrame->faces))
+        {
+            memcpy(pFrame->faces, pPayload, sizeof(pFrame->faces));
+            pFrame->bHaveFaceData = true;
+        }
+        break;
+
+    case SessionRecord_Audio:
+        if (header.cbPayload >= sizeof(AudioRecordHeader))
+        {
+            AudioRecordHeader audioHeader;
+            memcpy(&audioHeader, pPayload, sizeof(audioHeader));
+
+            UINT nAvailable = static_cast<UINT>((header.cbPayload - sizeof(audioHeader)) / sizeof(float));
+            UINT nSampleCount = (audioHeader.nSampleCount < nAvailable) ? audioHeader.nSampleCount : nAvailable;
+
+            pAudio->resize(pAudio->size() + 1);
+            AudioChunk& chunk = pAudio->back();
+            chunk.nTime = header.nTime;
+            chunk.fBeamAngle = audioHeader.fBeamAngle;
+            chunk.fBeamAngleConfidence = audioHeader.fBeamAngleConfidence;
+            chunk.samples.resize(nSampleCount);
+            if (nSampleCount > 0)
+            {
+                memcpy(&chunk.samples[0], pPayload + sizeof(audioHeader), nSampleCount * sizeof(float));
+            }
+        }
+        break;
+
+    case SessionRecord_Color:
+    case SessionRecord_EncodedColor:
+        if (header.cbPayload >= sizeof(ColorRecordHeader))
+        {
+            ColorRecordHeader colorHeader;
+            memcpy(&colorHeader, pPayload, sizeof(colorHeader));
+
+            pFrame->nTime = header.nTime;
+            pFrame->colorFormat = static_cast<ColorImageFormat>(colorHeader.nFormat);
+            pFrame->nColorWidth = colorHeader.nWidth;
+            pFrame->nColorHeight = colorHeader.nHeight;
+            pFrame->nColorStride = colorHeader.nStride;
+            pFrame->pColorBuffer = pPayload + sizeof(colorHeader);
+            pFrame->cbColorBuffer = header.cbPayload - sizeof(colorHeader);
+            pFrame->bColorEncoded = (SessionRecord_EncodedColor == header.nType);
+            return true;
+        }
+        break;
+
+    default:
+        // unknown records are skipped so newer recordings stay readable
+        break;
+    }
+
+    return false;
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+SessionWriter::SessionWriter() :
+    m_pFile(nullptr),
+    m_pEncoder(nullptr),
+    m_nOffset(0),
+    m_nFrameOffset(0),
+    m_bWriteFailed(false)
+{
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+SessionWriter::~SessionWriter()
+{
+    Close();
+}
+
+/// <summary>
+/// Creates a new recording, overwriting any existing file
+/// </summary>
+/// <param name="szPath">path of the recording</param>
+/// <param name="nColorWidth">width (in pixels) of the color frames</param>
+/// <param name="nColorHeight">height (in pixels) of the color frames</param>
+/// <param name="nAudioSamplesPerSecond">sample rate of the beam audio</param>
+/// <param name="pColorCodec">optional; how the YUY2 and BGRA color frames are encoded,
+/// null to store them as they are</param>
+/// <returns>indicates success or failure</returns>
+HRESULT SessionWriter::Open(const char* szPath, int nColorWidth, int nColorHeight, int nAudioSamplesPerSecond, const FrameCodecOptions* pColorCodec)
+{
+    Close();
+
+    m_pFile = OpenFile(szPath, "wb");
+    if (nullptr == m_pFile)
+    {
+        return E_FAIL;
+    }
+
+    SessionFileHeader header = {0};
+    memcpy(header.magic, c_SessionFileMagic, sizeof(header.magic));
+    header.nVersion = c_SessionFileVersion;
+    header.nColorWidth = nColorWidth;
+    header.nColorHeight = nColorHeight;
+    header.nAudioSamplesPerSecond = nAudioSamplesPerSecond;
+    header.nFlags = pColorCodec ? SessionFile_EncodedColor : 0;
+
+    if (1 != fwrite(&header, sizeof(header), 1, m_pFile))
+    {
+        fclose(m_pFile);
+        m_pFile = nullptr;
+        return E_FAIL;
+    }
+
+    m_nOffset = sizeof(header);
+    m_nFrameOffset = m_nOffset;
+    m_index.clear();
+    m_bWriteFailed = false;
+
+    if (pColorCodec)
+    {
+        m_pEncoder = new FrameEncoder(*pColorCodec);
+    }
+
+    return S_OK;
+}
+
+/// <summary>
+/// Appends the body, face and color records of a frame, encoding its color first if
+/// the recording was opened with a codec; frames may only be written from one thread
+/// </summary>
+/// <param name="pFrame">frame to record; a frame already encoded is stored as it is,
+/// which needs a recording opened with a codec</param>
+/// <returns>indicates success or failure</returns>
+HRESULT SessionWriter::WriteFrame(const SessionFrame* pFrame)
+{
+    HRESULT hr = S_OK;
+
+    if (nullptr == pFrame || nullptr == pFrame->pColorBuffer || (pFrame->bColorEncoded && nullptr == m_pEncoder))
+    {
+        return E_INVALIDARG;
+    }
+
+    UINT32 nColorType = pFrame->bColorEncoded ? SessionRecord_EncodedColor : SessionRecord_Color;
+    const BYTE* pColor = pFrame->pColorBuffer;
+    UINT cbColor = pFrame->cbColorBuffer;
+
+    if (pFrame->bColorEncoded)
+    {
+        // the encoder's previous frame is not the one this frame follows
+        m_pEncoder->Reset();
+    }
+    else if (m_pEncoder && (ColorImageFormat_Yuy2 == pFrame->colorFormat || ColorImageFormat_Bgra == pFrame->colorFormat) &&
+        cbColor >= static_cast<UINT>(pFrame->nColorStride) * pFrame->nColorHeight)
+    {
+        hr = m_pEncoder->Encode(pFrame->colorFormat, pFrame->nColorHeight, pFrame->nColorStride, pColor, &pColor, &cbColor);
+        nColorType = SessionRecord_EncodedColor;
+    }
+
+    if (SUCCEEDED(hr) && pFrame->bHaveBodyData)
+    {
+        hr = WriteRecord(SessionRecord_Bodies, pFrame->nTime, nullptr, 0, pFrame->bodies, sizeof(pFrame->bodies), nullptr);
+    }
+
+    if (SUCCEEDED(hr) && pFrame->bHaveFaceData)
+    {
+        hr = WriteRecord(SessionRecord_Faces, pFrame->nTime, nullptr, 0, pFrame->faces, sizeof(pFrame->faces), nullptr);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        ColorRecordHeader colorHeader;
+        colorHeader.nFormat = static_cast<UINT32>(pFrame->colorFormat);
+        colorHeader.nWidth = pFrame->nColorWidth;
+        colorHeader.nHeight = pFrame->nColorHeight;
+        colorHeader.nStride = pFrame->nColorStride;
+
+        UINT64 nColorOffset = 0;
+        hr = WriteRecord(nColorType, pFrame->nTime, &colorHeader, sizeof(colorHeader), pColor, cbColor, &nColorOffset);
+
+        if (SUCCEEDED(hr))
+        {
+            // audio written meanwhile belongs to the next frame, which starts after the color
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            SessionIndexEntry entry;
+            entry.nTime = pFrame->nTime;
+            entry.nOffset = m_nFrameOffset;
+            entry.nColorOffset = nColorOffset;
+            m_index.push_back(entry);
+
+            m_nFrameOffset = nColorOffset + sizeof(SessionRecordHeader) + sizeof(colorHeader) + cbColor;
+        }
+    }
+
+    return hr;
+}
+
+/// <summary>
+/// Appends an audio record
+/// </summary>
+/// <param name="nTime">time the audio was read, in 100ns ticks</param>
+/// <param name="pSamples">beam audio samples</param>
+/// <param name="nSampleCount">number of samples</param>
+/// <param name="fBeamAngle">beam angle in radians</param>
+/// <param name="fBeamAngleConfidence">beam angle confidence in the range [0,1]</param>
+/// <returns>indicates success or failure</returns>
+HRESULT SessionWriter::WriteAudio(INT64 nTime, const float* pSamples, UINT nSampleCount, float fBeamAngle, float fBeamAngleConfidence)
+{
+    AudioRecordHeader audioHeader = {0};
+    audioHeader.fBeamAngle = fBeamAngle;
+    audioHeader.fBeamAngleConfidence = fBeamAngleConfidence;
+    audioHeader.nSampleCount = nSampleCount;
+
+    return WriteRecord(SessionRecord_Audio, nTime, &audioHeader, sizeof(audioHeader), pSamples, nSampleCount * sizeof(float), nullptr);
+}
+
+/// <summary>
+/// Appends the frame index, then flushes and closes the recording
+/// </summary>
+/// <returns>indicates success or failure</returns>
+HRESULT SessionWriter::Close()
+{
+    HRESULT hr = S_OK;
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_pFile)
+    {
+        if (!m_bWriteFailed)
+        {
+            SessionIndexLocator locator = {0};
+            memcpy(locator.magic, c_SessionIndexMagic, sizeof(locator.magic));
+
+            hr = AppendRecord(SessionRecord_Index, 0, nullptr, 0, m_index.empty() ? nullptr : &m_index[0],
+                static_cast<UINT32>(m_index.size() * sizeof(SessionIndexEntry)), &locator.nIndexOffset);
+
+            if (SUCCEEDED(hr))
+            {
+                hr = AppendRecord(SessionRecord_IndexLocator, 0, nullptr, 0, &locator, sizeof(locator), nullptr);
+            }
+        }
+
+        if (0 != fclose(m_pFile))
+        {
+            hr = E_FAIL;
+        }
+        m_pFile = nullptr;
+    }
+
+    delete m_pEncoder;
+    m_pEncoder = nullptr;
+
+    return hr;
+}
+
+/// <summary>
+/// Appends a single record made of an optional fixed header and a data block
+/// </summary>
+/// <param name="nType">record type</param>
+/// <param name="nTime">record time in 100ns ticks</param>
+/// <param name="pHeader">record specific header, may be null</param>
+/// <param name="cbHeader">size of the record specific header</param>
+/// <param name="pData">record data, may be null</param>
+/// <param name="cbData">size of the record data</param>
+/// <param name="pnOffset">optional; receives the offset of the record</param>
+/// <returns>indicates success or failure</returns>
+HRESULT SessionWriter::WriteRecord(UINT32 nType, INT64 nTime, const void* pHeader, UINT32 cbHeader, const void* pData, UINT32 cbData, UINT64* pnOffset)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    return AppendRecord(nType, nTime, pHeader, cbHeader, pData, cbData, pnOffset);
+}
+
+/// <summary>
+/// Appends a single record as WriteRecord does; must be called with the mutex held
+/// </summary>
+/// <param name="nType">record type</param>
+/// <param name="nTime">record time in 100ns ticks</param>
+/// <param name="pHeader">record specific header, may be null</param>
+/// <param name="cbHeader">size of the record specific header</param>
+/// <param name="pData">record data, may be null</param>
+/// <param name="cbData">size of the record data</param>
+/// <param name="pnOffset">optional; receives the offset of the record</param>
+/// <returns>indicates success or failure</returns>
+HRESULT SessionWriter::AppendRecord(UINT32 nType, INT64 nTime, const void* pHeader, UINT32 cbHeader, const void* pData, UINT32 cbData, UINT64* pnOffset)
+{
+    if (nullptr == m_pFile)
+    {
+        return E_UNEXPECTED;
+    }
+
+    SessionRecordHeader recordHeader;
+    recordHeader.nType = nType;
+    recordHeader.cbPayload = cbHeader + cbData;
+    recordHeader.nTime = nTime;
+
+    bool bWritten = (1 == fwrite(&recordHeader, sizeof(recordHeader), 1, m_pFile));
+
+    if (bWritten && cbHeader > 0)
+    {
+        bWritten = (1 == fwrite(pHeader, cbHeader, 1, m_pFile));
+    }
+
+    if (bWritten && cbData > 0)
+    {
+        bWritten = (1 == fwrite(pData, cbData, 1, m_pFile));
+    }
+
+    if (!bWritten)
+    {
+        m_bWriteFailed = true;
+        return E_FAIL;
+    }
+
+    if (pnOffset)
+    {
+        *pnOffset = m_nOffset;
+    }
+
+    m_nOffset += sizeof(recordHeader) + recordHeader.cbPayload;
+    return S_OK;
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+SessionReader::SessionReader() :
+    m_pFile(nullptr)
+{
+    memset(&m_header, 0, sizeof(m_header));
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+SessionReader::~SessionReader()
+{
+    Close();
+}
+
+/// <summary>
+/// Opens an existing recording and validates its header
+/// </summary>
+/// <param name="szPath">path of the recording</param>
+/// <returns>indicates success or failure</returns>
+HRESULT SessionReader::Open(const char* szPath)
+{
+    Close();
+
+    m_pFile = OpenFile(szPath, "rb");
+    if (nullptr == m_pFile)
+    {
+        return E_FAIL;
+    }
+
+    HRESULT hr = S_OK;
+
+    if (1 != fread(&m_header, sizeof(m_header), 1, m_pFile))
+    {
+        hr = E_FAIL;
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        if (0 != memcmp(m_header.magic, c_SessionFileMagic, sizeof(m_header.magic)) ||
+            m_header.nVersion != c_SessionFileVersion)
+        {
+            hr = E_INVALIDARG;
+        }
+    }
+
+    if (FAILED(hr))
+    {
+        Close();
+    }
+
+    return hr;
+}
+
+/// <summary>
+/// Closes the recording
+/// </summary>
+void SessionReader::Close()
+{
+    if (m_pFile)
+    {
+        fclose(m_pFile);
+        m_pFile = nullptr;
+    }
+}
+
+/// <summary>
+/// Reads the next record
+/// </summary>
+/// <param name="pHeader">receives the record header</param>
+/// <param name="pPayload">receives the record payload</param>
+/// <returns>S_OK on success, S_FALSE at the end of the recording, else the failure code</returns>
+HRESULT SessionReader::ReadRecord(SessionRecordHeader* pHeader, std::vector<BYTE>* pPayload)
+{
+    if (nullptr == m_pFile)
+    {
+        return E_UNEXPECTED;
+    }
+
+    if (1 != fread(pHeader, sizeof(*pHeader), 1, m_pFile))
+    {
+        // a truncated trailing record is treated as the end of the recording
+        return S_FALSE;
+    }
+
+    if (pHeader->cbPayload > c_MaxRecordPayload)
+    {
+        return E_FAIL;
+    }
+
+    pPayload->resize(pHeader->cbPayload);
+    if (pHeader->cbPayload > 0 && 1 != fread(&(*pPayload)[0], pHeader->cbPayload, 1, m_pFile))
+    {
+        return S_FALSE;
+    }
+
+    return S_OK;
+}
+
+/// <summary>
+/// Moves back to the first record
+/// </summary>
+/// <returns>indicates success or failure</returns>
+HRESULT SessionReader::Rewind()
+{
+    if (nullptr == m_pFile)
+    {
+        return E_UNEXPECTED;
+    }
+
+    return (0 == fseek(m_pFile, sizeof(SessionFileHeader), SEEK_SET)) ? S_OK : E_FAIL;
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+MappedSession::MappedSession() :
+    m_pData(nullptr),
+    m_cbData(0),
+    m_bStoredIndex(false),
+    m_nRecordsEnd(0),
+    m_nBucketTicks(1)
+{
+    memset(&m_header, 0, sizeof(m_header));
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+MappedSession::~MappedSession()
+{
+    Close();
+}
+
+/// <summary>
+/// Maps an existing recording, validates its header and loads its index, walking the
+/// record headers if it has none
+/// </summary>
+/// <param name="szPath">path of the recording</param>
+/// <returns>indicates success or failure; E_OUTOFMEMORY if the recording does not fit
+/// into the address space</returns>
+HRESULT MappedSession::Open(const char* szPath)
+{
+    Close();
+
+    HRESULT hr = MapFile(szPath, sizeof(SessionFileHeader), &m_pData, &m_cbData);
+    if (FAILED(hr))
+    {
+        m_pData = nullptr;
+        m_cbData = 0;
+        return hr;
+    }
+
+    memcpy(&m_header, m_pData, sizeof(m_header));
+    if (0 != memcmp(m_header.magic, c_SessionFileMagic, sizeof(m_header.magic)) ||
+        m_header.nVersion != c_SessionFileVersion)
+    {
+        Close();
+        return E_INVALIDARG;
+    }
+
+    if (!LoadStoredIndex())
+    {
+        ScanIndex();
+    }
+
+    BuildTimeBuckets();
+    return S_OK;
+}
+
+/// <summary>
+/// Unmaps the recording
+/// </summary>
+void MappedSession::Close()
+{
+    if (m_pData)
+    {
+        UnmapFile(m_pData, m_cbData);
+        m_pData = nullptr;
+    }
+
+    m_cbData = 0;
+    memset(&m_header, 0, sizeof(m_header));
+    m_index.clear();
+    m_bStoredIndex = false;
+    m_nRecordsEnd = 0;
+    m_timeBuckets.clear();
+    m_nBucketTicks = 1;
+}
+
+/// <summary>
+/// Finds the last frame recorded at or before a time in constant time, for frames
+/// recorded at a steady rate
+/// </summary>
+/// <param name="nTime">RelativeTime in 100ns ticks</param>
+/// <returns>index of the frame; the first frame for a time before it, and the frame
+/// count if there are no frames</returns>
+size_t MappedSession::FindFrame(INT64 nTime) const
+{
+    size_t nFrames = m_index.size();
+    if (0 == nFrames || nTime <= m_index[0].nTime)
+    {
+        return 0;
+    }
+
+    size_t iBucket = (std::min)(static_cast<size_t>((nTime - m_index[0].nTime) / m_nBucketTicks), m_timeBuckets.size() - 1);
+
+    // the frame before the bucket's first one is earlier than nTime, so the walk ends past at least one frame
+    size_t iFrame = m_timeBuckets[iBucket];
+    while (iFrame < nFrames && m_index[iFrame].nTime <= nTime)
+    {
+        ++iFrame;
+    }
+
+    return iFrame - 1;
+}
+
+/// <summary>
+/// Reads a frame along with its body and face data and all the audio recorded since
+/// the previous frame, without copying its color
+/// </summary>
+/// <param name="iFrame">index of the frame</param>
+/// <param name="pFrame">receives the frame; its color buffer points into the mapping</param>
+/// <param name="pAudio">receives the audio chunks preceding the frame</param>
+/// <returns>indicates success or failure</returns>
+HRESULT MappedSession::ReadFrame(size_t iFrame, SessionFrame* pFrame, std::vector<AudioChunk>* pAudio) const
+{
+    if (iFrame >= m_index.size())
+    {
+        return E_INVALIDARG;
+    }
+
+    ResetSessionFrame(pFrame);
+    pAudio->clear();
+
+    const SessionIndexEntry& entry = m_index[iFrame];
+    UINT64 nOffset = entry.nOffset;
+
+    while (nOffset <= entry.nColorOffset && m_nRecordsEnd - nOffset >= sizeof(SessionRecordHeader))
+    {
+        SessionRecordHeader header;
+        memcpy(&header, m_pData + static_cast<size_t>(nOffset), sizeof(header));
+        if (header.cbPayload > m_nRecordsEnd - nOffset - sizeof(header))
+        {
+            break;
+        }
+
+        if (DecodeSessionRecord(header, m_pData + static_cast<size_t>(nOffset + sizeof(header)), pFrame, pAudio))
+        {
+            return (nOffset == entry.nColorOffset) ? S_OK : E_FAIL;
+        }
+
+        nOffset += sizeof(header) + header.cbPayload;
+    }
+
+    // the index does not match the records
+    return E_FAIL;
+}
+
+/// <summary>
+/// Loads the index the writer appended, after checking that it lies where its locator
+/// says and that its entries lie, in order, between the file header and the index
+/// </summary>
+/// <returns>true if the recording has a valid index</returns>
+bool MappedSession::LoadStoredIndex()
+{
+    const UINT64 cbLocatorRecord = sizeof(SessionRecordHeader) + sizeof(SessionIndexLocator);
+    if (m_cbData < sizeof(SessionFileHeader) + sizeof(SessionRecordHeader) + cbLocatorRecord)
+    {
+        return false;
+    }
+
+    UINT64 nLocatorOffset = m_cbData - cbLocatorRecord;
+    SessionRecordHeader header;
+    SessionIndexLocator locator;
+    memcpy(&header, m_pData + static_cast<size_t>(nLocatorOffset), sizeof(header));
+    memcpy(&locator, m_pData + static_cast<size_t>(nLocatorOffset + sizeof(header)), sizeof(locator));
+
+    if (SessionRecord_IndexLocator != header.nType || sizeof(locator) != header.cbPayload ||
+        0 != memcmp(locator.magic, c_SessionIndexMagic, sizeof(locator.magic)) ||
+        locator.nIndexOffset < sizeof(SessionFileHeader) || locator.nIndexOffset > nLocatorOffset - sizeof(header))
+    {
+        return false;
+    }
+
+    memcpy(&header, m_pData + static_cast<size_t>(locator.nIndexOffset), sizeof(header));
+    if (SessionRecord_Index != header.nType || 0 != header.cbPayload % sizeof(SessionIndexEntry) ||
+        locator.nIndexOffset + sizeof(header) + header.cbPayload != nLocatorOffset)
+    {
+        return false;
+    }
+
+    m_index.resize(header.cbPayload / sizeof(SessionIndexEntry));
+    if (!m_index.empty())
+    {
+        memcpy(&m_index[0], m_pData + static_cast<size_t>(locator.nIndexOffset + sizeof(header)), header.cbPayload);
+    }
+
+    // every frame starts after the color record of the one before it
+    UINT64 nMinOffset = sizeof(SessionFileHeader);
+    for (size_t i = 0; i < m_index.size(); ++i)
+    {
+        if (m_index[i].nOffset < nMinOffset || m_index[i].nOffset > m_index[i].nColorOffset ||
+            m_index[i].nColorOffset > locator.nIndexOffset - sizeof(SessionRecordHeader))
+        {
+            m_index.clear();
+            return false;
+        }
+
+        nMinOffset = m_index[i].nColorOffset + sizeof(SessionRecordHeader);
+    }
+
+    m_bStoredIndex = true;
+    m_nRecordsEnd = locator.nIndexOffset;
+    return true;
+}
+
+/// <summary>
+/// Rebuilds the index by walking the record headers, up to the last whole record, as
+/// the sequential reader would read them
+/// </summary>
+void MappedSession::ScanIndex()
+{
+    UINT64 nOffset = sizeof(SessionFileHeader);
+    UINT64 nFrameOffset = nOffset;
+
+    m_index.clear();
+    m_bStoredIndex = false;
+
+    while (m_cbData - nOffset >= sizeof(SessionRecordHeader))
+    {
+        SessionRecordHeader header;
+        memcpy(&header, m_pData + static_cast<size_t>(nOffset), sizeof(header));
+        if (header.cbPayload > c_MaxRecordPayload || header.cbPayload > m_cbData - nOffset - sizeof(header))
+        {
+            break;
+        }
+
+        UINT64 nNextOffset = nOffset + sizeof(header) + header.cbPayload;
+
+        if ((SessionRecord_Color == header.nType || SessionRecord_EncodedColor == header.nType) && header.cbPayload >= sizeof(ColorRecordHeader))
+        {
+            SessionIndexEntry entry;
+            entry.nTime = header.nTime;
+            entry.nOffset = nFrameOffset;
+            entry.nColorOffset = nOffset;
+            m_index.push_back(entry);
+
+            nFrameOffset = nNextOffset;
+        }
+
+        nOffset = nNextOffset;
+    }
+
+    m_nRecordsEnd = nOffset;
+}
+
+/// <summary>
+/// Splits the time the frames span into buckets of the mean frame interval and notes
+/// the first frame of each, for FindFrame
+/// </summary>
+void MappedSession::BuildTimeBuckets()
+{
+    m_timeBuckets.clear();
+    m_nBucketTicks = 1;
+
+    size_t nFrames = m_index.size();
+    if (0 == nFrames)
+    {
+        return;
+    }
+
+    INT64 nFirstTime = m_index[0].nTime;
+    INT64 nSpan = (std::max)(m_index[nFrames - 1].nTime - nFirstTime, static_cast<INT64>(0));
+    m_nBucketTicks = (std::max)(nSpan / static_cast<INT64>(nFrames), static_cast<INT64>(1));
+
+    size_t nBuckets = static_cast<size_t>(nSpan / m_nBucketTicks) + 1;
+    m_timeBuckets.resize(nBuckets);
+
+    size_t iFrame = 0;
+    for (size_t i = 0; i < nBuckets; ++i)
+    {
+        INT64 nBucketStart = nFirstTime + static_cast<INT64>(i) * m_nBucketTicks;
+        while (iFrame < nFrames && m_index[iFrame].nTime < nBucketStart)
+        {
+            ++iFrame;
+        }
+
+        m_timeBuckets[i] = static_cast<UINT32>(iFrame);
+    }
+}
+
+/// <summary>
+/// Appends a record to a file
+/// </summary>
+/// <param name="pFile">file to append to</param>
+/// <param name="nType">record type</param>
+/// <param name="pData">record payload, may be null</param>
+/// <param name="cbData">size of the record payload</param>
+/// <returns>true if the record was written</returns>
+static bool AppendFileRecord(FILE* pFile, UINT32 nType, const void* pData, UINT32 cbData)
+{
+    SessionRecordHeader header;
+    header.nType = nType;
+    header.cbPayload = cbData;
+    header.nTime = 0;
+
+    return 1 == fwrite(&header, sizeof(header), 1, pFile) && (0 == cbData || 1 == fwrite(pData, cbData, 1, pFile));
+}
+
+/// <summary>
+/// Appends an index to a recording that has none, such as one written before recordings
+/// were indexed
+/// </summary>
+/// <param name="szPath">path of the recording</param>
+/// <param name="pnFrames">optional; receives the number of frames indexed</param>
+/// <returns>S_OK, S_FALSE if the recording had an index already, E_FAIL for a recording
+/// ending in a truncated record, which the index cannot follow</returns>
+HRESULT AppendSessionIndex(const char* szPath, UINT64* pnFrames)
+{
+    std::vector<SessionIndexEntry> index;
+    SessionIndexLocator locator = {0};
+    memcpy(locator.magic, c_SessionIndexMagic, sizeof(locator.magic));
+
+    {
+        MappedSession session;
+        HRESULT hr = session.Open(szPath);
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+
+        if (pnFrames)
+        {
+            *pnFrames = session.GetIndex().size();
+        }
+
+        if (session.HasStoredIndex())
+        {
+            return S_FALSE;
+        }
+
+        if (session.GetRecordsEnd() != session.GetFileSize())
+        {
+            return E_FAIL;
+        }
+
+        index = session.GetIndex();
+        locator.nIndexOffset = session.GetRecordsEnd();
+    }
+
+    FILE* pFile = OpenFile(szPath, "ab");
+    if (nullptr == pFile)
+    {
+        return E_FAIL;
+    }
+
+    bool bWritten = AppendFileRecord(pFile, SessionRecord_Index, index.empty() ? nullptr : &index[0],
+        static_cast<UINT32>(index.size() * sizeof(SessionIndexEntry)));
+    bWritten = bWritten && AppendFileRecord(pFile, SessionRecord_IndexLocator, &locator, sizeof(locator));
+
+    if (0 != fclose(pFile))
+    {
+        bWritten = false;
+    }
+
+    return bWritten ? S_OK : E_FAIL;
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+SessionReplaySource::SessionReplaySource() :
+    m_iNextFrame(0),
+    m_pacing(ReplayPacing_MaxSpeed),
+    m_nFirstFrameTime(0),
+    m_nReplayStartTicks(0),
+    m_bStarted(false),
+    m_pDecoder(nullptr),
+    m_nDecodeThreads(0)
+{
+    memset(&m_recordHeader, 0, sizeof(m_recordHeader));
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+SessionReplaySource::~SessionReplaySource()
+{
+    delete m_pDecoder;
+}
+
+/// <summary>
+/// Opens a recording for replay, mapped into memory unless it does not fit into
+/// the address space, in which case it is read record by record
+/// </summary>
+/// <param name="szPath">path of the recording</param>
+/// <param name="pacing">whether to replay in real time or as fast as possible</param>
+/// <returns>indicates success or failure</returns>
+HRESULT SessionReplaySource::Open(const char* szPath, ReplayPacing pacing)
+{
+    m_pacing = pacing;
+    m_bStarted = false;
+    m_iNextFrame = 0;
+    m_reader.Close();
+    if (m_pDecoder)
+    {
+        m_pDecoder->Reset();
+    }
+
+    HRESULT hr = m_mapped.Open(szPath);
+    if (E_OUTOFMEMORY == hr)
+    {
+        hr = m_reader.Open(szPath);
+    }
+
+    return hr;
+}
+
+/// <summary>
+/// Reads the next color frame along with its body and face data, and all the
+/// audio recorded since the previous frame, decoding its color if it was encoded.
+/// With real time pacing this blocks until the frame is due.
+/// </summary>
+/// <param name="pFrame">receives the frame; its color buffer stays valid until the
+/// next call, or until the source is closed if IsColorStable</param>
+/// <param name="pAudio">receives the audio chunks preceding the frame</param>
+/// <returns>S_OK on success, S_FALSE at the end of the recording, else the failure code</returns>
+HRESULT SessionReplaySource::ReadNextFrame(SessionFrame* pFrame, std::vector<AudioChunk>* pAudio)
+{
+    ResetSessionFrame(pFrame);
+    pAudio->clear();
+
+    if (m_mapped.IsOpen())
+    {
+        if (m_iNextFrame >= m_mapped.GetIndex().size())
+        {
+            return S_FALSE;
+        }
+
+        HRESULT hr = m_mapped.ReadFrame(m_iNextFrame++, pFrame, pAudio);
+        if (SUCCEEDED(hr))
+        {
+            hr = DecodeColor(pFrame);
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            WaitUntilDue(pFrame->nTime);
+        }
+
+        return hr;
+    }
+
+    for (;;)
+    {
+        HRESULT hr = m_reader.ReadRecord(&m_recordHeader, &m_payload);
+        if (S_OK != hr)
+        {
+            return hr;
+        }
+
+        if (DecodeSessionRecord(m_recordHeader, m_payload.empty() ? nullptr : &m_payload[0], pFrame, pAudio))
+        {
+            // keep the pixels alive until the next call; swapping leaves them where they are
+            m_colorPayload.swap(m_payload);
+
+            hr = DecodeColor(pFrame);
+            if (SUCCEEDED(hr))
+            {
+                WaitUntilDue(pFrame->nTime);
+            }
+
+            return hr;
+        }
+    }
+}
+
+/// <summary>
+/// Restarts the replay from the first frame
+/// </summary>
+/// <returns>indicates success or failure</returns>
+HRESULT SessionReplaySource::Rewind()
+{
+    m_bStarted = false;
+
+    if (m_pDecoder)
+    {
+        m_pDecoder->Reset();
+    }
+
+    if (m_mapped.IsOpen())
+    {
+        m_iNextFrame = 0;
+        return S_OK;
+    }
+
+    return m_reader.Rewind();
+}
+
+/// <summary>
+/// Continues the replay from the last frame recorded at or before a time; the audio
+/// before that frame is skipped. Only a mapped recording can seek; for encoded color
+/// the frames from the key frame before on are decoded first.
+/// </summary>
+/// <param name="nTime">RelativeTime in 100ns ticks</param>
+/// <returns>indicates success or failure; E_NOTIMPL if the recording is not mapped</returns>
+HRESULT SessionReplaySource::Seek(INT64 nTime)
+{
+    if (!m_mapped.IsOpen())
+    {
+        return E_NOTIMPL;
+    }
+
+    // real time pacing starts over from the frame sought
+    m_bStarted = false;
+    m_iNextFrame = m_mapped.FindFrame(nTime);
+
+    if (0 == (m_mapped.GetHeader().nFlags & SessionFile_EncodedColor) || m_iNextFrame >= m_mapped.GetIndex().size())
+    {
+        return S_OK;
+    }
+
+    // the frame sought decodes after the one before it, and so on back to a key frame
+    SessionFrame frame;
+    std::vector<AudioChunk> audio;
+    size_t iKeyFrame = m_iNextFrame;
+    HRESULT hr = S_OK;
+
+    for (; iKeyFrame > 0; --iKeyFrame)
+    {
+        hr = m_mapped.ReadFrame(iKeyFrame, &frame, &audio);
+        if (FAILED(hr) || !frame.bColorEncoded || IsEncodedKeyFrame(frame.pColorBuffer, frame.cbColorBuffer))
+        {
+            break;
+        }
+    }
+
+    if (m_pDecoder)
+    {
+        m_pDecoder->Reset();
+    }
+
+    for (size_t i = iKeyFrame; SUCCEEDED(hr) && i < m_iNextFrame; ++i)
+    {
+        hr = m_mapped.ReadFrame(i, &frame, &audio);
+        if (SUCCEEDED(hr))
+        {
+            hr = DecodeColor(&frame);
+        }
+    }
+
+    return hr;
+}
+
+/// <summary>
+/// Replaces the color of a frame read from an encoded color record with the decoded
+/// frame, which stays valid until the next frame is decoded
+/// </summary>
+/// <param name="pFrame">frame read</param>
+/// <returns>indicates success or failure</returns>
+HRESULT SessionReplaySource::DecodeColor(SessionFrame* pFrame)
+{
+    if (!pFrame->bColorEncoded)
+    {
+        return S_OK;
+    }
+
+    if (nullptr == m_pDecoder)
+    {
+        m_pDecoder = new FrameDecoder(m_nDecodeThreads);
+    }
+
+    const BYTE* pPixels = nullptr;
+    HRESULT hr = m_pDecoder->Decode(pFrame->colorFormat, pFrame->nColorHeight, pFrame->nColorStride, pFrame->pColorBuffer,
+        pFrame->cbColorBuffer, &pPixels);
+
+    if (SUCCEEDED(hr))
+    {
+        pFrame->pColorBuffer = pPixels;
+        pFrame->cbColorBuffer = static_cast<UINT>(pFrame->nColorStride) * pFrame->nColorHeight;
+        pFrame->bColorEncoded = false;
+    }
+
+    return hr;
+}
+
+/// <summary>
+/// With real time pacing, blocks until the frame with the given time is due
+/// </summary>
+/// <param name="nTime">RelativeTime of the frame in 100ns ticks</param>
+void SessionReplaySource::WaitUntilDue(INT64 nTime)
+{
+    INT64 nNow = GetPerfClockTicks();
+
+    if (!m_bStarted)
+    {
+        m_nFirstFrameTime = nTime;
+        m_nReplayStartTicks = nNow;
+        m_bStarted = true;
+        return;
+    }
+
+    if (ReplayPacing_RealTime == m_pacing)
+    {
+        INT64 nDue = m_nReplayStartTicks + (nTime - m_nFirstFrameTime);
+        if (nDue > nNow)
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds((nDue - nNow) / 10));
+        }
+    }
+}
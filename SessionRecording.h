@@ -0,0 +1,550 @@
+//------------------------------------------------------------------------------
+// <copyright file="SessionRecording.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Timestamped container for the color, body, face and audio beam streams, so the
+// speaker ROI pipeline can be profiled and regression tested without a sensor.
+//
+// A recording is a SessionFileHeader followed by a sequence of records. Every record
+// starts with a SessionRecordHeader carrying its type, payload size and the Kinect
+// RelativeTime it belongs to. For each color frame the writer emits the bodies and
+// faces records first and the color record last; audio records are interleaved as
+// they are read. All values are stored little endian in their in-memory layout.
+//
+// Closing the writer appends an index of the frames, one SessionIndexEntry per color
+// record, and a locator record of fixed size that ends the file and points back at the
+// index. Both are record types older readers skip, so the format version is unchanged.
+// A MappedSession maps the whole recording and seeks to any frame through the index
+// without reading the frames before it; recordings without an index, such as one cut
+// short, are indexed by walking the record headers when they are opened.
+//
+// A recording opened with a frame codec stores encoded color records in place of the
+// color records, encoded as FrameCodec.h describes and flagged in the file header.
+// Encoded frames other than key frames only decode after the frame before them, so the
+// replay source decodes them in order and seeks by decoding on from a key frame.
+
+#pragma once
+
+#include <stdio.h>
+#include <mutex>
+#include <vector>
+#include "KinectTypes.h"
+#include "FrameCodec.h"
+
+// Identifies a session recording file
+static const char c_SessionFileMagic[4] = { 'A', 'F', 'R', 'S' };
+
+// Current version of the session recording format
+static const UINT32 c_SessionFileVersion = 1;
+
+enum SessionRecordType
+{
+    SessionRecord_Color     = 1,
+    SessionRecord_Bodies    = 2,
+    SessionRecord_Faces     = 3,
+    SessionRecord_Audio     = 4,
+
+    // Array of SessionIndexEntry, one per color record in the order written
+    SessionRecord_Index     = 5,
+
+    // SessionIndexLocator; the last record of an indexed recording
+    SessionRecord_IndexLocator = 6,
+
+    // ColorRecordHeader followed by a frame encoded by a FrameEncoder; completes a
+    // frame as a color record does, and is indexed as one
+    SessionRecord_EncodedColor = 7
+};
+
+enum SessionFileFlags
+{
+    // Color frames may be stored as encoded color records
+    SessionFile_EncodedColor = 1
+};
+
+// Identifies the payload of an index locator record
+static const char c_SessionIndexMagic[4] = { 'A', 'F', 'R', 'I' };
+
+enum ReplayPacing
+{
+    // Frames are delivered at the pace they were recorded at
+    ReplayPacing_RealTime   = 0,
+
+    // Frames are delivered as fast as they can be read
+    ReplayPacing_MaxSpeed   = 1
+};
+
+struct SessionFileHeader
+{
+    char                magic[4];
+    UINT32              nVersion;
+    INT32               nColorWidth;
+    INT32               nColorHeight;
+    UINT32              nAudioSamplesPerSecond;
+
+    // SessionFileFlags; 0 in recordings written before there were any
+    UINT32              nFlags;
+};
+
+struct SessionRecordHeader
+{
+    UINT32              nType;
+    UINT32              cbPayload;
+    INT64               nTime;
+};
+
+struct BodySample
+{
+    // Non-zero if the body is tracked
+    UINT32              bTracked;
+    UINT32              nReserved;
+    UINT64              nTrackingId;
+
+    // Head joint position in camera space
+    CameraSpacePoint    headJoint;
+    float               fReserved;
+};
+
+struct FaceSample
+{
+    // Non-zero if the face frame had a valid tracking id
+    UINT32              bTracked;
+
+    // Non-zero if the face result and its text layout position were all retrieved
+    UINT32              bHaveResult;
+    UINT64              nTrackingId;
+    RectI               faceBox;
+    PointF              facePoints[FacePointType_Count];
+    Vector4             faceRotation;
+    DetectionResult     faceProperties[FaceProperty_Count];
+    PointF              faceTextLayout;
+};
+
+struct ColorRecordHeader
+{
+    UINT32              nFormat;
+    INT32               nWidth;
+    INT32               nHeight;
+    UINT32              nStride;
+};
+
+struct AudioRecordHeader
+{
+    float               fBeamAngle;
+    float               fBeamAngleConfidence;
+    UINT32              nSampleCount;
+    UINT32              nReserved;
+};
+
+/// <summary>
+/// Where the records of one frame lie in the recording
+/// </summary>
+struct SessionIndexEntry
+{
+    // RelativeTime of the color frame in 100ns ticks
+    INT64               nTime;
+
+    // Offset of the first record of the frame: the one after the color record of the
+    // previous frame, or after the file header for the first frame
+    UINT64              nOffset;
+
+    // Offset of the color record, the last record of the frame
+    UINT64              nColorOffset;
+};
+
+struct SessionIndexLocator
+{
+    // Offset of the index record
+    UINT64              nIndexOffset;
+    char                magic[4];
+    UINT32              nReserved;
+};
+
+static_assert(sizeof(SessionFileHeader) == 24, "SessionFileHeader layout is part of the file format");
+static_assert(sizeof(SessionRecordHeader) == 16, "SessionRecordHeader layout is part of the file format");
+static_assert(sizeof(BodySample) == 32, "BodySample layout is part of the file format");
+static_assert(sizeof(FaceSample) == 128, "FaceSample layout is part of the file format");
+static_assert(sizeof(SessionIndexEntry) == 24, "SessionIndexEntry layout is part of the file format");
+static_assert(sizeof(SessionIndexLocator) == 16, "SessionIndexLocator layout is part of the file format");
+
+/// <summary>
+/// Everything the speaker ROI pipeline consumes for a single color frame
+/// </summary>
+struct SessionFrame
+{
+    // RelativeTime of the color frame in 100ns ticks
+    INT64               nTime;
+
+    // Color frame pixels; owned by whoever filled in the frame
+    ColorImageFormat    colorFormat;
+    int                 nColorWidth;
+    int                 nColorHeight;
+    int                 nColorStride;
+    const BYTE*         pColorBuffer;
+    UINT                cbColorBuffer;
+
+    // Whether the color buffer holds the frame encoded, as read from an encoded color
+    // record; the format, size and stride are those of the decoded frame
+    bool                bColorEncoded;
+
+    bool                bHaveBodyData;
+    BodySample          bodies[BODY_COUNT];
+
+    bool                bHaveFaceData;
+    FaceSample          faces[BODY_COUNT];
+};
+
+/// <summary>
+/// A block of beam audio together with the beam state it was read with
+/// </summary>
+struct AudioChunk
+{
+    INT64               nTime;
+    float               fBeamAngle;
+    float               fBeamAngleConfidence;
+    std::vector<float>  samples;
+};
+
+/// <summary>
+/// Clears a frame so that it holds no color, body or face data
+/// </summary>
+/// <param name="pFrame">frame to clear</param>
+void ResetSessionFrame(SessionFrame* pFrame);
+
+/// <summary>
+/// Adds a record to the frame being read: bodies and faces are copied into the frame,
+/// audio is appended to the chunks, and the color record completes the frame
+/// </summary>
+/// <param name="header">header of the record</param>
+/// <param name="pPayload">payload of the record, header.cbPayload bytes</param>
+/// <param name="pFrame">frame being read; its color buffer points into the payload</param>
+/// <param name="pAudio">receives the audio chunk of an audio record</param>
+/// <returns>true if the record was the color record completing the frame</returns>
+bool DecodeSessionRecord(const SessionRecordHeader& header, const BYTE* pPayload, SessionFrame* pFrame, std::vector<AudioChunk>* pAudio);
+
+// Frames and audio may be written from different threads; each record is appended atomically.
+class SessionWriter
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    SessionWriter();
+
+    /// <summary>
+    /// Destructor
+    /// </summary>
+    ~SessionWriter();
+
+    /// <summary>
+    /// Creates a new recording, overwriting any existing file
+    /// </summary>
+    /// <param name="szPath">path of the recording</param>
+    /// <param name="nColorWidth">width (in pixels) of the color frames</param>
+    /// <param name="nColorHeight">height (in pixels) of the color frames</param>
+    /// <param name="nAudioSamplesPerSecond">sample rate of the beam audio</param>
+    /// <param name="pColorCodec">optional; how the YUY2 and BGRA color frames are encoded,
+    /// null to store them as they are</param>
+    /// <returns>indicates success or failure</returns>
+    HRESULT Open(const char* szPath, int nColorWidth, int nColorHeight, int nAudioSamplesPerSecond, const FrameCodecOptions* pColorCodec);
+
+    /// <summary>
+    /// Appends the body, face and color records of a frame, encoding its color first if
+    /// the recording was opened with a codec; frames may only be written from one thread
+    /// </summary>
+    /// <param name="pFrame">frame to record; a frame already encoded is stored as it is,
+    /// which needs a recording opened with a codec</param>
+    /// <returns>indicates success or failure</returns>
+    HRESULT WriteFrame(const SessionFrame* pFrame);
+
+    /// <summary>
+    /// Appends an audio record
+    /// </summary>
+    /// <param name="nTime">time the audio was read, in 100ns ticks</param>
+    /// <param name="pSamples">beam audio samples</param>
+    /// <param name="nSampleCount">number of samples</param>
+    /// <param name="fBeamAngle">beam angle in radians</param>
+    /// <param name="fBeamAngleConfidence">beam angle confidence in the range [0,1]</param>
+    /// <returns>indicates success or failure</returns>
+    HRESULT WriteAudio(INT64 nTime, const float* pSamples, UINT nSampleCount, float fBeamAngle, float fBeamAngleConfidence);
+
+    /// <summary>
+    /// Appends the frame index, then flushes and closes the recording
+    /// </summary>
+    /// <returns>indicates success or failure</returns>
+    HRESULT Close();
+
+    /// <summary>
+    /// Whether a recording is currently open
+    /// </summary>
+    bool IsOpen() const { return nullptr != m_pFile; }
+
+private:
+    HRESULT WriteRecord(UINT32 nType, INT64 nTime, const void* pHeader, UINT32 cbHeader, const void* pData, UINT32 cbData, UINT64* pnOffset);
+    HRESULT AppendRecord(UINT32 nType, INT64 nTime, const void* pHeader, UINT32 cbHeader, const void* pData, UINT32 cbData, UINT64* pnOffset);
+
+    FILE*               m_pFile;
+    std::mutex          m_mutex;
+
+    // Encodes the color of the frames written, null for raw color; only WriteFrame uses it,
+    // outside of the mutex, so audio is appended while a frame is being encoded
+    FrameEncoder*       m_pEncoder;
+
+    // Bytes written so far, and where the records of the next frame start
+    UINT64              m_nOffset;
+    UINT64              m_nFrameOffset;
+
+    // Index of the frames written, appended on Close. After a failed write the offsets
+    // are unknown, so no index is appended and readers walk the records instead.
+    std::vector<SessionIndexEntry> m_index;
+    bool                m_bWriteFailed;
+};
+
+class SessionReader
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    SessionReader();
+
+    /// <summary>
+    /// Destructor
+    /// </summary>
+    ~SessionReader();
+
+    /// <summary>
+    /// Opens an existing recording and validates its header
+    /// </summary>
+    /// <param name="szPath">path of the recording</param>
+    /// <returns>indicates success or failure</returns>
+    HRESULT Open(const char* szPath);
+
+    /// <summary>
+    /// Closes the recording
+    /// </summary>
+    void Close();
+
+    /// <summary>
+    /// Reads the next record
+    /// </summary>
+    /// <param name="pHeader">receives the record header</param>
+    /// <param name="pPayload">receives the record payload</param>
+    /// <returns>S_OK on success, S_FALSE at the end of the recording, else the failure code</returns>
+    HRESULT ReadRecord(SessionRecordHeader* pHeader, std::vector<BYTE>* pPayload);
+
+    /// <summary>
+    /// Moves back to the first record
+    /// </summary>
+    /// <returns>indicates success or failure</returns>
+    HRESULT Rewind();
+
+    /// <summary>
+    /// Header of the open recording
+    /// </summary>
+    const SessionFileHeader& GetHeader() const { return m_header; }
+
+private:
+    FILE*               m_pFile;
+    SessionFileHeader   m_header;
+};
+
+// Maps a whole recording into memory. Frames are read straight out of the mapping: a
+// frame's color buffer points into it and stays valid until the recording is closed.
+// Nothing is written to the mapping, so any number of threads may read frames at once.
+class MappedSession
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    MappedSession();
+
+    /// <summary>
+    /// Destructor
+    /// </summary>
+    ~MappedSession();
+
+    /// <summary>
+    /// Maps an existing recording, validates its header and loads its index, walking the
+    /// record headers if it has none
+    /// </summary>
+    /// <param name="szPath">path of the recording</param>
+    /// <returns>indicates success or failure; E_OUTOFMEMORY if the recording does not fit
+    /// into the address space</returns>
+    HRESULT Open(const char* szPath);
+
+    /// <summary>
+    /// Unmaps the recording
+    /// </summary>
+    void Close();
+
+    /// <summary>
+    /// Whether a recording is mapped
+    /// </summary>
+    bool IsOpen() const { return nullptr != m_pData; }
+
+    /// <summary>
+    /// Header of the mapped recording
+    /// </summary>
+    const SessionFileHeader& GetHeader() const { return m_header; }
+
+    /// <summary>
+    /// Whether the index was stored in the recording rather than rebuilt on Open
+    /// </summary>
+    bool HasStoredIndex() const { return m_bStoredIndex; }
+
+    /// <summary>
+    /// Index of the frames, in the order recorded
+    /// </summary>
+    const std::vector<SessionIndexEntry>& GetIndex() const { return m_index; }
+
+    /// <summary>
+    /// Size of the recording in bytes
+    /// </summary>
+    UINT64 GetFileSize() const { return m_cbData; }
+
+    /// <summary>
+    /// Offset the frame and audio records end at: where the index starts, or for an
+    /// unindexed recording the end of its last whole record
+    /// </summary>
+    UINT64 GetRecordsEnd() const { return m_nRecordsEnd; }
+
+    /// <summary>
+    /// Finds the last frame recorded at or before a time in constant time, for frames
+    /// recorded at a steady rate
+    /// </summary>
+    /// <param name="nTime">RelativeTime in 100ns ticks</param>
+    /// <returns>index of the frame; the first frame for a time before it, and the frame
+    /// count if there are no frames</returns>
+    size_t FindFrame(INT64 nTime) const;
+
+    /// <summary>
+    /// Reads a frame along with its body and face data and all the audio recorded since
+    /// the previous frame, without copying its color
+    /// </summary>
+    /// <param name="iFrame">index of the frame</param>
+    /// <param name="pFrame">receives the frame; its color buffer points into the mapping,
+    /// and holds the frame encoded if it was recorded so</param>
+    /// <param name="pAudio">receives the audio chunks preceding the frame</param>
+    /// <returns>indicates success or failure</returns>
+    HRESULT ReadFrame(size_t iFrame, SessionFrame* pFrame, std::vector<AudioChunk>* pAudio) const;
+
+private:
+    bool LoadStoredIndex();
+    void ScanIndex();
+    void BuildTimeBuckets();
+
+    const BYTE*         m_pData;
+    UINT64              m_cbData;
+    SessionFileHeader   m_header;
+
+    std::vector<SessionIndexEntry> m_index;
+    bool                m_bStoredIndex;
+    UINT64              m_nRecordsEnd;
+
+    // First frame at or after the start of each span of m_nBucketTicks from the first
+    // frame on; a span is the mean frame interval, so a lookup checks a frame or two
+    std::vector<UINT32> m_timeBuckets;
+    INT64               m_nBucketTicks;
+};
+
+/// <summary>
+/// Appends an index to a recording that has none, such as one written before recordings
+/// were indexed
+/// </summary>
+/// <param name="szPath">path of the recording</param>
+/// <param name="pnFrames">optional; receives the number of frames indexed</param>
+/// <returns>S_OK, S_FALSE if the recording had an index already, E_FAIL for a recording
+/// ending in a truncated record, which the index cannot follow</returns>
+HRESULT AppendSessionIndex(const char* szPath, UINT64* pnFrames);
+
+class SessionReplaySource
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    SessionReplaySource();
+
+    /// <summary>
+    /// Destructor
+    /// </summary>
+    ~SessionReplaySource();
+
+    /// <summary>
+    /// Opens a recording for replay, mapped into memory unless it does not fit into
+    /// the address space, in which case it is read record by record
+    /// </summary>
+    /// <param name="szPath">path of the recording</param>
+    /// <param name="pacing">whether to replay in real time or as fast as possible</param>
+    /// <returns>indicates success or failure</returns>
+    HRESULT Open(const char* szPath, ReplayPacing pacing);
+
+    /// <summary>
+    /// Reads the next color frame along with its body and face data, and all the
+    /// audio recorded since the previous frame, decoding its color if it was encoded.
+    /// With real time pacing this blocks until the frame is due.
+    /// </summary>
+    /// <param name="pFrame">receives the frame; its color buffer stays valid until the
+    /// next call, or until the source is closed if IsColorStable</param>
+    /// <param name="pAudio">receives the audio chunks preceding the frame</param>
+    /// <returns>S_OK on success, S_FALSE at the end of the recording, else the failure code</returns>
+    HRESULT ReadNextFrame(SessionFrame* pFrame, std::vector<AudioChunk>* pAudio);
+
+    /// <summary>
+    /// Restarts the replay from the first frame
+    /// </summary>
+    /// <returns>indicates success or failure</returns>
+    HRESULT Rewind();
+
+    /// <summary>
+    /// Continues the replay from the last frame recorded at or before a time; the audio
+    /// before that frame is skipped. Only a mapped recording can seek; for encoded color
+    /// the frames from the key frame before on are decoded first.
+    /// </summary>
+    /// <param name="nTime">RelativeTime in 100ns ticks</param>
+    /// <returns>indicates success or failure; E_NOTIMPL if the recording is not mapped</returns>
+    HRESULT Seek(INT64 nTime);
+
+    /// <summary>
+    /// Sets the threads decoding encoded color; call it before the first encoded frame
+    /// is read. A source replayed next to others, as on a pipeline worker pool, decodes
+    /// on its own thread alone, since the sources open at once keep every core busy.
+    /// </summary>
+    /// <param name="nThreads">threads, the reading one included, or 0 for one per hardware thread</param>
+    void SetDecodeThreads(int nThreads) { m_nDecodeThreads = nThreads; }
+
+    /// <summary>
+    /// Whether the color buffers of the frames read stay valid until the source is
+    /// closed rather than until the next read, as they do for a mapped recording unless
+    /// its color is decoded
+    /// </summary>
+    bool IsColorStable() const { return m_mapped.IsOpen() && 0 == (m_mapped.GetHeader().nFlags & SessionFile_EncodedColor); }
+
+    /// <summary>
+    /// Header of the recording being replayed
+    /// </summary>
+    const SessionFileHeader& GetHeader() const { return m_mapped.IsOpen() ? m_mapped.GetHeader() : m_reader.GetHeader(); }
+
+private:
+    HRESULT DecodeColor(SessionFrame* pFrame);
+    void WaitUntilDue(INT64 nTime);
+
+    MappedSession       m_mapped;
+    size_t              m_iNextFrame;
+    SessionReader       m_reader;
+    ReplayPacing        m_pacing;
+    SessionRecordHeader m_recordHeader;
+    std::vector<BYTE>   m_payload;
+    std::vector<BYTE>   m_colorPayload;
+    INT64               m_nFirstFrameTime;
+    INT64               m_nReplayStartTicks;
+    bool                m_bStarted;
+
+    // Decodes encoded color, created with the first encoded frame on as many threads
+    // as asked for, 0 for one per hardware thread
+    FrameDecoder*       m_pDecoder;
+    int                 m_nDecodeThreads;
+};
@@ -0,0 +1,409 @@
+//------------------------------------------------------------------------------
+// <copyright file="SpeakerLog.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "KinectTypes.h"
+#include <string.h>
+#include "PerfClock.h"
+#include "SpeakerLog.h"
+
+/// <summary>
+/// Opens a file with the C runtime
+/// </summary>
+/// <param name="szPath">path of the file</param>
+/// <param name="szMode">fopen style mode string</param>
+/// <returns>the open file or nullptr on failure</returns>
+static FILE* OpenFile(const char* szPath, const char* szMode)
+{
+    FILE* pFile = nullptr;
+#if defined(_WIN32)
+    if (0 != fopen_s(&pFile, szPath, szMode))
+    {
+        pFile = nullptr;
+    }
+#else
+    pFile = fopen(szPath, szMode);
+#endif
+    return pFile;
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+SpeakerLogWriter::SpeakerLogWriter() :
+    m_pFile(nullptr),
+    m_iFront(0),
+    m_nFrontCount(0),
+    m_nFrontStartNs(0),
+    m_nBackCount(0),
+    m_bBackBusy(false),
+    m_bStopping(false),
+    m_nAppended(0),
+    m_nDropped(0),
+    m_hrWrite(S_OK)
+{
+    memset(&m_writerStats, 0, sizeof(m_writerStats));
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+SpeakerLogWriter::~SpeakerLogWriter()
+{
+    Close();
+}
+
+/// <summary>
+/// Creates a new log, overwriting any existing file, and starts the writer thread;
+/// both buffers are allocated here
+/// </summary>
+/// <param name="szPath">path of the log</param>
+/// <returns>indicates success or failure</returns>
+HRESULT SpeakerLogWriter::Open(const char* szPath)
+{
+    Close();
+
+    m_pFile = OpenFile(szPath, "wb");
+    if (nullptr == m_pFile)
+    {
+        return E_FAIL;
+    }
+
+    SpeakerLogFileHeader header = {0};
+    memcpy(header.magic, c_SpeakerLogMagic, sizeof(header.magic));
+    header.nVersion = c_SpeakerLogVersion;
+    header.cbRecord = sizeof(SpeakerLogRecord);
+
+    if (1 != fwrite(&header, sizeof(header), 1, m_pFile))
+    {
+        fclose(m_pFile);
+        m_pFile = nullptr;
+        return E_FAIL;
+    }
+
+    m_buffers[0].resize(c_SpeakerLogBufferRecords);
+    m_buffers[1].resize(c_SpeakerLogBufferRecords);
+    m_iFront = 0;
+    m_nFrontCount = 0;
+    m_nBackCount = 0;
+    m_bBackBusy.store(false);
+    m_bStopping = false;
+    m_nAppended = 0;
+    m_nDropped = 0;
+    memset(&m_writerStats, 0, sizeof(m_writerStats));
+    m_hrWrite = S_OK;
+
+    m_thread = std::thread(&SpeakerLogWriter::WriterThread, this);
+    return S_OK;
+}
+
+/// <summary>
+/// Appends a record without waiting for the disk; only one thread may append
+/// </summary>
+/// <param name="record">record to append</param>
+/// <returns>false if the record was dropped since both buffers were full</returns>
+bool SpeakerLogWriter::Append(const SpeakerLogRecord& record)
+{
+    if (nullptr == m_pFile)
+    {
+        return false;
+    }
+
+    if (c_SpeakerLogBufferRecords == m_nFrontCount && !HandOff())
+    {
+        m_nDropped++;
+        return false;
+    }
+
+    INT64 nNowNs = GetPerfClockNs();
+    if (0 == m_nFrontCount)
+    {
+        m_nFrontStartNs = nNowNs;
+    }
+
+    m_buffers[m_iFront][m_nFrontCount++] = record;
+    m_nAppended++;
+
+    // a full buffer goes right away; a failed hand-off is retried on the next record
+    if (c_SpeakerLogBufferRecords == m_nFrontCount || IsFrontStale(nNowNs))
+    {
+        HandOff();
+    }
+
+    return true;
+}
+
+/// <summary>
+/// Hands the front buffer to the writer thread if it has held records for
+/// c_SpeakerLogHandOffMs; call it from the appending thread every frame, appended
+/// to or not
+/// </summary>
+void SpeakerLogWriter::HandOffIfStale()
+{
+    // a failed hand-off is retried on the next call
+    if (nullptr != m_pFile && IsFrontStale(GetPerfClockNs()))
+    {
+        HandOff();
+    }
+}
+
+/// <summary>
+/// Writes out every record appended, stops the writer thread and closes the file
+/// </summary>
+/// <returns>indicates success or failure of every write since Open</returns>
+HRESULT SpeakerLogWriter::Close()
+{
+    if (nullptr == m_pFile)
+    {
+        return S_OK;
+    }
+
+    if (m_nFrontCount > 0)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_backFree.wait(lock, [this]() { return !m_bBackBusy.load(); });
+        lock.unlock();
+
+        HandOff();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_bStopping = true;
+    }
+
+    m_handedOff.notify_one();
+    m_thread.join();
+
+    HRESULT hr = m_hrWrite;
+    if (0 != fclose(m_pFile))
+    {
+        hr = E_FAIL;
+    }
+
+    m_pFile = nullptr;
+    return hr;
+}
+
+/// <summary>
+/// Snapshot of the writer counters; call it from the appending thread or after Close
+/// </summary>
+/// <param name="pStats">receives the counters</param>
+void SpeakerLogWriter::GetStats(SpeakerLogStats* pStats) const
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        *pStats = m_writerStats;
+    }
+
+    pStats->nAppended = m_nAppended;
+    pStats->nDropped = m_nDropped;
+}
+
+/// <summary>
+/// Whether the front buffer has held records for c_SpeakerLogHandOffMs
+/// </summary>
+/// <param name="nNowNs">GetPerfClockNs time</param>
+/// <returns>true if it is due to be handed off</returns>
+bool SpeakerLogWriter::IsFrontStale(INT64 nNowNs) const
+{
+    return m_nFrontCount > 0 && nNowNs - m_nFrontStartNs >= static_cast<INT64>(c_SpeakerLogHandOffMs) * 1000000;
+}
+
+/// <summary>
+/// Hands the front buffer to the writer thread, unless it still writes the back buffer
+/// </summary>
+/// <returns>true if the buffers were swapped</returns>
+bool SpeakerLogWriter::HandOff()
+{
+    if (m_bBackBusy.load(std::memory_order_acquire))
+    {
+        return false;
+    }
+
+    m_nBackCount = m_nFrontCount;
+    m_iFront ^= 1;
+    m_nFrontCount = 0;
+
+    // the writer thread only holds the mutex between its waits, never while writing
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_bBackBusy.store(true, std::memory_order_release);
+    }
+
+    m_handedOff.notify_one();
+    return true;
+}
+
+/// <summary>
+/// Writes out every buffer handed off until the writer is closed
+/// </summary>
+void SpeakerLogWriter::WriterThread()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    for (;;)
+    {
+        m_handedOff.wait(lock, [this]() { return m_bBackBusy.load() || m_bStopping; });
+        if (!m_bBackBusy.load())
+        {
+            break;
+        }
+
+        const SpeakerLogRecord* pRecords = &m_buffers[m_iFront ^ 1][0];
+        size_t nCount = m_nBackCount;
+        lock.unlock();
+
+        INT64 nStartNs = GetPerfClockNs();
+        size_t nWritten = fwrite(pRecords, sizeof(SpeakerLogRecord), nCount, m_pFile);
+        bool bFlushed = 0 == fflush(m_pFile);
+        INT64 nWriteNs = GetPerfClockNs() - nStartNs;
+
+        lock.lock();
+        m_writerStats.nWritten += nWritten;
+        m_writerStats.nWrites++;
+        m_writerStats.nBytesWritten += nWritten * sizeof(SpeakerLogRecord);
+        m_writerStats.nWriteNs += nWriteNs;
+        if (nWritten != nCount || !bFlushed)
+        {
+            m_hrWrite = E_FAIL;
+        }
+
+        m_bBackBusy.store(false, std::memory_order_release);
+        m_backFree.notify_all();
+    }
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+SpeakerLogReader::SpeakerLogReader() :
+    m_pFile(nullptr)
+{
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+SpeakerLogReader::~SpeakerLogReader()
+{
+    Close();
+}
+
+/// <summary>
+/// Opens a log and checks its header
+/// </summary>
+/// <param name="szPath">path of the log</param>
+/// <returns>indicates success or failure</returns>
+HRESULT SpeakerLogReader::Open(const char* szPath)
+{
+    Close();
+
+    m_pFile = OpenFile(szPath, "rb");
+    if (nullptr == m_pFile)
+    {
+        return E_FAIL;
+    }
+
+    SpeakerLogFileHeader header;
+    if (1 != fread(&header, sizeof(header), 1, m_pFile) ||
+        0 != memcmp(header.magic, c_SpeakerLogMagic, sizeof(header.magic)) ||
+        c_SpeakerLogVersion != header.nVersion ||
+        sizeof(SpeakerLogRecord) != header.cbRecord)
+    {
+        Close();
+        return E_FAIL;
+    }
+
+    return S_OK;
+}
+
+/// <summary>
+/// Reads the next record
+/// </summary>
+/// <param name="pRecord">receives the record</param>
+/// <returns>S_OK for a record, S_FALSE at the end of the log, a failure for a truncated record</returns>
+HRESULT SpeakerLogReader::Read(SpeakerLogRecord* pRecord)
+{
+    if (nullptr == m_pFile)
+    {
+        return E_UNEXPECTED;
+    }
+
+    size_t cbRead = fread(pRecord, 1, sizeof(*pRecord), m_pFile);
+    if (0 == cbRead && feof(m_pFile))
+    {
+        return S_FALSE;
+    }
+
+    return (sizeof(*pRecord) == cbRead) ? S_OK : E_FAIL;
+}
+
+/// <summary>
+/// Closes the log
+/// </summary>
+void SpeakerLogReader::Close()
+{
+    if (m_pFile)
+    {
+        fclose(m_pFile);
+        m_pFile = nullptr;
+    }
+}
+
+/// <summary>
+/// Converts a log to text, a CSV table or a JSON array of objects
+/// </summary>
+/// <param name="szPath">path of the log</param>
+/// <param name="bJson">whether to write JSON rather than CSV</param>
+/// <param name="pOutput">stream receiving the text</param>
+/// <param name="pnRecords">optional; receives the number of records converted</param>
+/// <returns>indicates success or failure</returns>
+HRESULT ConvertSpeakerLog(const char* szPath, bool bJson, FILE* pOutput, UINT64* pnRecords)
+{
+    SpeakerLogReader reader;
+    HRESULT hr = reader.Open(szPath);
+    UINT64 nRecords = 0;
+
+    if (SUCCEEDED(hr))
+    {
+        fprintf(pOutput, bJson ? "[" : "time,face,tracking_id,left,top,right,bottom,face_angle,beam_angle,beam_confidence,energy\n");
+
+        SpeakerLogRecord record;
+        while (S_OK == (hr = reader.Read(&record)))
+        {
+            if (bJson)
+            {
+                fprintf(pOutput, "%s\n  {\"time\": %lld, \"face\": %u, \"tracking_id\": %llu, \"face_box\": [%d, %d, %d, %d], "
+                    "\"face_angle\": %.3f, \"beam_angle\": %.3f, \"beam_confidence\": %.3f, \"energy\": %.4f}",
+                    (0 == nRecords) ? "" : ",", static_cast<long long>(record.nTime), record.nFace,
+                    static_cast<unsigned long long>(record.nTrackingId), record.faceBox.Left, record.faceBox.Top,
+                    record.faceBox.Right, record.faceBox.Bottom, record.fFaceAngle, record.fBeamAngle,
+                    record.fBeamAngleConfidence, record.fEnergy);
+            }
+            else
+            {
+                fprintf(pOutput, "%lld,%u,%llu,%d,%d,%d,%d,%.3f,%.3f,%.3f,%.4f\n", static_cast<long long>(record.nTime), record.nFace,
+                    static_cast<unsigned long long>(record.nTrackingId), record.faceBox.Left, record.faceBox.Top,
+                    record.faceBox.Right, record.faceBox.Bottom, record.fFaceAngle, record.fBeamAngle,
+                    record.fBeamAngleConfidence, record.fEnergy);
+            }
+
+            nRecords++;
+        }
+
+        if (bJson)
+        {
+            fprintf(pOutput, "\n]\n");
+        }
+    }
+
+    if (pnRecords)
+    {
+        *pnRecords = nRecords;
+    }
+
+    return FAILED(hr) ? hr : (ferror(pOutput) ? E_FAIL : S_OK);
+}
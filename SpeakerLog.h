@@ -0,0 +1,224 @@
+//------------------------------------------------------------------------------
+// <copyright file="SpeakerLog.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Append-only binary log of the speaker decisions: a SpeakerLogFileHeader followed by
+// one fixed size SpeakerLogRecord per face picked as the speaker in a frame. The writer
+// is fed from the frame path, so appending only copies the record into the front of two
+// buffers; a thread of the writer's own writes out the back buffer while the front one
+// fills, and the two swap whenever the front is full or has held records for a while;
+// the frame path checks the latter every frame, so that records reach the disk through
+// stretches without speakers too.
+// Should the back buffer still be on its way to the disk when the front one is full,
+// the record is dropped and counted rather than the frame path made to wait.
+
+#pragma once
+
+#include <stdio.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "KinectTypes.h"
+
+// Identifies a speaker log file
+static const char c_SpeakerLogMagic[4] = { 'A', 'F', 'S', 'L' };
+
+// Version of the speaker log format
+static const UINT32 c_SpeakerLogVersion = 1;
+
+// Records each of the two buffers holds
+static const size_t c_SpeakerLogBufferRecords = 4096;
+
+// Longest time records wait in the front buffer before it is handed to the writer
+// thread, in milliseconds, so that the log keeps up with the session on the disk
+static const int c_SpeakerLogHandOffMs = 250;
+
+struct SpeakerLogFileHeader
+{
+    char                magic[4];
+    UINT32              nVersion;
+
+    // Size of every record, in bytes
+    UINT32              cbRecord;
+    UINT32              nReserved;
+};
+
+/// <summary>
+/// A face picked as the speaker in a frame, with what it was picked on
+/// </summary>
+struct SpeakerLogRecord
+{
+    // RelativeTime of the color frame, in 100ns ticks
+    INT64               nTime;
+
+    // Tracking id of the face
+    UINT64              nTrackingId;
+
+    // Face bounding box in color space
+    RectI               faceBox;
+
+    // Angle, in degrees, the face was matched against the beam with: that of its head
+    // joint, or of its mouth center when the body has no joint
+    float               fFaceAngle;
+
+    // Beam angle, in degrees, and its confidence in the range [0,1]
+    float               fBeamAngle;
+    float               fBeamAngleConfidence;
+
+    // Energy of the newest beam audio as of the frame, in the range [0,1]
+    float               fEnergy;
+
+    // Index of the face, which is also that of its body
+    UINT32              nFace;
+    UINT32              nReserved;
+};
+
+static_assert(sizeof(SpeakerLogFileHeader) == 16, "SpeakerLogFileHeader layout is part of the file format");
+static_assert(sizeof(SpeakerLogRecord) == 56, "SpeakerLogRecord layout is part of the file format");
+
+struct SpeakerLogStats
+{
+    // Records appended, and records dropped since both buffers were full
+    UINT64              nAppended;
+    UINT64              nDropped;
+
+    // Records written out, in how many write calls, and the bytes written
+    UINT64              nWritten;
+    UINT64              nWrites;
+    UINT64              nBytesWritten;
+
+    // Time the writer thread spent in write calls, in nanoseconds
+    INT64               nWriteNs;
+};
+
+class SpeakerLogWriter
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    SpeakerLogWriter();
+
+    /// <summary>
+    /// Destructor
+    /// </summary>
+    ~SpeakerLogWriter();
+
+    /// <summary>
+    /// Creates a new log, overwriting any existing file, and starts the writer thread;
+    /// both buffers are allocated here
+    /// </summary>
+    /// <param name="szPath">path of the log</param>
+    /// <returns>indicates success or failure</returns>
+    HRESULT Open(const char* szPath);
+
+    /// <summary>
+    /// Appends a record without waiting for the disk; only one thread may append
+    /// </summary>
+    /// <param name="record">record to append</param>
+    /// <returns>false if the record was dropped since both buffers were full</returns>
+    bool Append(const SpeakerLogRecord& record);
+
+    /// <summary>
+    /// Hands the front buffer to the writer thread if it has held records for
+    /// c_SpeakerLogHandOffMs; call it from the appending thread every frame, appended
+    /// to or not
+    /// </summary>
+    void HandOffIfStale();
+
+    /// <summary>
+    /// Writes out every record appended, stops the writer thread and closes the file
+    /// </summary>
+    /// <returns>indicates success or failure of every write since Open</returns>
+    HRESULT Close();
+
+    /// <summary>
+    /// Whether a log is open
+    /// </summary>
+    bool IsOpen() const { return nullptr != m_pFile; }
+
+    /// <summary>
+    /// Snapshot of the writer counters; call it from the appending thread or after Close
+    /// </summary>
+    /// <param name="pStats">receives the counters</param>
+    void GetStats(SpeakerLogStats* pStats) const;
+
+private:
+    bool IsFrontStale(INT64 nNowNs) const;
+    bool HandOff();
+    void WriterThread();
+
+    FILE*                       m_pFile;
+    std::thread                 m_thread;
+
+    // The front buffer is the appending thread's; the back buffer is the writer
+    // thread's from the hand-off until m_bBackBusy is cleared
+    std::vector<SpeakerLogRecord> m_buffers[2];
+    int                         m_iFront;
+    size_t                      m_nFrontCount;
+    INT64                       m_nFrontStartNs;
+    size_t                      m_nBackCount;
+    std::atomic<bool>           m_bBackBusy;
+
+    // Wakes the writer thread for a hand-off or to stop, and Close once the back buffer is free
+    mutable std::mutex          m_mutex;
+    std::condition_variable     m_handedOff;
+    std::condition_variable     m_backFree;
+    bool                        m_bStopping;
+
+    // Counters of the appending thread, and of the writer thread guarded by m_mutex
+    UINT64                      m_nAppended;
+    UINT64                      m_nDropped;
+    SpeakerLogStats             m_writerStats;
+    HRESULT                     m_hrWrite;
+};
+
+class SpeakerLogReader
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    SpeakerLogReader();
+
+    /// <summary>
+    /// Destructor
+    /// </summary>
+    ~SpeakerLogReader();
+
+    /// <summary>
+    /// Opens a log and checks its header
+    /// </summary>
+    /// <param name="szPath">path of the log</param>
+    /// <returns>indicates success or failure</returns>
+    HRESULT Open(const char* szPath);
+
+    /// <summary>
+    /// Reads the next record
+    /// </summary>
+    /// <param name="pRecord">receives the record</param>
+    /// <returns>S_OK for a record, S_FALSE at the end of the log, a failure for a truncated record</returns>
+    HRESULT Read(SpeakerLogRecord* pRecord);
+
+    /// <summary>
+    /// Closes the log
+    /// </summary>
+    void Close();
+
+private:
+    FILE*                       m_pFile;
+};
+
+/// <summary>
+/// Converts a log to text, a CSV table or a JSON array of objects
+/// </summary>
+/// <param name="szPath">path of the log</param>
+/// <param name="bJson">whether to write JSON rather than CSV</param>
+/// <param name="pOutput">stream receiving the text</param>
+/// <param name="pnRecords">optional; receives the number of records converted</param>
+/// <returns>indicates success or failure</returns>
+HRESULT ConvertSpeakerLog(const char* szPath, bool bJson, FILE* pOutput, UINT64* pnRecords);
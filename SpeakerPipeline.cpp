@@ -0,0 +1,788 @@
+//------------------------------------------------------------------------------
+// <copyright file="SpeakerPipeline.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "KinectTypes.h"
+#include <math.h>
+#include <string.h>
+#include "PerfClock.h"
+#include "ColorConversion.h"
+#include "SpeakerSelection.h"
+#include "SpeakerPipeline.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/// <summary>
+/// Constructor
+/// </summary>
+/// <param name="pAudioCapture">audio capture whose energy values the pipeline
+/// consumes, and that replayed audio is fed through</param>
+SpeakerPipeline::SpeakerPipeline(AudioCapture* pAudioCapture) :
+    m_pAudioCapture(pAudioCapture),
+    m_pSource(nullptr),
+    m_pWakeup(nullptr),
+    m_pFreeFrames(nullptr),
+    m_bStopping(false),
+    m_bFrameReadyPending(false),
+    m_nAudioCaptureNs(0),
+    m_fEnergy(0.0f),
+    m_bPreviewRequired(true),
+    m_nIdleFrames(0),
+    m_bEnded(false),
+    m_hrEnded(S_OK),
+    m_nFramesAcquired(0),
+    m_nFramesComposed(0),
+    m_nFramesVoiceGated(0),
+    m_nBodyAcquired(0),
+    m_nBodySkipped(0),
+    m_nFaceAcquired(0),
+    m_nFaceSkipped(0),
+    m_nColorAcquired(0),
+    m_nColorSkipped(0),
+    m_nFullConversions(0),
+    m_nRoiConversions(0),
+    m_nPreviewConversions(0)
+{
+    for (int i = 0; i < PipelineStage_Count; ++i)
+    {
+        m_pQueues[i] = nullptr;
+        m_nStageNs[i] = 0;
+    }
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+SpeakerPipeline::~SpeakerPipeline()
+{
+    Stop();
+
+    for (int i = 0; i < PipelineStage_Count; ++i)
+    {
+        delete m_pQueues[i];
+    }
+
+    delete m_pFreeFrames;
+
+    for (size_t i = 0; i < m_frames.size(); ++i)
+    {
+        delete m_frames[i]->pMosaic;
+        delete m_frames[i];
+    }
+}
+
+/// <summary>
+/// Starts the source and, when threaded, the stage threads
+/// </summary>
+/// <param name="pSource">source of the frames; must outlive the pipeline</param>
+/// <param name="pWakeup">wake-up the source signals; must outlive the pipeline</param>
+/// <param name="options">how the stages run</param>
+/// <returns>indicates success or failure</returns>
+HRESULT SpeakerPipeline::Start(IFrameSource* pSource, FrameWakeup* pWakeup, const SpeakerPipelineOptions& options)
+{
+    if (nullptr == pSource || nullptr == pWakeup || options.nQueueDepth < 1 || options.nIdlePreviewInterval < 1 ||
+        options.mosaicScaling < 0 || options.mosaicScaling >= ScaleMethod_Count || options.previewResolution < 0 ||
+        options.previewResolution >= PreviewResolution_Count || options.nColorWidth <= 0 || options.nColorHeight <= 0)
+    {
+        return E_INVALIDARG;
+    }
+
+    if (m_pSource)
+    {
+        return E_UNEXPECTED;
+    }
+
+    m_pSource = pSource;
+    m_pWakeup = pWakeup;
+    m_options = options;
+
+    // one frame in every queue, one in the hands of every stage thread and one held by
+    // the consumer; serial, a single frame is ever in flight
+    size_t nFrames = m_options.bThreaded ? PipelineStage_Count * (m_options.nQueueDepth + 1) + 1 : 1;
+    m_pFreeFrames = new BoundedQueue<PipelineFrame*>(nFrames, QueueFull_Block);
+
+    // a BGRA frame for every frame in flight, and its color copy when threaded; all
+    // the frame memory there will be is allocated here
+    size_t cbBuffer = static_cast<size_t>(m_options.nColorWidth) * m_options.nColorHeight * sizeof(UINT32);
+    HRESULT hr = m_bufferPool.Create(cbBuffer, static_cast<UINT32>(m_options.bThreaded ? 2 * nFrames : nFrames), m_options.bLargePages);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    for (size_t i = 0; i < nFrames; ++i)
+    {
+        PipelineFrame* pFrame = new PipelineFrame();
+        pFrame->pMosaic = m_options.pExporter ? nullptr : new MosaicCompositor(c_MosaicWidth, c_MosaicHeight, m_options.mosaicScaling);
+        m_frames.push_back(pFrame);
+        ReleaseFrame(pFrame);
+    }
+
+    if (m_options.bThreaded)
+    {
+        // the composed frames are announced by the compose thread, not by the source
+        QueueFullPolicy policy = m_options.bDropWhenBehind ? QueueFull_DropOldest : QueueFull_Block;
+        m_pQueues[PipelineStage_Acquire] = new BoundedQueue<PipelineFrame*>(m_options.nQueueDepth, policy);
+        m_pQueues[PipelineStage_Associate] = new BoundedQueue<PipelineFrame*>(m_options.nQueueDepth, QueueFull_Block);
+        m_pQueues[PipelineStage_Compose] = new BoundedQueue<PipelineFrame*>(m_options.nQueueDepth, policy);
+        m_pWakeup->SetCallback(nullptr, nullptr);
+    }
+    else
+    {
+        m_pWakeup->SetCallback(m_options.pfnFrameReady, m_options.pContext);
+    }
+
+    m_pSource->SetLatencyMonitor(m_options.pLatencyMonitor);
+    hr = m_pSource->Start(m_pWakeup);
+
+    if (SUCCEEDED(hr) && m_options.bThreaded)
+    {
+        m_threads[PipelineStage_Acquire] = std::thread(&SpeakerPipeline::AcquireThread, this);
+        m_threads[PipelineStage_Associate] = std::thread(&SpeakerPipeline::AssociateThread, this);
+        m_threads[PipelineStage_Compose] = std::thread(&SpeakerPipeline::ComposeThread, this);
+    }
+
+    return hr;
+}
+
+/// <summary>
+/// Stops the stage threads and the source; frames still held may be released afterwards
+/// </summary>
+void SpeakerPipeline::Stop()
+{
+    m_bStopping = true;
+
+    // closing the queues wakes every stage waiting on one
+    if (m_pFreeFrames)
+    {
+        m_pFreeFrames->Close();
+    }
+
+    for (int i = 0; i < PipelineStage_Count; ++i)
+    {
+        if (m_pQueues[i])
+        {
+            m_pQueues[i]->Close();
+        }
+
+        if (m_threads[i].joinable())
+        {
+            m_threads[i].join();
+        }
+    }
+
+    if (m_pSource)
+    {
+        m_pSource->Stop();
+    }
+}
+
+/// <summary>
+/// Takes the next composed frame. Serial, this runs every stage for the frame the
+/// source has pending, if any.
+/// </summary>
+/// <param name="nTimeoutMs">longest time to wait for a frame, in milliseconds</param>
+/// <returns>the frame, to be handed back with ReleaseFrame, or null if there is none</returns>
+PipelineFrame* SpeakerPipeline::TakeComposedFrame(int nTimeoutMs)
+{
+    PipelineFrame* pFrame = nullptr;
+
+    if (nullptr == m_pSource)
+    {
+        return nullptr;
+    }
+
+    if (m_options.bThreaded)
+    {
+        BoundedQueue<PipelineFrame*>* pQueue = m_pQueues[PipelineStage_Compose];
+
+        // frames composed from here on are announced again; those already waiting are
+        // announced below, so that none is left behind without a notification
+        m_bFrameReadyPending = false;
+
+        if (!pQueue->Pop(&pFrame, nTimeoutMs))
+        {
+            return nullptr;
+        }
+
+        if (pQueue->GetCount() > 0)
+        {
+            NotifyFrameReady(false);
+        }
+
+        return pFrame;
+    }
+
+    if (m_bEnded || !m_pWakeup->Wait(nTimeoutMs) || !m_pFreeFrames->Pop(&pFrame, 0))
+    {
+        return nullptr;
+    }
+
+    HRESULT hr = AcquireStage(pFrame);
+    if (S_OK != hr)
+    {
+        ReleaseFrame(pFrame);
+        if (E_PENDING != hr)
+        {
+            m_hrEnded = hr;
+            m_bEnded = true;
+        }
+
+        return nullptr;
+    }
+
+    AssociateStage(pFrame);
+    ComposeStage(pFrame);
+    m_nFramesComposed++;
+
+    return pFrame;
+}
+
+/// <summary>
+/// Hands a frame taken with TakeComposedFrame back for reuse
+/// </summary>
+/// <param name="pFrame">frame to release</param>
+void SpeakerPipeline::ReleaseFrame(PipelineFrame* pFrame)
+{
+    bool bEvicted = false;
+    PipelineFrame* pEvicted = nullptr;
+
+    // the buffers go back to the pool unless someone else still holds them
+    pFrame->colorBuffer.Reset();
+    pFrame->bgraBuffer.Reset();
+    pFrame->pBgra = nullptr;
+
+    // the pool holds every frame, so it is never full; once closed the frame just stays idle
+    m_pFreeFrames->Push(pFrame, &pEvicted, &bEvicted);
+}
+
+/// <summary>
+/// Whether the source has ended and every composed frame was taken
+/// </summary>
+bool SpeakerPipeline::IsFinished() const
+{
+    if (m_options.bThreaded && m_pQueues[PipelineStage_Compose])
+    {
+        return m_pQueues[PipelineStage_Compose]->IsDrained();
+    }
+
+    return m_bEnded;
+}
+
+/// <summary>
+/// Snapshot of the pipeline counters
+/// </summary>
+/// <param name="pStats">receives the counters</param>
+void SpeakerPipeline::GetStats(SpeakerPipelineStats* pStats) const
+{
+    memset(pStats, 0, sizeof(*pStats));
+    pStats->nFramesAcquired = m_nFramesAcquired;
+    pStats->nFramesComposed = m_nFramesComposed;
+    pStats->nFramesVoiceGated = m_nFramesVoiceGated;
+    pStats->nBodyAcquired = m_nBodyAcquired;
+    pStats->nBodySkipped = m_nBodySkipped;
+    pStats->nFaceAcquired = m_nFaceAcquired;
+    pStats->nFaceSkipped = m_nFaceSkipped;
+    pStats->nColorAcquired = m_nColorAcquired;
+    pStats->nColorSkipped = m_nColorSkipped;
+    pStats->nFullConversions = m_nFullConversions;
+    pStats->nRoiConversions = m_nRoiConversions;
+    pStats->nPreviewConversions = m_nPreviewConversions;
+
+    for (int i = 0; i < PipelineStage_Count; ++i)
+    {
+        if (m_pQueues[i])
+        {
+            m_pQueues[i]->GetStats(&pStats->queues[i]);
+        }
+
+        pStats->nStageNs[i] = m_nStageNs[i];
+    }
+
+    m_bufferPool.GetStats(&pStats->pool);
+}
+
+/// <summary>
+/// Takes the pending frame of the source along with its audio, and the energy values
+/// and beam state the audio up to the frame yielded, then completes the frame with the
+/// streams the beam state calls for
+/// </summary>
+/// <param name="pFrame">receives the frame</param>
+/// <returns>S_OK for a new frame, E_PENDING if there is none, S_FALSE once the source has
+/// ended, else the failure code</returns>
+HRESULT SpeakerPipeline::AcquireStage(PipelineFrame* pFrame)
+{
+    INT64 nStartNs = GetPerfClockNs();
+
+    // whatever was signalled up to here is covered by this frame
+    pFrame->nTriggerNs = 0;
+    m_pWakeup->TakePending(&pFrame->nTriggerNs);
+
+    HRESULT hr = m_pSource->AcquireFrame(&pFrame->frame, &pFrame->audio);
+    if (S_OK != hr)
+    {
+        return hr;
+    }
+
+    for (size_t i = 0; i < pFrame->audio.size(); ++i)
+    {
+        const AudioChunk& chunk = pFrame->audio[i];
+        if (!chunk.samples.empty())
+        {
+            m_pAudioCapture->ProcessChunk(chunk.nTime, &chunk.samples[0], static_cast<UINT>(chunk.samples.size()), chunk.fBeamAngle, chunk.fBeamAngleConfidence);
+        }
+    }
+
+    // the source reuses its color buffer for the next frame, which is acquired while
+    // this one is still on its way through the other stages
+    if (m_options.bThreaded && !m_bufferPool.Acquire(&pFrame->colorBuffer))
+    {
+        // every buffer is held by the consumer; the pool counts the dropped frame,
+        // whose energy values are left to the next one
+        return E_PENDING;
+    }
+
+    // the energy values are taken here rather than by a later stage so that a frame is
+    // matched against the beam as of its own audio, not that of the frames acquired since
+    EnergySample samples[64];
+    size_t nCount;
+    EnergyRing* pEnergyRing = m_pAudioCapture->GetEnergyRing();
+
+    pFrame->energies.clear();
+    while ((nCount = pEnergyRing->PopMany(samples, _countof(samples))) > 0)
+    {
+        for (size_t i = 0; i < nCount; ++i)
+        {
+            pFrame->energies.push_back(samples[i].fEnergy);
+        }
+
+        m_beamHistory.Add(samples, nCount);
+        m_nAudioCaptureNs = samples[nCount - 1].nCaptureNs;
+        m_fEnergy = samples[nCount - 1].fEnergy;
+    }
+
+    // the beam as it was when the frame was taken; a frame newer than all the audio
+    // read so far gets the latest beam state. Sources stamp their audio on the clock of
+    // their frames, the sensor's through its SensorClock.
+    BeamState beam;
+    m_beamHistory.GetAt(pFrame->frame.nTime, &beam);
+    pFrame->fBeamAngle = beam.fBeamAngle;
+    pFrame->fBeamAngleConfidence = beam.fBeamAngleConfidence;
+    pFrame->bVoiceActive = beam.bVoiceActive;
+    pFrame->nAudioCaptureNs = m_nAudioCaptureNs;
+    pFrame->fEnergy = m_fEnergy;
+
+    pFrame->nStreams = GetFrameDemand(beam);
+    m_pSource->CompleteFrame(&pFrame->frame, pFrame->nStreams);
+
+    // sources that fill in every stream on acquisition still have the frame skip the work
+    // that follows from the streams left out
+    if (!(pFrame->nStreams & FrameStream_Color))
+    {
+        pFrame->frame.pColorBuffer = nullptr;
+        pFrame->frame.cbColorBuffer = 0;
+    }
+
+    if (pFrame->nStreams & FrameStream_Body)
+    {
+        m_nBodyAcquired++;
+    }
+    else
+    {
+        m_nBodySkipped++;
+    }
+
+    if (pFrame->nStreams & FrameStream_Face)
+    {
+        m_nFaceAcquired++;
+    }
+    else
+    {
+        m_nFaceSkipped++;
+    }
+
+    if (pFrame->nStreams & FrameStream_Color)
+    {
+        m_nColorAcquired++;
+    }
+    else
+    {
+        m_nColorSkipped++;
+    }
+
+    if (m_options.pRecorder)
+    {
+        m_options.pRecorder->WriteFrame(&pFrame->frame);
+    }
+
+    if (m_options.bThreaded && pFrame->frame.pColorBuffer)
+    {
+        if (pFrame->frame.cbColorBuffer > m_bufferPool.GetBufferSize())
+        {
+            // larger than the pipeline was started for; the color is unusable
+            pFrame->frame.pColorBuffer = nullptr;
+            pFrame->frame.cbColorBuffer = 0;
+        }
+        else
+        {
+            memcpy(pFrame->colorBuffer.GetData(), pFrame->frame.pColorBuffer, pFrame->frame.cbColorBuffer);
+            pFrame->frame.pColorBuffer = pFrame->colorBuffer.GetData();
+        }
+    }
+
+    if (nullptr == pFrame->frame.pColorBuffer)
+    {
+        pFrame->colorBuffer.Reset();
+    }
+
+    m_nFramesAcquired++;
+    pFrame->nStageEndNs[PipelineStage_Acquire] = GetPerfClockNs();
+    pFrame->nStageNs[PipelineStage_Acquire] = pFrame->nStageEndNs[PipelineStage_Acquire] - nStartNs;
+    m_nStageNs[PipelineStage_Acquire] += pFrame->nStageNs[PipelineStage_Acquire];
+
+    return S_OK;
+}
+
+/// <summary>
+/// Streams a frame is to be completed with: everything while a speaker could be picked
+/// or the frame is recorded, else the bodies, and the color of every few idle frames
+/// while they are shown, or of every frame when exporting. The bodies of idle frames
+/// keep the face sources bound to the people in view, so that face tracking is under
+/// way by the time one of them speaks.
+/// </summary>
+/// <param name="beam">beam state at the time of the frame</param>
+/// <returns>combination of FrameStream_Color, FrameStream_Body and FrameStream_Face</returns>
+UINT32 SpeakerPipeline::GetFrameDemand(const BeamState& beam)
+{
+    const UINT32 nAllStreams = FrameStream_Color | FrameStream_Body | FrameStream_Face;
+
+    // gated frames are counted here, whether or not their faces are acquired, so that the
+    // count means the same with eager acquisition and in replay
+    bool bVoiceGated = IsVoiceGated(beam.fBeamAngleConfidence, beam.bVoiceActive, m_options.bVoiceGate);
+    if (bVoiceGated)
+    {
+        m_nFramesVoiceGated++;
+    }
+
+    bool bSpeakerPossible = beam.fBeamAngleConfidence >= c_MinBeamAngleConfidence && !bVoiceGated;
+
+    if (bSpeakerPossible || m_options.bEagerAcquisition || m_options.pRecorder)
+    {
+        m_nIdleFrames = 0;
+        return nAllStreams;
+    }
+
+    // the export stream and the full frame comparison take the color of every frame; the
+    // window shows the first frame of an idle stretch and every few after it
+    bool bShown = m_options.pExporter || m_options.bFullFrameTransfer ||
+        (m_bPreviewRequired && 0 == m_nIdleFrames % static_cast<UINT64>(m_options.nIdlePreviewInterval));
+    m_nIdleFrames++;
+
+    return FrameStream_Body | (bShown ? static_cast<UINT32>(FrameStream_Color) : 0);
+}
+
+/// <summary>
+/// Decides on the speakers of a frame and converts the color of their regions to BGRA
+/// </summary>
+/// <param name="pFrame">frame to process</param>
+void SpeakerPipeline::AssociateStage(PipelineFrame* pFrame)
+{
+    INT64 nStartNs = GetPerfClockNs();
+    const SessionFrame* pSession = &pFrame->frame;
+
+    FaceFrameBatch faces;
+    LoadFaceFrameBatch(pSession, &faces);
+
+    pFrame->nSpeakers = SelectSpeakersBatch(&faces, pFrame->fBeamAngle, pFrame->fBeamAngleConfidence, pFrame->bIsSpeaker, m_options.angleMapping);
+    if (pFrame->nSpeakers > 0 && m_options.bVoiceGate && !pFrame->bVoiceActive)
+    {
+        // the beam followed something other than a voice
+        memset(pFrame->bIsSpeaker, 0, sizeof(pFrame->bIsSpeaker));
+        pFrame->nSpeakers = 0;
+    }
+
+    if (m_options.pSpeakerLog)
+    {
+        if (pFrame->nSpeakers > 0)
+        {
+            LogSpeakers(pFrame, &faces);
+        }
+
+        // the last records before a silence are written out in time all the same
+        m_options.pSpeakerLog->HandOffIfStale();
+    }
+    pFrame->pBgra = nullptr;
+    pFrame->nBgraWidth = 0;
+    pFrame->nBgraHeight = 0;
+    RecordLatency(LatencyMetric_SpeakerMatch, nStartNs);
+
+    // the exporter converts what it composes on its own
+    bool bColorValid = pSession->pColorBuffer && pSession->nColorWidth > 0 && pSession->nColorHeight > 0 &&
+        pSession->cbColorBuffer >= static_cast<UINT>(pSession->nColorStride) * pSession->nColorHeight;
+
+    if (!m_options.pExporter && bColorValid)
+    {
+        // only the speaker regions need to be converted when speakers are found
+        pFrame->bRoiTransfer = pFrame->nSpeakers > 0 && !m_options.bFullFrameTransfer &&
+            GetSpeakerTransferRect(pSession, pFrame->bIsSpeaker, c_RoiTransferMargin, &pFrame->transferRect);
+
+        if (!pFrame->bRoiTransfer)
+        {
+            pFrame->transferRect.Left = 0;
+            pFrame->transferRect.Top = 0;
+            pFrame->transferRect.Right = pSession->nColorWidth;
+            pFrame->transferRect.Bottom = pSession->nColorHeight;
+        }
+
+        size_t cbBgra = static_cast<size_t>(pSession->nColorWidth) * pSession->nColorHeight * sizeof(UINT32);
+        bool bBgra = pSession->colorFormat == ColorImageFormat_Bgra;
+
+        // a frame without speakers is only shown as the background, which the preview
+        // resolution may make a quarter of the pixels; frame sizes without a half
+        // resolution are shown at the full one
+        FrameGeometry geometry;
+        bool bPreview = 0 == pFrame->nSpeakers && PreviewResolution_Full != m_options.previewResolution &&
+            (bBgra || pSession->colorFormat == ColorImageFormat_Yuy2) &&
+            SUCCEEDED(GetFrameGeometry(pSession->nColorWidth, pSession->nColorHeight, m_options.previewResolution, &geometry)) &&
+            cbBgra <= m_bufferPool.GetBufferSize() && m_bufferPool.Acquire(&pFrame->bgraBuffer);
+
+        pFrame->nBgraWidth = bPreview ? geometry.nPreviewWidth : pSession->nColorWidth;
+        pFrame->nBgraHeight = bPreview ? geometry.nPreviewHeight : pSession->nColorHeight;
+
+        if (bPreview)
+        {
+            INT64 nConvertStartNs = GetPerfClockNs();
+            if (bBgra)
+            {
+                ShrinkBgraHalf(GetBestColorKernel(), pSession->pColorBuffer, pSession->nColorStride, pSession->nColorWidth, pSession->nColorHeight,
+                    pFrame->bgraBuffer.GetData(), pFrame->nBgraWidth * sizeof(UINT32));
+            }
+            else
+            {
+                ConvertYuy2ToBgraHalf(GetBestColorKernel(), pSession->pColorBuffer, pSession->nColorStride, pSession->nColorWidth, pSession->nColorHeight,
+                    pFrame->bgraBuffer.GetData(), pFrame->nBgraWidth * sizeof(UINT32));
+            }
+            RecordLatency(LatencyMetric_Conversion, nConvertStartNs);
+
+            m_nPreviewConversions++;
+            pFrame->pBgra = pFrame->bgraBuffer.GetData();
+        }
+        else if (bBgra)
+        {
+            pFrame->bgraBuffer = pFrame->colorBuffer;
+            pFrame->pBgra = pSession->pColorBuffer;
+        }
+        else if (pSession->colorFormat == ColorImageFormat_Yuy2 && cbBgra <= m_bufferPool.GetBufferSize() &&
+            m_bufferPool.Acquire(&pFrame->bgraBuffer))
+        {
+            INT64 nConvertStartNs = GetPerfClockNs();
+            AlignRectToYuy2(&pFrame->transferRect, pSession->nColorWidth);
+            ConvertYuy2ToBgra(GetBestColorKernel(), pSession->pColorBuffer, pSession->nColorStride,
+                pFrame->bgraBuffer.GetData(), pSession->nColorWidth * sizeof(UINT32), &pFrame->transferRect);
+            RecordLatency(LatencyMetric_Conversion, nConvertStartNs);
+
+            if (pFrame->bRoiTransfer)
+            {
+                m_nRoiConversions++;
+            }
+            else
+            {
+                m_nFullConversions++;
+            }
+
+            pFrame->pBgra = pFrame->bgraBuffer.GetData();
+        }
+    }
+
+    pFrame->nStageEndNs[PipelineStage_Associate] = GetPerfClockNs();
+    pFrame->nStageNs[PipelineStage_Associate] = pFrame->nStageEndNs[PipelineStage_Associate] - nStartNs;
+    m_nStageNs[PipelineStage_Associate] += pFrame->nStageNs[PipelineStage_Associate];
+}
+
+/// <summary>
+/// Appends every face picked as the speaker in a frame to the speaker log
+/// </summary>
+/// <param name="pFrame">frame the speakers were picked in</param>
+/// <param name="pFaces">faces of the frame</param>
+void SpeakerPipeline::LogSpeakers(const PipelineFrame* pFrame, const FaceFrameBatch* pFaces)
+{
+    const SessionFrame* pSession = &pFrame->frame;
+
+    float fFaceAngles[BODY_COUNT];
+    // the angles the speakers were picked by
+    GetFaceAngleBatch(pFaces, m_options.angleMapping, fFaceAngles);
+
+    SpeakerLogRecord record;
+    memset(&record, 0, sizeof(record));
+    record.nTime = pSession->nTime;
+    record.fBeamAngle = 180.0f * pFrame->fBeamAngle / static_cast<float>(M_PI);
+    record.fBeamAngleConfidence = pFrame->fBeamAngleConfidence;
+    record.fEnergy = pFrame->fEnergy;
+
+    for (int i = 0; i < BODY_COUNT; ++i)
+    {
+        if (pFrame->bIsSpeaker[i])
+        {
+            record.nTrackingId = pFaces->nTrackingIds[i];
+            GetBatchFaceBox(pFaces, i, &record.faceBox);
+            record.fFaceAngle = fFaceAngles[i];
+            record.nFace = i;
+
+            // a full log drops the record rather than hold up the frame
+            m_options.pSpeakerLog->Append(record);
+        }
+    }
+}
+
+/// <summary>
+/// Composes the speaker mosaic of a frame, or writes its speaker regions to the export stream
+/// </summary>
+/// <param name="pFrame">frame to process</param>
+void SpeakerPipeline::ComposeStage(PipelineFrame* pFrame)
+{
+    INT64 nStartNs = GetPerfClockNs();
+    const SessionFrame* pSession = &pFrame->frame;
+
+    pFrame->layout.nTiles = 0;
+    pFrame->hrExport = S_FALSE;
+
+    if (m_options.pExporter)
+    {
+        pFrame->hrExport = m_options.pExporter->WriteFrame(pSession, pFrame->bIsSpeaker);
+    }
+    else if (pFrame->pBgra && pFrame->nBgraWidth == pSession->nColorWidth && pFrame->pMosaic &&
+        LayoutSpeakerMosaic(pSession, pFrame->bIsSpeaker, pFrame->pMosaic->GetWidth(), pFrame->pMosaic->GetHeight(), &pFrame->layout) > 0)
+    {
+        pFrame->pMosaic->Compose(&pFrame->layout, pFrame->pBgra, pSession->nColorWidth, pSession->nColorHeight, pSession->nColorWidth * sizeof(UINT32));
+    }
+
+    RecordLatency(LatencyMetric_Compose, nStartNs);
+
+    pFrame->nStageEndNs[PipelineStage_Compose] = GetPerfClockNs();
+    pFrame->nStageNs[PipelineStage_Compose] = pFrame->nStageEndNs[PipelineStage_Compose] - nStartNs;
+    m_nStageNs[PipelineStage_Compose] += pFrame->nStageNs[PipelineStage_Compose];
+}
+
+/// <summary>
+/// Acquires a frame whenever the source signals one, as long as there is a free frame
+/// to acquire it into; otherwise the source keeps or drops its frames as it sees fit
+/// </summary>
+void SpeakerPipeline::AcquireThread()
+{
+    while (!m_bStopping)
+    {
+        PipelineFrame* pFrame = nullptr;
+
+        if (!m_pWakeup->Wait(cAcquireWaitTimeout) || !m_pFreeFrames->Pop(&pFrame, cAcquireWaitTimeout))
+        {
+            continue;
+        }
+
+        HRESULT hr = AcquireStage(pFrame);
+        if (S_OK == hr)
+        {
+            ForwardFrame(m_pQueues[PipelineStage_Acquire], pFrame);
+            continue;
+        }
+
+        ReleaseFrame(pFrame);
+        if (E_PENDING != hr)
+        {
+            m_hrEnded = hr;
+            m_bEnded = true;
+            break;
+        }
+    }
+
+    // the later stages drain what was acquired, then close their own queues in turn
+    m_pQueues[PipelineStage_Acquire]->Close();
+}
+
+/// <summary>
+/// Runs the associate stage on every acquired frame
+/// </summary>
+void SpeakerPipeline::AssociateThread()
+{
+    PipelineFrame* pFrame = nullptr;
+
+    while (m_pQueues[PipelineStage_Acquire]->Pop(&pFrame, -1))
+    {
+        AssociateStage(pFrame);
+        ForwardFrame(m_pQueues[PipelineStage_Associate], pFrame);
+    }
+
+    m_pQueues[PipelineStage_Associate]->Close();
+}
+
+/// <summary>
+/// Runs the compose stage on every associated frame and announces it to the consumer
+/// </summary>
+void SpeakerPipeline::ComposeThread()
+{
+    PipelineFrame* pFrame = nullptr;
+
+    while (m_pQueues[PipelineStage_Associate]->Pop(&pFrame, -1))
+    {
+        ComposeStage(pFrame);
+        m_nFramesComposed++;
+        ForwardFrame(m_pQueues[PipelineStage_Compose], pFrame);
+        NotifyFrameReady(false);
+    }
+
+    // the consumer finds out that the pipeline finished on its next take
+    m_pQueues[PipelineStage_Compose]->Close();
+    NotifyFrameReady(true);
+}
+
+/// <summary>
+/// Hands a frame to the next stage; a frame evicted to make room, or refused by a
+/// closed queue, goes back to the pool
+/// </summary>
+/// <param name="pQueue">queue of the next stage</param>
+/// <param name="pFrame">frame to hand over</param>
+void SpeakerPipeline::ForwardFrame(BoundedQueue<PipelineFrame*>* pQueue, PipelineFrame* pFrame)
+{
+    bool bEvicted = false;
+    PipelineFrame* pEvicted = nullptr;
+
+    if (!pQueue->Push(pFrame, &pEvicted, &bEvicted))
+    {
+        ReleaseFrame(pFrame);
+    }
+
+    if (bEvicted)
+    {
+        ReleaseFrame(pEvicted);
+    }
+}
+
+/// <summary>
+/// Runs the frame ready callback unless a notification is already out
+/// </summary>
+/// <param name="bForce">whether to notify even then</param>
+void SpeakerPipeline::NotifyFrameReady(bool bForce)
+{
+    bool bWasPending = m_bFrameReadyPending.exchange(true);
+
+    if (m_options.pfnFrameReady && (bForce || !bWasPending))
+    {
+        m_options.pfnFrameReady(m_options.pContext);
+    }
+}
+
+/// <summary>
+/// Records the time since a start into the latency monitor, if there is one
+/// </summary>
+/// <param name="metric">what was timed</param>
+/// <param name="nStartNs">GetPerfClockNs time it started</param>
+void SpeakerPipeline::RecordLatency(LatencyMetric metric, INT64 nStartNs)
+{
+    if (m_options.pLatencyMonitor)
+    {
+        m_options.pLatencyMonitor->Record(metric, GetPerfClockNs() - nStartNs);
+    }
+}
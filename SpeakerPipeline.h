@@ -0,0 +1,360 @@
+//------------------------------------------------------------------------------
+// <copyright file="SpeakerPipeline.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Processes the frames of a frame source in stages: acquire (frame, audio and beam
+// state), associate (speaker selection and color conversion of the speaker regions)
+// and compose (the speaker mosaic, or the export stream). Threaded, every stage runs
+// on its own thread and hands its frames to the next one through a bounded queue, so
+// that frame N+1 is acquired while frame N is composed and frame N-1 is presented by
+// the consumer. Serial, the consumer runs the stages one after the other itself. The
+// color and BGRA of the frames in flight live in a pool of buffers allocated on start.
+//
+// Acquisition follows demand: once the acquire stage knows the beam state of a frame it
+// completes the frame with only the streams something is going to use. Bodies and face
+// results are only read while a speaker could be picked, and the color of an idle frame,
+// one nobody can be picked in, only for every few frames shown while the room is idle.
+// Frames without speakers are only shown as the background, which can be converted at
+// half their width and height; speaker regions are always converted from the full frame.
+
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "KinectTypes.h"
+#include "BoundedQueue.h"
+#include "FrameBufferPool.h"
+#include "FrameSource.h"
+#include "FaceFrameBatch.h"
+#include "FrameGeometry.h"
+#include "AudioCapture.h"
+#include "BeamHistory.h"
+#include "MosaicCompositor.h"
+#include "RoiExport.h"
+#include "SessionRecording.h"
+#include "SpeakerLog.h"
+#include "SpeakerSelection.h"
+
+// Stages of the pipeline, in the order a frame passes through them
+enum PipelineStage
+{
+    PipelineStage_Acquire   = 0,
+    PipelineStage_Associate = 1,
+    PipelineStage_Compose   = 2,
+    PipelineStage_Count     = 3
+};
+
+/// <summary>
+/// A frame on its way through the pipeline, together with everything the stages
+/// derived from it. Frames are allocated once by the pipeline and recycled.
+/// </summary>
+struct PipelineFrame
+{
+    // GetPerfClockNs time of the wake-up the frame was acquired on, 0 if unknown
+    INT64               nTriggerNs;
+
+    // GetPerfClockNs time each stage was done with the frame, and the time it spent on it
+    INT64               nStageEndNs[PipelineStage_Count];
+    INT64               nStageNs[PipelineStage_Count];
+
+    // Frame as acquired; the color points into colorBuffer when the stages are threaded,
+    // else into the source, valid until the frame is released
+    SessionFrame        frame;
+    FrameBufferHandle   colorBuffer;
+
+    // FrameStream values of the data the frame was completed with; without
+    // FrameStream_Color the frame has no color and is not to be shown
+    UINT32              nStreams;
+
+    // Audio that came with the frame, the energy values it yielded, the newest energy
+    // value as of the frame, and the beam and voice state at the time of the frame
+    std::vector<AudioChunk> audio;
+    std::vector<float>  energies;
+    float               fEnergy;
+    float               fBeamAngle;
+    float               fBeamAngleConfidence;
+    bool                bVoiceActive;
+
+    // GetPerfClockNs time the audio behind the beam state was handed to the meter, 0 if unknown
+    INT64               nAudioCaptureNs;
+
+    // Speaker decisions for each of the BODY_COUNT faces
+    bool                bIsSpeaker[BODY_COUNT];
+    int                 nSpeakers;
+
+    // Part of the color converted to BGRA: only the speaker regions when bRoiTransfer,
+    // else the whole frame. pBgra is null for unusable color, or when exporting; it
+    // points into bgraBuffer, which shares colorBuffer when the color is BGRA already.
+    bool                bRoiTransfer;
+    RectI               transferRect;
+    const BYTE*         pBgra;
+    FrameBufferHandle   bgraBuffer;
+
+    // Size (in pixels) of the BGRA image, whose rows are nBgraWidth pixels apart: that of
+    // the color, or that of the preview when the frame was converted only to be shown
+    int                 nBgraWidth;
+    int                 nBgraHeight;
+
+    // Mosaic of the speakers; layout.nTiles is 0 when nobody speaks
+    MosaicLayout        layout;
+    MosaicCompositor*   pMosaic;
+
+    // Result of writing the frame to the export stream, S_FALSE when not exporting
+    HRESULT             hrExport;
+};
+
+struct SpeakerPipelineOptions
+{
+    // Whether every stage runs on its own thread; otherwise the consumer runs them
+    bool                bThreaded;
+
+    // Frames each queue between two stages holds
+    int                 nQueueDepth;
+
+    // Whether a stage that falls behind drops the oldest waiting frame; otherwise the
+    // stages ahead of it wait, down to the source
+    bool                bDropWhenBehind;
+
+    // Whether the whole color frame is converted even when only speakers are shown
+    bool                bFullFrameTransfer;
+
+    // Whether speakers are only picked while voice is active in the beam audio, so that
+    // noise steering the beam does not
+    bool                bVoiceGate;
+
+    // How the angle of each face, compared with the beam angle, is obtained; the speaker
+    // log records the angle of every speaker as this mapping gives it
+    SpeakerAngleMapping angleMapping;
+
+    // Whether every frame is completed with every stream and has its color converted,
+    // whether anything uses them or not, as before acquisition followed demand
+    bool                bEagerAcquisition;
+
+    // Idle frames per idle frame that gets its color, so is shown; 1 shows every one
+    int                 nIdlePreviewInterval;
+
+    // How the speaker regions are resampled to the mosaic
+    ScaleMethod         mosaicScaling;
+
+    // Resolution the color of frames without speakers is converted at, for the background
+    PreviewResolution   previewResolution;
+
+    // Largest color frame the source delivers, that of the sensor by default; sizes
+    // the frame buffer pool
+    int                 nColorWidth;
+    int                 nColorHeight;
+
+    // Whether the frame buffer pool is backed by large pages, when the system grants them
+    bool                bLargePages;
+
+    // Called whenever a composed frame is ready to be taken, on the thread that made it ready
+    FrameWakeupCallback pfnFrameReady;
+    void*               pContext;
+
+    // Optional; every acquired frame is written to it
+    SessionWriter*      pRecorder;
+
+    // Optional; the compose stage writes the speaker regions to it instead of composing the mosaic
+    RoiExporter*        pExporter;
+
+    // Optional; the source and the stages record their latencies into it
+    LatencyMonitor*     pLatencyMonitor;
+
+    // Optional; the associate stage appends every face it picks as the speaker to it,
+    // and has it hand off records held too long every frame
+    SpeakerLogWriter*   pSpeakerLog;
+
+    SpeakerPipelineOptions() :
+        bThreaded(true),
+        nQueueDepth(1),
+        bDropWhenBehind(true),
+        bFullFrameTransfer(false),
+        bVoiceGate(true),
+        angleMapping(SpeakerAngleMapping_Geometric),
+        bEagerAcquisition(false),
+        nIdlePreviewInterval(3),
+        mosaicScaling(ScaleMethod_Auto),
+        previewResolution(PreviewResolution_Full),
+        nColorWidth(c_SensorColorWidth),
+        nColorHeight(c_SensorColorHeight),
+        bLargePages(false),
+        pfnFrameReady(nullptr),
+        pContext(nullptr),
+        pRecorder(nullptr),
+        pExporter(nullptr),
+        pLatencyMonitor(nullptr),
+        pSpeakerLog(nullptr)
+    {
+    }
+};
+
+struct SpeakerPipelineStats
+{
+    // Frames acquired from the source and frames that made it through every stage
+    UINT64              nFramesAcquired;
+    UINT64              nFramesComposed;
+
+    // Frames the beam was confident in while no voice was active, which the voice gate
+    // kept speakers from being picked in; see IsVoiceGated
+    UINT64              nFramesVoiceGated;
+
+    // Frames the acquire stage completed with the body data, the face results and the
+    // color, and frames it left each of them out of since nothing was going to use it
+    UINT64              nBodyAcquired;
+    UINT64              nBodySkipped;
+    UINT64              nFaceAcquired;
+    UINT64              nFaceSkipped;
+    UINT64              nColorAcquired;
+    UINT64              nColorSkipped;
+
+    // Frames the associate stage converted the whole color of, only the speaker regions
+    // of, and the whole color at half resolution of; frames without color or in BGRA
+    // already are not converted, unless shrunk to a half resolution preview
+    UINT64              nFullConversions;
+    UINT64              nRoiConversions;
+    UINT64              nPreviewConversions;
+
+    // Queue behind each stage; frames dropped there are counted by the queue
+    BoundedQueueStats   queues[PipelineStage_Count];
+
+    // Time spent working by each stage, in nanoseconds
+    INT64               nStageNs[PipelineStage_Count];
+
+    // Buffers the color and BGRA of the frames are held in; frames that found the pool
+    // exhausted are dropped by the acquire stage and counted there
+    FrameBufferPoolStats pool;
+};
+
+class SpeakerPipeline
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    /// <param name="pAudioCapture">audio capture whose energy values the pipeline
+    /// consumes, and that replayed audio is fed through</param>
+    explicit SpeakerPipeline(AudioCapture* pAudioCapture);
+
+    /// <summary>
+    /// Destructor
+    /// </summary>
+    ~SpeakerPipeline();
+
+    /// <summary>
+    /// Starts the source and, when threaded, the stage threads
+    /// </summary>
+    /// <param name="pSource">source of the frames; must outlive the pipeline</param>
+    /// <param name="pWakeup">wake-up the source signals; must outlive the pipeline</param>
+    /// <param name="options">how the stages run</param>
+    /// <returns>indicates success or failure</returns>
+    HRESULT Start(IFrameSource* pSource, FrameWakeup* pWakeup, const SpeakerPipelineOptions& options);
+
+    /// <summary>
+    /// Stops the stage threads and the source; frames still held may be released afterwards
+    /// </summary>
+    void Stop();
+
+    /// <summary>
+    /// Takes the next composed frame. Serial, this runs every stage for the frame the
+    /// source has pending, if any.
+    /// </summary>
+    /// <param name="nTimeoutMs">longest time to wait for a frame, in milliseconds</param>
+    /// <returns>the frame, to be handed back with ReleaseFrame, or null if there is none</returns>
+    PipelineFrame* TakeComposedFrame(int nTimeoutMs);
+
+    /// <summary>
+    /// Hands a frame taken with TakeComposedFrame back for reuse
+    /// </summary>
+    /// <param name="pFrame">frame to release</param>
+    void ReleaseFrame(PipelineFrame* pFrame);
+
+    /// <summary>
+    /// Whether the source has ended and every composed frame was taken
+    /// </summary>
+    bool IsFinished() const;
+
+    /// <summary>
+    /// Result the source ended with: S_FALSE at the end of a replay, else the failure code
+    /// </summary>
+    HRESULT GetEndResult() const { return m_hrEnded; }
+
+    /// <summary>
+    /// Sets whether idle frames are shown at all, e.g. not while the window is minimized;
+    /// may be called on any thread
+    /// </summary>
+    /// <param name="bRequired">whether idle frames need their color</param>
+    void SetPreviewRequired(bool bRequired) { m_bPreviewRequired = bRequired; }
+
+    /// <summary>
+    /// Snapshot of the pipeline counters
+    /// </summary>
+    /// <param name="pStats">receives the counters</param>
+    void GetStats(SpeakerPipelineStats* pStats) const;
+
+private:
+    HRESULT AcquireStage(PipelineFrame* pFrame);
+    UINT32 GetFrameDemand(const BeamState& beam);
+    void AssociateStage(PipelineFrame* pFrame);
+    void LogSpeakers(const PipelineFrame* pFrame, const FaceFrameBatch* pFaces);
+    void ComposeStage(PipelineFrame* pFrame);
+    void AcquireThread();
+    void AssociateThread();
+    void ComposeThread();
+    void ForwardFrame(BoundedQueue<PipelineFrame*>* pQueue, PipelineFrame* pFrame);
+    void NotifyFrameReady(bool bForce);
+    void RecordLatency(LatencyMetric metric, INT64 nStartNs);
+
+    // Longest time the acquire thread waits before checking whether it should stop, in milliseconds
+    static const int        cAcquireWaitTimeout = 50;
+
+    AudioCapture*           m_pAudioCapture;
+    IFrameSource*           m_pSource;
+    FrameWakeup*            m_pWakeup;
+    SpeakerPipelineOptions  m_options;
+
+    // Every frame the pipeline owns; the free ones wait in m_freeFrames
+    std::vector<PipelineFrame*> m_frames;
+    BoundedQueue<PipelineFrame*>* m_pFreeFrames;
+
+    // Color copies and BGRA conversions of the frames in flight
+    FrameBufferPool         m_bufferPool;
+
+    // Queue behind each stage; the last one is taken from by the consumer
+    BoundedQueue<PipelineFrame*>* m_pQueues[PipelineStage_Count];
+
+    std::thread             m_threads[PipelineStage_Count];
+    std::atomic<bool>       m_bStopping;
+
+    // Whether a frame ready notification is out that the consumer has not acted on
+    std::atomic<bool>       m_bFrameReadyPending;
+
+    // Beam state of the energy values consumed lately, and when and at what energy the
+    // latest one was captured
+    BeamHistory             m_beamHistory;
+    INT64                   m_nAudioCaptureNs;
+    float                   m_fEnergy;
+
+    // Whether idle frames are shown, and idle frames acquired in a row so far
+    std::atomic<bool>       m_bPreviewRequired;
+    UINT64                  m_nIdleFrames;
+
+    std::atomic<bool>       m_bEnded;
+    HRESULT                 m_hrEnded;
+
+    std::atomic<UINT64>     m_nFramesAcquired;
+    std::atomic<UINT64>     m_nFramesComposed;
+    std::atomic<UINT64>     m_nFramesVoiceGated;
+    std::atomic<UINT64>     m_nBodyAcquired;
+    std::atomic<UINT64>     m_nBodySkipped;
+    std::atomic<UINT64>     m_nFaceAcquired;
+    std::atomic<UINT64>     m_nFaceSkipped;
+    std::atomic<UINT64>     m_nColorAcquired;
+    std::atomic<UINT64>     m_nColorSkipped;
+    std::atomic<UINT64>     m_nFullConversions;
+    std::atomic<UINT64>     m_nRoiConversions;
+    std::atomic<UINT64>     m_nPreviewConversions;
+    std::atomic<INT64>      m_nStageNs[PipelineStage_Count];
+};
@@ -0,0 +1,540 @@
+//------------------------------------------------------------------------------
+// <copyright file="SpeakerSelection.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "KinectTypes.h"
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include "SpeakerSelection.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/// <summary>
+/// Short name of an angle mapping, as taken by ParseSpeakerAngleMapping
+/// </summary>
+/// <param name="mapping">mapping to name</param>
+const char* GetSpeakerAngleMappingName(SpeakerAngleMapping mapping)
+{
+    static const char* c_szNames[SpeakerAngleMapping_Count] = { "quadratic", "geometric" };
+    return (mapping >= 0 && mapping < SpeakerAngleMapping_Count) ? c_szNames[mapping] : "unknown";
+}
+
+/// <summary>
+/// Parses the name of an angle mapping
+/// </summary>
+/// <param name="szName">quadratic or geometric</param>
+/// <param name="pMapping">receives the mapping</param>
+/// <returns>false for an unknown name</returns>
+bool ParseSpeakerAngleMapping(const char* szName, SpeakerAngleMapping* pMapping)
+{
+    for (int i = 0; i < SpeakerAngleMapping_Count; ++i)
+    {
+        if (0 == strcmp(szName, GetSpeakerAngleMappingName(static_cast<SpeakerAngleMapping>(i))))
+        {
+            *pMapping = static_cast<SpeakerAngleMapping>(i);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/// <summary>
+/// Whether the voice gate keeps the beam from picking speakers in a frame
+/// </summary>
+/// <param name="fBeamAngleConfidence">beam angle confidence in the range [0,1]</param>
+/// <param name="bVoiceActive">whether voice was active at the time of the frame</param>
+/// <param name="bVoiceGate">whether speakers are only picked while voice is active</param>
+bool IsVoiceGated(float fBeamAngleConfidence, bool bVoiceActive, bool bVoiceGate)
+{
+    return bVoiceGate && !bVoiceActive && fBeamAngleConfidence >= c_MinBeamAngleConfidence;
+}
+
+/// <summary>
+/// Maps the center of the mouth to the horizontal angle, in degrees, under which
+/// the microphone array sees it
+/// </summary>
+/// <param name="pFacePoints">face points in color space</param>
+/// <param name="nColorWidth">width (in pixels) of the color frame</param>
+/// <returns>angle in degrees, negative to the left of the sensor</returns>
+float GetMouthCenterAngle(const PointF* pFacePoints, int nColorWidth)
+{
+    PointF centerMouth;
+    centerMouth.X = (pFacePoints[FacePointType_MouthCornerLeft].X + pFacePoints[FacePointType_MouthCornerRight].X) / 2;
+    centerMouth.Y = (pFacePoints[FacePointType_MouthCornerLeft].Y + pFacePoints[FacePointType_MouthCornerRight].Y) / 2;
+
+    // the quadratic was fit on the columns of the sensor's frames
+    if (nColorWidth != c_SensorColorWidth)
+    {
+        centerMouth.X = centerMouth.X * c_SensorColorWidth / nColorWidth;
+    }
+
+    float ang;
+    if (centerMouth.X < (float) (c_SensorColorWidth / 2))
+    {
+        ang = static_cast<float>(-(0.000054253472*(pow(centerMouth.X, 2)) - .10416666666666667*centerMouth.X + 50));
+    }
+    else
+    {
+        ang = static_cast<float>(0.000054253472*(pow(centerMouth.X, 2)) - .10416666666666667*centerMouth.X + 50);
+    }
+
+    return ang;
+}
+
+/// <summary>
+/// Head joint of the body a face belongs to
+/// </summary>
+/// <param name="pFrame">frame holding the face and body data</param>
+/// <param name="iFace">face whose body to look at</param>
+/// <returns>the head joint, or null when the body is not tracked or has no usable joint</returns>
+static const CameraSpacePoint* GetFaceHeadJoint(const SessionFrame* pFrame, int iFace)
+{
+    // face sources are bound to the body of the same index
+    const BodySample& body = pFrame->bodies[iFace];
+    if (pFrame->bHaveBodyData && body.bTracked && body.nTrackingId == pFrame->faces[iFace].nTrackingId &&
+        IsValidCameraSpacePoint(&body.headJoint))
+    {
+        return &body.headJoint;
+    }
+
+    return nullptr;
+}
+
+/// <summary>
+/// Horizontal angle, in degrees, under which the microphone array hears a face
+/// </summary>
+/// <param name="pFrame">frame holding the face and body data</param>
+/// <param name="iFace">face to locate; its body has the same index</param>
+/// <param name="mapping">how to obtain the angle</param>
+/// <returns>angle in degrees, negative to the left of the sensor</returns>
+float GetFaceAngle(const SessionFrame* pFrame, int iFace, SpeakerAngleMapping mapping)
+{
+    const FaceSample& face = pFrame->faces[iFace];
+
+    if (SpeakerAngleMapping_Quadratic == mapping)
+    {
+        return GetMouthCenterAngle(face.facePoints, pFrame->nColorWidth);
+    }
+
+    const CameraSpacePoint* pHead = GetFaceHeadJoint(pFrame, iFace);
+    if (pHead)
+    {
+        MicArrayCalibration calibration;
+        GetDefaultMicArrayCalibration(&calibration);
+
+        return GetCameraSpaceAngle(pHead, &calibration);
+    }
+
+    float fMouthX = (face.facePoints[FacePointType_MouthCornerLeft].X + face.facePoints[FacePointType_MouthCornerRight].X) / 2;
+    return GetPixelAngle(fMouthX, pFrame->nColorWidth);
+}
+
+/// <summary>
+/// Validates face bounding box and face points to be within screen space
+/// </summary>
+/// <param name="pFaceBox">the face bounding box</param>
+/// <param name="pFacePoints">the face points</param>
+/// <param name="nWidth">width (in pixels) of the screen space</param>
+/// <param name="nHeight">height (in pixels) of the screen space</param>
+/// <returns>success or failure</returns>
+bool ValidateFaceBoxAndPoints(const RectI* pFaceBox, const PointF* pFacePoints, int nWidth, int nHeight)
+{
+    bool isFaceValid = false;
+
+    if (pFaceBox != nullptr)
+    {
+        INT32 screenWidth = nWidth;
+        INT32 screenHeight = nHeight;
+
+        INT32 width = pFaceBox->Right - pFaceBox->Left;
+        INT32 height = pFaceBox->Bottom - pFaceBox->Top;
+
+        // check if we have a valid rectangle within the bounds of the screen space
+        isFaceValid = width > 0 &&
+            height > 0 &&
+            pFaceBox->Right <= screenWidth &&
+            pFaceBox->Bottom <= screenHeight;
+
+        if (isFaceValid)
+        {
+            for (int i = 0; i < FacePointType_Count; i++)
+            {
+                // check if we have a valid face point within the bounds of the screen space
+                bool isFacePointValid = pFacePoints[i].X > 0.0f &&
+                    pFacePoints[i].Y > 0.0f &&
+                    pFacePoints[i].X < nWidth &&
+                    pFacePoints[i].Y < nHeight;
+
+                if (!isFacePointValid)
+                {
+                    isFaceValid = false;
+                    break;
+                }
+            }
+        }
+    }
+
+    return isFaceValid;
+}
+
+/// <summary>
+/// Converts rotation quaternion to Euler angles 
+/// And then maps them to a specified range of values to control the refresh rate
+/// </summary>
+/// <param name="pQuaternion">face rotation quaternion</param>
+/// <param name="pPitch">rotation about the X-axis</param>
+/// <param name="pYaw">rotation about the Y-axis</param>
+/// <param name="pRoll">rotation about the Z-axis</param>
+void ExtractFaceRotationInDegrees(const Vector4* pQuaternion, int* pPitch, int* pYaw, int* pRoll)
+{
+    double x = pQuaternion->x;
+    double y = pQuaternion->y;
+    double z = pQuaternion->z;
+    double w = pQuaternion->w;
+
+    // convert face rotation quaternion to Euler angles in degrees		
+    double dPitch, dYaw, dRoll;
+    dPitch = atan2(2 * (y * z + w * x), w * w - x * x - y * y + z * z) / M_PI * 180.0;
+    dYaw = asin(2 * (w * y - x * z)) / M_PI * 180.0;
+    dRoll = atan2(2 * (x * y + w * z), w * w + x * x - y * y - z * z) / M_PI * 180.0;
+
+    // clamp rotation values in degrees to a specified range of values to control the refresh rate
+    double increment = c_FaceRotationIncrementInDegrees; 
+    *pPitch = static_cast<int>(floor((dPitch + increment/2.0 * (dPitch > 0 ? 1.0 : -1.0)) / increment) * increment);
+    *pYaw = static_cast<int>(floor((dYaw + increment/2.0 * (dYaw > 0 ? 1.0 : -1.0)) / increment) * increment);
+    *pRoll = static_cast<int>(floor((dRoll + increment/2.0 * (dRoll > 0 ? 1.0 : -1.0)) / increment) * increment);
+}
+
+/// <summary>
+/// Enlarges the face bounding box to take in the hair and chin, clamped to the frame
+/// </summary>
+/// <param name="pFaceBox">the face bounding box</param>
+/// <param name="nWidth">width (in pixels) of the color frame</param>
+/// <param name="nHeight">height (in pixels) of the color frame</param>
+/// <param name="pRoi">receives the enlarged region of interest</param>
+void GetEnlargedFaceRect(const RectI* pFaceBox, int nWidth, int nHeight, RoiRect* pRoi)
+{
+    RoiRect faceBox;
+    faceBox.left = static_cast<float>(pFaceBox->Left);
+    faceBox.top = static_cast<float>(pFaceBox->Top);
+    faceBox.right = static_cast<float>(pFaceBox->Right);
+    faceBox.bottom = static_cast<float>(pFaceBox->Bottom);
+
+    if (faceBox.left - (float) 25.0 < (float) 0.0)
+    {
+        pRoi->left = (float) 0.0;
+    }
+    else
+    {
+        pRoi->left = faceBox.left - (float) 25.0;
+    }
+    if (faceBox.top - (float) 50.0 < 0.0)
+    {
+        pRoi->top = (float) 0.0;
+    }
+    else
+    {
+        pRoi->top = faceBox.top - (float) 50.0;
+    }
+    if (faceBox.right + (float) 25.0 > (float) nWidth)
+    {
+        pRoi->right = (float) nWidth;
+    }
+    else
+    {
+        pRoi->right = faceBox.right + (float) 25.0;
+    }
+    if (faceBox.bottom + (float) 25.0 > (float) nHeight)
+    {
+        pRoi->bottom = (float) nHeight;
+    }
+    else
+    {
+        pRoi->bottom = faceBox.bottom + (float) 25.0;
+    }
+}
+
+/// <summary>
+/// Decides which faces of a frame are speaking according to the audio beam
+/// </summary>
+/// <param name="pFrame">frame holding the face results</param>
+/// <param name="fBeamAngle">beam angle in radians</param>
+/// <param name="fBeamAngleConfidence">beam angle confidence in the range [0,1]</param>
+/// <param name="pbIsSpeaker">receives, for each of the BODY_COUNT faces, whether it is speaking</param>
+/// <param name="mapping">how the angle of each face is obtained</param>
+/// <returns>number of speaking faces</returns>
+int SelectSpeakers(const SessionFrame* pFrame, float fBeamAngle, float fBeamAngleConfidence, bool* pbIsSpeaker, SpeakerAngleMapping mapping)
+{
+    FaceFrameBatch batch;
+    LoadFaceFrameBatch(pFrame, &batch);
+
+    return SelectSpeakersBatch(&batch, fBeamAngle, fBeamAngleConfidence, pbIsSpeaker, mapping);
+}
+
+/// <summary>
+/// Maps the mouth center of every face of a batch to its angle from the pixel table
+/// </summary>
+/// <param name="pBatch">faces of the frame</param>
+/// <param name="pAngles">receives, for each of the BODY_COUNT faces, the angle in degrees</param>
+static void GetMouthPixelAngleBatch(const FaceFrameBatch* pBatch, float* pAngles)
+{
+    const float* pLeftX = pBatch->fPointX[FacePointType_MouthCornerLeft];
+    const float* pRightX = pBatch->fPointX[FacePointType_MouthCornerRight];
+
+    for (int iFace = 0; iFace < BODY_COUNT; ++iFace)
+    {
+        pAngles[iFace] = GetPixelAngle((pLeftX[iFace] + pRightX[iFace]) / 2, pBatch->nColorWidth);
+    }
+}
+
+/// <summary>
+/// Decides which faces of a batch are speaking according to the audio beam
+/// </summary>
+/// <param name="pBatch">faces of the frame</param>
+/// <param name="fBeamAngle">beam angle in radians</param>
+/// <param name="fBeamAngleConfidence">beam angle confidence in the range [0,1]</param>
+/// <param name="pbIsSpeaker">receives, for each of the BODY_COUNT faces, whether it is speaking</param>
+/// <param name="mapping">how the angle of each face is obtained</param>
+/// <returns>number of speaking faces</returns>
+int SelectSpeakersBatch(const FaceFrameBatch* pBatch, float fBeamAngle, float fBeamAngleConfidence, bool* pbIsSpeaker, SpeakerAngleMapping mapping)
+{
+    bool bAnyFace = false;
+    for (int iFace = 0; iFace < BODY_COUNT; ++iFace)
+    {
+        pbIsSpeaker[iFace] = false;
+        bAnyFace = bAnyFace || pBatch->bHaveResult[iFace];
+    }
+
+    if (fBeamAngleConfidence < c_MinBeamAngleConfidence || !bAnyFace)
+    {
+        return 0;
+    }
+
+    float fBeamAngleInDegrees = 180.0f * fBeamAngle / static_cast<float>(M_PI);
+
+    // faces without a head joint to go by are matched on the angle of their mouth
+    float fAngles[BODY_COUNT];
+    bool bAnyHead = false;
+    if (SpeakerAngleMapping_Geometric == mapping)
+    {
+        GetMouthPixelAngleBatch(pBatch, fAngles);
+        for (int iFace = 0; iFace < BODY_COUNT; ++iFace)
+        {
+            bAnyHead = bAnyHead || (pBatch->bHaveResult[iFace] && pBatch->bHaveHead[iFace]);
+        }
+    }
+    else
+    {
+        GetMouthCenterAngleBatch(pBatch, fAngles);
+    }
+
+    // head joints are tested against the beam window in tangent space, X/Z, which
+    // needs one pair of tangents per frame instead of an arc tangent per face
+    MicArrayCalibration calibration;
+    float fTanLow = 0.0f;
+    float fTanHigh = 0.0f;
+    if (bAnyHead)
+    {
+        GetDefaultMicArrayCalibration(&calibration);
+
+        double fLow = (fBeamAngleInDegrees + calibration.fYawDegrees - c_SpeakerAngleTolerance) * M_PI / 180.0;
+        double fHigh = (fBeamAngleInDegrees + calibration.fYawDegrees + c_SpeakerAngleTolerance) * M_PI / 180.0;
+        fTanLow = static_cast<float>(tan((std::max)(fLow, -M_PI * 0.499)));
+        fTanHigh = static_cast<float>(tan((std::min)(fHigh, M_PI * 0.499)));
+    }
+
+    int nSpeakers = 0;
+    for (int iFace = 0; iFace < BODY_COUNT; ++iFace)
+    {
+        if (!pBatch->bHaveResult[iFace])
+        {
+            continue;
+        }
+
+        bool bSpeaking;
+        if (bAnyHead && pBatch->bHaveHead[iFace])
+        {
+            float fX = pBatch->fHeadX[iFace] - calibration.fOffsetX;
+            float fZ = pBatch->fHeadZ[iFace] - calibration.fOffsetZ;
+            bSpeaking = fZ > 0.0f && fX > fTanLow * fZ && fX < fTanHigh * fZ;
+        }
+        else
+        {
+            bSpeaking = fabs(fBeamAngleInDegrees - fAngles[iFace]) < c_SpeakerAngleTolerance;
+        }
+
+        pbIsSpeaker[iFace] = bSpeaking;
+        nSpeakers += bSpeaking ? 1 : 0;
+    }
+
+    return nSpeakers;
+}
+
+/// <summary>
+/// Validates the bounding box and face points of every face of a batch to be within
+/// the color frame, as ValidateFaceBoxAndPoints does for one face
+/// </summary>
+/// <param name="pBatch">faces of the frame</param>
+/// <param name="pbValid">receives, for each of the BODY_COUNT faces, whether it is valid</param>
+/// <returns>number of valid faces</returns>
+int ValidateFaceBatch(const FaceFrameBatch* pBatch, bool* pbValid)
+{
+    const int nWidth = pBatch->nColorWidth;
+    const int nHeight = pBatch->nColorHeight;
+    const float fWidth = static_cast<float>(nWidth);
+    const float fHeight = static_cast<float>(nHeight);
+
+    // every test of every face is evaluated, without an early out, so that the loops
+    // over the faces run branch free
+    int nValid[BODY_COUNT];
+    for (int iFace = 0; iFace < BODY_COUNT; ++iFace)
+    {
+        nValid[iFace] = (pBatch->nBoxRight[iFace] - pBatch->nBoxLeft[iFace] > 0) &
+            (pBatch->nBoxBottom[iFace] - pBatch->nBoxTop[iFace] > 0) &
+            (pBatch->nBoxRight[iFace] <= nWidth) &
+            (pBatch->nBoxBottom[iFace] <= nHeight);
+    }
+
+    for (int i = 0; i < FacePointType_Count; ++i)
+    {
+        const float* pX = pBatch->fPointX[i];
+        const float* pY = pBatch->fPointY[i];
+
+        for (int iFace = 0; iFace < BODY_COUNT; ++iFace)
+        {
+            nValid[iFace] &= (pX[iFace] > 0.0f) & (pY[iFace] > 0.0f) & (pX[iFace] < fWidth) & (pY[iFace] < fHeight);
+        }
+    }
+
+    int nFaces = 0;
+    for (int iFace = 0; iFace < BODY_COUNT; ++iFace)
+    {
+        pbValid[iFace] = 0 != nValid[iFace];
+        nFaces += nValid[iFace];
+    }
+
+    return nFaces;
+}
+
+/// <summary>
+/// Maps the mouth center of every face of a batch to its angle with the hand-fit
+/// quadratic, as GetMouthCenterAngle does for one face
+/// </summary>
+/// <param name="pBatch">faces of the frame</param>
+/// <param name="pAngles">receives, for each of the BODY_COUNT faces, the angle in degrees</param>
+void GetMouthCenterAngleBatch(const FaceFrameBatch* pBatch, float* pAngles)
+{
+    const float* pLeftX = pBatch->fPointX[FacePointType_MouthCornerLeft];
+    const float* pRightX = pBatch->fPointX[FacePointType_MouthCornerRight];
+    const int nColorWidth = pBatch->nColorWidth;
+
+    for (int iFace = 0; iFace < BODY_COUNT; ++iFace)
+    {
+        float fX = (pLeftX[iFace] + pRightX[iFace]) / 2;
+
+        // the quadratic was fit on the columns of the sensor's frames
+        if (nColorWidth != c_SensorColorWidth)
+        {
+            fX = fX * c_SensorColorWidth / nColorWidth;
+        }
+
+        // the square of a float is exact in double, as pow(x, 2) is, without the call
+        double fX2 = static_cast<double>(fX) * fX;
+        double fAngle = 0.000054253472*fX2 - .10416666666666667*fX + 50;
+        pAngles[iFace] = static_cast<float>((fX < (float) (c_SensorColorWidth / 2)) ? -fAngle : fAngle);
+    }
+}
+
+/// <summary>
+/// Horizontal angle, in degrees, under which the microphone array hears every face of
+/// a batch, as GetFaceAngle does for one face
+/// </summary>
+/// <param name="pBatch">faces of the frame</param>
+/// <param name="mapping">how to obtain the angles</param>
+/// <param name="pAngles">receives, for each of the BODY_COUNT faces, the angle in degrees</param>
+void GetFaceAngleBatch(const FaceFrameBatch* pBatch, SpeakerAngleMapping mapping, float* pAngles)
+{
+    if (SpeakerAngleMapping_Quadratic == mapping)
+    {
+        GetMouthCenterAngleBatch(pBatch, pAngles);
+        return;
+    }
+
+    GetMouthPixelAngleBatch(pBatch, pAngles);
+
+    MicArrayCalibration calibration;
+    GetDefaultMicArrayCalibration(&calibration);
+
+    for (int iFace = 0; iFace < BODY_COUNT; ++iFace)
+    {
+        if (pBatch->bHaveHead[iFace])
+        {
+            CameraSpacePoint head;
+            head.X = pBatch->fHeadX[iFace];
+            head.Y = pBatch->fHeadY[iFace];
+            head.Z = pBatch->fHeadZ[iFace];
+            pAngles[iFace] = GetCameraSpaceAngle(&head, &calibration);
+        }
+    }
+}
+
+/// <summary>
+/// Computes the smallest pixel rectangle holding every speaker region that will be drawn,
+/// plus a margin, so that only that part of the color frame has to be transferred
+/// </summary>
+/// <param name="pFrame">frame holding the face results</param>
+/// <param name="pbIsSpeaker">for each of the BODY_COUNT faces, whether it is speaking</param>
+/// <param name="nMargin">margin in pixels added on every side, clamped to the frame</param>
+/// <param name="pRect">receives the rectangle; right and bottom are exclusive</param>
+/// <returns>false if no speaker region will be drawn</returns>
+bool GetSpeakerTransferRect(const SessionFrame* pFrame, const bool* pbIsSpeaker, int nMargin, RectI* pRect)
+{
+    bool bHaveRoi = false;
+    RoiRect bounds = {0};
+
+    for (int iFace = 0; iFace < BODY_COUNT; ++iFace)
+    {
+        const FaceSample& face = pFrame->faces[iFace];
+
+        // only regions the renderer will actually draw
+        if (!pbIsSpeaker[iFace] || !ValidateFaceBoxAndPoints(&face.faceBox, face.facePoints, pFrame->nColorWidth, pFrame->nColorHeight))
+        {
+            continue;
+        }
+
+        RoiRect roi;
+        GetEnlargedFaceRect(&face.faceBox, pFrame->nColorWidth, pFrame->nColorHeight, &roi);
+
+        if (!bHaveRoi)
+        {
+            bounds = roi;
+            bHaveRoi = true;
+        }
+        else
+        {
+            bounds.left = (std::min)(bounds.left, roi.left);
+            bounds.top = (std::min)(bounds.top, roi.top);
+            bounds.right = (std::max)(bounds.right, roi.right);
+            bounds.bottom = (std::max)(bounds.bottom, roi.bottom);
+        }
+    }
+
+    if (bHaveRoi)
+    {
+        // round outwards so that filtering at the edges of the region still sees real pixels
+        pRect->Left = (std::max)(static_cast<int>(floor(bounds.left)) - nMargin, 0);
+        pRect->Top = (std::max)(static_cast<int>(floor(bounds.top)) - nMargin, 0);
+        pRect->Right = (std::min)(static_cast<int>(ceil(bounds.right)) + nMargin, pFrame->nColorWidth);
+        pRect->Bottom = (std::min)(static_cast<int>(ceil(bounds.bottom)) + nMargin, pFrame->nColorHeight);
+
+        bHaveRoi = (pRect->Right > pRect->Left) && (pRect->Bottom > pRect->Top);
+    }
+
+    return bHaveRoi;
+}
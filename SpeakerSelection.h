@@ -0,0 +1,186 @@
+//------------------------------------------------------------------------------
+// <copyright file="SpeakerSelection.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Matches tracked faces against the audio beam and derives the region of interest
+// drawn for the active speaker. Shared by the live renderer and replay so that both
+// make the exact same decisions.
+//
+// The per-face functions take a face as the recordings store it; the batch kernels
+// take every face of a frame at once, as a FaceFrameBatch, and are what the pipeline
+// and replay decide on. Both give the same results.
+
+#pragma once
+
+#include "KinectTypes.h"
+#include "SessionRecording.h"
+#include "BeamAngleMapping.h"
+#include "FaceFrameBatch.h"
+
+// Minimum beam angle confidence for the beam to be used to pick a speaker
+static const float c_MinBeamAngleConfidence = 0.5f;
+
+// Maximum difference, in degrees, between a face's mouth angle and the beam angle
+static const float c_SpeakerAngleTolerance = 5.0f;
+
+// Margin, in pixels, kept around the speaker regions when only those are transferred
+static const int c_RoiTransferMargin = 16;
+
+// Step, in degrees, the face rotation angles are rounded to
+static const double c_FaceRotationIncrementInDegrees = 5.0;
+
+// How the angle of a face, compared with the beam angle, is obtained
+enum SpeakerAngleMapping
+{
+    // Hand-fit quadratic of the mouth center column, evaluated for every face
+    SpeakerAngleMapping_Quadratic = 0,
+
+    // Geometry of the body's head joint, or the pixel table when the body has no joint
+    SpeakerAngleMapping_Geometric = 1,
+
+    SpeakerAngleMapping_Count = 2
+};
+
+/// <summary>
+/// Short name of an angle mapping, as taken by ParseSpeakerAngleMapping
+/// </summary>
+/// <param name="mapping">mapping to name</param>
+const char* GetSpeakerAngleMappingName(SpeakerAngleMapping mapping);
+
+/// <summary>
+/// Parses the name of an angle mapping
+/// </summary>
+/// <param name="szName">quadratic or geometric</param>
+/// <param name="pMapping">receives the mapping</param>
+/// <returns>false for an unknown name</returns>
+bool ParseSpeakerAngleMapping(const char* szName, SpeakerAngleMapping* pMapping);
+
+/// <summary>
+/// Whether the voice gate keeps the beam from picking speakers in a frame: the beam is
+/// confident enough to be matched against the faces, but no voice is active
+/// </summary>
+/// <param name="fBeamAngleConfidence">beam angle confidence in the range [0,1]</param>
+/// <param name="bVoiceActive">whether voice was active at the time of the frame</param>
+/// <param name="bVoiceGate">whether speakers are only picked while voice is active</param>
+bool IsVoiceGated(float fBeamAngleConfidence, bool bVoiceActive, bool bVoiceGate);
+
+/// <summary>
+/// Floating point rectangle in color space
+/// </summary>
+struct RoiRect
+{
+    float left;
+    float top;
+    float right;
+    float bottom;
+};
+
+/// <summary>
+/// Maps the center of the mouth to the horizontal angle, in degrees, under which
+/// the microphone array sees it
+/// </summary>
+/// <param name="pFacePoints">face points in color space</param>
+/// <param name="nColorWidth">width (in pixels) of the color frame</param>
+/// <returns>angle in degrees, negative to the left of the sensor</returns>
+float GetMouthCenterAngle(const PointF* pFacePoints, int nColorWidth);
+
+/// <summary>
+/// Horizontal angle, in degrees, under which the microphone array hears a face
+/// </summary>
+/// <param name="pFrame">frame holding the face and body data</param>
+/// <param name="iFace">face to locate; its body has the same index</param>
+/// <param name="mapping">how to obtain the angle</param>
+/// <returns>angle in degrees, negative to the left of the sensor</returns>
+float GetFaceAngle(const SessionFrame* pFrame, int iFace, SpeakerAngleMapping mapping);
+
+/// <summary>
+/// Validates face bounding box and face points to be within screen space
+/// </summary>
+/// <param name="pFaceBox">the face bounding box</param>
+/// <param name="pFacePoints">the face points</param>
+/// <param name="nWidth">width (in pixels) of the screen space</param>
+/// <param name="nHeight">height (in pixels) of the screen space</param>
+/// <returns>success or failure</returns>
+bool ValidateFaceBoxAndPoints(const RectI* pFaceBox, const PointF* pFacePoints, int nWidth, int nHeight);
+
+/// <summary>
+/// Converts rotation quaternion to Euler angles 
+/// And then maps them to a specified range of values to control the refresh rate
+/// </summary>
+/// <param name="pQuaternion">face rotation quaternion</param>
+/// <param name="pPitch">rotation about the X-axis</param>
+/// <param name="pYaw">rotation about the Y-axis</param>
+/// <param name="pRoll">rotation about the Z-axis</param>
+void ExtractFaceRotationInDegrees(const Vector4* pQuaternion, int* pPitch, int* pYaw, int* pRoll);
+
+/// <summary>
+/// Enlarges the face bounding box to take in the hair and chin, clamped to the frame
+/// </summary>
+/// <param name="pFaceBox">the face bounding box</param>
+/// <param name="nWidth">width (in pixels) of the color frame</param>
+/// <param name="nHeight">height (in pixels) of the color frame</param>
+/// <param name="pRoi">receives the enlarged region of interest</param>
+void GetEnlargedFaceRect(const RectI* pFaceBox, int nWidth, int nHeight, RoiRect* pRoi);
+
+/// <summary>
+/// Decides which faces of a frame are speaking according to the audio beam
+/// </summary>
+/// <param name="pFrame">frame holding the face results</param>
+/// <param name="fBeamAngle">beam angle in radians</param>
+/// <param name="fBeamAngleConfidence">beam angle confidence in the range [0,1]</param>
+/// <param name="pbIsSpeaker">receives, for each of the BODY_COUNT faces, whether it is speaking</param>
+/// <param name="mapping">how the angle of each face is obtained</param>
+/// <returns>number of speaking faces</returns>
+int SelectSpeakers(const SessionFrame* pFrame, float fBeamAngle, float fBeamAngleConfidence, bool* pbIsSpeaker,
+    SpeakerAngleMapping mapping = SpeakerAngleMapping_Geometric);
+
+/// <summary>
+/// Decides which faces of a batch are speaking according to the audio beam
+/// </summary>
+/// <param name="pBatch">faces of the frame</param>
+/// <param name="fBeamAngle">beam angle in radians</param>
+/// <param name="fBeamAngleConfidence">beam angle confidence in the range [0,1]</param>
+/// <param name="pbIsSpeaker">receives, for each of the BODY_COUNT faces, whether it is speaking</param>
+/// <param name="mapping">how the angle of each face is obtained</param>
+/// <returns>number of speaking faces</returns>
+int SelectSpeakersBatch(const FaceFrameBatch* pBatch, float fBeamAngle, float fBeamAngleConfidence, bool* pbIsSpeaker,
+    SpeakerAngleMapping mapping = SpeakerAngleMapping_Geometric);
+
+/// <summary>
+/// Validates the bounding box and face points of every face of a batch to be within
+/// the color frame, as ValidateFaceBoxAndPoints does for one face
+/// </summary>
+/// <param name="pBatch">faces of the frame</param>
+/// <param name="pbValid">receives, for each of the BODY_COUNT faces, whether it is valid</param>
+/// <returns>number of valid faces</returns>
+int ValidateFaceBatch(const FaceFrameBatch* pBatch, bool* pbValid);
+
+/// <summary>
+/// Maps the mouth center of every face of a batch to its angle with the hand-fit
+/// quadratic, as GetMouthCenterAngle does for one face
+/// </summary>
+/// <param name="pBatch">faces of the frame</param>
+/// <param name="pAngles">receives, for each of the BODY_COUNT faces, the angle in degrees</param>
+void GetMouthCenterAngleBatch(const FaceFrameBatch* pBatch, float* pAngles);
+
+/// <summary>
+/// Horizontal angle, in degrees, under which the microphone array hears every face of
+/// a batch, as GetFaceAngle does for one face
+/// </summary>
+/// <param name="pBatch">faces of the frame</param>
+/// <param name="mapping">how to obtain the angles</param>
+/// <param name="pAngles">receives, for each of the BODY_COUNT faces, the angle in degrees</param>
+void GetFaceAngleBatch(const FaceFrameBatch* pBatch, SpeakerAngleMapping mapping, float* pAngles);
+
+/// <summary>
+/// Computes the smallest pixel rectangle holding every speaker region that will be drawn,
+/// plus a margin, so that only that part of the color frame has to be transferred
+/// </summary>
+/// <param name="pFrame">frame holding the face results</param>
+/// <param name="pbIsSpeaker">for each of the BODY_COUNT faces, whether it is speaking</param>
+/// <param name="nMargin">margin in pixels added on every side, clamped to the frame</param>
+/// <param name="pRect">receives the rectangle; right and bottom are exclusive</param>
+/// <returns>false if no speaker region will be drawn</returns>
+bool GetSpeakerTransferRect(const SessionFrame* pFrame, const bool* pbIsSpeaker, int nMargin, RectI* pRect);
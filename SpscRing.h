@@ -0,0 +1,112 @@
+//------------------------------------------------------------------------------
+// <copyright file="SpscRing.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Wait-free ring buffer for exactly one producer thread and one consumer thread.
+// Neither side ever blocks: a push into a full ring fails and is counted, a pop
+// from an empty ring returns nothing.
+
+#pragma once
+
+#include <stddef.h>
+#include <atomic>
+
+template <typename T, size_t Capacity>
+class SpscRing
+{
+    static_assert(Capacity > 0 && 0 == (Capacity & (Capacity - 1)), "SpscRing capacity must be a power of two");
+
+    static const size_t cCacheLineSize = 64;
+
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    SpscRing() :
+        m_nWriteIndex(0),
+        m_nReadIndex(0),
+        m_nDropped(0)
+    {
+    }
+
+    /// <summary>
+    /// Appends an item; producer thread only
+    /// </summary>
+    /// <param name="item">item to append</param>
+    /// <returns>false if the ring was full and the item was dropped</returns>
+    bool TryPush(const T& item)
+    {
+        size_t nWrite = m_nWriteIndex.load(std::memory_order_relaxed);
+        if (nWrite - m_nReadIndex.load(std::memory_order_acquire) >= Capacity)
+        {
+            m_nDropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        m_items[nWrite & (Capacity - 1)] = item;
+
+        // publish the item only once it is completely written
+        m_nWriteIndex.store(nWrite + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// <summary>
+    /// Removes the oldest item; consumer thread only
+    /// </summary>
+    /// <param name="pItem">receives the item</param>
+    /// <returns>false if the ring was empty</returns>
+    bool TryPop(T* pItem)
+    {
+        return 1 == PopMany(pItem, 1);
+    }
+
+    /// <summary>
+    /// Removes up to nMaxItems of the oldest items; consumer thread only
+    /// </summary>
+    /// <param name="pItems">receives the items, oldest first</param>
+    /// <param name="nMaxItems">capacity of pItems</param>
+    /// <returns>number of items removed</returns>
+    size_t PopMany(T* pItems, size_t nMaxItems)
+    {
+        size_t nRead = m_nReadIndex.load(std::memory_order_relaxed);
+        size_t nAvailable = m_nWriteIndex.load(std::memory_order_acquire) - nRead;
+        size_t nCount = (nAvailable < nMaxItems) ? nAvailable : nMaxItems;
+
+        for (size_t i = 0; i < nCount; ++i)
+        {
+            pItems[i] = m_items[(nRead + i) & (Capacity - 1)];
+        }
+
+        // hand the slots back to the producer only once they are copied out
+        m_nReadIndex.store(nRead + nCount, std::memory_order_release);
+        return nCount;
+    }
+
+    /// <summary>
+    /// Number of items waiting to be popped; exact only on the consumer thread
+    /// </summary>
+    size_t GetSize() const
+    {
+        return m_nWriteIndex.load(std::memory_order_acquire) - m_nReadIndex.load(std::memory_order_acquire);
+    }
+
+    /// <summary>
+    /// Number of items dropped because the ring was full
+    /// </summary>
+    size_t GetDroppedCount() const
+    {
+        return m_nDropped.load(std::memory_order_relaxed);
+    }
+
+private:
+    // producer and consumer indices live on separate cache lines to avoid false sharing
+    std::atomic<size_t>     m_nWriteIndex;
+    char                    m_padding0[cCacheLineSize - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t>     m_nReadIndex;
+    char                    m_padding1[cCacheLineSize - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t>     m_nDropped;
+    char                    m_padding2[cCacheLineSize - sizeof(std::atomic<size_t>)];
+    T                       m_items[Capacity];
+};
@@ -0,0 +1,693 @@
+//------------------------------------------------------------------------------
+// <copyright file="ToolCommands.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Console tool commands working on recordings, and the helpers shared by every command
+
+#include "KinectTypes.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "PerfClock.h"
+#include "BatchRunner.h"
+#include "FrameCodec.h"
+#include "MosaicCompositor.h"
+#include "PipelineWorkerPool.h"
+#include "ReplayRunner.h"
+#include "RoiExport.h"
+#include "RoiScaler.h"
+#include "SessionRecording.h"
+#include "SpeakerLog.h"
+#include "SpeakerSelection.h"
+#include "ToolCommands.h"
+
+/// <summary>
+/// Opens a file with the C runtime
+/// </summary>
+/// <param name="szPath">path of the file</param>
+/// <param name="szMode">fopen style mode string</param>
+/// <returns>the open file or nullptr on failure</returns>
+FILE* OpenFile(const char* szPath, const char* szMode)
+{
+    FILE* pFile = nullptr;
+#if defined(_WIN32)
+    if (0 != fopen_s(&pFile, szPath, szMode))
+    {
+        pFile = nullptr;
+    }
+#else
+    pFile = fopen(szPath, szMode);
+#endif
+    return pFile;
+}
+
+/// <summary>
+/// Whether an argument matches the given switch
+/// </summary>
+/// <param name="szArg">argument</param>
+/// <param name="szSwitch">switch including its dashes</param>
+/// <returns>true on a match</returns>
+bool IsSwitch(const char* szArg, const char* szSwitch)
+{
+    return 0 == strcmp(szArg, szSwitch);
+}
+
+/// <summary>
+/// replay &lt;recording&gt; [--realtime] [--no-vad]: replays a recording through speaker
+/// selection
+/// </summary>
+/// <param name="argc">number of command arguments</param>
+/// <param name="argv">command arguments, starting after the command name</param>
+/// <returns>process exit code</returns>
+int ReplayCommand(int argc, char** argv)
+{
+    const char* szPath = nullptr;
+    ReplayPacing pacing = ReplayPacing_MaxSpeed;
+    bool bVoiceGate = true;
+
+    for (int i = 0; i < argc; ++i)
+    {
+        if (IsSwitch(argv[i], "--realtime"))
+        {
+            pacing = ReplayPacing_RealTime;
+        }
+        else if (IsSwitch(argv[i], "--no-vad"))
+        {
+            bVoiceGate = false;
+        }
+        else
+        {
+            szPath = argv[i];
+        }
+    }
+
+    if (nullptr == szPath)
+    {
+        fprintf(stderr, "replay: missing recording path\n");
+        return 1;
+    }
+
+    ReplayStats stats;
+    HRESULT hr = RunReplay(szPath, pacing, bVoiceGate, nullptr, &stats);
+    if (FAILED(hr))
+    {
+        fprintf(stderr, "replay: failed to replay %s (0x%08x)\n", szPath, static_cast<unsigned int>(hr));
+        return 1;
+    }
+
+    double fRecordedSeconds = static_cast<double>(stats.nRecordedTicks) / c_TicksPerSecond;
+    double fElapsedSeconds = static_cast<double>(stats.nElapsedNs) / 1e9;
+
+    printf("frames               %llu\n", static_cast<unsigned long long>(stats.nFrames));
+    printf("frames with speaker  %llu\n", static_cast<unsigned long long>(stats.nFramesWithSpeaker));
+    printf("frames voice gated   %llu\n", static_cast<unsigned long long>(stats.nFramesVoiceGated));
+    if (stats.voiceActivity.nHops > 0)
+    {
+        printf("voice active         %.1f%% of audio, %llu onsets\n", 100.0 * stats.voiceActivity.nVoiceHops / stats.voiceActivity.nHops,
+            static_cast<unsigned long long>(stats.voiceActivity.nOnsets));
+    }
+    printf("speaker rois         %llu\n", static_cast<unsigned long long>(stats.nSpeakerRois));
+    if (stats.nFrames > 0)
+    {
+        printf("full frame transfer  %.1f KB/frame\n", static_cast<double>(stats.nFullFrameBytes) / stats.nFrames / 1024);
+        printf("roi transfer         %.1f KB/frame\n", static_cast<double>(stats.nRoiTransferBytes) / stats.nFrames / 1024);
+    }
+    printf("audio chunks         %llu\n", static_cast<unsigned long long>(stats.nAudioChunks));
+    printf("audio samples        %llu\n", static_cast<unsigned long long>(stats.nAudioSamples));
+    printf("recorded seconds     %.3f\n", fRecordedSeconds);
+    printf("elapsed seconds      %.3f\n", fElapsedSeconds);
+    if (fElapsedSeconds > 0.0)
+    {
+        printf("frames per second    %.2f\n", stats.nFrames / fElapsedSeconds);
+        printf("speed vs real time   %.2fx\n", fRecordedSeconds / fElapsedSeconds);
+    }
+
+    return 0;
+}
+
+/// <summary>
+/// Parses a frame size given as WIDTHxHEIGHT
+/// </summary>
+/// <param name="szSize">size argument</param>
+/// <param name="pnWidth">receives the width</param>
+/// <param name="pnHeight">receives the height</param>
+/// <returns>false unless both are positive and even</returns>
+bool ParseFrameSize(const char* szSize, int* pnWidth, int* pnHeight)
+{
+    const char* szSeparator = strchr(szSize, 'x');
+    if (nullptr == szSeparator)
+    {
+        return false;
+    }
+
+    *pnWidth = atoi(szSize);
+    *pnHeight = atoi(szSeparator + 1);
+
+    return *pnWidth > 0 && *pnHeight > 0 && 0 == (*pnWidth % 2) && 0 == (*pnHeight % 2);
+}
+
+/// <summary>
+/// export &lt;recording&gt; &lt;output|-&gt; [--format y4m|i420|bgra] [--size WxH]
+/// [--scaling nearest|bilinear|box|auto] [--timestamps file] [--realtime] [--no-vad]: writes the speaker regions of a recording as a video
+/// stream; the report goes to stderr since the stream may be on stdout
+/// </summary>
+/// <param name="argc">number of command arguments</param>
+/// <param name="argv">command arguments, starting after the command name</param>
+/// <returns>process exit code</returns>
+int ExportCommand(int argc, char** argv)
+{
+    const char* szPaths[2] = { nullptr, nullptr };
+    const char* szTimestampPath = nullptr;
+    int nPaths = 0;
+    RoiExportFormat format = RoiExportFormat_Y4m;
+    int nWidth = c_MosaicWidth;
+    int nHeight = c_MosaicHeight;
+    ScaleMethod scaling = ScaleMethod_Auto;
+    ReplayPacing pacing = ReplayPacing_MaxSpeed;
+    bool bVoiceGate = true;
+
+    for (int i = 0; i < argc; ++i)
+    {
+        if (IsSwitch(argv[i], "--format") && i + 1 < argc)
+        {
+            if (!ParseRoiExportFormat(argv[++i], &format))
+            {
+                fprintf(stderr, "export: unknown format %s\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (IsSwitch(argv[i], "--size") && i + 1 < argc)
+        {
+            if (!ParseFrameSize(argv[++i], &nWidth, &nHeight))
+            {
+                fprintf(stderr, "export: size must be WIDTHxHEIGHT, both even\n");
+                return 1;
+            }
+        }
+        else if (IsSwitch(argv[i], "--scaling") && i + 1 < argc)
+        {
+            if (!ParseScaleMethod(argv[++i], &scaling))
+            {
+                fprintf(stderr, "export: unknown scaling %s\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (IsSwitch(argv[i], "--timestamps") && i + 1 < argc)
+        {
+            szTimestampPath = argv[++i];
+        }
+        else if (IsSwitch(argv[i], "--realtime"))
+        {
+            pacing = ReplayPacing_RealTime;
+        }
+        else if (IsSwitch(argv[i], "--no-vad"))
+        {
+            bVoiceGate = false;
+        }
+        else if (nPaths < 2)
+        {
+            szPaths[nPaths++] = argv[i];
+        }
+    }
+
+    if (nPaths < 2)
+    {
+        fprintf(stderr, "export: missing recording or output path\n");
+        return 1;
+    }
+
+    RoiExporter exporter;
+    HRESULT hr = exporter.Open(szPaths[1], szTimestampPath, format, nWidth, nHeight, scaling);
+    if (FAILED(hr))
+    {
+        fprintf(stderr, "export: failed to create %s (0x%08x)\n", szPaths[1], static_cast<unsigned int>(hr));
+        return 1;
+    }
+
+    ReplayStats replayStats;
+    hr = RunReplay(szPaths[0], pacing, bVoiceGate, &exporter, &replayStats);
+
+    HRESULT hrClose = exporter.Close();
+    if (SUCCEEDED(hr))
+    {
+        hr = hrClose;
+    }
+
+    RoiExportStats stats;
+    exporter.GetStats(&stats);
+
+    double fElapsedSeconds = static_cast<double>(replayStats.nElapsedNs) / 1e9;
+
+    fprintf(stderr, "frames               %llu\n", static_cast<unsigned long long>(stats.nFrames));
+    fprintf(stderr, "frames with speaker  %llu\n", static_cast<unsigned long long>(stats.nSpeakerFrames));
+    fprintf(stderr, "output size          %dx%d\n", nWidth, nHeight);
+    fprintf(stderr, "bytes written        %llu in %llu writes\n", static_cast<unsigned long long>(stats.nBytesWritten), static_cast<unsigned long long>(stats.nWrites));
+    if (stats.nFrames > 0)
+    {
+        fprintf(stderr, "compose and convert  %.3f ms/frame\n", static_cast<double>(stats.nComposeNs) / stats.nFrames / 1e6);
+        fprintf(stderr, "write                %.3f ms/frame\n", static_cast<double>(stats.nWriteNs) / stats.nFrames / 1e6);
+    }
+    if (fElapsedSeconds > 0.0)
+    {
+        fprintf(stderr, "frames per second    %.2f\n", stats.nFrames / fElapsedSeconds);
+    }
+
+    if (FAILED(hr))
+    {
+        fprintf(stderr, "export: failed to export %s (0x%08x)\n", szPaths[0], static_cast<unsigned int>(hr));
+        return 1;
+    }
+
+    return 0;
+}
+
+/// <summary>
+/// Prints the progress of a batch to stderr: a line for every recording done, with its
+/// throughput, and in between the frames replayed so far
+/// </summary>
+/// <param name="pContext">unused</param>
+/// <param name="progress">where the batch stands</param>
+static void PrintBatchProgress(void* /* pContext */, const BatchProgress& progress)
+{
+    double fElapsedSeconds = progress.nElapsedNs / 1e9;
+
+    if (nullptr == progress.pFinished)
+    {
+        fprintf(stderr, "[%u/%u] %u running, %llu frames, %.1f frames per second\n", static_cast<unsigned int>(progress.nDone),
+            static_cast<unsigned int>(progress.nTotal), static_cast<unsigned int>(progress.nActive),
+            static_cast<unsigned long long>(progress.nFrames), (fElapsedSeconds > 0.0) ? progress.nFrames / fElapsedSeconds : 0.0);
+        return;
+    }
+
+    const BatchFileResult* pResult = progress.pFinished;
+    if (FAILED(pResult->hr))
+    {
+        fprintf(stderr, "[%u/%u] %s failed (0x%08x)\n", static_cast<unsigned int>(progress.nDone), static_cast<unsigned int>(progress.nTotal),
+            pResult->path.c_str(), static_cast<unsigned int>(pResult->hr));
+        return;
+    }
+
+    double fFileSeconds = pResult->nElapsedNs / 1e9;
+    fprintf(stderr, "[%u/%u] %s: %llu frames, %llu segments, %.1f frames per second, %.1fx real time\n",
+        static_cast<unsigned int>(progress.nDone), static_cast<unsigned int>(progress.nTotal), pResult->path.c_str(), static_cast<unsigned long long>(pResult->nFrames),
+        static_cast<unsigned long long>(pResult->nSegments), (fFileSeconds > 0.0) ? pResult->nFrames / fFileSeconds : 0.0,
+        (fFileSeconds > 0.0) ? pResult->nRecordedTicks / 1e7 / fFileSeconds : 0.0);
+}
+
+/// <summary>
+/// batch &lt;directory&gt; &lt;output directory&gt; [--format y4m|i420|bgra] [--size WxH]
+/// [--scaling nearest|bilinear|box|auto] [--workers N] [--no-crops] [--speaker-log] [--no-vad]
+/// [--mapping quadratic|geometric] [--decode-threads N]: replays every recording in a directory at maximum speed, several at once on a worker
+/// pool, and writes the speaker timeline and the speaker regions of each, and optionally
+/// its speaker log; progress goes to stderr. Encoded color is decoded on one thread per
+/// recording unless --decode-threads asks for more, 0 for one per hardware thread.
+/// </summary>
+/// <param name="argc">number of command arguments</param>
+/// <param name="argv">command arguments, starting after the command name</param>
+/// <returns>process exit code</returns>
+int BatchCommand(int argc, char** argv)
+{
+    const char* szPaths[2] = { nullptr, nullptr };
+    int nPaths = 0;
+    BatchOptions options;
+
+    for (int i = 0; i < argc; ++i)
+    {
+        if (IsSwitch(argv[i], "--format") && i + 1 < argc)
+        {
+            if (!ParseRoiExportFormat(argv[++i], &options.format))
+            {
+                fprintf(stderr, "batch: unknown format %s\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (IsSwitch(argv[i], "--size") && i + 1 < argc)
+        {
+            if (!ParseFrameSize(argv[++i], &options.nWidth, &options.nHeight))
+            {
+                fprintf(stderr, "batch: size must be WIDTHxHEIGHT, both even\n");
+                return 1;
+            }
+        }
+        else if (IsSwitch(argv[i], "--scaling") && i + 1 < argc)
+        {
+            if (!ParseScaleMethod(argv[++i], &options.scaling))
+            {
+                fprintf(stderr, "batch: unknown scaling %s\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (IsSwitch(argv[i], "--workers") && i + 1 < argc)
+        {
+            options.nWorkers = (std::max)(atoi(argv[++i]), 1);
+        }
+        else if (IsSwitch(argv[i], "--decode-threads") && i + 1 < argc)
+        {
+            options.nDecodeThreads = (std::max)(atoi(argv[++i]), 0);
+        }
+        else if (IsSwitch(argv[i], "--no-crops"))
+        {
+            options.bExportRois = false;
+        }
+        else if (IsSwitch(argv[i], "--speaker-log"))
+        {
+            options.bSpeakerLog = true;
+        }
+        else if (IsSwitch(argv[i], "--no-vad"))
+        {
+            options.bVoiceGate = false;
+        }
+        else if (IsSwitch(argv[i], "--mapping") && i + 1 < argc)
+        {
+            if (!ParseSpeakerAngleMapping(argv[++i], &options.angleMapping))
+            {
+                fprintf(stderr, "batch: unknown mapping %s\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (nPaths < 2)
+        {
+            szPaths[nPaths++] = argv[i];
+        }
+    }
+
+    if (nPaths < 2)
+    {
+        fprintf(stderr, "batch: missing recording or output directory\n");
+        return 1;
+    }
+
+    std::vector<std::string> recordings;
+    HRESULT hr = ListRecordings(szPaths[0], &recordings);
+    if (FAILED(hr))
+    {
+        fprintf(stderr, "batch: failed to list %s (0x%08x)\n", szPaths[0], static_cast<unsigned int>(hr));
+        return 1;
+    }
+
+    if (recordings.empty())
+    {
+        fprintf(stderr, "batch: no recordings in %s\n", szPaths[0]);
+        return 1;
+    }
+
+    options.outputDirectory = szPaths[1];
+
+    std::vector<BatchFileResult> results;
+    PipelineWorkerPoolStats poolStats;
+    memset(&poolStats, 0, sizeof(poolStats));
+
+    INT64 nStartNs = GetPerfClockNs();
+    hr = RunBatch(recordings, options, PrintBatchProgress, nullptr, &results, &poolStats);
+    double fWallSeconds = (GetPerfClockNs() - nStartNs) / 1e9;
+
+    UINT64 nFrames = 0;
+    INT64 nRecordedTicks = 0;
+    size_t nFailed = 0;
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        nFrames += results[i].nFrames;
+        nRecordedTicks += results[i].nRecordedTicks;
+        nFailed += FAILED(results[i].hr) ? 1 : 0;
+    }
+
+    fprintf(stderr, "recordings           %u, %u failed\n", static_cast<unsigned int>(results.size()), static_cast<unsigned int>(nFailed));
+    fprintf(stderr, "workers              %d\n", poolStats.nWorkers);
+    fprintf(stderr, "frames               %llu\n", static_cast<unsigned long long>(nFrames));
+    fprintf(stderr, "recorded time        %.1f s\n", nRecordedTicks / 1e7);
+    fprintf(stderr, "wall time            %.2f s\n", fWallSeconds);
+    if (fWallSeconds > 0.0)
+    {
+        fprintf(stderr, "frames per second    %.1f\n", nFrames / fWallSeconds);
+        fprintf(stderr, "speed                %.1fx real time\n", nRecordedTicks / 1e7 / fWallSeconds);
+        fprintf(stderr, "worker utilization   %.1f%%\n", 100.0 * poolStats.nBusyNs / (fWallSeconds * 1e9 * (std::max)(poolStats.nWorkers, 1)));
+    }
+
+    if (FAILED(hr))
+    {
+        fprintf(stderr, "batch: failed (0x%08x)\n", static_cast<unsigned int>(hr));
+        return 1;
+    }
+
+    return 0;
+}
+
+/// <summary>
+/// speaker-log &lt;log&gt; [--json]: writes a speaker log to stdout as CSV, or as JSON
+/// </summary>
+/// <param name="argc">number of command arguments</param>
+/// <param name="argv">command arguments, starting after the command name</param>
+/// <returns>process exit code</returns>
+int SpeakerLogCommand(int argc, char** argv)
+{
+    const char* szPath = nullptr;
+    bool bJson = false;
+
+    for (int i = 0; i < argc; ++i)
+    {
+        if (IsSwitch(argv[i], "--json"))
+        {
+            bJson = true;
+        }
+        else
+        {
+            szPath = argv[i];
+        }
+    }
+
+    if (nullptr == szPath)
+    {
+        fprintf(stderr, "speaker-log: missing log path\n");
+        return 1;
+    }
+
+    UINT64 nRecords;
+    HRESULT hr = ConvertSpeakerLog(szPath, bJson, stdout, &nRecords);
+    if (FAILED(hr))
+    {
+        fprintf(stderr, "speaker-log: failed to convert %s after %llu records (0x%08x)\n", szPath,
+            static_cast<unsigned long long>(nRecords), static_cast<unsigned int>(hr));
+        return 1;
+    }
+
+    return 0;
+}
+
+/// <summary>
+/// session-index &lt;recording&gt;...: appends a frame index to recordings written before
+/// recordings were indexed, so that they open without walking every record
+/// </summary>
+/// <param name="argc">number of command arguments</param>
+/// <param name="argv">command arguments, starting after the command name</param>
+/// <returns>process exit code</returns>
+int SessionIndexCommand(int argc, char** argv)
+{
+    if (argc < 1)
+    {
+        fprintf(stderr, "session-index: missing recording path\n");
+        return 1;
+    }
+
+    int nFailed = 0;
+
+    for (int i = 0; i < argc; ++i)
+    {
+        UINT64 nFrames = 0;
+        HRESULT hr = AppendSessionIndex(argv[i], &nFrames);
+
+        if (S_OK == hr)
+        {
+            printf("%s: indexed %llu frames\n", argv[i], static_cast<unsigned long long>(nFrames));
+        }
+        else if (S_FALSE == hr)
+        {
+            printf("%s: already indexed, %llu frames\n", argv[i], static_cast<unsigned long long>(nFrames));
+        }
+        else
+        {
+            fprintf(stderr, "session-index: failed to index %s (0x%08x)\n", argv[i], static_cast<unsigned int>(hr));
+            nFailed++;
+        }
+    }
+
+    return (0 == nFailed) ? 0 : 1;
+}
+
+/// <summary>
+/// Writes a copy of a recording with its color frames decoded, and encoded again with
+/// a codec or stored as they are
+/// </summary>
+/// <param name="szSource">recording to copy</param>
+/// <param name="szPath">path of the copy</param>
+/// <param name="pColorCodec">how the color frames of the copy are encoded, null to store them as they are</param>
+/// <param name="pStats">optional; receives the counters of the encoder</param>
+/// <returns>indicates success or failure</returns>
+static HRESULT CopyRecording(const char* szSource, const char* szPath, const FrameCodecOptions* pColorCodec, FrameCodecStats* pStats)
+{
+    SessionReplaySource* pSource = new SessionReplaySource();
+    HRESULT hr = pSource->Open(szSource, ReplayPacing_MaxSpeed);
+
+    SessionWriter writer;
+    if (SUCCEEDED(hr))
+    {
+        const SessionFileHeader& header = pSource->GetHeader();
+        hr = writer.Open(szPath, header.nColorWidth, header.nColorHeight, header.nAudioSamplesPerSecond, pColorCodec);
+    }
+
+    // the frames are re-encoded here rather than in the writer, to count what encoding takes
+    FrameEncoder* pEncoder = pColorCodec ? new FrameEncoder(*pColorCodec) : nullptr;
+    SessionFrame frame;
+    std::vector<AudioChunk> audio;
+
+    while (SUCCEEDED(hr) && S_OK == (hr = pSource->ReadNextFrame(&frame, &audio)))
+    {
+        for (size_t j = 0; SUCCEEDED(hr) && j < audio.size(); ++j)
+        {
+            const AudioChunk& chunk = audio[j];
+            hr = writer.WriteAudio(chunk.nTime, chunk.samples.empty() ? nullptr : &chunk.samples[0],
+                static_cast<UINT>(chunk.samples.size()), chunk.fBeamAngle, chunk.fBeamAngleConfidence);
+        }
+
+        if (SUCCEEDED(hr) && pEncoder && (ColorImageFormat_Yuy2 == frame.colorFormat || ColorImageFormat_Bgra == frame.colorFormat))
+        {
+            hr = pEncoder->Encode(frame.colorFormat, frame.nColorHeight, frame.nColorStride, frame.pColorBuffer, &frame.pColorBuffer, &frame.cbColorBuffer);
+            frame.bColorEncoded = true;
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            hr = writer.WriteFrame(&frame);
+        }
+    }
+
+    if (pStats)
+    {
+        memset(pStats, 0, sizeof(*pStats));
+        if (pEncoder)
+        {
+            *pStats = pEncoder->GetStats();
+        }
+    }
+
+    HRESULT hrClose = writer.Close();
+    delete pEncoder;
+    delete pSource;
+
+    return FAILED(hr) ? hr : hrClose;
+}
+
+/// <summary>
+/// Size of a recording, 0 if it cannot be opened
+/// </summary>
+/// <param name="szPath">path of the recording</param>
+/// <returns>size in bytes</returns>
+static UINT64 GetRecordingSize(const char* szPath)
+{
+    MappedSession session;
+    if (SUCCEEDED(session.Open(szPath)))
+    {
+        return session.GetFileSize();
+    }
+
+    return 0;
+}
+
+/// <summary>
+/// session-encode &lt;recording&gt; &lt;output&gt; [--raw] [--max-error N] [--threads N]:
+/// writes a copy of a recording with its color frames encoded losslessly, with at most
+/// the given error, or with --raw decoded and stored as they are. Everything other than
+/// the color frames is copied as it is, except for audio recorded after the last frame.
+/// </summary>
+/// <param name="argc">number of command arguments</param>
+/// <param name="argv">command arguments, starting after the command name</param>
+/// <returns>process exit code</returns>
+int SessionEncodeCommand(int argc, char** argv)
+{
+    const char* szPaths[2] = { nullptr, nullptr };
+    int nPaths = 0;
+    bool bRaw = false;
+    FrameCodecOptions codec;
+
+    for (int i = 0; i < argc; ++i)
+    {
+        if (IsSwitch(argv[i], "--raw"))
+        {
+            bRaw = true;
+        }
+        else if (IsSwitch(argv[i], "--max-error") && i + 1 < argc)
+        {
+            codec.nMaxError = (std::min)((std::max)(atoi(argv[++i]), 0), 127);
+        }
+        else if (IsSwitch(argv[i], "--threads") && i + 1 < argc)
+        {
+            codec.nThreads = (std::max)(atoi(argv[++i]), 0);
+        }
+        else if (nPaths < 2)
+        {
+            szPaths[nPaths++] = argv[i];
+        }
+    }
+
+    if (nPaths < 2)
+    {
+        fprintf(stderr, "session-encode: missing recording or output path\n");
+        return 1;
+    }
+
+    FrameCodecStats stats;
+    INT64 nStartNs = GetPerfClockNs();
+    HRESULT hr = CopyRecording(szPaths[0], szPaths[1], bRaw ? nullptr : &codec, &stats);
+    double fSeconds = (GetPerfClockNs() - nStartNs) / 1e9;
+
+    if (FAILED(hr))
+    {
+        fprintf(stderr, "session-encode: failed to copy %s to %s (0x%08x)\n", szPaths[0], szPaths[1], static_cast<unsigned int>(hr));
+        return 1;
+    }
+
+    UINT64 cbSource = GetRecordingSize(szPaths[0]);
+    UINT64 cbCopy = GetRecordingSize(szPaths[1]);
+    printf("%s: %.1f MB to %.1f MB (%.2f:1) in %.1f s\n", szPaths[1], cbSource / 1e6, cbCopy / 1e6,
+        (cbCopy > 0) ? static_cast<double>(cbSource) / cbCopy : 0.0, fSeconds);
+
+    if (stats.nFrames > 0)
+    {
+        printf("color: %llu frames, %llu key frames, %.2f:1, encoded at %.0f MB/s on %.0f MB/s per core\n",
+            static_cast<unsigned long long>(stats.nFrames), static_cast<unsigned long long>(stats.nKeyFrames),
+            static_cast<double>(stats.cbDecoded) / stats.cbEncoded, stats.cbDecoded * 1e3 / stats.nWallNs,
+            stats.cbDecoded * 1e3 / (std::max)(stats.nTileNs, static_cast<INT64>(1)));
+    }
+
+    return 0;
+}
+
+/// <summary>
+/// Places a tracked face with a result in a synthetic frame
+/// </summary>
+/// <param name="pFace">face to fill in</param>
+/// <param name="nLeft">left of the face box</param>
+/// <param name="nTop">top of the face box</param>
+void MakeBenchFace(FaceSample* pFace, int nLeft, int nTop)
+{
+    const int nFaceWidth = 180;
+    const int nFaceHeight = 220;
+
+    memset(pFace, 0, sizeof(*pFace));
+    pFace->bTracked = TRUE;
+    pFace->bHaveResult = TRUE;
+    pFace->faceBox.Left = nLeft;
+    pFace->faceBox.Top = nTop;
+    pFace->faceBox.Right = nLeft + nFaceWidth;
+    pFace->faceBox.Bottom = nTop + nFaceHeight;
+
+    for (int i = 0; i < FacePointType_Count; ++i)
+    {
+        pFace->facePoints[i].X = static_cast<float>(nLeft + nFaceWidth / 4 + i * nFaceWidth / 10);
+        pFace->facePoints[i].Y = static_cast<float>(nTop + nFaceHeight / 3 + i * nFaceHeight / 10);
+    }
+}
@@ -0,0 +1,337 @@
+//------------------------------------------------------------------------------
+// <copyright file="ToolCommands.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Console tool commands, dispatched by RunToolCommand in CommandLine.cpp. The commands
+// working on recordings live in ToolCommands.cpp; the benchmarks and stress tests live
+// in a Bench*.cpp source named after the module they exercise.
+
+#pragma once
+
+#include <stdio.h>
+#include "KinectTypes.h"
+#include "SessionRecording.h"
+
+// Helpers shared by the commands
+
+/// <summary>
+/// Opens a file with the C runtime
+/// </summary>
+/// <param name="szPath">path of the file</param>
+/// <param name="szMode">fopen style mode string</param>
+/// <returns>the open file or nullptr on failure</returns>
+FILE* OpenFile(const char* szPath, const char* szMode);
+
+/// <summary>
+/// Whether an argument matches the given switch
+/// </summary>
+/// <param name="szArg">argument</param>
+/// <param name="szSwitch">switch including its dashes</param>
+/// <returns>true on a match</returns>
+bool IsSwitch(const char* szArg, const char* szSwitch);
+
+/// <summary>
+/// Parses a frame size given as WIDTHxHEIGHT
+/// </summary>
+/// <param name="szSize">size argument</param>
+/// <param name="pnWidth">receives the width</param>
+/// <param name="pnHeight">receives the height</param>
+/// <returns>false unless both are positive and even</returns>
+bool ParseFrameSize(const char* szSize, int* pnWidth, int* pnHeight);
+
+/// <summary>
+/// Places a tracked face with a result in a synthetic frame
+/// </summary>
+/// <param name="pFace">face to fill in</param>
+/// <param name="nLeft">left of the face box</param>
+/// <param name="nTop">top of the face box</param>
+void MakeBenchFace(FaceSample* pFace, int nLeft, int nTop);
+
+// Commands working on recordings, in ToolCommands.cpp
+
+/// <summary>
+/// replay &lt;recording&gt; [--realtime] [--no-vad]: replays a recording through speaker
+/// selection
+/// </summary>
+/// <param name="argc">number of command arguments</param>
+/// <param name="argv">command arguments, starting after the command name</param>
+/// <returns>process exit code</returns>
+int ReplayCommand(int argc, char** argv);
+
+/// <summary>
+/// export &lt;recording&gt; &lt;output|-&gt; [--format y4m|i420|bgra] [--size WxH]
+/// [--scaling nearest|bilinear|box|auto] [--timestamps file] [--realtime] [--no-vad]: writes the speaker regions of a recording as a video
+/// stream; the report goes to stderr since the stream may be on stdout
+/// </summary>
+/// <param name="argc">number of command arguments</param>
+/// <param name="argv">command arguments, starting after the command name</param>
+/// <returns>process exit code</returns>
+int ExportCommand(int argc, char** argv);
+
+/// <summary>
+/// batch &lt;directory&gt; &lt;output directory&gt; [--format y4m|i420|bgra] [--size WxH]
+/// [--scaling nearest|bilinear|box|auto] [--workers N] [--no-crops] [--speaker-log] [--no-vad]
+/// [--mapping quadratic|geometric]: replays every recording in a directory at maximum speed, several at once on a worker
+/// pool, and writes the speaker timeline and the speaker regions of each, and optionally
+/// its speaker log; progress goes to stderr
+/// </summary>
+/// <param name="argc">number of command arguments</param>
+/// <param name="argv">command arguments, starting after the command name</param>
+/// <returns>process exit code</returns>
+int BatchCommand(int argc, char** argv);
+
+/// <summary>
+/// speaker-log &lt;log&gt; [--json]: writes a speaker log to stdout as CSV, or as JSON
+/// </summary>
+/// <param name="argc">number of command arguments</param>
+/// <param name="argv">command arguments, starting after the command name</param>
+/// <returns>process exit code</returns>
+int SpeakerLogCommand(int argc, char** argv);
+
+/// <summary>
+/// session-index &lt;recording&gt;...: appends a frame index to recordings written before
+/// recordings were indexed, so that they open without walking every record
+/// </summary>
+/// <param name="argc">number of command arguments</param>
+/// <param name="argv">command arguments, starting after the command name</param>
+/// <returns>process exit code</returns>
+int SessionIndexCommand(int argc, char** argv);
+
+/// <summary>
+/// session-encode &lt;recording&gt; &lt;output&gt; [--raw] [--max-error N] [--threads N]:
+/// writes a copy of a recording with its color frames encoded losslessly, with at most
+/// the given error, or with --raw decoded and stored as they are. Everything other than
+/// the color frames is copied as it is, except for audio recorded after the last frame.
+/// </summary>
+/// <param name="argc">number of command arguments</param>
+/// <param name="argv">command arguments, starting after the command name</param>
+/// <returns>process exit code</returns>
+int SessionEncodeCommand(int argc, char** argv);
+
+// Benchmarks and stress tests, in the Bench*.cpp sources
+
+/// <summary>
+/// speaker-log-bench [--seconds N] [--faces N] [--output file]: measures the sustained
+/// throughput of the speaker log with one thread appending as fast as it can, then the
+/// time appending adds to a frame loop logging N speakers in every frame at 30 frames per
+/// second, against writing every record with the C runtime right away. Checks that the
+/// frame loop lost no record and that the logs read back whole and in order.
+/// </summary>
+/// <param name="argc">number of command arguments</param>
+/// <param name="argv">command arguments, starting after the command name</param>
+/// <returns>process exit code</returns>
+int SpeakerLogBenchCommand(int argc, char** argv);
+
+/// <summary>
+/// session-bench &lt;recording&gt; [--seeks N] [--synthesize GB] [--output file]: measures
+/// opening a mapped recording, reading it from start to end mapped against reading it
+/// record by record, and seeking to random times through the index against reading up
+/// to the time. With --synthesize the recording is first repeated into a new one of the
+/// given size, which is removed afterwards. Checks that both ways of reading yield the
+/// same frames, and that every seek lands on the last frame at or before its time.
+/// Reads go through the page cache, so a recording read recently measures memory
+/// rather than the disk.
+/// </summary>
+/// <param name="argc">number of command arguments</param>
+/// <param name="argv">command arguments, starting after the command name</param>
+/// <returns>process exit code</returns>
+int SessionBenchCommand(int argc, char** argv);
+
+/// <summary>
+/// codec-bench [recording] [--frames N] [--max-error N] [--threads N] [--keyframe N]:
+/// encodes and decodes color frames, those of a recording or of a synthetic 1080p YUY2
+/// scene, losslessly and with the given maximum error, on one thread and on the given
+/// number of threads. Reports the compression ratio and the encode and decode rates in
+/// MB of frames per second, both per core and on the wall clock, against the 30 frames
+/// per second of the sensor. Checks that lossless coding decodes every byte and that
+/// no byte of near-lossless coding is off by more than the maximum error.
+/// </summary>
+/// <param name="argc">number of command arguments</param>
+/// <param name="argv">command arguments, starting after the command name</param>
+/// <returns>process exit code</returns>
+int CodecBenchCommand(int argc, char** argv);
+
+/// <summary>
+/// ring-stress [--seconds N] [--consumer-ms N]: checks the energy ring for loss and tearing
+/// with a producer at the real energy rate against a slow consumer, then with an unpaced
+/// producer where drops are expected but must be accounted for
+/// </summary>
+/// <param name="argc">number of command arguments</param>
+/// <param name="argv">command arguments, starting after the command name</param>
+/// <returns>process exit code</returns>
+int RingStressCommand(int argc, char** argv);
+
+/// <summary>
+/// audio-capture [--seconds N] [--stall-ms N]: runs the audio capture thread on simulated
+/// audio while the video side stalls every second, and checks that no energy was lost
+/// </summary>
+/// <param name="argc">number of command arguments</param>
+/// <param name="argv">command arguments, starting after the command name</param>
+/// <returns>process exit code</returns>
+int AudioCaptureCommand(int argc, char** argv);
+
+/// <summary>
+/// energy-bench [--seconds N] [--iterations N]: checks the energy kernels against the original
+/// scalar loop, then measures their throughput on the application's read size
+/// </summary>
+/// <param name="argc">number of command arguments</param>
+/// <param name="argv">command arguments, starting after the command name</param>
+/// <returns>process exit code</returns>
+int EnergyBenchCommand(int argc, char** argv);
+
+/// <summary>
+/// roi-bench [--frames N] [--speakers N]: compares the bytes moved and the time spent per
+/// frame transferring the full color frame against transferring only the speaker regions
+/// </summary>
+/// <param name="argc">number of command arguments</param>
+/// <param name="argv">command arguments, starting after the command name</param>
+/// <returns>process exit code</returns>
+int RoiBenchCommand(int argc, char** argv);
+
+/// <summary>
+/// mosaic-bench [--frames N]: checks the speaker mosaic for every number of speakers and
+/// compares its cost against stretching each speaker region over the full frame
+/// </summary>
+/// <param name="argc">number of command arguments</param>
+/// <param name="argv">command arguments, starting after the command name</param>
+/// <returns>process exit code</returns>
+int MosaicBenchCommand(int argc, char** argv);
+
+/// <summary>
+/// beam-map-bench [--frames N] [--iterations N] [recording ...]: compares speaker
+/// selection with the hand-fit quadratic against the geometric head joint mapping, on a
+/// synthetic session with known speakers and on every recording given, and checks the
+/// face batch kernels against the per-face functions on all of them. The synthetic
+/// session shares the geometric mapping's model of the scene, so only the recordings
+/// tell which mapping matches the sensor.
+/// </summary>
+/// <param name="argc">number of command arguments</param>
+/// <param name="argv">command arguments, starting after the command name</param>
+/// <returns>process exit code</returns>
+int BeamMapBenchCommand(int argc, char** argv);
+
+/// <summary>
+/// beam-align-bench [--frames N] [recording ...]: compares speaker selection under the
+/// beam state of the latest audio read against the beam state at the time of each color
+/// frame, counting how often the wrong speaker is shown around turn changes, on a
+/// synthetic session with known turns and on every recording given
+/// </summary>
+/// <param name="argc">number of command arguments</param>
+/// <param name="argv">command arguments, starting after the command name</param>
+/// <returns>process exit code</returns>
+int BeamAlignBenchCommand(int argc, char** argv);
+
+/// <summary>
+/// vad-bench [--seconds N] [--iterations N] [recording ...]: checks the voice activity
+/// kernels against each other, measures their cost per 10 ms hop, and measures how often
+/// voice is found in a synthetic scene of speech among fan noise, doors and typing, and
+/// how often it gates the speakers the beam picks in every recording given
+/// </summary>
+/// <param name="argc">number of command arguments</param>
+/// <param name="argv">command arguments, starting after the command name</param>
+/// <returns>process exit code</returns>
+int VadBenchCommand(int argc, char** argv);
+
+/// <summary>
+/// yuy2-bench [--iterations N]: checks every color kernel against the scalar kernel and a
+/// floating point reference on synthetic frames, then measures them per megapixel on the
+/// full frame and on a speaker sized region
+/// </summary>
+/// <param name="argc">number of command arguments</param>
+/// <param name="argv">command arguments, starting after the command name</param>
+/// <returns>process exit code</returns>
+int Yuy2BenchCommand(int argc, char** argv);
+
+/// <summary>
+/// scale-bench [--iterations N]: checks the resampling kernels against each other and
+/// against a double precision reference, and measures their throughput enlarging a small
+/// face, shrinking a large one to a model input, and making three sizes of one region in
+/// one pass rather than three
+/// </summary>
+/// <param name="argc">number of command arguments</param>
+/// <param name="argv">command arguments, starting after the command name</param>
+/// <returns>process exit code</returns>
+int ScaleBenchCommand(int argc, char** argv);
+
+/// <summary>
+/// acquisition-bench [--seconds N] [--fps N] [recording]: measures the CPU use and the time
+/// from frame arrival to the end of its processing of the polling and of the event driven
+/// loop, then replays the recording, if any, in real time through the event driven loop
+/// </summary>
+/// <param name="argc">number of command arguments</param>
+/// <param name="argv">command arguments, starting after the command name</param>
+/// <returns>process exit code</returns>
+int AcquisitionBenchCommand(int argc, char** argv);
+
+/// <summary>
+/// pipeline-bench &lt;recording&gt; [--depth N] [--present-ms N] [--large-pages]: replays a
+/// recording through the serial and the threaded speaker pipeline, as fast as possible to
+/// compare the throughput and in real time to compare the latency from frame arrival to
+/// presentation; also reports the latency of every stage and checks that timing them
+/// costs under 1% of the work per frame
+/// </summary>
+/// <param name="argc">number of command arguments</param>
+/// <param name="argv">command arguments, starting after the command name</param>
+/// <returns>process exit code</returns>
+int PipelineBenchCommand(int argc, char** argv);
+
+/// <summary>
+/// multi-bench &lt;recording&gt; [--pipelines N] [--workers N]: replays a recording at
+/// maximum speed through 1, 2, 4 ... N independent pipelines at once, every one with a
+/// source of its own, first on a worker pool sized to the machine and then as threaded
+/// pipelines with three stage threads each. Reports the aggregate frames per second and
+/// the scaling over one pipeline, and checks that every pipeline decides as one alone does.
+/// </summary>
+/// <param name="argc">number of command arguments</param>
+/// <param name="argv">command arguments, starting after the command name</param>
+/// <returns>process exit code</returns>
+int MultiBenchCommand(int argc, char** argv);
+
+/// <summary>
+/// lazy-bench &lt;recording&gt; [--idle-preview N]: replays a recording through the serial
+/// pipeline with every stream of every frame acquired and converted, then with acquisition
+/// following demand; once with the voice gate, which makes a recording without speech an
+/// idle room, and once without. Reports the stage time per frame and the work done and
+/// skipped, and checks that no speaker decision changes.
+/// </summary>
+/// <param name="argc">number of command arguments</param>
+/// <param name="argv">command arguments, starting after the command name</param>
+/// <returns>process exit code</returns>
+int LazyBenchCommand(int argc, char** argv);
+
+/// <summary>
+/// preview-bench &lt;recording&gt; [--idle-preview N]: replays a recording through the
+/// serial pipeline with the background converted at full and at half resolution, once
+/// with the voice gate, which makes a recording without speech an idle room, and once
+/// without. Reports the stage time and conversion latency per frame and the background
+/// bytes presented, and checks that the speaker decisions and the speaker regions, which
+/// are converted at full resolution either way, do not change.
+/// </summary>
+/// <param name="argc">number of command arguments</param>
+/// <param name="argv">command arguments, starting after the command name</param>
+/// <returns>process exit code</returns>
+int PreviewBenchCommand(int argc, char** argv);
+
+/// <summary>
+/// pool-stress [--seconds N] [--large-pages]: fills pooled buffers as fast as the pool
+/// hands them out and shares every one between a fast and a slow consumer, checking that
+/// no buffer is reused while referenced, that every buffer is aligned, and that all of
+/// them are back in the pool at the end
+/// </summary>
+/// <param name="argc">number of command arguments</param>
+/// <param name="argv">command arguments, starting after the command name</param>
+/// <returns>process exit code</returns>
+int PoolStressCommand(int argc, char** argv);
+
+/// <summary>
+/// kernel-bench [--filter S] [--min-ms N] [--batches N] [--json file] [--baseline file]
+/// [--tolerance PCT]: times the per-frame and per-chunk kernels of the speaker pipeline on
+/// synthetic data, optionally writing the results as JSON and comparing them against a
+/// baseline written the same way; fails if any kernel slowed down beyond the tolerance
+/// </summary>
+/// <param name="argc">number of command arguments</param>
+/// <param name="argv">command arguments, starting after the command name</param>
+/// <returns>process exit code</returns>
+int KernelBenchCommand(int argc, char** argv);
@@ -0,0 +1,381 @@
+//------------------------------------------------------------------------------
+// <copyright file="VoiceActivity.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "KinectTypes.h"
+#include <math.h>
+#include <algorithm>
+#include <string.h>
+#include "CpuFeatures.h"
+#include "AudioEnergy.h"
+#include "VoiceActivity.h"
+
+// Edges of the filter bands in Hz: 300-800 and 800-1800 hold the first formants,
+// 1800-3400 the upper ones, and 4500-7000 is the reference band above speech
+static const float c_VadBandEdgesHz[c_VadBands][2] =
+{
+    { 300.0f, 800.0f },
+    { 800.0f, 1800.0f },
+    { 1800.0f, 3400.0f },
+    { 4500.0f, 7000.0f },
+};
+
+// Mean level of the speech bands above their noise floors a speech-like hop reaches, in dB
+static const float c_VadMinSpeechToNoiseDb = 6.0f;
+
+// Most the reference band may stand out of its floor, as a share of how much the speech
+// bands stand out of theirs; broadband sound raises all four bands alike
+static const float c_VadMaxReferenceShare = 0.5f;
+
+// Mean level of the speech bands above their noise floors from which a hop that fails
+// the reference test is a loud broadband sound rather than a hiss within speech, in dB
+static const float c_VadMinBroadbandDb = 12.0f;
+
+// Mean level of the speech bands below which a hop is never speech-like, in dB full scale
+static const float c_VadMinSpeechLevelDb = -65.0f;
+
+// Range the mean level of the speech bands spans over the latest c_VadModulationHops for
+// a hop to be speech-like, in dB; noise steady enough for its floor to be tracked spans
+// a few dB, speech at a usable level spans its whole signal to noise ratio
+static const float c_VadMinModulationDb = 6.0f;
+
+// Share of the distance to the hop level the noise floor moves by per hop when falling
+// and when rising. The floor drops into every pause between syllables, so that speech
+// hardly raises it while noise that came on is taken in within a second or two.
+static const float c_VadFloorFallRate = 0.2f;
+static const float c_VadFloorRiseRate = 0.01f;
+
+// Filter states smaller than this are flushed to zero at the end of each hop, so that
+// a decaying filter never goes through denormals, which are very slow on x86
+static const float c_VadMinFilterState = 1e-15f;
+
+// Each band is two identical band-pass biquads in cascade, in transposed direct form II
+// with b1 = 0. The coefficients are stored as rows b0, b2, a1, a2 and the state as rows
+// s1, s2 of the first section then s1, s2 of the second, each row holding one value per
+// band, so that one SSE register runs the four bands at once.
+enum VadRow
+{
+    VadRow_B0 = 0,
+    VadRow_B2 = 1,
+    VadRow_A1 = 2,
+    VadRow_A2 = 3,
+
+    VadRow_S1 = 0,
+    VadRow_S2 = 1,
+    VadRow_T1 = 2,
+    VadRow_T2 = 3
+};
+
+/// <summary>
+/// Filter bank kernel, one band at a time
+/// </summary>
+static void FilterBandsScalar(const float* pCoefficients, float* pState, const float* pSamples, UINT nSampleCount, float* pEnergy)
+{
+    for (int iBand = 0; iBand < c_VadBands; ++iBand)
+    {
+        float b0 = pCoefficients[VadRow_B0 * c_VadBands + iBand];
+        float b2 = pCoefficients[VadRow_B2 * c_VadBands + iBand];
+        float a1 = pCoefficients[VadRow_A1 * c_VadBands + iBand];
+        float a2 = pCoefficients[VadRow_A2 * c_VadBands + iBand];
+        float s1 = pState[VadRow_S1 * c_VadBands + iBand];
+        float s2 = pState[VadRow_S2 * c_VadBands + iBand];
+        float t1 = pState[VadRow_T1 * c_VadBands + iBand];
+        float t2 = pState[VadRow_T2 * c_VadBands + iBand];
+        float fEnergy = pEnergy[iBand];
+
+        for (UINT i = 0; i < nSampleCount; ++i)
+        {
+            float x = pSamples[i];
+            float y = b0 * x + s1;
+            s1 = s2 - a1 * y;
+            s2 = b2 * x - a2 * y;
+
+            float z = b0 * y + t1;
+            t1 = t2 - a1 * z;
+            t2 = b2 * y - a2 * z;
+
+            fEnergy += z * z;
+        }
+
+        pState[VadRow_S1 * c_VadBands + iBand] = s1;
+        pState[VadRow_S2 * c_VadBands + iBand] = s2;
+        pState[VadRow_T1 * c_VadBands + iBand] = t1;
+        pState[VadRow_T2 * c_VadBands + iBand] = t2;
+        pEnergy[iBand] = fEnergy;
+    }
+}
+
+#if defined(CPU_X86)
+
+/// <summary>
+/// Filter bank kernel, the four bands in the lanes of one register; the same operations
+/// in the same order as the scalar kernel, lane by lane
+/// </summary>
+static void FilterBandsSse(const float* pCoefficients, float* pState, const float* pSamples, UINT nSampleCount, float* pEnergy)
+{
+    __m128 b0 = _mm_loadu_ps(pCoefficients + VadRow_B0 * c_VadBands);
+    __m128 b2 = _mm_loadu_ps(pCoefficients + VadRow_B2 * c_VadBands);
+    __m128 a1 = _mm_loadu_ps(pCoefficients + VadRow_A1 * c_VadBands);
+    __m128 a2 = _mm_loadu_ps(pCoefficients + VadRow_A2 * c_VadBands);
+    __m128 s1 = _mm_loadu_ps(pState + VadRow_S1 * c_VadBands);
+    __m128 s2 = _mm_loadu_ps(pState + VadRow_S2 * c_VadBands);
+    __m128 t1 = _mm_loadu_ps(pState + VadRow_T1 * c_VadBands);
+    __m128 t2 = _mm_loadu_ps(pState + VadRow_T2 * c_VadBands);
+    __m128 energy = _mm_loadu_ps(pEnergy);
+
+    for (UINT i = 0; i < nSampleCount; ++i)
+    {
+        __m128 x = _mm_set1_ps(pSamples[i]);
+        __m128 y = _mm_add_ps(_mm_mul_ps(b0, x), s1);
+        s1 = _mm_sub_ps(s2, _mm_mul_ps(a1, y));
+        s2 = _mm_sub_ps(_mm_mul_ps(b2, x), _mm_mul_ps(a2, y));
+
+        __m128 z = _mm_add_ps(_mm_mul_ps(b0, y), t1);
+        t1 = _mm_sub_ps(t2, _mm_mul_ps(a1, z));
+        t2 = _mm_sub_ps(_mm_mul_ps(b2, y), _mm_mul_ps(a2, z));
+
+        energy = _mm_add_ps(energy, _mm_mul_ps(z, z));
+    }
+
+    _mm_storeu_ps(pState + VadRow_S1 * c_VadBands, s1);
+    _mm_storeu_ps(pState + VadRow_S2 * c_VadBands, s2);
+    _mm_storeu_ps(pState + VadRow_T1 * c_VadBands, t1);
+    _mm_storeu_ps(pState + VadRow_T2 * c_VadBands, t2);
+    _mm_storeu_ps(pEnergy, energy);
+}
+
+#endif
+
+/// <summary>
+/// Runs samples through the filter bank with the given kernel
+/// </summary>
+static void FilterBands(VadKernel kernel, const float* pCoefficients, float* pState, const float* pSamples, UINT nSampleCount, float* pEnergy)
+{
+    switch (kernel)
+    {
+#if defined(CPU_X86)
+    case VadKernel_Sse:
+        FilterBandsSse(pCoefficients, pState, pSamples, nSampleCount, pEnergy);
+        break;
+#endif
+
+    default:
+        FilterBandsScalar(pCoefficients, pState, pSamples, nSampleCount, pEnergy);
+        break;
+    }
+}
+
+/// <summary>
+/// Fastest filter bank kernel the processor supports
+/// </summary>
+VadKernel GetBestVadKernel()
+{
+    static const VadKernel s_kernel =
+        IsVadKernelSupported(VadKernel_Sse) ? VadKernel_Sse :
+        VadKernel_Scalar;
+
+    return s_kernel;
+}
+
+/// <summary>
+/// Whether the processor supports a filter bank kernel
+/// </summary>
+/// <param name="kernel">kernel to check</param>
+bool IsVadKernelSupported(VadKernel kernel)
+{
+    switch (kernel)
+    {
+    case VadKernel_Scalar:
+        return true;
+
+#if defined(CPU_X86)
+    case VadKernel_Sse:
+        return CpuHasSse2();
+#endif
+
+    default:
+        return false;
+    }
+}
+
+/// <summary>
+/// Short name of a filter bank kernel, for reports
+/// </summary>
+/// <param name="kernel">kernel to name</param>
+const char* GetVadKernelName(VadKernel kernel)
+{
+    static const char* c_szNames[VadKernel_Count] = { "scalar", "sse" };
+    return (kernel >= 0 && kernel < VadKernel_Count) ? c_szNames[kernel] : "unknown";
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+/// <param name="kernel">filter bank kernel to use; must be supported</param>
+VoiceActivityDetector::VoiceActivityDetector(VadKernel kernel) :
+    m_kernel(kernel)
+{
+    // band-pass biquads with 0dB gain at the center of the band (Robert Bristow-Johnson's
+    // audio EQ cookbook), centered on the geometric mean of the edges
+    for (int iBand = 0; iBand < c_VadBands; ++iBand)
+    {
+        double fLow = c_VadBandEdgesHz[iBand][0];
+        double fHigh = c_VadBandEdgesHz[iBand][1];
+        double fCenter = sqrt(fLow * fHigh);
+        double fQ = fCenter / (fHigh - fLow);
+        double fOmega = 2.0 * M_PI * fCenter / c_AudioSamplesPerSecond;
+        double fAlpha = sin(fOmega) / (2.0 * fQ);
+        double fA0 = 1.0 + fAlpha;
+
+        m_fCoefficients[VadRow_B0 * c_VadBands + iBand] = static_cast<float>(fAlpha / fA0);
+        m_fCoefficients[VadRow_B2 * c_VadBands + iBand] = static_cast<float>(-fAlpha / fA0);
+        m_fCoefficients[VadRow_A1 * c_VadBands + iBand] = static_cast<float>(-2.0 * cos(fOmega) / fA0);
+        m_fCoefficients[VadRow_A2 * c_VadBands + iBand] = static_cast<float>((1.0 - fAlpha) / fA0);
+    }
+
+    Reset();
+}
+
+/// <summary>
+/// Forgets the audio and the noise floors seen so far, as for a new session
+/// </summary>
+void VoiceActivityDetector::Reset()
+{
+    memset(m_fState, 0, sizeof(m_fState));
+    memset(m_fHopEnergy, 0, sizeof(m_fHopEnergy));
+    memset(m_fNoiseFloorDb, 0, sizeof(m_fNoiseFloorDb));
+    memset(m_fSpeechLevelDb, 0, sizeof(m_fSpeechLevelDb));
+    m_iSpeechLevel = 0;
+    memset(&m_stats, 0, sizeof(m_stats));
+    m_nHopSamples = 0;
+    m_nSpeechRun = 0;
+    m_bBroadbandTail = false;
+    m_nHangoverHops = 0;
+    m_fSpeechToNoiseDb = 0.0f;
+}
+
+/// <summary>
+/// Runs audio through the detector; a partial hop carries over to the next call
+/// </summary>
+/// <param name="pSamples">beam audio samples</param>
+/// <param name="nSampleCount">number of samples</param>
+/// <returns>number of hops completed</returns>
+UINT VoiceActivityDetector::Process(const float* pSamples, UINT nSampleCount)
+{
+    UINT nHops = 0;
+
+    while (nSampleCount > 0)
+    {
+        UINT nTake = (std::min)(nSampleCount, c_VadHopSamples - m_nHopSamples);
+        FilterBands(m_kernel, m_fCoefficients, m_fState, pSamples, nTake, m_fHopEnergy);
+
+        pSamples += nTake;
+        nSampleCount -= nTake;
+        m_nHopSamples += nTake;
+
+        if (m_nHopSamples == c_VadHopSamples)
+        {
+            EndHop();
+            nHops++;
+        }
+    }
+
+    return nHops;
+}
+
+/// <summary>
+/// Updates the noise floors and the voice state from the band energies of a whole hop
+/// </summary>
+void VoiceActivityDetector::EndHop()
+{
+    for (size_t i = 0; i < _countof(m_fState); ++i)
+    {
+        if (fabsf(m_fState[i]) < c_VadMinFilterState)
+        {
+            m_fState[i] = 0.0f;
+        }
+    }
+
+    // band levels in dB full scale; the offset keeps digital silence finite
+    float fLevelDb[c_VadBands];
+    for (int iBand = 0; iBand < c_VadBands; ++iBand)
+    {
+        fLevelDb[iBand] = PowerToDecibels(m_fHopEnergy[iBand] / c_VadHopSamples + 1e-12f);
+        m_fHopEnergy[iBand] = 0.0f;
+    }
+    m_nHopSamples = 0;
+
+    float fSpeechLevelDb = 0.0f;
+    float fSpeechToNoiseDb = 0.0f;
+    for (int iBand = 0; iBand < c_VadSpeechBands; ++iBand)
+    {
+        fSpeechLevelDb += fLevelDb[iBand];
+        fSpeechToNoiseDb += fLevelDb[iBand] - m_fNoiseFloorDb[iBand];
+    }
+    fSpeechLevelDb /= c_VadSpeechBands;
+    fSpeechToNoiseDb /= c_VadSpeechBands;
+
+    if (0 == m_stats.nHops)
+    {
+        // everything starts out as noise
+        memcpy(m_fNoiseFloorDb, fLevelDb, sizeof(m_fNoiseFloorDb));
+        for (int i = 0; i < c_VadModulationHops; ++i)
+        {
+            m_fSpeechLevelDb[i] = fSpeechLevelDb;
+        }
+        fSpeechToNoiseDb = 0.0f;
+    }
+
+    m_fSpeechLevelDb[m_iSpeechLevel] = fSpeechLevelDb;
+    m_iSpeechLevel = (m_iSpeechLevel + 1) % c_VadModulationHops;
+
+    float fMinLevelDb = fSpeechLevelDb;
+    float fMaxLevelDb = fSpeechLevelDb;
+    for (int i = 0; i < c_VadModulationHops; ++i)
+    {
+        fMinLevelDb = (std::min)(fMinLevelDb, m_fSpeechLevelDb[i]);
+        fMaxLevelDb = (std::max)(fMaxLevelDb, m_fSpeechLevelDb[i]);
+    }
+
+    float fReferenceToNoiseDb = fLevelDb[c_VadSpeechBands] - m_fNoiseFloorDb[c_VadSpeechBands];
+
+    // a loud broadband sound, like a door or a knock, rings down through the speech bands
+    // faster than through the reference band; nothing is speech-like until it died away
+    bool bBroadband = fSpeechToNoiseDb >= c_VadMinBroadbandDb && fReferenceToNoiseDb > c_VadMaxReferenceShare * fSpeechToNoiseDb;
+    m_bBroadbandTail = bBroadband || (m_bBroadbandTail && fSpeechToNoiseDb >= c_VadMinSpeechToNoiseDb);
+
+    bool bSpeechLike = !m_bBroadbandTail &&
+        fSpeechToNoiseDb >= c_VadMinSpeechToNoiseDb &&
+        fReferenceToNoiseDb <= c_VadMaxReferenceShare * fSpeechToNoiseDb &&
+        fSpeechLevelDb >= c_VadMinSpeechLevelDb &&
+        fMaxLevelDb - fMinLevelDb >= c_VadMinModulationDb;
+
+    for (int iBand = 0; iBand < c_VadBands; ++iBand)
+    {
+        float fDelta = fLevelDb[iBand] - m_fNoiseFloorDb[iBand];
+        m_fNoiseFloorDb[iBand] += fDelta * ((fDelta < 0.0f) ? c_VadFloorFallRate : c_VadFloorRiseRate);
+    }
+
+    // voice comes on after a few speech-like hops in a row, which a click or a knock
+    // does not last for, and holds on over the gaps between words
+    m_nSpeechRun = bSpeechLike ? m_nSpeechRun + 1 : 0;
+    if (m_nSpeechRun >= c_VadOnsetHops)
+    {
+        if (0 == m_nHangoverHops)
+        {
+            m_stats.nOnsets++;
+        }
+        m_nHangoverHops = c_VadHangoverHops;
+    }
+    else if (m_nHangoverHops > 0)
+    {
+        m_nHangoverHops--;
+    }
+
+    m_fSpeechToNoiseDb = fSpeechToNoiseDb;
+    m_stats.nHops++;
+    m_stats.nSpeechHops += bSpeechLike ? 1 : 0;
+    m_stats.nVoiceHops += IsVoiceActive() ? 1 : 0;
+}
@@ -0,0 +1,144 @@
+//------------------------------------------------------------------------------
+// <copyright file="VoiceActivity.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Voice activity detection on the beam audio. The beam angle confidence only says that
+// sound comes from somewhere; a fan, a door or a keyboard steer the beam as well as a
+// voice does. The detector splits the audio into three speech bands and one band above
+// speech with a bank of band-pass filters, tracks the noise floor of each band, and
+// calls a 10ms hop speech-like when the speech bands stand out of their floors, the
+// band above speech does not stand out as much, and the speech bands rose and fell by
+// syllables lately. Broadband transients then fail the second test and stationary
+// noise the first or, until its floor caught up with it, the third.
+
+#pragma once
+
+#include "KinectTypes.h"
+
+// Audio samples per detection hop, 10ms at 16kHz
+static const UINT c_VadHopSamples = 160;
+
+// Filter bands: three speech bands and a reference band above speech
+static const int c_VadBands = 4;
+static const int c_VadSpeechBands = 3;
+
+// Consecutive speech-like hops that start voice activity
+static const int c_VadOnsetHops = 3;
+
+// Hops voice activity holds on for after the last speech-like hop
+static const int c_VadHangoverHops = 30;
+
+// Hops over which the level of the speech bands has to have varied by syllables
+static const int c_VadModulationHops = 25;
+
+// Implementations of the filter bank kernel, slowest first
+enum VadKernel
+{
+    VadKernel_Scalar = 0,
+    VadKernel_Sse = 1,
+    VadKernel_Count = 2
+};
+
+/// <summary>
+/// Fastest filter bank kernel the processor supports
+/// </summary>
+VadKernel GetBestVadKernel();
+
+/// <summary>
+/// Whether the processor supports a filter bank kernel
+/// </summary>
+/// <param name="kernel">kernel to check</param>
+bool IsVadKernelSupported(VadKernel kernel);
+
+/// <summary>
+/// Short name of a filter bank kernel, for reports
+/// </summary>
+/// <param name="kernel">kernel to name</param>
+const char* GetVadKernelName(VadKernel kernel);
+
+struct VoiceActivityStats
+{
+    // Hops analyzed
+    UINT64              nHops;
+
+    // Hops found speech-like, and hops voice activity was on for
+    UINT64              nSpeechHops;
+    UINT64              nVoiceHops;
+
+    // Times voice activity came on
+    UINT64              nOnsets;
+};
+
+class VoiceActivityDetector
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    /// <param name="kernel">filter bank kernel to use; must be supported</param>
+    explicit VoiceActivityDetector(VadKernel kernel = GetBestVadKernel());
+
+    /// <summary>
+    /// Runs audio through the detector; a partial hop carries over to the next call
+    /// </summary>
+    /// <param name="pSamples">beam audio samples</param>
+    /// <param name="nSampleCount">number of samples</param>
+    /// <returns>number of hops completed</returns>
+    UINT Process(const float* pSamples, UINT nSampleCount);
+
+    /// <summary>
+    /// Whether voice is active as of the last completed hop
+    /// </summary>
+    bool IsVoiceActive() const { return m_nHangoverHops > 0; }
+
+    /// <summary>
+    /// Mean level of the speech bands above their noise floors in the last completed hop, in dB
+    /// </summary>
+    float GetSpeechToNoiseDb() const { return m_fSpeechToNoiseDb; }
+
+    /// <summary>
+    /// Snapshot of the detector counters
+    /// </summary>
+    /// <param name="pStats">receives the counters</param>
+    void GetStats(VoiceActivityStats* pStats) const { *pStats = m_stats; }
+
+    /// <summary>
+    /// Forgets the audio and the noise floors seen so far, as for a new session
+    /// </summary>
+    void Reset();
+
+private:
+    /// <summary>
+    /// Updates the noise floors and the voice state from the band energies of a whole hop
+    /// </summary>
+    void EndHop();
+
+    VadKernel           m_kernel;
+
+    // Filter bank coefficients and state, band-interleaved; see VoiceActivity.cpp for the layout
+    float               m_fCoefficients[4 * c_VadBands];
+    float               m_fState[4 * c_VadBands];
+
+    // Sum of the squared filter outputs per band over the hop so far
+    float               m_fHopEnergy[c_VadBands];
+    UINT                m_nHopSamples;
+
+    // Noise floor per band in dB, valid once a hop was completed
+    float               m_fNoiseFloorDb[c_VadBands];
+
+    // Mean level of the speech bands over the latest hops, circular, in dB
+    float               m_fSpeechLevelDb[c_VadModulationHops];
+    int                 m_iSpeechLevel;
+
+    // Whether a loud broadband sound is still dying away
+    bool                m_bBroadbandTail;
+
+    // Speech-like hops in a row, and hops left before voice activity turns off
+    int                 m_nSpeechRun;
+    int                 m_nHangoverHops;
+
+    float               m_fSpeechToNoiseDb;
+    VoiceActivityStats  m_stats;
+};